@@ -158,6 +158,8 @@ struct SubmeshGeometry
     // Bounding box of the geometry defined by this submesh. 
     // This is used in later chapters of the book.
 	DirectX::BoundingBox Bounds;
+	// Sphere around the center of Bounds that holds the geometry, often tighter.
+	DirectX::BoundingSphere Sphere;
 };
 
 struct MeshGeometry
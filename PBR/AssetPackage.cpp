@@ -0,0 +1,911 @@
+#include "AssetPackage.h"
+#include "EntropyCodec.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	const char kMagic[8] = { 'P', 'B', 'R', 'P', 'A', 'K', '0', '1' };
+	const uint32_t kVersion = 4;
+	// Version 3 had no sources in the table of contents; cooked textures of that
+	// version still read.
+	const uint32_t kOldestVersion = 3;
+	const size_t kHeaderBytes = 32;
+
+	const uint32_t kHashBits = 12;
+	const uint32_t kMinMatch = 4;
+	// The encoder leaves this many bytes as literals at the end of a block, so that
+	// its 4 byte loads never run past the input.
+	const uint32_t kTailLiterals = 8;
+
+	uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	uint32_t Load32(const uint8_t* p) {
+		uint32_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	uint32_t HashSlot(uint32_t v) {
+		return (v * 2654435761u) >> (32 - kHashBits);
+	}
+
+	void PutLength(std::vector<uint8_t>& out, size_t length) {
+		while (length >= 255) {
+			out.push_back(255);
+			length -= 255;
+		}
+		out.push_back((uint8_t)length);
+	}
+
+	void PutSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount, uint32_t offset,
+		size_t matchLength)
+	{
+		size_t matchCode = matchLength ? matchLength - kMinMatch : 0;
+		out.push_back((uint8_t)((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15)));
+		if (literalCount >= 15) {
+			PutLength(out, literalCount - 15);
+		}
+		out.insert(out.end(), literals, literals + literalCount);
+		if (matchLength) {
+			out.push_back((uint8_t)offset);
+			out.push_back((uint8_t)(offset >> 8));
+			if (matchCode >= 15) {
+				PutLength(out, matchCode - 15);
+			}
+		}
+	}
+
+	// LZ4 style byte oriented LZ77: each sequence is a token with the literal and
+	// match length in its nibbles, the literals, a 16 bit distance and the rest of
+	// the match length.  The last sequence has literals only.  Decoding is a few
+	// branches and copies per sequence, so blocks decompress at memory speed.
+	std::vector<uint8_t> CompressBlock(const uint8_t* src, size_t size) {
+		std::vector<uint8_t> out;
+		out.reserve(size + size / 255 + 16);
+		std::vector<uint32_t> table(1u << kHashBits, UINT32_MAX);
+		size_t anchor = 0;
+		size_t pos = 0;
+		size_t matchLimit = size > kTailLiterals ? size - kTailLiterals : 0;
+		while (pos + kMinMatch <= matchLimit) {
+			uint32_t v = Load32(src + pos);
+			uint32_t& slot = table[HashSlot(v)];
+			uint32_t candidate = slot;
+			slot = (uint32_t)pos;
+			if (candidate == UINT32_MAX || pos - candidate > 0xFFFF || Load32(src + candidate) != v) {
+				pos++;
+				continue;
+			}
+			size_t length = kMinMatch;
+			while (pos + length < matchLimit && src[candidate + length] == src[pos + length]) {
+				length++;
+			}
+			PutSequence(out, src + anchor, pos - anchor, (uint32_t)(pos - candidate), length);
+			pos += length;
+			anchor = pos;
+		}
+		PutSequence(out, src + anchor, size - anchor, 0, 0);
+		return out;
+	}
+
+	bool GetLength(const uint8_t*& in, const uint8_t* end, size_t& length) {
+		uint8_t b;
+		do {
+			if (in == end) {
+				return false;
+			}
+			b = *in++;
+			length += b;
+		} while (b == 255);
+		return true;
+	}
+
+	// Returns false unless src decodes to exactly size bytes without reading or
+	// writing out of bounds.
+	bool DecompressBlock(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t size) {
+		const uint8_t* in = src;
+		const uint8_t* inEnd = src + srcSize;
+		uint8_t* out = dst;
+		uint8_t* outEnd = dst + size;
+		while (in < inEnd) {
+			uint8_t token = *in++;
+			size_t literals = token >> 4;
+			if (literals == 15 && !GetLength(in, inEnd, literals)) {
+				return false;
+			}
+			if (literals > (size_t)(inEnd - in) || literals > (size_t)(outEnd - out)) {
+				return false;
+			}
+			std::memcpy(out, in, literals);
+			in += literals;
+			out += literals;
+			if (in == inEnd) {
+				break;
+			}
+
+			if (inEnd - in < 2) {
+				return false;
+			}
+			size_t offset = in[0] | ((size_t)in[1] << 8);
+			in += 2;
+			size_t length = token & 15;
+			if (length == 15 && !GetLength(in, inEnd, length)) {
+				return false;
+			}
+			length += kMinMatch;
+			if (offset == 0 || offset > (size_t)(out - dst) || length > (size_t)(outEnd - out)) {
+				return false;
+			}
+			const uint8_t* match = out - offset;
+			if (offset >= length) {
+				std::memcpy(out, match, length);
+				out += length;
+			}
+			else {
+				for (size_t i = 0; i < length; i++) {
+					*out++ = match[i];
+				}
+			}
+		}
+		return out == outEnd;
+	}
+
+	// DXGI format the entropy coder splits the blocks of an entry by, 0 for blobs.
+	uint32_t EntryFormat(const AssetEntry& entry) {
+		return entry.Kind == AssetKind::Texture ? entry.Texture.DxgiFormat : 0;
+	}
+
+	std::vector<uint8_t> CompressBlock(PackageCodec codec, const uint8_t* src, size_t size, uint32_t dxgiFormat) {
+		return codec == PackageCodec::Entropy ? EntropyCompress(src, size, dxgiFormat) : CompressBlock(src, size);
+	}
+
+	bool DecompressBlock(PackageCodec codec, const uint8_t* src, size_t srcSize, uint8_t* dst, size_t size,
+		uint32_t dxgiFormat)
+	{
+		return codec == PackageCodec::Entropy ? EntropyDecompress(src, srcSize, dst, size, dxgiFormat) :
+			DecompressBlock(src, srcSize, dst, size);
+	}
+
+	class TocWriter {
+	public:
+		void U32(uint32_t v) { Bytes(&v, sizeof(v)); }
+		void U64(uint64_t v) { Bytes(&v, sizeof(v)); }
+		void String(const std::string& s) {
+			U32((uint32_t)s.size());
+			Bytes(s.data(), s.size());
+		}
+		void Bytes(const void* data, size_t size) {
+			const uint8_t* p = static_cast<const uint8_t*>(data);
+			mData.insert(mData.end(), p, p + size);
+		}
+		const std::vector<uint8_t>& Data()const { return mData; }
+
+	private:
+		std::vector<uint8_t> mData;
+	};
+
+	class TocReader {
+	public:
+		TocReader(const uint8_t* data, size_t size) : mData(data), mSize(size) {}
+		uint32_t U32() { uint32_t v; Bytes(&v, sizeof(v)); return v; }
+		uint64_t U64() { uint64_t v; Bytes(&v, sizeof(v)); return v; }
+		std::string String() {
+			uint32_t length = U32();
+			Check(length);
+			std::string s(reinterpret_cast<const char*>(mData + mPos), length);
+			mPos += length;
+			return s;
+		}
+		void Bytes(void* dst, size_t size) {
+			Check(size);
+			std::memcpy(dst, mData + mPos, size);
+			mPos += size;
+		}
+		// Throws unless count items of itemBytes each can still be read, before a
+		// vector of count items is allocated.
+		void Check(uint64_t count, uint64_t itemBytes = 1) {
+			if (count > (mSize - mPos) / itemBytes) {
+				throw std::runtime_error("Malformed asset package table of contents");
+			}
+		}
+
+	private:
+		const uint8_t* mData;
+		size_t mSize;
+		size_t mPos = 0;
+	};
+
+	double SecondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Asks the OS to drop the file's cached pages, so that the next read goes to disk.
+	bool EvictFromCache(const std::string& path) {
+#if defined(_WIN32)
+		(void)path;
+		return false;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		::fdatasync(fd);
+		bool evicted = ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+		::close(fd);
+		return evicted;
+#endif
+	}
+
+	// Renames from to to, replacing an existing file.  std::rename does not replace
+	// on Windows; MoveFileEx does, without a moment where to is missing.
+	bool MoveOver(const std::string& from, const std::string& to) {
+#if defined(_WIN32)
+		return ::MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+	}
+}
+
+bool ReadFileStamp(const std::string& path, uint64_t& size, int64_t& modifiedTime) {
+#if defined(_WIN32)
+	struct _stat64 info;
+	if (::_stat64(path.c_str(), &info) != 0) {
+		return false;
+	}
+#else
+	struct stat info;
+	if (::stat(path.c_str(), &info) != 0) {
+		return false;
+	}
+#endif
+	size = (uint64_t)info.st_size;
+	modifiedTime = (int64_t)info.st_mtime;
+	return true;
+}
+
+const char* PackageCodecName(PackageCodec codec) {
+	switch (codec) {
+	case PackageCodec::None: return "none";
+	case PackageCodec::LZ: return "lz";
+	case PackageCodec::Entropy: return "entropy";
+	}
+	return "unknown";
+}
+
+void AssetPackageWriter::AddBlob(const std::string& name, const void* data, size_t size, uint32_t stride,
+	PackageCodec codec)
+{
+	Pending pending;
+	pending.Entry.Name = name;
+	pending.Entry.Kind = AssetKind::Blob;
+	pending.Entry.Stride = stride;
+	pending.Entry.Alignment = kPackageBlobAlignment;
+	pending.Entry.Size = size;
+	pending.Entry.Hash = HashBytes(data, size);
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	pending.Bytes.assign(bytes, bytes + size);
+	pending.Entry.Codec = codec;
+	Add(std::move(pending));
+}
+
+void AssetPackageWriter::AddTexture(const std::string& name, const CompressedTexture& texture, PackageCodec codec) {
+	Pending pending;
+	AssetEntry& entry = pending.Entry;
+	entry.Name = name;
+	entry.Kind = AssetKind::Texture;
+	entry.Alignment = kTexturePlacementAlignment;
+	entry.Texture.Width = texture.Width();
+	entry.Texture.Height = texture.Height();
+	entry.Texture.MipLevels = texture.MipLevels();
+	entry.Texture.ArraySize = texture.ArraySize();
+	entry.Texture.IsCube = texture.IsCube();
+	entry.Texture.DxgiFormat = texture.DxgiFormat();
+	entry.Texture.BlockBytes = texture.BlockBytes();
+	entry.Texture.BlockDim = texture.BlockDim();
+	entry.Footprints = ComputeTextureFootprints(texture);
+	entry.Size = entry.Footprints.TotalBytes;
+
+	pending.Bytes.resize((size_t)entry.Size);
+	CopyToFootprints(texture, entry.Footprints, pending.Bytes.data());
+	// Seeded with the description, so the same bytes as another shape or format differ.
+	uint32_t desc[6] = { texture.Width(), texture.Height(), texture.MipLevels(), texture.ArraySize(),
+		texture.DxgiFormat(), texture.IsCube() ? 1u : 0u };
+	ContentHash descHash = HashBytes(desc, sizeof(desc));
+	entry.Hash = HashBytes(pending.Bytes.data(), pending.Bytes.size(), (uint32_t)(descHash.Low ^ descHash.High));
+	entry.Codec = codec;
+	Add(std::move(pending));
+}
+
+void AssetPackageWriter::AddEntry(const std::string& name, const AssetPackage& package, const AssetEntry& entry,
+	PackageCodec codec)
+{
+	Pending pending;
+	pending.Entry.Name = name;
+	pending.Entry.Kind = entry.Kind;
+	pending.Entry.Stride = entry.Stride;
+	pending.Entry.Alignment = entry.Alignment;
+	pending.Entry.Size = entry.Size;
+	pending.Entry.Hash = entry.Hash;
+	pending.Entry.Texture = entry.Texture;
+	pending.Entry.Footprints = entry.Footprints;
+	pending.Entry.Codec = codec;
+	pending.Bytes = package.Read(entry);
+	Add(std::move(pending));
+}
+
+void AssetPackageWriter::AddSource(const std::string& path) {
+	for (const PackageSource& source : mSources) {
+		if (source.Path == path) {
+			return;
+		}
+	}
+	PackageSource source;
+	source.Path = path;
+	if (!ReadFileStamp(path, source.Size, source.ModifiedTime)) {
+		throw std::runtime_error("Cannot open " + path);
+	}
+	source.Hash = HashFile(path);
+	mSources.push_back(source);
+}
+
+void AssetPackageWriter::Add(Pending&& pending) {
+	if (!mNames.emplace(pending.Entry.Name, mPending.size()).second) {
+		throw std::runtime_error("Asset " + pending.Entry.Name + " is already in the package");
+	}
+	mPending.push_back(std::move(pending));
+}
+
+AssetPackStats AssetPackageWriter::Write(const std::string& path, TaskPool& pool)const {
+	auto start = std::chrono::steady_clock::now();
+
+	// Compressed blocks of every entry; blocks that do not shrink stay raw.
+	std::vector<std::vector<std::vector<uint8_t>>> blocks(mPending.size());
+	pool.ParallelFor((uint32_t)mPending.size(), [&](uint32_t i) {
+		const Pending& pending = mPending[i];
+		if (pending.Entry.Codec == PackageCodec::None || pending.Bytes.empty()) {
+			return;
+		}
+		uint32_t count = (uint32_t)((pending.Bytes.size() + kPackageCompressionBlock - 1) / kPackageCompressionBlock);
+		blocks[i].resize(count);
+		pool.ParallelFor(count, [&](uint32_t b) {
+			size_t begin = (size_t)b * kPackageCompressionBlock;
+			size_t size = std::min<size_t>(kPackageCompressionBlock, pending.Bytes.size() - begin);
+			std::vector<uint8_t> packed = CompressBlock(pending.Entry.Codec, pending.Bytes.data() + begin, size,
+				EntryFormat(pending.Entry));
+			if (packed.size() >= size) {
+				packed.assign(pending.Bytes.begin() + begin, pending.Bytes.begin() + begin + size);
+			}
+			blocks[i][b] = std::move(packed);
+		});
+	});
+
+	// Written beside the package and renamed over it once complete, so that a crash
+	// or a failed write never leaves a truncated package behind.
+	std::string tempPath = path + ".tmp";
+	std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		throw std::runtime_error("Cannot create " + tempPath);
+	}
+	std::vector<uint8_t> zeros(kTexturePlacementAlignment, 0);
+	uint64_t fileOffset = kHeaderBytes;
+	file.write(reinterpret_cast<const char*>(zeros.data()), kHeaderBytes);
+	auto pad = [&](uint64_t alignment) {
+		uint64_t aligned = AlignUp(fileOffset, alignment);
+		file.write(reinterpret_cast<const char*>(zeros.data()), (std::streamsize)(aligned - fileOffset));
+		fileOffset = aligned;
+	};
+
+	AssetPackStats stats;
+	std::vector<AssetEntry> entries(mPending.size());
+	// Entries already written, by content, codec and alignment.
+	std::map<std::tuple<uint64_t, uint64_t, PackageCodec, uint32_t>, size_t> written;
+	for (size_t i = 0; i < mPending.size(); i++) {
+		const Pending& pending = mPending[i];
+		AssetEntry& entry = entries[i];
+		entry = pending.Entry;
+		stats.Bytes += entry.Size;
+
+		if (blocks[i].empty()) {
+			entry.Codec = PackageCodec::None;
+		}
+		auto key = std::make_tuple(entry.Hash.Low, entry.Hash.High, entry.Codec, entry.Alignment);
+		auto found = written.find(key);
+		if (found != written.end() && entries[found->second].Size == entry.Size) {
+			const AssetEntry& original = entries[found->second];
+			entry.Offset = original.Offset;
+			entry.StoredSize = original.StoredSize;
+			entry.BlockSizes = original.BlockSizes;
+			entry.BlockOffsets = original.BlockOffsets;
+			stats.Shared++;
+			continue;
+		}
+		written.emplace(key, i);
+
+		pad(entry.Alignment);
+		entry.Offset = fileOffset;
+		if (blocks[i].empty()) {
+			file.write(reinterpret_cast<const char*>(pending.Bytes.data()), (std::streamsize)pending.Bytes.size());
+			entry.StoredSize = pending.Bytes.size();
+		}
+		else {
+			size_t rawSize = pending.Bytes.size();
+			for (size_t b = 0; b < blocks[i].size(); b++) {
+				const std::vector<uint8_t>& block = blocks[i][b];
+				size_t blockSize = std::min<size_t>(kPackageCompressionBlock, rawSize - b * kPackageCompressionBlock);
+				bool raw = block.size() == blockSize;
+				entry.BlockOffsets.push_back(entry.Offset + entry.StoredSize);
+				entry.BlockSizes.push_back((uint32_t)block.size() | (raw ? AssetEntry::kRawBlock : 0));
+				file.write(reinterpret_cast<const char*>(block.data()), (std::streamsize)block.size());
+				entry.StoredSize += block.size();
+			}
+		}
+		fileOffset += entry.StoredSize;
+	}
+
+	TocWriter toc;
+	toc.U32((uint32_t)mSources.size());
+	for (const PackageSource& source : mSources) {
+		toc.String(source.Path);
+		toc.U64(source.Size);
+		toc.U64((uint64_t)source.ModifiedTime);
+		toc.U64(source.Hash.Low);
+		toc.U64(source.Hash.High);
+	}
+	for (const AssetEntry& entry : entries) {
+		toc.String(entry.Name);
+		toc.U32((uint32_t)entry.Kind);
+		toc.U32(entry.Stride);
+		toc.U32(entry.Alignment);
+		toc.U64(entry.Offset);
+		toc.U64(entry.StoredSize);
+		toc.U64(entry.Size);
+		toc.U64(entry.Hash.Low);
+		toc.U64(entry.Hash.High);
+		toc.U32((uint32_t)entry.Codec);
+		toc.U32((uint32_t)entry.BlockSizes.size());
+		for (uint32_t size : entry.BlockSizes) {
+			toc.U32(size);
+		}
+		if (entry.Kind == AssetKind::Texture) {
+			const PackageTextureDesc& desc = entry.Texture;
+			toc.U32(desc.Width);
+			toc.U32(desc.Height);
+			toc.U32(desc.MipLevels);
+			toc.U32(desc.ArraySize);
+			toc.U32(desc.IsCube ? 1 : 0);
+			toc.U32(desc.DxgiFormat);
+			toc.U32(desc.BlockBytes);
+			toc.U32(desc.BlockDim);
+			toc.U32((uint32_t)entry.Footprints.Subresources.size());
+			toc.U64(entry.Footprints.TotalBytes);
+			for (const SubresourceFootprint& footprint : entry.Footprints.Subresources) {
+				toc.U64(footprint.Offset);
+				toc.U32(footprint.Width);
+				toc.U32(footprint.Height);
+				toc.U32(footprint.RowPitch);
+				toc.U32(footprint.NumRows);
+				toc.U32(footprint.RowBytes);
+			}
+		}
+	}
+	pad(8);
+	uint64_t tocOffset = fileOffset;
+	file.write(reinterpret_cast<const char*>(toc.Data().data()), (std::streamsize)toc.Data().size());
+	fileOffset += toc.Data().size();
+
+	TocWriter header;
+	header.Bytes(kMagic, sizeof(kMagic));
+	header.U32(kVersion);
+	header.U32((uint32_t)entries.size());
+	header.U64(tocOffset);
+	header.U64(toc.Data().size());
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(header.Data().data()), (std::streamsize)header.Data().size());
+	file.close();
+	if (!file) {
+		std::remove(tempPath.c_str());
+		throw std::runtime_error("Failed writing " + tempPath);
+	}
+	if (!MoveOver(tempPath, path)) {
+		std::remove(tempPath.c_str());
+		throw std::runtime_error("Cannot replace " + path);
+	}
+
+	stats.Entries = (uint32_t)entries.size();
+	stats.FileBytes = fileOffset;
+	stats.Seconds = SecondsSince(start);
+	return stats;
+}
+
+AssetPackage::AssetPackage(const std::string& path) {
+#if defined(_WIN32)
+	HANDLE file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Cannot open " + path);
+	}
+	mFile = file;
+	LARGE_INTEGER size;
+	if (!::GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		::CloseHandle(file);
+		throw std::runtime_error("Cannot map " + path);
+	}
+	HANDLE mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void* view = mapping ? ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!view) {
+		if (mapping) {
+			::CloseHandle(mapping);
+		}
+		::CloseHandle(file);
+		throw std::runtime_error("Cannot map " + path);
+	}
+	mMapping = mapping;
+	mSize = (uint64_t)size.QuadPart;
+	mData = static_cast<const uint8_t*>(view);
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Cannot open " + path);
+	}
+	struct stat info;
+	void* view = MAP_FAILED;
+	if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+		view = ::mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	// The mapping keeps the file alive on its own.
+	::close(fd);
+	if (view == MAP_FAILED) {
+		throw std::runtime_error("Cannot map " + path);
+	}
+	mSize = (uint64_t)info.st_size;
+	mData = static_cast<const uint8_t*>(view);
+#endif
+
+	try {
+		ReadTableOfContents();
+	}
+	catch (...) {
+		Unmap();
+		throw;
+	}
+}
+
+AssetPackage::~AssetPackage() {
+	Unmap();
+}
+
+void AssetPackage::Unmap() {
+	if (!mData) {
+		return;
+	}
+#if defined(_WIN32)
+	::UnmapViewOfFile(mData);
+	::CloseHandle(mMapping);
+	::CloseHandle(mFile);
+#else
+	::munmap(const_cast<uint8_t*>(mData), (size_t)mSize);
+#endif
+	mData = nullptr;
+}
+
+void AssetPackage::ReadTableOfContents() {
+	if (mSize < kHeaderBytes) {
+		throw std::runtime_error("Not an asset package");
+	}
+	TocReader header(mData, kHeaderBytes);
+	char magic[sizeof(kMagic)];
+	header.Bytes(magic, sizeof(magic));
+	uint32_t version = header.U32();
+	uint32_t entryCount = header.U32();
+	uint64_t tocOffset = header.U64();
+	uint64_t tocSize = header.U64();
+	if (std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 || version < kOldestVersion || version > kVersion) {
+		throw std::runtime_error("Not an asset package");
+	}
+	if (tocOffset < kHeaderBytes || tocOffset > mSize || tocSize > mSize - tocOffset) {
+		throw std::runtime_error("Malformed asset package table of contents");
+	}
+
+	TocReader toc(mData + tocOffset, (size_t)tocSize);
+	auto malformed = [](const std::string& name) {
+		return std::runtime_error("Malformed asset package entry " + name);
+	};
+	uint32_t sourceCount = version >= 4 ? toc.U32() : 0;
+	// Every source takes at least this many bytes of the table.
+	toc.Check(sourceCount, 36);
+	mSources.resize(sourceCount);
+	for (PackageSource& source : mSources) {
+		source.Path = toc.String();
+		source.Size = toc.U64();
+		source.ModifiedTime = (int64_t)toc.U64();
+		source.Hash.Low = toc.U64();
+		source.Hash.High = toc.U64();
+	}
+
+	// Every entry takes at least this many bytes of the table.
+	toc.Check(entryCount, 64);
+	mEntries.resize(entryCount);
+	for (uint32_t i = 0; i < entryCount; i++) {
+		AssetEntry& entry = mEntries[i];
+		entry.Name = toc.String();
+		uint32_t kind = toc.U32();
+		entry.Stride = toc.U32();
+		entry.Alignment = toc.U32();
+		entry.Offset = toc.U64();
+		entry.StoredSize = toc.U64();
+		entry.Size = toc.U64();
+		entry.Hash.Low = toc.U64();
+		entry.Hash.High = toc.U64();
+		uint32_t codec = toc.U32();
+		if (kind > (uint32_t)AssetKind::Texture || codec > (uint32_t)PackageCodec::Entropy ||
+			entry.Offset > tocOffset || entry.StoredSize > tocOffset - entry.Offset) {
+			throw malformed(entry.Name);
+		}
+		entry.Kind = (AssetKind)kind;
+		entry.Codec = (PackageCodec)codec;
+
+		uint32_t blockCount = toc.U32();
+		toc.Check(blockCount, sizeof(uint32_t));
+		if (blockCount != (entry.Size + kPackageCompressionBlock - 1) / kPackageCompressionBlock && blockCount != 0) {
+			throw malformed(entry.Name);
+		}
+		if ((blockCount != 0) != (entry.Codec != PackageCodec::None)) {
+			throw malformed(entry.Name);
+		}
+		uint64_t stored = 0;
+		for (uint32_t b = 0; b < blockCount; b++) {
+			uint32_t size = toc.U32();
+			entry.BlockSizes.push_back(size);
+			entry.BlockOffsets.push_back(entry.Offset + stored);
+			stored += size & ~AssetEntry::kRawBlock;
+		}
+		if (blockCount ? stored != entry.StoredSize : entry.Size != entry.StoredSize) {
+			throw malformed(entry.Name);
+		}
+
+		if (entry.Kind == AssetKind::Texture) {
+			PackageTextureDesc& desc = entry.Texture;
+			desc.Width = toc.U32();
+			desc.Height = toc.U32();
+			desc.MipLevels = toc.U32();
+			desc.ArraySize = toc.U32();
+			desc.IsCube = toc.U32() != 0;
+			desc.DxgiFormat = toc.U32();
+			desc.BlockBytes = toc.U32();
+			desc.BlockDim = toc.U32();
+			uint32_t subresourceCount = toc.U32();
+			entry.Footprints.TotalBytes = toc.U64();
+			toc.Check(subresourceCount, 28);
+			if (subresourceCount == 0 || subresourceCount != (uint64_t)desc.MipLevels * desc.ArraySize) {
+				throw malformed(entry.Name);
+			}
+			entry.Footprints.Subresources.resize(subresourceCount);
+			for (SubresourceFootprint& footprint : entry.Footprints.Subresources) {
+				footprint.Offset = toc.U64();
+				footprint.Width = toc.U32();
+				footprint.Height = toc.U32();
+				footprint.RowPitch = toc.U32();
+				footprint.NumRows = toc.U32();
+				footprint.RowBytes = toc.U32();
+			}
+			// The uploader copies rows by these footprints, so they have to be
+			// valid before anything reads through them.
+			std::string error;
+			if (entry.Footprints.TotalBytes != entry.Size ||
+				!ValidateTextureFootprints(entry.Footprints, entry.Size, error)) {
+				throw std::runtime_error("Malformed asset package entry " + entry.Name + ": " + error);
+			}
+		}
+		if (!mIndex.emplace(entry.Name, i).second) {
+			throw malformed(entry.Name);
+		}
+	}
+}
+
+std::vector<std::string> AssetPackage::StaleSources()const {
+	std::vector<std::string> stale;
+	for (const PackageSource& source : mSources) {
+		uint64_t size;
+		int64_t modifiedTime;
+		if (!ReadFileStamp(source.Path, size, modifiedTime) || size != source.Size) {
+			stale.push_back(source.Path);
+			continue;
+		}
+		if (modifiedTime == source.ModifiedTime) {
+			continue;
+		}
+		try {
+			if (!(HashFile(source.Path) == source.Hash)) {
+				stale.push_back(source.Path);
+			}
+		}
+		catch (const std::exception&) {
+			stale.push_back(source.Path);
+		}
+	}
+	return stale;
+}
+
+const AssetEntry* AssetPackage::Find(const std::string& name)const {
+	auto it = mIndex.find(name);
+	return it == mIndex.end() ? nullptr : &mEntries[it->second];
+}
+
+const uint8_t* AssetPackage::Data(const AssetEntry& entry)const {
+	return entry.Compressed() ? nullptr : mData + entry.Offset;
+}
+
+void AssetPackage::Read(const AssetEntry& entry, void* dst, TaskPool& pool)const {
+	uint8_t* out = static_cast<uint8_t*>(dst);
+	if (!entry.Compressed()) {
+		std::memcpy(out, mData + entry.Offset, (size_t)entry.Size);
+		return;
+	}
+	std::atomic<bool> corrupt(false);
+	pool.ParallelFor((uint32_t)entry.BlockSizes.size(), [&](uint32_t b) {
+		uint8_t* blockDst = out + (size_t)b * kPackageCompressionBlock;
+		size_t size = std::min<size_t>(kPackageCompressionBlock, (size_t)entry.Size - (size_t)b * kPackageCompressionBlock);
+		const uint8_t* src = mData + entry.BlockOffsets[b];
+		uint32_t stored = entry.BlockSizes[b] & ~AssetEntry::kRawBlock;
+		if (entry.BlockSizes[b] & AssetEntry::kRawBlock) {
+			if (stored != size) {
+				corrupt = true;
+				return;
+			}
+			std::memcpy(blockDst, src, size);
+		}
+		else if (!DecompressBlock(entry.Codec, src, stored, blockDst, size, EntryFormat(entry))) {
+			corrupt = true;
+		}
+	});
+	if (corrupt) {
+		throw std::runtime_error("Corrupt asset package entry " + entry.Name);
+	}
+}
+
+std::vector<uint8_t> AssetPackage::Read(const AssetEntry& entry, TaskPool& pool)const {
+	std::vector<uint8_t> bytes((size_t)entry.Size);
+	Read(entry, bytes.data(), pool);
+	return bytes;
+}
+
+AssetIOStats BenchmarkAssetIO(const std::vector<std::string>& looseFiles, const std::string& packagePath,
+	TaskPool& pool)
+{
+	AssetIOStats stats;
+	stats.Files = (uint32_t)looseFiles.size();
+	std::vector<uint8_t> buffer;
+
+	auto readLoose = [&]() {
+		auto start = std::chrono::steady_clock::now();
+		uint64_t bytes = 0;
+		for (const std::string& path : looseFiles) {
+			std::ifstream file(path, std::ios::binary | std::ios::ate);
+			if (!file) {
+				throw std::runtime_error("Cannot open " + path);
+			}
+			buffer.resize((size_t)file.tellg());
+			file.seekg(0);
+			file.read(reinterpret_cast<char*>(buffer.data()), (std::streamsize)buffer.size());
+			bytes += buffer.size();
+		}
+		stats.Bytes = bytes;
+		return SecondsSince(start);
+	};
+	// Mapping and copying every entry out, as the upload path does.
+	auto readPackage = [&]() {
+		auto start = std::chrono::steady_clock::now();
+		AssetPackage package(packagePath);
+		for (const AssetEntry& entry : package.Entries()) {
+			buffer.resize((size_t)entry.Size);
+			package.Read(entry, buffer.data(), pool);
+		}
+		return SecondsSince(start);
+	};
+
+	bool evicted = true;
+	for (const std::string& path : looseFiles) {
+		evicted &= EvictFromCache(path);
+	}
+	stats.LooseColdSeconds = readLoose();
+	stats.LooseWarmSeconds = readLoose();
+	evicted &= EvictFromCache(packagePath);
+	stats.PackageColdSeconds = readPackage();
+	stats.PackageWarmSeconds = readPackage();
+	stats.ColdValid = evicted;
+	return stats;
+}
+
+std::vector<PackageCodecStats> BenchmarkPackageCodecs(const std::vector<const AssetPackage*>& packages,
+	const std::vector<const AssetEntry*>& entries, TaskPool& pool)
+{
+	struct Chunk {
+		size_t Entry;
+		size_t Begin;
+		size_t Size;
+	};
+	std::vector<std::vector<uint8_t>> bytes;
+	std::vector<uint32_t> formats;
+	std::vector<Chunk> chunks;
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (!packages[i] || !entries[i]) {
+			continue;
+		}
+		bytes.push_back(packages[i]->Read(*entries[i], pool));
+		formats.push_back(EntryFormat(*entries[i]));
+		for (size_t begin = 0; begin < bytes.back().size(); begin += kPackageCompressionBlock) {
+			chunks.push_back({ bytes.size() - 1, begin, std::min<size_t>(kPackageCompressionBlock, bytes.back().size() - begin) });
+		}
+	}
+	std::vector<std::vector<uint8_t>> decoded(bytes.size());
+	for (size_t i = 0; i < bytes.size(); i++) {
+		decoded[i].resize(bytes[i].size());
+	}
+
+	std::vector<PackageCodecStats> results;
+	for (PackageCodec codec : { PackageCodec::None, PackageCodec::LZ, PackageCodec::Entropy }) {
+		PackageCodecStats stats;
+		stats.Codec = codec;
+		std::vector<std::vector<uint8_t>> packed(chunks.size());
+		auto start = std::chrono::steady_clock::now();
+		if (codec != PackageCodec::None) {
+			pool.ParallelFor((uint32_t)chunks.size(), [&](uint32_t c) {
+				const Chunk& chunk = chunks[c];
+				packed[c] = CompressBlock(codec, bytes[chunk.Entry].data() + chunk.Begin, chunk.Size, formats[chunk.Entry]);
+			});
+		}
+		stats.EncodeSeconds = SecondsSince(start);
+		for (size_t c = 0; c < chunks.size(); c++) {
+			stats.Bytes += chunks[c].Size;
+			// As Write stores them: blocks that do not shrink stay raw.
+			stats.StoredBytes += codec == PackageCodec::None ? chunks[c].Size : std::min(packed[c].size(), chunks[c].Size);
+		}
+
+		// The best of a few runs, as the first one also faults in the destination.
+		stats.DecodeSeconds = INFINITY;
+		for (int run = 0; run < 3; run++) {
+			std::atomic<bool> corrupt(false);
+			start = std::chrono::steady_clock::now();
+			pool.ParallelFor((uint32_t)chunks.size(), [&](uint32_t c) {
+				const Chunk& chunk = chunks[c];
+				uint8_t* dst = decoded[chunk.Entry].data() + chunk.Begin;
+				if (codec == PackageCodec::None || packed[c].size() >= chunk.Size) {
+					std::memcpy(dst, bytes[chunk.Entry].data() + chunk.Begin, chunk.Size);
+				}
+				else if (!DecompressBlock(codec, packed[c].data(), packed[c].size(), dst, chunk.Size, formats[chunk.Entry])) {
+					corrupt = true;
+				}
+			});
+			stats.DecodeSeconds = std::min(stats.DecodeSeconds, SecondsSince(start));
+			if (corrupt || decoded != bytes) {
+				throw std::runtime_error(std::string("Package codec ") + PackageCodecName(codec) + " does not round trip");
+			}
+		}
+		results.push_back(stats);
+	}
+	return results;
+}
@@ -0,0 +1,200 @@
+#pragma once
+#include "CompressedTexture.h"
+#include "ContentHash.h"
+#include "TaskPool.h"
+#include "TextureFootprints.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+const uint32_t kPackageBlobAlignment = 64;
+// Compressed entries are split into blocks of this many bytes, compressed and
+// decompressed independently.
+const uint32_t kPackageCompressionBlock = 64 * 1024;
+
+// How the blocks of an entry are compressed.
+enum class PackageCodec : uint32_t {
+	None,
+	// Byte oriented LZ that decompresses at memory speed.
+	LZ,
+	// LZ with entropy coded streams, see EntropyCodec.h.  Block compressed textures
+	// take noticeably less space, at a few hundred MB/s per thread to decode.
+	Entropy
+};
+
+const char* PackageCodecName(PackageCodec codec);
+
+enum class AssetKind : uint32_t {
+	// Plain bytes, such as vertices, indices or a whole DDS file.
+	Blob,
+	// A texture laid out as an upload buffer wants it, see AssetEntry::Footprints, so
+	// that it is copied to one with a single memcpy.
+	Texture
+};
+
+struct PackageTextureDesc {
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	uint32_t MipLevels = 0;
+	uint32_t ArraySize = 0;
+	bool IsCube = false;
+	uint32_t DxgiFormat = 0;
+	uint32_t BlockBytes = 0;
+	uint32_t BlockDim = 1;
+};
+
+struct AssetEntry {
+	std::string Name;
+	AssetKind Kind = AssetKind::Blob;
+	// Bytes per element for vertex and index blobs, 0 otherwise.
+	uint32_t Stride = 0;
+	uint32_t Alignment = 0;
+	// Position and size in the file, and the size once decompressed.
+	uint64_t Offset = 0;
+	uint64_t StoredSize = 0;
+	uint64_t Size = 0;
+	// Hash of the decompressed bytes, for ResourceRegistry style sharing.
+	ContentHash Hash;
+	PackageCodec Codec = PackageCodec::None;
+	// Stored size of each compression block, empty when the entry is stored as is.
+	// Blocks that did not shrink are stored as is and have kRawBlock set.
+	std::vector<uint32_t> BlockSizes;
+	std::vector<uint64_t> BlockOffsets;
+	PackageTextureDesc Texture;
+	// Where each subresource of a texture is in the decompressed bytes.
+	TextureFootprints Footprints;
+
+	static const uint32_t kRawBlock = 0x80000000u;
+	bool Compressed()const { return !BlockSizes.empty(); }
+};
+
+// A file the entries of a package were built from, as it was when the package was
+// written.
+struct PackageSource {
+	std::string Path;
+	uint64_t Size = 0;
+	// Last write time in seconds since the epoch.
+	int64_t ModifiedTime = 0;
+	ContentHash Hash;
+};
+
+// The size and last write time of a file.  Returns false when it does not exist.
+bool ReadFileStamp(const std::string& path, uint64_t& size, int64_t& modifiedTime);
+
+struct AssetPackStats {
+	double Seconds = 0.0;
+	uint32_t Entries = 0;
+	// Entries whose content matched an earlier one and share its bytes.
+	uint32_t Shared = 0;
+	uint64_t Bytes = 0;
+	uint64_t FileBytes = 0;
+};
+
+// Collects assets and writes them as one package: a header, the entry data, each at
+// its alignment, and a table of contents at the end.
+class AssetPackageWriter {
+public:
+	// Throws std::runtime_error when the name is taken.
+	void AddBlob(const std::string& name, const void* data, size_t size, uint32_t stride = 0,
+		PackageCodec codec = PackageCodec::None);
+	void AddTexture(const std::string& name, const CompressedTexture& texture, PackageCodec codec = PackageCodec::None);
+	// Copies an entry of another package, already in its stored layout.
+	void AddEntry(const std::string& name, const class AssetPackage& package, const AssetEntry& entry,
+		PackageCodec codec = PackageCodec::None);
+	// Records a file the entries were built from, with its size, time and hash as they
+	// are now, for AssetPackage::StaleSources.  Adding a path again does nothing.
+	// Throws std::runtime_error when the file cannot be read.
+	void AddSource(const std::string& path);
+
+	// Compresses the entries on the pool and writes the file, through path + ".tmp"
+	// that then replaces it, so a failed write leaves any previous package intact.
+	// Entries with the same content and compression are stored once.  Throws
+	// std::runtime_error when the file cannot be written.
+	AssetPackStats Write(const std::string& path, TaskPool& pool = TaskPool::Default())const;
+
+private:
+	struct Pending {
+		AssetEntry Entry;
+		std::vector<uint8_t> Bytes;
+	};
+	void Add(Pending&& pending);
+
+private:
+	std::vector<Pending> mPending;
+	std::unordered_map<std::string, size_t> mNames;
+	std::vector<PackageSource> mSources;
+};
+
+// A package mapped into memory.  Entries stored as is are read through a pointer into
+// the mapping; compressed ones are decompressed into the caller's memory.
+class AssetPackage {
+public:
+	// Maps the file and reads the table of contents.  Throws std::runtime_error when
+	// the file cannot be mapped or is not a well formed package.
+	explicit AssetPackage(const std::string& path);
+	~AssetPackage();
+	AssetPackage(const AssetPackage& rhs) = delete;
+	AssetPackage& operator=(const AssetPackage& rhs) = delete;
+
+	const std::vector<AssetEntry>& Entries()const { return mEntries; }
+	const AssetEntry* Find(const std::string& name)const;
+	uint64_t FileSize()const { return mSize; }
+	const std::vector<PackageSource>& Sources()const { return mSources; }
+
+	// The sources that are missing or whose content changed since the package was
+	// written.  A file whose size and time still match is taken as unchanged; only
+	// the others are hashed, so that touching a file does not make it stale.
+	std::vector<std::string> StaleSources()const;
+
+	// The entry's bytes inside the mapping, or nullptr when it is compressed.
+	const uint8_t* Data(const AssetEntry& entry)const;
+	// Copies entry.Size bytes to dst, decompressing the blocks in parallel.  Throws
+	// std::runtime_error when a block is corrupt.
+	void Read(const AssetEntry& entry, void* dst, TaskPool& pool = TaskPool::Default())const;
+	std::vector<uint8_t> Read(const AssetEntry& entry, TaskPool& pool = TaskPool::Default())const;
+
+private:
+	void ReadTableOfContents();
+	void Unmap();
+
+private:
+	const uint8_t* mData = nullptr;
+	uint64_t mSize = 0;
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+	std::vector<AssetEntry> mEntries;
+	std::unordered_map<std::string, size_t> mIndex;
+	std::vector<PackageSource> mSources;
+};
+
+struct AssetIOStats {
+	uint32_t Files = 0;
+	uint64_t Bytes = 0;
+	// Reading every loose file whole, and mapping the package and reading every entry.
+	// Cold runs first drop the files from the OS cache, which is only possible on
+	// POSIX systems; elsewhere ColdValid is false and cold times are first-touch times.
+	bool ColdValid = false;
+	double LooseColdSeconds = 0.0;
+	double LooseWarmSeconds = 0.0;
+	double PackageColdSeconds = 0.0;
+	double PackageWarmSeconds = 0.0;
+};
+
+AssetIOStats BenchmarkAssetIO(const std::vector<std::string>& looseFiles, const std::string& packagePath,
+	TaskPool& pool = TaskPool::Default());
+
+struct PackageCodecStats {
+	PackageCodec Codec = PackageCodec::None;
+	uint64_t Bytes = 0;
+	uint64_t StoredBytes = 0;
+	// Compressing and decompressing every block on the pool.
+	double EncodeSeconds = 0.0;
+	double DecodeSeconds = 0.0;
+};
+
+// Stores the entries with every codec, in blocks as Write does, and decompresses
+// them again, to weigh package size against load time.  Null entries are skipped.
+// Throws std::runtime_error when a codec does not return the original bytes.
+std::vector<PackageCodecStats> BenchmarkPackageCodecs(const std::vector<const AssetPackage*>& packages,
+	const std::vector<const AssetEntry*>& entries, TaskPool& pool = TaskPool::Default());
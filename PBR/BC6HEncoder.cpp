@@ -0,0 +1,759 @@
+#include "BC6HEncoder.h"
+#include "HDRPacking.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace {
+	struct ModeInfo {
+		uint32_t ModeBits;
+		uint32_t ModeValue;
+		bool Partitioned;
+		bool Transformed;
+		int EndpointBits;
+		int DeltaBits[3];
+		// Order of the endpoint bits after the mode bits, lowest block bit first.
+		// rN/gN/bN is channel of endpoint N; x[a:b] lists bits a down to b, so the
+		// lowest bit comes first when a > b and the highest one when a < b.
+		const char* Layout;
+	};
+
+	// The fourteen BC6H modes, in the order of the D3D documentation.
+	const ModeInfo kModes[14] = {
+		{ 2, 0x00, true, true, 10, { 5, 5, 5 }, "g2[4] b2[4] b3[4] r0[9:0] g0[9:0] b0[9:0] r1[4:0] g3[4] g2[3:0] g1[4:0] b3[0] g3[3:0] b1[4:0] b3[1] b2[3:0] r2[4:0] b3[2] r3[4:0] b3[3]" },
+		{ 2, 0x01, true, true, 7, { 6, 6, 6 }, "g2[5] g3[4] g3[5] r0[6:0] b3[0] b3[1] b2[4] g0[6:0] b2[5] b3[2] g2[4] b0[6:0] b3[3] b3[5] b3[4] r1[5:0] g2[3:0] g1[5:0] g3[3:0] b1[5:0] b2[3:0] r2[5:0] r3[5:0]" },
+		{ 5, 0x02, true, true, 11, { 5, 4, 4 }, "r0[9:0] g0[9:0] b0[9:0] r1[4:0] r0[10] g2[3:0] g1[3:0] g0[10] b3[0] g3[3:0] b1[3:0] b0[10] b3[1] b2[3:0] r2[4:0] b3[2] r3[4:0] b3[3]" },
+		{ 5, 0x06, true, true, 11, { 4, 5, 4 }, "r0[9:0] g0[9:0] b0[9:0] r1[3:0] r0[10] g3[4] g2[3:0] g1[4:0] g0[10] g3[3:0] b1[3:0] b0[10] b3[1] b2[3:0] r2[3:0] b3[0] b3[2] r3[3:0] g2[4] b3[3]" },
+		{ 5, 0x0a, true, true, 11, { 4, 4, 5 }, "r0[9:0] g0[9:0] b0[9:0] r1[3:0] r0[10] b2[4] g2[3:0] g1[3:0] g0[10] b3[0] g3[3:0] b1[4:0] b0[10] b2[3:0] r2[3:0] b3[1] b3[2] r3[3:0] b3[4] b3[3]" },
+		{ 5, 0x0e, true, true, 9, { 5, 5, 5 }, "r0[8:0] b2[4] g0[8:0] g2[4] b0[8:0] b3[4] r1[4:0] g3[4] g2[3:0] g1[4:0] b3[0] g3[3:0] b1[4:0] b3[1] b2[3:0] r2[4:0] b3[2] r3[4:0] b3[3]" },
+		{ 5, 0x12, true, true, 8, { 6, 5, 5 }, "r0[7:0] g3[4] b2[4] g0[7:0] b3[2] g2[4] b0[7:0] b3[3] b3[4] r1[5:0] g2[3:0] g1[4:0] b3[0] g3[3:0] b1[4:0] b3[1] b2[3:0] r2[5:0] r3[5:0]" },
+		{ 5, 0x16, true, true, 8, { 5, 6, 5 }, "r0[7:0] b3[0] b2[4] g0[7:0] g2[5] g2[4] b0[7:0] g3[5] b3[4] r1[4:0] g3[4] g2[3:0] g1[5:0] g3[3:0] b1[4:0] b3[1] b2[3:0] r2[4:0] b3[2] r3[4:0] b3[3]" },
+		{ 5, 0x1a, true, true, 8, { 5, 5, 6 }, "r0[7:0] b3[1] b2[4] g0[7:0] b2[5] g2[4] b0[7:0] b3[5] b3[4] r1[4:0] g3[4] g2[3:0] g1[4:0] b3[0] g3[3:0] b1[5:0] b2[3:0] r2[4:0] b3[2] r3[4:0] b3[3]" },
+		{ 5, 0x1e, true, false, 6, { 6, 6, 6 }, "r0[5:0] g3[4] b3[0] b3[1] b2[4] g0[5:0] g2[5] b2[5] b3[2] g2[4] b0[5:0] g3[5] b3[3] b3[5] b3[4] r1[5:0] g2[3:0] g1[5:0] g3[3:0] b1[5:0] b2[3:0] r2[5:0] r3[5:0]" },
+		{ 5, 0x03, false, false, 10, { 10, 10, 10 }, "r0[9:0] g0[9:0] b0[9:0] r1[9:0] g1[9:0] b1[9:0]" },
+		{ 5, 0x07, false, true, 11, { 9, 9, 9 }, "r0[9:0] g0[9:0] b0[9:0] r1[8:0] r0[10] g1[8:0] g0[10] b1[8:0] b0[10]" },
+		{ 5, 0x0b, false, true, 12, { 8, 8, 8 }, "r0[9:0] g0[9:0] b0[9:0] r1[7:0] r0[10:11] g1[7:0] g0[10:11] b1[7:0] b0[10:11]" },
+		{ 5, 0x0f, false, true, 16, { 4, 4, 4 }, "r0[9:0] g0[9:0] b0[9:0] r1[3:0] r0[10:15] g1[3:0] g0[10:15] b1[3:0] b0[10:15]" },
+	};
+
+	// First 32 two subset partitions of BC7, bit i set when texel i is in subset 1,
+	// and the anchor texel of subset 1.
+	const uint16_t kPartitions[32] = {
+		0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+		0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+		0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+		0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+	};
+	const uint8_t kAnchors[32] = {
+		15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+		15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+	};
+
+	const int kWeights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+	const int kWeights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Two region partitions kept for the full search in quality mode.
+	const int kPartitionCandidates = 4;
+
+	const float kMaxHalf = 65504.0f;
+	const int kMaxHalfBits = 0x7bff;
+
+	struct Field {
+		uint8_t Endpoint;
+		uint8_t Channel;
+		uint8_t Bit;
+	};
+
+	struct ModeLayouts {
+		std::vector<Field> Fields[14];
+
+		ModeLayouts() {
+			for (int mode = 0; mode < 14; mode++) {
+				const char* p = kModes[mode].Layout;
+				while (*p) {
+					while (*p == ' ') {
+						p++;
+					}
+					uint8_t channel = *p == 'r' ? 0 : (*p == 'g' ? 1 : 2);
+					uint8_t endpoint = (uint8_t)(p[1] - '0');
+					p += 3;
+					int hi = 0;
+					while (*p >= '0' && *p <= '9') {
+						hi = hi * 10 + (*p++ - '0');
+					}
+					int lo = hi;
+					if (*p == ':') {
+						lo = 0;
+						for (p++; *p >= '0' && *p <= '9'; p++) {
+							lo = lo * 10 + (*p - '0');
+						}
+					}
+					p++; // ']'
+					if (hi >= lo) {
+						for (int bit = lo; bit <= hi; bit++) {
+							Fields[mode].push_back({ endpoint, channel, (uint8_t)bit });
+						}
+					}
+					else {
+						for (int bit = lo; bit >= hi; bit--) {
+							Fields[mode].push_back({ endpoint, channel, (uint8_t)bit });
+						}
+					}
+				}
+			}
+		}
+	};
+
+	const ModeLayouts& Layouts() {
+		static const ModeLayouts layouts;
+		return layouts;
+	}
+
+	// BC6H works on the bit patterns of the halves: magnitudes as integers, with the
+	// sign applied for the signed format.
+	float HalfBitsOf(float value, bool isSigned) {
+		if (!(value == value)) {
+			value = 0.0f;
+		}
+		value = std::min(std::max(value, isSigned ? -kMaxHalf : 0.0f), kMaxHalf);
+		uint16_t half = FloatToHalf(value);
+		return (half & 0x8000) ? -(float)(half & 0x7fff) : (float)half;
+	}
+
+	float FloatOfHalfBits(int bits, bool isSigned) {
+		if (isSigned && bits < 0) {
+			return HalfToFloat((uint16_t)(0x8000 | -bits));
+		}
+		return HalfToFloat((uint16_t)bits);
+	}
+
+	int SignExtend(int value, int bits) {
+		int shift = 32 - bits;
+		return (int)((uint32_t)value << shift) >> shift;
+	}
+
+	int Unquantize(int q, int bits, bool isSigned) {
+		if (!isSigned) {
+			if (bits >= 15 || q == 0) {
+				return q;
+			}
+			if (q == (1 << bits) - 1) {
+				return 0xffff;
+			}
+			return ((q << 16) + 0x8000) >> bits;
+		}
+
+		if (bits >= 16) {
+			return q;
+		}
+		bool negative = q < 0;
+		int magnitude = negative ? -q : q;
+		int unq;
+		if (magnitude == 0) {
+			unq = 0;
+		}
+		else if (magnitude >= (1 << (bits - 1)) - 1) {
+			unq = 0x7fff;
+		}
+		else {
+			unq = ((magnitude << 15) + 0x4000) >> (bits - 1);
+		}
+		return negative ? -unq : unq;
+	}
+
+	// Scales an interpolated value to the half bit pattern the hardware returns.
+	int FinishUnquantize(int value, bool isSigned) {
+		if (!isSigned) {
+			return (value * 31) >> 6;
+		}
+		return value < 0 ? -(((-value) * 31) >> 5) : (value * 31) >> 5;
+	}
+
+	int Interpolate(int a, int b, int weight) {
+		return (a * (64 - weight) + b * weight + 32) >> 6;
+	}
+
+	bool IsAnchor(int texel, bool partitioned, int partition) {
+		return texel == 0 || (partitioned && texel == kAnchors[partition]);
+	}
+
+	int SubsetOf(int texel, bool partitioned, int partition) {
+		return partitioned ? (kPartitions[partition] >> texel) & 1 : 0;
+	}
+
+	class BitWriter {
+	public:
+		explicit BitWriter(uint8_t* block) : mBlock(block) {
+			std::memset(mBlock, 0, 16);
+		}
+		void Put(uint32_t value, int count) {
+			for (int i = 0; i < count; i++, mPosition++) {
+				if ((value >> i) & 1) {
+					mBlock[mPosition >> 3] |= (uint8_t)(1 << (mPosition & 7));
+				}
+			}
+		}
+	private:
+		uint8_t* mBlock;
+		int mPosition = 0;
+	};
+
+	class BitReader {
+	public:
+		explicit BitReader(const uint8_t* block) : mBlock(block) {}
+		uint32_t Get(int count) {
+			uint32_t value = 0;
+			for (int i = 0; i < count; i++, mPosition++) {
+				value |= (uint32_t)((mBlock[mPosition >> 3] >> (mPosition & 7)) & 1) << i;
+			}
+			return value;
+		}
+	private:
+		const uint8_t* mBlock;
+		int mPosition = 0;
+	};
+
+	struct BlockTarget {
+		float Texel[16][3];
+		bool Signed;
+	};
+
+	// One way of encoding a block: mode, partition, the values stored in the endpoint
+	// fields and the indices.
+	struct Encoding {
+		int Mode = 0;
+		int Partition = 0;
+		int Stored[4][3] = {};
+		uint8_t Indices[16] = {};
+		float Error = INFINITY;
+	};
+
+	// Endpoint quantization in the mode's precision, choosing the code whose
+	// reconstruction lands closest to target.
+	int QuantizeEndpoint(float target, int bits, bool isSigned) {
+		int lo = isSigned ? -(1 << (bits - 1)) + 1 : 0;
+		int hi = isSigned ? (1 << (bits - 1)) - 1 : (1 << bits) - 1;
+		if (bits >= (isSigned ? 16 : 15)) {
+			// Unquantization is the identity; only the final scale applies.
+			float scale = isSigned ? 32.0f / 31.0f : 64.0f / 31.0f;
+			int q = (int)std::floor(target * scale + 0.5f);
+			int best = q;
+			float bestError = INFINITY;
+			for (int c = q - 1; c <= q + 1; c++) {
+				int clamped = std::min(std::max(c, lo), hi);
+				float error = std::fabs(FinishUnquantize(clamped, isSigned) - target);
+				if (error < bestError) {
+					bestError = error;
+					best = clamped;
+				}
+			}
+			return best;
+		}
+
+		float unq = isSigned ? target * 32.0f / 31.0f : target * 64.0f / 31.0f;
+		int q = isSigned ? (int)(unq * (1 << (bits - 1)) / 32768.0f) : (int)(unq * (1 << bits) / 65536.0f);
+		int best = std::min(std::max(q, lo), hi);
+		float bestError = INFINITY;
+		for (int c = q - 1; c <= q + 1; c++) {
+			int clamped = std::min(std::max(c, lo), hi);
+			float error = std::fabs(FinishUnquantize(Unquantize(clamped, bits, isSigned), isSigned) - target);
+			if (error < bestError) {
+				bestError = error;
+				best = clamped;
+			}
+		}
+		return best;
+	}
+
+	// Quantizes the float endpoints for the mode and returns the reconstructed
+	// endpoint values (before the final scale) the decoder will see.
+	void QuantizeEndpoints(const ModeInfo& mode, const float endpoints[4][3], int endpointCount, bool isSigned,
+		int stored[4][3], int unquantized[4][3])
+	{
+		int bits = mode.EndpointBits;
+		for (int c = 0; c < 3; c++) {
+			int q[4];
+			for (int e = 0; e < endpointCount; e++) {
+				q[e] = QuantizeEndpoint(endpoints[e][c], bits, isSigned);
+			}
+
+			if (mode.Transformed) {
+				int deltaBits = mode.DeltaBits[c];
+				int lo = -(1 << (deltaBits - 1));
+				int hi = (1 << (deltaBits - 1)) - 1;
+				stored[0][c] = q[0] & ((1 << bits) - 1);
+				for (int e = 1; e < endpointCount; e++) {
+					int delta = std::min(std::max(q[e] - q[0], lo), hi);
+					q[e] = q[0] + delta;
+					stored[e][c] = delta & ((1 << deltaBits) - 1);
+				}
+			}
+			else {
+				for (int e = 0; e < endpointCount; e++) {
+					stored[e][c] = q[e] & ((1 << bits) - 1);
+				}
+			}
+
+			for (int e = 0; e < endpointCount; e++) {
+				unquantized[e][c] = Unquantize(q[e], bits, isSigned);
+			}
+		}
+	}
+
+	// Picks indices for fixed endpoints and returns the squared error.  Anchor texels
+	// are limited to the lower half of the palette, since their top bit is implicit.
+	float AssignIndices(const BlockTarget& target, const ModeInfo& mode, int partition, const int unquantized[4][3],
+		uint8_t indices[16])
+	{
+		int subsets = mode.Partitioned ? 2 : 1;
+		int count = mode.Partitioned ? 8 : 16;
+		const int* weights = mode.Partitioned ? kWeights3 : kWeights4;
+
+		float palette[2][16][3];
+		for (int s = 0; s < subsets; s++) {
+			for (int k = 0; k < count; k++) {
+				for (int c = 0; c < 3; c++) {
+					int value = Interpolate(unquantized[2 * s][c], unquantized[2 * s + 1][c], weights[k]);
+					palette[s][k][c] = (float)FinishUnquantize(value, target.Signed);
+				}
+			}
+		}
+
+		// The palette lies on a line, so projecting onto it gives the nearest entry up
+		// to rounding; only that entry and its neighbours are compared.
+		float axis[2][3];
+		float invLengthSq[2];
+		for (int s = 0; s < subsets; s++) {
+			float lengthSq = 0.0f;
+			for (int c = 0; c < 3; c++) {
+				axis[s][c] = palette[s][count - 1][c] - palette[s][0][c];
+				lengthSq += axis[s][c] * axis[s][c];
+			}
+			invLengthSq[s] = lengthSq > 0.0f ? (count - 1) / lengthSq : 0.0f;
+		}
+
+		float total = 0.0f;
+		for (int t = 0; t < 16; t++) {
+			int s = SubsetOf(t, mode.Partitioned, partition);
+			int limit = IsAnchor(t, mode.Partitioned, partition) ? count / 2 : count;
+
+			float along = 0.0f;
+			for (int c = 0; c < 3; c++) {
+				along += (target.Texel[t][c] - palette[s][0][c]) * axis[s][c];
+			}
+			int guess = (int)std::floor(along * invLengthSq[s] + 0.5f);
+			int first = std::min(std::max(guess - 1, 0), limit - 1);
+			int last = std::min(std::max(guess + 1, 0), limit - 1);
+
+			float bestError = INFINITY;
+			int best = first;
+			for (int k = first; k <= last; k++) {
+				float error = 0.0f;
+				for (int c = 0; c < 3; c++) {
+					float d = palette[s][k][c] - target.Texel[t][c];
+					error += d * d;
+				}
+				if (error < bestError) {
+					bestError = error;
+					best = k;
+				}
+			}
+			indices[t] = (uint8_t)best;
+			total += bestError;
+		}
+		return total;
+	}
+
+	// Principal axis fit of the texels of one subset.
+	void FitLine(const BlockTarget& target, bool partitioned, int partition, int subset, float a[3], float b[3],
+		float* residual)
+	{
+		float mean[3] = { 0.0f, 0.0f, 0.0f };
+		int n = 0;
+		for (int t = 0; t < 16; t++) {
+			if (SubsetOf(t, partitioned, partition) == subset) {
+				for (int c = 0; c < 3; c++) {
+					mean[c] += target.Texel[t][c];
+				}
+				n++;
+			}
+		}
+		for (int c = 0; c < 3; c++) {
+			mean[c] /= std::max(n, 1);
+		}
+
+		float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int t = 0; t < 16; t++) {
+			if (SubsetOf(t, partitioned, partition) == subset) {
+				float d[3] = { target.Texel[t][0] - mean[0], target.Texel[t][1] - mean[1], target.Texel[t][2] - mean[2] };
+				cov[0] += d[0] * d[0];
+				cov[1] += d[0] * d[1];
+				cov[2] += d[0] * d[2];
+				cov[3] += d[1] * d[1];
+				cov[4] += d[1] * d[2];
+				cov[5] += d[2] * d[2];
+			}
+		}
+
+		float axis[3] = { 1.0f, 1.0f, 1.0f };
+		float lambda = 0.0f;
+		for (int iteration = 0; iteration < 8; iteration++) {
+			float next[3] = {
+				cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+				cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+				cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2],
+			};
+			float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+			if (length < 1e-12f) {
+				break;
+			}
+			lambda = length;
+			for (int c = 0; c < 3; c++) {
+				axis[c] = next[c] / length;
+			}
+		}
+		float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+		for (int c = 0; c < 3; c++) {
+			axis[c] /= axisLength;
+		}
+		if (residual) {
+			*residual = std::max(cov[0] + cov[3] + cov[5] - lambda, 0.0f);
+		}
+
+		float tMin = 0.0f, tMax = 0.0f;
+		for (int t = 0; t < 16; t++) {
+			if (SubsetOf(t, partitioned, partition) == subset) {
+				float p = 0.0f;
+				for (int c = 0; c < 3; c++) {
+					p += (target.Texel[t][c] - mean[c]) * axis[c];
+				}
+				tMin = std::min(tMin, p);
+				tMax = std::max(tMax, p);
+			}
+		}
+		for (int c = 0; c < 3; c++) {
+			a[c] = mean[c] + axis[c] * tMin;
+			b[c] = mean[c] + axis[c] * tMax;
+		}
+	}
+
+	// Least squares endpoints for fixed indices.
+	void RefineEndpoints(const BlockTarget& target, const ModeInfo& mode, int partition, const uint8_t indices[16],
+		float endpoints[4][3])
+	{
+		const int* weights = mode.Partitioned ? kWeights3 : kWeights4;
+		int subsets = mode.Partitioned ? 2 : 1;
+		for (int s = 0; s < subsets; s++) {
+			float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+			float ax[3] = { 0.0f, 0.0f, 0.0f };
+			float bx[3] = { 0.0f, 0.0f, 0.0f };
+			for (int t = 0; t < 16; t++) {
+				if (SubsetOf(t, mode.Partitioned, partition) != s) {
+					continue;
+				}
+				float w = weights[indices[t]] / 64.0f;
+				float wa = 1.0f - w;
+				aa += wa * wa;
+				ab += wa * w;
+				bb += w * w;
+				for (int c = 0; c < 3; c++) {
+					ax[c] += wa * target.Texel[t][c];
+					bx[c] += w * target.Texel[t][c];
+				}
+			}
+			float det = aa * bb - ab * ab;
+			if (std::fabs(det) < 1e-6f) {
+				continue;
+			}
+			for (int c = 0; c < 3; c++) {
+				endpoints[2 * s][c] = (ax[c] * bb - bx[c] * ab) / det;
+				endpoints[2 * s + 1][c] = (bx[c] * aa - ax[c] * ab) / det;
+			}
+		}
+	}
+
+	void ClampEndpoints(float endpoints[4][3], bool isSigned) {
+		float lo = isSigned ? -(float)kMaxHalfBits : 0.0f;
+		for (int e = 0; e < 4; e++) {
+			for (int c = 0; c < 3; c++) {
+				endpoints[e][c] = std::min(std::max(endpoints[e][c], lo), (float)kMaxHalfBits);
+			}
+		}
+	}
+
+	// Orders each subset's endpoints so that its anchor texel is nearer the first one.
+	void OrientEndpoints(const BlockTarget& target, const ModeInfo& mode, int partition, float endpoints[4][3]) {
+		int subsets = mode.Partitioned ? 2 : 1;
+		for (int s = 0; s < subsets; s++) {
+			int anchor = s == 0 ? 0 : kAnchors[partition];
+			float* a = endpoints[2 * s];
+			float* b = endpoints[2 * s + 1];
+			float along = 0.0f, length = 0.0f;
+			for (int c = 0; c < 3; c++) {
+				along += (target.Texel[anchor][c] - a[c]) * (b[c] - a[c]);
+				length += (b[c] - a[c]) * (b[c] - a[c]);
+			}
+			if (along > 0.5f * length) {
+				for (int c = 0; c < 3; c++) {
+					std::swap(a[c], b[c]);
+				}
+			}
+		}
+	}
+
+	// Single region mode with the most endpoint precision whose deltas still fit.
+	int PickSingleRegionMode(const float endpoints[4][3], bool isSigned) {
+		for (int modeIndex = 13; modeIndex > 10; modeIndex--) {
+			const ModeInfo& mode = kModes[modeIndex];
+			bool fits = true;
+			for (int c = 0; c < 3 && fits; c++) {
+				int delta = QuantizeEndpoint(endpoints[1][c], mode.EndpointBits, isSigned) -
+					QuantizeEndpoint(endpoints[0][c], mode.EndpointBits, isSigned);
+				fits = delta >= -(1 << (mode.DeltaBits[c] - 1)) && delta < (1 << (mode.DeltaBits[c] - 1));
+			}
+			if (fits) {
+				return modeIndex;
+			}
+		}
+		return 10;
+	}
+
+	// Encodes with one mode and partition starting from the line fit in initial,
+	// keeping the result in best if it beats it.
+	void TryMode(const BlockTarget& target, int modeIndex, int partition, const float initial[4][3], int refinements,
+		Encoding& best)
+	{
+		const ModeInfo& mode = kModes[modeIndex];
+		int endpointCount = mode.Partitioned ? 4 : 2;
+
+		float endpoints[4][3];
+		std::memcpy(endpoints, initial, sizeof(endpoints));
+
+		for (int pass = 0; pass <= refinements; pass++) {
+			ClampEndpoints(endpoints, target.Signed);
+			OrientEndpoints(target, mode, partition, endpoints);
+
+			Encoding candidate;
+			int unquantized[4][3] = {};
+			QuantizeEndpoints(mode, endpoints, endpointCount, target.Signed, candidate.Stored, unquantized);
+			candidate.Error = AssignIndices(target, mode, partition, unquantized, candidate.Indices);
+			candidate.Mode = modeIndex;
+			candidate.Partition = partition;
+			if (candidate.Error < best.Error) {
+				best = candidate;
+			}
+			if (candidate.Error == 0.0f) {
+				break;
+			}
+			if (pass < refinements) {
+				RefineEndpoints(target, mode, partition, candidate.Indices, endpoints);
+			}
+		}
+	}
+
+	void WriteBlock(const Encoding& encoding, uint8_t block[16]) {
+		const ModeInfo& mode = kModes[encoding.Mode];
+		BitWriter writer(block);
+		writer.Put(mode.ModeValue, mode.ModeBits);
+		for (const Field& field : Layouts().Fields[encoding.Mode]) {
+			writer.Put((uint32_t)(encoding.Stored[field.Endpoint][field.Channel] >> field.Bit) & 1, 1);
+		}
+
+		int indexBits = 4;
+		if (mode.Partitioned) {
+			writer.Put((uint32_t)encoding.Partition, 5);
+			indexBits = 3;
+		}
+		for (int t = 0; t < 16; t++) {
+			int bits = IsAnchor(t, mode.Partitioned, encoding.Partition) ? indexBits - 1 : indexBits;
+			writer.Put(encoding.Indices[t], bits);
+		}
+	}
+
+	void GatherBlock(const float* rgba, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, float texels[16][4]) {
+		for (uint32_t y = 0; y < 4; y++) {
+			uint32_t sy = std::min(by * 4 + y, height - 1);
+			for (uint32_t x = 0; x < 4; x++) {
+				uint32_t sx = std::min(bx * 4 + x, width - 1);
+				std::memcpy(texels[y * 4 + x], rgba + ((size_t)sy * width + sx) * 4, 4 * sizeof(float));
+			}
+		}
+	}
+}
+
+void EncodeBC6HBlock(const float texels[16][4], BC6HFormat format, BC6HQuality quality, uint8_t block[16]) {
+	BlockTarget target;
+	target.Signed = format == BC6HFormat::Signed;
+	for (int t = 0; t < 16; t++) {
+		for (int c = 0; c < 3; c++) {
+			target.Texel[t][c] = HalfBitsOf(texels[t][c], target.Signed);
+		}
+	}
+
+	float endpoints[4][3] = {};
+	FitLine(target, false, 0, 0, endpoints[0], endpoints[1], nullptr);
+
+	Encoding best;
+	if (quality == BC6HQuality::Fast) {
+		TryMode(target, PickSingleRegionMode(endpoints, target.Signed), 0, endpoints, 1, best);
+		WriteBlock(best, block);
+		return;
+	}
+
+	for (int mode = 10; mode < 14 && best.Error > 0.0f; mode++) {
+		TryMode(target, mode, 0, endpoints, 2, best);
+	}
+	if (best.Error > 0.0f) {
+		// Rank the partitions by how well two lines fit them, then search the
+		// two region modes on the best few.
+		std::pair<float, int> ranked[32];
+		float fits[32][4][3];
+		for (int p = 0; p < 32; p++) {
+			float r0, r1;
+			FitLine(target, true, p, 0, fits[p][0], fits[p][1], &r0);
+			FitLine(target, true, p, 1, fits[p][2], fits[p][3], &r1);
+			ranked[p] = std::make_pair(r0 + r1, p);
+		}
+		std::partial_sort(ranked, ranked + kPartitionCandidates, ranked + 32);
+
+		// Screen every mode on those without refinement, then refine the winner.
+		Encoding twoRegion;
+		for (int i = 0; i < kPartitionCandidates; i++) {
+			int p = ranked[i].second;
+			for (int mode = 0; mode < 10; mode++) {
+				TryMode(target, mode, p, fits[p], 0, twoRegion);
+			}
+		}
+		TryMode(target, twoRegion.Mode, twoRegion.Partition, fits[twoRegion.Partition], 2, twoRegion);
+		if (twoRegion.Error < best.Error) {
+			best = twoRegion;
+		}
+	}
+
+	WriteBlock(best, block);
+}
+
+void DecodeBC6HBlock(const uint8_t block[16], BC6HFormat format, float texels[16][4]) {
+	bool isSigned = format == BC6HFormat::Signed;
+	BitReader reader(block);
+
+	uint32_t modeValue = reader.Get(2);
+	if (modeValue & 2) {
+		modeValue |= reader.Get(3) << 2;
+	}
+	int modeIndex = -1;
+	for (int m = 0; m < 14; m++) {
+		if (kModes[m].ModeValue == modeValue && (kModes[m].ModeBits == 2) == (modeValue < 2)) {
+			modeIndex = m;
+		}
+	}
+	if (modeIndex < 0) {
+		for (int t = 0; t < 16; t++) {
+			texels[t][0] = texels[t][1] = texels[t][2] = 0.0f;
+			texels[t][3] = 1.0f;
+		}
+		return;
+	}
+
+	const ModeInfo& mode = kModes[modeIndex];
+	int stored[4][3] = {};
+	for (const Field& field : Layouts().Fields[modeIndex]) {
+		stored[field.Endpoint][field.Channel] |= (int)reader.Get(1) << field.Bit;
+	}
+
+	int partition = mode.Partitioned ? (int)reader.Get(5) : 0;
+	int endpointCount = mode.Partitioned ? 4 : 2;
+	int indexBits = mode.Partitioned ? 3 : 4;
+	int bits = mode.EndpointBits;
+
+	int unquantized[4][3];
+	for (int c = 0; c < 3; c++) {
+		int q[4];
+		q[0] = isSigned ? SignExtend(stored[0][c], bits) : stored[0][c];
+		for (int e = 1; e < endpointCount; e++) {
+			if (mode.Transformed) {
+				q[e] = (q[0] + SignExtend(stored[e][c], mode.DeltaBits[c])) & ((1 << bits) - 1);
+			}
+			else {
+				q[e] = stored[e][c];
+			}
+			if (isSigned) {
+				q[e] = SignExtend(q[e], bits);
+			}
+		}
+		for (int e = 0; e < endpointCount; e++) {
+			unquantized[e][c] = Unquantize(q[e], bits, isSigned);
+		}
+	}
+
+	const int* weights = mode.Partitioned ? kWeights3 : kWeights4;
+	for (int t = 0; t < 16; t++) {
+		int index = (int)reader.Get(IsAnchor(t, mode.Partitioned, partition) ? indexBits - 1 : indexBits);
+		int s = SubsetOf(t, mode.Partitioned, partition);
+		for (int c = 0; c < 3; c++) {
+			int value = Interpolate(unquantized[2 * s][c], unquantized[2 * s + 1][c], weights[index]);
+			texels[t][c] = FloatOfHalfBits(FinishUnquantize(value, isSigned), isSigned);
+		}
+		texels[t][3] = 1.0f;
+	}
+}
+
+void EncodeBC6HSurface(const float* rgba, uint32_t width, uint32_t height, BC6HFormat format, BC6HQuality quality,
+	uint8_t* blocks, TaskPool& pool)
+{
+	uint32_t blocksWide = (width + 3) / 4;
+	uint32_t blocksHigh = (height + 3) / 4;
+	pool.ParallelFor(blocksHigh, [&](uint32_t by) {
+		for (uint32_t bx = 0; bx < blocksWide; bx++) {
+			float texels[16][4];
+			GatherBlock(rgba, width, height, bx, by, texels);
+			EncodeBC6HBlock(texels, format, quality, blocks + ((size_t)by * blocksWide + bx) * 16);
+		}
+	});
+}
+
+BC6HStats EncodeCubeMapBC6H(const CubeMapImage& image, BC6HFormat format, BC6HQuality quality,
+	CompressedTexture& out, TaskPool& pool)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	out = CompressedTexture(image.Size(), image.Size(), image.MipLevels(), 6, true,
+		format == BC6HFormat::Signed ? kDxgiFormatBC6HSF16 : kDxgiFormatBC6HUF16, 16);
+
+	// One job per row of blocks over every face and mip, so the small mips do not
+	// leave threads idle at the end.
+	struct Row {
+		uint32_t Face;
+		uint32_t Mip;
+		uint32_t BlockRow;
+	};
+	std::vector<Row> rows;
+	double texels = 0.0;
+	for (uint32_t face = 0; face < 6; face++) {
+		for (uint32_t mip = 0; mip < image.MipLevels(); mip++) {
+			for (uint32_t by = 0; by < out.BlocksHigh(mip); by++) {
+				rows.push_back({ face, mip, by });
+			}
+			texels += (double)image.MipSize(mip) * image.MipSize(mip);
+		}
+	}
+
+	pool.ParallelFor((uint32_t)rows.size(), [&](uint32_t job) {
+		const Row& row = rows[job];
+		uint32_t size = image.MipSize(row.Mip);
+		uint8_t* blocks = out.Blocks(row.Face, row.Mip) + row.BlockRow * out.RowPitch(row.Mip);
+		for (uint32_t bx = 0; bx < out.BlocksWide(row.Mip); bx++) {
+			float block[16][4];
+			GatherBlock(image.Texels(row.Face, row.Mip), size, size, bx, row.BlockRow, block);
+			EncodeBC6HBlock(block, format, quality, blocks + bx * 16);
+		}
+	});
+
+	BC6HStats stats;
+	stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stats.MPixelsPerSecond = stats.Seconds > 0.0 ? texels / (stats.Seconds * 1e6) : 0.0;
+	return stats;
+}
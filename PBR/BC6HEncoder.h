@@ -0,0 +1,38 @@
+#pragma once
+#include "CompressedTexture.h"
+#include "CubeMapImage.h"
+#include "TaskPool.h"
+
+enum class BC6HFormat {
+	// BC6H_UF16: non-negative half floats.
+	Unsigned,
+	// BC6H_SF16: signed half floats.
+	Signed
+};
+
+enum class BC6HQuality {
+	// The single region mode with the most precision that fits, one endpoint refinement.
+	Fast,
+	// Every mode, two region ones on the partitions that fit best; two refinements.
+	Quality
+};
+
+// Encodes a 4x4 block of RGBA float texels (alpha is ignored) into 16 bytes.
+void EncodeBC6HBlock(const float texels[16][4], BC6HFormat format, BC6HQuality quality, uint8_t block[16]);
+// Decodes a block back to RGBA floats with alpha 1.  Reserved modes decode to zero.
+void DecodeBC6HBlock(const uint8_t block[16], BC6HFormat format, float texels[16][4]);
+
+// Encodes a width x height RGBA32F surface, rows of blocks spread over the pool.
+// Edge blocks of sizes that are not multiples of four repeat the last row/column.
+void EncodeBC6HSurface(const float* rgba, uint32_t width, uint32_t height, BC6HFormat format, BC6HQuality quality,
+	uint8_t* blocks, TaskPool& pool = TaskPool::Default());
+
+struct BC6HStats {
+	double Seconds = 0.0;
+	// Texels encoded per second over all faces and mips, in millions.
+	double MPixelsPerSecond = 0.0;
+};
+
+// Encodes every face and mip of image into a BC6H cube ready for WriteDDS.
+BC6HStats EncodeCubeMapBC6H(const CubeMapImage& image, BC6HFormat format, BC6HQuality quality,
+	CompressedTexture& out, TaskPool& pool = TaskPool::Default());
@@ -0,0 +1,1356 @@
+#include "BCEncoder.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+	const int kWeights2[4] = { 0, 21, 43, 64 };
+	const int kWeights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+	const int kWeights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Two subset partitions of BC7: bit t set puts texel t in subset 1.  The first 32
+	// are the BC6H ones.
+	const uint16_t kPartitions[64] = {
+		0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+		0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+		0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+		0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+		0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+		0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+		0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+		0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+	};
+	// Anchor texel of subset 1; subset 0 is anchored at texel 0.
+	const uint8_t kAnchors[64] = {
+		15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+		15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+		15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+		6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15,
+	};
+
+	struct BC7Mode {
+		int Subsets;
+		int PartitionBits;
+		int RotationBits;
+		int ColorBits;
+		// 0 when the mode has no alpha, which then decodes as 255.
+		int AlphaBits;
+		// 0 none, 1 one per subset, 2 one per endpoint.
+		int PBits;
+		int IndexBits;
+		// Bits of the separate alpha indices of modes 4 and 5, 0 when alpha shares the color indices.
+		int AlphaIndexBits;
+	};
+
+	const BC7Mode kBC7Modes[8] = {
+		{ 3, 4, 0, 4, 0, 2, 3, 0 },
+		{ 2, 6, 0, 6, 0, 1, 3, 0 },
+		{ 3, 6, 0, 5, 0, 0, 2, 0 },
+		{ 2, 6, 0, 7, 0, 2, 2, 0 },
+		{ 1, 0, 2, 5, 6, 0, 2, 3 },
+		{ 1, 0, 2, 7, 8, 0, 2, 2 },
+		{ 1, 0, 0, 7, 7, 2, 4, 0 },
+		{ 2, 6, 0, 5, 5, 2, 2, 0 },
+	};
+
+	// Partitions the quality preset fully encodes per two subset mode.
+	const int kPartitionCandidates = 4;
+	// Squared error over a block below which the quality preset keeps mode 6: one
+	// level per channel and texel on average.
+	const float kMode6GoodEnough = 64.0f;
+	// Least squares passes after the first fit of a line.
+	const int kFastRefinements = 1;
+	const int kQualityRefinements = 2;
+
+	const int* WeightsFor(int indexBits) {
+		return indexBits == 2 ? kWeights2 : indexBits == 3 ? kWeights3 : kWeights4;
+	}
+
+	int Interpolate(int a, int b, int weight) {
+		return (a * (64 - weight) + b * weight + 32) >> 6;
+	}
+
+	// Widens a code to 8 bits by repeating its top bits.
+	int Expand(int code, int bits) {
+		return bits >= 8 ? code : (code << (8 - bits)) | (code >> (2 * bits - 8));
+	}
+
+	int Unquantize(int code, int bits, int pbit) {
+		return pbit >= 0 ? Expand((code << 1) | pbit, bits + 1) : Expand(code, bits);
+	}
+
+	// Codes whose expansion lands closest to each 8 bit value, per code width and
+	// p-bit (none, 0 or 1).
+	struct QuantizeTable {
+		uint8_t Codes[9][3][256];
+		QuantizeTable() {
+			for (int bits = 1; bits <= 8; bits++) {
+				for (int pbit = -1; pbit <= 1; pbit++) {
+					for (int v = 0; v < 256; v++) {
+						int bestError = 256;
+						for (int code = 0; code < (1 << bits) && (pbit < 0 || bits < 8); code++) {
+							int error = std::abs(Unquantize(code, bits, pbit) - v);
+							if (error < bestError) {
+								bestError = error;
+								Codes[bits][pbit + 1][v] = (uint8_t)code;
+							}
+						}
+					}
+				}
+			}
+		}
+	};
+
+	// Code of `bits` bits whose expansion, with the p-bit appended when pbit >= 0,
+	// lands closest to target.
+	int Quantize(float target, int bits, int pbit) {
+		static const QuantizeTable table;
+		int value = (int)(std::min(std::max(target, 0.0f), 255.0f) + 0.5f);
+		return table.Codes[bits][pbit + 1][value];
+	}
+
+	// Texels of one subset in channel planes, padded to a multiple of four with
+	// copies of the first texel; the padding is left out of every sum.
+	struct TexelSet {
+		alignas(16) float C[4][16];
+		uint8_t Texel[16];
+		int Count = 0;
+	};
+
+	void GatherSet(const uint8_t texels[16][4], uint32_t mask, TexelSet& set) {
+		set.Count = 0;
+		for (int t = 0; t < 16; t++) {
+			if ((mask >> t) & 1) {
+				for (int c = 0; c < 4; c++) {
+					set.C[c][set.Count] = texels[t][c];
+				}
+				set.Texel[set.Count++] = (uint8_t)t;
+			}
+		}
+		for (int i = set.Count; i < ((set.Count + 3) & ~3); i++) {
+			for (int c = 0; c < 4; c++) {
+				set.C[c][i] = set.C[c][0];
+			}
+		}
+	}
+
+	__m128 Select(__m128 mask, __m128 a, __m128 b) {
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	// Picks the nearest palette entry over channels [First, First + Count) for four
+	// texels at a time and returns the squared error of the set.
+	template <int First, int Count>
+	float FitIndices(const TexelSet& set, const float palette[16][4], int levels, uint8_t indices[16]) {
+		float error = 0.0f;
+		for (int g = 0; g < set.Count; g += 4) {
+			__m128 best = _mm_set1_ps(INFINITY);
+			__m128 bestIndex = _mm_setzero_ps();
+			for (int i = 0; i < levels; i++) {
+				__m128 distance = _mm_setzero_ps();
+				for (int c = First; c < First + Count; c++) {
+					__m128 diff = _mm_sub_ps(_mm_load_ps(&set.C[c][g]), _mm_set1_ps(palette[i][c]));
+					distance = _mm_add_ps(distance, _mm_mul_ps(diff, diff));
+				}
+				__m128 closer = _mm_cmplt_ps(distance, best);
+				best = _mm_min_ps(distance, best);
+				bestIndex = Select(closer, _mm_set1_ps((float)i), bestIndex);
+			}
+			alignas(16) float errors[4];
+			alignas(16) float chosen[4];
+			_mm_store_ps(errors, best);
+			_mm_store_ps(chosen, bestIndex);
+			for (int k = 0; k < 4 && g + k < set.Count; k++) {
+				error += errors[k];
+				indices[g + k] = (uint8_t)chosen[k];
+			}
+		}
+		return error;
+	}
+
+	// Mean and scatter matrix of the set over channels [first, first + count).
+	void Moments(const TexelSet& set, int first, int count, float mean[4], float scatter[4][4]) {
+		for (int a = 0; a < count; a++) {
+			mean[a] = 0.0f;
+			for (int i = 0; i < set.Count; i++) {
+				mean[a] += set.C[first + a][i];
+			}
+			mean[a] /= set.Count;
+		}
+		for (int a = 0; a < count; a++) {
+			for (int b = a; b < count; b++) {
+				float sum = 0.0f;
+				for (int i = 0; i < set.Count; i++) {
+					sum += (set.C[first + a][i] - mean[a]) * (set.C[first + b][i] - mean[b]);
+				}
+				scatter[a][b] = scatter[b][a] = sum;
+			}
+		}
+	}
+
+	// Unit principal axis of a scatter matrix by power iteration, started from the
+	// column of the channel that varies most.  Returns false when the texels do not
+	// spread.
+	bool PrincipalAxis(const float scatter[4][4], int count, float axis[4]) {
+		int widest = 0;
+		for (int a = 1; a < count; a++) {
+			if (scatter[a][a] > scatter[widest][widest]) {
+				widest = a;
+			}
+		}
+		for (int a = 0; a < count; a++) {
+			axis[a] = scatter[a][widest];
+		}
+		for (int iteration = 0; iteration < 6; iteration++) {
+			float next[4] = {};
+			float largest = 0.0f;
+			for (int a = 0; a < count; a++) {
+				for (int b = 0; b < count; b++) {
+					next[a] += scatter[a][b] * axis[b];
+				}
+				largest = std::max(largest, std::fabs(next[a]));
+			}
+			if (largest < 1e-6f) {
+				return false;
+			}
+			float scale = 1.0f / largest;
+			for (int a = 0; a < count; a++) {
+				axis[a] = next[a] * scale;
+			}
+		}
+		float length = 0.0f;
+		for (int a = 0; a < count; a++) {
+			length += axis[a] * axis[a];
+		}
+		length = std::sqrt(length);
+		for (int a = 0; a < count; a++) {
+			axis[a] /= length;
+		}
+		return true;
+	}
+
+	// Endpoints on the principal axis through the mean, at the extreme projections
+	// of the texels.  Only channels [first, first + count) are written.
+	void FitLine(const TexelSet& set, int first, int count, float e0[4], float e1[4]) {
+		float mean[4];
+		float scatter[4][4];
+		float axis[4];
+		Moments(set, first, count, mean, scatter);
+		if (!PrincipalAxis(scatter, count, axis)) {
+			for (int a = 0; a < count; a++) {
+				e0[first + a] = e1[first + a] = mean[a];
+			}
+			return;
+		}
+		float low = INFINITY;
+		float high = -INFINITY;
+		for (int i = 0; i < set.Count; i++) {
+			float t = 0.0f;
+			for (int a = 0; a < count; a++) {
+				t += (set.C[first + a][i] - mean[a]) * axis[a];
+			}
+			low = std::min(low, t);
+			high = std::max(high, t);
+		}
+		for (int a = 0; a < count; a++) {
+			e0[first + a] = std::min(std::max(mean[a] + low * axis[a], 0.0f), 255.0f);
+			e1[first + a] = std::min(std::max(mean[a] + high * axis[a], 0.0f), 255.0f);
+		}
+	}
+
+	// Least squares endpoints for fixed indices, weights being the palette positions
+	// in [0, 1].  Returns false when the indices do not pin down two endpoints.
+	bool RefineLine(const TexelSet& set, const uint8_t indices[16], const float* weights, int first, int count,
+		float e0[4], float e1[4])
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[4] = {};
+		float bx[4] = {};
+		for (int i = 0; i < set.Count; i++) {
+			float b = weights[indices[i]];
+			float a = 1.0f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < count; c++) {
+				ax[c] += a * set.C[first + c][i];
+				bx[c] += b * set.C[first + c][i];
+			}
+		}
+		float det = aa * bb - ab * ab;
+		if (std::fabs(det) < 1e-6f) {
+			return false;
+		}
+		for (int c = 0; c < count; c++) {
+			e0[first + c] = std::min(std::max((bb * ax[c] - ab * bx[c]) / det, 0.0f), 255.0f);
+			e1[first + c] = std::min(std::max((aa * bx[c] - ab * ax[c]) / det, 0.0f), 255.0f);
+		}
+		return true;
+	}
+
+	// BC1
+
+	// 5:6:5 codes of endpoint pairs whose 1/3 point lands closest to each 8 bit
+	// value, for solid color blocks.
+	struct SingleColorTable {
+		uint8_t Codes[2][256][2];
+		SingleColorTable() {
+			const int bits[2] = { 5, 6 };
+			for (int table = 0; table < 2; table++) {
+				int top = (1 << bits[table]) - 1;
+				for (int v = 0; v < 256; v++) {
+					int bestError = 256 * 256;
+					for (int a = 0; a <= top; a++) {
+						for (int b = 0; b <= top; b++) {
+							int ea = Expand(a, bits[table]);
+							int eb = Expand(b, bits[table]);
+							int error = std::abs((2 * ea + eb) / 3 - v) * 256 + std::abs(ea - eb);
+							if (error < bestError) {
+								bestError = error;
+								Codes[table][v][0] = (uint8_t)a;
+								Codes[table][v][1] = (uint8_t)b;
+							}
+						}
+					}
+				}
+			}
+		}
+	};
+
+	const int kBC1Bits[3] = { 5, 6, 5 };
+
+	// Palette in line order: endpoint 0, its 2/3 and 1/3 blends, endpoint 1.
+	void BC1Palette(const int codes[2][3], float palette[16][4]) {
+		for (int c = 0; c < 3; c++) {
+			int e0 = Expand(codes[0][c], kBC1Bits[c]);
+			int e1 = Expand(codes[1][c], kBC1Bits[c]);
+			palette[0][c] = (float)e0;
+			palette[1][c] = (float)((2 * e0 + e1) / 3);
+			palette[2][c] = (float)((e0 + 2 * e1) / 3);
+			palette[3][c] = (float)e1;
+		}
+	}
+
+	float BC1Fit(const TexelSet& set, const int codes[2][3], uint8_t indices[16]) {
+		float palette[16][4];
+		BC1Palette(codes, palette);
+		return FitIndices<0, 3>(set, palette, 4, indices);
+	}
+
+	void BC1Quantize(const float e0[4], const float e1[4], int codes[2][3]) {
+		for (int c = 0; c < 3; c++) {
+			codes[0][c] = Quantize(e0[c], kBC1Bits[c], -1);
+			codes[1][c] = Quantize(e1[c], kBC1Bits[c], -1);
+		}
+	}
+
+	// Writes the block in four color mode, which needs the first endpoint to be the
+	// larger 5:6:5 value; equal endpoints fall back to index 0 of three color mode.
+	void WriteBC1(const int codes[2][3], const uint8_t lineIndices[16], uint8_t block[8]) {
+		static const uint8_t kLineToCode[4] = { 0, 2, 3, 1 };
+		int c0 = (codes[0][0] << 11) | (codes[0][1] << 5) | codes[0][2];
+		int c1 = (codes[1][0] << 11) | (codes[1][1] << 5) | codes[1][2];
+		bool swapped = c0 < c1;
+		if (swapped) {
+			std::swap(c0, c1);
+		}
+		uint32_t bits = 0;
+		if (c0 != c1) {
+			for (int t = 0; t < 16; t++) {
+				int line = swapped ? 3 - lineIndices[t] : lineIndices[t];
+				bits |= (uint32_t)kLineToCode[line] << (2 * t);
+			}
+		}
+		block[0] = (uint8_t)c0;
+		block[1] = (uint8_t)(c0 >> 8);
+		block[2] = (uint8_t)c1;
+		block[3] = (uint8_t)(c1 >> 8);
+		for (int i = 0; i < 4; i++) {
+			block[4 + i] = (uint8_t)(bits >> (8 * i));
+		}
+	}
+
+	void DecodeBC1(const uint8_t block[8], uint8_t texels[16][4]) {
+		int c0 = block[0] | (block[1] << 8);
+		int c1 = block[2] | (block[3] << 8);
+		int e[2][3] = {
+			{ Expand(c0 >> 11, 5), Expand((c0 >> 5) & 63, 6), Expand(c0 & 31, 5) },
+			{ Expand(c1 >> 11, 5), Expand((c1 >> 5) & 63, 6), Expand(c1 & 31, 5) },
+		};
+		uint8_t palette[4][4];
+		for (int c = 0; c < 3; c++) {
+			palette[0][c] = (uint8_t)e[0][c];
+			palette[1][c] = (uint8_t)e[1][c];
+			if (c0 > c1) {
+				palette[2][c] = (uint8_t)((2 * e[0][c] + e[1][c]) / 3);
+				palette[3][c] = (uint8_t)((e[0][c] + 2 * e[1][c]) / 3);
+			}
+			else {
+				palette[2][c] = (uint8_t)((e[0][c] + e[1][c]) / 2);
+				palette[3][c] = 0;
+			}
+		}
+		palette[0][3] = palette[1][3] = palette[2][3] = 255;
+		palette[3][3] = c0 > c1 ? 255 : 0;
+		uint32_t bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+		for (int t = 0; t < 16; t++) {
+			std::memcpy(texels[t], palette[(bits >> (2 * t)) & 3], 4);
+		}
+	}
+
+	// BC4
+
+	// Palette in code order: the endpoints, then six blends when r0 > r1, or four
+	// blends, 0 and 255 otherwise.  Blends round to nearest like the D3D float decode.
+	void BC4Palette(int r0, int r1, float palette[16][4]) {
+		palette[0][0] = (float)r0;
+		palette[1][0] = (float)r1;
+		if (r0 > r1) {
+			for (int k = 2; k < 8; k++) {
+				palette[k][0] = (float)(((8 - k) * r0 + (k - 1) * r1 + 3) / 7);
+			}
+		}
+		else {
+			for (int k = 2; k < 6; k++) {
+				palette[k][0] = (float)(((6 - k) * r0 + (k - 1) * r1 + 2) / 5);
+			}
+			palette[6][0] = 0.0f;
+			palette[7][0] = 255.0f;
+		}
+	}
+
+	float BC4Fit(const TexelSet& set, int r0, int r1, uint8_t indices[16]) {
+		float palette[16][4];
+		BC4Palette(r0, r1, palette);
+		return FitIndices<0, 1>(set, palette, 8, indices);
+	}
+
+	// Tries every endpoint pair within `radius` of (r0, r1) that keeps the order of
+	// the mode the pair selects.
+	void SearchBC4(const TexelSet& set, int r0, int r1, int radius, int& best0, int& best1, float& bestError,
+		uint8_t bestIndices[16])
+	{
+		bool sixValues = r0 <= r1;
+		for (int a = std::max(r0 - radius, 0); a <= std::min(r0 + radius, 255); a++) {
+			for (int b = std::max(r1 - radius, 0); b <= std::min(r1 + radius, 255); b++) {
+				if ((a <= b) != sixValues) {
+					continue;
+				}
+				uint8_t indices[16];
+				float error = BC4Fit(set, a, b, indices);
+				if (error < bestError) {
+					bestError = error;
+					best0 = a;
+					best1 = b;
+					std::memcpy(bestIndices, indices, 16);
+				}
+			}
+		}
+	}
+
+	void DecodeBC4(const uint8_t block[8], uint8_t values[16]) {
+		float palette[16][4];
+		BC4Palette(block[0], block[1], palette);
+		uint64_t bits = 0;
+		for (int i = 0; i < 6; i++) {
+			bits |= (uint64_t)block[2 + i] << (8 * i);
+		}
+		for (int t = 0; t < 16; t++) {
+			values[t] = (uint8_t)palette[(bits >> (3 * t)) & 7][0];
+		}
+	}
+
+	// BC7
+
+	class BitWriter {
+	public:
+		explicit BitWriter(uint8_t* block) : mBlock(block) {
+			std::memset(mBlock, 0, 16);
+		}
+		void Put(uint32_t value, int count) {
+			for (int i = 0; i < count; i++, mPosition++) {
+				if ((value >> i) & 1) {
+					mBlock[mPosition >> 3] |= (uint8_t)(1 << (mPosition & 7));
+				}
+			}
+		}
+	private:
+		uint8_t* mBlock;
+		int mPosition = 0;
+	};
+
+	class BitReader {
+	public:
+		explicit BitReader(const uint8_t* block) : mBlock(block) {}
+		uint32_t Get(int count) {
+			uint32_t value = 0;
+			for (int i = 0; i < count; i++, mPosition++) {
+				value |= (uint32_t)((mBlock[mPosition >> 3] >> (mPosition & 7)) & 1) << i;
+			}
+			return value;
+		}
+	private:
+		const uint8_t* mBlock;
+		int mPosition = 0;
+	};
+
+	// One way of encoding a block: mode, partition, the codes of the endpoints
+	// (subset, endpoint, RGBA) with their p-bits, and the indices of every texel.
+	struct BC7Encoding {
+		int Mode = 6;
+		int Partition = 0;
+		int Codes[2][2][4] = {};
+		int PBits[2][2] = {};
+		uint8_t Indices[16] = {};
+		uint8_t AlphaIndices[16] = {};
+		float Error = INFINITY;
+	};
+
+	int SubsetOf(const BC7Mode& mode, int partition, int texel) {
+		return mode.Subsets == 2 ? (kPartitions[partition] >> texel) & 1 : 0;
+	}
+
+	bool IsAnchor(const BC7Mode& mode, int partition, int texel) {
+		return texel == 0 || (mode.Subsets == 2 && texel == kAnchors[partition]);
+	}
+
+	int RefinementsFor(BCQuality quality) {
+		return quality == BCQuality::Fast ? kFastRefinements : kQualityRefinements;
+	}
+
+	// Fits a subset of a mode whose channels share one set of indices: RGBA for
+	// modes with alpha, RGB otherwise.  The fitted line and each least squares
+	// refinement of it are quantized with every p-bit choice of the mode.  Only the
+	// choice that moves the endpoints least is fitted, except on the last pass of
+	// the quality preset, which fits them all.
+	float EncodeSubset(const TexelSet& set, const BC7Mode& mode, BCQuality quality, int codes[2][4], int pbits[2],
+		uint8_t indices[16])
+	{
+		int refinements = RefinementsFor(quality);
+		int channels = mode.AlphaBits ? 4 : 3;
+		int levels = 1 << mode.IndexBits;
+		const int* weights = WeightsFor(mode.IndexBits);
+		float lineWeights[16];
+		for (int i = 0; i < levels; i++) {
+			lineWeights[i] = weights[i] / 64.0f;
+		}
+		int combinations = mode.PBits == 2 ? 4 : mode.PBits == 1 ? 2 : 1;
+
+		float e0[4], e1[4];
+		FitLine(set, 0, channels, e0, e1);
+		float bestError = INFINITY;
+		for (int pass = 0; ; pass++) {
+			struct Candidate {
+				int Codes[2][4];
+				int PBits[2];
+				int Ends[2][4];
+				float Shift;
+			};
+			Candidate candidates[4] = {};
+			for (int combination = 0; combination < combinations; combination++) {
+				Candidate& candidate = candidates[combination];
+				int p[2] = { -1, -1 };
+				if (mode.PBits == 2) {
+					p[0] = combination & 1;
+					p[1] = combination >> 1;
+				}
+				else if (mode.PBits == 1) {
+					p[0] = p[1] = combination;
+				}
+				candidate.Shift = 0.0f;
+				for (int c = 0; c < channels; c++) {
+					int bits = c < 3 ? mode.ColorBits : mode.AlphaBits;
+					for (int e = 0; e < 2; e++) {
+						float target = e ? e1[c] : e0[c];
+						candidate.Codes[e][c] = Quantize(target, bits, p[e]);
+						candidate.Ends[e][c] = Unquantize(candidate.Codes[e][c], bits, p[e]);
+						candidate.Shift += (candidate.Ends[e][c] - target) * (candidate.Ends[e][c] - target);
+					}
+				}
+				candidate.PBits[0] = std::max(p[0], 0);
+				candidate.PBits[1] = std::max(p[1], 0);
+			}
+			int first = 0;
+			int last = combinations;
+			if (quality == BCQuality::Fast || pass < refinements) {
+				for (int combination = 1; combination < combinations; combination++) {
+					if (candidates[combination].Shift < candidates[first].Shift) {
+						first = combination;
+					}
+				}
+				last = first + 1;
+			}
+
+			for (int combination = first; combination < last; combination++) {
+				const Candidate& candidate = candidates[combination];
+				float palette[16][4];
+				for (int i = 0; i < levels; i++) {
+					for (int c = 0; c < channels; c++) {
+						palette[i][c] = (float)Interpolate(candidate.Ends[0][c], candidate.Ends[1][c], weights[i]);
+					}
+				}
+				uint8_t fitted[16];
+				float error = channels == 4 ? FitIndices<0, 4>(set, palette, levels, fitted) :
+					FitIndices<0, 3>(set, palette, levels, fitted);
+				if (error < bestError) {
+					bestError = error;
+					std::memcpy(codes, candidate.Codes, sizeof(candidate.Codes));
+					pbits[0] = candidate.PBits[0];
+					pbits[1] = candidate.PBits[1];
+					std::memcpy(indices, fitted, 16);
+				}
+			}
+			if (pass == refinements || bestError == 0.0f ||
+				!RefineLine(set, indices, lineWeights, 0, channels, e0, e1)) {
+				break;
+			}
+		}
+		return bestError;
+	}
+
+	void TryMode6(const uint8_t texels[16][4], BCQuality quality, BC7Encoding& best) {
+		TexelSet set;
+		GatherSet(texels, 0xffff, set);
+		BC7Encoding encoding;
+		encoding.Mode = 6;
+		encoding.Error = EncodeSubset(set, kBC7Modes[6], quality, encoding.Codes[0], encoding.PBits[0],
+			encoding.Indices);
+		if (encoding.Error < best.Error) {
+			best = encoding;
+		}
+	}
+
+	// Mode 5: a 7 bit RGB line and an 8 bit alpha line, each with its own 2 bit indices.
+	void TryMode5(const uint8_t texels[16][4], BCQuality quality, BC7Encoding& best) {
+		TexelSet set;
+		GatherSet(texels, 0xffff, set);
+		BC7Encoding encoding;
+		encoding.Mode = 5;
+		BC7Mode color = kBC7Modes[5];
+		color.AlphaBits = 0;
+		encoding.Error = EncodeSubset(set, color, quality, encoding.Codes[0], encoding.PBits[0],
+			encoding.Indices);
+		int refinements = RefinementsFor(quality);
+
+		float a0[4], a1[4];
+		FitLine(set, 3, 1, a0, a1);
+		float alphaError = INFINITY;
+		const float lineWeights[4] = { 0.0f, 21 / 64.0f, 43 / 64.0f, 1.0f };
+		for (int pass = 0; ; pass++) {
+			int q0 = Quantize(a0[3], 8, -1);
+			int q1 = Quantize(a1[3], 8, -1);
+			float palette[16][4];
+			for (int i = 0; i < 4; i++) {
+				palette[i][3] = (float)Interpolate(q0, q1, kWeights2[i]);
+			}
+			uint8_t candidate[16];
+			float error = FitIndices<3, 1>(set, palette, 4, candidate);
+			if (error < alphaError) {
+				alphaError = error;
+				encoding.Codes[0][0][3] = q0;
+				encoding.Codes[0][1][3] = q1;
+				std::memcpy(encoding.AlphaIndices, candidate, 16);
+			}
+			if (pass == refinements || alphaError == 0.0f ||
+				!RefineLine(set, encoding.AlphaIndices, lineWeights, 3, 1, a0, a1)) {
+				break;
+			}
+		}
+		encoding.Error += alphaError;
+		if (encoding.Error < best.Error) {
+			best = encoding;
+		}
+	}
+
+	// Modes 1 and 3 on one partition; gives up once the first subset alone is worse
+	// than the best encoding.
+	void TryPartitioned(const uint8_t texels[16][4], int mode, int partition, BCQuality quality, BC7Encoding& best) {
+		BC7Encoding encoding;
+		encoding.Mode = mode;
+		encoding.Partition = partition;
+		encoding.Error = 0.0f;
+		for (int subset = 0; subset < 2 && encoding.Error < best.Error; subset++) {
+			uint32_t mask = subset ? kPartitions[partition] : ~kPartitions[partition] & 0xffffu;
+			TexelSet set;
+			GatherSet(texels, mask, set);
+			uint8_t indices[16];
+			encoding.Error += EncodeSubset(set, kBC7Modes[mode], quality, encoding.Codes[subset],
+				encoding.PBits[subset], indices);
+			for (int i = 0; i < set.Count; i++) {
+				encoding.Indices[set.Texel[i]] = indices[i];
+			}
+		}
+		if (encoding.Error < best.Error) {
+			best = encoding;
+		}
+	}
+
+	// Sums of RGB and of the products of RGB pairs over some texels of a block.
+	struct ColorMoments {
+		int Count = 0;
+		int Sum[3] = {};
+		int Products[3][3] = {};
+
+		void Add(const ColorMoments& other) {
+			Count += other.Count;
+			for (int a = 0; a < 3; a++) {
+				Sum[a] += other.Sum[a];
+				for (int b = a; b < 3; b++) {
+					Products[a][b] += other.Products[a][b];
+				}
+			}
+		}
+
+		void Subtract(const ColorMoments& other) {
+			Count -= other.Count;
+			for (int a = 0; a < 3; a++) {
+				Sum[a] -= other.Sum[a];
+				for (int b = a; b < 3; b++) {
+					Products[a][b] -= other.Products[a][b];
+				}
+			}
+		}
+	};
+
+	void ScatterOf(const ColorMoments& moments, float scatter[4][4]) {
+		for (int a = 0; a < 3; a++) {
+			for (int b = a; b < 3; b++) {
+				scatter[a][b] = scatter[b][a] =
+					moments.Products[a][b] - (float)moments.Sum[a] * moments.Sum[b] / moments.Count;
+			}
+		}
+	}
+
+	// Error of fitting the texels with an exact RGB line: the scatter off its
+	// principal axis, estimated with two power iterations from start.
+	float LineResidual(const ColorMoments& moments, const float start[4]) {
+		if (moments.Count == 0) {
+			return 0.0f;
+		}
+		float scatter[4][4];
+		ScatterOf(moments, scatter);
+		float axis[3] = { start[0], start[1], start[2] };
+		float along = 0.0f;
+		for (int iteration = 0; iteration < 2; iteration++) {
+			float next[3];
+			for (int a = 0; a < 3; a++) {
+				next[a] = scatter[a][0] * axis[0] + scatter[a][1] * axis[1] + scatter[a][2] * axis[2];
+			}
+			float length = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+			along = length > 0.0f ? (axis[0] * next[0] + axis[1] * next[1] + axis[2] * next[2]) / length : 0.0f;
+			std::memcpy(axis, next, sizeof(axis));
+		}
+		return std::max(scatter[0][0] + scatter[1][1] + scatter[2][2] - along, 0.0f);
+	}
+
+	// Orders the two subset partitions by the residual of their subsets, best first.
+	// The power iterations start from the axis of the whole block, and the moments
+	// of subset 0 are those of the block less subset 1.
+	void RankPartitions(const uint8_t texels[16][4], std::pair<float, int> ranked[64]) {
+		ColorMoments single[16];
+		ColorMoments whole;
+		for (int t = 0; t < 16; t++) {
+			single[t].Count = 1;
+			for (int a = 0; a < 3; a++) {
+				single[t].Sum[a] = texels[t][a];
+				for (int b = a; b < 3; b++) {
+					single[t].Products[a][b] = texels[t][a] * texels[t][b];
+				}
+			}
+			whole.Add(single[t]);
+		}
+		float scatter[4][4];
+		float axis[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+		ScatterOf(whole, scatter);
+		PrincipalAxis(scatter, 3, axis);
+
+		for (int partition = 0; partition < 64; partition++) {
+			ColorMoments one;
+			for (uint32_t t = 0, mask = kPartitions[partition]; mask; t++, mask >>= 1) {
+				if (mask & 1) {
+					one.Add(single[t]);
+				}
+			}
+			ColorMoments zero = whole;
+			zero.Subtract(one);
+			ranked[partition].first = LineResidual(zero, axis) + LineResidual(one, axis);
+			ranked[partition].second = partition;
+		}
+		std::partial_sort(ranked, ranked + kPartitionCandidates, ranked + 64);
+	}
+
+	void WriteBC7(const BC7Encoding& source, uint8_t block[16]) {
+		BC7Encoding encoding = source;
+		const BC7Mode& mode = kBC7Modes[encoding.Mode];
+
+		// The top index bit of every anchor texel is implied zero: swap the endpoints
+		// of subsets whose anchor is in the upper half and mirror their indices.
+		int levels = 1 << mode.IndexBits;
+		int sharedChannels = mode.AlphaIndexBits ? 3 : 4;
+		for (int subset = 0; subset < mode.Subsets; subset++) {
+			int anchor = subset == 0 ? 0 : kAnchors[encoding.Partition];
+			if (encoding.Indices[anchor] < levels / 2) {
+				continue;
+			}
+			for (int c = 0; c < sharedChannels; c++) {
+				std::swap(encoding.Codes[subset][0][c], encoding.Codes[subset][1][c]);
+			}
+			std::swap(encoding.PBits[subset][0], encoding.PBits[subset][1]);
+			for (int t = 0; t < 16; t++) {
+				if (SubsetOf(mode, encoding.Partition, t) == subset) {
+					encoding.Indices[t] = (uint8_t)(levels - 1 - encoding.Indices[t]);
+				}
+			}
+		}
+		if (mode.AlphaIndexBits) {
+			int alphaLevels = 1 << mode.AlphaIndexBits;
+			if (encoding.AlphaIndices[0] >= alphaLevels / 2) {
+				std::swap(encoding.Codes[0][0][3], encoding.Codes[0][1][3]);
+				for (int t = 0; t < 16; t++) {
+					encoding.AlphaIndices[t] = (uint8_t)(alphaLevels - 1 - encoding.AlphaIndices[t]);
+				}
+			}
+		}
+
+		BitWriter writer(block);
+		writer.Put(1u << encoding.Mode, encoding.Mode + 1);
+		writer.Put(encoding.Partition, mode.PartitionBits);
+		writer.Put(0, mode.RotationBits);
+		for (int c = 0; c < 3; c++) {
+			for (int subset = 0; subset < mode.Subsets; subset++) {
+				writer.Put(encoding.Codes[subset][0][c], mode.ColorBits);
+				writer.Put(encoding.Codes[subset][1][c], mode.ColorBits);
+			}
+		}
+		if (mode.AlphaBits) {
+			for (int subset = 0; subset < mode.Subsets; subset++) {
+				writer.Put(encoding.Codes[subset][0][3], mode.AlphaBits);
+				writer.Put(encoding.Codes[subset][1][3], mode.AlphaBits);
+			}
+		}
+		for (int subset = 0; subset < mode.Subsets; subset++) {
+			if (mode.PBits == 2) {
+				writer.Put(encoding.PBits[subset][0], 1);
+				writer.Put(encoding.PBits[subset][1], 1);
+			}
+			else if (mode.PBits == 1) {
+				writer.Put(encoding.PBits[subset][0], 1);
+			}
+		}
+		for (int t = 0; t < 16; t++) {
+			writer.Put(encoding.Indices[t], mode.IndexBits - (IsAnchor(mode, encoding.Partition, t) ? 1 : 0));
+		}
+		if (mode.AlphaIndexBits) {
+			for (int t = 0; t < 16; t++) {
+				writer.Put(encoding.AlphaIndices[t], mode.AlphaIndexBits - (t == 0 ? 1 : 0));
+			}
+		}
+	}
+
+	void DecodeBC7(const uint8_t block[16], uint8_t texels[16][4]) {
+		int modeIndex = 0;
+		while (modeIndex < 8 && !((block[0] >> modeIndex) & 1)) {
+			modeIndex++;
+		}
+		if (modeIndex == 8 || kBC7Modes[modeIndex].Subsets == 3) {
+			std::memset(texels, 0, 64);
+			return;
+		}
+		const BC7Mode& mode = kBC7Modes[modeIndex];
+		BitReader reader(block);
+		reader.Get(modeIndex + 1);
+		int partition = reader.Get(mode.PartitionBits);
+		int rotation = reader.Get(mode.RotationBits);
+		int indexSelection = modeIndex == 4 ? reader.Get(1) : 0;
+
+		int codes[2][2][4] = {};
+		for (int c = 0; c < 3; c++) {
+			for (int subset = 0; subset < mode.Subsets; subset++) {
+				codes[subset][0][c] = reader.Get(mode.ColorBits);
+				codes[subset][1][c] = reader.Get(mode.ColorBits);
+			}
+		}
+		if (mode.AlphaBits) {
+			for (int subset = 0; subset < mode.Subsets; subset++) {
+				codes[subset][0][3] = reader.Get(mode.AlphaBits);
+				codes[subset][1][3] = reader.Get(mode.AlphaBits);
+			}
+		}
+		int pbits[2][2] = { { -1, -1 }, { -1, -1 } };
+		for (int subset = 0; subset < mode.Subsets; subset++) {
+			if (mode.PBits == 2) {
+				pbits[subset][0] = reader.Get(1);
+				pbits[subset][1] = reader.Get(1);
+			}
+			else if (mode.PBits == 1) {
+				pbits[subset][0] = pbits[subset][1] = reader.Get(1);
+			}
+		}
+		int ends[2][2][4];
+		for (int subset = 0; subset < mode.Subsets; subset++) {
+			for (int e = 0; e < 2; e++) {
+				for (int c = 0; c < 3; c++) {
+					ends[subset][e][c] = Unquantize(codes[subset][e][c], mode.ColorBits, pbits[subset][e]);
+				}
+				ends[subset][e][3] = mode.AlphaBits ?
+					Unquantize(codes[subset][e][3], mode.AlphaBits, pbits[subset][e]) : 255;
+			}
+		}
+
+		uint8_t indices[16];
+		uint8_t alphaIndices[16];
+		for (int t = 0; t < 16; t++) {
+			indices[t] = (uint8_t)reader.Get(mode.IndexBits - (IsAnchor(mode, partition, t) ? 1 : 0));
+		}
+		for (int t = 0; t < 16 && mode.AlphaIndexBits; t++) {
+			alphaIndices[t] = (uint8_t)reader.Get(mode.AlphaIndexBits - (t == 0 ? 1 : 0));
+		}
+
+		for (int t = 0; t < 16; t++) {
+			int subset = SubsetOf(mode, partition, t);
+			int colorWeight = WeightsFor(mode.IndexBits)[indices[t]];
+			int alphaWeight = colorWeight;
+			if (mode.AlphaIndexBits) {
+				alphaWeight = WeightsFor(mode.AlphaIndexBits)[alphaIndices[t]];
+				if (indexSelection) {
+					std::swap(colorWeight, alphaWeight);
+				}
+			}
+			for (int c = 0; c < 4; c++) {
+				texels[t][c] = (uint8_t)Interpolate(ends[subset][0][c], ends[subset][1][c],
+					c < 3 ? colorWeight : alphaWeight);
+			}
+			if (rotation) {
+				std::swap(texels[t][3], texels[t][rotation - 1]);
+			}
+		}
+	}
+
+	void GatherBlock(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t bx, uint32_t by,
+		uint8_t texels[16][4])
+	{
+		for (uint32_t y = 0; y < 4; y++) {
+			uint32_t sy = std::min(by * 4 + y, height - 1);
+			for (uint32_t x = 0; x < 4; x++) {
+				uint32_t sx = std::min(bx * 4 + x, width - 1);
+				std::memcpy(texels[y * 4 + x], rgba + ((size_t)sy * width + sx) * 4, 4);
+			}
+		}
+	}
+
+	void EncodeBlock(const uint8_t texels[16][4], BCFormat format, BCQuality quality, uint8_t* block) {
+		switch (format) {
+		case BCFormat::BC1: EncodeBC1Block(texels, quality, block); break;
+		case BCFormat::BC4: EncodeBC4Block(texels, 0, quality, block); break;
+		case BCFormat::BC5: EncodeBC5Block(texels, quality, block); break;
+		case BCFormat::BC7: EncodeBC7Block(texels, quality, block); break;
+		}
+	}
+
+	// Channels a format keeps, the ones its error is measured over.
+	int KeptChannels(BCFormat format) {
+		return format == BCFormat::BC4 ? 1 : format == BCFormat::BC5 ? 2 : format == BCFormat::BC1 ? 3 : 4;
+	}
+
+	uint32_t BlockError(const uint8_t* block, BCFormat format, const uint8_t source[16][4]) {
+		uint8_t decoded[16][4];
+		DecodeBCBlock(block, format, decoded);
+		int channels = KeptChannels(format);
+		uint32_t error = 0;
+		for (int t = 0; t < 16; t++) {
+			for (int c = 0; c < channels; c++) {
+				int diff = (int)source[t][c] - decoded[t][c];
+				error += (uint32_t)(diff * diff);
+			}
+		}
+		return error;
+	}
+
+	// Byte ranges of a block that hold only indices: BC1 and BC4 end with them and BC5
+	// is two BC4 blocks.  BC7 packs them after mode dependent fields, so it has none.
+	uint32_t IndexRanges(BCFormat format, uint32_t ranges[2][2]) {
+		switch (format) {
+		case BCFormat::BC1: ranges[0][0] = 4; ranges[0][1] = 8; return 1;
+		case BCFormat::BC4: ranges[0][0] = 2; ranges[0][1] = 8; return 1;
+		case BCFormat::BC5:
+			ranges[0][0] = 2; ranges[0][1] = 8;
+			ranges[1][0] = 10; ranges[1][1] = 16;
+			return 2;
+		case BCFormat::BC7: return 0;
+		}
+		return 0;
+	}
+}
+
+void EncodeBC1Block(const uint8_t texels[16][4], BCQuality quality, uint8_t block[8]) {
+	TexelSet set;
+	GatherSet(texels, 0xffff, set);
+	int codes[2][3];
+	uint8_t indices[16];
+
+	bool solid = true;
+	for (int t = 1; t < 16 && solid; t++) {
+		solid = std::memcmp(texels[t], texels[0], 3) == 0;
+	}
+	if (solid) {
+		static const SingleColorTable table;
+		for (int c = 0; c < 3; c++) {
+			const uint8_t* pair = table.Codes[c == 1][texels[0][c]];
+			codes[0][c] = pair[0];
+			codes[1][c] = pair[1];
+		}
+		std::memset(indices, 1, 16);
+		WriteBC1(codes, indices, block);
+		return;
+	}
+
+	float e0[4], e1[4];
+	FitLine(set, 0, 3, e0, e1);
+	BC1Quantize(e0, e1, codes);
+	float error = BC1Fit(set, codes, indices);
+
+	const float lineWeights[4] = { 0.0f, 1.0f / 3.0f, 2.0f / 3.0f, 1.0f };
+	int refinements = RefinementsFor(quality);
+	for (int pass = 0; pass < refinements && error > 0.0f; pass++) {
+		if (!RefineLine(set, indices, lineWeights, 0, 3, e0, e1)) {
+			break;
+		}
+		int refined[2][3];
+		uint8_t refinedIndices[16];
+		BC1Quantize(e0, e1, refined);
+		float refinedError = BC1Fit(set, refined, refinedIndices);
+		if (refinedError >= error) {
+			break;
+		}
+		error = refinedError;
+		std::memcpy(codes, refined, sizeof(codes));
+		std::memcpy(indices, refinedIndices, 16);
+	}
+
+	// Nudge each endpoint channel by one step while that lowers the error.
+	if (quality == BCQuality::Quality) {
+		for (int pass = 0; pass < 8 && error > 0.0f; pass++) {
+			bool improved = false;
+			for (int e = 0; e < 2; e++) {
+				for (int c = 0; c < 3; c++) {
+					for (int step = -1; step <= 1; step += 2) {
+						int trial[2][3];
+						std::memcpy(trial, codes, sizeof(trial));
+						trial[e][c] += step;
+						if (trial[e][c] < 0 || trial[e][c] >= (1 << kBC1Bits[c])) {
+							continue;
+						}
+						uint8_t trialIndices[16];
+						float trialError = BC1Fit(set, trial, trialIndices);
+						if (trialError < error) {
+							error = trialError;
+							std::memcpy(codes, trial, sizeof(codes));
+							std::memcpy(indices, trialIndices, 16);
+							improved = true;
+						}
+					}
+				}
+			}
+			if (!improved) {
+				break;
+			}
+		}
+	}
+	WriteBC1(codes, indices, block);
+}
+
+void EncodeBC4Block(const uint8_t texels[16][4], int channel, BCQuality quality, uint8_t block[8]) {
+	TexelSet set;
+	set.Count = 16;
+	int low = 255, high = 0;
+	int innerLow = 255, innerHigh = 0;
+	for (int t = 0; t < 16; t++) {
+		int v = texels[t][channel];
+		set.C[0][t] = (float)v;
+		low = std::min(low, v);
+		high = std::max(high, v);
+		if (v != 0 && v != 255) {
+			innerLow = std::min(innerLow, v);
+			innerHigh = std::max(innerHigh, v);
+		}
+	}
+
+	int r0 = high, r1 = low;
+	uint8_t indices[16];
+	float error = BC4Fit(set, r0, r1, indices);
+	if (quality == BCQuality::Quality && error > 0.0f) {
+		SearchBC4(set, high, low, 2, r0, r1, error, indices);
+		// Blocks reaching 0 or 255 may do better with the six value mode, which has
+		// those two for free.
+		if (innerLow <= innerHigh && (low == 0 || high == 255)) {
+			SearchBC4(set, innerLow, innerHigh, 2, r0, r1, error, indices);
+		}
+	}
+
+	block[0] = (uint8_t)r0;
+	block[1] = (uint8_t)r1;
+	uint64_t bits = 0;
+	for (int t = 0; t < 16; t++) {
+		bits |= (uint64_t)indices[t] << (3 * t);
+	}
+	for (int i = 0; i < 6; i++) {
+		block[2 + i] = (uint8_t)(bits >> (8 * i));
+	}
+}
+
+void EncodeBC5Block(const uint8_t texels[16][4], BCQuality quality, uint8_t block[16]) {
+	EncodeBC4Block(texels, 0, quality, block);
+	EncodeBC4Block(texels, 1, quality, block + 8);
+}
+
+void EncodeBC7Block(const uint8_t texels[16][4], BCQuality quality, uint8_t block[16]) {
+	BC7Encoding best;
+	TryMode6(texels, quality, best);
+	if (quality == BCQuality::Fast || best.Error <= kMode6GoodEnough) {
+		WriteBC7(best, block);
+		return;
+	}
+
+	bool opaque = true;
+	for (int t = 0; t < 16; t++) {
+		opaque = opaque && texels[t][3] == 255;
+	}
+	if (!opaque) {
+		TryMode5(texels, quality, best);
+	}
+	else {
+		// The two subset modes have no alpha; only the partitions that two exact lines
+		// fit best are encoded.
+		std::pair<float, int> ranked[64];
+		RankPartitions(texels, ranked);
+		for (int i = 0; i < kPartitionCandidates; i++) {
+			TryPartitioned(texels, 1, ranked[i].second, quality, best);
+			TryPartitioned(texels, 3, ranked[i].second, quality, best);
+		}
+	}
+	WriteBC7(best, block);
+}
+
+void DecodeBCBlock(const uint8_t* block, BCFormat format, uint8_t texels[16][4]) {
+	uint8_t red[16];
+	uint8_t green[16];
+	switch (format) {
+	case BCFormat::BC1:
+		DecodeBC1(block, texels);
+		break;
+	case BCFormat::BC4:
+	case BCFormat::BC5:
+		DecodeBC4(block, red);
+		if (format == BCFormat::BC5) {
+			DecodeBC4(block + 8, green);
+		}
+		for (int t = 0; t < 16; t++) {
+			texels[t][0] = red[t];
+			texels[t][1] = format == BCFormat::BC5 ? green[t] : 0;
+			texels[t][2] = 0;
+			texels[t][3] = 255;
+		}
+		break;
+	case BCFormat::BC7:
+		DecodeBC7(block, texels);
+		break;
+	}
+}
+
+uint32_t BCBlockBytes(BCFormat format) {
+	return format == BCFormat::BC1 || format == BCFormat::BC4 ? 8 : 16;
+}
+
+uint32_t BCDxgiFormat(BCFormat format, bool srgb) {
+	switch (format) {
+	case BCFormat::BC1: return srgb ? kDxgiFormatBC1UnormSrgb : kDxgiFormatBC1Unorm;
+	case BCFormat::BC4: return kDxgiFormatBC4Unorm;
+	case BCFormat::BC5: return kDxgiFormatBC5Unorm;
+	case BCFormat::BC7: return srgb ? kDxgiFormatBC7UnormSrgb : kDxgiFormatBC7Unorm;
+	}
+	return 0;
+}
+
+BCStats EncodeTextureBC(const CompressedTexture& rgba8, BCFormat format, BCQuality quality,
+	CompressedTexture& out, TaskPool& pool)
+{
+	if (rgba8.IsBlockCompressed() || rgba8.BlockBytes() != 4) {
+		throw std::runtime_error("EncodeTextureBC: source is not RGBA8");
+	}
+	auto start = std::chrono::steady_clock::now();
+
+	out = CompressedTexture(rgba8.Width(), rgba8.Height(), rgba8.MipLevels(), rgba8.ArraySize(), rgba8.IsCube(),
+		BCDxgiFormat(format, rgba8.DxgiFormat() == kDxgiFormatR8G8B8A8UnormSrgb), BCBlockBytes(format));
+
+	// One job per row of blocks over every item and mip, so the small mips do not
+	// leave threads idle at the end.
+	struct Row {
+		uint32_t Item;
+		uint32_t Mip;
+		uint32_t BlockRow;
+	};
+	std::vector<Row> rows;
+	double texels = 0.0;
+	for (uint32_t item = 0; item < out.ArraySize(); item++) {
+		for (uint32_t mip = 0; mip < out.MipLevels(); mip++) {
+			for (uint32_t by = 0; by < out.BlocksHigh(mip); by++) {
+				rows.push_back({ item, mip, by });
+			}
+			texels += (double)out.MipWidth(mip) * out.MipHeight(mip);
+		}
+	}
+
+	uint32_t blockBytes = out.BlockBytes();
+	pool.ParallelFor((uint32_t)rows.size(), [&](uint32_t job) {
+		const Row& row = rows[job];
+		uint8_t* blocks = out.Blocks(row.Item, row.Mip) + row.BlockRow * out.RowPitch(row.Mip);
+		for (uint32_t bx = 0; bx < out.BlocksWide(row.Mip); bx++) {
+			uint8_t block[16][4];
+			GatherBlock(rgba8.Blocks(row.Item, row.Mip), out.MipWidth(row.Mip), out.MipHeight(row.Mip),
+				bx, row.BlockRow, block);
+			EncodeBlock(block, format, quality, blocks + bx * blockBytes);
+		}
+	});
+
+	BCStats stats;
+	stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stats.MPixelsPerSecond = stats.Seconds > 0.0 ? texels / (stats.Seconds * 1e6) : 0.0;
+	return stats;
+}
+
+double MeasureBCPsnr(const CompressedTexture& rgba8, const CompressedTexture& encoded, BCFormat format) {
+	int channels = KeptChannels(format);
+	uint32_t width = rgba8.Width();
+	uint32_t height = rgba8.Height();
+	double squaredError = 0.0;
+	for (uint32_t item = 0; item < rgba8.ArraySize(); item++) {
+		const uint8_t* source = rgba8.Blocks(item, 0);
+		for (uint32_t by = 0; by < encoded.BlocksHigh(0); by++) {
+			for (uint32_t bx = 0; bx < encoded.BlocksWide(0); bx++) {
+				uint8_t decoded[16][4];
+				DecodeBCBlock(encoded.Blocks(item, 0) + by * encoded.RowPitch(0) + bx * encoded.BlockBytes(),
+					format, decoded);
+				for (uint32_t t = 0; t < 16; t++) {
+					uint32_t x = bx * 4 + t % 4;
+					uint32_t y = by * 4 + t / 4;
+					if (x >= width || y >= height) {
+						continue;
+					}
+					const uint8_t* texel = source + ((size_t)y * width + x) * 4;
+					for (int c = 0; c < channels; c++) {
+						double diff = (double)texel[c] - decoded[t][c];
+						squaredError += diff * diff;
+					}
+				}
+			}
+		}
+	}
+	double mse = squaredError / ((double)width * height * rgba8.ArraySize() * channels);
+	return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+BCRdoStats OptimizeBCForCompression(const CompressedTexture& rgba8, BCFormat format, const BCRdoSettings& settings,
+	CompressedTexture& encoded, TaskPool& pool)
+{
+	if (encoded.BlockBytes() != BCBlockBytes(format) || encoded.Width() != rgba8.Width() ||
+		encoded.Height() != rgba8.Height() || encoded.MipLevels() != rgba8.MipLevels() ||
+		encoded.ArraySize() != rgba8.ArraySize()) {
+		throw std::runtime_error("OptimizeBCForCompression: texture is not the encoding of the source");
+	}
+	auto start = std::chrono::steady_clock::now();
+
+	struct Row {
+		uint32_t Item;
+		uint32_t Mip;
+		uint32_t BlockRow;
+		uint64_t RepeatedBlocks;
+		uint64_t RepeatedIndices;
+	};
+	std::vector<Row> rows;
+	BCRdoStats stats;
+	for (uint32_t item = 0; item < encoded.ArraySize(); item++) {
+		for (uint32_t mip = 0; mip < encoded.MipLevels(); mip++) {
+			for (uint32_t by = 0; by < encoded.BlocksHigh(mip); by++) {
+				rows.push_back({ item, mip, by, 0, 0 });
+			}
+			stats.Blocks += (uint64_t)encoded.BlocksWide(mip) * encoded.BlocksHigh(mip);
+		}
+	}
+
+	uint32_t blockBytes = encoded.BlockBytes();
+	uint32_t ranges[2][2];
+	uint32_t rangeCount = IndexRanges(format, ranges);
+	double allowed = settings.MaxMseIncrease * 16.0 * KeptChannels(format);
+	// Rows only look back within themselves, so they are independent jobs.
+	pool.ParallelFor((uint32_t)rows.size(), [&](uint32_t job) {
+		Row& row = rows[job];
+		uint8_t* blocks = encoded.Blocks(row.Item, row.Mip) + row.BlockRow * encoded.RowPitch(row.Mip);
+		for (uint32_t bx = 0; bx < encoded.BlocksWide(row.Mip); bx++) {
+			uint8_t source[16][4];
+			GatherBlock(rgba8.Blocks(row.Item, row.Mip), encoded.MipWidth(row.Mip), encoded.MipHeight(row.Mip),
+				bx, row.BlockRow, source);
+			uint8_t* block = blocks + bx * blockBytes;
+			double limit = BlockError(block, format, source) + allowed;
+			uint32_t first = bx > settings.Window ? bx - settings.Window : 0;
+
+			// The whole block first: it repeats in every stream of the second layer.
+			double bestError = limit;
+			const uint8_t* best = nullptr;
+			bool repeated = false;
+			for (uint32_t c = bx; c-- > first && !repeated;) {
+				const uint8_t* candidate = blocks + c * blockBytes;
+				repeated = std::memcmp(candidate, block, blockBytes) == 0;
+				uint32_t error = repeated ? 0 : BlockError(candidate, format, source);
+				if (!repeated && error <= bestError) {
+					bestError = error;
+					best = candidate;
+				}
+			}
+			if (repeated) {
+				continue;
+			}
+			if (best) {
+				std::memcpy(block, best, blockBytes);
+				row.RepeatedBlocks++;
+				continue;
+			}
+
+			// Then only the indices, keeping the block's own endpoints.
+			uint8_t bestBlock[16];
+			for (uint32_t c = bx; c-- > first && rangeCount != 0;) {
+				const uint8_t* candidate = blocks + c * blockBytes;
+				uint8_t trial[16];
+				std::memcpy(trial, block, blockBytes);
+				for (uint32_t r = 0; r < rangeCount; r++) {
+					std::memcpy(trial + ranges[r][0], candidate + ranges[r][0], ranges[r][1] - ranges[r][0]);
+				}
+				if (std::memcmp(trial, block, blockBytes) == 0) {
+					best = nullptr;
+					break;
+				}
+				uint32_t error = BlockError(trial, format, source);
+				if (error <= bestError) {
+					bestError = error;
+					best = candidate;
+					std::memcpy(bestBlock, trial, blockBytes);
+				}
+			}
+			if (best) {
+				std::memcpy(block, bestBlock, blockBytes);
+				row.RepeatedIndices++;
+			}
+		}
+	});
+
+	for (const Row& row : rows) {
+		stats.RepeatedBlocks += row.RepeatedBlocks;
+		stats.RepeatedIndices += row.RepeatedIndices;
+	}
+	stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "CompressedTexture.h"
+#include "TaskPool.h"
+
+enum class BCFormat {
+	// RGB with 5:6:5 endpoints and 2 bit indices; alpha is dropped.  4 bits per texel.
+	BC1,
+	// One channel with 8 bit endpoints and 3 bit indices.  4 bits per texel.
+	BC4,
+	// Two BC4 channels, for the XY of tangent space normals.  8 bits per texel.
+	BC5,
+	// RGBA with one or two subsets per block.  8 bits per texel.
+	BC7
+};
+
+enum class BCQuality {
+	// One line fit per block with a least squares refinement; BC7 uses mode 6 only.
+	Fast,
+	// BC1 and BC4 also search around the fitted endpoints.  BC7 adds the two subset
+	// modes 1 and 3 on the partitions that fit best, and mode 5 for blocks with alpha.
+	Quality
+};
+
+// Block encoders for 4x4 RGBA8 texels.  BC4 encodes the given channel.
+void EncodeBC1Block(const uint8_t texels[16][4], BCQuality quality, uint8_t block[8]);
+void EncodeBC4Block(const uint8_t texels[16][4], int channel, BCQuality quality, uint8_t block[8]);
+void EncodeBC5Block(const uint8_t texels[16][4], BCQuality quality, uint8_t block[16]);
+void EncodeBC7Block(const uint8_t texels[16][4], BCQuality quality, uint8_t block[16]);
+
+// Decodes a block to RGBA8: BC4 gives (r, 0, 0, 255) and BC5 (r, g, 0, 255).  BC7
+// blocks in the three subset modes 0 and 2, which the encoder never writes, and
+// reserved blocks decode to zero.
+void DecodeBCBlock(const uint8_t* block, BCFormat format, uint8_t texels[16][4]);
+
+uint32_t BCBlockBytes(BCFormat format);
+// srgb picks the _SRGB variant of BC1 and BC7; BC4 and BC5 have none.
+uint32_t BCDxgiFormat(BCFormat format, bool srgb);
+
+struct BCStats {
+	double Seconds = 0.0;
+	// Texels encoded per second over all array items and mips, in millions.
+	double MPixelsPerSecond = 0.0;
+};
+
+// Encodes every array item and mip of an RGBA8 texture (blockDim 1, as made by
+// CookTexture) for WriteDDS or an upload.  Rows of blocks of every mip are spread
+// over the pool.  An _SRGB source gives an _SRGB result with the stored values
+// encoded as they are.
+BCStats EncodeTextureBC(const CompressedTexture& rgba8, BCFormat format, BCQuality quality,
+	CompressedTexture& out, TaskPool& pool = TaskPool::Default());
+
+// PSNR in dB of mip 0 of the encoded texture against its RGBA8 source, over the
+// channels the format keeps.
+double MeasureBCPsnr(const CompressedTexture& rgba8, const CompressedTexture& encoded, BCFormat format);
+
+// Rate-distortion pass for an LZ based second layer such as EntropyCodec.  A block
+// takes over one of the Window blocks before it in its row, whole or, for BC1, BC4
+// and BC5, by its indices only, when that raises its mean squared error per channel
+// by at most MaxMseIncrease.  The repeated bytes become matches.
+struct BCRdoSettings {
+	float MaxMseIncrease = 1.0f;
+	uint32_t Window = 8;
+};
+
+struct BCRdoStats {
+	double Seconds = 0.0;
+	uint64_t Blocks = 0;
+	// Blocks that became copies of an earlier one, and ones that took its indices.
+	uint64_t RepeatedBlocks = 0;
+	uint64_t RepeatedIndices = 0;
+};
+
+// Runs the pass over every array item and mip of encoded, which EncodeTextureBC made
+// from rgba8 in format, with rows of blocks spread over the pool.  Throws
+// std::runtime_error when the shapes do not match.
+BCRdoStats OptimizeBCForCompression(const CompressedTexture& rgba8, BCFormat format, const BCRdoSettings& settings,
+	CompressedTexture& encoded, TaskPool& pool = TaskPool::Default());
@@ -0,0 +1,852 @@
+#include "BVH.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+namespace {
+	const uint32_t kBinCount = 12;
+	// Leaves are made as soon as a node holds this few triangles.
+	const uint32_t kMinLeafTriangles = 2;
+	// Above this SAH always splits, even when a leaf looks cheaper.
+	const uint32_t kMaxLeafTriangles = 16;
+	// The same for scene objects, whose box tests cost about as much as a node visit.
+	const uint32_t kMinLeafObjects = 2;
+	const uint32_t kMaxLeafObjects = 8;
+	// Cost of a node visit relative to a triangle test.
+	const float kTraversalCost = 1.0f;
+	// Nodes this deep are split at the median instead of by SAH, which keeps every
+	// tree under kStackSize levels.
+	const uint32_t kMaxSAHDepth = 64;
+	const uint32_t kStackSize = 128;
+
+	struct Box {
+		float Min[3] = { INFINITY, INFINITY, INFINITY };
+		float Max[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+		void Grow(const float p[3]) {
+			for (int i = 0; i < 3; i++) {
+				Min[i] = std::min(Min[i], p[i]);
+				Max[i] = std::max(Max[i], p[i]);
+			}
+		}
+		void Grow(const Box& b) {
+			for (int i = 0; i < 3; i++) {
+				Min[i] = std::min(Min[i], b.Min[i]);
+				Max[i] = std::max(Max[i], b.Max[i]);
+			}
+		}
+		float HalfArea()const {
+			return HalfAreaOf(Min, Max);
+		}
+		static float HalfAreaOf(const float min[3], const float max[3]) {
+			float d[3] = { max[0] - min[0], max[1] - min[1], max[2] - min[2] };
+			if (d[0] < 0.0f) {
+				return 0.0f;
+			}
+			return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+		}
+	};
+
+	struct BuildTask {
+		uint32_t Node;
+		uint32_t Begin;
+		uint32_t End;
+		uint32_t Depth;
+	};
+
+	// A primitive during the build.  They are partitioned themselves rather than
+	// their indices, so every pass over a node reads memory in order.
+	struct BuildPrimitive {
+		Box Bounds;
+		float Centroid[3];
+		uint32_t Index;
+	};
+
+	// Binned SAH over the boxes of primitives.  Fills order with the primitive indices
+	// such that every leaf covers a contiguous range of it, and the nodes with
+	// siblings next to each other and children after their parent.  NodeT needs Min,
+	// Max, LeftOrFirst and Count as in TriangleBVH::Node.
+	template <typename NodeT>
+	void BuildBinnedSAH(const std::vector<Box>& bounds, uint32_t minLeaf, uint32_t maxLeaf,
+		std::vector<uint32_t>& order, std::vector<NodeT>& nodes)
+	{
+		uint32_t primitiveCount = (uint32_t)bounds.size();
+		nodes.clear();
+		order.clear();
+		if (primitiveCount == 0) {
+			return;
+		}
+
+		std::vector<BuildPrimitive> primitives(primitiveCount);
+		for (uint32_t t = 0; t < primitiveCount; t++) {
+			primitives[t].Bounds = bounds[t];
+			for (int i = 0; i < 3; i++) {
+				primitives[t].Centroid[i] = 0.5f * (bounds[t].Min[i] + bounds[t].Max[i]);
+			}
+			primitives[t].Index = t;
+		}
+
+		nodes.reserve((size_t)primitiveCount * 2);
+		nodes.push_back(NodeT());
+		std::vector<BuildTask> stack;
+		stack.push_back({ 0, 0, primitiveCount, 0 });
+
+		while (!stack.empty()) {
+			BuildTask task = stack.back();
+			stack.pop_back();
+
+			Box nodeBox, centroidBox;
+			for (uint32_t i = task.Begin; i < task.End; i++) {
+				nodeBox.Grow(primitives[i].Bounds);
+				centroidBox.Grow(primitives[i].Centroid);
+			}
+			NodeT& node = nodes[task.Node];
+			for (int i = 0; i < 3; i++) {
+				node.Min[i] = nodeBox.Min[i];
+				node.Max[i] = nodeBox.Max[i];
+			}
+
+			uint32_t count = task.End - task.Begin;
+			auto makeLeaf = [&]() {
+				nodes[task.Node].LeftOrFirst = task.Begin;
+				nodes[task.Node].Count = count;
+			};
+			if (count <= minLeaf) {
+				makeLeaf();
+				continue;
+			}
+
+			// Binned SAH over the centroid bounds, on every axis at once.
+			int bestAxis = -1;
+			uint32_t bestSplit = 0;
+			float bestCost = INFINITY;
+			float scale[3];
+			bool splittable[3];
+			for (int axis = 0; axis < 3; axis++) {
+				float extent = centroidBox.Max[axis] - centroidBox.Min[axis];
+				splittable[axis] = extent > 0.0f && task.Depth < kMaxSAHDepth;
+				scale[axis] = splittable[axis] ? kBinCount / extent : 0.0f;
+			}
+			Box binBoxes[3][kBinCount];
+			uint32_t binCounts[3][kBinCount] = {};
+			if (splittable[0] || splittable[1] || splittable[2]) {
+				for (uint32_t i = task.Begin; i < task.End; i++) {
+					const BuildPrimitive& primitive = primitives[i];
+					for (int axis = 0; axis < 3; axis++) {
+						uint32_t bin = std::min((uint32_t)((primitive.Centroid[axis] - centroidBox.Min[axis]) * scale[axis]), kBinCount - 1);
+						binBoxes[axis][bin].Grow(primitive.Bounds);
+						binCounts[axis][bin]++;
+					}
+				}
+			}
+			for (int axis = 0; axis < 3; axis++) {
+				if (!splittable[axis]) {
+					continue;
+				}
+				float rightArea[kBinCount];
+				uint32_t rightCount[kBinCount];
+				Box accumulated;
+				uint32_t accumulatedCount = 0;
+				for (uint32_t b = kBinCount - 1; b > 0; b--) {
+					accumulated.Grow(binBoxes[axis][b]);
+					accumulatedCount += binCounts[axis][b];
+					rightArea[b] = accumulated.HalfArea();
+					rightCount[b] = accumulatedCount;
+				}
+
+				accumulated = Box();
+				accumulatedCount = 0;
+				for (uint32_t b = 0; b < kBinCount - 1; b++) {
+					accumulated.Grow(binBoxes[axis][b]);
+					accumulatedCount += binCounts[axis][b];
+					float cost = accumulated.HalfArea() * accumulatedCount + rightArea[b + 1] * rightCount[b + 1];
+					if (accumulatedCount != 0 && rightCount[b + 1] != 0 && cost < bestCost) {
+						bestCost = cost;
+						bestAxis = axis;
+						bestSplit = b + 1;
+					}
+				}
+			}
+
+			float leafCost = nodeBox.HalfArea() * count;
+			float splitCost = nodeBox.HalfArea() * kTraversalCost + bestCost;
+			bool splitPays = bestAxis >= 0 && splitCost < leafCost;
+			if (!splitPays && count <= maxLeaf) {
+				makeLeaf();
+				continue;
+			}
+
+			uint32_t middle;
+			if (bestAxis >= 0) {
+				float scale = kBinCount / (centroidBox.Max[bestAxis] - centroidBox.Min[bestAxis]);
+				float minimum = centroidBox.Min[bestAxis];
+				BuildPrimitive* split = std::partition(primitives.data() + task.Begin, primitives.data() + task.End,
+					[&](const BuildPrimitive& primitive) {
+						uint32_t bin = std::min((uint32_t)((primitive.Centroid[bestAxis] - minimum) * scale), kBinCount - 1);
+						return bin < bestSplit;
+					});
+				middle = (uint32_t)(split - primitives.data());
+			}
+			else {
+				// Every centroid coincides, or the node is too deep: split by count along
+				// the longest centroid axis.
+				int axis = 0;
+				for (int i = 1; i < 3; i++) {
+					if (centroidBox.Max[i] - centroidBox.Min[i] > centroidBox.Max[axis] - centroidBox.Min[axis]) {
+						axis = i;
+					}
+				}
+				middle = task.Begin + count / 2;
+				std::nth_element(primitives.data() + task.Begin, primitives.data() + middle, primitives.data() + task.End,
+					[&](const BuildPrimitive& a, const BuildPrimitive& b) { return a.Centroid[axis] < b.Centroid[axis]; });
+			}
+
+			uint32_t left = (uint32_t)nodes.size();
+			nodes[task.Node].LeftOrFirst = left;
+			nodes[task.Node].Count = 0;
+			nodes.push_back(NodeT());
+			nodes.push_back(NodeT());
+			stack.push_back({ left, task.Begin, middle, task.Depth + 1 });
+			stack.push_back({ left + 1, middle, task.End, task.Depth + 1 });
+		}
+
+		order.resize(primitiveCount);
+		for (uint32_t i = 0; i < primitiveCount; i++) {
+			order[i] = primitives[i].Index;
+		}
+	}
+
+	// Slab test; returns the entry distance or INFINITY on a miss.
+	inline float IntersectBox(const float min[3], const float max[3], const float origin[3], const float invDir[3], float tMax) {
+		float t0 = 0.0f, t1 = tMax;
+		for (int i = 0; i < 3; i++) {
+			float a = (min[i] - origin[i]) * invDir[i];
+			float b = (max[i] - origin[i]) * invDir[i];
+			t0 = std::max(t0, std::min(a, b));
+			t1 = std::min(t1, std::max(a, b));
+		}
+		return t0 <= t1 ? t0 : INFINITY;
+	}
+
+	void InverseDirection(const float dir[3], float invDir[3]) {
+		for (int i = 0; i < 3; i++) {
+			invDir[i] = dir[i] != 0.0f ? 1.0f / dir[i] : std::copysign(INFINITY, dir[i]);
+		}
+	}
+}
+
+TriangleBVH::TriangleBVH(const std::vector<float>& positions, const std::vector<uint32_t>& indices) {
+	if (indices.size() % 3 != 0) {
+		throw std::runtime_error("TriangleBVH: index count is not a multiple of three");
+	}
+	uint32_t triangleCount = (uint32_t)(indices.size() / 3);
+	uint32_t vertexCount = (uint32_t)(positions.size() / 3);
+	if (triangleCount == 0) {
+		return;
+	}
+
+	std::vector<Box> bounds(triangleCount);
+	for (uint32_t t = 0; t < triangleCount; t++) {
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = indices[t * 3 + k];
+			if (v >= vertexCount) {
+				throw std::runtime_error("TriangleBVH: index out of range");
+			}
+			bounds[t].Grow(&positions[(size_t)v * 3]);
+		}
+	}
+
+	std::vector<uint32_t> order;
+	BuildBinnedSAH(bounds, kMinLeafTriangles, kMaxLeafTriangles, order, mNodes);
+
+	mTriangles.resize(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; i++) {
+		uint32_t t = order[i];
+		const float* p0 = &positions[(size_t)indices[t * 3 + 0] * 3];
+		const float* p1 = &positions[(size_t)indices[t * 3 + 1] * 3];
+		const float* p2 = &positions[(size_t)indices[t * 3 + 2] * 3];
+		Triangle& tri = mTriangles[i];
+		for (int k = 0; k < 3; k++) {
+			tri.V0[k] = p0[k];
+			tri.E1[k] = p1[k] - p0[k];
+			tri.E2[k] = p2[k] - p0[k];
+		}
+		tri.Id = t;
+	}
+}
+
+void TriangleBVH::Bounds(float min[3], float max[3])const {
+	for (int i = 0; i < 3; i++) {
+		min[i] = mNodes.empty() ? 0.0f : mNodes[0].Min[i];
+		max[i] = mNodes.empty() ? 0.0f : mNodes[0].Max[i];
+	}
+}
+
+bool TriangleBVH::Intersect(const float origin[3], const float dir[3], float tMax, RayHit& hit)const {
+	return Traverse<false>(origin, dir, tMax, &hit);
+}
+
+bool TriangleBVH::Occluded(const float origin[3], const float dir[3], float tMax)const {
+	return Traverse<true>(origin, dir, tMax, nullptr);
+}
+
+template <bool AnyHit>
+bool TriangleBVH::Traverse(const float origin[3], const float dir[3], float tMax, RayHit* hit)const {
+	if (mNodes.empty()) {
+		return false;
+	}
+
+	float invDir[3];
+	InverseDirection(dir, invDir);
+
+	bool found = false;
+	float closest = tMax;
+	// Pending far children and their entry distances, to skip the ones behind a hit.
+	uint32_t stack[kStackSize];
+	float stackT[kStackSize];
+	uint32_t stackSize = 0;
+	uint32_t nodeIndex = 0;
+	if (IntersectBox(mNodes[0].Min, mNodes[0].Max, origin, invDir, closest) == INFINITY) {
+		return false;
+	}
+
+	for (;;) {
+		const Node& node = mNodes[nodeIndex];
+		if (node.Count != 0) {
+			for (uint32_t i = node.LeftOrFirst; i < node.LeftOrFirst + node.Count; i++) {
+				const Triangle& tri = mTriangles[i];
+				float p[3] = {
+					dir[1] * tri.E2[2] - dir[2] * tri.E2[1],
+					dir[2] * tri.E2[0] - dir[0] * tri.E2[2],
+					dir[0] * tri.E2[1] - dir[1] * tri.E2[0],
+				};
+				float det = tri.E1[0] * p[0] + tri.E1[1] * p[1] + tri.E1[2] * p[2];
+				if (std::fabs(det) < 1e-12f) {
+					continue;
+				}
+				float invDet = 1.0f / det;
+				float s[3] = { origin[0] - tri.V0[0], origin[1] - tri.V0[1], origin[2] - tri.V0[2] };
+				float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+				if (u < 0.0f || u > 1.0f) {
+					continue;
+				}
+				float q[3] = {
+					s[1] * tri.E1[2] - s[2] * tri.E1[1],
+					s[2] * tri.E1[0] - s[0] * tri.E1[2],
+					s[0] * tri.E1[1] - s[1] * tri.E1[0],
+				};
+				float v = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) * invDet;
+				if (v < 0.0f || u + v > 1.0f) {
+					continue;
+				}
+				float t = (tri.E2[0] * q[0] + tri.E2[1] * q[1] + tri.E2[2] * q[2]) * invDet;
+				if (t <= 0.0f || t >= closest) {
+					continue;
+				}
+				if (AnyHit) {
+					return true;
+				}
+				found = true;
+				closest = t;
+				hit->T = t;
+				hit->Triangle = tri.Id;
+				hit->U = u;
+				hit->V = v;
+			}
+		}
+		else {
+			// Visit the nearer child first; the farther one waits on the stack.
+			uint32_t near = node.LeftOrFirst;
+			uint32_t far = near + 1;
+			float tNear = IntersectBox(mNodes[near].Min, mNodes[near].Max, origin, invDir, closest);
+			float tFar = IntersectBox(mNodes[far].Min, mNodes[far].Max, origin, invDir, closest);
+			if (tFar < tNear) {
+				std::swap(near, far);
+				std::swap(tNear, tFar);
+			}
+			if (tNear != INFINITY) {
+				if (tFar != INFINITY) {
+					if (stackSize == kStackSize) {
+						throw std::runtime_error("TriangleBVH: traversal stack overflow");
+					}
+					stackT[stackSize] = tFar;
+					stack[stackSize++] = far;
+				}
+				nodeIndex = near;
+				continue;
+			}
+		}
+
+		do {
+			if (stackSize == 0) {
+				return found;
+			}
+			stackSize--;
+		} while (stackT[stackSize] >= closest);
+		nodeIndex = stack[stackSize];
+	}
+}
+
+SceneBVH::SceneBVH(const std::vector<float>& bounds) {
+	if (bounds.size() % 6 != 0) {
+		throw std::runtime_error("SceneBVH: bounds are not six floats per object");
+	}
+	uint32_t objectCount = (uint32_t)(bounds.size() / 6);
+	mItems.resize(objectCount);
+	for (uint32_t id = 0; id < objectCount; id++) {
+		Item& item = mItems[id];
+		for (int i = 0; i < 3; i++) {
+			item.Min[i] = bounds[(size_t)id * 6 + i];
+			item.Max[i] = bounds[(size_t)id * 6 + 3 + i];
+		}
+		item.Id = id;
+	}
+	mSlots.resize(objectCount);
+	mLeaves.resize(objectCount);
+	mMoved.assign(objectCount, 0);
+	Rebuild();
+}
+
+float SceneBVH::Cost()const {
+	if (mNodes.empty()) {
+		return 0.0f;
+	}
+	float rootArea = Box::HalfAreaOf(mNodes[0].Min, mNodes[0].Max);
+	return rootArea > 0.0f ? (float)(mCostSum / rootArea) : 0.0f;
+}
+
+void SceneBVH::SetBounds(uint32_t id, const float min[3], const float max[3]) {
+	if (id >= ObjectCount()) {
+		throw std::runtime_error("SceneBVH: object id out of range");
+	}
+	Item& item = mItems[mSlots[id]];
+	for (int i = 0; i < 3; i++) {
+		item.Min[i] = min[i];
+		item.Max[i] = max[i];
+	}
+	if (!mMoved[id]) {
+		mMoved[id] = 1;
+		mMovedIds.push_back(id);
+	}
+}
+
+bool SceneBVH::RefitNode(uint32_t index) {
+	Node& node = mNodes[index];
+	Box box;
+	if (node.Count != 0) {
+		for (uint32_t i = node.LeftOrFirst; i < node.LeftOrFirst + node.Count; i++) {
+			box.Grow(mItems[i].Min);
+			box.Grow(mItems[i].Max);
+		}
+	}
+	else {
+		for (uint32_t child = node.LeftOrFirst; child < node.LeftOrFirst + 2; child++) {
+			box.Grow(mNodes[child].Min);
+			box.Grow(mNodes[child].Max);
+		}
+	}
+
+	bool changed = false;
+	for (int i = 0; i < 3; i++) {
+		changed = changed || box.Min[i] != node.Min[i] || box.Max[i] != node.Max[i];
+	}
+	if (changed) {
+		float weight = node.Count != 0 ? (float)node.Count : kTraversalCost;
+		mCostSum += ((double)box.HalfArea() - Box::HalfAreaOf(node.Min, node.Max)) * weight;
+		for (int i = 0; i < 3; i++) {
+			node.Min[i] = box.Min[i];
+			node.Max[i] = box.Max[i];
+		}
+	}
+	return changed;
+}
+
+bool SceneBVH::Update(float rebuildRatio) {
+	if (mMovedIds.empty()) {
+		return false;
+	}
+	// Walking up from every moved object pays off while they are few; children
+	// always come after their parent, so a backward sweep refits everything.
+	if (mMovedIds.size() * 16 > mItems.size()) {
+		for (uint32_t n = NodeCount(); n-- > 0;) {
+			RefitNode(n);
+		}
+	}
+	else {
+		for (uint32_t id : mMovedIds) {
+			uint32_t node = mLeaves[id];
+			while (RefitNode(node) && node != 0) {
+				node = mParents[node];
+			}
+		}
+	}
+	for (uint32_t id : mMovedIds) {
+		mMoved[id] = 0;
+	}
+	mMovedIds.clear();
+
+	if (Cost() > rebuildRatio * mBuiltCost) {
+		Rebuild();
+		return true;
+	}
+	return false;
+}
+
+void SceneBVH::Rebuild() {
+	uint32_t objectCount = ObjectCount();
+	std::vector<Box> bounds(objectCount);
+	for (const Item& item : mItems) {
+		bounds[item.Id].Grow(item.Min);
+		bounds[item.Id].Grow(item.Max);
+	}
+	std::vector<uint32_t> order;
+	BuildBinnedSAH(bounds, kMinLeafObjects, kMaxLeafObjects, order, mNodes);
+
+	for (uint32_t i = 0; i < objectCount; i++) {
+		uint32_t id = order[i];
+		Item& item = mItems[i];
+		for (int k = 0; k < 3; k++) {
+			item.Min[k] = bounds[id].Min[k];
+			item.Max[k] = bounds[id].Max[k];
+		}
+		item.Id = id;
+		mSlots[id] = i;
+	}
+
+	mParents.assign(mNodes.size(), 0);
+	mCostSum = 0.0;
+	for (uint32_t n = 0; n < NodeCount(); n++) {
+		const Node& node = mNodes[n];
+		if (node.Count != 0) {
+			for (uint32_t i = node.LeftOrFirst; i < node.LeftOrFirst + node.Count; i++) {
+				mLeaves[mItems[i].Id] = n;
+			}
+			mCostSum += (double)Box::HalfAreaOf(node.Min, node.Max) * node.Count;
+		}
+		else {
+			mParents[node.LeftOrFirst] = n;
+			mParents[node.LeftOrFirst + 1] = n;
+			mCostSum += (double)Box::HalfAreaOf(node.Min, node.Max) * kTraversalCost;
+		}
+	}
+	mBuiltCost = Cost();
+}
+
+template <typename Test>
+void SceneBVH::Collect(uint32_t initialState, const Test& test, std::vector<uint32_t>& ids)const {
+	ids.clear();
+	if (mNodes.empty()) {
+		return;
+	}
+
+	struct Pending {
+		uint32_t Node;
+		uint32_t State;
+	};
+	Pending stack[kStackSize];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = { 0, initialState };
+	while (stackSize != 0) {
+		Pending pending = stack[--stackSize];
+		const Node& node = mNodes[pending.Node];
+		uint32_t state = pending.State;
+		if (state != 0 && !test(node.Min, node.Max, state)) {
+			continue;
+		}
+		if (node.Count != 0) {
+			for (uint32_t i = node.LeftOrFirst; i < node.LeftOrFirst + node.Count; i++) {
+				uint32_t itemState = state;
+				if (state == 0 || test(mItems[i].Min, mItems[i].Max, itemState)) {
+					ids.push_back(mItems[i].Id);
+				}
+			}
+		}
+		else {
+			// At most one pending node per level, plus the two children.
+			stack[stackSize++] = { node.LeftOrFirst + 1, state };
+			stack[stackSize++] = { node.LeftOrFirst, state };
+		}
+	}
+}
+
+void SceneBVH::QueryFrustum(const Frustum& frustum, std::vector<uint32_t>& ids)const {
+	// The state holds the planes the box still straddles.
+	Collect(0x3f, [&](const float min[3], const float max[3], uint32_t& planes) {
+		for (uint32_t p = 0; p < 6; p++) {
+			if (!(planes & (1u << p))) {
+				continue;
+			}
+			const float* plane = frustum.Planes[p];
+			float dist = plane[3];
+			float reach = 0.0f;
+			for (int i = 0; i < 3; i++) {
+				dist += 0.5f * (min[i] + max[i]) * plane[i];
+				reach += 0.5f * (max[i] - min[i]) * std::fabs(plane[i]);
+			}
+			if (!(dist + reach >= 0.0f)) {
+				return false;
+			}
+			if (dist - reach >= 0.0f) {
+				planes &= ~(1u << p);
+			}
+		}
+		return true;
+	}, ids);
+}
+
+void SceneBVH::QuerySphere(const float center[3], float radius, std::vector<uint32_t>& ids)const {
+	float radiusSq = radius * radius;
+	Collect(1, [&](const float min[3], const float max[3], uint32_t& state) {
+		float nearSq = 0.0f;
+		float farSq = 0.0f;
+		for (int i = 0; i < 3; i++) {
+			float below = min[i] - center[i];
+			float above = center[i] - max[i];
+			float gap = std::max(std::max(below, above), 0.0f);
+			float span = std::max(std::fabs(below), std::fabs(above));
+			nearSq += gap * gap;
+			farSq += span * span;
+		}
+		if (!(nearSq <= radiusSq)) {
+			return false;
+		}
+		if (farSq <= radiusSq) {
+			state = 0;
+		}
+		return true;
+	}, ids);
+}
+
+void SceneBVH::QueryBox(const float queryMin[3], const float queryMax[3], std::vector<uint32_t>& ids)const {
+	Collect(1, [&](const float min[3], const float max[3], uint32_t& state) {
+		bool inside = true;
+		for (int i = 0; i < 3; i++) {
+			if (!(min[i] <= queryMax[i] && max[i] >= queryMin[i])) {
+				return false;
+			}
+			inside = inside && min[i] >= queryMin[i] && max[i] <= queryMax[i];
+		}
+		if (inside) {
+			state = 0;
+		}
+		return true;
+	}, ids);
+}
+
+bool SceneBVH::Raycast(const float origin[3], const float dir[3], float tMax, uint32_t& id, float& t)const {
+	if (mNodes.empty()) {
+		return false;
+	}
+
+	float invDir[3];
+	InverseDirection(dir, invDir);
+
+	bool found = false;
+	float closest = tMax;
+	uint32_t stack[kStackSize];
+	float stackT[kStackSize];
+	uint32_t stackSize = 0;
+	uint32_t nodeIndex = 0;
+	if (IntersectBox(mNodes[0].Min, mNodes[0].Max, origin, invDir, closest) == INFINITY) {
+		return false;
+	}
+
+	for (;;) {
+		const Node& node = mNodes[nodeIndex];
+		if (node.Count != 0) {
+			for (uint32_t i = node.LeftOrFirst; i < node.LeftOrFirst + node.Count; i++) {
+				float entry = IntersectBox(mItems[i].Min, mItems[i].Max, origin, invDir, closest);
+				if (entry < closest) {
+					found = true;
+					closest = entry;
+					id = mItems[i].Id;
+				}
+			}
+		}
+		else {
+			// Visit the nearer child first; the farther one waits on the stack.
+			uint32_t near = node.LeftOrFirst;
+			uint32_t far = near + 1;
+			float tNear = IntersectBox(mNodes[near].Min, mNodes[near].Max, origin, invDir, closest);
+			float tFar = IntersectBox(mNodes[far].Min, mNodes[far].Max, origin, invDir, closest);
+			if (tFar < tNear) {
+				std::swap(near, far);
+				std::swap(tNear, tFar);
+			}
+			if (tNear != INFINITY) {
+				if (tFar != INFINITY) {
+					stackT[stackSize] = tFar;
+					stack[stackSize++] = far;
+				}
+				nodeIndex = near;
+				continue;
+			}
+		}
+
+		do {
+			if (stackSize == 0) {
+				if (found) {
+					t = closest;
+				}
+				return found;
+			}
+			stackSize--;
+		} while (stackT[stackSize] >= closest);
+		nodeIndex = stack[stackSize];
+	}
+}
+
+SceneBVHBenchmark BenchmarkSceneBVH(uint32_t objects, float movedFraction, uint32_t frames) {
+	typedef std::chrono::steady_clock Clock;
+	auto seconds = [](Clock::time_point start) {
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	};
+
+	// Objects of 0.5 to 5 units in a cube whose side grows with the count, so that
+	// the density stays that of 100K objects in 2000 units.
+	float side = 2000.0f * std::cbrt(objects / 100000.0f);
+	std::mt19937 rng(objects);
+	std::uniform_real_distribution<float> position(-0.5f * side, 0.5f * side);
+	std::uniform_real_distribution<float> size(0.25f, 2.5f);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::vector<float> bounds((size_t)objects * 6);
+	std::vector<float> velocity((size_t)objects * 3);
+	for (uint32_t i = 0; i < objects; i++) {
+		float* box = &bounds[(size_t)i * 6];
+		for (int k = 0; k < 3; k++) {
+			float center = position(rng);
+			float extent = size(rng);
+			box[k] = center - extent;
+			box[3 + k] = center + extent;
+			velocity[(size_t)i * 3 + k] = 2.0f * unit(rng);
+		}
+	}
+
+	SceneBVHBenchmark bench;
+	bench.Objects = objects;
+	auto start = Clock::now();
+	SceneBVH bvh(bounds);
+	bench.BuildMs = seconds(start) * 1000.0;
+	bench.Nodes = bvh.NodeCount();
+
+	// The same objects move every frame, with constant velocities.
+	uint32_t moving = (uint32_t)(objects * std::min(std::max(movedFraction, 0.0f), 1.0f));
+	double updateSeconds = 0.0;
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		for (uint32_t i = 0; i < moving; i++) {
+			float* box = &bounds[(size_t)i * 6];
+			for (int k = 0; k < 3; k++) {
+				box[k] += velocity[(size_t)i * 3 + k];
+				box[3 + k] += velocity[(size_t)i * 3 + k];
+			}
+			bvh.SetBounds(i, box, box + 3);
+		}
+		start = Clock::now();
+		bench.Rebuilds += bvh.Update() ? 1 : 0;
+		updateSeconds += seconds(start);
+	}
+	bench.Frames = frames;
+	bench.UpdateMs = frames ? updateSeconds * 1000.0 / frames : 0.0;
+	float refittedCost = bvh.Cost();
+	bvh.Rebuild();
+	bench.CostRatio = bvh.Cost() > 0.0f ? refittedCost / bvh.Cost() : 1.0f;
+
+	// Frustums of a 60 degree camera at the center, 1000 units deep, looking in random
+	// directions.
+	const uint32_t frustumCount = 64;
+	std::vector<Frustum> frustums;
+	for (uint32_t f = 0; f < frustumCount; f++) {
+		float forward[3] = { unit(rng), unit(rng), unit(rng) };
+		float length = std::sqrt(forward[0] * forward[0] + forward[1] * forward[1] + forward[2] * forward[2]) + 1e-6f;
+		for (float& v : forward) {
+			v /= length;
+		}
+		float up[3] = { 0.0f, 1.0f, 0.0f };
+		if (std::fabs(forward[1]) > 0.99f) {
+			up[1] = 0.0f;
+			up[2] = 1.0f;
+		}
+		float right[3] = { up[1] * forward[2] - up[2] * forward[1], up[2] * forward[0] - up[0] * forward[2], up[0] * forward[1] - up[1] * forward[0] };
+		length = std::sqrt(right[0] * right[0] + right[1] * right[1] + right[2] * right[2]);
+		for (float& v : right) {
+			v /= length;
+		}
+		float trueUp[3] = { forward[1] * right[2] - forward[2] * right[1], forward[2] * right[0] - forward[0] * right[2], forward[0] * right[1] - forward[1] * right[0] };
+		// The view matrix of a camera at the origin has the axes as columns.
+		const float nearZ = 0.1f;
+		const float farZ = 1000.0f;
+		float yScale = 1.0f / std::tan(0.5f * 1.0471976f);
+		float scale[3] = { yScale * 9.0f / 16.0f, yScale, farZ / (farZ - nearZ) };
+		float viewProj[4][4] = {};
+		for (int row = 0; row < 3; row++) {
+			viewProj[row][0] = right[row] * scale[0];
+			viewProj[row][1] = trueUp[row] * scale[1];
+			viewProj[row][2] = forward[row] * scale[2];
+			viewProj[row][3] = forward[row];
+		}
+		viewProj[3][2] = -nearZ * scale[2];
+		frustums.push_back(FrustumFromViewProj(viewProj));
+	}
+
+	std::vector<uint32_t> ids;
+	size_t found = 0;
+	start = Clock::now();
+	for (const Frustum& frustum : frustums) {
+		bvh.QueryFrustum(frustum, ids);
+		found += ids.size();
+	}
+	double elapsed = seconds(start);
+	bench.FrustumQueriesPerSecond = elapsed > 0.0 ? frustumCount / elapsed : 0.0;
+	bench.FrustumObjects = (double)found / frustumCount;
+
+	CullingBounds flat;
+	flat.Reserve(objects);
+	for (uint32_t i = 0; i < objects; i++) {
+		const float* box = &bounds[(size_t)i * 6];
+		float center[3], extents[3];
+		for (int k = 0; k < 3; k++) {
+			center[k] = 0.5f * (box[k] + box[3 + k]);
+			extents[k] = 0.5f * (box[3 + k] - box[k]);
+		}
+		flat.Add(center, extents, INFINITY);
+	}
+	start = Clock::now();
+	for (const Frustum& frustum : frustums) {
+		flat.Cull(frustum, ids);
+	}
+	elapsed = seconds(start);
+	bench.FlatCullsPerSecond = elapsed > 0.0 ? frustumCount / elapsed : 0.0;
+
+	const uint32_t queryCount = 100000;
+	std::uniform_real_distribution<float> inside(-0.5f * side, 0.5f * side);
+	start = Clock::now();
+	for (uint32_t q = 0; q < queryCount; q++) {
+		float center[3] = { inside(rng), inside(rng), inside(rng) };
+		bvh.QuerySphere(center, 20.0f, ids);
+	}
+	elapsed = seconds(start);
+	bench.SphereQueriesPerSecond = elapsed > 0.0 ? queryCount / elapsed : 0.0;
+
+	start = Clock::now();
+	for (uint32_t q = 0; q < queryCount; q++) {
+		float min[3] = { inside(rng), inside(rng), inside(rng) };
+		float max[3] = { min[0] + 40.0f, min[1] + 40.0f, min[2] + 40.0f };
+		bvh.QueryBox(min, max, ids);
+	}
+	elapsed = seconds(start);
+	bench.BoxQueriesPerSecond = elapsed > 0.0 ? queryCount / elapsed : 0.0;
+
+	start = Clock::now();
+	for (uint32_t q = 0; q < queryCount; q++) {
+		float origin[3] = { inside(rng), inside(rng), inside(rng) };
+		float dir[3] = { unit(rng), unit(rng), unit(rng) };
+		uint32_t id;
+		float t;
+		bvh.Raycast(origin, dir, INFINITY, id, t);
+	}
+	elapsed = seconds(start);
+	bench.RaysPerSecond = elapsed > 0.0 ? queryCount / elapsed : 0.0;
+	return bench;
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include "FrustumCulling.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct RayHit {
+	float T = 0.0f;
+	uint32_t Triangle = 0;
+	// Barycentrics of the hit: weight of vertex 1 and vertex 2.
+	float U = 0.0f;
+	float V = 0.0f;
+};
+
+// Bounding volume hierarchy over a static triangle soup for CPU ray queries, built
+// with binned SAH.  Triangle indices in hits refer to the input order.
+class TriangleBVH {
+public:
+	TriangleBVH() = default;
+	// positions holds xyz per vertex, indices three vertices per triangle.
+	TriangleBVH(const std::vector<float>& positions, const std::vector<uint32_t>& indices);
+
+	uint32_t TriangleCount()const { return (uint32_t)mTriangles.size(); }
+	uint32_t NodeCount()const { return (uint32_t)mNodes.size(); }
+	void Bounds(float min[3], float max[3])const;
+
+	// Closest hit along origin + t * dir with 0 < t < tMax.  dir need not be unit length.
+	bool Intersect(const float origin[3], const float dir[3], float tMax, RayHit& hit)const;
+	// Any hit with 0 < t < tMax; cheaper than Intersect.
+	bool Occluded(const float origin[3], const float dir[3], float tMax)const;
+
+private:
+	struct Node {
+		float Min[3];
+		// Interior nodes: index of the first child, the second one follows it.
+		// Leaves: first entry in mTriangles.
+		uint32_t LeftOrFirst;
+		float Max[3];
+		// Triangles in a leaf, 0 for interior nodes.
+		uint32_t Count;
+	};
+
+	// Vertex 0 and the two edges from it, for Moller-Trumbore.
+	struct Triangle {
+		float V0[3];
+		float E1[3];
+		float E2[3];
+		uint32_t Id;
+	};
+
+	template <bool AnyHit>
+	bool Traverse(const float origin[3], const float dir[3], float tMax, RayHit* hit)const;
+
+private:
+	std::vector<Node> mNodes;
+	std::vector<Triangle> mTriangles;
+};
+
+// Bounding volume hierarchy over the boxes of objects that move, such as render
+// items, for culling and spatial queries.  Moving objects refit the boxes above them
+// at the next Update, and the tree is rebuilt with binned SAH once refitting has
+// made it too loose.  Queries skip the tests below nodes wholly inside the query
+// volume.  Ids are the object indices given to the constructor.
+class SceneBVH {
+public:
+	SceneBVH() = default;
+	// bounds holds the box of each object: min xyz, then max xyz.
+	explicit SceneBVH(const std::vector<float>& bounds);
+
+	uint32_t ObjectCount()const { return (uint32_t)mItems.size(); }
+	uint32_t NodeCount()const { return (uint32_t)mNodes.size(); }
+	// SAH cost of the tree, in object tests of a ray through the root box.
+	float Cost()const;
+
+	// The new box takes effect at the next Update.
+	void SetBounds(uint32_t id, const float min[3], const float max[3]);
+	// Refits the nodes above the objects moved since the last call, or all nodes when
+	// many moved.  Rebuilds when the cost has grown past rebuildRatio times the cost
+	// after the last build, and returns whether it did.
+	bool Update(float rebuildRatio = 1.5f);
+	void Rebuild();
+
+	// Replace ids with the objects whose boxes may intersect the volume, in no
+	// particular order.  The frustum test is the box test of CullingBounds.
+	void QueryFrustum(const Frustum& frustum, std::vector<uint32_t>& ids)const;
+	void QuerySphere(const float center[3], float radius, std::vector<uint32_t>& ids)const;
+	void QueryBox(const float min[3], const float max[3], std::vector<uint32_t>& ids)const;
+	// The object whose box origin + t * dir enters first with 0 <= t < tMax; t is 0
+	// when the origin is inside the box.
+	bool Raycast(const float origin[3], const float dir[3], float tMax, uint32_t& id, float& t)const;
+
+private:
+	struct Node {
+		float Min[3];
+		// Interior nodes: index of the first child, the second one follows it.
+		// Leaves: first entry in mItems.
+		uint32_t LeftOrFirst;
+		float Max[3];
+		// Objects in a leaf, 0 for interior nodes.
+		uint32_t Count;
+	};
+
+	// An object box in leaf order.
+	struct Item {
+		float Min[3];
+		uint32_t Id;
+		float Max[3];
+	};
+
+	// Recomputes the box of a node from its items or children and returns whether it
+	// changed.
+	bool RefitNode(uint32_t index);
+	// Calls test(min, max, state) on the nodes and then the items under the ones it
+	// accepts.  state starts at initialState and is passed down; once a test sets it
+	// to 0, the whole subtree is inside and is taken without tests.
+	template <typename Test>
+	void Collect(uint32_t initialState, const Test& test, std::vector<uint32_t>& ids)const;
+
+private:
+	std::vector<Node> mNodes;
+	std::vector<Item> mItems;
+	std::vector<uint32_t> mParents;
+	// Per id: position in mItems, leaf node, and whether it moved since Update.
+	std::vector<uint32_t> mSlots;
+	std::vector<uint32_t> mLeaves;
+	std::vector<uint8_t> mMoved;
+	std::vector<uint32_t> mMovedIds;
+	// Sum of the half areas of the nodes weighted by their cost, kept through refits.
+	double mCostSum = 0.0;
+	float mBuiltCost = 0.0f;
+};
+
+struct SceneBVHBenchmark {
+	uint32_t Objects = 0;
+	uint32_t Nodes = 0;
+	double BuildMs = 0.0;
+	// Mean Update time per frame with the moving objects, and the rebuilds it made.
+	double UpdateMs = 0.0;
+	uint32_t Frames = 0;
+	uint32_t Rebuilds = 0;
+	// Cost of the refitted tree relative to a fresh build at the end.
+	float CostRatio = 1.0f;
+	// Queries per second, and the objects a frustum query returned on average.
+	double FrustumQueriesPerSecond = 0.0;
+	double FlatCullsPerSecond = 0.0;
+	double FrustumObjects = 0.0;
+	double SphereQueriesPerSecond = 0.0;
+	double BoxQueriesPerSecond = 0.0;
+	double RaysPerSecond = 0.0;
+};
+
+// Builds a tree over objects scattered in a cube, moves movedFraction of them every
+// frame for frames frames, and runs each query against it.  Frustum queries are
+// compared with culling all objects with CullingBounds.
+SceneBVHBenchmark BenchmarkSceneBVH(uint32_t objects, float movedFraction = 0.1f, uint32_t frames = 16);
@@ -0,0 +1,100 @@
+#include "BindlessDescriptorHeap.h"
+#include <algorithm>
+
+using Microsoft::WRL::ComPtr;
+
+BindlessDescriptorHeap::BindlessDescriptorHeap(ID3D12Device* device, uint32_t persistentCapacity,
+	uint32_t transientPerFrame, uint32_t frameCount, uint32_t maxPersistentCapacity)
+	: mDevice(device), mTransientPerFrame(transientPerFrame), mTransientCount(transientPerFrame * frameCount),
+	mIndices(std::max(persistentCapacity, 1u), maxPersistentCapacity)
+{
+	mDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	CreateHeaps(mIndices.Capacity());
+}
+
+void BindlessDescriptorHeap::CreateHeaps(uint32_t persistentCapacity) {
+	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+	heapDesc.NumDescriptors = mTransientCount + persistentCapacity;
+	heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	ThrowIfFailed(mDevice->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(mHeap.ReleaseAndGetAddressOf())));
+
+	heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+	ThrowIfFailed(mDevice->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(mStagingHeap.ReleaseAndGetAddressOf())));
+}
+
+void BindlessDescriptorHeap::BeginFrame(uint32_t frameIndex, uint64_t completedFence) {
+	mFrameIndex = frameIndex;
+	mTransientUsed.store(0, std::memory_order_relaxed);
+	mIndices.ReleaseCompleted(completedFence);
+	mRetiredHeaps.erase(std::remove_if(mRetiredHeaps.begin(), mRetiredHeaps.end(),
+		[completedFence](const std::pair<ComPtr<ID3D12DescriptorHeap>, uint64_t>& retired) {
+			return retired.second <= completedFence;
+		}), mRetiredHeaps.end());
+}
+
+uint32_t BindlessDescriptorHeap::AllocatePersistent(uint64_t currentFence) {
+	uint32_t index = mIndices.Allocate();
+	if (index != kNoDescriptor) {
+		return index;
+	}
+
+	uint32_t oldCapacity = mIndices.Capacity();
+	uint32_t newCapacity = std::min(oldCapacity * 2, mIndices.MaxCapacity());
+	if (newCapacity == oldCapacity) {
+		throw std::runtime_error("BindlessDescriptorHeap: out of persistent descriptors");
+	}
+
+	// The staging heap holds everything written so far; copy it into the new pair.
+	ComPtr<ID3D12DescriptorHeap> oldStaging = mStagingHeap;
+	mRetiredHeaps.emplace_back(mHeap, currentFence);
+	CreateHeaps(newCapacity);
+	UINT oldCount = mTransientCount + oldCapacity;
+	mDevice->CopyDescriptorsSimple(oldCount, mStagingHeap->GetCPUDescriptorHandleForHeapStart(),
+		oldStaging->GetCPUDescriptorHandleForHeapStart(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	mDevice->CopyDescriptorsSimple(oldCount, mHeap->GetCPUDescriptorHandleForHeapStart(),
+		mStagingHeap->GetCPUDescriptorHandleForHeapStart(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+	mIndices.Grow(newCapacity);
+	return AllocatePersistent(currentFence);
+}
+
+void BindlessDescriptorHeap::Publish(uint32_t heapSlot) {
+	CD3DX12_CPU_DESCRIPTOR_HANDLE source(mStagingHeap->GetCPUDescriptorHandleForHeapStart(), heapSlot, mDescriptorSize);
+	CD3DX12_CPU_DESCRIPTOR_HANDLE destination(mHeap->GetCPUDescriptorHandleForHeapStart(), heapSlot, mDescriptorSize);
+	mDevice->CopyDescriptorsSimple(1, destination, source, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+}
+
+void BindlessDescriptorHeap::CreateSrv(uint32_t index, ID3D12Resource* resource,
+	const D3D12_SHADER_RESOURCE_VIEW_DESC* desc)
+{
+	uint32_t heapSlot = mTransientCount + index;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE handle(mStagingHeap->GetCPUDescriptorHandleForHeapStart(), heapSlot, mDescriptorSize);
+	mDevice->CreateShaderResourceView(resource, desc, handle);
+	Publish(heapSlot);
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE BindlessDescriptorHeap::PersistentGpuHandle(uint32_t index)const {
+	return CD3DX12_GPU_DESCRIPTOR_HANDLE(mHeap->GetGPUDescriptorHandleForHeapStart(), mTransientCount + index,
+		mDescriptorSize);
+}
+
+uint32_t BindlessDescriptorHeap::AllocateTransient(uint32_t count) {
+	uint32_t first = mTransientUsed.fetch_add(count, std::memory_order_relaxed);
+	if (first + count > mTransientPerFrame) {
+		return kNoDescriptor;
+	}
+	return mFrameIndex * mTransientPerFrame + first;
+}
+
+void BindlessDescriptorHeap::CreateTransientSrv(uint32_t slot, ID3D12Resource* resource,
+	const D3D12_SHADER_RESOURCE_VIEW_DESC* desc)
+{
+	CD3DX12_CPU_DESCRIPTOR_HANDLE handle(mStagingHeap->GetCPUDescriptorHandleForHeapStart(), slot, mDescriptorSize);
+	mDevice->CreateShaderResourceView(resource, desc, handle);
+	Publish(slot);
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE BindlessDescriptorHeap::TransientGpuHandle(uint32_t slot)const {
+	return CD3DX12_GPU_DESCRIPTOR_HANDLE(mHeap->GetGPUDescriptorHandleForHeapStart(), slot, mDescriptorSize);
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "DescriptorIndexAllocator.h"
+
+// The one shader visible CBV/SRV/UAV heap of the app.  It holds a ring of transient
+// descriptors per frame resource, followed by persistent descriptors whose indices
+// stay valid until they are freed.  Shaders index the persistent part through an
+// unbounded table starting at PersistentGpuHandle(0), so a persistent index is what
+// goes into MaterialData.
+//
+// Descriptors are written to a CPU only copy of the heap and then copied over, so
+// that growing can rebuild the shader visible heap from it.  A grown heap replaces
+// the old one for the next SetDescriptorHeaps; the old one lives until the GPU has
+// passed the fence it was replaced at.
+class BindlessDescriptorHeap {
+public:
+	BindlessDescriptorHeap(ID3D12Device* device, uint32_t persistentCapacity, uint32_t transientPerFrame,
+		uint32_t frameCount, uint32_t maxPersistentCapacity = 1u << 20);
+	BindlessDescriptorHeap(const BindlessDescriptorHeap& rhs) = delete;
+	BindlessDescriptorHeap& operator=(const BindlessDescriptorHeap& rhs) = delete;
+
+	ID3D12DescriptorHeap* Heap()const { return mHeap.Get(); }
+	DescriptorIndexAllocator& Indices() { return mIndices; }
+
+	// Starts frame resource frameIndex: resets its transient ring and releases the
+	// frees and old heaps the GPU is done with.  Call after waiting for its fence.
+	void BeginFrame(uint32_t frameIndex, uint64_t completedFence);
+
+	// Allocates a persistent index, doubling the heap when it is full.  Growing
+	// touches the heap, so this runs on the render thread outside of recording;
+	// other threads allocate through Indices() and leave growing to it.  currentFence
+	// is the fence value the GPU reaches after the commands recorded so far.
+	uint32_t AllocatePersistent(uint64_t currentFence);
+	void CreateSrv(uint32_t index, ID3D12Resource* resource, const D3D12_SHADER_RESOURCE_VIEW_DESC* desc);
+	// The descriptor stays readable until the GPU passes fence.
+	void FreePersistent(uint32_t index, uint64_t fence) { mIndices.FreeDeferred(index, fence); }
+	D3D12_GPU_DESCRIPTOR_HANDLE PersistentGpuHandle(uint32_t index)const;
+
+	// First of count consecutive descriptors of the current frame, valid until its
+	// frame resource comes around again, or kNoDescriptor when the ring is full.
+	// Lock-free.
+	uint32_t AllocateTransient(uint32_t count);
+	void CreateTransientSrv(uint32_t slot, ID3D12Resource* resource, const D3D12_SHADER_RESOURCE_VIEW_DESC* desc);
+	D3D12_GPU_DESCRIPTOR_HANDLE TransientGpuHandle(uint32_t slot)const;
+
+private:
+	void CreateHeaps(uint32_t persistentCapacity);
+	void Publish(uint32_t heapSlot);
+
+private:
+	ID3D12Device* mDevice;
+	uint32_t mDescriptorSize;
+	uint32_t mTransientPerFrame;
+	uint32_t mTransientCount;
+	DescriptorIndexAllocator mIndices;
+
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mHeap;
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mStagingHeap;
+	std::vector<std::pair<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>, uint64_t>> mRetiredHeaps;
+
+	uint32_t mFrameIndex = 0;
+	std::atomic<uint32_t> mTransientUsed{ 0 };
+};
@@ -0,0 +1,24 @@
+#include "CompressedTexture.h"
+
+CompressedTexture::CompressedTexture(uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t arraySize, bool isCube,
+	uint32_t dxgiFormat, uint32_t blockBytes, uint32_t blockDim)
+{
+	mWidth = width;
+	mHeight = height;
+	mMipLevels = mipLevels;
+	mArraySize = arraySize;
+	mIsCube = isCube;
+	mDxgiFormat = dxgiFormat;
+	mBlockBytes = blockBytes;
+	mBlockDim = blockDim;
+
+	size_t offset = 0;
+	mOffsets.resize((size_t)arraySize * mipLevels);
+	for (uint32_t item = 0; item < arraySize; item++) {
+		for (uint32_t mip = 0; mip < mipLevels; mip++) {
+			mOffsets[item * mipLevels + mip] = offset;
+			offset += SubresourceBytes(mip);
+		}
+	}
+	mData.resize(offset, 0);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// DXGI_FORMAT values of the formats the CPU encoders produce, so the portable code
+// does not need dxgiformat.h.
+const uint32_t kDxgiFormatR32G32B32A32Float = 2;
+const uint32_t kDxgiFormatR16G16B16A16Float = 10;
+const uint32_t kDxgiFormatR11G11B10Float = 26;
+const uint32_t kDxgiFormatR8G8B8A8Unorm = 28;
+const uint32_t kDxgiFormatR8G8B8A8UnormSrgb = 29;
+const uint32_t kDxgiFormatR9G9B9E5SharedExp = 67;
+const uint32_t kDxgiFormatBC1Unorm = 71;
+const uint32_t kDxgiFormatBC1UnormSrgb = 72;
+const uint32_t kDxgiFormatBC4Unorm = 80;
+const uint32_t kDxgiFormatBC5Unorm = 83;
+const uint32_t kDxgiFormatBC6HUF16 = 95;
+const uint32_t kDxgiFormatBC6HSF16 = 96;
+const uint32_t kDxgiFormatBC7Unorm = 98;
+const uint32_t kDxgiFormatBC7UnormSrgb = 99;
+
+// 4x4 block compressed texture: a 2D texture, array or cube with a mip chain.
+// Subresources are stored array item major, then mip, the order of DDS files and
+// of D3D12 subresource indices.  Uncompressed formats use blockDim 1, so that a
+// block is one texel and blockBytes the texel size.
+class CompressedTexture {
+public:
+	CompressedTexture() = default;
+	// For cubes arraySize counts faces, so it is a multiple of six.
+	CompressedTexture(uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t arraySize, bool isCube,
+		uint32_t dxgiFormat, uint32_t blockBytes, uint32_t blockDim = 4);
+
+	uint32_t Width()const { return mWidth; }
+	uint32_t Height()const { return mHeight; }
+	uint32_t MipLevels()const { return mMipLevels; }
+	uint32_t ArraySize()const { return mArraySize; }
+	bool IsCube()const { return mIsCube; }
+	uint32_t DxgiFormat()const { return mDxgiFormat; }
+	uint32_t BlockBytes()const { return mBlockBytes; }
+	uint32_t BlockDim()const { return mBlockDim; }
+	bool IsBlockCompressed()const { return mBlockDim > 1; }
+
+	uint32_t MipWidth(uint32_t mip)const { return mWidth >> mip ? mWidth >> mip : 1; }
+	uint32_t MipHeight(uint32_t mip)const { return mHeight >> mip ? mHeight >> mip : 1; }
+	uint32_t BlocksWide(uint32_t mip)const { return (MipWidth(mip) + mBlockDim - 1) / mBlockDim; }
+	uint32_t BlocksHigh(uint32_t mip)const { return (MipHeight(mip) + mBlockDim - 1) / mBlockDim; }
+	size_t RowPitch(uint32_t mip)const { return (size_t)BlocksWide(mip) * mBlockBytes; }
+	size_t SubresourceBytes(uint32_t mip)const { return RowPitch(mip) * BlocksHigh(mip); }
+
+	uint8_t* Blocks(uint32_t item, uint32_t mip) { return mData.data() + mOffsets[item * mMipLevels + mip]; }
+	const uint8_t* Blocks(uint32_t item, uint32_t mip)const { return mData.data() + mOffsets[item * mMipLevels + mip]; }
+
+	const uint8_t* Data()const { return mData.data(); }
+	size_t ByteSize()const { return mData.size(); }
+
+private:
+	uint32_t mWidth = 0;
+	uint32_t mHeight = 0;
+	uint32_t mMipLevels = 0;
+	uint32_t mArraySize = 0;
+	bool mIsCube = false;
+	uint32_t mDxgiFormat = 0;
+	uint32_t mBlockBytes = 0;
+	uint32_t mBlockDim = 4;
+	std::vector<size_t> mOffsets;
+	std::vector<uint8_t> mData;
+};
@@ -0,0 +1,126 @@
+#include "ContentHash.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+	const uint64_t kC1 = 0x87c37b91114253d5ull;
+	const uint64_t kC2 = 0x4cf5ad432745937full;
+
+	uint64_t Rotl(uint64_t x, int r) {
+		return (x << r) | (x >> (64 - r));
+	}
+
+	uint64_t FMix(uint64_t k) {
+		k ^= k >> 33;
+		k *= 0xff51afd7ed558ccdull;
+		k ^= k >> 33;
+		k *= 0xc4ceb9fe1a85ec53ull;
+		k ^= k >> 33;
+		return k;
+	}
+
+	uint64_t LoadTail(const uint8_t* tail, size_t begin, size_t end) {
+		uint64_t k = 0;
+		for (size_t i = end; i > begin; i--) {
+			k = (k << 8) | tail[i - 1];
+		}
+		return k;
+	}
+}
+
+std::string ContentHash::ToString()const {
+	static const char kDigits[] = "0123456789abcdef";
+	std::string text(32, '0');
+	for (int i = 0; i < 16; i++) {
+		text[i] = kDigits[(High >> (60 - 4 * i)) & 0xf];
+		text[16 + i] = kDigits[(Low >> (60 - 4 * i)) & 0xf];
+	}
+	return text;
+}
+
+bool ContentHash::FromString(const std::string& text, ContentHash& hash) {
+	if (text.size() != 32) {
+		return false;
+	}
+	uint64_t words[2] = {};
+	for (int i = 0; i < 32; i++) {
+		char c = text[i];
+		uint64_t digit;
+		if (c >= '0' && c <= '9') {
+			digit = c - '0';
+		}
+		else if (c >= 'a' && c <= 'f') {
+			digit = c - 'a' + 10;
+		}
+		else if (c >= 'A' && c <= 'F') {
+			digit = c - 'A' + 10;
+		}
+		else {
+			return false;
+		}
+		words[i / 16] = (words[i / 16] << 4) | digit;
+	}
+	hash.High = words[0];
+	hash.Low = words[1];
+	return true;
+}
+
+ContentHash HashBytes(const void* data, size_t size, uint32_t seed) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	size_t blockCount = size / 16;
+
+	uint64_t h1 = seed;
+	uint64_t h2 = seed;
+	for (size_t i = 0; i < blockCount; i++) {
+		uint64_t k1, k2;
+		std::memcpy(&k1, bytes + i * 16, 8);
+		std::memcpy(&k2, bytes + i * 16 + 8, 8);
+
+		k1 *= kC1; k1 = Rotl(k1, 31); k1 *= kC2; h1 ^= k1;
+		h1 = Rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+		k2 *= kC2; k2 = Rotl(k2, 33); k2 *= kC1; h2 ^= k2;
+		h2 = Rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	const uint8_t* tail = bytes + blockCount * 16;
+	size_t tailSize = size & 15;
+	if (tailSize > 8) {
+		uint64_t k2 = LoadTail(tail, 8, tailSize);
+		k2 *= kC2; k2 = Rotl(k2, 33); k2 *= kC1; h2 ^= k2;
+	}
+	if (tailSize > 0) {
+		uint64_t k1 = LoadTail(tail, 0, tailSize < 8 ? tailSize : 8);
+		k1 *= kC1; k1 = Rotl(k1, 31); k1 *= kC2; h1 ^= k1;
+	}
+
+	h1 ^= size;
+	h2 ^= size;
+	h1 += h2;
+	h2 += h1;
+	h1 = FMix(h1);
+	h2 = FMix(h2);
+	h1 += h2;
+	h2 += h1;
+
+	ContentHash hash;
+	hash.Low = h1;
+	hash.High = h2;
+	return hash;
+}
+
+ContentHash HashFile(const std::string& path) {
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file) {
+		throw std::runtime_error("Cannot open " + path);
+	}
+	std::vector<char> contents((size_t)file.tellg());
+	file.seekg(0);
+	file.read(contents.data(), (std::streamsize)contents.size());
+	if (!file) {
+		throw std::runtime_error("Failed reading " + path);
+	}
+	return HashBytes(contents.data(), contents.size());
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 128 bit MurmurHash3 (x64 variant) of some bytes.  Not cryptographic; used to tell
+// whether cooked assets are still in sync with their sources.
+struct ContentHash {
+	uint64_t Low = 0;
+	uint64_t High = 0;
+
+	bool operator==(const ContentHash& rhs)const { return Low == rhs.Low && High == rhs.High; }
+	bool operator!=(const ContentHash& rhs)const { return !(*this == rhs); }
+
+	// 32 lowercase hex digits, High first.
+	std::string ToString()const;
+	// Parses the output of ToString.  Returns false on malformed input.
+	static bool FromString(const std::string& text, ContentHash& hash);
+};
+
+ContentHash HashBytes(const void* data, size_t size, uint32_t seed = 0);
+
+// Hashes a whole file.  Throws std::runtime_error when it cannot be read.
+ContentHash HashFile(const std::string& path);
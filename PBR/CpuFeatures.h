@@ -0,0 +1,18 @@
+#pragma once
+
+// AVX2 code paths are always compiled on x86; functions that use the intrinsics are
+// tagged CPU_AVX2_TARGET so GCC/Clang accept them without -mavx2, and they are only
+// called when CpuHasAVX2() reports support at run time.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define CPU_AVX2_COMPILED 1
+#define CPU_AVX2_TARGET
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_AVX2_COMPILED 1
+#define CPU_AVX2_TARGET __attribute__((target("avx2,fma")))
+#else
+#define CPU_AVX2_COMPILED 0
+#define CPU_AVX2_TARGET
+#endif
+
+// True when the processor and OS support AVX2 and FMA3.  Cached after the first call.
+bool CpuHasAVX2();
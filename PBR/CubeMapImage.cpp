@@ -0,0 +1,66 @@
+#include "CubeMapImage.h"
+
+// Right = cross(Up, LookAt).  World up (0,1,0) is used for every face except +Y/-Y,
+// which look down the up axis and need a different "up" vector.
+const CubeFaceBasis gCubeFaceBasis[6] = {
+	{ { +1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f } }, // +X
+	{ { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, +1.0f } }, // -X
+	{ { 0.0f, +1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f } }, // +Y
+	{ { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, +1.0f }, { 1.0f, 0.0f, 0.0f } }, // -Y
+	{ { 0.0f, 0.0f, +1.0f }, { 0.0f, 1.0f, 0.0f }, { +1.0f, 0.0f, 0.0f } }, // +Z
+	{ { 0.0f, 0.0f, -1.0f }, { 0.0f, 1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f } }, // -Z
+};
+
+void CubeFaceDirection(uint32_t face, float u, float v, float dir[3]) {
+	const CubeFaceBasis& b = gCubeFaceBasis[face];
+	float x = 2.0f * u - 1.0f;
+	float y = 1.0f - 2.0f * v;
+	for (int i = 0; i < 3; i++) {
+		dir[i] = x * b.Right[i] + y * b.Up[i] + b.LookAt[i];
+	}
+}
+
+CubeMapImage::CubeMapImage(uint32_t size, uint32_t mipLevels) {
+	mSize = size;
+
+	uint32_t fullChain = 1;
+	while ((size >> fullChain) != 0) {
+		fullChain++;
+	}
+	mMipLevels = (mipLevels == 0 || mipLevels > fullChain) ? fullChain : mipLevels;
+
+	size_t offset = 0;
+	mOffsets.resize(6 * mMipLevels);
+	for (uint32_t face = 0; face < 6; face++) {
+		for (uint32_t mip = 0; mip < mMipLevels; mip++) {
+			mOffsets[face * mMipLevels + mip] = offset;
+			offset += (size_t)MipSize(mip) * MipSize(mip) * 4;
+		}
+	}
+	mData.resize(offset, 0.0f);
+}
+
+void CubeMapImage::GenerateMips() {
+	for (uint32_t face = 0; face < 6; face++) {
+		for (uint32_t mip = 1; mip < mMipLevels; mip++) {
+			uint32_t srcSize = MipSize(mip - 1);
+			uint32_t dstSize = MipSize(mip);
+			const float* src = Texels(face, mip - 1);
+			float* dst = Texels(face, mip);
+
+			for (uint32_t y = 0; y < dstSize; y++) {
+				uint32_t y0 = 2 * y;
+				uint32_t y1 = srcSize > 1 ? y0 + 1 : y0;
+				for (uint32_t x = 0; x < dstSize; x++) {
+					uint32_t x0 = 2 * x;
+					uint32_t x1 = srcSize > 1 ? x0 + 1 : x0;
+					for (int c = 0; c < 4; c++) {
+						dst[(y * dstSize + x) * 4 + c] = 0.25f * (
+							src[(y0 * srcSize + x0) * 4 + c] + src[(y0 * srcSize + x1) * 4 + c] +
+							src[(y1 * srcSize + x0) * 4 + c] + src[(y1 * srcSize + x1) * 4 + c]);
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Face basis shared by the GPU bakers (RenderTexture::BuildFaceConstant) and the CPU
+// cube map code.  The texel at uv in [0,1]^2 of face f looks along
+//     (2u - 1) * Right + (1 - 2v) * Up + LookAt
+// which matches the D3D TextureCube face layout.
+struct CubeFaceBasis {
+	float LookAt[3];
+	float Up[3];
+	float Right[3];
+};
+
+extern const CubeFaceBasis gCubeFaceBasis[6];
+
+// Unnormalized direction through uv on the given face.
+void CubeFaceDirection(uint32_t face, float u, float v, float dir[3]);
+
+// Linear RGBA32F cube map with a mip chain.  Faces and mips are stored in D3D12
+// subresource order (face major, then mip) so the data uploads without repacking.
+class CubeMapImage {
+public:
+	CubeMapImage() = default;
+	// mipLevels == 0 allocates the full chain down to 1x1.
+	CubeMapImage(uint32_t size, uint32_t mipLevels);
+
+	uint32_t Size()const { return mSize; }
+	uint32_t MipLevels()const { return mMipLevels; }
+	uint32_t MipSize(uint32_t mip)const { return mSize >> mip ? mSize >> mip : 1; }
+
+	float* Texels(uint32_t face, uint32_t mip) { return mData.data() + mOffsets[face * mMipLevels + mip]; }
+	const float* Texels(uint32_t face, uint32_t mip)const { return mData.data() + mOffsets[face * mMipLevels + mip]; }
+
+	size_t ByteSize()const { return mData.size() * sizeof(float); }
+
+	// Rebuilds mips 1..N-1 of every face from mip 0 with a 2x2 box filter.
+	void GenerateMips();
+
+private:
+	uint32_t mSize = 0;
+	uint32_t mMipLevels = 0;
+	std::vector<size_t> mOffsets;
+	std::vector<float> mData;
+};
@@ -0,0 +1,290 @@
+#include "CubeMapSampler.h"
+#include <algorithm>
+#include <cmath>
+#if CPU_AVX2_COMPILED
+#include <immintrin.h>
+#endif
+
+namespace {
+	// Face whose LookAt is +/- the given axis, indexed [axis * 2 + negative].  Derived
+	// from gCubeFaceBasis so the sampler follows whatever order the bakers use.
+	struct FaceTable {
+		int32_t FaceOfAxis[6];
+
+		FaceTable() {
+			for (uint32_t face = 0; face < 6; face++) {
+				const float* look = gCubeFaceBasis[face].LookAt;
+				for (int axis = 0; axis < 3; axis++) {
+					if (look[axis] != 0.0f) {
+						FaceOfAxis[axis * 2 + (look[axis] < 0.0f ? 1 : 0)] = (int32_t)face;
+					}
+				}
+			}
+		}
+	};
+
+	const FaceTable& Faces() {
+		static const FaceTable table;
+		return table;
+	}
+
+	void ClampLevel(float lod, uint32_t mipLevels, uint32_t& mip0, uint32_t& mip1, float& t) {
+		float maxLod = (float)(mipLevels - 1);
+		lod = std::min(std::max(lod, 0.0f), maxLod);
+		mip0 = (uint32_t)lod;
+		mip1 = std::min(mip0 + 1, mipLevels - 1);
+		t = lod - (float)mip0;
+	}
+}
+
+CubeFaceUV DirectionToFaceUV(const float dir[3]) {
+	float ax = std::fabs(dir[0]);
+	float ay = std::fabs(dir[1]);
+	float az = std::fabs(dir[2]);
+
+	int axis = (ax >= ay && ax >= az) ? 0 : (ay >= az ? 1 : 2);
+	CubeFaceUV result;
+	result.Face = (uint32_t)Faces().FaceOfAxis[axis * 2 + (dir[axis] < 0.0f ? 1 : 0)];
+
+	const CubeFaceBasis& b = gCubeFaceBasis[result.Face];
+	float ma = dir[0] * b.LookAt[0] + dir[1] * b.LookAt[1] + dir[2] * b.LookAt[2];
+	float sc = dir[0] * b.Right[0] + dir[1] * b.Right[1] + dir[2] * b.Right[2];
+	float tc = dir[0] * b.Up[0] + dir[1] * b.Up[1] + dir[2] * b.Up[2];
+	float invMa = ma > 0.0f ? 1.0f / ma : 0.0f;
+	result.U = 0.5f + 0.5f * sc * invMa;
+	result.V = 0.5f - 0.5f * tc * invMa;
+	return result;
+}
+
+void WrapCubeTexel(uint32_t& face, int32_t& x, int32_t& y, int32_t size) {
+	float dir[3];
+	CubeFaceDirection(face, (x + 0.5f) / size, (y + 0.5f) / size, dir);
+	CubeFaceUV uv = DirectionToFaceUV(dir);
+	face = uv.Face;
+	x = std::min(std::max((int32_t)(uv.U * size), 0), size - 1);
+	y = std::min(std::max((int32_t)(uv.V * size), 0), size - 1);
+}
+
+CubeMapSampler::CubeMapSampler(const CubeMapImage& image) {
+	mImage = &image;
+	mTexels = image.Texels(0, 0);
+
+	mLevelOffsets.resize(6 * image.MipLevels());
+	for (uint32_t face = 0; face < 6; face++) {
+		for (uint32_t mip = 0; mip < image.MipLevels(); mip++) {
+			mLevelOffsets[face * image.MipLevels() + mip] = (int32_t)(image.Texels(face, mip) - mTexels);
+		}
+	}
+}
+
+int32_t CubeMapSampler::TexelOffset(uint32_t face, uint32_t mip, int32_t x, int32_t y)const {
+	int32_t size = (int32_t)mImage->MipSize(mip);
+	if (x < 0 || y < 0 || x >= size || y >= size) {
+		WrapCubeTexel(face, x, y, size);
+	}
+	return mLevelOffsets[face * mImage->MipLevels() + mip] + (y * size + x) * 4;
+}
+
+void CubeMapSampler::AccumulateBilinear(uint32_t face, uint32_t mip, float u, float v, float weight, float rgba[4])const {
+	float size = (float)mImage->MipSize(mip);
+	float px = u * size - 0.5f;
+	float py = v * size - 0.5f;
+	float x0 = std::floor(px);
+	float y0 = std::floor(py);
+	float fx = px - x0;
+	float fy = py - y0;
+
+	const float* t00 = mTexels + TexelOffset(face, mip, (int32_t)x0, (int32_t)y0);
+	const float* t10 = mTexels + TexelOffset(face, mip, (int32_t)x0 + 1, (int32_t)y0);
+	const float* t01 = mTexels + TexelOffset(face, mip, (int32_t)x0, (int32_t)y0 + 1);
+	const float* t11 = mTexels + TexelOffset(face, mip, (int32_t)x0 + 1, (int32_t)y0 + 1);
+
+	float w00 = (1.0f - fx) * (1.0f - fy) * weight;
+	float w10 = fx * (1.0f - fy) * weight;
+	float w01 = (1.0f - fx) * fy * weight;
+	float w11 = fx * fy * weight;
+	for (int c = 0; c < 4; c++) {
+		rgba[c] += w00 * t00[c] + w10 * t10[c] + w01 * t01[c] + w11 * t11[c];
+	}
+}
+
+void CubeMapSampler::SampleBilinear(const float dir[3], uint32_t mip, float rgba[4])const {
+	CubeFaceUV uv = DirectionToFaceUV(dir);
+	rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0.0f;
+	AccumulateBilinear(uv.Face, std::min(mip, mImage->MipLevels() - 1), uv.U, uv.V, 1.0f, rgba);
+}
+
+void CubeMapSampler::SampleLevel(const float dir[3], float lod, float rgba[4])const {
+	uint32_t mip0, mip1;
+	float t;
+	ClampLevel(lod, mImage->MipLevels(), mip0, mip1, t);
+
+	CubeFaceUV uv = DirectionToFaceUV(dir);
+	rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0.0f;
+	AccumulateBilinear(uv.Face, mip0, uv.U, uv.V, 1.0f - t, rgba);
+	if (t > 0.0f) {
+		AccumulateBilinear(uv.Face, mip1, uv.U, uv.V, t, rgba);
+	}
+}
+
+void CubeMapSampler::SampleLevelScalar(const float* x, const float* y, const float* z, const float* lod,
+	uint32_t count, float* rgba)const
+{
+	for (uint32_t i = 0; i < count; i++) {
+		float dir[3] = { x[i], y[i], z[i] };
+		SampleLevel(dir, lod ? lod[i] : 0.0f, rgba + i * 4);
+	}
+}
+
+void CubeMapSampler::SampleLevel(const float* x, const float* y, const float* z, const float* lod,
+	uint32_t count, float* rgba)const
+{
+	uint32_t i = 0;
+#if CPU_AVX2_COMPILED
+	if (CpuHasAVX2()) {
+		for (; i + 8 <= count; i += 8) {
+			SampleLevelAVX2(x + i, y + i, z + i, lod ? lod + i : nullptr, rgba + i * 4);
+		}
+	}
+#endif
+	SampleLevelScalar(x + i, y + i, z + i, lod ? lod + i : nullptr, count - i, rgba + i * 4);
+}
+
+#if CPU_AVX2_COMPILED
+CPU_AVX2_TARGET void CubeMapSampler::SampleLevelAVX2(const float* x, const float* y, const float* z, const float* lod,
+	float* rgba)const
+{
+	// Per-face basis vectors as lookup tables, so every lane can fetch the basis of
+	// its own face with one permute.
+	alignas(32) float basis[9][8] = {};
+	for (uint32_t face = 0; face < 6; face++) {
+		const CubeFaceBasis& b = gCubeFaceBasis[face];
+		for (int i = 0; i < 3; i++) {
+			basis[i][face] = b.LookAt[i];
+			basis[3 + i][face] = b.Right[i];
+			basis[6 + i][face] = b.Up[i];
+		}
+	}
+	alignas(32) int32_t faceOfAxis[8] = {};
+	std::copy(Faces().FaceOfAxis, Faces().FaceOfAxis + 6, faceOfAxis);
+
+	__m256 dx = _mm256_loadu_ps(x);
+	__m256 dy = _mm256_loadu_ps(y);
+	__m256 dz = _mm256_loadu_ps(z);
+
+	// Face selection: major axis, then its sign.
+	__m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 ax = _mm256_and_ps(dx, absMask);
+	__m256 ay = _mm256_and_ps(dy, absMask);
+	__m256 az = _mm256_and_ps(dz, absMask);
+	__m256 isX = _mm256_and_ps(_mm256_cmp_ps(ax, ay, _CMP_GE_OQ), _mm256_cmp_ps(ax, az, _CMP_GE_OQ));
+	__m256 isY = _mm256_cmp_ps(ay, az, _CMP_GE_OQ);
+	__m256 major = _mm256_blendv_ps(_mm256_blendv_ps(dz, dy, isY), dx, isX);
+	__m256 axis2 = _mm256_blendv_ps(_mm256_blendv_ps(_mm256_set1_ps(4.0f), _mm256_set1_ps(2.0f), isY), _mm256_setzero_ps(), isX);
+	__m256 negative = _mm256_and_ps(_mm256_cmp_ps(major, _mm256_setzero_ps(), _CMP_LT_OQ), _mm256_set1_ps(1.0f));
+	__m256i face = _mm256_permutevar8x32_epi32(
+		_mm256_load_si256((const __m256i*)faceOfAxis), _mm256_cvttps_epi32(_mm256_add_ps(axis2, negative)));
+
+	__m256 b[9];
+	for (int i = 0; i < 9; i++) {
+		b[i] = _mm256_permutevar8x32_ps(_mm256_load_ps(basis[i]), face);
+	}
+	__m256 ma = _mm256_fmadd_ps(dz, b[2], _mm256_fmadd_ps(dy, b[1], _mm256_mul_ps(dx, b[0])));
+	__m256 sc = _mm256_fmadd_ps(dz, b[5], _mm256_fmadd_ps(dy, b[4], _mm256_mul_ps(dx, b[3])));
+	__m256 tc = _mm256_fmadd_ps(dz, b[8], _mm256_fmadd_ps(dy, b[7], _mm256_mul_ps(dx, b[6])));
+	__m256 halfInvMa = _mm256_div_ps(_mm256_set1_ps(0.5f), ma);
+	halfInvMa = _mm256_and_ps(halfInvMa, _mm256_cmp_ps(ma, _mm256_setzero_ps(), _CMP_GT_OQ));
+	__m256 u = _mm256_fmadd_ps(sc, halfInvMa, _mm256_set1_ps(0.5f));
+	__m256 v = _mm256_fnmadd_ps(tc, halfInvMa, _mm256_set1_ps(0.5f));
+
+	// Level of detail, split into the two mips to blend.
+	uint32_t mipLevels = mImage->MipLevels();
+	__m256 lodv = lod ? _mm256_loadu_ps(lod) : _mm256_setzero_ps();
+	lodv = _mm256_min_ps(_mm256_max_ps(lodv, _mm256_setzero_ps()), _mm256_set1_ps((float)(mipLevels - 1)));
+	__m256 lod0 = _mm256_floor_ps(lodv);
+	__m256 t = _mm256_sub_ps(lodv, lod0);
+	__m256i mip0 = _mm256_cvttps_epi32(lod0);
+	__m256i mip1 = _mm256_min_epi32(_mm256_add_epi32(mip0, _mm256_set1_epi32(1)), _mm256_set1_epi32((int)mipLevels - 1));
+	bool secondLevel = _mm256_movemask_ps(_mm256_cmp_ps(t, _mm256_setzero_ps(), _CMP_GT_OQ)) != 0;
+
+	alignas(32) int32_t faces[8];
+	_mm256_store_si256((__m256i*)faces, face);
+
+	__m128 acc[8];
+	for (int lane = 0; lane < 8; lane++) {
+		acc[lane] = _mm_setzero_ps();
+	}
+
+	for (int level = 0; level < (secondLevel ? 2 : 1); level++) {
+		__m256i mip = level == 0 ? mip0 : mip1;
+		__m256 levelWeight = level == 0 ? _mm256_sub_ps(_mm256_set1_ps(1.0f), t) : t;
+
+		__m256i size = _mm256_max_epi32(_mm256_srlv_epi32(_mm256_set1_epi32((int)mImage->Size()), mip), _mm256_set1_epi32(1));
+		__m256 sizeF = _mm256_cvtepi32_ps(size);
+		__m256 px = _mm256_fmsub_ps(u, sizeF, _mm256_set1_ps(0.5f));
+		__m256 py = _mm256_fmsub_ps(v, sizeF, _mm256_set1_ps(0.5f));
+		__m256 x0f = _mm256_floor_ps(px);
+		__m256 y0f = _mm256_floor_ps(py);
+		__m256 fx = _mm256_sub_ps(px, x0f);
+		__m256 fy = _mm256_sub_ps(py, y0f);
+		__m256i x0 = _mm256_cvttps_epi32(x0f);
+		__m256i y0 = _mm256_cvttps_epi32(y0f);
+
+		__m256i level0 = _mm256_add_epi32(_mm256_mullo_epi32(face, _mm256_set1_epi32((int)mipLevels)), mip);
+		__m256i base = _mm256_i32gather_epi32(mLevelOffsets.data(), level0, 4);
+		__m256i rowPitch = _mm256_slli_epi32(size, 2);
+		__m256i off00 = _mm256_add_epi32(base, _mm256_slli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(y0, size), x0), 2));
+
+		// Lanes with a tap outside their face take the slow path below.
+		__m256i last = _mm256_sub_epi32(size, _mm256_set1_epi32(1));
+		__m256i zero = _mm256_setzero_si256();
+		__m256i outside = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpgt_epi32(zero, x0), _mm256_cmpgt_epi32(zero, y0)),
+			_mm256_or_si256(_mm256_cmpgt_epi32(_mm256_add_epi32(x0, _mm256_set1_epi32(1)), last),
+				_mm256_cmpgt_epi32(_mm256_add_epi32(y0, _mm256_set1_epi32(1)), last)));
+
+		alignas(32) int32_t offsets[4][8];
+		_mm256_store_si256((__m256i*)offsets[0], off00);
+		_mm256_store_si256((__m256i*)offsets[1], _mm256_add_epi32(off00, _mm256_set1_epi32(4)));
+		_mm256_store_si256((__m256i*)offsets[2], _mm256_add_epi32(off00, rowPitch));
+		_mm256_store_si256((__m256i*)offsets[3], _mm256_add_epi32(off00, _mm256_add_epi32(rowPitch, _mm256_set1_epi32(4))));
+
+		int outsideMask = _mm256_movemask_ps(_mm256_castsi256_ps(outside));
+		if (outsideMask != 0) {
+			alignas(32) int32_t xs[8], ys[8], mips[8];
+			_mm256_store_si256((__m256i*)xs, x0);
+			_mm256_store_si256((__m256i*)ys, y0);
+			_mm256_store_si256((__m256i*)mips, mip);
+			for (int lane = 0; lane < 8; lane++) {
+				if (outsideMask & (1 << lane)) {
+					for (int tap = 0; tap < 4; tap++) {
+						offsets[tap][lane] = TexelOffset((uint32_t)faces[lane], (uint32_t)mips[lane],
+							xs[lane] + (tap & 1), ys[lane] + (tap >> 1));
+					}
+				}
+			}
+		}
+
+		__m256 gx = _mm256_sub_ps(_mm256_set1_ps(1.0f), fx);
+		__m256 gy = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), fy), levelWeight);
+		fy = _mm256_mul_ps(fy, levelWeight);
+		alignas(32) float weights[4][8];
+		_mm256_store_ps(weights[0], _mm256_mul_ps(gx, gy));
+		_mm256_store_ps(weights[1], _mm256_mul_ps(fx, gy));
+		_mm256_store_ps(weights[2], _mm256_mul_ps(gx, fy));
+		_mm256_store_ps(weights[3], _mm256_mul_ps(fx, fy));
+
+		for (int lane = 0; lane < 8; lane++) {
+			__m128 sum = acc[lane];
+			for (int tap = 0; tap < 4; tap++) {
+				sum = _mm_fmadd_ps(_mm_set1_ps(weights[tap][lane]), _mm_loadu_ps(mTexels + offsets[tap][lane]), sum);
+			}
+			acc[lane] = sum;
+		}
+	}
+
+	for (int lane = 0; lane < 8; lane++) {
+		_mm_storeu_ps(rgba + lane * 4, acc[lane]);
+	}
+}
+#endif
@@ -0,0 +1,55 @@
+#pragma once
+#include "CpuFeatures.h"
+#include "CubeMapImage.h"
+
+struct CubeFaceUV {
+	uint32_t Face;
+	float U;
+	float V;
+};
+
+// Inverse of CubeFaceDirection: the face a direction points into and its uv in
+// [0,1]^2.  The major axis picks the face the same way the hardware does.
+CubeFaceUV DirectionToFaceUV(const float dir[3]);
+
+// Moves texel (x, y) of a size^2 face that lies outside the face onto the face it
+// actually belongs to, by sending the texel center through the cube.  At the
+// corners this picks one of the two neighbours, like the hardware does.
+void WrapCubeTexel(uint32_t& face, int32_t& x, int32_t& y, int32_t size);
+
+// CPU TextureCube sampling of a CubeMapImage: bilinear per mip, linear between
+// mips, with taps that fall off a face fetched from the neighbouring face so there
+// are no seams.  Batches are processed eight directions at a time with AVX2 when
+// the CPU supports it, otherwise one at a time.
+class CubeMapSampler {
+public:
+	explicit CubeMapSampler(const CubeMapImage& image);
+
+	// Bilinear sample of a single mip.  dir does not need to be normalized.
+	void SampleBilinear(const float dir[3], uint32_t mip, float rgba[4])const;
+	// Trilinear sample at an explicit level of detail, clamped to the chain.
+	void SampleLevel(const float dir[3], float lod, float rgba[4])const;
+
+	// Trilinear samples of count directions given as separate x, y, z arrays.  lod may
+	// be null to sample mip 0.  Results are written as RGBA quadruples.
+	void SampleLevel(const float* x, const float* y, const float* z, const float* lod,
+		uint32_t count, float* rgba)const;
+	// Same as above without the AVX2 path.
+	void SampleLevelScalar(const float* x, const float* y, const float* z, const float* lod,
+		uint32_t count, float* rgba)const;
+
+private:
+	// Offset in floats of texel (x, y) of the face and mip.  Coordinates one texel
+	// outside the face are redirected to the adjacent face.
+	int32_t TexelOffset(uint32_t face, uint32_t mip, int32_t x, int32_t y)const;
+	void AccumulateBilinear(uint32_t face, uint32_t mip, float u, float v, float weight, float rgba[4])const;
+#if CPU_AVX2_COMPILED
+	void SampleLevelAVX2(const float* x, const float* y, const float* z, const float* lod, float* rgba)const;
+#endif
+
+private:
+	const CubeMapImage* mImage;
+	const float* mTexels;
+	// Offset of every face/mip from mTexels, indexed face * MipLevels + mip.
+	std::vector<int32_t> mLevelOffsets;
+};
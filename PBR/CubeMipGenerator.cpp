@@ -0,0 +1,245 @@
+#include "CubeMipGenerator.h"
+#include "CubeMapSampler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <xmmintrin.h>
+
+namespace {
+	// Destination rows of one face filtered by one task.
+	const uint32_t kBandRows = 32;
+
+	const float kPi = 3.14159265358979f;
+
+	float Sinc(float x) {
+		if (std::fabs(x) < 1e-5f) {
+			return 1.0f;
+		}
+		return std::sin(kPi * x) / (kPi * x);
+	}
+
+	// Zeroth order modified Bessel function of the first kind.
+	float BesselI0(float x) {
+		float sum = 1.0f;
+		float term = 1.0f;
+		float halfX = 0.5f * x;
+		for (int k = 1; k < 32; k++) {
+			term *= (halfX / k) * (halfX / k);
+			sum += term;
+			if (term < sum * 1e-7f) {
+				break;
+			}
+		}
+		return sum;
+	}
+
+	// Support radius of the kernel, in destination texels.
+	float KernelRadius(CubeMipFilter filter) {
+		return filter == CubeMipFilter::Box ? 0.5f : 2.0f;
+	}
+
+	// Kernel weight at distance t, in destination texels.
+	float Kernel(CubeMipFilter filter, float t) {
+		float radius = KernelRadius(filter);
+		if (std::fabs(t) >= radius) {
+			return 0.0f;
+		}
+		switch (filter) {
+		case CubeMipFilter::Kaiser: {
+			const float alpha = 4.0f;
+			float r = t / radius;
+			return Sinc(t) * BesselI0(alpha * std::sqrt(1.0f - r * r)) / BesselI0(alpha);
+		}
+		case CubeMipFilter::Lanczos:
+			return Sinc(t) * Sinc(t / radius);
+		default:
+			return 1.0f;
+		}
+	}
+
+	// Taps of a 1D downsample from srcSize to dstSize.  Destination texel i reads
+	// source texels First[i] .. First[i] + TapCount - 1 with Weights[i * TapCount + k];
+	// indices may run up to Padding texels past either end of the face.
+	struct TapTable {
+		uint32_t TapCount = 0;
+		int32_t Padding = 0;
+		std::vector<int32_t> First;
+		std::vector<float> Weights;
+	};
+
+	TapTable BuildTaps(CubeMipFilter filter, uint32_t srcSize, uint32_t dstSize) {
+		float scale = (float)srcSize / dstSize;
+		float support = KernelRadius(filter) * scale;
+
+		TapTable table;
+		table.First.resize(dstSize);
+		std::vector<std::vector<float>> weights(dstSize);
+		for (uint32_t i = 0; i < dstSize; i++) {
+			float center = (i + 0.5f) * scale;
+			int32_t first = (int32_t)std::ceil(center - support - 0.5f);
+			int32_t last = (int32_t)std::floor(center + support - 0.5f);
+
+			float total = 0.0f;
+			for (int32_t j = first; j <= last; j++) {
+				float w = Kernel(filter, (j + 0.5f - center) / scale);
+				weights[i].push_back(w);
+				total += w;
+			}
+			for (float& w : weights[i]) {
+				w /= total;
+			}
+
+			table.First[i] = first;
+			table.TapCount = std::max(table.TapCount, (uint32_t)weights[i].size());
+		}
+
+		// Texels with fewer taps are padded with zero weights, which still read memory.
+		for (uint32_t i = 0; i < dstSize; i++) {
+			int32_t last = table.First[i] + (int32_t)table.TapCount - 1;
+			table.Padding = std::max(table.Padding, std::max(-table.First[i], last - (int32_t)srcSize + 1));
+		}
+
+		table.Weights.assign((size_t)dstSize * table.TapCount, 0.0f);
+		for (uint32_t i = 0; i < dstSize; i++) {
+			std::copy(weights[i].begin(), weights[i].end(), table.Weights.begin() + (size_t)i * table.TapCount);
+		}
+		return table;
+	}
+
+	// Where the texels around one face of a mip live: Padding columns left and right
+	// of every row, and Padding full padded rows above and below.
+	struct FaceBorder {
+		std::vector<const float*> Sides;
+		std::vector<const float*> TopBottom;
+	};
+
+	FaceBorder BuildBorder(const CubeMapImage& image, uint32_t face, uint32_t mip, int32_t padding) {
+		int32_t size = (int32_t)image.MipSize(mip);
+		int32_t paddedSize = size + 2 * padding;
+
+		auto texel = [&](int32_t x, int32_t y) {
+			uint32_t f = face;
+			WrapCubeTexel(f, x, y, size);
+			return image.Texels(f, mip) + ((size_t)y * size + x) * 4;
+		};
+
+		FaceBorder border;
+		border.Sides.resize((size_t)size * 2 * padding);
+		for (int32_t y = 0; y < size; y++) {
+			for (int32_t k = 0; k < padding; k++) {
+				border.Sides[((size_t)y * 2 + 0) * padding + k] = texel(k - padding, y);
+				border.Sides[((size_t)y * 2 + 1) * padding + k] = texel(size + k, y);
+			}
+		}
+		border.TopBottom.resize((size_t)2 * padding * paddedSize);
+		for (int32_t k = 0; k < 2 * padding; k++) {
+			int32_t y = k < padding ? k - padding : size + k - padding;
+			for (int32_t x = 0; x < paddedSize; x++) {
+				border.TopBottom[(size_t)k * paddedSize + x] = texel(x - padding, y);
+			}
+		}
+		return border;
+	}
+
+	// Source row y of the face, including the padding taken from the neighbours.
+	void GatherRow(const CubeMapImage& image, const FaceBorder& border, uint32_t face, uint32_t mip,
+		int32_t padding, int32_t y, float* row)
+	{
+		int32_t size = (int32_t)image.MipSize(mip);
+		int32_t paddedSize = size + 2 * padding;
+
+		if (y < 0 || y >= size) {
+			int32_t k = y < 0 ? y + padding : y - size + padding;
+			const float* const* src = border.TopBottom.data() + (size_t)k * paddedSize;
+			for (int32_t x = 0; x < paddedSize; x++) {
+				_mm_storeu_ps(row + (size_t)x * 4, _mm_loadu_ps(src[x]));
+			}
+			return;
+		}
+
+		std::memcpy(row + (size_t)padding * 4, image.Texels(face, mip) + (size_t)y * size * 4, (size_t)size * 4 * sizeof(float));
+		const float* const* left = border.Sides.data() + (size_t)y * 2 * padding;
+		const float* const* right = left + padding;
+		for (int32_t k = 0; k < padding; k++) {
+			_mm_storeu_ps(row + (size_t)k * 4, _mm_loadu_ps(left[k]));
+			_mm_storeu_ps(row + (size_t)(padding + size + k) * 4, _mm_loadu_ps(right[k]));
+		}
+	}
+
+	void FilterBand(CubeMapImage& image, const std::vector<FaceBorder>& borders, const TapTable& taps,
+		uint32_t face, uint32_t mip, uint32_t firstRow)
+	{
+		int32_t srcSize = (int32_t)image.MipSize(mip - 1);
+		uint32_t dstSize = image.MipSize(mip);
+		uint32_t lastRow = std::min(firstRow + kBandRows, dstSize) - 1;
+		int32_t padding = taps.Padding;
+		uint32_t tapCount = taps.TapCount;
+
+		int32_t srcFirst = taps.First[firstRow];
+		int32_t srcLast = taps.First[lastRow] + (int32_t)tapCount - 1;
+
+		thread_local std::vector<float> row;
+		thread_local std::vector<float> filtered;
+		row.resize((size_t)(srcSize + 2 * padding) * 4);
+		filtered.resize((size_t)(srcLast - srcFirst + 1) * dstSize * 4);
+
+		// Horizontal pass over every source row the band touches.
+		for (int32_t y = srcFirst; y <= srcLast; y++) {
+			GatherRow(image, borders[face], face, mip - 1, padding, y, row.data());
+			float* out = filtered.data() + (size_t)(y - srcFirst) * dstSize * 4;
+			for (uint32_t x = 0; x < dstSize; x++) {
+				const float* src = row.data() + (size_t)(taps.First[x] + padding) * 4;
+				const float* w = taps.Weights.data() + (size_t)x * tapCount;
+				__m128 sum = _mm_setzero_ps();
+				for (uint32_t k = 0; k < tapCount; k++) {
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(src + k * 4)));
+				}
+				_mm_storeu_ps(out + (size_t)x * 4, sum);
+			}
+		}
+
+		// Vertical pass, a whole row at a time.
+		float* dst = image.Texels(face, mip);
+		for (uint32_t y = firstRow; y <= lastRow; y++) {
+			const float* w = taps.Weights.data() + (size_t)y * tapCount;
+			const float* src = filtered.data() + (size_t)(taps.First[y] - srcFirst) * dstSize * 4;
+			float* out = dst + (size_t)y * dstSize * 4;
+			for (uint32_t x = 0; x < dstSize * 4; x += 4) {
+				__m128 sum = _mm_setzero_ps();
+				for (uint32_t k = 0; k < tapCount; k++) {
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(src + (size_t)k * dstSize * 4 + x)));
+				}
+				_mm_storeu_ps(out + x, _mm_max_ps(sum, _mm_setzero_ps()));
+			}
+		}
+	}
+}
+
+CubeMipStats GenerateCubeMips(CubeMapImage& image, CubeMipFilter filter, TaskPool& pool) {
+	auto start = std::chrono::steady_clock::now();
+
+	double sourceTexels = 0.0;
+	for (uint32_t mip = 1; mip < image.MipLevels(); mip++) {
+		uint32_t srcSize = image.MipSize(mip - 1);
+		uint32_t dstSize = image.MipSize(mip);
+		TapTable taps = BuildTaps(filter, srcSize, dstSize);
+
+		std::vector<FaceBorder> borders(6);
+		pool.ParallelFor(6, [&](uint32_t face) {
+			borders[face] = BuildBorder(image, face, mip - 1, taps.Padding);
+		});
+
+		uint32_t bands = (dstSize + kBandRows - 1) / kBandRows;
+		pool.ParallelFor(6 * bands, [&](uint32_t job) {
+			FilterBand(image, borders, taps, job / bands, mip, (job % bands) * kBandRows);
+		});
+
+		sourceTexels += 6.0 * srcSize * srcSize;
+	}
+
+	CubeMipStats stats;
+	stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stats.MPixelsPerSecond = stats.Seconds > 0.0 ? sourceTexels / (stats.Seconds * 1e6) : 0.0;
+	return stats;
+}
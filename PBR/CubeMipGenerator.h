@@ -0,0 +1,25 @@
+#pragma once
+#include "CubeMapImage.h"
+#include "TaskPool.h"
+
+enum class CubeMipFilter {
+	// Average of the source texels under the destination texel.
+	Box,
+	// Kaiser windowed sinc (alpha 4) over two destination texels each side.
+	Kaiser,
+	// Lanczos-2 windowed sinc.
+	Lanczos
+};
+
+struct CubeMipStats {
+	double Seconds = 0.0;
+	// Source texels filtered per second over the whole chain, in millions.
+	double MPixelsPerSecond = 0.0;
+};
+
+// Rebuilds mips 1..N-1 of every face from mip 0.  Each mip is filtered from the one
+// above with a separable kernel in linear space; kernel taps that fall off a face
+// read the neighbouring face, so the edges of every mip agree across faces.  Faces
+// are cut into bands of rows that run on the pool, and the passes use SSE.
+// Negative lobes of the sinc kernels are clamped away.
+CubeMipStats GenerateCubeMips(CubeMapImage& image, CubeMipFilter filter, TaskPool& pool = TaskPool::Default());
@@ -0,0 +1,173 @@
+#include "DDSFile.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+	const uint32_t kDdsMagic = 0x20534444; // "DDS "
+
+	const uint32_t kDdsdCaps = 0x1;
+	const uint32_t kDdsdHeight = 0x2;
+	const uint32_t kDdsdWidth = 0x4;
+	const uint32_t kDdsdPitch = 0x8;
+	const uint32_t kDdsdPixelFormat = 0x1000;
+	const uint32_t kDdsdMipMapCount = 0x20000;
+	const uint32_t kDdsdLinearSize = 0x80000;
+
+	const uint32_t kDdpfFourCC = 0x4;
+	const uint32_t kFourCCDX10 = 0x30315844; // "DX10"
+
+	const uint32_t kDdsCapsComplex = 0x8;
+	const uint32_t kDdsCapsTexture = 0x1000;
+	const uint32_t kDdsCapsMipMap = 0x400000;
+	const uint32_t kDdsCaps2CubeAllFaces = 0xFE00;
+
+	const uint32_t kDimensionTexture2D = 3;
+	const uint32_t kMiscTextureCube = 0x4;
+
+	struct DdsPixelFormat {
+		uint32_t Size;
+		uint32_t Flags;
+		uint32_t FourCC;
+		uint32_t RGBBitCount;
+		uint32_t RBitMask;
+		uint32_t GBitMask;
+		uint32_t BBitMask;
+		uint32_t ABitMask;
+	};
+
+	struct DdsHeader {
+		uint32_t Size;
+		uint32_t Flags;
+		uint32_t Height;
+		uint32_t Width;
+		uint32_t PitchOrLinearSize;
+		uint32_t Depth;
+		uint32_t MipMapCount;
+		uint32_t Reserved1[11];
+		DdsPixelFormat PixelFormat;
+		uint32_t Caps;
+		uint32_t Caps2;
+		uint32_t Caps3;
+		uint32_t Caps4;
+		uint32_t Reserved2;
+	};
+
+	struct DdsHeaderDX10 {
+		uint32_t DxgiFormat;
+		uint32_t ResourceDimension;
+		uint32_t MiscFlag;
+		uint32_t ArraySize;
+		uint32_t MiscFlags2;
+	};
+
+	static_assert(sizeof(DdsHeader) == 124, "DDS_HEADER must be 124 bytes");
+	static_assert(sizeof(DdsHeaderDX10) == 20, "DDS_HEADER_DXT10 must be 20 bytes");
+
+	// Block size in bytes and texels of the formats the CPU encoders produce.
+	bool FormatBlock(uint32_t format, uint32_t& blockBytes, uint32_t& blockDim) {
+		switch (format) {
+		case kDxgiFormatR32G32B32A32Float: blockBytes = 16; blockDim = 1; return true;
+		case kDxgiFormatR16G16B16A16Float: blockBytes = 8; blockDim = 1; return true;
+		case kDxgiFormatR11G11B10Float:
+		case kDxgiFormatR9G9B9E5SharedExp:
+		case kDxgiFormatR8G8B8A8Unorm:
+		case kDxgiFormatR8G8B8A8UnormSrgb: blockBytes = 4; blockDim = 1; return true;
+		case kDxgiFormatBC1Unorm:
+		case kDxgiFormatBC1UnormSrgb:
+		case kDxgiFormatBC4Unorm: blockBytes = 8; blockDim = 4; return true;
+		case kDxgiFormatBC5Unorm:
+		case kDxgiFormatBC6HUF16:
+		case kDxgiFormatBC6HSF16:
+		case kDxgiFormatBC7Unorm:
+		case kDxgiFormatBC7UnormSrgb: blockBytes = 16; blockDim = 4; return true;
+		default: return false;
+		}
+	}
+}
+
+void WriteDDS(const std::string& path, const CompressedTexture& texture) {
+	DdsHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.Size = sizeof(DdsHeader);
+	header.Flags = kDdsdCaps | kDdsdHeight | kDdsdWidth | kDdsdPixelFormat | kDdsdMipMapCount;
+	header.Height = texture.Height();
+	header.Width = texture.Width();
+	// Block compressed formats give the size of the top mip, the others its row pitch.
+	if (texture.IsBlockCompressed()) {
+		header.Flags |= kDdsdLinearSize;
+		header.PitchOrLinearSize = (uint32_t)texture.SubresourceBytes(0);
+	}
+	else {
+		header.Flags |= kDdsdPitch;
+		header.PitchOrLinearSize = (uint32_t)texture.RowPitch(0);
+	}
+	header.MipMapCount = texture.MipLevels();
+	header.PixelFormat.Size = sizeof(DdsPixelFormat);
+	header.PixelFormat.Flags = kDdpfFourCC;
+	header.PixelFormat.FourCC = kFourCCDX10;
+	header.Caps = kDdsCapsTexture;
+	if (texture.MipLevels() > 1) {
+		header.Caps |= kDdsCapsComplex | kDdsCapsMipMap;
+	}
+	if (texture.IsCube()) {
+		header.Caps |= kDdsCapsComplex;
+		header.Caps2 = kDdsCaps2CubeAllFaces;
+	}
+
+	DdsHeaderDX10 dx10;
+	std::memset(&dx10, 0, sizeof(dx10));
+	dx10.DxgiFormat = texture.DxgiFormat();
+	dx10.ResourceDimension = kDimensionTexture2D;
+	dx10.MiscFlag = texture.IsCube() ? kMiscTextureCube : 0;
+	dx10.ArraySize = texture.IsCube() ? texture.ArraySize() / 6 : texture.ArraySize();
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		throw std::runtime_error("Cannot create " + path);
+	}
+	file.write(reinterpret_cast<const char*>(&kDdsMagic), sizeof(kDdsMagic));
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(&dx10), sizeof(dx10));
+	file.write(reinterpret_cast<const char*>(texture.Data()), (std::streamsize)texture.ByteSize());
+	if (!file) {
+		throw std::runtime_error("Failed writing " + path);
+	}
+}
+
+bool ReadDDS(const uint8_t* data, size_t size, CompressedTexture& texture) {
+	size_t headerBytes = sizeof(kDdsMagic) + sizeof(DdsHeader) + sizeof(DdsHeaderDX10);
+	if (size < headerBytes) {
+		return false;
+	}
+	uint32_t magic;
+	DdsHeader header;
+	DdsHeaderDX10 dx10;
+	std::memcpy(&magic, data, sizeof(magic));
+	std::memcpy(&header, data + sizeof(magic), sizeof(header));
+	std::memcpy(&dx10, data + sizeof(magic) + sizeof(header), sizeof(dx10));
+	if (magic != kDdsMagic || header.Size != sizeof(DdsHeader) || !(header.PixelFormat.Flags & kDdpfFourCC) ||
+		header.PixelFormat.FourCC != kFourCCDX10 || dx10.ResourceDimension != kDimensionTexture2D) {
+		return false;
+	}
+
+	uint32_t blockBytes;
+	uint32_t blockDim;
+	// D3D12 limits, so that a broken header cannot ask for a huge allocation.
+	if (!FormatBlock(dx10.DxgiFormat, blockBytes, blockDim) || header.Width == 0 || header.Height == 0 ||
+		header.Width > 16384 || header.Height > 16384 || header.MipMapCount > 15 || dx10.ArraySize > 2048) {
+		return false;
+	}
+	bool isCube = (dx10.MiscFlag & kMiscTextureCube) != 0;
+	uint32_t arraySize = std::max(dx10.ArraySize, 1u) * (isCube ? 6 : 1);
+	uint32_t mipLevels = std::max(header.MipMapCount, 1u);
+	CompressedTexture parsed(header.Width, header.Height, mipLevels, arraySize, isCube, dx10.DxgiFormat,
+		blockBytes, blockDim);
+	if (size - headerBytes < parsed.ByteSize()) {
+		return false;
+	}
+	std::memcpy(parsed.Blocks(0, 0), data + headerBytes, parsed.ByteSize());
+	texture = std::move(parsed);
+	return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "CompressedTexture.h"
+#include <string>
+
+// Writes texture as a DDS file with a DX10 header, the layout DirectXTK's
+// CreateDDSTextureFromFile(Ex) loads without conversion.  Cubes get the cube flag.
+// Throws std::runtime_error when the file cannot be written.
+void WriteDDS(const std::string& path, const CompressedTexture& texture);
+
+// Parses a DDS file with a DX10 header in one of the formats of CompressedTexture.h,
+// such as the ones WriteDDS writes.  Returns false for legacy headers, other formats
+// and truncated files.
+bool ReadDDS(const uint8_t* data, size_t size, CompressedTexture& texture);
@@ -0,0 +1,121 @@
+#include "DescriptorIndexAllocator.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+	// Indices a benchmark thread holds at a time.
+	const uint32_t kBenchmarkBatch = 16;
+}
+
+DescriptorIndexAllocator::DescriptorIndexAllocator(uint32_t capacity, uint32_t maxCapacity)
+	: mNext(std::max(maxCapacity, capacity)), mRetireFence(mNext.size()), mFreeHead(PackHead(kNoDescriptor, 0)),
+	mRetiredHead(kNoDescriptor), mCapacity(0)
+{
+	Grow(capacity);
+}
+
+uint32_t DescriptorIndexAllocator::Allocate() {
+	uint64_t head = mFreeHead.load(std::memory_order_acquire);
+	for (;;) {
+		uint32_t index = (uint32_t)head;
+		if (index == kNoDescriptor) {
+			return kNoDescriptor;
+		}
+		// A stale next only happens when another thread popped index in between, and
+		// then the tag has moved on and the exchange fails.
+		uint32_t next = mNext[index].load(std::memory_order_relaxed);
+		uint64_t newHead = PackHead(next, (uint32_t)(head >> 32) + 1);
+		if (mFreeHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire)) {
+			return index;
+		}
+	}
+}
+
+void DescriptorIndexAllocator::Free(uint32_t index) {
+	uint64_t head = mFreeHead.load(std::memory_order_relaxed);
+	for (;;) {
+		mNext[index].store((uint32_t)head, std::memory_order_relaxed);
+		uint64_t newHead = PackHead(index, (uint32_t)(head >> 32) + 1);
+		if (mFreeHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed)) {
+			return;
+		}
+	}
+}
+
+void DescriptorIndexAllocator::FreeDeferred(uint32_t index, uint64_t fence) {
+	mRetireFence[index] = fence;
+	// Only ReleaseCompleted takes from this list, and it takes all of it at once, so
+	// pushing needs no tag.
+	uint32_t head = mRetiredHead.load(std::memory_order_relaxed);
+	do {
+		mNext[index].store(head, std::memory_order_relaxed);
+	} while (!mRetiredHead.compare_exchange_weak(head, index, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void DescriptorIndexAllocator::ReleaseCompleted(uint64_t completedFence) {
+	for (uint32_t index = mRetiredHead.exchange(kNoDescriptor, std::memory_order_acquire); index != kNoDescriptor;) {
+		uint32_t next = mNext[index].load(std::memory_order_relaxed);
+		mWaiting.push_back(index);
+		index = next;
+	}
+
+	size_t kept = 0;
+	for (uint32_t index : mWaiting) {
+		if (mRetireFence[index] <= completedFence) {
+			Free(index);
+		}
+		else {
+			mWaiting[kept++] = index;
+		}
+	}
+	mWaiting.resize(kept);
+}
+
+bool DescriptorIndexAllocator::Grow(uint32_t capacity) {
+	uint32_t current = Capacity();
+	if (capacity > mNext.size()) {
+		return false;
+	}
+	// Pushed from the top down so the lowest new index is allocated first.
+	for (uint32_t index = capacity; index-- > current;) {
+		Free(index);
+	}
+	mCapacity.store(std::max(capacity, current), std::memory_order_release);
+	return true;
+}
+
+DescriptorAllocatorStats BenchmarkDescriptorIndexAllocator(uint32_t capacity, uint32_t operationsPerThread,
+	TaskPool& pool)
+{
+	DescriptorIndexAllocator allocator(capacity, capacity);
+	DescriptorAllocatorStats stats;
+	stats.Threads = pool.ThreadCount();
+	std::atomic<uint64_t> operations{ 0 };
+
+	auto start = std::chrono::steady_clock::now();
+	pool.ParallelFor(stats.Threads, [&](uint32_t) {
+		uint32_t held[kBenchmarkBatch];
+		uint64_t done = 0;
+		while (done < operationsPerThread) {
+			uint32_t count = 0;
+			while (count < kBenchmarkBatch) {
+				uint32_t index = allocator.Allocate();
+				if (index == kNoDescriptor) {
+					break;
+				}
+				held[count++] = index;
+			}
+			for (uint32_t i = 0; i < count; i++) {
+				allocator.Free(held[i]);
+			}
+			done += 2 * count + (count == 0 ? 1 : 0);
+		}
+		operations += done;
+	});
+	stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stats.Operations = operations.load();
+	if (stats.Seconds > 0.0) {
+		stats.MOpsPerSecond = stats.Operations / stats.Seconds * 1e-6;
+	}
+	return stats;
+}
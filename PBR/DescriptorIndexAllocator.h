@@ -0,0 +1,65 @@
+#pragma once
+#include "TaskPool.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+const uint32_t kNoDescriptor = 0xffffffffu;
+
+// Hands out stable descriptor indices from [0, Capacity()) and takes them back.
+// Allocate, Free and FreeDeferred are lock-free and may run on any thread; free
+// indices form a Treiber stack whose head carries a tag against ABA.  Deferred frees
+// wait for a fence value and go back to the free list in ReleaseCompleted, which,
+// like Grow, runs on one thread at a time (the render thread).
+class DescriptorIndexAllocator {
+public:
+	// Room for maxCapacity indices is set aside up front so that growing never moves
+	// anything other threads may be reading.
+	DescriptorIndexAllocator(uint32_t capacity, uint32_t maxCapacity);
+	DescriptorIndexAllocator(const DescriptorIndexAllocator& rhs) = delete;
+	DescriptorIndexAllocator& operator=(const DescriptorIndexAllocator& rhs) = delete;
+
+	uint32_t Capacity()const { return mCapacity.load(std::memory_order_acquire); }
+	uint32_t MaxCapacity()const { return (uint32_t)mNext.size(); }
+
+	// Lowest free indices come out first on a fresh allocator.  Returns kNoDescriptor
+	// when all are in use.
+	uint32_t Allocate();
+	// The index must not be in use by the GPU any more.
+	void Free(uint32_t index);
+	// Frees the index once the GPU has passed fence.
+	void FreeDeferred(uint32_t index, uint64_t fence);
+	// Returns the deferred frees whose fence is at most completedFence to the free list.
+	void ReleaseCompleted(uint64_t completedFence);
+
+	// Adds the indices [Capacity(), capacity) to the free list.  Returns false when
+	// capacity exceeds MaxCapacity().
+	bool Grow(uint32_t capacity);
+
+private:
+	static uint64_t PackHead(uint32_t index, uint32_t tag) { return (uint64_t)tag << 32 | index; }
+
+private:
+	// Next free (or next retired) index after each index.
+	std::vector<std::atomic<uint32_t>> mNext;
+	std::vector<uint64_t> mRetireFence;
+	std::atomic<uint64_t> mFreeHead;
+	std::atomic<uint32_t> mRetiredHead;
+	std::atomic<uint32_t> mCapacity;
+	// Retired indices whose fence had not passed yet; owned by ReleaseCompleted.
+	std::vector<uint32_t> mWaiting;
+};
+
+struct DescriptorAllocatorStats {
+	double Seconds = 0.0;
+	uint64_t Operations = 0;
+	// Allocations plus frees per second, in millions.
+	double MOpsPerSecond = 0.0;
+	uint32_t Threads = 0;
+};
+
+// Every pool thread allocates batches of indices and frees them again until it did
+// operationsPerThread operations.
+DescriptorAllocatorStats BenchmarkDescriptorIndexAllocator(uint32_t capacity, uint32_t operationsPerThread,
+	TaskPool& pool = TaskPool::Default());
@@ -1,9 +1,10 @@
 #include "DiffuseCubeMap.h"
 
-DiffuseCubeMap::DiffuseCubeMap(ID3D12Device* device, ID3D12Resource* lightMap, UINT width, UINT height)
-	: RenderTexture(device, width, height, DXGI_FORMAT_R8G8B8A8_UNORM)
+DiffuseCubeMap::DiffuseCubeMap(ID3D12Device* device, ID3D12Resource* lightMap, const IBLTextureDesc& desc)
+	: RenderTexture(device, IBLTextureExtent(desc), IBLTextureExtent(desc), desc.MipLevels, desc.Format)
 {
 	mLightMap = lightMap;
+	mLayout = desc.Layout;
 }
 
 
@@ -14,8 +15,8 @@ void DiffuseCubeMap::BuildResource() {
 	texDesc.Height = mHeight;
 	texDesc.Width = mWidth;
 	texDesc.Format = mFormat;
-	texDesc.DepthOrArraySize = 6;
-	texDesc.MipLevels = 1;
+	texDesc.DepthOrArraySize = FaceCount();
+	texDesc.MipLevels = mMipLevels;
 	texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
 	texDesc.Alignment = 0;
 	texDesc.SampleDesc.Count = 1;
@@ -32,21 +33,18 @@ void DiffuseCubeMap::BuildResource() {
 		IID_PPV_ARGS(&mTextureMap)
 	));
 
+	mMipLevels = mTextureMap->GetDesc().MipLevels;
 }
 
 void DiffuseCubeMap::BuildDescriptorHeaps() {
 	D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc;
-	rtvHeapDesc.NumDescriptors = 6;
+	rtvHeapDesc.NumDescriptors = FaceCount() * mMipLevels;
 	rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
 	rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 	rtvHeapDesc.NodeMask = 0;
 	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(
 		&rtvHeapDesc, IID_PPV_ARGS(mRtvHeap.GetAddressOf())));
 
-	for (int i = 0; i < 6; i++) {
-		mhCpuRtv[i] = CD3DX12_CPU_DESCRIPTOR_HANDLE(mRtvHeap->GetCPUDescriptorHandleForHeapStart(), i, mRtvDescriptorSize);
-	}
-
 	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc;
 	srvHeapDesc.NumDescriptors = 1;
 	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
@@ -71,23 +69,29 @@ void DiffuseCubeMap::BuildDescriptors() {
 	md3dDevice->CreateShaderResourceView(mLightMap, &srvDesc, mhCpuSrv);
 	mhGpuSrv = CD3DX12_GPU_DESCRIPTOR_HANDLE(mSrvHeap->GetGPUDescriptorHandleForHeapStart());
 
-	for (int i = 0; i < 6; i++) {
-		D3D12_RENDER_TARGET_VIEW_DESC rtvDesc;
-		rtvDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2DARRAY;
-		rtvDesc.Format = mFormat;
-		rtvDesc.Texture2DArray.MipSlice = 0;
-		rtvDesc.Texture2DArray.PlaneSlice = 0;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE handle(mRtvHeap->GetCPUDescriptorHandleForHeapStart());
+
+	// The irradiance is resolution independent, so every mip gets the same convolution.
+	for (UINT mip = 0; mip < mMipLevels; mip++) {
+		for (UINT i = 0; i < FaceCount(); i++) {
+			D3D12_RENDER_TARGET_VIEW_DESC rtvDesc;
+			rtvDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2DARRAY;
+			rtvDesc.Format = mFormat;
+			rtvDesc.Texture2DArray.MipSlice = mip;
+			rtvDesc.Texture2DArray.PlaneSlice = 0;
 
-		rtvDesc.Texture2DArray.ArraySize = 1;
-		rtvDesc.Texture2DArray.FirstArraySlice = i;
+			rtvDesc.Texture2DArray.ArraySize = 1;
+			rtvDesc.Texture2DArray.FirstArraySlice = i;
 
-		md3dDevice->CreateRenderTargetView(mTextureMap.Get(), &rtvDesc, mhCpuRtv[i]);
+			md3dDevice->CreateRenderTargetView(mTextureMap.Get(), &rtvDesc, handle);
+			handle.Offset(mRtvDescriptorSize);
+		}
 	}
 }
 
 void DiffuseCubeMap::BuildPso() {
 	mVertexShader = d3dUtil::CompileShader(L"Shaders/convolution.hlsl", nullptr, "VS", "vs_5_1");
-	mPixelShader = d3dUtil::CompileShader(L"Shaders/convolution.hlsl", nullptr, "PS", "ps_5_1");
+	mPixelShader = d3dUtil::CompileShader(L"Shaders/convolution.hlsl", LayoutDefines(), "PS", "ps_5_1");
 
 	std::vector<D3D12_INPUT_ELEMENT_DESC> inputLayout = {
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
@@ -111,7 +115,7 @@ void DiffuseCubeMap::BuildPso() {
 	psoDesc.SampleMask = UINT_MAX;
 	psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
 	psoDesc.NumRenderTargets = 1;
-	psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+	psoDesc.RTVFormats[0] = mFormat;
 	psoDesc.SampleDesc.Count = 1;
 	psoDesc.SampleDesc.Quality = 0;
 	psoDesc.DepthStencilState.DepthEnable = false;
@@ -185,14 +189,8 @@ void DiffuseCubeMap::OnResize(UINT newWidth, UINT newHeight) {
 	}
 }
 
-void DiffuseCubeMap::BakeTexture(ID3D12GraphicsCommandList* cmdList) {
-	ThrowIfFailed(md3dDevice->CreateCommandAllocator(
-		D3D12_COMMAND_LIST_TYPE_DIRECT,
-		IID_PPV_ARGS(cmdListAlloc.GetAddressOf())
-	));
-
-	ThrowIfFailed(cmdListAlloc->Reset());
-	ThrowIfFailed(cmdList->Reset(cmdListAlloc.Get(), mPSO.Get()));
+void DiffuseCubeMap::BakeRegion(ID3D12GraphicsCommandList* cmdList, UINT face, UINT mip, const D3D12_RECT& rect) {
+	cmdList->SetPipelineState(mPSO.Get());
 
 	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvHeap.Get() };
 	cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
@@ -201,39 +199,23 @@ void DiffuseCubeMap::BakeTexture(ID3D12GraphicsCommandList* cmdList) {
 	// Set the Light Map
 	cmdList->SetGraphicsRootDescriptorTable(1, mhGpuSrv);
 
-	cmdList->RSSetViewports(1, &mViewport);
-	cmdList->RSSetScissorRects(1, &mScissorRect);
+	TransitionForBake(cmdList, face, mip, true);
 
-	cmdList->ResourceBarrier(
-		1,
-		&CD3DX12_RESOURCE_BARRIER::Transition(
-			mTextureMap.Get(),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			D3D12_RESOURCE_STATE_RENDER_TARGET
-		)
-	);
-
-	UINT faceCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(faceCB));
+	D3D12_VIEWPORT viewport = MipViewport(mip);
+	cmdList->RSSetViewports(1, &viewport);
+	cmdList->RSSetScissorRects(1, &rect);
 
+	CD3DX12_CPU_DESCRIPTOR_HANDLE rtv = RtvHandle(face, mip);
+	cmdList->OMSetRenderTargets(1, &rtv, true, nullptr);
 
-	for (int i = 0; i < 6; i++) {
-		cmdList->OMSetRenderTargets(1, &mhCpuRtv[i], true, nullptr);
+	UINT faceCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(FaceConstants));
+	D3D12_GPU_VIRTUAL_ADDRESS faceCBAddress = faceCB->Resource()->GetGPUVirtualAddress() + face * faceCBByteSize;
+	cmdList->SetGraphicsRootConstantBufferView(0, faceCBAddress);
 
-		D3D12_GPU_VIRTUAL_ADDRESS faceCBAddress = faceCB->Resource()->GetGPUVirtualAddress() + i * faceCBByteSize;
+	cmdList->IASetVertexBuffers(0, 0, nullptr);
+	cmdList->IASetIndexBuffer(nullptr);
+	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	cmdList->DrawInstanced(6, 1, 0, 0);
 
-		cmdList->SetGraphicsRootConstantBufferView(0, faceCBAddress);
-		cmdList->IASetVertexBuffers(0, 0, nullptr);
-		cmdList->IASetIndexBuffer(nullptr);
-		cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		cmdList->DrawInstanced(6, 1, 0, 0);
-	}
-
-	cmdList->ResourceBarrier(
-		1,
-		&CD3DX12_RESOURCE_BARRIER::Transition(
-			mTextureMap.Get(),
-			D3D12_RESOURCE_STATE_RENDER_TARGET,
-			D3D12_RESOURCE_STATE_GENERIC_READ
-		)
-	);
+	TransitionForBake(cmdList, face, mip, false);
 }
@@ -3,13 +3,13 @@
 
 class DiffuseCubeMap : public RenderTexture {
 public:
-	DiffuseCubeMap(ID3D12Device* device, ID3D12Resource* lightMap, UINT width, UINT height);
+	DiffuseCubeMap(ID3D12Device* device, ID3D12Resource* lightMap, const IBLTextureDesc& desc);
 	DiffuseCubeMap(const DiffuseCubeMap& rhs) = delete;
 	DiffuseCubeMap& operator=(const DiffuseCubeMap& rhs) = delete;
 	virtual ~DiffuseCubeMap() = default;
 
 	virtual void OnResize(UINT newWidth, UINT newHeight)override;
-	virtual void BakeTexture(ID3D12GraphicsCommandList * cmdList)override;
+	virtual void BakeRegion(ID3D12GraphicsCommandList* cmdList, UINT face, UINT mip, const D3D12_RECT& rect)override;
 
 protected:
 	virtual void BuildResource()override;
@@ -21,7 +21,6 @@ protected:
 protected:
 	ID3D12Resource* mLightMap = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mSrvHeap = nullptr;
-	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuRtv[6];
 	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuSrv;
 	CD3DX12_GPU_DESCRIPTOR_HANDLE mhGpuSrv;
 };
\ No newline at end of file
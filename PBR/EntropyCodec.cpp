@@ -0,0 +1,460 @@
+#include "EntropyCodec.h"
+#include "CompressedTexture.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	// Symbol frequencies are scaled to sum to 1 << kProbBits.
+	const uint32_t kProbBits = 12;
+	const uint32_t kProbScale = 1u << kProbBits;
+	// Renormalization keeps each rANS state in [kRansLow, kRansLow << 16).
+	const uint32_t kRansLow = 1u << 16;
+	const uint32_t kRansStates = 4;
+
+	const uint32_t kMinMatch = 4;
+	const uint32_t kHashBits = 14;
+	// Candidates tried per position.  Only the encoder pays for a longer search.
+	const uint32_t kMaxChain = 32;
+
+	uint32_t Load32(const uint8_t* p) {
+		uint32_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	uint32_t HashSlot(uint32_t v) {
+		return (v * 2654435761u) >> (32 - kHashBits);
+	}
+
+	void PutVarint(std::vector<uint8_t>& out, size_t v) {
+		while (v >= 128) {
+			out.push_back((uint8_t)(v | 128));
+			v >>= 7;
+		}
+		out.push_back((uint8_t)v);
+	}
+
+	bool GetVarint(const uint8_t*& in, const uint8_t* end, uint32_t& v) {
+		v = 0;
+		for (uint32_t shift = 0; shift < 35; shift += 7) {
+			if (in == end) {
+				return false;
+			}
+			uint8_t b = *in++;
+			v |= (uint32_t)(b & 127) << shift;
+			if (!(b & 128)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Scales the counts to sum to kProbScale.  Every symbol that occurs keeps a
+	// frequency of at least 1.
+	void NormalizeFrequencies(const uint32_t counts[256], size_t total, uint32_t freqs[256]) {
+		uint32_t sum = 0;
+		for (int s = 0; s < 256; s++) {
+			freqs[s] = counts[s] ? std::max<uint32_t>(1, (uint32_t)((uint64_t)counts[s] * kProbScale / total)) : 0;
+			sum += freqs[s];
+		}
+		// Rounding down and the minimum of 1 leave the sum off; the most frequent
+		// symbols absorb the difference, where it costs the least.
+		while (sum != kProbScale) {
+			int best = -1;
+			for (int s = 0; s < 256; s++) {
+				if ((sum < kProbScale ? freqs[s] > 0 : freqs[s] > 1) && (best < 0 || freqs[s] > freqs[best])) {
+					best = s;
+				}
+			}
+			if (sum < kProbScale) {
+				freqs[best] += kProbScale - sum;
+				sum = kProbScale;
+			}
+			else {
+				uint32_t take = std::min(sum - kProbScale, freqs[best] - 1);
+				freqs[best] -= take;
+				sum -= take;
+			}
+		}
+	}
+
+	// Order-0 rANS with four interleaved states, so that the decoder works on four
+	// independent chains, and 16 bit renormalization.  The coded bytes are a bitmap
+	// of the symbols that occur, their frequencies less one, and the coder output.
+	// The encoder runs backwards so that the decoder reads forwards.
+	std::vector<uint8_t> RansEncode(const std::vector<uint8_t>& raw) {
+		uint32_t counts[256] = {};
+		for (uint8_t s : raw) {
+			counts[s]++;
+		}
+		uint32_t freqs[256];
+		uint32_t cumulative[256];
+		NormalizeFrequencies(counts, raw.size(), freqs);
+		std::vector<uint8_t> out(32, 0);
+		uint32_t sum = 0;
+		for (int s = 0; s < 256; s++) {
+			cumulative[s] = sum;
+			sum += freqs[s];
+			if (freqs[s]) {
+				out[s / 8] |= (uint8_t)(1 << (s % 8));
+				PutVarint(out, freqs[s] - 1);
+			}
+		}
+
+		std::vector<uint8_t> coded;
+		coded.reserve(raw.size() + 16);
+		uint32_t states[kRansStates];
+		std::fill(states, states + kRansStates, kRansLow);
+		for (size_t i = raw.size(); i-- > 0;) {
+			uint32_t& x = states[i % kRansStates];
+			uint32_t freq = freqs[raw[i]];
+			if (x >= ((uint64_t)(kRansLow >> kProbBits) << 16) * freq) {
+				coded.push_back((uint8_t)(x >> 8));
+				coded.push_back((uint8_t)x);
+				x >>= 16;
+			}
+			x = ((x / freq) << kProbBits) + (x % freq) + cumulative[raw[i]];
+		}
+		for (uint32_t k = kRansStates; k-- > 0;) {
+			for (int shift = 24; shift >= 0; shift -= 8) {
+				coded.push_back((uint8_t)(states[k] >> shift));
+			}
+		}
+		out.insert(out.end(), coded.rbegin(), coded.rend());
+		return out;
+	}
+
+	bool RansDecode(const uint8_t* in, const uint8_t* end, uint8_t* dst, size_t size) {
+		if (end - in < 32) {
+			return false;
+		}
+		const uint8_t* present = in;
+		in += 32;
+		// What decoding needs of each slot, so that a step is one table lookup.
+		struct Slot {
+			uint16_t Freq;
+			uint16_t Bias;
+			uint8_t Symbol;
+		};
+		Slot slots[kProbScale];
+		uint32_t sum = 0;
+		for (int s = 0; s < 256; s++) {
+			if (present[s / 8] & (1 << (s % 8))) {
+				uint32_t freq;
+				if (!GetVarint(in, end, freq) || freq >= kProbScale - sum) {
+					return false;
+				}
+				freq++;
+				for (uint32_t slot = sum; slot < sum + freq; slot++) {
+					slots[slot] = { (uint16_t)freq, (uint16_t)(slot - sum), (uint8_t)s };
+				}
+				sum += freq;
+			}
+		}
+		if (sum != kProbScale || (size_t)(end - in) < 4 * kRansStates) {
+			return false;
+		}
+
+		uint32_t states[kRansStates];
+		for (uint32_t k = 0; k < kRansStates; k++) {
+			states[k] = Load32(in);
+			in += 4;
+		}
+		bool overrun = false;
+		auto step = [&](uint32_t& x, uint8_t& out) {
+			const Slot& slot = slots[x & (kProbScale - 1)];
+			out = slot.Symbol;
+			x = slot.Freq * (x >> kProbBits) + slot.Bias;
+			// One 16 bit read always brings the state back above kRansLow.
+			if (x < kRansLow) {
+				if (end - in < 2) {
+					overrun = true;
+					return;
+				}
+				x = (x << 16) | in[0] | ((uint32_t)in[1] << 8);
+				in += 2;
+			}
+		};
+		// While 8 bytes are left, the four steps of a round cannot run out of input and
+		// renormalize without branches, which would mispredict on every other symbol.
+		auto fastStep = [&](uint32_t& x, uint8_t& out) {
+			const Slot& slot = slots[x & (kProbScale - 1)];
+			out = slot.Symbol;
+			x = slot.Freq * (x >> kProbBits) + slot.Bias;
+			uint32_t renormalize = x < kRansLow;
+			uint32_t word = in[0] | ((uint32_t)in[1] << 8);
+			x = renormalize ? (x << 16) | word : x;
+			in += renormalize * 2;
+		};
+		// The states stay in registers only when the loop names them one by one.
+		uint32_t x0 = states[0], x1 = states[1], x2 = states[2], x3 = states[3];
+		size_t i = 0;
+		for (; i + kRansStates <= size && end - in >= 8; i += kRansStates) {
+			fastStep(x0, dst[i]);
+			fastStep(x1, dst[i + 1]);
+			fastStep(x2, dst[i + 2]);
+			fastStep(x3, dst[i + 3]);
+		}
+		states[0] = x0;
+		states[1] = x1;
+		states[2] = x2;
+		states[3] = x3;
+		for (; i < size && !overrun; i++) {
+			step(states[i % kRansStates], dst[i]);
+		}
+		// The encoder started every state at kRansLow, so a stream that decoded
+		// correctly ends there.
+		for (uint32_t k = 0; k < kRansStates; k++) {
+			if (states[k] != kRansLow) {
+				return false;
+			}
+		}
+		return !overrun && in == end;
+	}
+
+	// A stream is its size, the size coded, and the coded bytes.  A coded size of 0
+	// means the raw bytes follow, for streams the coder would not shrink.
+	void PutStream(std::vector<uint8_t>& out, const std::vector<uint8_t>& raw) {
+		PutVarint(out, raw.size());
+		std::vector<uint8_t> coded;
+		if (!raw.empty()) {
+			coded = RansEncode(raw);
+		}
+		if (coded.empty() || coded.size() >= raw.size()) {
+			PutVarint(out, 0);
+			out.insert(out.end(), raw.begin(), raw.end());
+			return;
+		}
+		PutVarint(out, coded.size());
+		out.insert(out.end(), coded.begin(), coded.end());
+	}
+
+	bool GetStream(const uint8_t*& in, const uint8_t* end, size_t maxSize, std::vector<uint8_t>& raw) {
+		uint32_t rawSize;
+		uint32_t codedSize;
+		if (!GetVarint(in, end, rawSize) || !GetVarint(in, end, codedSize) || rawSize > maxSize) {
+			return false;
+		}
+		if (codedSize == 0) {
+			if (rawSize > (size_t)(end - in)) {
+				return false;
+			}
+			raw.assign(in, in + rawSize);
+			in += rawSize;
+			return true;
+		}
+		if (codedSize > (size_t)(end - in)) {
+			return false;
+		}
+		raw.resize(rawSize);
+		const uint8_t* coded = in;
+		in += codedSize;
+		return RansDecode(coded, in, raw.data(), rawSize);
+	}
+
+	struct Streams {
+		uint32_t Matches = 0;
+		std::vector<uint8_t> Literals;
+		std::vector<uint8_t> LiteralLengths;
+		std::vector<uint8_t> MatchLengths;
+		std::vector<uint8_t> Distances;
+	};
+
+	// Greedy LZ77 over hash chains.  Each match is preceded by a run of literals,
+	// and a last run of literals follows the final match.
+	void Parse(const uint8_t* data, size_t size, Streams& streams) {
+		std::vector<int32_t> head(1u << kHashBits, -1);
+		std::vector<int32_t> previous(size, -1);
+		auto insert = [&](size_t pos) {
+			if (pos + kMinMatch <= size) {
+				int32_t& slot = head[HashSlot(Load32(data + pos))];
+				previous[pos] = slot;
+				slot = (int32_t)pos;
+			}
+		};
+
+		size_t anchor = 0;
+		size_t pos = 0;
+		while (pos + kMinMatch <= size) {
+			size_t best = 0;
+			size_t distance = 0;
+			int32_t candidate = head[HashSlot(Load32(data + pos))];
+			for (uint32_t chain = 0; candidate >= 0 && chain < kMaxChain; chain++, candidate = previous[candidate]) {
+				size_t length = 0;
+				while (pos + length < size && data[candidate + length] == data[pos + length]) {
+					length++;
+				}
+				if (length > best) {
+					best = length;
+					distance = pos - candidate;
+					if (pos + length == size) {
+						break;
+					}
+				}
+			}
+			if (best < kMinMatch) {
+				insert(pos++);
+				continue;
+			}
+			PutVarint(streams.LiteralLengths, pos - anchor);
+			streams.Literals.insert(streams.Literals.end(), data + anchor, data + pos);
+			PutVarint(streams.MatchLengths, best - kMinMatch);
+			PutVarint(streams.Distances, distance);
+			streams.Matches++;
+			for (size_t end = pos + best; pos < end; pos++) {
+				insert(pos);
+			}
+			anchor = pos;
+		}
+		PutVarint(streams.LiteralLengths, size - anchor);
+		streams.Literals.insert(streams.Literals.end(), data + anchor, data + size);
+	}
+
+	bool Reconstruct(const Streams& streams, uint8_t* dst, size_t size) {
+		const uint8_t* literals = streams.Literals.data();
+		const uint8_t* literalsEnd = literals + streams.Literals.size();
+		const uint8_t* literalLengths = streams.LiteralLengths.data();
+		const uint8_t* literalLengthsEnd = literalLengths + streams.LiteralLengths.size();
+		const uint8_t* matchLengths = streams.MatchLengths.data();
+		const uint8_t* matchLengthsEnd = matchLengths + streams.MatchLengths.size();
+		const uint8_t* distances = streams.Distances.data();
+		const uint8_t* distancesEnd = distances + streams.Distances.size();
+		uint8_t* out = dst;
+		uint8_t* outEnd = dst + size;
+		for (uint32_t m = 0; m <= streams.Matches; m++) {
+			uint32_t count;
+			if (!GetVarint(literalLengths, literalLengthsEnd, count) || count > (size_t)(literalsEnd - literals) ||
+				count > (size_t)(outEnd - out)) {
+				return false;
+			}
+			if (count) {
+				std::memcpy(out, literals, count);
+			}
+			literals += count;
+			out += count;
+			if (m == streams.Matches) {
+				break;
+			}
+
+			uint32_t length;
+			uint32_t distance;
+			if (!GetVarint(matchLengths, matchLengthsEnd, length) || !GetVarint(distances, distancesEnd, distance)) {
+				return false;
+			}
+			if (length > size || (length += kMinMatch) > (size_t)(outEnd - out) || distance == 0 ||
+				distance > (size_t)(out - dst)) {
+				return false;
+			}
+			const uint8_t* match = out - distance;
+			if (distance >= length) {
+				std::memcpy(out, match, length);
+				out += length;
+			}
+			else {
+				for (uint32_t i = 0; i < length; i++) {
+					*out++ = match[i];
+				}
+			}
+		}
+		return out == outEnd && literals == literalsEnd && literalLengths == literalLengthsEnd &&
+			matchLengths == matchLengthsEnd && distances == distancesEnd;
+	}
+
+	// The bytes of a block, field by field: endpoints first, then indices.
+	struct BlockFields {
+		uint32_t BlockBytes = 0;
+		uint32_t EndpointBytes = 0;
+		uint8_t Order[16];
+	};
+
+	bool GetBlockFields(uint32_t dxgiFormat, BlockFields& fields) {
+		static const uint8_t kIdentity[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+		// BC5 is two BC4 blocks, red and then green.
+		static const uint8_t kBC5[16] = { 0, 1, 8, 9, 2, 3, 4, 5, 6, 7, 10, 11, 12, 13, 14, 15 };
+		switch (dxgiFormat) {
+		case kDxgiFormatBC1Unorm:
+		case kDxgiFormatBC1UnormSrgb: fields.BlockBytes = 8; fields.EndpointBytes = 4; break;
+		case kDxgiFormatBC4Unorm: fields.BlockBytes = 8; fields.EndpointBytes = 2; break;
+		case kDxgiFormatBC5Unorm: fields.BlockBytes = 16; fields.EndpointBytes = 4; break;
+		default: return false;
+		}
+		std::memcpy(fields.Order, dxgiFormat == kDxgiFormatBC5Unorm ? kBC5 : kIdentity, sizeof(fields.Order));
+		return true;
+	}
+
+	void SplitFields(const uint8_t* src, size_t size, const BlockFields& fields, uint8_t* dst) {
+		size_t blocks = size / fields.BlockBytes;
+		uint8_t* endpoints = dst;
+		uint8_t* indices = dst + blocks * fields.EndpointBytes;
+		for (size_t b = 0; b < blocks; b++) {
+			const uint8_t* block = src + b * fields.BlockBytes;
+			for (uint32_t i = 0; i < fields.EndpointBytes; i++) {
+				*endpoints++ = block[fields.Order[i]];
+			}
+			for (uint32_t i = fields.EndpointBytes; i < fields.BlockBytes; i++) {
+				*indices++ = block[fields.Order[i]];
+			}
+		}
+	}
+
+	void MergeFields(const uint8_t* src, size_t size, const BlockFields& fields, uint8_t* dst) {
+		size_t blocks = size / fields.BlockBytes;
+		const uint8_t* endpoints = src;
+		const uint8_t* indices = src + blocks * fields.EndpointBytes;
+		for (size_t b = 0; b < blocks; b++) {
+			uint8_t* block = dst + b * fields.BlockBytes;
+			for (uint32_t i = 0; i < fields.EndpointBytes; i++) {
+				block[fields.Order[i]] = *endpoints++;
+			}
+			for (uint32_t i = fields.EndpointBytes; i < fields.BlockBytes; i++) {
+				block[fields.Order[i]] = *indices++;
+			}
+		}
+	}
+}
+
+std::vector<uint8_t> EntropyCompress(const uint8_t* src, size_t size, uint32_t dxgiFormat) {
+	BlockFields fields;
+	std::vector<uint8_t> split;
+	if (GetBlockFields(dxgiFormat, fields) && size % fields.BlockBytes == 0) {
+		split.resize(size);
+		SplitFields(src, size, fields, split.data());
+		src = split.data();
+	}
+
+	Streams streams;
+	Parse(src, size, streams);
+	std::vector<uint8_t> out;
+	PutVarint(out, streams.Matches);
+	PutStream(out, streams.Literals);
+	PutStream(out, streams.LiteralLengths);
+	PutStream(out, streams.MatchLengths);
+	PutStream(out, streams.Distances);
+	return out;
+}
+
+bool EntropyDecompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t size, uint32_t dxgiFormat) {
+	const uint8_t* in = src;
+	const uint8_t* end = src + srcSize;
+	Streams streams;
+	// A length takes at most 5 bytes, and there is one per match and run of literals.
+	size_t maxLengthBytes = 5 * (size / kMinMatch + 1);
+	if (!GetVarint(in, end, streams.Matches) || streams.Matches > size / kMinMatch ||
+		!GetStream(in, end, size, streams.Literals) ||
+		!GetStream(in, end, maxLengthBytes, streams.LiteralLengths) ||
+		!GetStream(in, end, maxLengthBytes, streams.MatchLengths) ||
+		!GetStream(in, end, maxLengthBytes, streams.Distances) || in != end) {
+		return false;
+	}
+
+	BlockFields fields;
+	if (GetBlockFields(dxgiFormat, fields) && size % fields.BlockBytes == 0) {
+		std::vector<uint8_t> split(size);
+		if (!Reconstruct(streams, split.data(), size)) {
+			return false;
+		}
+		MergeFields(split.data(), size, fields, dst);
+		return true;
+	}
+	return Reconstruct(streams, dst, size);
+}
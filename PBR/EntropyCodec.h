@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// LZ77 whose literals, literal lengths, match lengths and distances are kept in
+// separate streams, each coded with an order-0 rANS coder.  It stores block
+// compressed textures in noticeably less space than byte oriented LZ, and decodes
+// at a few hundred MB/s per thread.
+//
+// Given the DXGI format of block compressed data, the bytes of each block are first
+// grouped by field: the endpoints of all blocks, then their indices.  Fields of the
+// same kind have similar statistics and repeat at fixed distances, which helps both
+// layers.  BC1, BC4 and BC5 have byte aligned fields; other formats are coded as they are.
+
+std::vector<uint8_t> EntropyCompress(const uint8_t* src, size_t size, uint32_t dxgiFormat = 0);
+// Returns false unless src decodes to exactly size bytes without reading or writing
+// out of bounds.  dxgiFormat has to be the one given to EntropyCompress.
+bool EntropyDecompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t size, uint32_t dxgiFormat = 0);
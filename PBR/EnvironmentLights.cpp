@@ -0,0 +1,223 @@
+#include "EnvironmentLights.h"
+#include "CubeMipGenerator.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+	const float kPi = 3.14159265358979f;
+
+	float Luminance(const float* rgb) {
+		return 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2];
+	}
+
+	// Integral of the solid angle of a cube face from the face center to (x, y).
+	float AreaElement(float x, float y) {
+		return std::atan2(x * y, std::sqrt(x * x + y * y + 1.0f));
+	}
+
+	void TexelDirection(uint32_t face, uint32_t x, uint32_t y, uint32_t size, float dir[3]) {
+		CubeFaceDirection(face, (x + 0.5f) / size, (y + 0.5f) / size, dir);
+		float invLength = 1.0f / std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+		dir[0] *= invLength;
+		dir[1] *= invLength;
+		dir[2] *= invLength;
+	}
+}
+
+DominantLightResult ExtractDominantLights(const CubeMapImage& environment, const DominantLightDesc& desc) {
+	if (environment.MipLevels() == 0) {
+		throw std::runtime_error("ExtractDominantLights: empty environment");
+	}
+	auto start = std::chrono::steady_clock::now();
+
+	uint32_t mip = 0;
+	while (mip + 1 < environment.MipLevels() && environment.MipSize(mip) > desc.AnalysisSize) {
+		mip++;
+	}
+	uint32_t size = environment.MipSize(mip);
+	size_t faceTexels = (size_t)size * size;
+	size_t count = 6 * faceTexels;
+
+	// Every face has the same solid angles, so the area elements of the texel
+	// corners are computed once.
+	std::vector<float> corners((size_t)(size + 1) * (size + 1));
+	for (uint32_t y = 0; y <= size; y++) {
+		for (uint32_t x = 0; x <= size; x++) {
+			corners[(size_t)y * (size + 1) + x] = AreaElement(2.0f * x / size - 1.0f, 2.0f * y / size - 1.0f);
+		}
+	}
+
+	// Working copy of the mip, with the direction and solid angle of every texel.
+	std::vector<float> rgb(count * 3);
+	std::vector<float> dirs(count * 3);
+	std::vector<float> weights(count);
+	std::vector<float> luminance(count);
+	double totalWeight = 0.0;
+	double totalPower = 0.0;
+	for (uint32_t face = 0; face < 6; face++) {
+		const float* texels = environment.Texels(face, mip);
+		for (uint32_t y = 0; y < size; y++) {
+			for (uint32_t x = 0; x < size; x++) {
+				size_t i = face * faceTexels + (size_t)y * size + x;
+				const float* c = &corners[(size_t)y * (size + 1) + x];
+				weights[i] = c[0] - c[size + 1] - c[1] + c[size + 2];
+				TexelDirection(face, x, y, size, &dirs[i * 3]);
+				for (int k = 0; k < 3; k++) {
+					rgb[i * 3 + k] = texels[((size_t)y * size + x) * 4 + k];
+				}
+				luminance[i] = Luminance(&rgb[i * 3]);
+				totalWeight += weights[i];
+				totalPower += (double)luminance[i] * weights[i];
+			}
+		}
+	}
+
+	// The solid angles add up to 4 pi up to rounding; renormalize to remove it.
+	float normalization = (float)(4.0 * kPi / totalWeight);
+	for (float& w : weights) {
+		w *= normalization;
+	}
+	totalPower *= normalization;
+
+	float clip = desc.Threshold * (float)(totalPower / (4.0 * kPi));
+	float cosCone = std::cos(desc.MaxConeAngle);
+
+	DominantLightResult result;
+	std::vector<uint32_t> gathered;
+	while (result.Lights.size() < desc.MaxLights) {
+		size_t peak = std::max_element(luminance.begin(), luminance.end()) - luminance.begin();
+		if (!(luminance[peak] > clip)) {
+			break;
+		}
+		const float* peakDir = &dirs[peak * 3];
+
+		gathered.clear();
+		double power = 0.0;
+		double direction[3] = {};
+		double irradiance[3] = {};
+		double solidAngle = 0.0;
+		for (size_t i = 0; i < count; i++) {
+			const float* dir = &dirs[i * 3];
+			if (luminance[i] <= clip || dir[0] * peakDir[0] + dir[1] * peakDir[1] + dir[2] * peakDir[2] < cosCone) {
+				continue;
+			}
+			// Scaling the whole texel keeps the hue of both parts.
+			float excess = 1.0f - clip / luminance[i];
+			float excessPower = (luminance[i] - clip) * weights[i];
+			for (int k = 0; k < 3; k++) {
+				irradiance[k] += rgb[i * 3 + k] * excess * weights[i];
+				direction[k] += dir[k] * excessPower;
+			}
+			power += excessPower;
+			solidAngle += weights[i];
+			gathered.push_back((uint32_t)i);
+		}
+		if (power < desc.MinPowerFraction * totalPower) {
+			break;
+		}
+
+		for (uint32_t i : gathered) {
+			float scale = clip / luminance[i];
+			for (int k = 0; k < 3; k++) {
+				rgb[i * 3 + k] *= scale;
+			}
+			luminance[i] = clip;
+		}
+
+		DominantLight light;
+		double length = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+		for (int k = 0; k < 3; k++) {
+			light.Direction[k] = (float)(direction[k] / length);
+			light.Irradiance[k] = (float)irradiance[k];
+		}
+		light.SolidAngle = (float)solidAngle;
+		light.ClipLuminance = clip;
+		light.CosConeAngle = cosCone;
+		result.Lights.push_back(light);
+	}
+
+	double sum[9][3] = {};
+	for (size_t i = 0; i < count; i++) {
+		float basis[9];
+		SHBasis9(&dirs[i * 3], basis);
+		for (int b = 0; b < 9; b++) {
+			for (int k = 0; k < 3; k++) {
+				sum[b][k] += (double)rgb[i * 3 + k] * basis[b] * weights[i];
+			}
+		}
+	}
+	for (int b = 0; b < 9; b++) {
+		for (int k = 0; k < 3; k++) {
+			result.ResidualSH.C[b][k] = (float)sum[b][k];
+		}
+	}
+
+	result.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+void RemoveDominantLights(CubeMapImage& environment, std::vector<DominantLight>& lights, TaskPool& pool) {
+	if (lights.empty()) {
+		return;
+	}
+	uint32_t size = environment.Size();
+	size_t lightCount = lights.size();
+	float minClip = lights[0].ClipLuminance;
+	for (const DominantLight& light : lights) {
+		minClip = std::min(minClip, light.ClipLuminance);
+	}
+
+	// Irradiance removed per row and light, summed after the loop.
+	std::vector<double> removed((size_t)6 * size * lightCount * 3, 0.0);
+
+	pool.ParallelFor(6 * size, [&](uint32_t row) {
+		uint32_t face = row / size;
+		uint32_t y = row % size;
+		float* texel = environment.Texels(face, 0) + (size_t)y * size * 4;
+		double* rowRemoved = &removed[(size_t)row * lightCount * 3];
+		float v = 1.0f - 2.0f * (y + 0.5f) / size;
+
+		for (uint32_t x = 0; x < size; x++, texel += 4) {
+			float luminance = Luminance(texel);
+			if (luminance <= minClip) {
+				continue;
+			}
+			float dir[3];
+			TexelDirection(face, x, y, size, dir);
+			// Solid angle of a small texel at (u, v) on the unit cube.
+			float u = 2.0f * (x + 0.5f) / size - 1.0f;
+			float d = 1.0f + u * u + v * v;
+			float weight = 4.0f / ((float)size * size * d * std::sqrt(d));
+
+			for (size_t l = 0; l < lightCount; l++) {
+				const DominantLight& light = lights[l];
+				if (luminance <= light.ClipLuminance ||
+					dir[0] * light.Direction[0] + dir[1] * light.Direction[1] + dir[2] * light.Direction[2] < light.CosConeAngle) {
+					continue;
+				}
+				float scale = light.ClipLuminance / luminance;
+				for (int k = 0; k < 3; k++) {
+					rowRemoved[l * 3 + k] += texel[k] * (1.0f - scale) * weight;
+					texel[k] *= scale;
+				}
+				luminance = light.ClipLuminance;
+			}
+		}
+	});
+
+	for (size_t l = 0; l < lightCount; l++) {
+		double irradiance[3] = {};
+		for (uint32_t row = 0; row < 6 * size; row++) {
+			for (int k = 0; k < 3; k++) {
+				irradiance[k] += removed[((size_t)row * lightCount + l) * 3 + k];
+			}
+		}
+		for (int k = 0; k < 3; k++) {
+			lights[l].Irradiance[k] = (float)irradiance[k];
+		}
+	}
+
+	GenerateCubeMips(environment, CubeMipFilter::Kaiser, pool);
+}
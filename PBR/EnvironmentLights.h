@@ -0,0 +1,52 @@
+#pragma once
+#include "CubeMapImage.h"
+#include "SphericalHarmonics.h"
+#include "TaskPool.h"
+#include <vector>
+
+struct DominantLightDesc {
+	uint32_t MaxLights = 2;
+	// The analysis runs on the largest mip whose faces are not above this size.
+	uint32_t AnalysisSize = 64;
+	// Texels brighter than this many times the mean luminance belong to a light.
+	float Threshold = 16.0f;
+	// Lights carrying less than this fraction of the environment's power are dropped.
+	float MinPowerFraction = 0.05f;
+	// Half angle in radians of the cone gathered around each peak.
+	float MaxConeAngle = 0.35f;
+};
+
+// A bright region of the environment turned into a directional light.
+struct DominantLight {
+	// Unit direction toward the light.
+	float Direction[3];
+	// Steradians covered by the texels the light was gathered from.
+	float SolidAngle;
+	// Irradiance on a surface facing the light: the radiance above ClipLuminance
+	// integrated over SolidAngle.
+	float Irradiance[3];
+	// The gathered texels were scaled down to this luminance.
+	float ClipLuminance;
+	float CosConeAngle;
+};
+
+struct DominantLightResult {
+	std::vector<DominantLight> Lights;
+	// Radiance SH of the analysed mip with the lights clipped out.  Pass it through
+	// RadianceToIrradianceSH9 for the ambient term.
+	SH9Color ResidualSH;
+	double Seconds = 0.0;
+};
+
+// Finds the brightest regions of the environment by repeatedly picking the peak
+// texel of a small mip and gathering the texels above the threshold within a cone
+// around it.  Each region's excess over the threshold becomes a light; the rest of
+// the texel stays in the residual, so lights plus residual keep the total energy.
+// The environment needs its mip chain.
+DominantLightResult ExtractDominantLights(const CubeMapImage& environment, const DominantLightDesc& desc = {});
+
+// Applies the clipping of the lights to mip 0 of the environment and rebuilds its
+// mips, for the IBL products to be baked from the residual.  The full resolution
+// texels hold more energy above the clip than the analysed mip, so the irradiance
+// of each light is replaced by what is actually removed here.
+void RemoveDominantLights(CubeMapImage& environment, std::vector<DominantLight>& lights, TaskPool& pool = TaskPool::Default());
@@ -0,0 +1,152 @@
+#include "EquirectToCube.h"
+#include "CubeMipGenerator.h"
+#include <chrono>
+#include <cmath>
+#include <emmintrin.h>
+
+namespace {
+	const float kPi = 3.14159265358979f;
+
+	inline __m128 Select(__m128 mask, __m128 a, __m128 b) {
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	// atan(x) for x in [0, 1], absolute error below 1e-5 radians.
+	inline __m128 AtanUnit(__m128 x) {
+		__m128 x2 = _mm_mul_ps(x, x);
+		__m128 p = _mm_set1_ps(-0.01172120f);
+		p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(0.05265332f));
+		p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-0.11643287f));
+		p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(0.19354346f));
+		p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-0.33262347f));
+		p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(0.99997726f));
+		return _mm_mul_ps(p, x);
+	}
+
+	inline __m128 Atan2(__m128 y, __m128 x) {
+		const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+		__m128 ax = _mm_andnot_ps(signMask, x);
+		__m128 ay = _mm_andnot_ps(signMask, y);
+
+		__m128 hi = _mm_max_ps(ax, ay);
+		__m128 lo = _mm_min_ps(ax, ay);
+		__m128 r = AtanUnit(_mm_div_ps(lo, _mm_max_ps(hi, _mm_set1_ps(1e-30f))));
+
+		r = Select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(0.5f * kPi), r), r);
+		r = Select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(kPi), r), r);
+		// r is in [0, pi] here, so copying the sign of y finishes the quadrant.
+		return _mm_or_ps(r, _mm_and_ps(y, signMask));
+	}
+
+	// Maps four face coordinates to continuous panorama pixel coordinates.
+	void FaceToPanorama(const CubeFaceBasis& b, __m128 u, __m128 v, float width, float height, float* px, float* py) {
+		__m128 sx = _mm_sub_ps(_mm_add_ps(u, u), _mm_set1_ps(1.0f));
+		__m128 sy = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_add_ps(v, v));
+
+		__m128 d[3];
+		for (int i = 0; i < 3; i++) {
+			d[i] = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(sx, _mm_set1_ps(b.Right[i])), _mm_mul_ps(sy, _mm_set1_ps(b.Up[i]))),
+				_mm_set1_ps(b.LookAt[i]));
+		}
+
+		__m128 horizontal = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(d[0], d[0]), _mm_mul_ps(d[2], d[2])));
+		__m128 longitude = Atan2(d[2], d[0]);
+		__m128 latitude = Atan2(d[1], horizontal);
+
+		__m128 x = _mm_add_ps(_mm_mul_ps(longitude, _mm_set1_ps(0.5f / kPi)), _mm_set1_ps(0.5f));
+		__m128 y = _mm_sub_ps(_mm_set1_ps(0.5f), _mm_mul_ps(latitude, _mm_set1_ps(1.0f / kPi)));
+
+		_mm_storeu_ps(px, _mm_sub_ps(_mm_mul_ps(x, _mm_set1_ps(width)), _mm_set1_ps(0.5f)));
+		_mm_storeu_ps(py, _mm_sub_ps(_mm_mul_ps(y, _mm_set1_ps(height)), _mm_set1_ps(0.5f)));
+	}
+
+	// Bilinear fetch that wraps around in longitude and clamps at the poles.
+	inline void SampleBilinear(const HDRImage& src, float px, float py, float* rgb) {
+		float fx = std::floor(px);
+		float fy = std::floor(py);
+		float tx = px - fx;
+		float ty = py - fy;
+
+		int w = (int)src.Width;
+		int h = (int)src.Height;
+		int x0 = (int)fx % w;
+		if (x0 < 0) {
+			x0 += w;
+		}
+		int x1 = x0 + 1 == w ? 0 : x0 + 1;
+		int y0 = (int)fy < 0 ? 0 : ((int)fy >= h ? h - 1 : (int)fy);
+		int y1 = (int)fy + 1 < 0 ? 0 : ((int)fy + 1 >= h ? h - 1 : (int)fy + 1);
+
+		const float* p00 = &src.Pixels[((size_t)y0 * w + x0) * 3];
+		const float* p01 = &src.Pixels[((size_t)y0 * w + x1) * 3];
+		const float* p10 = &src.Pixels[((size_t)y1 * w + x0) * 3];
+		const float* p11 = &src.Pixels[((size_t)y1 * w + x1) * 3];
+		for (int c = 0; c < 3; c++) {
+			float top = p00[c] + (p01[c] - p00[c]) * tx;
+			float bottom = p10[c] + (p11[c] - p10[c]) * tx;
+			rgb[c] += top + (bottom - top) * ty;
+		}
+	}
+
+	void ResampleRow(const HDRImage& src, CubeMapImage& dst, uint32_t face, uint32_t row, uint32_t samplesPerAxis) {
+		const CubeFaceBasis& basis = gCubeFaceBasis[face];
+		uint32_t size = dst.Size();
+		float invSize = 1.0f / size;
+		float* out = dst.Texels(face, 0) + (size_t)row * size * 4;
+		float weight = 1.0f / (samplesPerAxis * samplesPerAxis);
+
+		for (uint32_t x = 0; x < size; x += 4) {
+			float rgb[4][3] = {};
+
+			for (uint32_t sy = 0; sy < samplesPerAxis; sy++) {
+				float v = (row + (sy + 0.5f) / samplesPerAxis) * invSize;
+				for (uint32_t sx = 0; sx < samplesPerAxis; sx++) {
+					float offset = (sx + 0.5f) / samplesPerAxis;
+					__m128 u = _mm_mul_ps(
+						_mm_add_ps(_mm_set_ps(x + 3.0f, x + 2.0f, x + 1.0f, (float)x), _mm_set1_ps(offset)),
+						_mm_set1_ps(invSize));
+
+					float px[4], py[4];
+					FaceToPanorama(basis, u, _mm_set1_ps(v), (float)src.Width, (float)src.Height, px, py);
+					for (int lane = 0; lane < 4; lane++) {
+						SampleBilinear(src, px[lane], py[lane], rgb[lane]);
+					}
+				}
+			}
+
+			for (uint32_t lane = 0; lane < 4 && x + lane < size; lane++) {
+				float* texel = out + (size_t)(x + lane) * 4;
+				texel[0] = rgb[lane][0] * weight;
+				texel[1] = rgb[lane][1] * weight;
+				texel[2] = rgb[lane][2] * weight;
+				texel[3] = 1.0f;
+			}
+		}
+	}
+}
+
+EquirectToCubeStats EquirectToCube(
+	const HDRImage& src,
+	CubeMapImage& dst,
+	EquirectFilter filter,
+	uint32_t samplesPerAxis,
+	TaskPool& pool)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	uint32_t samples = filter == EquirectFilter::Supersample && samplesPerAxis > 1 ? samplesPerAxis : 1;
+	uint32_t size = dst.Size();
+
+	pool.ParallelFor(6 * size, [&](uint32_t job) {
+		ResampleRow(src, dst, job / size, job % size, samples);
+	});
+	double resampleSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	GenerateCubeMips(dst, CubeMipFilter::Kaiser, pool);
+
+	EquirectToCubeStats stats;
+	stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stats.MPixelsPerSecond = 6.0 * size * size / (resampleSeconds * 1e6);
+	return stats;
+}
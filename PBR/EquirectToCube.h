@@ -0,0 +1,28 @@
+#pragma once
+#include "CubeMapImage.h"
+#include "HDRLoader.h"
+#include "TaskPool.h"
+
+enum class EquirectFilter {
+	// One bilinear tap at the texel center.
+	Bilinear,
+	// SamplesPerAxis^2 stratified bilinear taps per texel, for minified sources.
+	Supersample
+};
+
+struct EquirectToCubeStats {
+	double Seconds = 0.0;
+	// Output texels of mip 0 written per second, in millions.
+	double MPixelsPerSecond = 0.0;
+};
+
+// Resamples a latitude/longitude panorama into mip 0 of every face of dst, then
+// fills the rest of the chain with the seamless Kaiser mip generator.  Rows of all
+// six faces are spread over the pool and four texels of a row are mapped to the
+// panorama at once with SSE.
+EquirectToCubeStats EquirectToCube(
+	const HDRImage& src,
+	CubeMapImage& dst,
+	EquirectFilter filter,
+	uint32_t samplesPerAxis = 2,
+	TaskPool& pool = TaskPool::Default());
@@ -10,9 +10,14 @@ struct ObjectConstants
 	DirectX::XMFLOAT4X4 InvTransWorld = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
 	UINT     MaterialIndex;
+	// Up to two reflection probe slices and their blend weights, see ReflectionProbes.h.
+	UINT     ProbeSlice0 = 0;
+	UINT     ProbeSlice1 = 0;
 	UINT     ObjPad0;
-	UINT     ObjPad1;
-	UINT     ObjPad2;
+	float    ProbeWeight0 = 0.0f;
+	float    ProbeWeight1 = 0.0f;
+	float    ObjPad1;
+	float    ObjPad2;
 };
 
 struct LightObject {
@@ -41,6 +46,30 @@ struct PassConstants
 
     DirectX::XMFLOAT4 AmbientLight = { 0.0f, 0.0f, 0.0f, 1.0f };
 
+    // Progress of the time sliced IBL bake.  Mips of the prefiltered map below
+    // PrefilteredMinMip are not baked yet; IBLReadyMask bit 0 is the irradiance map,
+    // bit 1 the BRDF LUT.  AmbientSH stands in for the maps that are still missing.
+    float PrefilteredMinMip = 0.0f;
+    UINT IBLReadyMask = 0;
+    UINT ProbeMipLevels = 0;
+    float IBLPad = 0.0f;
+    DirectX::XMFLOAT4 AmbientSH[9];
+
+    // SH irradiance volume, see IrradianceVolume.h.  Probe (x, y, z) sits at
+    // VolumeMin + (x, y, z) / VolumeInvCellSize; VolumeEnabled is 0 without one.
+    DirectX::XMFLOAT3 VolumeMin = { 0.0f, 0.0f, 0.0f };
+    UINT VolumeEnabled = 0;
+    DirectX::XMFLOAT3 VolumeInvCellSize = { 0.0f, 0.0f, 0.0f };
+    float VolumePad0 = 0.0f;
+    DirectX::XMUINT3 VolumeDim = { 0, 0, 0 };
+    float VolumePad1 = 0.0f;
+
+    // Lights[0, NumDirLights) are directional, LightPosAndDir being the direction the
+    // light travels; the next NumPointLights are point lights.
+    UINT NumDirLights = 0;
+    UINT NumPointLights = 0;
+    DirectX::XMFLOAT2 LightPad = { 0.0f, 0.0f };
+
     // Indices [0, NUM_DIR_LIGHTS) are directional lights;
     // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
     // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
@@ -56,9 +85,7 @@ struct MaterialData
 	float roughness;
 	float ao;
 	int AlbedoMapIndex;
-	int MetallicMapIndex;
-	int RoughnessMapIndex;
-	int AOMapIndex;
+	int OrmMapIndex;
 	int NormalMapIndex;
 	float padding;
 };
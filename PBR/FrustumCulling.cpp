@@ -0,0 +1,262 @@
+#include "FrustumCulling.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#if CPU_AVX2_COMPILED
+#include <immintrin.h>
+#endif
+
+namespace {
+	bool UseAVX2(bool allowed) {
+#if CPU_AVX2_COMPILED
+		return allowed && CpuHasAVX2();
+#else
+		(void)allowed;
+		return false;
+#endif
+	}
+
+	// A plane with the absolute values of its normal, which give the distance from the
+	// center of a box to its corner deepest behind the plane.
+	struct CullPlane {
+		float N[3];
+		float D;
+		float AbsN[3];
+	};
+
+	void CullPlanes(const Frustum& frustum, CullPlane planes[6]) {
+		for (int p = 0; p < 6; p++) {
+			for (int k = 0; k < 3; k++) {
+				planes[p].N[k] = frustum.Planes[p][k];
+				planes[p].AbsN[k] = std::fabs(frustum.Planes[p][k]);
+			}
+			planes[p].D = frustum.Planes[p][3];
+		}
+	}
+
+	void CullScalar(const CullPlane planes[6], const float* cx, const float* cy, const float* cz,
+		const float* ex, const float* ey, const float* ez, const float* radius,
+		uint32_t first, uint32_t end, std::vector<uint32_t>& visible)
+	{
+		for (uint32_t i = first; i < end; i++) {
+			bool inside = true;
+			for (int p = 0; p < 6; p++) {
+				const CullPlane& plane = planes[p];
+				float dist = cx[i] * plane.N[0] + cy[i] * plane.N[1] + cz[i] * plane.N[2] + plane.D;
+				float reach = ex[i] * plane.AbsN[0] + ey[i] * plane.AbsN[1] + ez[i] * plane.AbsN[2];
+				inside = inside && dist + std::min(radius[i], reach) >= 0.0f;
+			}
+			if (inside) {
+				visible.push_back(i);
+			}
+		}
+	}
+
+#if CPU_AVX2_COMPILED
+	// Lanes of the set bits of each 8 bit mask, lowest first, and their number.
+	struct CompactTable {
+		uint8_t Lanes[256][8];
+		uint8_t Count[256];
+
+		CompactTable() {
+			for (uint32_t mask = 0; mask < 256; mask++) {
+				uint32_t count = 0;
+				for (uint8_t lane = 0; lane < 8; lane++) {
+					if (mask & (1u << lane)) {
+						Lanes[mask][count++] = lane;
+					}
+				}
+				Count[mask] = (uint8_t)count;
+				while (count < 8) {
+					Lanes[mask][count++] = 0;
+				}
+			}
+		}
+	};
+
+	const CompactTable& Compaction() {
+		static const CompactTable table;
+		return table;
+	}
+
+	// Returns the new end of visible, which needs room for 8 ids past the objects.
+	CPU_AVX2_TARGET uint32_t CullAVX2(const CullPlane planes[6], const float* cx, const float* cy, const float* cz,
+		const float* ex, const float* ey, const float* ez, const float* radius,
+		uint32_t end, uint32_t* visible)
+	{
+		const CompactTable& table = Compaction();
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		uint32_t count = 0;
+		for (uint32_t i = 0; i + 8 <= end; i += 8) {
+			__m256 x = _mm256_loadu_ps(cx + i);
+			__m256 y = _mm256_loadu_ps(cy + i);
+			__m256 z = _mm256_loadu_ps(cz + i);
+			__m256 extentX = _mm256_loadu_ps(ex + i);
+			__m256 extentY = _mm256_loadu_ps(ey + i);
+			__m256 extentZ = _mm256_loadu_ps(ez + i);
+			__m256 r = _mm256_loadu_ps(radius + i);
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < 6; p++) {
+				const CullPlane& plane = planes[p];
+				// Multiplies and adds in the order of the scalar code, without FMA, so both
+				// round alike.
+				__m256 dist = _mm256_mul_ps(x, _mm256_set1_ps(plane.N[0]));
+				dist = _mm256_add_ps(dist, _mm256_mul_ps(y, _mm256_set1_ps(plane.N[1])));
+				dist = _mm256_add_ps(dist, _mm256_mul_ps(z, _mm256_set1_ps(plane.N[2])));
+				dist = _mm256_add_ps(dist, _mm256_set1_ps(plane.D));
+				__m256 reach = _mm256_mul_ps(extentX, _mm256_set1_ps(plane.AbsN[0]));
+				reach = _mm256_add_ps(reach, _mm256_mul_ps(extentY, _mm256_set1_ps(plane.AbsN[1])));
+				reach = _mm256_add_ps(reach, _mm256_mul_ps(extentZ, _mm256_set1_ps(plane.AbsN[2])));
+				// min_ps returns its second operand when either is NaN, as std::min returns its first.
+				__m256 margin = _mm256_add_ps(dist, _mm256_min_ps(reach, r));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(margin, zero, _CMP_GE_OQ));
+			}
+
+			uint32_t mask = (uint32_t)_mm256_movemask_ps(inside);
+			if (mask) {
+				__m256i order = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)table.Lanes[mask]));
+				__m256i ids = _mm256_add_epi32(_mm256_set1_epi32((int)i), lanes);
+				_mm256_storeu_si256((__m256i*)(visible + count), _mm256_permutevar8x32_epi32(ids, order));
+				count += table.Count[mask];
+			}
+		}
+		return count;
+	}
+#endif
+
+	void NormalizePlane(float plane[4]) {
+		float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		if (length > 0.0f) {
+			for (int k = 0; k < 4; k++) {
+				plane[k] /= length;
+			}
+		}
+	}
+}
+
+Frustum FrustumFromViewProj(const float viewProj[4][4]) {
+	// Clip coordinates are dot products of the point with the columns; the planes
+	// bound -w <= x <= w, -w <= y <= w and 0 <= z <= w.
+	auto column = [&](int c, int k) { return viewProj[k][c]; };
+	Frustum frustum;
+	for (int k = 0; k < 4; k++) {
+		float x = column(0, k);
+		float y = column(1, k);
+		float z = column(2, k);
+		float w = column(3, k);
+		frustum.Planes[0][k] = w + x;
+		frustum.Planes[1][k] = w - x;
+		frustum.Planes[2][k] = w + y;
+		frustum.Planes[3][k] = w - y;
+		frustum.Planes[4][k] = z;
+		frustum.Planes[5][k] = w - z;
+	}
+	for (int p = 0; p < 6; p++) {
+		NormalizePlane(frustum.Planes[p]);
+	}
+	return frustum;
+}
+
+void CullingBounds::Clear() {
+	for (std::vector<float>* v : { &mCenterX, &mCenterY, &mCenterZ, &mExtentX, &mExtentY, &mExtentZ, &mRadius }) {
+		v->clear();
+	}
+}
+
+void CullingBounds::Reserve(uint32_t count) {
+	for (std::vector<float>* v : { &mCenterX, &mCenterY, &mCenterZ, &mExtentX, &mExtentY, &mExtentZ, &mRadius }) {
+		v->reserve(count);
+	}
+}
+
+uint32_t CullingBounds::Add(const float center[3], const float extents[3], float radius) {
+	uint32_t id = Count();
+	for (std::vector<float>* v : { &mCenterX, &mCenterY, &mCenterZ, &mExtentX, &mExtentY, &mExtentZ, &mRadius }) {
+		v->push_back(0.0f);
+	}
+	Set(id, center, extents, radius);
+	return id;
+}
+
+void CullingBounds::Set(uint32_t id, const float center[3], const float extents[3], float radius) {
+	mCenterX[id] = center[0];
+	mCenterY[id] = center[1];
+	mCenterZ[id] = center[2];
+	mExtentX[id] = extents[0];
+	mExtentY[id] = extents[1];
+	mExtentZ[id] = extents[2];
+	mRadius[id] = radius;
+}
+
+void CullingBounds::Cull(const Frustum& frustum, std::vector<uint32_t>& visible, bool allowSimd)const {
+	CullPlane planes[6];
+	CullPlanes(frustum, planes);
+	uint32_t count = Count();
+	uint32_t first = 0;
+	visible.clear();
+#if CPU_AVX2_COMPILED
+	if (UseAVX2(allowSimd)) {
+		visible.resize((size_t)count + 8);
+		uint32_t found = CullAVX2(planes, mCenterX.data(), mCenterY.data(), mCenterZ.data(),
+			mExtentX.data(), mExtentY.data(), mExtentZ.data(), mRadius.data(), count, visible.data());
+		visible.resize(found);
+		first = count & ~7u;
+	}
+#endif
+	CullScalar(planes, mCenterX.data(), mCenterY.data(), mCenterZ.data(),
+		mExtentX.data(), mExtentY.data(), mExtentZ.data(), mRadius.data(), first, count, visible);
+}
+
+FrustumCullBenchmark BenchmarkFrustumCulling(const std::vector<uint32_t>& objectCounts, uint32_t iterations) {
+	iterations = std::max(iterations, 1u);
+	// A 60 degree 16:9 camera at the origin looking down +z, as
+	// XMMatrixPerspectiveFovLH builds it.
+	const float nearZ = 0.1f;
+	const float farZ = 1000.0f;
+	float yScale = 1.0f / std::tan(0.5f * 1.0471976f);
+	float proj[4][4] = {
+		{ yScale * 9.0f / 16.0f, 0.0f, 0.0f, 0.0f },
+		{ 0.0f, yScale, 0.0f, 0.0f },
+		{ 0.0f, 0.0f, farZ / (farZ - nearZ), 1.0f },
+		{ 0.0f, 0.0f, -nearZ * farZ / (farZ - nearZ), 0.0f },
+	};
+	Frustum frustum = FrustumFromViewProj(proj);
+
+	FrustumCullBenchmark bench;
+	bench.Simd = UseAVX2(true);
+	for (uint32_t objects : objectCounts) {
+		// Objects of 0.5 to 5 units around the camera, out to 1.5 times the far plane.
+		std::mt19937 rng(objects);
+		std::uniform_real_distribution<float> position(-1.5f * farZ, 1.5f * farZ);
+		std::uniform_real_distribution<float> size(0.5f, 5.0f);
+		CullingBounds bounds;
+		bounds.Reserve(objects);
+		for (uint32_t i = 0; i < objects; i++) {
+			float center[3] = { position(rng), position(rng), position(rng) };
+			float extents[3] = { size(rng), size(rng), size(rng) };
+			float radius = std::sqrt(extents[0] * extents[0] + extents[1] * extents[1] + extents[2] * extents[2]) *
+				std::uniform_real_distribution<float>(0.6f, 1.0f)(rng);
+			bounds.Add(center, extents, radius);
+		}
+
+		FrustumCullRates rates;
+		rates.Objects = objects;
+		double mobjects = (double)objects * iterations * 1e-6;
+		std::vector<uint32_t> visible[2];
+		for (int simd = 0; simd < (bench.Simd ? 2 : 1); simd++) {
+			auto start = std::chrono::steady_clock::now();
+			for (uint32_t i = 0; i < iterations; i++) {
+				bounds.Cull(frustum, visible[simd], simd != 0);
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			(simd ? rates.SimdMObjectsPerSecond : rates.ScalarMObjectsPerSecond) = seconds > 0.0 ? mobjects / seconds : 0.0;
+		}
+		rates.Visible = (uint32_t)visible[0].size();
+		rates.Match = !bench.Simd || visible[0] == visible[1];
+		bench.Sizes.push_back(rates);
+	}
+	return bench;
+}
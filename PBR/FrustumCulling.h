@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Planes a*x + b*y + c*z + d >= 0 on the inside, normalized: left, right, bottom,
+// top, near, far.
+struct Frustum {
+	float Planes[6][4];
+};
+
+// Frustum of a view-projection matrix in the DirectXMath convention: row vectors
+// times the matrix, m[row][column], and clip space z from 0 to w.
+Frustum FrustumFromViewProj(const float viewProj[4][4]);
+
+// World space bounds of many objects in structure of arrays form, culled eight at a
+// time with AVX2.  Each object has a box and a sphere around the same center; it is
+// culled when either lies wholly outside one of the planes, so a tight sphere helps
+// round objects and the box helps long ones.
+class CullingBounds {
+public:
+	uint32_t Count()const { return (uint32_t)mRadius.size(); }
+	void Clear();
+	void Reserve(uint32_t count);
+
+	// Returns the id of the new object, its index in the order of adding.
+	uint32_t Add(const float center[3], const float extents[3], float radius);
+	void Set(uint32_t id, const float center[3], const float extents[3], float radius);
+
+	// Replaces visible with the ids of the objects that may intersect the frustum, in
+	// increasing order.  The scalar and the AVX2 code give the same list.
+	void Cull(const Frustum& frustum, std::vector<uint32_t>& visible, bool allowSimd = true)const;
+
+private:
+	std::vector<float> mCenterX;
+	std::vector<float> mCenterY;
+	std::vector<float> mCenterZ;
+	std::vector<float> mExtentX;
+	std::vector<float> mExtentY;
+	std::vector<float> mExtentZ;
+	std::vector<float> mRadius;
+};
+
+struct FrustumCullRates {
+	uint32_t Objects = 0;
+	uint32_t Visible = 0;
+	// Millions of objects tested per second.
+	double ScalarMObjectsPerSecond = 0.0;
+	double SimdMObjectsPerSecond = 0.0;
+	// The two visible lists are the same.
+	bool Match = true;
+};
+
+struct FrustumCullBenchmark {
+	bool Simd = false;
+	std::vector<FrustumCullRates> Sizes;
+};
+
+// Culls random objects scattered around a camera, for each count in objectCounts,
+// iterations times with the scalar and, when supported, the AVX2 code.
+FrustumCullBenchmark BenchmarkFrustumCulling(const std::vector<uint32_t>& objectCounts, uint32_t iterations = 16);
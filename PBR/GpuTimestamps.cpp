@@ -0,0 +1,65 @@
+#include "GpuTimestamps.h"
+#include <algorithm>
+
+using Microsoft::WRL::ComPtr;
+
+GpuTimestamps::GpuTimestamps(ID3D12Device* device, ID3D12CommandQueue* queue, uint32_t frameCount, uint32_t queriesPerFrame)
+	: mQueriesPerFrame(queriesPerFrame)
+{
+	UINT64 frequency = 0;
+	ThrowIfFailed(queue->GetTimestampFrequency(&frequency));
+	mMsPerTick = frequency != 0 ? 1000.0 / (double)frequency : 0.0;
+
+	D3D12_QUERY_HEAP_DESC heapDesc = {};
+	heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	heapDesc.Count = frameCount * queriesPerFrame;
+	ThrowIfFailed(device->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(mHeap.GetAddressOf())));
+
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer((UINT64)heapDesc.Count * sizeof(UINT64)),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(mReadback.GetAddressOf())));
+}
+
+void GpuTimestamps::BeginFrame(uint32_t frameIndex) {
+	mFrameIndex = frameIndex;
+	mUsed = 0;
+}
+
+uint32_t GpuTimestamps::Write(ID3D12GraphicsCommandList* cmdList) {
+	if (mUsed == mQueriesPerFrame) {
+		return kNoQuery;
+	}
+	cmdList->EndQuery(mHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, mFrameIndex * mQueriesPerFrame + mUsed);
+	return mUsed++;
+}
+
+void GpuTimestamps::Resolve(ID3D12GraphicsCommandList* cmdList) {
+	if (mUsed == 0) {
+		return;
+	}
+	UINT first = mFrameIndex * mQueriesPerFrame;
+	cmdList->ResolveQueryData(mHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, first, mUsed,
+		mReadback.Get(), (UINT64)first * sizeof(UINT64));
+}
+
+void GpuTimestamps::ReadMs(uint32_t frameIndex, uint32_t count, std::vector<double>& ms) {
+	count = std::min(count, mQueriesPerFrame);
+	ms.resize(count);
+	if (count == 0) {
+		return;
+	}
+	SIZE_T first = (SIZE_T)frameIndex * mQueriesPerFrame;
+	D3D12_RANGE range = { first * sizeof(UINT64), (first + count) * sizeof(UINT64) };
+	UINT8* data = nullptr;
+	ThrowIfFailed(mReadback->Map(0, &range, reinterpret_cast<void**>(&data)));
+	const UINT64* ticks = reinterpret_cast<const UINT64*>(data + range.Begin);
+	for (uint32_t i = 0; i < count; i++) {
+		ms[i] = (double)ticks[i] * mMsPerTick;
+	}
+	D3D12_RANGE written = { 0, 0 };
+	mReadback->Unmap(0, &written);
+}
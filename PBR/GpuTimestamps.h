@@ -0,0 +1,40 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+
+// Timestamp queries for a ring of frame resources.  Each frame writes up to
+// queriesPerFrame timestamps into its own part of the query heap and resolves them
+// into its part of a readback buffer; the values can be read once the GPU has
+// passed the frame's fence, that is when its frame resource comes around again.
+class GpuTimestamps {
+public:
+	static const uint32_t kNoQuery = ~0u;
+
+	GpuTimestamps(ID3D12Device* device, ID3D12CommandQueue* queue, uint32_t frameCount, uint32_t queriesPerFrame);
+	GpuTimestamps(const GpuTimestamps& rhs) = delete;
+	GpuTimestamps& operator=(const GpuTimestamps& rhs) = delete;
+
+	// Starts writing the queries of frame resource frameIndex.  Read its previous
+	// timestamps before this.
+	void BeginFrame(uint32_t frameIndex);
+
+	// Records a timestamp and returns its index in the current frame, or kNoQuery
+	// when the frame has used all of its queries.
+	uint32_t Write(ID3D12GraphicsCommandList* cmdList);
+
+	// Records the copy of the current frame's timestamps to the readback buffer.
+	void Resolve(ID3D12GraphicsCommandList* cmdList);
+
+	// Reads the first count timestamps of a frame whose fence the GPU has passed, in
+	// milliseconds from an arbitrary start.  Only differences of timestamps from the
+	// same command queue are meaningful.
+	void ReadMs(uint32_t frameIndex, uint32_t count, std::vector<double>& ms);
+
+private:
+	uint32_t mQueriesPerFrame;
+	uint32_t mFrameIndex = 0;
+	uint32_t mUsed = 0;
+	double mMsPerTick;
+
+	Microsoft::WRL::ComPtr<ID3D12QueryHeap> mHeap;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mReadback;
+};
@@ -0,0 +1,177 @@
+#include "HDRLoader.h"
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+	// 2^(e - 136) for every RGBE exponent; e == 0 encodes black.
+	struct ExponentTable {
+		float Scale[256];
+		ExponentTable() {
+			Scale[0] = 0.0f;
+			for (int e = 1; e < 256; e++) {
+				Scale[e] = std::ldexp(1.0f, e - (128 + 8));
+			}
+		}
+	};
+
+	const ExponentTable gExponents;
+}
+
+HDRReader::HDRReader(const std::string& path)
+	: mFile(path, std::ios::binary), mPath(path)
+{
+	if (!mFile) {
+		throw std::runtime_error("Cannot open " + path);
+	}
+	ReadHeader();
+	mRgbe.resize((size_t)mWidth * 4);
+}
+
+uint8_t HDRReader::ReadByte() {
+	int c = mFile.get();
+	if (c == EOF) {
+		throw std::runtime_error("Unexpected end of file in " + mPath);
+	}
+	return (uint8_t)c;
+}
+
+void HDRReader::ReadHeader() {
+	std::string line;
+	std::getline(mFile, line);
+	if (line != "#?RADIANCE" && line != "#?RGBE") {
+		throw std::runtime_error(mPath + " is not a Radiance HDR file");
+	}
+
+	// Variables end with an empty line, the resolution string follows it.
+	while (std::getline(mFile, line) && !line.empty()) {
+		if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe") {
+			throw std::runtime_error(mPath + ": unsupported " + line);
+		}
+	}
+
+	std::getline(mFile, line);
+	std::istringstream resolution(line);
+	std::string yAxis, xAxis;
+	uint32_t height = 0;
+	uint32_t width = 0;
+	if (!(resolution >> yAxis >> height >> xAxis >> width) ||
+		xAxis != "+X" || (yAxis != "-Y" && yAxis != "+Y") || width == 0 || height == 0) {
+		throw std::runtime_error(mPath + ": unsupported resolution string " + line);
+	}
+
+	mWidth = width;
+	mHeight = height;
+	mBottomUp = yAxis == "+Y";
+}
+
+void HDRReader::ReadFlatScanline(uint32_t start) {
+	// Old style files: raw RGBE quads where (1,1,1,n) repeats the previous pixel.
+	int shift = 0;
+	for (uint32_t x = start; x < mWidth; ) {
+		uint8_t* p = &mRgbe[(size_t)x * 4];
+		mFile.read(reinterpret_cast<char*>(p), 4);
+		if (!mFile) {
+			throw std::runtime_error("Unexpected end of file in " + mPath);
+		}
+		if (p[0] == 1 && p[1] == 1 && p[2] == 1) {
+			if (x == 0) {
+				throw std::runtime_error(mPath + ": run at the start of a scanline");
+			}
+			uint32_t count = (uint32_t)p[3] << shift;
+			if (x + count > mWidth) {
+				throw std::runtime_error(mPath + ": run overflows scanline");
+			}
+			for (uint32_t i = 0; i < count; i++, x++) {
+				memcpy(&mRgbe[(size_t)x * 4], &mRgbe[(size_t)(x - 1) * 4], 4);
+			}
+			shift += 8;
+		}
+		else {
+			x++;
+			shift = 0;
+		}
+	}
+}
+
+void HDRReader::ReadRgbeScanline() {
+	if (mWidth < 8 || mWidth > 0x7fff) {
+		ReadFlatScanline(0);
+		return;
+	}
+
+	uint8_t header[4];
+	mFile.read(reinterpret_cast<char*>(header), 4);
+	if (!mFile) {
+		throw std::runtime_error("Unexpected end of file in " + mPath);
+	}
+
+	if (header[0] != 2 || header[1] != 2 || (header[2] & 0x80) != 0) {
+		// Not run length encoded, the four bytes were the first pixel.
+		memcpy(mRgbe.data(), header, 4);
+		ReadFlatScanline(1);
+		return;
+	}
+	if (((uint32_t)header[2] << 8 | header[3]) != mWidth) {
+		throw std::runtime_error(mPath + ": scanline width mismatch");
+	}
+
+	// New style RLE stores each channel as its own run length coded plane.
+	for (int c = 0; c < 4; c++) {
+		for (uint32_t x = 0; x < mWidth; ) {
+			uint32_t count = ReadByte();
+			bool run = count > 128;
+			if (run) {
+				count -= 128;
+			}
+			if (count == 0 || x + count > mWidth) {
+				throw std::runtime_error(mPath + ": bad run length");
+			}
+			if (run) {
+				uint8_t value = ReadByte();
+				for (uint32_t i = 0; i < count; i++) {
+					mRgbe[(size_t)(x++) * 4 + c] = value;
+				}
+			}
+			else {
+				for (uint32_t i = 0; i < count; i++) {
+					mRgbe[(size_t)(x++) * 4 + c] = ReadByte();
+				}
+			}
+		}
+	}
+}
+
+bool HDRReader::ReadScanline(float* rgb) {
+	if (mNextRow == mHeight) {
+		return false;
+	}
+	ReadRgbeScanline();
+	mNextRow++;
+
+	for (uint32_t x = 0; x < mWidth; x++) {
+		const uint8_t* p = &mRgbe[(size_t)x * 4];
+		float scale = gExponents.Scale[p[3]];
+		rgb[x * 3 + 0] = p[0] * scale;
+		rgb[x * 3 + 1] = p[1] * scale;
+		rgb[x * 3 + 2] = p[2] * scale;
+	}
+	return true;
+}
+
+HDRImage LoadHDR(const std::string& path) {
+	HDRReader reader(path);
+
+	HDRImage image;
+	image.Width = reader.Width();
+	image.Height = reader.Height();
+	image.Pixels.resize((size_t)image.Width * image.Height * 3);
+
+	size_t rowFloats = (size_t)image.Width * 3;
+	for (uint32_t y = 0; y < image.Height; y++) {
+		uint32_t row = reader.BottomUp() ? image.Height - 1 - y : y;
+		reader.ReadScanline(&image.Pixels[row * rowFloats]);
+	}
+	return image;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Streaming reader for Radiance RGBE (.hdr) files.  Scanlines are decoded one at a
+// time, so the whole file never has to be resident in its compressed form.
+// Handles flat, old style run length and new style (per channel) RLE scanlines.
+class HDRReader {
+public:
+	// Throws std::runtime_error when the file is missing or not a supported .hdr.
+	explicit HDRReader(const std::string& path);
+	HDRReader(const HDRReader& rhs) = delete;
+	HDRReader& operator=(const HDRReader& rhs) = delete;
+
+	uint32_t Width()const { return mWidth; }
+	uint32_t Height()const { return mHeight; }
+	// True when the file stores its rows bottom to top (+Y resolution string).
+	bool BottomUp()const { return mBottomUp; }
+
+	// Decodes the next scanline into Width() linear RGB float triples.
+	// Returns false once every scanline has been read.
+	bool ReadScanline(float* rgb);
+
+private:
+	void ReadHeader();
+	void ReadRgbeScanline();
+	void ReadFlatScanline(uint32_t start);
+	uint8_t ReadByte();
+
+private:
+	std::ifstream mFile;
+	std::string mPath;
+	uint32_t mWidth = 0;
+	uint32_t mHeight = 0;
+	uint32_t mNextRow = 0;
+	bool mBottomUp = false;
+
+	std::vector<uint8_t> mRgbe;
+};
+
+// Fully decoded image, top row first, three floats per pixel.
+struct HDRImage {
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	std::vector<float> Pixels;
+};
+
+HDRImage LoadHDR(const std::string& path);
@@ -0,0 +1,502 @@
+#include "HDRPacking.h"
+#include "CompressedTexture.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#if CPU_AVX2_COMPILED
+#include <immintrin.h>
+#endif
+
+namespace {
+	const uint32_t kFloatInfinity = 255u << 23;
+	// The smallest normal of the 5 bit exponent formats, 2^-14, as float bits.
+	const uint32_t kMinNormal5 = 113u << 23;
+	const uint32_t kHalfOverflow = (127u + 16u) << 23;
+	// (1 + 511/512) * 2^15, the largest value of R9G9B9E5.
+	const float kMaxRGB9E5 = 65408.0f;
+
+	uint32_t BitsOf(float f) {
+		uint32_t u;
+		std::memcpy(&u, &f, sizeof(u));
+		return u;
+	}
+
+	float FloatOf(uint32_t u) {
+		float f;
+		std::memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+
+	// Added as a float to a value under 2^-14, it leaves the mantissa bits of the
+	// denormal with mantissaBits bits in its low bits, rounded to nearest even.
+	uint32_t DenormMagic(uint32_t mantissaBits) {
+		return ((127u - 15u) + (23u - mantissaBits) + 1u) << 23;
+	}
+
+	// Largest finite value of an unsigned float with a 5 bit exponent.
+	float MaxSmallFloat(uint32_t mantissaBits) {
+		return FloatOf(((15u + 127u) << 23) | (((1u << mantissaBits) - 1) << (23 - mantissaBits)));
+	}
+
+	// Unsigned float with a 5 bit exponent, 6 or 5 bit mantissa: the R11G11B10 channels.
+	uint32_t FloatToSmallFloat(float value, uint32_t mantissaBits) {
+		if (!(value > 0.0f)) {
+			return 0;
+		}
+		if (value == INFINITY) {
+			return 31u << mantissaBits;
+		}
+		uint32_t f = BitsOf(std::min(value, MaxSmallFloat(mantissaBits)));
+		if (f < kMinNormal5) {
+			return BitsOf(FloatOf(f) + FloatOf(DenormMagic(mantissaBits))) - DenormMagic(mantissaBits);
+		}
+		uint32_t shift = 23 - mantissaBits;
+		uint32_t mantissaOdd = (f >> shift) & 1;
+		f += ((uint32_t)(15 - 127) << 23) + (1u << (shift - 1)) - 1 + mantissaOdd;
+		return f >> shift;
+	}
+
+	// Also decodes halves without their sign, with mantissaBits 10.
+	float SmallFloatToFloat(uint32_t bits, uint32_t mantissaBits) {
+		uint32_t o = bits << (23 - mantissaBits);
+		uint32_t exponent = o & (31u << 23);
+		o += (127u - 15u) << 23;
+		if (exponent == 31u << 23) {
+			o += (128u - 16u) << 23;
+		}
+		else if (exponent == 0) {
+			o += 1u << 23;
+			return FloatOf(o) - FloatOf(kMinNormal5);
+		}
+		return FloatOf(o);
+	}
+
+	bool UseAVX2(bool allowed) {
+#if CPU_AVX2_COMPILED
+		return allowed && CpuHasAVX2();
+#else
+		(void)allowed;
+		return false;
+#endif
+	}
+
+#if CPU_AVX2_COMPILED
+	CPU_AVX2_TARGET __m256i HalfBitsAVX2(__m256 value) {
+		__m256i f = _mm256_castps_si256(value);
+		__m256i sign = _mm256_and_si256(f, _mm256_set1_epi32((int)0x80000000u));
+		f = _mm256_xor_si256(f, sign);
+
+		__m256i nan = _mm256_cmpgt_epi32(f, _mm256_set1_epi32((int)kFloatInfinity));
+		__m256i overflow = _mm256_or_si256(_mm256_set1_epi32(0x7c00), _mm256_and_si256(nan, _mm256_set1_epi32(0x0200)));
+
+		__m256 denormal = _mm256_add_ps(_mm256_castsi256_ps(f), _mm256_castsi256_ps(_mm256_set1_epi32((int)DenormMagic(10))));
+		__m256i denormalBits = _mm256_sub_epi32(_mm256_castps_si256(denormal), _mm256_set1_epi32((int)DenormMagic(10)));
+
+		__m256i mantissaOdd = _mm256_and_si256(_mm256_srli_epi32(f, 13), _mm256_set1_epi32(1));
+		__m256i normal = _mm256_add_epi32(f, _mm256_set1_epi32((int)(((uint32_t)(15 - 127) << 23) + 0xfff)));
+		normal = _mm256_srli_epi32(_mm256_add_epi32(normal, mantissaOdd), 13);
+
+		__m256i isDenormal = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)kMinNormal5), f);
+		__m256i isOverflow = _mm256_cmpgt_epi32(f, _mm256_set1_epi32((int)kHalfOverflow - 1));
+		__m256i half = _mm256_blendv_epi8(normal, denormalBits, isDenormal);
+		half = _mm256_blendv_epi8(half, overflow, isOverflow);
+		return _mm256_or_si256(half, _mm256_srli_epi32(sign, 16));
+	}
+
+	// 8 unsigned small floats with a 5 bit exponent, in the low bits of each lane.
+	CPU_AVX2_TARGET __m256i SmallFloatsToFloatsAVX2(__m256i bits, int mantissaBits) {
+		__m256i o = _mm256_sll_epi32(bits, _mm_cvtsi32_si128(23 - mantissaBits));
+		__m256i exponent = _mm256_and_si256(o, _mm256_set1_epi32(31 << 23));
+		o = _mm256_add_epi32(o, _mm256_set1_epi32((127 - 15) << 23));
+		__m256i isSpecial = _mm256_cmpeq_epi32(exponent, _mm256_set1_epi32(31 << 23));
+		o = _mm256_add_epi32(o, _mm256_and_si256(isSpecial, _mm256_set1_epi32((128 - 16) << 23)));
+		__m256i isDenormal = _mm256_cmpeq_epi32(exponent, _mm256_setzero_si256());
+		__m256 denormal = _mm256_sub_ps(_mm256_castsi256_ps(_mm256_add_epi32(o, _mm256_set1_epi32(1 << 23))),
+			_mm256_castsi256_ps(_mm256_set1_epi32((int)kMinNormal5)));
+		return _mm256_blendv_epi8(o, _mm256_castps_si256(denormal), isDenormal);
+	}
+
+	CPU_AVX2_TARGET __m256i FloatsToSmallFloatsAVX2(__m256 value, int mantissaBits) {
+		__m256 infinity = _mm256_castsi256_ps(_mm256_set1_epi32((int)kFloatInfinity));
+		__m256i isInfinity = _mm256_castps_si256(_mm256_cmp_ps(value, infinity, _CMP_EQ_OQ));
+		// max returns its second operand for NaN, so NaN and negatives become 0.
+		value = _mm256_max_ps(value, _mm256_setzero_ps());
+		value = _mm256_min_ps(value, _mm256_set1_ps(MaxSmallFloat(mantissaBits)));
+		__m256i f = _mm256_castps_si256(value);
+
+		__m256i magic = _mm256_set1_epi32((int)DenormMagic(mantissaBits));
+		__m256i denormal = _mm256_sub_epi32(_mm256_castps_si256(_mm256_add_ps(value, _mm256_castsi256_ps(magic))), magic);
+
+		__m128i shift = _mm_cvtsi32_si128(23 - mantissaBits);
+		__m256i mantissaOdd = _mm256_and_si256(_mm256_srl_epi32(f, shift), _mm256_set1_epi32(1));
+		__m256i normal = _mm256_add_epi32(f,
+			_mm256_set1_epi32((int)(((uint32_t)(15 - 127) << 23) + (1u << (22 - mantissaBits)) - 1)));
+		normal = _mm256_srl_epi32(_mm256_add_epi32(normal, mantissaOdd), shift);
+
+		__m256i isDenormal = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)kMinNormal5), f);
+		__m256i bits = _mm256_blendv_epi8(normal, denormal, isDenormal);
+		return _mm256_blendv_epi8(bits, _mm256_set1_epi32(31 << mantissaBits), isInfinity);
+	}
+
+	// Loads 8 RGBA texels as R, G and B vectors.  Lanes hold texels 0 2 4 6 1 3 5 7.
+	CPU_AVX2_TARGET void LoadRGB8(const float* rgba, __m256& r, __m256& g, __m256& b) {
+		__m256 t01 = _mm256_loadu_ps(rgba);
+		__m256 t23 = _mm256_loadu_ps(rgba + 8);
+		__m256 t45 = _mm256_loadu_ps(rgba + 16);
+		__m256 t67 = _mm256_loadu_ps(rgba + 24);
+		__m256 rg0 = _mm256_unpacklo_ps(t01, t23);
+		__m256 ba0 = _mm256_unpackhi_ps(t01, t23);
+		__m256 rg1 = _mm256_unpacklo_ps(t45, t67);
+		__m256 ba1 = _mm256_unpackhi_ps(t45, t67);
+		r = _mm256_shuffle_ps(rg0, rg1, 0x44);
+		g = _mm256_shuffle_ps(rg0, rg1, 0xEE);
+		b = _mm256_shuffle_ps(ba0, ba1, 0x44);
+	}
+
+	// Stores 8 packed texels whose lanes are in LoadRGB8 order.
+	CPU_AVX2_TARGET void StoreTexels8(uint32_t* dst, __m256i packed) {
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+			_mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)));
+	}
+
+	// Stores R, G, B and an alpha of 1 for 8 texels in natural order as RGBA.
+	CPU_AVX2_TARGET void StoreRGBA8(float* rgba, __m256 r, __m256 g, __m256 b) {
+		__m256i order = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+		r = _mm256_permutevar8x32_ps(r, order);
+		g = _mm256_permutevar8x32_ps(g, order);
+		b = _mm256_permutevar8x32_ps(b, order);
+		__m256 a = _mm256_set1_ps(1.0f);
+		__m256 rg0 = _mm256_unpacklo_ps(r, g);
+		__m256 ba0 = _mm256_unpacklo_ps(b, a);
+		__m256 rg1 = _mm256_unpackhi_ps(r, g);
+		__m256 ba1 = _mm256_unpackhi_ps(b, a);
+		_mm256_storeu_ps(rgba, _mm256_shuffle_ps(rg0, ba0, 0x44));
+		_mm256_storeu_ps(rgba + 8, _mm256_shuffle_ps(rg0, ba0, 0xEE));
+		_mm256_storeu_ps(rgba + 16, _mm256_shuffle_ps(rg1, ba1, 0x44));
+		_mm256_storeu_ps(rgba + 24, _mm256_shuffle_ps(rg1, ba1, 0xEE));
+	}
+
+	CPU_AVX2_TARGET size_t FloatsToHalvesAVX2(const float* src, uint16_t* dst, size_t count) {
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m256i half = HalfBitsAVX2(_mm256_loadu_ps(src + i));
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(half, half), 0x08);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_castsi256_si128(packed));
+		}
+		return i;
+	}
+
+	CPU_AVX2_TARGET size_t HalvesToFloatsAVX2(const uint16_t* src, float* dst, size_t count) {
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m256i half = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+			__m256i magnitude = SmallFloatsToFloatsAVX2(_mm256_and_si256(half, _mm256_set1_epi32(0x7fff)), 10);
+			__m256i sign = _mm256_slli_epi32(_mm256_and_si256(half, _mm256_set1_epi32(0x8000)), 16);
+			_mm256_storeu_ps(dst + i, _mm256_castsi256_ps(_mm256_or_si256(magnitude, sign)));
+		}
+		return i;
+	}
+
+	CPU_AVX2_TARGET size_t PackR11G11B10AVX2(const float* rgba, uint32_t* dst, size_t texels) {
+		size_t i = 0;
+		for (; i + 8 <= texels; i += 8) {
+			__m256 r, g, b;
+			LoadRGB8(rgba + i * 4, r, g, b);
+			__m256i packed = _mm256_or_si256(FloatsToSmallFloatsAVX2(r, 6),
+				_mm256_or_si256(_mm256_slli_epi32(FloatsToSmallFloatsAVX2(g, 6), 11),
+					_mm256_slli_epi32(FloatsToSmallFloatsAVX2(b, 5), 22)));
+			StoreTexels8(dst + i, packed);
+		}
+		return i;
+	}
+
+	CPU_AVX2_TARGET size_t UnpackR11G11B10AVX2(const uint32_t* src, float* rgba, size_t texels) {
+		size_t i = 0;
+		for (; i + 8 <= texels; i += 8) {
+			__m256i packed = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+			__m256i r = SmallFloatsToFloatsAVX2(_mm256_and_si256(packed, _mm256_set1_epi32(0x7ff)), 6);
+			__m256i g = SmallFloatsToFloatsAVX2(_mm256_and_si256(_mm256_srli_epi32(packed, 11), _mm256_set1_epi32(0x7ff)), 6);
+			__m256i b = SmallFloatsToFloatsAVX2(_mm256_srli_epi32(packed, 22), 5);
+			StoreRGBA8(rgba + i * 4, _mm256_castsi256_ps(r), _mm256_castsi256_ps(g), _mm256_castsi256_ps(b));
+		}
+		return i;
+	}
+
+	CPU_AVX2_TARGET size_t PackRGB9E5AVX2(const float* rgba, uint32_t* dst, size_t texels) {
+		__m256 zero = _mm256_setzero_ps();
+		__m256 maxValue = _mm256_set1_ps(kMaxRGB9E5);
+		size_t i = 0;
+		for (; i + 8 <= texels; i += 8) {
+			__m256 r, g, b;
+			LoadRGB8(rgba + i * 4, r, g, b);
+			r = _mm256_min_ps(_mm256_max_ps(r, zero), maxValue);
+			g = _mm256_min_ps(_mm256_max_ps(g, zero), maxValue);
+			b = _mm256_min_ps(_mm256_max_ps(b, zero), maxValue);
+			__m256 maxChannel = _mm256_max_ps(r, _mm256_max_ps(g, b));
+
+			// floor(log2(max)), at least -16, plus the bias of 15 and one.
+			__m256i exponent = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(maxChannel), 23),
+				_mm256_set1_epi32(127));
+			exponent = _mm256_add_epi32(_mm256_max_epi32(exponent, _mm256_set1_epi32(-16)), _mm256_set1_epi32(16));
+			__m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(
+				_mm256_sub_epi32(_mm256_set1_epi32(24 + 127), exponent), 23));
+			__m256i maxMantissa = _mm256_cvtps_epi32(_mm256_mul_ps(maxChannel, scale));
+			__m256i carry = _mm256_cmpeq_epi32(maxMantissa, _mm256_set1_epi32(512));
+			exponent = _mm256_sub_epi32(exponent, carry);
+			scale = _mm256_blendv_ps(scale, _mm256_mul_ps(scale, _mm256_set1_ps(0.5f)), _mm256_castsi256_ps(carry));
+
+			__m256i packed = _mm256_or_si256(_mm256_cvtps_epi32(_mm256_mul_ps(r, scale)),
+				_mm256_or_si256(_mm256_slli_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(g, scale)), 9),
+					_mm256_or_si256(_mm256_slli_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(b, scale)), 18),
+						_mm256_slli_epi32(exponent, 27))));
+			StoreTexels8(dst + i, packed);
+		}
+		return i;
+	}
+
+	CPU_AVX2_TARGET size_t UnpackRGB9E5AVX2(const uint32_t* src, float* rgba, size_t texels) {
+		__m256i mask = _mm256_set1_epi32(0x1ff);
+		size_t i = 0;
+		for (; i + 8 <= texels; i += 8) {
+			__m256i packed = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+			__m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(
+				_mm256_add_epi32(_mm256_srli_epi32(packed, 27), _mm256_set1_epi32(127 - 24)), 23));
+			__m256 r = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(packed, mask)), scale);
+			__m256 g = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(packed, 9), mask)), scale);
+			__m256 b = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(packed, 18), mask)), scale);
+			StoreRGBA8(rgba + i * 4, r, g, b);
+		}
+		return i;
+	}
+#endif
+}
+
+uint16_t FloatToHalf(float value) {
+	// Round to nearest even, see "float->half variants" by F. Giesen.
+	uint32_t f = BitsOf(value);
+	uint32_t sign = f & 0x80000000u;
+	f ^= sign;
+
+	uint16_t half;
+	if (f >= kHalfOverflow) {
+		half = f > kFloatInfinity ? 0x7e00 : 0x7c00;
+	}
+	else if (f < kMinNormal5) {
+		half = (uint16_t)(BitsOf(FloatOf(f) + FloatOf(DenormMagic(10))) - DenormMagic(10));
+	}
+	else {
+		uint32_t mantissaOdd = (f >> 13) & 1;
+		f += ((uint32_t)(15 - 127) << 23) + 0xfff;
+		f += mantissaOdd;
+		half = (uint16_t)(f >> 13);
+	}
+	return (uint16_t)(half | (sign >> 16));
+}
+
+float HalfToFloat(uint16_t half) {
+	float magnitude = SmallFloatToFloat(half & 0x7fffu, 10);
+	return FloatOf(BitsOf(magnitude) | ((uint32_t)(half & 0x8000) << 16));
+}
+
+uint32_t PackR11G11B10(const float rgb[3]) {
+	return FloatToSmallFloat(rgb[0], 6) | (FloatToSmallFloat(rgb[1], 6) << 11) | (FloatToSmallFloat(rgb[2], 5) << 22);
+}
+
+void UnpackR11G11B10(uint32_t packed, float rgb[3]) {
+	rgb[0] = SmallFloatToFloat(packed & 0x7ff, 6);
+	rgb[1] = SmallFloatToFloat((packed >> 11) & 0x7ff, 6);
+	rgb[2] = SmallFloatToFloat(packed >> 22, 5);
+}
+
+uint32_t PackRGB9E5(const float rgb[3]) {
+	// The shared exponent fits the largest channel into 9 bits, see
+	// EXT_texture_shared_exponent; the mantissas are rounded to nearest even.
+	float c[3];
+	for (int i = 0; i < 3; i++) {
+		c[i] = rgb[i] > 0.0f ? std::min(rgb[i], kMaxRGB9E5) : 0.0f;
+	}
+	float maxChannel = std::max(c[0], std::max(c[1], c[2]));
+	int exponent = std::max((int)(BitsOf(maxChannel) >> 23) - 127, -16) + 16;
+	float scale = FloatOf((uint32_t)(24 + 127 - exponent) << 23);
+	if (std::nearbyint(maxChannel * scale) == 512.0f) {
+		exponent++;
+		scale *= 0.5f;
+	}
+	uint32_t packed = (uint32_t)exponent << 27;
+	for (int i = 0; i < 3; i++) {
+		packed |= (uint32_t)std::nearbyint(c[i] * scale) << (9 * i);
+	}
+	return packed;
+}
+
+void UnpackRGB9E5(uint32_t packed, float rgb[3]) {
+	float scale = FloatOf(((packed >> 27) + 127 - 24) << 23);
+	for (int i = 0; i < 3; i++) {
+		rgb[i] = (float)((packed >> (9 * i)) & 0x1ff) * scale;
+	}
+}
+
+void FloatsToHalves(const float* src, uint16_t* dst, size_t count, bool allowSimd) {
+	size_t i = 0;
+#if CPU_AVX2_COMPILED
+	if (UseAVX2(allowSimd)) {
+		i = FloatsToHalvesAVX2(src, dst, count);
+	}
+#endif
+	for (; i < count; i++) {
+		dst[i] = FloatToHalf(src[i]);
+	}
+}
+
+void HalvesToFloats(const uint16_t* src, float* dst, size_t count, bool allowSimd) {
+	size_t i = 0;
+#if CPU_AVX2_COMPILED
+	if (UseAVX2(allowSimd)) {
+		i = HalvesToFloatsAVX2(src, dst, count);
+	}
+#endif
+	for (; i < count; i++) {
+		dst[i] = HalfToFloat(src[i]);
+	}
+}
+
+void PackR11G11B10(const float* rgba, uint32_t* dst, size_t texels, bool allowSimd) {
+	size_t i = 0;
+#if CPU_AVX2_COMPILED
+	if (UseAVX2(allowSimd)) {
+		i = PackR11G11B10AVX2(rgba, dst, texels);
+	}
+#endif
+	for (; i < texels; i++) {
+		dst[i] = PackR11G11B10(rgba + i * 4);
+	}
+}
+
+void UnpackR11G11B10(const uint32_t* src, float* rgba, size_t texels, bool allowSimd) {
+	size_t i = 0;
+#if CPU_AVX2_COMPILED
+	if (UseAVX2(allowSimd)) {
+		i = UnpackR11G11B10AVX2(src, rgba, texels);
+	}
+#endif
+	for (; i < texels; i++) {
+		UnpackR11G11B10(src[i], rgba + i * 4);
+		rgba[i * 4 + 3] = 1.0f;
+	}
+}
+
+void PackRGB9E5(const float* rgba, uint32_t* dst, size_t texels, bool allowSimd) {
+	size_t i = 0;
+#if CPU_AVX2_COMPILED
+	if (UseAVX2(allowSimd)) {
+		i = PackRGB9E5AVX2(rgba, dst, texels);
+	}
+#endif
+	for (; i < texels; i++) {
+		dst[i] = PackRGB9E5(rgba + i * 4);
+	}
+}
+
+void UnpackRGB9E5(const uint32_t* src, float* rgba, size_t texels, bool allowSimd) {
+	size_t i = 0;
+#if CPU_AVX2_COMPILED
+	if (UseAVX2(allowSimd)) {
+		i = UnpackRGB9E5AVX2(src, rgba, texels);
+	}
+#endif
+	for (; i < texels; i++) {
+		UnpackRGB9E5(src[i], rgba + i * 4);
+		rgba[i * 4 + 3] = 1.0f;
+	}
+}
+
+uint32_t HDRTexelBytes(uint32_t dxgiFormat) {
+	switch (dxgiFormat) {
+	case kDxgiFormatR32G32B32A32Float: return 16;
+	case kDxgiFormatR16G16B16A16Float: return 8;
+	case kDxgiFormatR11G11B10Float:
+	case kDxgiFormatR9G9B9E5SharedExp: return 4;
+	default: return 0;
+	}
+}
+
+void PackHDRTexels(uint32_t dxgiFormat, const float* rgba, size_t texels, void* dst, bool allowSimd) {
+	switch (dxgiFormat) {
+	case kDxgiFormatR32G32B32A32Float:
+		std::memcpy(dst, rgba, texels * 4 * sizeof(float));
+		break;
+	case kDxgiFormatR16G16B16A16Float:
+		FloatsToHalves(rgba, static_cast<uint16_t*>(dst), texels * 4, allowSimd);
+		break;
+	case kDxgiFormatR11G11B10Float:
+		PackR11G11B10(rgba, static_cast<uint32_t*>(dst), texels, allowSimd);
+		break;
+	case kDxgiFormatR9G9B9E5SharedExp:
+		PackRGB9E5(rgba, static_cast<uint32_t*>(dst), texels, allowSimd);
+		break;
+	default:
+		throw std::runtime_error("PackHDRTexels: unsupported format " + std::to_string(dxgiFormat));
+	}
+}
+
+HDRPackBenchmark BenchmarkHDRPacking(size_t texels, uint32_t iterations) {
+	iterations = std::max(iterations, 1u);
+	std::vector<float> rgba(texels * 4);
+	std::vector<float> unpacked(texels * 4);
+	std::vector<uint32_t> packed(texels * 2);
+	// Log-uniform over the range an environment map spans.
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> logValue(-12.0f, 14.0f);
+	for (float& v : rgba) {
+		v = std::exp2(logValue(rng));
+	}
+
+	typedef void(*PackFn)(const float*, void*, size_t, bool);
+	typedef void(*UnpackFn)(const void*, float*, size_t, bool);
+	struct Format {
+		const char* Name;
+		PackFn Pack;
+		UnpackFn Unpack;
+	};
+	const Format formats[] = {
+		{ "R16G16B16A16_FLOAT",
+			[](const float* src, void* dst, size_t n, bool simd) { FloatsToHalves(src, static_cast<uint16_t*>(dst), n * 4, simd); },
+			[](const void* src, float* dst, size_t n, bool simd) { HalvesToFloats(static_cast<const uint16_t*>(src), dst, n * 4, simd); } },
+		{ "R11G11B10_FLOAT",
+			[](const float* src, void* dst, size_t n, bool simd) { PackR11G11B10(src, static_cast<uint32_t*>(dst), n, simd); },
+			[](const void* src, float* dst, size_t n, bool simd) { UnpackR11G11B10(static_cast<const uint32_t*>(src), dst, n, simd); } },
+		{ "R9G9B9E5_SHAREDEXP",
+			[](const float* src, void* dst, size_t n, bool simd) { PackRGB9E5(src, static_cast<uint32_t*>(dst), n, simd); },
+			[](const void* src, float* dst, size_t n, bool simd) { UnpackRGB9E5(static_cast<const uint32_t*>(src), dst, n, simd); } },
+	};
+
+	HDRPackBenchmark bench;
+	bench.Simd = UseAVX2(true);
+	double gigabytes = (double)texels * 4 * sizeof(float) * iterations * 1e-9;
+	auto rate = [gigabytes](std::chrono::steady_clock::time_point start) {
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return seconds > 0.0 ? gigabytes / seconds : 0.0;
+	};
+	for (const Format& format : formats) {
+		HDRPackRates rates;
+		rates.Format = format.Name;
+		for (int simd = 0; simd < (bench.Simd ? 2 : 1); simd++) {
+			auto start = std::chrono::steady_clock::now();
+			for (uint32_t i = 0; i < iterations; i++) {
+				format.Pack(rgba.data(), packed.data(), texels, simd != 0);
+			}
+			(simd ? rates.SimdPackGBps : rates.ScalarPackGBps) = rate(start);
+			start = std::chrono::steady_clock::now();
+			for (uint32_t i = 0; i < iterations; i++) {
+				format.Unpack(packed.data(), unpacked.data(), texels, simd != 0);
+			}
+			(simd ? rates.SimdUnpackGBps : rates.ScalarUnpackGBps) = rate(start);
+		}
+		bench.Formats.push_back(rates);
+	}
+	return bench;
+}
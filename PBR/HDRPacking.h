@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Conversions between linear float texels and the compact HDR formats the GPU
+// filters natively.  Every conversion rounds to nearest even, and the AVX2 kernels
+// return the same bits as the scalar ones.
+//
+// FP16 follows IEEE 754: values past 65504 become infinity and NaNs stay NaN.  The
+// unsigned formats, R11G11B10_FLOAT and R9G9B9E5_SHAREDEXP, turn negatives and NaN
+// into 0 and clamp finite values to their largest finite one; only R11G11B10 keeps
+// +infinity.  Texel arrays are RGBA, four floats per texel; the packers ignore alpha
+// and the unpackers set it to 1.
+
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t half);
+uint32_t PackR11G11B10(const float rgb[3]);
+void UnpackR11G11B10(uint32_t packed, float rgb[3]);
+uint32_t PackRGB9E5(const float rgb[3]);
+void UnpackRGB9E5(uint32_t packed, float rgb[3]);
+
+void FloatsToHalves(const float* src, uint16_t* dst, size_t count, bool allowSimd = true);
+void HalvesToFloats(const uint16_t* src, float* dst, size_t count, bool allowSimd = true);
+void PackR11G11B10(const float* rgba, uint32_t* dst, size_t texels, bool allowSimd = true);
+void UnpackR11G11B10(const uint32_t* src, float* rgba, size_t texels, bool allowSimd = true);
+void PackRGB9E5(const float* rgba, uint32_t* dst, size_t texels, bool allowSimd = true);
+void UnpackRGB9E5(const uint32_t* src, float* rgba, size_t texels, bool allowSimd = true);
+
+// Bytes per texel of an HDR format the packers produce: R16G16B16A16_FLOAT,
+// R11G11B10_FLOAT, R9G9B9E5_SHAREDEXP or R32G32B32A32_FLOAT.  0 for other formats.
+uint32_t HDRTexelBytes(uint32_t dxgiFormat);
+// Converts RGBA float texels to the format.  Throws std::runtime_error when
+// HDRTexelBytes does not know it.
+void PackHDRTexels(uint32_t dxgiFormat, const float* rgba, size_t texels, void* dst, bool allowSimd = true);
+
+struct HDRPackRates {
+	const char* Format = "";
+	// Gigabytes of RGBA32F texels converted per second, in either direction.
+	double ScalarPackGBps = 0.0;
+	double ScalarUnpackGBps = 0.0;
+	double SimdPackGBps = 0.0;
+	double SimdUnpackGBps = 0.0;
+};
+
+struct HDRPackBenchmark {
+	bool Simd = false;
+	std::vector<HDRPackRates> Formats;
+};
+
+// Converts texels random HDR texels to and from each format, iterations times, with
+// the scalar and, when supported, the AVX2 code.
+HDRPackBenchmark BenchmarkHDRPacking(size_t texels = 1 << 20, uint32_t iterations = 8);
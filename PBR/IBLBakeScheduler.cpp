@@ -0,0 +1,145 @@
+#include "IBLBakeScheduler.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+	// Weight of a new measurement in the running cost estimate.
+	const float kCostSmoothing = 0.25f;
+
+	uint32_t MipExtent(uint32_t size, uint32_t mip) {
+		return std::max(size >> mip, 1u);
+	}
+}
+
+float CpuBakeBackend::ExecuteJob(const BakeJob& job) {
+	auto start = std::chrono::steady_clock::now();
+	mBakeTile(job);
+	return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+IBLBakeScheduler::IBLBakeScheduler(uint32_t tileSize) {
+	mTileSize = std::max(tileSize, 1u);
+}
+
+uint32_t IBLBakeScheduler::AddTarget(const BakeTargetDesc& desc) {
+	TargetState state;
+	state.Desc = desc;
+	state.CostPerTexelMs = desc.CostPerTexelMs;
+	mTargets.push_back(state);
+
+	uint32_t target = (uint32_t)mTargets.size() - 1;
+	QueueJobs(target);
+	return target;
+}
+
+void IBLBakeScheduler::QueueJobs(uint32_t target) {
+	TargetState& state = mTargets[target];
+	state.PendingJobs.assign(state.Desc.MipLevels, 0);
+	state.FinishedFrame = 0;
+
+	// Smallest mip first: it is the cheapest and, for the prefiltered map, the
+	// roughest one, which is the best stand-in for the mips that are still missing.
+	for (uint32_t mip = state.Desc.MipLevels; mip-- > 0;) {
+		uint32_t extent = MipExtent(state.Desc.Size, mip);
+		for (uint32_t face = 0; face < state.Desc.Faces; face++) {
+			for (uint32_t y = 0; y < extent; y += mTileSize) {
+				for (uint32_t x = 0; x < extent; x += mTileSize) {
+					BakeJob job;
+					job.Target = target;
+					job.Face = face;
+					job.Mip = mip;
+					job.X = x;
+					job.Y = y;
+					job.Width = std::min(mTileSize, extent - x);
+					job.Height = std::min(mTileSize, extent - y);
+					mJobs.push_back(job);
+
+					state.PendingJobs[mip]++;
+					mTotalEstimateMs += (double)state.Desc.CostPerTexelMs * job.Width * job.Height;
+				}
+			}
+		}
+	}
+}
+
+void IBLBakeScheduler::Restart() {
+	mJobs.clear();
+	mNextJob = 0;
+	mTotalEstimateMs = 0.0;
+	mDoneEstimateMs = 0.0;
+	for (uint32_t target = 0; target < mTargets.size(); target++) {
+		QueueJobs(target);
+	}
+}
+
+float IBLBakeScheduler::EstimateMs(const BakeJob& job)const {
+	return mTargets[job.Target].CostPerTexelMs * job.Width * job.Height;
+}
+
+uint32_t IBLBakeScheduler::RunFrame(IBakeBackend& backend, float budgetMs) {
+	if (Finished()) {
+		return 0;
+	}
+	mFrameCount++;
+
+	uint32_t executed = 0;
+	float spentMs = 0.0f;
+	while (mNextJob < mJobs.size()) {
+		const BakeJob& job = mJobs[mNextJob];
+		float estimateMs = EstimateMs(job);
+		if (executed > 0 && spentMs + estimateMs > budgetMs) {
+			break;
+		}
+
+		float measuredMs = backend.ExecuteJob(job);
+		if (measuredMs >= 0.0f) {
+			ReportCost(job.Target, (uint64_t)job.Width * job.Height, measuredMs);
+			spentMs += measuredMs;
+		}
+		else {
+			spentMs += estimateMs;
+		}
+
+		// Progress is measured against the initial estimates so that recalibration
+		// does not make it jump around.
+		TargetState& state = mTargets[job.Target];
+		mDoneEstimateMs += (double)state.Desc.CostPerTexelMs * job.Width * job.Height;
+		executed++;
+		mNextJob++;
+
+		state.PendingJobs[job.Mip]--;
+		if (TargetFinished(job.Target)) {
+			state.FinishedFrame = mFrameCount;
+		}
+	}
+	return executed;
+}
+
+void IBLBakeScheduler::ReportCost(uint32_t target, uint64_t texels, float milliseconds) {
+	if (texels == 0) {
+		return;
+	}
+	TargetState& state = mTargets[target];
+	float measured = milliseconds / texels;
+	state.CostPerTexelMs += (measured - state.CostPerTexelMs) * kCostSmoothing;
+}
+
+bool IBLBakeScheduler::TargetFinished(uint32_t target)const {
+	return MostDetailedCompleteMip(target) == 0;
+}
+
+float IBLBakeScheduler::Progress()const {
+	if (mTotalEstimateMs <= 0.0) {
+		return 1.0f;
+	}
+	return (float)std::min(mDoneEstimateMs / mTotalEstimateMs, 1.0);
+}
+
+uint32_t IBLBakeScheduler::MostDetailedCompleteMip(uint32_t target)const {
+	const TargetState& state = mTargets[target];
+	uint32_t mip = state.Desc.MipLevels;
+	while (mip > 0 && state.PendingJobs[mip - 1] == 0) {
+		mip--;
+	}
+	return mip;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// One unit of bake work: a rectangle of one face of one mip of a registered target.
+struct BakeJob {
+	uint32_t Target;
+	uint32_t Face;
+	uint32_t Mip;
+	uint32_t X;
+	uint32_t Y;
+	uint32_t Width;
+	uint32_t Height;
+};
+
+// Something that bakes texels.  The GPU bakers record draws into the frame's command
+// list, a CPU baker computes the texels directly; the scheduler does not care which.
+class IBakeBackend {
+public:
+	virtual ~IBakeBackend() = default;
+
+	// Bakes the job and returns the milliseconds it took, or a negative value when the
+	// work is asynchronous and its cost will arrive later through ReportCost.
+	virtual float ExecuteJob(const BakeJob& job) = 0;
+};
+
+// Bakes each job on the calling thread with bakeTile and returns the wall time it
+// took, so the scheduler works from measured costs right away.
+class CpuBakeBackend : public IBakeBackend {
+public:
+	explicit CpuBakeBackend(std::function<void(const BakeJob&)> bakeTile) : mBakeTile(std::move(bakeTile)) {}
+
+	virtual float ExecuteJob(const BakeJob& job)override;
+
+private:
+	std::function<void(const BakeJob&)> mBakeTile;
+};
+
+struct BakeTargetDesc {
+	uint32_t Size;
+	uint32_t MipLevels;
+	// 6 for cube maps, 1 for 2D textures.
+	uint32_t Faces;
+	// Initial guess of the cost of one texel of mip 0, refined as jobs report back.
+	float CostPerTexelMs;
+};
+
+// Splits IBL bakes into face x mip x tile jobs and runs as many of them per frame as
+// fit into a time budget.  Targets bake in registration order and mips from the
+// smallest up, so a low quality result is available after a few frames and each
+// target sharpens until it is complete.
+class IBLBakeScheduler {
+public:
+	explicit IBLBakeScheduler(uint32_t tileSize = 64);
+
+	// Queues every job of the target and returns its index for the queries below.
+	uint32_t AddTarget(const BakeTargetDesc& desc);
+
+	// Drops all queued work and restarts every target from scratch.
+	void Restart();
+
+	// Executes jobs until the estimated cost of the next one would exceed budgetMs.
+	// At least one job runs per call so the bake always progresses.  Returns the
+	// number of jobs executed.
+	uint32_t RunFrame(IBakeBackend& backend, float budgetMs);
+
+	// Feeds a measured cost back for jobs whose backend returned a negative time.
+	void ReportCost(uint32_t target, uint64_t texels, float milliseconds);
+
+	bool Finished()const { return mNextJob == mJobs.size(); }
+	bool TargetFinished(uint32_t target)const;
+	// Fraction of the total estimated work that has been executed, in [0, 1].
+	float Progress()const;
+
+	// Most detailed mip m of the target such that mips m..N-1 are all baked, or
+	// MipLevels when nothing is usable yet.
+	uint32_t MostDetailedCompleteMip(uint32_t target)const;
+
+	// Frame index (counted by RunFrame) at which the target finished, 0 until then.
+	uint32_t FinishedFrame(uint32_t target)const { return mTargets[target].FinishedFrame; }
+	uint32_t FrameCount()const { return mFrameCount; }
+
+private:
+	struct TargetState {
+		BakeTargetDesc Desc;
+		float CostPerTexelMs;
+		// Jobs still queued per mip.
+		std::vector<uint32_t> PendingJobs;
+		uint32_t FinishedFrame = 0;
+	};
+
+	void QueueJobs(uint32_t target);
+	float EstimateMs(const BakeJob& job)const;
+
+private:
+	uint32_t mTileSize;
+	std::vector<TargetState> mTargets;
+	std::vector<BakeJob> mJobs;
+	size_t mNextJob = 0;
+	double mTotalEstimateMs = 0.0;
+	double mDoneEstimateMs = 0.0;
+	uint32_t mFrameCount = 0;
+};
@@ -0,0 +1,243 @@
+#include "IrradianceVolume.h"
+#include "CubeMapSampler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+	const float kPi = 3.14159265358979f;
+	const float kGoldenAngle = 2.39996323f;
+
+	// A probe is buried in geometry when more of its rays than this hit back faces.
+	const float kMaxBackfaceFraction = 0.25f;
+
+	// Per probe rotation of the ray pattern, so that neighbouring probes do not
+	// alias the same way.
+	float ProbeRotation(uint32_t probe) {
+		uint32_t h = probe * 0x9e3779b9u;
+		h ^= h >> 16;
+		h *= 0x85ebca6bu;
+		h ^= h >> 13;
+		return (h & 0xffffff) * (2.0f * kPi / 16777216.0f);
+	}
+
+	// Spherical Fibonacci point i of count.
+	void FibonacciDirection(uint32_t i, uint32_t count, float rotation, float dir[3]) {
+		float z = 1.0f - (2.0f * i + 1.0f) / count;
+		float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+		float phi = i * kGoldenAngle + rotation;
+		dir[0] = r * std::cos(phi);
+		dir[1] = r * std::sin(phi);
+		dir[2] = z;
+	}
+}
+
+IrradianceVolume::IrradianceVolume(const IrradianceVolumeDesc& desc) {
+	for (int i = 0; i < 3; i++) {
+		if (desc.Dim[i] < 2 || !(desc.Max[i] > desc.Min[i])) {
+			throw std::runtime_error("IrradianceVolume: needs at least two probes along a non-empty extent per axis");
+		}
+	}
+	mDesc = desc;
+	mProbes.resize((size_t)desc.Dim[0] * desc.Dim[1] * desc.Dim[2]);
+}
+
+void IrradianceVolume::ProbePosition(uint32_t x, uint32_t y, uint32_t z, float position[3])const {
+	uint32_t cell[3] = { x, y, z };
+	for (int i = 0; i < 3; i++) {
+		position[i] = mDesc.Min[i] + (mDesc.Max[i] - mDesc.Min[i]) * cell[i] / (mDesc.Dim[i] - 1);
+	}
+}
+
+void IrradianceVolume::InvCellSize(float invCellSize[3])const {
+	for (int i = 0; i < 3; i++) {
+		invCellSize[i] = (mDesc.Dim[i] - 1) / (mDesc.Max[i] - mDesc.Min[i]);
+	}
+}
+
+IrradianceBakeStats IrradianceVolume::Bake(const ProbeScene& scene, const CubeMapImage& environment,
+	const SH9Color& environmentIrradiance, TaskPool& pool)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	CubeMapSampler sampler(environment);
+	uint32_t rayCount = std::max(mDesc.RaysPerProbe, 1u);
+	// Each ray stands for 4 pi / rayCount steradians: read the mip whose texels are
+	// about that large so that the few rays do not alias the environment.
+	float texelSolidAngle = 4.0f * kPi / (6.0f * environment.Size() * environment.Size());
+	float lod = std::max(0.0f, 0.5f * std::log2(4.0f * kPi / rayCount / texelSolidAngle));
+	lod = std::min(lod, (float)(environment.MipLevels() - 1));
+
+	std::vector<uint8_t> valid(mProbes.size(), 1);
+	uint32_t dimX = mDesc.Dim[0];
+	uint32_t dimY = mDesc.Dim[1];
+
+	pool.ParallelFor((uint32_t)mProbes.size(), [&](uint32_t probe) {
+		float origin[3];
+		ProbePosition(probe % dimX, (probe / dimX) % dimY, probe / (dimX * dimY), origin);
+		float rotation = ProbeRotation(probe);
+
+		std::vector<float> radiance((size_t)rayCount * 4, 0.0f);
+		std::vector<float> missX, missY, missZ;
+		std::vector<uint32_t> missRay;
+		missX.reserve(rayCount);
+		missY.reserve(rayCount);
+		missZ.reserve(rayCount);
+		missRay.reserve(rayCount);
+
+		uint32_t backfaces = 0;
+		for (uint32_t i = 0; i < rayCount; i++) {
+			float dir[3];
+			FibonacciDirection(i, rayCount, rotation, dir);
+
+			RayHit hit;
+			if (!scene.Geometry.Intersect(origin, dir, INFINITY, hit)) {
+				missX.push_back(dir[0]);
+				missY.push_back(dir[1]);
+				missZ.push_back(dir[2]);
+				missRay.push_back(i);
+				continue;
+			}
+
+			const float* normal = &scene.Normals[(size_t)hit.Triangle * 3];
+			if (normal[0] * dir[0] + normal[1] * dir[1] + normal[2] * dir[2] > 0.0f) {
+				backfaces++;
+				continue;
+			}
+
+			// Lambertian surface lit by the unoccluded environment.
+			float irradiance[3];
+			EvaluateSH9(environmentIrradiance, normal, irradiance);
+			const float* albedo = &scene.Albedo[(size_t)hit.Triangle * 3];
+			for (int c = 0; c < 3; c++) {
+				radiance[(size_t)i * 4 + c] = albedo[c] * std::max(irradiance[c], 0.0f);
+			}
+		}
+
+		// The misses go through the vectorized sampler in one batch.
+		std::vector<float> missRadiance(missRay.size() * 4);
+		std::vector<float> missLod(missRay.size(), lod);
+		sampler.SampleLevel(missX.data(), missY.data(), missZ.data(), missLod.data(), (uint32_t)missRay.size(), missRadiance.data());
+		for (size_t m = 0; m < missRay.size(); m++) {
+			for (int c = 0; c < 3; c++) {
+				radiance[(size_t)missRay[m] * 4 + c] = missRadiance[m * 4 + c];
+			}
+		}
+
+		SH9Color projected;
+		float weight = 4.0f * kPi / rayCount;
+		for (uint32_t i = 0; i < rayCount; i++) {
+			float dir[3], basis[9];
+			FibonacciDirection(i, rayCount, rotation, dir);
+			SHBasis9(dir, basis);
+			for (int k = 0; k < 9; k++) {
+				for (int c = 0; c < 3; c++) {
+					projected.C[k][c] += radiance[(size_t)i * 4 + c] * basis[k] * weight;
+				}
+			}
+		}
+
+		mProbes[probe] = RadianceToIrradianceSH9(projected);
+		valid[probe] = backfaces <= kMaxBackfaceFraction * rayCount;
+	});
+
+	IrradianceBakeStats stats;
+	stats.InvalidProbes = (uint32_t)std::count(valid.begin(), valid.end(), 0);
+	FillInvalidProbes(valid, environmentIrradiance);
+
+	stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stats.Rays = (uint64_t)rayCount * mProbes.size();
+	stats.MRaysPerSecond = stats.Seconds > 0.0 ? stats.Rays / (stats.Seconds * 1e6) : 0.0;
+	// The calling thread works through the loop next to the pool's workers.
+	stats.Threads = pool.ThreadCount() + 1;
+	return stats;
+}
+
+void IrradianceVolume::FillInvalidProbes(const std::vector<uint8_t>& valid, const SH9Color& fallback) {
+	// Grow the valid probes into the buried ones one neighbour ring at a time,
+	// averaging the valid face neighbours.
+	std::vector<uint8_t> current = valid;
+	std::vector<uint8_t> next;
+	int dim[3] = { (int)mDesc.Dim[0], (int)mDesc.Dim[1], (int)mDesc.Dim[2] };
+	const int offsets[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+
+	for (bool changed = true; changed;) {
+		changed = false;
+		next = current;
+		for (int z = 0; z < dim[2]; z++) {
+			for (int y = 0; y < dim[1]; y++) {
+				for (int x = 0; x < dim[0]; x++) {
+					size_t index = ((size_t)z * dim[1] + y) * dim[0] + x;
+					if (current[index]) {
+						continue;
+					}
+
+					SH9Color sum;
+					int count = 0;
+					for (const int* o : offsets) {
+						int nx = x + o[0], ny = y + o[1], nz = z + o[2];
+						if (nx < 0 || ny < 0 || nz < 0 || nx >= dim[0] || ny >= dim[1] || nz >= dim[2]) {
+							continue;
+						}
+						size_t neighbour = ((size_t)nz * dim[1] + ny) * dim[0] + nx;
+						if (!current[neighbour]) {
+							continue;
+						}
+						for (int k = 0; k < 9; k++) {
+							for (int c = 0; c < 3; c++) {
+								sum.C[k][c] += mProbes[neighbour].C[k][c];
+							}
+						}
+						count++;
+					}
+
+					if (count != 0) {
+						for (int k = 0; k < 9; k++) {
+							for (int c = 0; c < 3; c++) {
+								mProbes[index].C[k][c] = sum.C[k][c] / count;
+							}
+						}
+						next[index] = 1;
+						changed = true;
+					}
+				}
+			}
+		}
+		current.swap(next);
+	}
+
+	for (size_t i = 0; i < mProbes.size(); i++) {
+		if (!current[i]) {
+			mProbes[i] = fallback;
+		}
+	}
+}
+
+SH9Color IrradianceVolume::Sample(const float position[3])const {
+	int base[3];
+	float frac[3];
+	for (int i = 0; i < 3; i++) {
+		float coord = (position[i] - mDesc.Min[i]) * (mDesc.Dim[i] - 1) / (mDesc.Max[i] - mDesc.Min[i]);
+		coord = std::min(std::max(coord, 0.0f), (float)(mDesc.Dim[i] - 1));
+		base[i] = std::min((int)coord, (int)mDesc.Dim[i] - 2);
+		frac[i] = coord - base[i];
+	}
+
+	SH9Color result;
+	for (int corner = 0; corner < 8; corner++) {
+		int x = base[0] + (corner & 1);
+		int y = base[1] + ((corner >> 1) & 1);
+		int z = base[2] + ((corner >> 2) & 1);
+		float weight = ((corner & 1) ? frac[0] : 1.0f - frac[0]) *
+			(((corner >> 1) & 1) ? frac[1] : 1.0f - frac[1]) *
+			(((corner >> 2) & 1) ? frac[2] : 1.0f - frac[2]);
+		const SH9Color& probe = mProbes[((size_t)z * mDesc.Dim[1] + y) * mDesc.Dim[0] + x];
+		for (int k = 0; k < 9; k++) {
+			for (int c = 0; c < 3; c++) {
+				result.C[k][c] += probe.C[k][c] * weight;
+			}
+		}
+	}
+	return result;
+}
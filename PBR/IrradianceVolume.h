@@ -0,0 +1,64 @@
+#pragma once
+#include "BVH.h"
+#include "CubeMapImage.h"
+#include "SphericalHarmonics.h"
+#include "TaskPool.h"
+
+// What the probes see: the scene triangles in a BVH and, per triangle, the outward
+// normal and diffuse albedo used to shade hits with one bounce of the environment.
+struct ProbeScene {
+	TriangleBVH Geometry;
+	// Three floats per triangle, in the triangle order of the BVH input.
+	std::vector<float> Normals;
+	std::vector<float> Albedo;
+};
+
+struct IrradianceVolumeDesc {
+	float Min[3];
+	float Max[3];
+	// Probes along each axis, at least 2; the corner probes sit on Min and Max.
+	uint32_t Dim[3];
+	uint32_t RaysPerProbe = 256;
+};
+
+struct IrradianceBakeStats {
+	double Seconds = 0.0;
+	uint64_t Rays = 0;
+	// In millions.
+	double MRaysPerSecond = 0.0;
+	uint32_t Threads = 0;
+	// Probes buried in geometry, replaced by their neighbours.
+	uint32_t InvalidProbes = 0;
+};
+
+// Regular 3D grid of L2 SH irradiance probes.  Each probe stores irradiance / pi,
+// the convention of gAmbientSH and the irradiance map.
+class IrradianceVolume {
+public:
+	IrradianceVolume() = default;
+	explicit IrradianceVolume(const IrradianceVolumeDesc& desc);
+
+	const IrradianceVolumeDesc& Desc()const { return mDesc; }
+	uint32_t ProbeCount()const { return (uint32_t)mProbes.size(); }
+	// Probe (x, y, z) is at index (z * Dim[1] + y) * Dim[0] + x.
+	const SH9Color& Probe(uint32_t index)const { return mProbes[index]; }
+	void ProbePosition(uint32_t x, uint32_t y, uint32_t z, float position[3])const;
+	// Reciprocal of the probe spacing along each axis.
+	void InvCellSize(float invCellSize[3])const;
+
+	// Traces RaysPerProbe rays from every probe.  Misses sample the environment
+	// radiance, hits return the albedo times the environment irradiance on the hit
+	// normal.  environmentIrradiance comes from RadianceToIrradianceSH9.
+	IrradianceBakeStats Bake(const ProbeScene& scene, const CubeMapImage& environment,
+		const SH9Color& environmentIrradiance, TaskPool& pool = TaskPool::Default());
+
+	// Trilinear blend of the eight probes around position, clamped to the volume.
+	SH9Color Sample(const float position[3])const;
+
+private:
+	void FillInvalidProbes(const std::vector<uint8_t>& valid, const SH9Color& fallback);
+
+private:
+	IrradianceVolumeDesc mDesc = {};
+	std::vector<SH9Color> mProbes;
+};
@@ -1,7 +1,7 @@
 #include "LUTMap.h"
 
-LUTMap::LUTMap(ID3D12Device* device, UINT width, UINT height)
-	: RenderTexture(device, width, height, DXGI_FORMAT_R32G32_FLOAT)
+LUTMap::LUTMap(ID3D12Device* device, const IBLTextureDesc& desc)
+	: RenderTexture(device, desc.Size, desc.Size, 1, desc.Format)
 {
 }
 
@@ -119,7 +119,7 @@ void LUTMap::BuildPso() {
 	psoDesc.SampleMask = UINT_MAX;
 	psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
 	psoDesc.NumRenderTargets = 1;
-	psoDesc.RTVFormats[0] = DXGI_FORMAT_R32G32_FLOAT;
+	psoDesc.RTVFormats[0] = mFormat;
 	psoDesc.SampleDesc.Count = 1;
 	psoDesc.SampleDesc.Quality = 0;
 	psoDesc.DepthStencilState.DepthEnable = false;
@@ -131,31 +131,16 @@ void LUTMap::BuildPso() {
 	));
 }
 
-void LUTMap::BakeTexture(ID3D12GraphicsCommandList* cmdList) {
-	ThrowIfFailed(md3dDevice->CreateCommandAllocator(
-		D3D12_COMMAND_LIST_TYPE_DIRECT,
-		IID_PPV_ARGS(cmdListAlloc.GetAddressOf())
-	));
-
-	ThrowIfFailed(cmdListAlloc->Reset());
-	ThrowIfFailed(cmdList->Reset(cmdListAlloc.Get(), mPSO.Get()));
-
+void LUTMap::BakeRegion(ID3D12GraphicsCommandList* cmdList, UINT face, UINT mip, const D3D12_RECT& rect) {
+	cmdList->SetPipelineState(mPSO.Get());
 	cmdList->SetGraphicsRootSignature(mRootSignature.Get());
 
-	cmdList->ResourceBarrier(
-		1,
-		&CD3DX12_RESOURCE_BARRIER::Transition(
-			mTextureMap.Get(),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			D3D12_RESOURCE_STATE_RENDER_TARGET
-		)
-	);
+	TransitionForBake(cmdList, face, mip, true);
 
 	cmdList->RSSetViewports(1, &mViewport);
-	cmdList->RSSetScissorRects(1, &mScissorRect);
-
-	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(mRtvHeap->GetCPUDescriptorHandleForHeapStart());
+	cmdList->RSSetScissorRects(1, &rect);
 
+	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle = RtvHandle(0, 0);
 	cmdList->OMSetRenderTargets(1, &rtvHandle, true, nullptr);
 
 	cmdList->IASetVertexBuffers(0, 0, nullptr);
@@ -163,12 +148,5 @@ void LUTMap::BakeTexture(ID3D12GraphicsCommandList* cmdList) {
 	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	cmdList->DrawInstanced(6, 1, 0, 0);
 
-	cmdList->ResourceBarrier(
-		1,
-		&CD3DX12_RESOURCE_BARRIER::Transition(
-			mTextureMap.Get(),
-			D3D12_RESOURCE_STATE_RENDER_TARGET,
-			D3D12_RESOURCE_STATE_GENERIC_READ
-		)
-	);
+	TransitionForBake(cmdList, face, mip, false);
 }
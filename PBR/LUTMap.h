@@ -3,13 +3,14 @@
 
 class LUTMap : public RenderTexture{
 public:
-	LUTMap(ID3D12Device* device, UINT width, UINT height);
+	LUTMap(ID3D12Device* device, const IBLTextureDesc& desc);
 	LUTMap(const LUTMap& rhs) = delete;
 	LUTMap& operator=(const LUTMap& rhs) = delete;
 	virtual ~LUTMap() = default;
 
+	virtual UINT FaceCount()const override { return 1; }
 	virtual void OnResize(UINT newWidth, UINT newHeight)override;
-	virtual void BakeTexture(ID3D12GraphicsCommandList* cmdList)override;
+	virtual void BakeRegion(ID3D12GraphicsCommandList* cmdList, UINT face, UINT mip, const D3D12_RECT& rect)override;
 
 protected:
 	virtual void BuildResource()override;
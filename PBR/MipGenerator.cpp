@@ -0,0 +1,506 @@
+#include "MipGenerator.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#if CPU_AVX2_COMPILED
+#include <immintrin.h>
+#endif
+
+namespace {
+	// Entries of the table the AVX2 path encodes sRGB with.
+	const uint32_t kSrgbEncodeSize = 4096;
+
+	uint8_t ToUnorm8(float v) {
+		return (uint8_t)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+
+	uint8_t LinearToSrgb8(float c) {
+		c = std::min(std::max(c, 0.0f), 1.0f);
+		return ToUnorm8(c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f);
+	}
+
+	struct SrgbTables {
+		float ToLinear[256];
+		// sRGB code of the linear value (i / (kSrgbEncodeSize - 1))^2.  Indexing by the
+		// square root gives the steep part near black enough entries.
+		int32_t Encode[kSrgbEncodeSize];
+
+		SrgbTables() {
+			for (int i = 0; i < 256; i++) {
+				float c = i / 255.0f;
+				ToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (uint32_t i = 0; i < kSrgbEncodeSize; i++) {
+				float s = (float)i / (kSrgbEncodeSize - 1);
+				Encode[i] = LinearToSrgb8(s * s);
+			}
+		}
+	};
+
+	const SrgbTables& Srgb() {
+		static const SrgbTables tables;
+		return tables;
+	}
+
+	bool UseAVX2(bool allowed) {
+#if CPU_AVX2_COMPILED
+		return allowed && CpuHasAVX2();
+#else
+		(void)allowed;
+		return false;
+#endif
+	}
+
+	void CheckImage(const SourceImage& image, const char* message) {
+		if (image.Width == 0 || image.Height == 0 || image.Pixels.size() != (size_t)image.Width * image.Height * 4) {
+			throw std::runtime_error(message);
+		}
+	}
+
+	void Normalize3(float* n) {
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length > 1e-6f) {
+			n[0] /= length;
+			n[1] /= length;
+			n[2] /= length;
+		}
+		else {
+			n[0] = 0.0f;
+			n[1] = 0.0f;
+			n[2] = 1.0f;
+		}
+	}
+
+	// GGX alpha is roughness squared.  Averaging normals of length one gives a shorter
+	// vector; the Toksvig variance (1 - |n|) / |n| is added to alpha squared.
+	float ToksvigRoughness(float roughness, float normalLength) {
+		roughness = std::min(std::max(roughness, 0.0f), 1.0f);
+		normalLength = std::min(std::max(normalLength, 1e-4f), 1.0f);
+		float variance = (1.0f - normalLength) / normalLength;
+		float alpha = roughness * roughness;
+		return std::sqrt(std::sqrt(std::min(alpha * alpha + variance, 1.0f)));
+	}
+
+	// Source texels and weights of a box filter from srcSize down to dstSize texels.
+	// Destination texel i covers [i, i + 1) * srcSize / dstSize of the source.
+	struct BoxTaps {
+		std::vector<uint32_t> First;
+		std::vector<uint32_t> Count;
+		std::vector<float> Weights;
+		std::vector<uint32_t> WeightOffset;
+	};
+
+	BoxTaps MakeBoxTaps(uint32_t srcSize, uint32_t dstSize) {
+		BoxTaps taps;
+		double scale = (double)srcSize / dstSize;
+		for (uint32_t i = 0; i < dstSize; i++) {
+			double begin = i * scale;
+			double end = (i + 1) * scale;
+			uint32_t first = (uint32_t)begin;
+			uint32_t last = std::min((uint32_t)std::ceil(end), srcSize);
+			taps.First.push_back(first);
+			taps.Count.push_back(last - first);
+			taps.WeightOffset.push_back((uint32_t)taps.Weights.size());
+			for (uint32_t j = first; j < last; j++) {
+				double overlap = std::min(end, (double)j + 1) - std::max(begin, (double)j);
+				taps.Weights.push_back((float)(overlap / scale));
+			}
+		}
+		return taps;
+	}
+
+	void FilterRow(const float* in, float* out, const BoxTaps& taps, uint32_t dstWidth) {
+		for (uint32_t x = 0; x < dstWidth; x++) {
+			float sum[4] = {};
+			const float* weights = &taps.Weights[taps.WeightOffset[x]];
+			for (uint32_t t = 0; t < taps.Count[x]; t++) {
+				const float* texel = in + (size_t)(taps.First[x] + t) * 4;
+				for (int c = 0; c < 4; c++) {
+					sum[c] += texel[c] * weights[t];
+				}
+			}
+			for (int c = 0; c < 4; c++) {
+				out[x * 4 + c] = sum[c];
+			}
+		}
+	}
+
+	void AccumulateRow(const float* in, float weight, float* out, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			out[i] += in[i] * weight;
+		}
+	}
+
+	void DecodeTexels(const uint8_t* in, float* out, size_t count, TextureUsage usage, bool premultiply) {
+		const SrgbTables& srgb = Srgb();
+		for (size_t i = 0; i < count; i++) {
+			const uint8_t* t = in + i * 4;
+			float* o = out + i * 4;
+			for (int c = 0; c < 3; c++) {
+				switch (usage) {
+				case TextureUsage::Color: o[c] = srgb.ToLinear[t[c]]; break;
+				case TextureUsage::Linear:
+				case TextureUsage::Packed: o[c] = t[c] / 255.0f; break;
+				case TextureUsage::Normal: o[c] = t[c] / 255.0f * 2.0f - 1.0f; break;
+				}
+			}
+			if (usage == TextureUsage::Normal) {
+				Normalize3(o);
+			}
+			o[3] = t[3] / 255.0f;
+			if (premultiply) {
+				for (int c = 0; c < 3; c++) {
+					o[c] *= o[3];
+				}
+			}
+		}
+	}
+
+	void StoreTexels(const float* in, uint8_t* out, size_t count, TextureUsage usage, bool premultiplied) {
+		for (size_t i = 0; i < count; i++) {
+			float t[4] = { in[i * 4], in[i * 4 + 1], in[i * 4 + 2], in[i * 4 + 3] };
+			uint8_t* o = out + i * 4;
+			if (premultiplied) {
+				float scale = t[3] > 0.0f ? 1.0f / t[3] : 0.0f;
+				for (int c = 0; c < 3; c++) {
+					t[c] *= scale;
+				}
+			}
+			switch (usage) {
+			case TextureUsage::Color:
+				for (int c = 0; c < 3; c++) {
+					o[c] = LinearToSrgb8(t[c]);
+				}
+				break;
+			case TextureUsage::Linear:
+			case TextureUsage::Packed:
+				for (int c = 0; c < 3; c++) {
+					o[c] = ToUnorm8(t[c]);
+				}
+				break;
+			case TextureUsage::Normal:
+				Normalize3(t);
+				for (int c = 0; c < 3; c++) {
+					o[c] = ToUnorm8(t[c] * 0.5f + 0.5f);
+				}
+				break;
+			}
+			o[3] = ToUnorm8(t[3]);
+		}
+	}
+
+	// Rewrites the roughness channel of stored texels from the filtered roughness and
+	// the length of the filtered normals.
+	void ApplyToksvig(const float* in, const float* normals, uint8_t* out, size_t count, uint32_t channel,
+		bool premultiplied)
+	{
+		for (size_t i = 0; i < count; i++) {
+			float roughness = in[i * 4 + channel];
+			if (premultiplied) {
+				float alpha = in[i * 4 + 3];
+				roughness = alpha > 0.0f ? roughness / alpha : 0.0f;
+			}
+			const float* n = normals + i * 4;
+			float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			out[i * 4 + channel] = ToUnorm8(ToksvigRoughness(roughness, length));
+		}
+	}
+
+#if CPU_AVX2_COMPILED
+	// x^2 + y^2 + z^2 in the x, y and z lanes of both texels.
+	CPU_AVX2_TARGET inline __m256 LengthSquared3(__m256 v) {
+		__m256 squared = _mm256_mul_ps(v, v);
+		return _mm256_add_ps(squared, _mm256_add_ps(_mm256_permute_ps(squared, _MM_SHUFFLE(3, 0, 2, 1)),
+			_mm256_permute_ps(squared, _MM_SHUFFLE(3, 1, 0, 2))));
+	}
+
+	// Like Normalize3 on both texels; the w lanes are left undefined.
+	CPU_AVX2_TARGET inline __m256 Normalize3x2(__m256 v) {
+		__m256 lengthSquared = LengthSquared3(v);
+		__m256 valid = _mm256_cmp_ps(lengthSquared, _mm256_set1_ps(1e-12f), _CMP_GT_OQ);
+		__m256 normalized = _mm256_div_ps(v, _mm256_sqrt_ps(lengthSquared));
+		return _mm256_blendv_ps(_mm256_setr_ps(0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f), normalized, valid);
+	}
+
+	CPU_AVX2_TARGET inline __m256i ToUnorm8x8(__m256 v) {
+		v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+		return _mm256_cvttps_epi32(_mm256_fmadd_ps(v, _mm256_set1_ps(255.0f), _mm256_set1_ps(0.5f)));
+	}
+
+	CPU_AVX2_TARGET inline void StoreBytes8(__m256i v, uint8_t* out) {
+		__m128i words = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+		_mm_storel_epi64((__m128i*)out, _mm_packus_epi16(words, words));
+	}
+
+	CPU_AVX2_TARGET void DecodeTexelsAVX2(const uint8_t* in, float* out, size_t count, TextureUsage usage,
+		bool premultiply)
+	{
+		const SrgbTables& srgb = Srgb();
+		const __m256 toUnit = _mm256_set1_ps(1.0f / 255.0f);
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2) {
+			__m256i bytes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + i * 4)));
+			__m256 unit = _mm256_mul_ps(_mm256_cvtepi32_ps(bytes), toUnit);
+			__m256 v = unit;
+			if (usage == TextureUsage::Color) {
+				v = _mm256_blend_ps(_mm256_i32gather_ps(srgb.ToLinear, bytes, 4), unit, 0x88);
+			}
+			else if (usage == TextureUsage::Normal) {
+				v = Normalize3x2(_mm256_fmadd_ps(unit, _mm256_set1_ps(2.0f), _mm256_set1_ps(-1.0f)));
+				v = _mm256_blend_ps(v, unit, 0x88);
+			}
+			if (premultiply) {
+				__m256 alpha = _mm256_permute_ps(v, _MM_SHUFFLE(3, 3, 3, 3));
+				v = _mm256_blend_ps(_mm256_mul_ps(v, alpha), v, 0x88);
+			}
+			_mm256_storeu_ps(out + i * 4, v);
+		}
+		DecodeTexels(in + i * 4, out + i * 4, count - i, usage, premultiply);
+	}
+
+	CPU_AVX2_TARGET void StoreTexelsAVX2(const float* in, uint8_t* out, size_t count, TextureUsage usage,
+		bool premultiplied)
+	{
+		const SrgbTables& srgb = Srgb();
+		const __m256 half = _mm256_set1_ps(0.5f);
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2) {
+			__m256 v = _mm256_loadu_ps(in + i * 4);
+			if (premultiplied) {
+				__m256 alpha = _mm256_permute_ps(v, _MM_SHUFFLE(3, 3, 3, 3));
+				__m256 covered = _mm256_cmp_ps(alpha, _mm256_setzero_ps(), _CMP_GT_OQ);
+				v = _mm256_blend_ps(_mm256_and_ps(_mm256_div_ps(v, alpha), covered), v, 0x88);
+			}
+			__m256i alphaCodes = ToUnorm8x8(v);
+			__m256i codes = alphaCodes;
+			if (usage == TextureUsage::Color) {
+				__m256 c = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+				__m256i index = _mm256_cvttps_epi32(_mm256_fmadd_ps(_mm256_sqrt_ps(c),
+					_mm256_set1_ps((float)(kSrgbEncodeSize - 1)), half));
+				codes = _mm256_blend_epi32(_mm256_i32gather_epi32((const int*)srgb.Encode, index, 4), alphaCodes, 0x88);
+			}
+			else if (usage == TextureUsage::Normal) {
+				codes = _mm256_blend_epi32(ToUnorm8x8(_mm256_fmadd_ps(Normalize3x2(v), half, half)), alphaCodes, 0x88);
+			}
+			StoreBytes8(codes, out + i * 4);
+		}
+		StoreTexels(in + i * 4, out + i * 4, count - i, usage, premultiplied);
+	}
+
+	// One row of a 2x2 box filter from the source rows a and b.
+	CPU_AVX2_TARGET void HalveRowAVX2(const float* a, const float* b, float* out, uint32_t dstWidth) {
+		const __m256 quarter = _mm256_set1_ps(0.25f);
+		uint32_t x = 0;
+		for (; x + 2 <= dstWidth; x += 2) {
+			__m256 left = _mm256_add_ps(_mm256_loadu_ps(a + x * 8), _mm256_loadu_ps(b + x * 8));
+			__m256 right = _mm256_add_ps(_mm256_loadu_ps(a + x * 8 + 8), _mm256_loadu_ps(b + x * 8 + 8));
+			__m256 even = _mm256_permute2f128_ps(left, right, 0x20);
+			__m256 odd = _mm256_permute2f128_ps(left, right, 0x31);
+			_mm256_storeu_ps(out + x * 4, _mm256_mul_ps(_mm256_add_ps(even, odd), quarter));
+		}
+		if (x < dstWidth) {
+			__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(a + x * 8), _mm_loadu_ps(a + x * 8 + 4)),
+				_mm_add_ps(_mm_loadu_ps(b + x * 8), _mm_loadu_ps(b + x * 8 + 4)));
+			_mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, _mm256_castps256_ps128(quarter)));
+		}
+	}
+
+	CPU_AVX2_TARGET void FilterRowAVX2(const float* in, float* out, const BoxTaps& taps, uint32_t dstWidth) {
+		for (uint32_t x = 0; x < dstWidth; x++) {
+			__m128 sum = _mm_setzero_ps();
+			const float* weights = &taps.Weights[taps.WeightOffset[x]];
+			const float* texel = in + (size_t)taps.First[x] * 4;
+			for (uint32_t t = 0; t < taps.Count[x]; t++) {
+				sum = _mm_fmadd_ps(_mm_loadu_ps(texel + t * 4), _mm_set1_ps(weights[t]), sum);
+			}
+			_mm_storeu_ps(out + x * 4, sum);
+		}
+	}
+
+	CPU_AVX2_TARGET void AccumulateRowAVX2(const float* in, float weight, float* out, size_t count) {
+		__m256 w = _mm256_set1_ps(weight);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			_mm256_storeu_ps(out + i, _mm256_fmadd_ps(_mm256_loadu_ps(in + i), w, _mm256_loadu_ps(out + i)));
+		}
+		AccumulateRow(in + i, weight, out + i, count - i);
+	}
+#endif
+
+	void DecodeImage(const SourceImage& image, TextureUsage usage, bool premultiply, bool simd,
+		std::vector<float>& texels, TaskPool& pool)
+	{
+		texels.resize(image.Pixels.size());
+		pool.ParallelFor(image.Height, [&](uint32_t y) {
+			size_t first = (size_t)y * image.Width;
+#if CPU_AVX2_COMPILED
+			if (simd) {
+				DecodeTexelsAVX2(&image.Pixels[first * 4], &texels[first * 4], image.Width, usage, premultiply);
+				return;
+			}
+#endif
+			DecodeTexels(&image.Pixels[first * 4], &texels[first * 4], image.Width, usage, premultiply);
+		});
+	}
+}
+
+void ResampleRGBA(const std::vector<float>& src, uint32_t srcWidth, uint32_t srcHeight,
+	std::vector<float>& dst, uint32_t dstWidth, uint32_t dstHeight, TaskPool& pool, bool allowSimd)
+{
+	bool simd = UseAVX2(allowSimd);
+#if CPU_AVX2_COMPILED
+	// Halving both sides, the common case down a chain, needs no weights.
+	if (simd && srcWidth == dstWidth * 2 && srcHeight == dstHeight * 2) {
+		dst.resize((size_t)dstWidth * dstHeight * 4);
+		pool.ParallelFor(dstHeight, [&](uint32_t y) {
+			const float* a = &src[(size_t)(2 * y) * srcWidth * 4];
+			HalveRowAVX2(a, a + (size_t)srcWidth * 4, &dst[(size_t)y * dstWidth * 4], dstWidth);
+		});
+		return;
+	}
+#endif
+
+	// Rows first, then columns.
+	BoxTaps horizontal = MakeBoxTaps(srcWidth, dstWidth);
+	BoxTaps vertical = MakeBoxTaps(srcHeight, dstHeight);
+
+	std::vector<float> rows((size_t)dstWidth * srcHeight * 4);
+	pool.ParallelFor(srcHeight, [&](uint32_t y) {
+		const float* in = &src[(size_t)y * srcWidth * 4];
+		float* out = &rows[(size_t)y * dstWidth * 4];
+#if CPU_AVX2_COMPILED
+		if (simd) {
+			FilterRowAVX2(in, out, horizontal, dstWidth);
+			return;
+		}
+#endif
+		FilterRow(in, out, horizontal, dstWidth);
+	});
+
+	dst.assign((size_t)dstWidth * dstHeight * 4, 0.0f);
+	pool.ParallelFor(dstHeight, [&](uint32_t y) {
+		float* out = &dst[(size_t)y * dstWidth * 4];
+		const float* weights = &vertical.Weights[vertical.WeightOffset[y]];
+		for (uint32_t t = 0; t < vertical.Count[y]; t++) {
+			const float* in = &rows[(size_t)(vertical.First[y] + t) * dstWidth * 4];
+#if CPU_AVX2_COMPILED
+			if (simd) {
+				AccumulateRowAVX2(in, weights[t], out, (size_t)dstWidth * 4);
+				continue;
+			}
+#endif
+			AccumulateRow(in, weights[t], out, (size_t)dstWidth * 4);
+		}
+	});
+}
+
+CompressedTexture GenerateMips(const SourceImage& image, const MipGenSettings& settings, TaskPool& pool) {
+	CheckImage(image, "GenerateMips: bad source image");
+	TextureUsage usage = settings.Usage;
+	const SourceImage* normals = settings.ToksvigNormals;
+	bool toksvig = normals && (usage == TextureUsage::Linear || usage == TextureUsage::Packed);
+	if (toksvig) {
+		CheckImage(*normals, "GenerateMips: bad Toksvig normal map");
+		if (settings.RoughnessChannel > 2) {
+			throw std::runtime_error("GenerateMips: roughness must be in R, G or B");
+		}
+	}
+	bool simd = UseAVX2(settings.AllowSimd);
+	bool premultiply = settings.AlphaWeighted && usage != TextureUsage::Normal;
+
+	uint32_t mipLevels = 1;
+	while ((image.Width >> mipLevels) || (image.Height >> mipLevels)) {
+		mipLevels++;
+	}
+	uint32_t format = usage == TextureUsage::Color ? kDxgiFormatR8G8B8A8UnormSrgb : kDxgiFormatR8G8B8A8Unorm;
+	CompressedTexture texture(image.Width, image.Height, mipLevels, 1, false, format, 4, 1);
+	std::copy(image.Pixels.begin(), image.Pixels.end(), texture.Blocks(0, 0));
+
+	std::vector<float> current;
+	DecodeImage(image, usage, premultiply, simd, current, pool);
+
+	// The normals are filtered down alongside, without renormalizing, so that their
+	// length at each mip tells how far the normals under a texel spread.
+	std::vector<float> normalLevel;
+	uint32_t normalWidth = 0;
+	uint32_t normalHeight = 0;
+	if (toksvig) {
+		DecodeImage(*normals, TextureUsage::Normal, false, simd, normalLevel, pool);
+		normalWidth = normals->Width;
+		normalHeight = normals->Height;
+	}
+
+	std::vector<float> next;
+	std::vector<float> normalNext;
+	for (uint32_t mip = 1; mip < mipLevels; mip++) {
+		uint32_t width = texture.MipWidth(mip);
+		uint32_t height = texture.MipHeight(mip);
+		ResampleRGBA(current, texture.MipWidth(mip - 1), texture.MipHeight(mip - 1), next, width, height, pool, simd);
+		if (toksvig) {
+			ResampleRGBA(normalLevel, normalWidth, normalHeight, normalNext, width, height, pool, simd);
+			normalLevel.swap(normalNext);
+			normalWidth = width;
+			normalHeight = height;
+		}
+
+		uint8_t* out = texture.Blocks(0, mip);
+		pool.ParallelFor(height, [&](uint32_t y) {
+			size_t first = (size_t)y * width;
+#if CPU_AVX2_COMPILED
+			if (simd) {
+				StoreTexelsAVX2(&next[first * 4], out + first * 4, width, usage, premultiply);
+			}
+			else
+#endif
+			{
+				StoreTexels(&next[first * 4], out + first * 4, width, usage, premultiply);
+			}
+			if (toksvig) {
+				ApplyToksvig(&next[first * 4], &normalLevel[first * 4], out + first * 4, width,
+					settings.RoughnessChannel, premultiply);
+			}
+		});
+		current.swap(next);
+	}
+	return texture;
+}
+
+MipGenBenchmark BenchmarkMipGeneration(const SourceImage& image, const MipGenSettings& settings, uint32_t iterations,
+	TaskPool& pool)
+{
+	iterations = std::max(iterations, 1u);
+	MipGenBenchmark bench;
+	double mpixels = (double)image.Width * image.Height * iterations * 1e-6;
+
+	auto run = [&](bool allowSimd, CompressedTexture& chain) {
+		MipGenSettings runSettings = settings;
+		runSettings.AllowSimd = allowSimd;
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < iterations; i++) {
+			chain = GenerateMips(image, runSettings, pool);
+		}
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	CompressedTexture scalarChain;
+	bench.ScalarSeconds = run(false, scalarChain);
+	if (bench.ScalarSeconds > 0.0) {
+		bench.ScalarMPixelsPerSecond = mpixels / bench.ScalarSeconds;
+	}
+
+	bench.Simd = UseAVX2(true);
+	if (bench.Simd) {
+		CompressedTexture simdChain;
+		bench.SimdSeconds = run(true, simdChain);
+		if (bench.SimdSeconds > 0.0) {
+			bench.SimdMPixelsPerSecond = mpixels / bench.SimdSeconds;
+		}
+		for (size_t i = 0; i < scalarChain.ByteSize(); i++) {
+			uint32_t difference = (uint32_t)std::abs((int)scalarChain.Data()[i] - (int)simdChain.Data()[i]);
+			bench.MaxDifference = std::max(bench.MaxDifference, difference);
+		}
+	}
+	return bench;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "CompressedTexture.h"
+#include "TaskPool.h"
+#include "TextureCooker.h"
+
+// How GenerateMips filters a texture.
+struct MipGenSettings {
+	TextureUsage Usage = TextureUsage::Color;
+	// Weights R, G and B by alpha while filtering, so that the color of transparent
+	// texels does not bleed into the mips.  Normals ignore it.
+	bool AlphaWeighted = false;
+	// Linear and packed textures: widens the roughness in RoughnessChannel by how much
+	// these normals spread over each texel (Toksvig), so that highlights keep their
+	// energy instead of turning sharp and sparkly in the distance.  The normal map may
+	// have any size.
+	const SourceImage* ToksvigNormals = nullptr;
+	uint32_t RoughnessChannel = 1;
+	// Uses the AVX2 paths when the CPU has them.  Their output is within one code of
+	// the scalar one.
+	bool AllowSimd = true;
+};
+
+// Builds the full mip chain of image as an RGBA8 texture in the format of the usage.
+// Mip 0 is the source as is.  Every other mip is box filtered from the float copy of
+// the one above, so rounding does not build up down the chain; odd sizes use
+// fractional texel weights.  Color is averaged in linear space and normals as unit
+// vectors that are renormalized on the way out.  Rows run in parallel on the pool.
+// Throws std::runtime_error on a malformed image.
+CompressedTexture GenerateMips(const SourceImage& image, const MipGenSettings& settings, TaskPool& pool = TaskPool::Default());
+
+// Box filters a float RGBA image to another size, the filter GenerateMips uses.
+void ResampleRGBA(const std::vector<float>& src, uint32_t srcWidth, uint32_t srcHeight,
+	std::vector<float>& dst, uint32_t dstWidth, uint32_t dstHeight, TaskPool& pool = TaskPool::Default(),
+	bool allowSimd = true);
+
+struct MipGenBenchmark {
+	bool Simd = false;
+	double ScalarSeconds = 0.0;
+	double SimdSeconds = 0.0;
+	// Source texels per second.
+	double ScalarMPixelsPerSecond = 0.0;
+	double SimdMPixelsPerSecond = 0.0;
+	// Largest difference of any byte between the two chains.
+	uint32_t MaxDifference = 0;
+};
+
+// Generates the chain of image iterations times with the scalar code and with the
+// AVX2 code, and compares the results.  Without AVX2 only the scalar side runs.
+MipGenBenchmark BenchmarkMipGeneration(const SourceImage& image, const MipGenSettings& settings, uint32_t iterations,
+	TaskPool& pool = TaskPool::Default());
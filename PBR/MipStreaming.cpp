@@ -0,0 +1,270 @@
+#include "MipStreaming.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <queue>
+#include <stdexcept>
+
+namespace {
+	const uint32_t kNoMip = 0xffffffffu;
+	const float kPi = 3.14159265358979323846f;
+
+	// A candidate next finer mip for one texture in the budget split.
+	struct Step {
+		double PixelsPerByte;
+		uint32_t Texture;
+		uint32_t Mip;
+
+		bool operator<(const Step& rhs)const {
+			if (PixelsPerByte != rhs.PixelsPerByte) {
+				return PixelsPerByte < rhs.PixelsPerByte;
+			}
+			return Texture > rhs.Texture;
+		}
+	};
+}
+
+float RequiredMip(const StreamingView& view, const StreamingInstance& instance, uint32_t textureSize, float& coverage) {
+	float toCenter[3] = {
+		instance.Center[0] - view.Eye[0],
+		instance.Center[1] - view.Eye[1],
+		instance.Center[2] - view.Eye[2]
+	};
+	float distance = std::sqrt(toCenter[0] * toCenter[0] + toCenter[1] * toCenter[1] + toCenter[2] * toCenter[2]);
+	float depth = toCenter[0] * view.Look[0] + toCenter[1] * view.Look[1] + toCenter[2] * view.Look[2];
+
+	// Pixels one world unit spans at the nearest point of the bounds.  Inside the
+	// bounds the nearest point is taken to be a hundredth of the radius away.
+	float nearest = std::max(distance - instance.Radius, 0.01f * instance.Radius);
+	float pixelsPerUnit = view.ViewportHeight / (2.0f * nearest * std::tan(0.5f * view.FovY));
+
+	if (depth < -instance.Radius) {
+		coverage = 0.0f;
+	}
+	else {
+		float projectedRadius = instance.Radius * view.ViewportHeight /
+			(2.0f * std::max(distance, instance.Radius) * std::tan(0.5f * view.FovY));
+		coverage = std::min(kPi * projectedRadius * projectedRadius, view.ViewportWidth * view.ViewportHeight);
+	}
+
+	float texelsPerPixel = textureSize * instance.UVPerWorldUnit / pixelsPerUnit;
+	return std::log2(std::max(texelsPerPixel, 1e-6f));
+}
+
+MipStreamer::MipStreamer(const MipStreamingDesc& desc) : mDesc(desc) {
+	mDesc.MaxLoadsInFlight = std::max(mDesc.MaxLoadsInFlight, 1u);
+}
+
+uint32_t MipStreamer::AddTexture(const StreamedTextureDesc& desc) {
+	uint32_t mipLevels = (uint32_t)desc.MipBytes.size();
+	if (mipLevels == 0 || desc.TailMips == 0 || desc.TailMips > mipLevels) {
+		throw std::runtime_error("MipStreamer: bad texture desc");
+	}
+
+	TextureState texture;
+	texture.Desc = desc;
+	texture.TailMip = mipLevels - desc.TailMips;
+	texture.ResidentMip = texture.TailMip;
+	texture.TargetMip = texture.TailMip;
+	texture.LoadingMip = kNoMip;
+	texture.RequiredMip = (float)texture.TailMip;
+	texture.Coverage = 0.0f;
+
+	uint64_t tailBytes = 0;
+	for (uint32_t mip = texture.TailMip; mip < mipLevels; mip++) {
+		tailBytes += desc.MipBytes[mip];
+	}
+	if (mCommittedBytes + tailBytes > mDesc.BudgetBytes) {
+		throw std::runtime_error("MipStreamer: mip tails exceed the budget");
+	}
+	mCommittedBytes += tailBytes;
+	mStats.PeakBytes = std::max(mStats.PeakBytes, mCommittedBytes);
+	mTextures.push_back(texture);
+	return (uint32_t)mTextures.size() - 1;
+}
+
+void MipStreamer::BeginFrame() {
+	for (TextureState& texture : mTextures) {
+		texture.RequiredMip = (float)texture.TailMip;
+		texture.Coverage = 0.0f;
+	}
+}
+
+void MipStreamer::Request(uint32_t texture, float mip, float coverage) {
+	TextureState& state = mTextures[texture];
+	if (coverage <= 0.0f) {
+		return;
+	}
+	state.RequiredMip = std::min(state.RequiredMip, mip);
+	state.Coverage += coverage;
+}
+
+void MipStreamer::RequestInstances(const StreamingView& view, const StreamingInstance* instances, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		const TextureState& texture = mTextures[instances[i].Texture];
+		float coverage;
+		float mip = RequiredMip(view, instances[i], std::max(texture.Desc.Width, texture.Desc.Height), coverage);
+		Request(instances[i].Texture, mip, coverage);
+	}
+}
+
+std::vector<MipStreamCommand> MipStreamer::Update() {
+	mStats.Frames++;
+
+	// Split the budget left after the tails, best pixels per byte first.  Each
+	// texture's steps get more expensive as they get finer, so taking the best step
+	// of every texture in turn is the greedy fill of the budget.
+	uint64_t available = mDesc.BudgetBytes;
+	std::priority_queue<Step> steps;
+	for (uint32_t t = 0; t < (uint32_t)mTextures.size(); t++) {
+		TextureState& texture = mTextures[t];
+		for (uint32_t mip = texture.TailMip; mip < texture.Desc.MipBytes.size(); mip++) {
+			available -= texture.Desc.MipBytes[mip];
+		}
+		texture.TargetMip = texture.TailMip;
+		uint32_t wanted = (uint32_t)std::max(std::floor(texture.RequiredMip), 0.0f);
+		if (texture.Coverage > 0.0f && wanted < texture.TailMip) {
+			uint32_t mip = texture.TailMip - 1;
+			steps.push({ texture.Coverage / (double)texture.Desc.MipBytes[mip], t, mip });
+		}
+
+		float missing = texture.ResidentMip - std::max(texture.RequiredMip, 0.0f);
+		if (missing > 0.0f) {
+			mStats.MissingMipPixels += missing * texture.Coverage;
+		}
+	}
+	while (!steps.empty()) {
+		Step step = steps.top();
+		steps.pop();
+		TextureState& texture = mTextures[step.Texture];
+		uint64_t bytes = texture.Desc.MipBytes[step.Mip];
+		if (bytes > available) {
+			continue;
+		}
+		available -= bytes;
+		texture.TargetMip = step.Mip;
+		uint32_t wanted = (uint32_t)std::max(std::floor(texture.RequiredMip), 0.0f);
+		if (step.Mip > wanted) {
+			steps.push({ texture.Coverage / (double)texture.Desc.MipBytes[step.Mip - 1], step.Texture, step.Mip - 1 });
+		}
+	}
+
+	// Drops free their bytes at once, so they go first to make room for the loads.
+	// A texture with a load in flight drops once it lands.
+	std::vector<MipStreamCommand> commands;
+	for (uint32_t t = 0; t < (uint32_t)mTextures.size(); t++) {
+		TextureState& texture = mTextures[t];
+		while (texture.LoadingMip == kNoMip && texture.ResidentMip < texture.TargetMip) {
+			commands.push_back({ t, texture.ResidentMip, MipStreamAction::Drop });
+			mCommittedBytes -= texture.Desc.MipBytes[texture.ResidentMip];
+			texture.ResidentMip++;
+			mStats.Drops++;
+		}
+	}
+
+	std::vector<Step> loads;
+	for (uint32_t t = 0; t < (uint32_t)mTextures.size(); t++) {
+		const TextureState& texture = mTextures[t];
+		if (texture.LoadingMip == kNoMip && texture.TargetMip < texture.ResidentMip) {
+			uint32_t mip = texture.ResidentMip - 1;
+			loads.push_back({ texture.Coverage / (double)texture.Desc.MipBytes[mip], t, mip });
+		}
+	}
+	std::sort(loads.begin(), loads.end(), [](const Step& a, const Step& b) { return b < a; });
+	for (const Step& load : loads) {
+		if (mLoadsInFlight == mDesc.MaxLoadsInFlight) {
+			break;
+		}
+		TextureState& texture = mTextures[load.Texture];
+		uint64_t bytes = texture.Desc.MipBytes[load.Mip];
+		// Other textures may still hold mips they are about to give up.
+		if (mCommittedBytes + bytes > mDesc.BudgetBytes) {
+			continue;
+		}
+		commands.push_back({ load.Texture, load.Mip, MipStreamAction::Load });
+		texture.LoadingMip = load.Mip;
+		mCommittedBytes += bytes;
+		mLoadsInFlight++;
+		mStats.Loads++;
+		mStats.LoadedBytes += bytes;
+	}
+	mStats.PeakBytes = std::max(mStats.PeakBytes, mCommittedBytes);
+	return commands;
+}
+
+void MipStreamer::LoadFinished(uint32_t texture, uint32_t mip) {
+	TextureState& state = mTextures[texture];
+	if (state.LoadingMip != mip) {
+		throw std::runtime_error("MipStreamer: finished a load that was not started");
+	}
+	state.LoadingMip = kNoMip;
+	state.ResidentMip = mip;
+	mLoadsInFlight--;
+}
+
+MipStreamingSimStats SimulateMipStreaming(const MipStreamingScenario& scenario, const MipStreamingDesc& desc) {
+	MipStreamer streamer(desc);
+	for (const StreamedTextureDesc& texture : scenario.Textures) {
+		streamer.AddTexture(texture);
+	}
+
+	struct PendingLoad {
+		uint64_t Frame;
+		uint32_t Texture;
+		uint32_t Mip;
+	};
+	std::deque<PendingLoad> pending;
+
+	MipStreamingSimStats stats;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t frame = 0; frame < scenario.Path.size(); frame++) {
+		while (!pending.empty() && pending.front().Frame <= frame) {
+			streamer.LoadFinished(pending.front().Texture, pending.front().Mip);
+			pending.pop_front();
+		}
+
+		streamer.BeginFrame();
+		streamer.RequestInstances(scenario.Path[frame], scenario.Instances.data(), scenario.Instances.size());
+		for (const MipStreamCommand& command : streamer.Update()) {
+			if (command.Action == MipStreamAction::Load) {
+				pending.push_back({ frame + scenario.LoadLatencyFrames, command.Texture, command.Mip });
+			}
+		}
+		if (streamer.CommittedBytes() > desc.BudgetBytes) {
+			stats.FramesOverBudget++;
+		}
+	}
+	stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stats.Streaming = streamer.Stats();
+	if (!scenario.Path.empty()) {
+		stats.MeanMissingMipPixels = stats.Streaming.MissingMipPixels / scenario.Path.size();
+	}
+	return stats;
+}
+
+std::vector<StreamingView> MakeOrbitPath(const float center[3], float minDistance, float maxDistance,
+	uint32_t frames, float fovY, float viewportWidth, float viewportHeight)
+{
+	std::vector<StreamingView> path;
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		float t = frames > 1 ? (float)frame / (frames - 1) : 0.0f;
+		float angle = 2.0f * kPi * t;
+		float distance = minDistance + (maxDistance - minDistance) * 0.5f * (1.0f + std::cos(3.0f * angle));
+
+		StreamingView view;
+		view.Eye[0] = center[0] + distance * std::sin(angle);
+		view.Eye[1] = center[1] + 0.25f * distance;
+		view.Eye[2] = center[2] - distance * std::cos(angle);
+		float look[3] = { center[0] - view.Eye[0], center[1] - view.Eye[1], center[2] - view.Eye[2] };
+		float length = std::sqrt(look[0] * look[0] + look[1] * look[1] + look[2] * look[2]);
+		for (int c = 0; c < 3; c++) {
+			view.Look[c] = look[c] / length;
+		}
+		view.FovY = fovY;
+		view.ViewportWidth = viewportWidth;
+		view.ViewportHeight = viewportHeight;
+		path.push_back(view);
+	}
+	return path;
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What the camera sees, in the terms mip selection needs.
+struct StreamingView {
+	float Eye[3];
+	// Unit view direction.
+	float Look[3];
+	// Vertical field of view in radians.
+	float FovY;
+	float ViewportWidth;
+	float ViewportHeight;
+};
+
+// Something drawn with a streamed texture: its world bounding sphere and how many
+// UV units one world unit spans on its surface.  A sphere of radius r with the
+// texture wrapped around it once has about 1 / (2 pi r).
+struct StreamingInstance {
+	float Center[3];
+	float Radius;
+	float UVPerWorldUnit;
+	uint32_t Texture;
+};
+
+// Finest mip the instance can show from the view: log2 of the texels per pixel at
+// the nearest point of its bounds, with textureSize texels across UV [0, 1].  Can be
+// negative when it is magnified.  coverage gets the projected pixel area of the
+// bounds, clamped to the viewport, or 0 when it is behind the eye.
+float RequiredMip(const StreamingView& view, const StreamingInstance& instance, uint32_t textureSize, float& coverage);
+
+struct StreamedTextureDesc {
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	// Bytes of every mip, finest first.
+	std::vector<uint64_t> MipBytes;
+	// Mips at the end of the chain that are always resident.
+	uint32_t TailMips = 1;
+};
+
+struct MipStreamingDesc {
+	// Bytes of all resident mips plus those being loaded never exceed this.
+	uint64_t BudgetBytes = 256ull << 20;
+	uint32_t MaxLoadsInFlight = 4;
+};
+
+enum class MipStreamAction {
+	// Start reading the mip; call LoadFinished once it is in place.
+	Load,
+	// Stop sampling the mip and release it, right away.
+	Drop
+};
+
+struct MipStreamCommand {
+	uint32_t Texture;
+	uint32_t Mip;
+	MipStreamAction Action;
+};
+
+struct MipStreamingStats {
+	uint64_t Frames = 0;
+	uint64_t Loads = 0;
+	uint64_t Drops = 0;
+	uint64_t LoadedBytes = 0;
+	uint64_t PeakBytes = 0;
+	// Mip levels missing between what was resident and what was required, weighted by
+	// the coverage of the texture, summed over frames.  Lower is sharper.
+	double MissingMipPixels = 0.0;
+};
+
+// Keeps each texture's resident mips a contiguous run ending at the mip tail, and
+// picks per frame how far up every run should reach.  The budget goes to the steps
+// that add the most covered pixels per byte: every texture starts from its tail, and
+// the next finer mip of the texture whose coverage / mip bytes is highest is added
+// until it no longer fits or the texture reaches its required mip.  Textures move
+// towards that target one mip at a time: drops happen at once, loads are
+// asynchronous and count against the budget while in flight.
+class MipStreamer {
+public:
+	explicit MipStreamer(const MipStreamingDesc& desc);
+
+	// Returns the texture's index.  Its tail is resident from the start.  Throws
+	// std::runtime_error when the desc is inconsistent or the tails overflow the budget.
+	uint32_t AddTexture(const StreamedTextureDesc& desc);
+
+	// Starts collecting the needs of a frame.
+	void BeginFrame();
+	// The texture is seen needing mip, over coverage pixels.  Repeats keep the finest
+	// mip and add up the coverage.
+	void Request(uint32_t texture, float mip, float coverage);
+	// Requests every instance that is in front of the view.
+	void RequestInstances(const StreamingView& view, const StreamingInstance* instances, size_t count);
+	// Drops first, then loads by priority.
+	std::vector<MipStreamCommand> Update();
+	void LoadFinished(uint32_t texture, uint32_t mip);
+
+	// Finest resident mip; sampling must be clamped to it.
+	uint32_t ResidentMip(uint32_t texture)const { return mTextures[texture].ResidentMip; }
+	uint32_t TargetMip(uint32_t texture)const { return mTextures[texture].TargetMip; }
+	// Resident bytes plus the bytes of loads in flight.
+	uint64_t CommittedBytes()const { return mCommittedBytes; }
+	const MipStreamingStats& Stats()const { return mStats; }
+
+private:
+	struct TextureState {
+		StreamedTextureDesc Desc;
+		uint32_t TailMip;
+		uint32_t ResidentMip;
+		uint32_t TargetMip;
+		// Mip being loaded, or none.
+		uint32_t LoadingMip;
+		float RequiredMip;
+		float Coverage;
+	};
+
+private:
+	MipStreamingDesc mDesc;
+	std::vector<TextureState> mTextures;
+	uint64_t mCommittedBytes = 0;
+	uint32_t mLoadsInFlight = 0;
+	MipStreamingStats mStats;
+};
+
+// A recorded or scripted camera over a fixed scene, to check budget and priorities
+// without a GPU.  Loads finish LoadLatencyFrames frames after they were issued.
+struct MipStreamingScenario {
+	std::vector<StreamedTextureDesc> Textures;
+	std::vector<StreamingInstance> Instances;
+	std::vector<StreamingView> Path;
+	uint32_t LoadLatencyFrames = 2;
+};
+
+struct MipStreamingSimStats {
+	MipStreamingStats Streaming;
+	// Frames whose committed bytes went over the budget; 0 unless the tails alone do.
+	uint32_t FramesOverBudget = 0;
+	// Average MissingMipPixels per frame.
+	double MeanMissingMipPixels = 0.0;
+	double Seconds = 0.0;
+};
+
+MipStreamingSimStats SimulateMipStreaming(const MipStreamingScenario& scenario, const MipStreamingDesc& desc);
+
+// Camera circling center at a distance that swings between minDistance and
+// maxDistance over the path, always looking at center.
+std::vector<StreamingView> MakeOrbitPath(const float center[3], float minDistance, float maxDistance,
+	uint32_t frames, float fovY, float viewportWidth, float viewportHeight);
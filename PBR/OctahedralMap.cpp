@@ -0,0 +1,217 @@
+#include "OctahedralMap.h"
+#include "CubeMapSampler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	float SignNotZero(float x) {
+		return x >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	// Octahedral level whose texels cover the same angle as texels of cube mip
+	// cubeLod, and the other way round.
+	float OctLodForCubeLod(const CubeMapImage& cube, const OctahedralImage& oct, float cubeLod) {
+		return cubeLod + std::log2((float)oct.Size() / OctahedralSizeForCube(cube.Size()));
+	}
+}
+
+void OctahedralEncode(const float dir[3], float& u, float& v) {
+	float invL1 = 1.0f / std::max(std::fabs(dir[0]) + std::fabs(dir[1]) + std::fabs(dir[2]), 1e-20f);
+	float px = dir[0] * invL1;
+	float pz = dir[2] * invL1;
+	if (dir[1] < 0.0f) {
+		float fx = (1.0f - std::fabs(pz)) * SignNotZero(px);
+		float fz = (1.0f - std::fabs(px)) * SignNotZero(pz);
+		px = fx;
+		pz = fz;
+	}
+	u = 0.5f + 0.5f * px;
+	v = 0.5f + 0.5f * pz;
+}
+
+void OctahedralDecode(float u, float v, float dir[3]) {
+	float px = 2.0f * u - 1.0f;
+	float pz = 2.0f * v - 1.0f;
+	float py = 1.0f - std::fabs(px) - std::fabs(pz);
+	if (py < 0.0f) {
+		float fx = (1.0f - std::fabs(pz)) * SignNotZero(px);
+		float fz = (1.0f - std::fabs(px)) * SignNotZero(pz);
+		px = fx;
+		pz = fz;
+	}
+	float invLength = 1.0f / std::sqrt(px * px + py * py + pz * pz);
+	dir[0] = px * invLength;
+	dir[1] = py * invLength;
+	dir[2] = pz * invLength;
+}
+
+OctahedralImage::OctahedralImage(uint32_t size, uint32_t mipLevels) {
+	mSize = size;
+
+	uint32_t fullChain = 1;
+	while ((size >> fullChain) != 0) {
+		fullChain++;
+	}
+	mMipLevels = (mipLevels == 0 || mipLevels > fullChain) ? fullChain : mipLevels;
+
+	size_t offset = 0;
+	mOffsets.resize(mMipLevels);
+	for (uint32_t mip = 0; mip < mMipLevels; mip++) {
+		mOffsets[mip] = offset;
+		offset += (size_t)MipSize(mip) * MipSize(mip) * 4;
+	}
+	mData.resize(offset, 0.0f);
+}
+
+const float* OctahedralImage::Texel(uint32_t mip, int32_t x, int32_t y)const {
+	// Crossing an edge of the square lands on the mirrored texel of the same edge;
+	// the corners all meet at -Y.
+	int32_t size = (int32_t)MipSize(mip);
+	if (x < 0 || x >= size) {
+		x = x < 0 ? -1 - x : 2 * size - 1 - x;
+		y = size - 1 - y;
+	}
+	if (y < 0 || y >= size) {
+		y = y < 0 ? -1 - y : 2 * size - 1 - y;
+		x = size - 1 - x;
+	}
+	x = std::min(std::max(x, 0), size - 1);
+	y = std::min(std::max(y, 0), size - 1);
+	return Texels(mip) + ((size_t)y * size + x) * 4;
+}
+
+void OctahedralImage::AccumulateBilinear(uint32_t mip, float u, float v, float weight, float rgba[4])const {
+	float size = (float)MipSize(mip);
+	float px = u * size - 0.5f;
+	float py = v * size - 0.5f;
+	float x0 = std::floor(px);
+	float y0 = std::floor(py);
+	float fx = px - x0;
+	float fy = py - y0;
+
+	const float* t00 = Texel(mip, (int32_t)x0, (int32_t)y0);
+	const float* t10 = Texel(mip, (int32_t)x0 + 1, (int32_t)y0);
+	const float* t01 = Texel(mip, (int32_t)x0, (int32_t)y0 + 1);
+	const float* t11 = Texel(mip, (int32_t)x0 + 1, (int32_t)y0 + 1);
+
+	float w00 = (1.0f - fx) * (1.0f - fy) * weight;
+	float w10 = fx * (1.0f - fy) * weight;
+	float w01 = (1.0f - fx) * fy * weight;
+	float w11 = fx * fy * weight;
+	for (int c = 0; c < 4; c++) {
+		rgba[c] += w00 * t00[c] + w10 * t10[c] + w01 * t01[c] + w11 * t11[c];
+	}
+}
+
+void OctahedralImage::SampleLevel(const float dir[3], float lod, float rgba[4])const {
+	lod = std::min(std::max(lod, 0.0f), (float)(mMipLevels - 1));
+	uint32_t mip0 = (uint32_t)lod;
+	uint32_t mip1 = std::min(mip0 + 1, mMipLevels - 1);
+	float t = lod - (float)mip0;
+
+	float u, v;
+	OctahedralEncode(dir, u, v);
+	rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0.0f;
+	AccumulateBilinear(mip0, u, v, 1.0f - t, rgba);
+	if (t > 0.0f) {
+		AccumulateBilinear(mip1, u, v, t, rgba);
+	}
+}
+
+void CubeToOctahedral(const CubeMapImage& src, OctahedralImage& dst, uint32_t samplesPerAxis, TaskPool& pool) {
+	CubeMapSampler sampler(src);
+	samplesPerAxis = std::max(samplesPerAxis, 1u);
+	float lodOffset = -OctLodForCubeLod(src, dst, 0.0f);
+
+	for (uint32_t mip = 0; mip < dst.MipLevels(); mip++) {
+		uint32_t size = dst.MipSize(mip);
+		float lod = std::max((float)mip + lodOffset, 0.0f);
+		float* texels = dst.Texels(mip);
+
+		pool.ParallelFor(size, [&](uint32_t y) {
+			// One row of directions at a time, so the sampler can batch them.
+			uint32_t count = size * samplesPerAxis * samplesPerAxis;
+			std::vector<float> xs(count), ys(count), zs(count), lods(count, lod), rgba((size_t)count * 4);
+			uint32_t i = 0;
+			for (uint32_t x = 0; x < size; x++) {
+				for (uint32_t sy = 0; sy < samplesPerAxis; sy++) {
+					for (uint32_t sx = 0; sx < samplesPerAxis; sx++, i++) {
+						float dir[3];
+						OctahedralDecode((x + (sx + 0.5f) / samplesPerAxis) / size, (y + (sy + 0.5f) / samplesPerAxis) / size, dir);
+						xs[i] = dir[0];
+						ys[i] = dir[1];
+						zs[i] = dir[2];
+					}
+				}
+			}
+			sampler.SampleLevel(xs.data(), ys.data(), zs.data(), lods.data(), count, rgba.data());
+
+			float weight = 1.0f / (samplesPerAxis * samplesPerAxis);
+			for (uint32_t x = 0; x < size; x++) {
+				float* out = texels + ((size_t)y * size + x) * 4;
+				const float* in = rgba.data() + (size_t)x * samplesPerAxis * samplesPerAxis * 4;
+				for (int c = 0; c < 4; c++) {
+					float sum = 0.0f;
+					for (uint32_t s = 0; s < samplesPerAxis * samplesPerAxis; s++) {
+						sum += in[s * 4 + c];
+					}
+					out[c] = sum * weight;
+				}
+			}
+		});
+	}
+}
+
+void OctahedralToCube(const OctahedralImage& src, CubeMapImage& dst, TaskPool& pool) {
+	float lodOffset = OctLodForCubeLod(dst, src, 0.0f);
+
+	for (uint32_t mip = 0; mip < dst.MipLevels(); mip++) {
+		uint32_t size = dst.MipSize(mip);
+		float lod = std::max((float)mip + lodOffset, 0.0f);
+
+		pool.ParallelFor(6 * size, [&](uint32_t job) {
+			uint32_t face = job / size;
+			uint32_t y = job % size;
+			float* out = dst.Texels(face, mip) + (size_t)y * size * 4;
+			for (uint32_t x = 0; x < size; x++) {
+				float dir[3];
+				CubeFaceDirection(face, (x + 0.5f) / size, (y + 0.5f) / size, dir);
+				src.SampleLevel(dir, lod, out + (size_t)x * 4);
+			}
+		});
+	}
+}
+
+EnvMapError CompareOctahedralToCube(const CubeMapImage& cube, const OctahedralImage& oct, float cubeLod,
+	uint32_t directionCount)
+{
+	CubeMapSampler sampler(cube);
+	float octLod = OctLodForCubeLod(cube, oct, cubeLod);
+
+	double sumSq = 0.0;
+	double maxError = 0.0;
+	double sumReference = 0.0;
+	for (uint32_t i = 0; i < directionCount; i++) {
+		// Fibonacci sphere: evenly spread, deterministic directions.
+		float z = 1.0f - 2.0f * (i + 0.5f) / directionCount;
+		float r = std::sqrt(std::max(1.0f - z * z, 0.0f));
+		float phi = 2.39996323f * i;
+		float dir[3] = { r * std::cos(phi), z, r * std::sin(phi) };
+
+		float reference[4], value[4];
+		sampler.SampleLevel(dir, cubeLod, reference);
+		oct.SampleLevel(dir, octLod, value);
+		for (int c = 0; c < 3; c++) {
+			double error = std::fabs((double)value[c] - reference[c]);
+			sumSq += error * error;
+			maxError = std::max(maxError, error);
+			sumReference += reference[c];
+		}
+	}
+
+	double mean = std::max(sumReference / (3.0 * directionCount), 1e-20);
+	EnvMapError result;
+	result.RmsError = std::sqrt(sumSq / (3.0 * directionCount)) / mean;
+	result.MaxError = maxError / mean;
+	return result;
+}
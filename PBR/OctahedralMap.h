@@ -0,0 +1,67 @@
+#pragma once
+#include "CubeMapImage.h"
+#include "TaskPool.h"
+
+// Octahedral environment layout shared with Shaders/Octahedral.hlsl.  The sphere is
+// folded onto an octahedron and flattened into one square: +Y lands in the center,
+// -Y in the four corners, u grows along +X and v along +Z.
+
+// uv in [0,1]^2 of a direction, which does not need to be normalized.
+void OctahedralEncode(const float dir[3], float& u, float& v);
+// Normalized direction through uv.
+void OctahedralDecode(float u, float v, float dir[3]);
+
+// Side of the octahedral map that matches a cube map's face size: twice the face,
+// which stores 4/6 of the cube's texels.
+inline uint32_t OctahedralSizeForCube(uint32_t cubeSize) { return 2 * cubeSize; }
+
+// Linear RGBA32F octahedral map with a mip chain, stored mip after mip.
+class OctahedralImage {
+public:
+	OctahedralImage() = default;
+	// mipLevels == 0 allocates the full chain down to 1x1.
+	OctahedralImage(uint32_t size, uint32_t mipLevels);
+
+	uint32_t Size()const { return mSize; }
+	uint32_t MipLevels()const { return mMipLevels; }
+	uint32_t MipSize(uint32_t mip)const { return mSize >> mip ? mSize >> mip : 1; }
+
+	float* Texels(uint32_t mip) { return mData.data() + mOffsets[mip]; }
+	const float* Texels(uint32_t mip)const { return mData.data() + mOffsets[mip]; }
+
+	size_t ByteSize()const { return mData.size() * sizeof(float); }
+
+	// Trilinear sample at an explicit level of detail.  Bilinear taps past an edge
+	// are mirrored back the way the octahedron folds, so there are no seams.
+	void SampleLevel(const float dir[3], float lod, float rgba[4])const;
+
+private:
+	const float* Texel(uint32_t mip, int32_t x, int32_t y)const;
+	void AccumulateBilinear(uint32_t mip, float u, float v, float weight, float rgba[4])const;
+
+private:
+	uint32_t mSize = 0;
+	uint32_t mMipLevels = 0;
+	std::vector<size_t> mOffsets;
+	std::vector<float> mData;
+};
+
+// Fills every mip of dst from src.  Each texel averages samplesPerAxis^2 trilinear
+// cube samples taken at the cube mip with the same texel footprint, so the mips of
+// a prefiltered cube keep their meaning.
+void CubeToOctahedral(const CubeMapImage& src, OctahedralImage& dst, uint32_t samplesPerAxis = 2,
+	TaskPool& pool = TaskPool::Default());
+
+// The inverse conversion, one trilinear sample per cube texel.
+void OctahedralToCube(const OctahedralImage& src, CubeMapImage& dst, TaskPool& pool = TaskPool::Default());
+
+struct EnvMapError {
+	// Relative to the mean luminance of the reference, over RGB.
+	double RmsError = 0.0;
+	double MaxError = 0.0;
+};
+
+// Compares oct against cube at directionCount quasi-random directions, sampling
+// cube mip cubeLod and the matching octahedral level.
+EnvMapError CompareOctahedralToCube(const CubeMapImage& cube, const OctahedralImage& oct, float cubeLod,
+	uint32_t directionCount = 1 << 16);
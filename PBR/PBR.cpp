@@ -9,6 +9,30 @@
 #include "PreFilteredCubeMap.h"
 #include "LUTMap.h"
 #include "MeshLoader.h"
+#include "EquirectToCube.h"
+#include "OctahedralMap.h"
+#include "BC6HEncoder.h"
+#include "DDSFile.h"
+#include "TextureUpload.h"
+#include "IBLBakeScheduler.h"
+#include "GpuTimestamps.h"
+#include "SphericalHarmonics.h"
+#include "ReflectionProbes.h"
+#include "ReflectionProbeArray.h"
+#include "IrradianceVolume.h"
+#include "EnvironmentLights.h"
+#include "TextureCooker.h"
+#include "WICImage.h"
+#include "TextureStreamer.h"
+#include "MipGenerator.h"
+#include "BindlessDescriptorHeap.h"
+#include "ResourceRegistry.h"
+#include "AssetPackage.h"
+#include "FrustumCulling.h"
+#include "BVH.h"
+#include <chrono>
+#include <cstdio>
+#include <thread>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -16,7 +40,144 @@ using namespace DirectX::PackedVector;
 
 const int gNumFrameResources = 3;
 
-const int IBLMapSize = 2048;
+// IBL product configuration.  Irradiance is low frequency and needs only a few texels
+// per face, the prefiltered map keeps one mip per roughness step, and both stay HDR.
+// IBLLayout stores both as cubes or as octahedral 2D maps.
+const EnvMapLayout IBLLayout = EnvMapLayout::Cube;
+const IBLTextureDesc gIrradianceDesc = { 32, 1, DXGI_FORMAT_R11G11B10_FLOAT, IBLLayout };
+const IBLTextureDesc gPrefilteredDesc = { 512, 6, DXGI_FORMAT_R11G11B10_FLOAT, IBLLayout };
+const IBLTextureDesc gBrdfLUTDesc = { 512, 1, DXGI_FORMAT_R16G16_FLOAT };
+
+// The PNG textures are cooked into DDS files with their mip chains once, listed in
+// a manifest with the content hashes of source and result.  A source whose hash
+// changed is cooked again on the next launch.
+const char* const CookedTextureDir = "../textures-nondds/cooked";
+const char* const TextureManifestPath = "../textures-nondds/cooked/manifest.txt";
+// Cooked color maps become BC7, linear data BC4 and normal maps BC5 (XY only, Z is
+// rebuilt in the shader).  The blocks are then tuned to repeat and entropy coded in
+// the cooked files.  Changing these recooks the textures on the next launch.
+const TextureCookSettings gTextureCookSettings = { true, BCFormat::BC7, BCQuality::Quality };
+// Off: the PNG textures are decoded and get their mips generated at every launch,
+// and are uploaded as RGBA8 without touching the cooked files.
+const bool CookMaterialTextures = true;
+
+// Face size of the environment cube resampled from the HDR panorama.
+const UINT EnvironmentMapSize = 512;
+
+// Keep the environment cube as BC6H instead of RGBA32F.  The encode is cached as a
+// DDS next to the panorama, named by a hash of the panorama and the encode settings.
+// Without a cache the launch uses a fast encode, and the pool writes the cache in
+// EnvironmentBC6HQuality for the next one.
+const bool CompressEnvironment = true;
+const BC6HQuality EnvironmentBC6HQuality = BC6HQuality::Quality;
+// Format of the float environment cubes: the sky when it is not BC6H and the source
+// of the IBL bakes.  RGBA16F halves the upload of RGBA32F; R11G11B10_FLOAT and
+// R9G9B9E5_SHAREDEXP quarter it at lower precision.
+const DXGI_FORMAT EnvironmentFloatFormat = DXGI_FORMAT_R16G16B16A16_FLOAT;
+
+// The brightest regions of the environment become up to MaxDominantLights
+// directional lights.  They are clipped out of the environment that the IBL
+// products, the SH ambient and the irradiance volume see; the sky keeps them.
+const bool ExtractEnvironmentLights = true;
+const UINT MaxDominantLights = 2;
+
+// The fixed point lights of the scene, after the directional ones in Lights[].
+const UINT NumScenePointLights = 4;
+
+// GPU time per frame spent on baking the IBL products, and the rough cost of one
+// sample of the bake shaders used to size the first jobs.  Each job is timed with
+// GPU timestamps, up to IBLTimedJobsPerFrame of them a frame, and the scheduler
+// learns the real cost when the frame's fence has passed.
+const float IBLBakeBudgetMs = 2.0f;
+const float IBLMsPerSample = 1e-7f;
+const UINT IBLTimedJobsPerFrame = 128;
+
+// Local reflection probes.  Only ProbeArraySlices of them are resident at once, and
+// each frame rebakes at most ProbeBakesPerFrame, picked by dirtiness and by distance
+// to the camera in units of ProbeDistanceScale.
+const IBLTextureDesc gProbeDesc = { 64, 4, DXGI_FORMAT_R11G11B10_FLOAT };
+const UINT ProbeArraySlices = 8;
+const UINT ProbeCaptureSize = 64;
+const UINT ProbeBakesPerFrame = 1;
+const float ProbeDistanceScale = 10.0f;
+
+// SH irradiance volume over the opaque render items, baked on the CPU at startup.
+// Probes are IrradianceProbeSpacing apart; hits on the scene are shaded with the
+// material albedo constant and the environment irradiance.
+const bool UseIrradianceVolume = true;
+const float IrradianceProbeSpacing = 3.0f;
+const UINT IrradianceMaxProbesPerAxis = 32;
+const UINT IrradianceRaysPerProbe = 256;
+
+// The material textures stream their mips into reserved resources within
+// TextureStreamingBudget bytes.  Each frame every opaque item asks for the mip its
+// size on screen needs, and the views clamp to the mips that are resident.  Off, or
+// without tiled resources: every mip stays resident as loaded.
+const bool StreamMaterialTextures = true;
+const UINT64 TextureStreamingBudget = 64ull << 20;
+
+// All SRVs live in one shader visible heap.  Textures get persistent indices that
+// shaders use directly; the heap doubles when they run out.  Each frame resource
+// also has a ring of transient descriptors.
+const UINT BindlessInitialCapacity = 256;
+const UINT BindlessTransientPerFrame = 1024;
+
+// The cooked material textures, the DDS textures and the model are packed into one
+// file after the first launch that cooks them.  Later launches map it and copy the
+// textures straight into upload buffers, skipping the cooker and the model loader.
+// The package records the size, time and hash of every source file; when one of
+// them changed, the launch loads the loose files and writes the package again.
+const bool UseAssetPackage = true;
+const char* const AssetPackagePath = "../assets.pak";
+// Codec of the textures in the package.  Entropy takes the least space and decodes
+// on the pool at a few hundred MB/s per thread; LZ decodes at memory speed but
+// barely shrinks block compressed data.
+const PackageCodec PackageTextureCodec = PackageCodec::Entropy;
+
+// Opaque items are culled against the camera and the probe capture frustums by
+// their world space boxes and spheres.  The sky is always drawn.
+const bool CullRenderItems = true;
+// From this many opaque items on, culling walks a BVH over their boxes instead of
+// testing every item.  Low enough that the demo scene, a 10x10 grid of balls and a
+// few more items, goes through the BVH, so that path runs every frame; with so few
+// items both ways take microseconds.  Below it a tree would only add overhead.
+const UINT SceneBVHMinItems = 64;
+
+// A bake job recorded in a frame, and the timestamps around it.
+struct TimedBakeJob {
+	UINT Target;
+	UINT64 Texels;
+	UINT BeginQuery;
+	UINT EndQuery;
+};
+
+// Records the IBL bake jobs picked by the scheduler into the frame's command list,
+// between two timestamps.  The GPU runs them later, so their cost goes back to the
+// scheduler through ReportCost once the frame has finished.
+class RenderTextureBakeBackend : public IBakeBackend {
+public:
+	RenderTextureBakeBackend(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderTexture*>& targets,
+		GpuTimestamps& timestamps, std::vector<TimedBakeJob>& timedJobs)
+		: mCmdList(cmdList), mTargets(targets), mTimestamps(timestamps), mTimedJobs(timedJobs) {
+	}
+
+	virtual float ExecuteJob(const BakeJob& job)override {
+		D3D12_RECT rect = { (LONG)job.X, (LONG)job.Y, (LONG)(job.X + job.Width), (LONG)(job.Y + job.Height) };
+		UINT begin = mTimestamps.Write(mCmdList);
+		mTargets[job.Target]->BakeRegion(mCmdList, job.Face, job.Mip, rect);
+		UINT end = mTimestamps.Write(mCmdList);
+		if (begin != GpuTimestamps::kNoQuery && end != GpuTimestamps::kNoQuery) {
+			mTimedJobs.push_back({ job.Target, (UINT64)job.Width * job.Height, begin, end });
+		}
+		return -1.0f;
+	}
+
+private:
+	ID3D12GraphicsCommandList* mCmdList;
+	const std::vector<RenderTexture*>& mTargets;
+	GpuTimestamps& mTimestamps;
+	std::vector<TimedBakeJob>& mTimedJobs;
+};
 
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
@@ -44,6 +205,13 @@ struct RenderItem
 	MaterialObj* Mat = nullptr;
 	MeshGeometry* Geo = nullptr;
 
+	// Reflection probes blended over the global environment for this item.
+	ProbeSelection Probes;
+
+	// Object space bounds of the submesh.
+	BoundingBox Bounds;
+	BoundingSphere Sphere;
+
     // Primitive topology.
     D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
@@ -78,6 +246,13 @@ private:
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateMaterialBuffer(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
+	void ScheduleIBLBake();
+	void RecordIBLBake();
+	void ReportIBLBakeCosts();
+	void UpdateReflectionProbes(const GameTimer& gt);
+	void UpdateProbeCapturePassCBs(const GameTimer& gt);
+	void RecordProbeBakes();
+	void BindSceneResources(UINT passIndex);
 
 	void LoadTextures();
     void BuildRootSignature();
@@ -89,6 +264,16 @@ private:
     void BuildFrameResources();
     void BuildMaterials();
     void BuildRenderItems();
+	void BuildReflectionProbes();
+	void BuildIrradianceVolume();
+	void BuildCullingBounds();
+	void CullOpaqueItems(FXMMATRIX viewProj, std::vector<RenderItem*>& visible);
+	void BuildTextureStreaming();
+	void UpdateTextureStreaming();
+	void CreateStreamedTextureSrv(uint32_t texture);
+	ComPtr<ID3D12Resource> CreateSharedBuffer(const std::string& geometry, const void* data, UINT byteSize,
+		ComPtr<ID3D12Resource>& uploader);
+	void ReleaseSceneResources();
     void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
@@ -103,7 +288,16 @@ private:
 
     ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
 
-	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
+	std::unique_ptr<BindlessDescriptorHeap> mSrvHeap;
+	// Textures and geometry buffers with the same content share one resource.
+	std::unique_ptr<ResourceRegistry> mResources;
+	// The buffers each geometry holds a reference to in mResources, by its name.
+	std::unordered_map<std::string, std::vector<ContentHash>> mGeometryContent;
+
+	// The mapped package, or the assets collected for writing it when there is none.
+	std::unique_ptr<AssetPackage> mPackage;
+	std::unique_ptr<AssetPackageWriter> mPackageWriter;
+	std::vector<ComPtr<ID3D12Resource>> mPackageUploaders;
 
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
 	std::unordered_map<std::string, std::unique_ptr<MaterialObj>> mMaterials;
@@ -117,6 +311,42 @@ private:
 	std::unique_ptr<PreFilteredCubeMap> mPrefilteredMap;
 	std::unique_ptr<LUTMap> mLUTMap;
 
+	// The IBL products bake a few tiles per frame; until they are done the shaders
+	// fall back to the SH projection of the environment.
+	IBLBakeScheduler mIBLScheduler;
+	std::vector<RenderTexture*> mIBLTargets;
+	std::vector<std::string> mIBLTargetNames;
+	UINT mLUTBakeTarget = 0;
+	UINT mIrradianceBakeTarget = 0;
+	UINT mPrefilteredBakeTarget = 0;
+	std::chrono::steady_clock::time_point mIBLBakeStart;
+	// Jobs recorded by each frame resource, timed when its fence has passed.
+	std::unique_ptr<GpuTimestamps> mIBLTimestamps;
+	std::vector<std::vector<TimedBakeJob>> mIBLTimedJobs;
+	SH9Color mAmbientSH;
+
+	// Directional lights taken out of the environment, and the environment without
+	// them that the IBL products are baked from.
+	std::vector<DominantLight> mDominantLights;
+	ComPtr<ID3D12Resource> mIBLSourceTexture = nullptr;
+
+	// The environment on the CPU, kept until the irradiance volume has been baked.
+	CubeMapImage mEnvironment;
+	IrradianceVolume mIrradianceVolume;
+	ComPtr<ID3D12Resource> mIrradianceVolumeBuffer = nullptr;
+	ComPtr<ID3D12Resource> mIrradianceVolumeUploader = nullptr;
+
+	// The streamed material textures, and the textures that use each of them.
+	std::unique_ptr<TextureStreamer> mTextureStreamer;
+	std::unordered_map<TextureData*, uint32_t> mStreamedTextureIds;
+	std::vector<std::vector<TextureData*>> mStreamedTextureUsers;
+	std::vector<uint32_t> mStreamedTexturesChanged;
+
+	std::unique_ptr<ReflectionProbeArray> mProbeArray;
+	ReflectionProbeSet mProbes;
+	std::vector<uint32_t> mProbesToBake;
+	bool mProbesRelit = false;
+
     std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
  
 	// List of all the render items.
@@ -125,6 +355,15 @@ private:
 	// Render items divided by PSO.
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
+	// World space bounds of the opaque items in layer order, a BVH over them when
+	// there are many, and the items that pass the camera frustum and each probe
+	// capture face of this frame.
+	CullingBounds mOpaqueBounds;
+	SceneBVH mOpaqueBVH;
+	std::vector<uint32_t> mVisibleIds;
+	std::vector<RenderItem*> mVisibleOpaque;
+	std::vector<std::vector<RenderItem*>> mProbeFaceItems;
+
     PassConstants mMainPassCB;
 
 	Camera mCamera;
@@ -153,6 +392,12 @@ int WINAPI main(HINSTANCE hInstance, HINSTANCE prevInstance,
         MessageBox(nullptr, e.ToString().c_str(), L"HR Failed", MB_OK);
         return 0;
     }
+    // Texture cooking and the asset loaders report missing or broken files this way.
+    catch(std::exception& e)
+    {
+        MessageBox(nullptr, AnsiToWString(e.what()).c_str(), L"Failed", MB_OK);
+        return 0;
+    }
 }
 
 PBR::PBR(HINSTANCE hInstance) : D3DApp(hInstance)
@@ -162,7 +407,37 @@ PBR::PBR(HINSTANCE hInstance) : D3DApp(hInstance)
 PBR::~PBR()
 {
     if(md3dDevice != nullptr)
+    {
         FlushCommandQueue();
+        if(mResources != nullptr)
+            ReleaseSceneResources();
+    }
+}
+
+// Materials and geometry drop their references to the shared resources, which the
+// registry then retires.  The queue is idle, so they go at once.
+void PBR::ReleaseSceneResources()
+{
+	for (auto& texture : mTextures) {
+		mResources->Release(texture.second->Hash, mCurrentFence, mSrvHeap.get());
+		texture.second->Resource.Reset();
+	}
+	for (auto& geometry : mGeometries) {
+		for (const ContentHash& hash : mGeometryContent[geometry.first]) {
+			mResources->Release(hash, mCurrentFence, mSrvHeap.get());
+		}
+		geometry.second->VertexBufferGPU.Reset();
+		geometry.second->IndexBufferGPU.Reset();
+	}
+	mGeometryContent.clear();
+	mResources->Collect(mCurrentFence);
+
+	SharedResourceStats left = mResources->Stats();
+	if (left.LiveResources != 0) {
+		std::string leakMsg = "Resource registry: " + std::to_string(left.LiveResources) +
+			" resources still referenced at exit\n";
+		::OutputDebugStringA(leakMsg.c_str());
+	}
 }
 
 bool PBR::Initialize()
@@ -179,6 +454,7 @@ bool PBR::Initialize()
 
 	mCamera.SetPosition(0.0f, 0.0f, -3.0f);
 
+	mResources = std::make_unique<ResourceRegistry>(md3dDevice.Get());
 	LoadTextures();
     BuildRootSignature();
 	BuildDescriptorHeaps();
@@ -187,6 +463,10 @@ bool PBR::Initialize()
 	BuildMeshes();
 	BuildMaterials();
     BuildRenderItems();
+	BuildCullingBounds();
+	BuildTextureStreaming();
+	BuildReflectionProbes();
+	BuildIrradianceVolume();
     BuildFrameResources();
     BuildPSOs();
 
@@ -195,24 +475,13 @@ bool PBR::Initialize()
     ThrowIfFailed(mCommandList->Close());
     ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
     mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
-
-	mDiffuseLight->BakeTexture(mCommandList.Get());
-    ThrowIfFailed(mCommandList->Close());
-	cmdsLists[0] = mCommandList.Get();
-    mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
-
-	mPrefilteredMap->BakeTexture(mCommandList.Get());
-    ThrowIfFailed(mCommandList->Close());
-	cmdsLists[0] = mCommandList.Get();
-    mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
-
-	mLUTMap->BakeTexture(mCommandList.Get());
-    ThrowIfFailed(mCommandList->Close());
-	cmdsLists[0] = mCommandList.Get();
-    mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
-
-    // Wait until initialization is complete.
     FlushCommandQueue();
+	mPackageUploaders.clear();
+	if (mTextureStreamer) {
+		mTextureStreamer->FinishAdds();
+	}
+
+	ScheduleIBLBake();
 
     return true;
 }
@@ -244,6 +513,430 @@ void PBR::CreateRtvAndDsvDescriptorHeaps() {
         &dsvHeapDesc, IID_PPV_ARGS(mDsvHeap.GetAddressOf())));
 }
 
+void PBR::ScheduleIBLBake()
+{
+	// The LUT and the irradiance map are small and needed by every pixel, so they go
+	// first; the prefiltered map then refines from its roughest mip to its sharpest.
+	auto addTarget = [&](RenderTexture* target, const std::string& name, float samplesPerTexel) {
+		BakeTargetDesc desc;
+		desc.Size = target->Size();
+		desc.MipLevels = target->MipLevels();
+		desc.Faces = target->FaceCount();
+		desc.CostPerTexelMs = samplesPerTexel * IBLMsPerSample;
+
+		mIBLTargets.push_back(target);
+		mIBLTargetNames.push_back(name);
+		return mIBLScheduler.AddTarget(desc);
+	};
+
+	mLUTBakeTarget = addTarget(mLUTMap.get(), "BRDF LUT", 1024.0f);
+	mIrradianceBakeTarget = addTarget(mDiffuseLight.get(), "Irradiance map", 16000.0f);
+	mPrefilteredBakeTarget = addTarget(mPrefilteredMap.get(), "Prefiltered map", 1024.0f);
+
+	mIBLTimestamps = std::make_unique<GpuTimestamps>(md3dDevice.Get(), mCommandQueue.Get(),
+		gNumFrameResources, 2 * IBLTimedJobsPerFrame);
+	mIBLTimedJobs.resize(gNumFrameResources);
+	mIBLBakeStart = std::chrono::steady_clock::now();
+}
+
+void PBR::RecordIBLBake()
+{
+	if (mIBLScheduler.Finished()) {
+		return;
+	}
+
+	std::vector<bool> wasFinished;
+	for (UINT i = 0; i < mIBLTargets.size(); i++) {
+		wasFinished.push_back(mIBLScheduler.TargetFinished(i));
+	}
+
+	mIBLTimestamps->BeginFrame(mCurrFrameResourceIndex);
+	RenderTextureBakeBackend backend(mCommandList.Get(), mIBLTargets, *mIBLTimestamps, mIBLTimedJobs[mCurrFrameResourceIndex]);
+	mIBLScheduler.RunFrame(backend, IBLBakeBudgetMs);
+	mIBLTimestamps->Resolve(mCommandList.Get());
+
+	for (UINT i = 0; i < mIBLTargets.size(); i++) {
+		if (!wasFinished[i] && mIBLScheduler.TargetFinished(i)) {
+			mIBLTargets[i]->BakeTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - mIBLBakeStart).count();
+			std::string msg = mIBLTargetNames[i] + " complete after " + std::to_string(mIBLScheduler.FinishedFrame(i)) + " frames\n";
+			::OutputDebugStringA(msg.c_str());
+			::OutputDebugStringA(mIBLTargets[i]->Describe(mIBLTargetNames[i]).c_str());
+		}
+	}
+}
+
+void PBR::ReportIBLBakeCosts()
+{
+	// The GPU has passed the fence of the current frame resource, so the jobs it
+	// recorded last time around have their timestamps resolved.
+	std::vector<TimedBakeJob>& jobs = mIBLTimedJobs[mCurrFrameResourceIndex];
+	if (jobs.empty()) {
+		return;
+	}
+	std::vector<double> ms;
+	mIBLTimestamps->ReadMs(mCurrFrameResourceIndex, jobs.back().EndQuery + 1, ms);
+	for (const TimedBakeJob& job : jobs) {
+		mIBLScheduler.ReportCost(job.Target, job.Texels, (float)std::max(ms[job.EndQuery] - ms[job.BeginQuery], 0.0));
+	}
+	jobs.clear();
+}
+
+void PBR::BindSceneResources(UINT passIndex)
+{
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvHeap->Heap() };
+	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
+
+	UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
+	auto passCB = mCurrFrameResource->PassCB->Resource();
+	mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress() + passIndex * passCBByteSize);
+
+	// Bind all the materials used in this scene.  For structured buffers, we can bypass the heap and 
+	// set as a root descriptor.
+	auto matBuffer = mCurrFrameResource->MaterialBuffer->Resource();
+	mCommandList->SetGraphicsRootShaderResourceView(2, matBuffer->GetGPUVirtualAddress());
+	mCommandList->SetGraphicsRootShaderResourceView(9, mIrradianceVolumeBuffer->GetGPUVirtualAddress());
+
+	// Bind all the textures used in this scene.  The table is unbounded and starts at
+	// persistent index 0, so materials index it with their srvHeapIndex.
+	mCommandList->SetGraphicsRootDescriptorTable(3, mSrvHeap->PersistentGpuHandle(0));
+
+	// Bind sky texture.  This is the source environment: mip 0 of the prefiltered map
+	// may still be baking.
+	mCommandList->SetGraphicsRootDescriptorTable(4, mSrvHeap->PersistentGpuHandle(mCubeTexture->srvHeapIndex));
+
+	// Bind irradiance texture
+	mCommandList->SetGraphicsRootDescriptorTable(5, mSrvHeap->PersistentGpuHandle(mDiffuseLight->srvHeapIndex));
+
+	// Bind prefilteredMap texture
+	mCommandList->SetGraphicsRootDescriptorTable(6, mSrvHeap->PersistentGpuHandle(mPrefilteredMap->srvHeapIndex));
+
+	// Bind LUT map texture
+	mCommandList->SetGraphicsRootDescriptorTable(7, mSrvHeap->PersistentGpuHandle(mLUTMap->srvHeapIndex));
+
+	// Bind reflection probe array
+	mCommandList->SetGraphicsRootDescriptorTable(8, mSrvHeap->PersistentGpuHandle(mProbeArray->srvHeapIndex));
+}
+
+void PBR::BuildReflectionProbes()
+{
+	mProbes = ReflectionProbeSet(ProbeArraySlices);
+
+	// One probe per quadrant of the sphere wall, overlapping in the middle so that
+	// neighbours blend, and one around the gun.
+	for (int y = 0; y < 2; y++) {
+		for (int x = 0; x < 2; x++) {
+			float cx = x == 0 ? -8.0f : 7.0f;
+			float cy = y == 0 ? -8.0f : 7.0f;
+			float position[3] = { cx, cy, -4.0f };
+			ProbeBox influence = { { cx - 10.0f, cy - 10.0f, -6.0f }, { cx + 10.0f, cy + 10.0f, 10.0f } };
+			mProbes.AddProbe(position, influence, 3.0f);
+		}
+	}
+
+	float gunPosition[3] = { 0.0f, 3.0f, 20.0f };
+	ProbeBox gunInfluence = { { -12.0f, -10.0f, 10.0f }, { 12.0f, 14.0f, 30.0f } };
+	mProbes.AddProbe(gunPosition, gunInfluence, 4.0f);
+
+	mProbes.BuildSpatialIndex(4.0f);
+}
+
+void PBR::BuildIrradianceVolume()
+{
+	if (!UseIrradianceVolume) {
+		// The shaders skip the volume, but the root descriptor still needs a buffer.
+		XMFLOAT4 empty[9] = {};
+		mIrradianceVolumeBuffer = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+			empty, sizeof(empty), mIrradianceVolumeUploader);
+		return;
+	}
+
+	// World space triangles of the opaque items, with the averaged vertex normal and
+	// the material albedo of each.
+	std::vector<float> positions;
+	std::vector<uint32_t> indices;
+	ProbeScene scene;
+	for (auto ri : mRitemLayer[(int)RenderLayer::Opaque]) {
+		const Vertex* vertices = (const Vertex*)ri->Geo->VertexBufferCPU->GetBufferPointer();
+		const uint8_t* indexData = (const uint8_t*)ri->Geo->IndexBufferCPU->GetBufferPointer();
+		bool shortIndices = ri->Geo->IndexFormat == DXGI_FORMAT_R16_UINT;
+
+		XMMATRIX world = XMLoadFloat4x4(&ri->World);
+		XMMATRIX invTransWorld = XMMatrixTranspose(XMMatrixInverse(&XMMatrixDeterminant(world), world));
+
+		for (UINT i = 0; i + 2 < ri->IndexCount; i += 3) {
+			XMVECTOR normal = XMVectorZero();
+			for (UINT k = 0; k < 3; k++) {
+				UINT location = ri->StartIndexLocation + i + k;
+				UINT index = shortIndices ? ((const uint16_t*)indexData)[location] : ((const uint32_t*)indexData)[location];
+				const Vertex& vertex = vertices[index + ri->BaseVertexLocation];
+
+				XMFLOAT3 position;
+				XMStoreFloat3(&position, XMVector3TransformCoord(XMLoadFloat3(&vertex.Pos), world));
+				indices.push_back((uint32_t)(positions.size() / 3));
+				positions.push_back(position.x);
+				positions.push_back(position.y);
+				positions.push_back(position.z);
+
+				normal += XMVector3TransformNormal(XMLoadFloat3(&vertex.Normal), invTransWorld);
+			}
+
+			XMFLOAT3 n;
+			XMStoreFloat3(&n, XMVector3Normalize(normal));
+			scene.Normals.insert(scene.Normals.end(), { n.x, n.y, n.z });
+			scene.Albedo.insert(scene.Albedo.end(), { ri->Mat->albedo.x, ri->Mat->albedo.y, ri->Mat->albedo.z });
+		}
+	}
+	scene.Geometry = TriangleBVH(positions, indices);
+
+	// Probes cover the scene bounds plus half a spacing on every side.
+	IrradianceVolumeDesc desc;
+	scene.Geometry.Bounds(desc.Min, desc.Max);
+	for (int i = 0; i < 3; i++) {
+		desc.Min[i] -= 0.5f * IrradianceProbeSpacing;
+		desc.Max[i] += 0.5f * IrradianceProbeSpacing;
+		UINT cells = (UINT)std::ceil((desc.Max[i] - desc.Min[i]) / IrradianceProbeSpacing);
+		desc.Dim[i] = std::min(std::max(cells + 1, 2u), IrradianceMaxProbesPerAxis);
+	}
+	desc.RaysPerProbe = IrradianceRaysPerProbe;
+	mIrradianceVolume = IrradianceVolume(desc);
+
+	IrradianceBakeStats stats = mIrradianceVolume.Bake(scene, mEnvironment, mAmbientSH);
+	std::string volumeMsg = "Irradiance volume " + std::to_string(desc.Dim[0]) + "x" + std::to_string(desc.Dim[1]) + "x" +
+		std::to_string(desc.Dim[2]) + " over " + std::to_string(scene.Geometry.TriangleCount()) + " triangles: " +
+		std::to_string(stats.Seconds * 1000.0) + " ms, " + std::to_string(stats.MRaysPerSecond) + " Mrays/s on " +
+		std::to_string(stats.Threads) + " threads, " + std::to_string(stats.InvalidProbes) + " probes inside geometry\n";
+	::OutputDebugStringA(volumeMsg.c_str());
+
+	mEnvironment = CubeMapImage();
+
+	// Nine float4 per probe, the layout of gAmbientSH.
+	std::vector<XMFLOAT4> probeData((size_t)mIrradianceVolume.ProbeCount() * 9);
+	for (UINT p = 0; p < mIrradianceVolume.ProbeCount(); p++) {
+		const SH9Color& sh = mIrradianceVolume.Probe(p);
+		for (int k = 0; k < 9; k++) {
+			probeData[(size_t)p * 9 + k] = XMFLOAT4(sh.C[k][0], sh.C[k][1], sh.C[k][2], 0.0f);
+		}
+	}
+	mIrradianceVolumeBuffer = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+		probeData.data(), probeData.size() * sizeof(XMFLOAT4), mIrradianceVolumeUploader);
+}
+
+void PBR::BuildTextureStreaming()
+{
+	if (!StreamMaterialTextures || !TextureStreamer::Supported(md3dDevice.Get())) {
+		return;
+	}
+	MipStreamingDesc desc;
+	desc.BudgetBytes = TextureStreamingBudget;
+	mTextureStreamer = std::make_unique<TextureStreamer>(md3dDevice.Get(), mCommandQueue.Get(), desc);
+
+	// Every texture of every opaque item's material.  Textures that share a resource
+	// share its streamed copy too.
+	std::unordered_map<ID3D12Resource*, uint32_t> streamedResources;
+	for (auto ri : mRitemLayer[(int)RenderLayer::Opaque]) {
+		for (TextureData* tex : { ri->Mat->AlbedoTex, ri->Mat->OrmTex, ri->Mat->NormalTex }) {
+			if (mStreamedTextureIds.count(tex) != 0) {
+				continue;
+			}
+			auto it = streamedResources.find(tex->Resource.Get());
+			if (it == streamedResources.end()) {
+				uint32_t id = mTextureStreamer->Add(mCommandList.Get(), tex->Resource.Get());
+				it = streamedResources.emplace(tex->Resource.Get(), id).first;
+				mStreamedTextureUsers.emplace_back();
+			}
+			mStreamedTextureIds[tex] = it->second;
+			mStreamedTextureUsers[it->second].push_back(tex);
+		}
+	}
+
+	// The streamer keeps the loaded resources until FinishAdds has read them back.
+	for (uint32_t id = 0; id < (uint32_t)mStreamedTextureUsers.size(); id++) {
+		ComPtr<ID3D12Resource> resource = mTextureStreamer->Resource(id);
+		for (TextureData* tex : mStreamedTextureUsers[id]) {
+			tex->Resource = resource;
+			mResources->Find(tex->Hash)->Resource = resource;
+		}
+		CreateStreamedTextureSrv(id);
+	}
+
+	std::string streamMsg = "Texture streaming: " + std::to_string(mStreamedTextureUsers.size()) + " textures, " +
+		std::to_string(mTextureStreamer->Streamer().CommittedBytes() >> 10) + " KB of mip tails, " +
+		std::to_string(TextureStreamingBudget >> 20) + " MB budget\n";
+	::OutputDebugStringA(streamMsg.c_str());
+}
+
+void PBR::CreateStreamedTextureSrv(uint32_t texture)
+{
+	// The new clamp goes into a new descriptor, as the frames in flight still read
+	// the old one.
+	ID3D12Resource* resource = mTextureStreamer->Resource(texture);
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = resource->GetDesc().Format;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.Texture2D.MipLevels = resource->GetDesc().MipLevels;
+	srvDesc.Texture2D.ResourceMinLODClamp = (float)mTextureStreamer->ResidentMip(texture);
+
+	uint32_t index = mSrvHeap->AllocatePersistent(mCurrentFence);
+	mSrvHeap->CreateSrv(index, resource, &srvDesc);
+	ResourceRegistry::Entry* entry = mResources->Find(mStreamedTextureUsers[texture][0]->Hash);
+	if (entry->SrvIndex != kNoDescriptor) {
+		mSrvHeap->FreePersistent(entry->SrvIndex, mCurrentFence);
+	}
+	entry->SrvIndex = index;
+	for (TextureData* tex : mStreamedTextureUsers[texture]) {
+		tex->srvHeapIndex = index;
+	}
+}
+
+void PBR::UpdateTextureStreaming()
+{
+	if (!mTextureStreamer) {
+		return;
+	}
+
+	StreamingView view;
+	XMFLOAT3 eye = mCamera.GetPosition3f();
+	XMFLOAT3 look = mCamera.GetLook3f();
+	for (int c = 0; c < 3; c++) {
+		view.Eye[c] = (&eye.x)[c];
+		view.Look[c] = (&look.x)[c];
+	}
+	view.FovY = mCamera.GetFovY();
+	view.ViewportWidth = (float)mClientWidth;
+	view.ViewportHeight = (float)mClientHeight;
+
+	// For their texel density the items count as spheres with the texture wrapped
+	// around them once; the gun is treated as one too.
+	std::vector<StreamingInstance> instances;
+	for (auto ri : mRitemLayer[(int)RenderLayer::Opaque]) {
+		BoundingSphere sphere;
+		ri->Sphere.Transform(sphere, XMLoadFloat4x4(&ri->World));
+		XMMATRIX texTransform = XMLoadFloat4x4(&ri->TexTransform);
+		float uvScale = std::max(XMVectorGetX(XMVector3Length(texTransform.r[0])), XMVectorGetX(XMVector3Length(texTransform.r[1])));
+
+		StreamingInstance instance;
+		instance.Center[0] = sphere.Center.x;
+		instance.Center[1] = sphere.Center.y;
+		instance.Center[2] = sphere.Center.z;
+		instance.Radius = sphere.Radius;
+		instance.UVPerWorldUnit = uvScale / (2.0f * MathHelper::Pi * sphere.Radius);
+		for (TextureData* tex : { ri->Mat->AlbedoTex, ri->Mat->OrmTex, ri->Mat->NormalTex }) {
+			instance.Texture = mStreamedTextureIds[tex];
+			instances.push_back(instance);
+		}
+	}
+
+	MipStreamer& streamer = mTextureStreamer->Streamer();
+	streamer.BeginFrame();
+	streamer.RequestInstances(view, instances.data(), instances.size());
+	mTextureStreamer->Update(mFence->GetCompletedValue(), mCurrentFence + 1, mStreamedTexturesChanged);
+	if (mStreamedTexturesChanged.empty()) {
+		return;
+	}
+
+	for (uint32_t texture : mStreamedTexturesChanged) {
+		CreateStreamedTextureSrv(texture);
+	}
+	auto changed = [&](TextureData* tex) {
+		auto it = mStreamedTextureIds.find(tex);
+		return it != mStreamedTextureIds.end() &&
+			std::binary_search(mStreamedTexturesChanged.begin(), mStreamedTexturesChanged.end(), it->second);
+	};
+	for (auto& e : mMaterials) {
+		MaterialObj* mat = e.second.get();
+		if (changed(mat->AlbedoTex) || changed(mat->OrmTex) || changed(mat->NormalTex)) {
+			mat->NumFramesDirty = gNumFrameResources;
+		}
+	}
+}
+
+void PBR::UpdateReflectionProbes(const GameTimer& gt)
+{
+	// Captures taken before the global IBL finished were lit by the SH fallback.
+	if (!mProbesRelit && mIBLScheduler.Finished()) {
+		mProbes.MarkAllDirty();
+		mProbesRelit = true;
+	}
+
+	XMFLOAT3 eye = mCamera.GetPosition3f();
+	mProbesToBake.clear();
+	mProbes.ScheduleRebakes(&eye.x, ProbeBakesPerFrame, ProbeDistanceScale, mProbesToBake);
+
+	// Scheduling may evict probes, so select afterwards.
+	for (auto ri : mRitemLayer[(int)RenderLayer::Opaque]) {
+		ProbeSelection probes = mProbes.Select(&ri->World.m[3][0]);
+		if (probes != ri->Probes) {
+			ri->Probes = probes;
+			ri->NumFramesDirty = gNumFrameResources;
+		}
+	}
+}
+
+void PBR::UpdateProbeCapturePassCBs(const GameTimer& gt)
+{
+	// Pass constants 1 + 6 * i + face view the scene from the i-th probe of this frame.
+	XMMATRIX proj = XMMatrixPerspectiveFovLH(0.5f * MathHelper::Pi, 1.0f, 0.1f, 1000.0f);
+	auto currPassCB = mCurrFrameResource->PassCB.get();
+	mProbeFaceItems.resize(6 * mProbesToBake.size());
+
+	for (size_t i = 0; i < mProbesToBake.size(); i++) {
+		const ReflectionProbe& probe = mProbes.Probe(mProbesToBake[i]);
+		XMVECTOR pos = XMVectorSet(probe.Position[0], probe.Position[1], probe.Position[2], 1.0f);
+
+		for (UINT face = 0; face < 6; face++) {
+			const CubeFaceBasis& basis = gCubeFaceBasis[face];
+			XMVECTOR look = XMVectorSet(basis.LookAt[0], basis.LookAt[1], basis.LookAt[2], 0.0f);
+			XMVECTOR up = XMVectorSet(basis.Up[0], basis.Up[1], basis.Up[2], 0.0f);
+			XMMATRIX view = XMMatrixLookToLH(pos, look, up);
+
+			XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+			CullOpaqueItems(viewProj, mProbeFaceItems[6 * i + face]);
+			XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+			XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
+			XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
+
+			PassConstants capturePassCB = mMainPassCB;
+			XMStoreFloat4x4(&capturePassCB.View, XMMatrixTranspose(view));
+			XMStoreFloat4x4(&capturePassCB.InvView, XMMatrixTranspose(invView));
+			XMStoreFloat4x4(&capturePassCB.Proj, XMMatrixTranspose(proj));
+			XMStoreFloat4x4(&capturePassCB.InvProj, XMMatrixTranspose(invProj));
+			XMStoreFloat4x4(&capturePassCB.ViewProj, XMMatrixTranspose(viewProj));
+			XMStoreFloat4x4(&capturePassCB.InvViewProj, XMMatrixTranspose(invViewProj));
+			capturePassCB.EyePosW = XMFLOAT3(probe.Position);
+			capturePassCB.RenderTargetSize = XMFLOAT2((float)ProbeCaptureSize, (float)ProbeCaptureSize);
+			capturePassCB.InvRenderTargetSize = XMFLOAT2(1.0f / ProbeCaptureSize, 1.0f / ProbeCaptureSize);
+			capturePassCB.NearZ = 0.1f;
+
+			currPassCB->CopyData(1 + 6 * (int)i + face, capturePassCB);
+		}
+	}
+}
+
+void PBR::RecordProbeBakes()
+{
+	for (size_t i = 0; i < mProbesToBake.size(); i++) {
+		mProbeArray->BeginCapture(mCommandList.Get());
+		for (UINT face = 0; face < 6; face++) {
+			mProbeArray->BeginCaptureFace(mCommandList.Get(), face);
+			BindSceneResources(1 + 6 * (UINT)i + face);
+
+			mCommandList->SetPipelineState(mPSOs["probeCapture"].Get());
+			DrawRenderItems(mCommandList.Get(), mProbeFaceItems[6 * i + face]);
+			mCommandList->SetPipelineState(mPSOs["probeCaptureSky"].Get());
+			DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Sky]);
+		}
+		mProbeArray->EndCapture(mCommandList.Get());
+
+		UINT probe = mProbesToBake[i];
+		mProbeArray->FilterIntoSlice(mCommandList.Get(), mProbes.Probe(probe).Slice);
+		mProbes.MarkBaked(probe);
+	}
+}
+
 void PBR::Update(const GameTimer& gt)
 {
     OnKeyboardInput(gt);
@@ -261,11 +954,18 @@ void PBR::Update(const GameTimer& gt)
         WaitForSingleObject(eventHandle, INFINITE);
         CloseHandle(eventHandle);
     }
+	mSrvHeap->BeginFrame(mCurrFrameResourceIndex, mFence->GetCompletedValue());
+	mResources->Collect(mFence->GetCompletedValue());
+	ReportIBLBakeCosts();
+	UpdateTextureStreaming();
 
 	AnimateMaterials(gt);
+	UpdateReflectionProbes(gt);
 	UpdateObjectCBs(gt);
 	UpdateMaterialBuffer(gt);
 	UpdateMainPassCB(gt);
+	UpdateProbeCapturePassCBs(gt);
+	CullOpaqueItems(mCamera.GetView() * mCamera.GetProj(), mVisibleOpaque);
 }
 
 void PBR::Draw(const GameTimer& gt)
@@ -280,6 +980,14 @@ void PBR::Draw(const GameTimer& gt)
     // Reusing the command list reuses memory.
     ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
 
+	// Bake this frame's share of the IBL products and probes before the scene samples them.
+	RecordIBLBake();
+	RecordProbeBakes();
+	if (mTextureStreamer) {
+		mTextureStreamer->RecordUploads(mCommandList.Get());
+	}
+	mCommandList->SetPipelineState(mPSOs["opaque"].Get());
+
     mCommandList->RSSetViewports(1, &mScreenViewport);
     mCommandList->RSSetScissorRects(1, &mScissorRect);
 
@@ -294,45 +1002,9 @@ void PBR::Draw(const GameTimer& gt)
     // Specify the buffers we are going to render to.
     mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
 
-	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
-	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
-
-	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
-
-	auto passCB = mCurrFrameResource->PassCB->Resource();
-	mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
-
-	// Bind all the materials used in this scene.  For structured buffers, we can bypass the heap and 
-	// set as a root descriptor.
-	auto matBuffer = mCurrFrameResource->MaterialBuffer->Resource();
-	mCommandList->SetGraphicsRootShaderResourceView(2, matBuffer->GetGPUVirtualAddress());
-
-	// Bind all the textures used in this scene.  Observe
-    // that we only have to specify the first descriptor in the table.  
-    // The root signature knows how many descriptors are expected in the table.
-	mCommandList->SetGraphicsRootDescriptorTable(3, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-
-	// Bind sky texture
-	CD3DX12_GPU_DESCRIPTOR_HANDLE skyHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-	skyHandle.Offset(mPrefilteredMap->srvHeapIndex, mCbvSrvDescriptorSize);
-	mCommandList->SetGraphicsRootDescriptorTable(4, skyHandle);
-
-	// Bind irradiance texture
-	CD3DX12_GPU_DESCRIPTOR_HANDLE irradianceHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-	irradianceHandle.Offset(mDiffuseLight->srvHeapIndex, mCbvSrvDescriptorSize);
-	mCommandList->SetGraphicsRootDescriptorTable(5, irradianceHandle);
-
-	// Bind prefilteredMap texture
-	CD3DX12_GPU_DESCRIPTOR_HANDLE prefilteredHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-	prefilteredHandle.Offset(mPrefilteredMap->srvHeapIndex, mCbvSrvDescriptorSize);
-	mCommandList->SetGraphicsRootDescriptorTable(6, prefilteredHandle);
-
-	// Bind LUT map texture
-	CD3DX12_GPU_DESCRIPTOR_HANDLE lutHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-	lutHandle.Offset(mLUTMap->srvHeapIndex, mCbvSrvDescriptorSize);
-	mCommandList->SetGraphicsRootDescriptorTable(7, lutHandle);
+	BindSceneResources(0);
 
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+    DrawRenderItems(mCommandList.Get(), mVisibleOpaque);
 
 	mCommandList->SetPipelineState(mPSOs["sky"].Get());
 	DrawRenderItems(mCommandList.Get(), mRitemLayer[( int )RenderLayer::Sky]);
@@ -438,6 +1110,16 @@ void PBR::UpdateObjectCBs(const GameTimer& gt)
 			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
 			objConstants.MaterialIndex = e->Mat->MatCBIndex;
 
+			const ProbeSelection& probes = e->Probes;
+			if (probes.Probe[0] != kNoProbe) {
+				objConstants.ProbeSlice0 = mProbes.Probe(probes.Probe[0]).Slice;
+				objConstants.ProbeWeight0 = probes.Weight[0];
+			}
+			if (probes.Probe[1] != kNoProbe) {
+				objConstants.ProbeSlice1 = mProbes.Probe(probes.Probe[1]).Slice;
+				objConstants.ProbeWeight1 = probes.Weight[1];
+			}
+
 			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
 
 			// Next FrameResource need to be updated too.
@@ -458,9 +1140,7 @@ void PBR::UpdateMaterialBuffer(const GameTimer& gt)
 		{
 			MaterialData matData;
 			matData.AlbedoMapIndex = mat->AlbedoTex->srvHeapIndex;
-			matData.MetallicMapIndex = mat->MetallicTex->srvHeapIndex;
-			matData.RoughnessMapIndex = mat->RoughnessTex->srvHeapIndex;
-			matData.AOMapIndex = mat->AOTex->srvHeapIndex;
+			matData.OrmMapIndex = mat->OrmTex->srvHeapIndex;
 			matData.NormalMapIndex = mat->NormalTex->srvHeapIndex;
 
 			matData.albedo = mat->albedo;
@@ -501,22 +1181,58 @@ void PBR::UpdateMainPassCB(const GameTimer& gt)
 	mMainPassCB.DeltaTime = gt.DeltaTime();
 	mMainPassCB.AmbientLight = { 0.25f, 0.25f, 0.35f, 1.0f };
 
-	mMainPassCB.PrefilteredMipLevel = mPrefilteredMap->Resource()->GetDesc().MipLevels;
+	mMainPassCB.PrefilteredMipLevel = mPrefilteredMap->MipLevels();
 
-	mMainPassCB.Lights[0].LightPosAndDir = XMFLOAT3(-10, 10, 10);
-	mMainPassCB.Lights[1].LightPosAndDir = XMFLOAT3(10, 10, 10);
-	mMainPassCB.Lights[2].LightPosAndDir = XMFLOAT3(-10, -10, 10);
-	mMainPassCB.Lights[3].LightPosAndDir = XMFLOAT3(10, -10, 10);
+	mMainPassCB.PrefilteredMinMip = (float)mIBLScheduler.MostDetailedCompleteMip(mPrefilteredBakeTarget);
+	mMainPassCB.IBLReadyMask =
+		(mIBLScheduler.TargetFinished(mIrradianceBakeTarget) ? 1u : 0u) |
+		(mIBLScheduler.TargetFinished(mLUTBakeTarget) ? 2u : 0u);
+	mMainPassCB.ProbeMipLevels = mProbeArray->MipLevels();
+	for (int i = 0; i < 9; i++) {
+		mMainPassCB.AmbientSH[i] = XMFLOAT4(mAmbientSH.C[i][0], mAmbientSH.C[i][1], mAmbientSH.C[i][2], 0.0f);
+	}
+	if (mIrradianceVolume.ProbeCount() != 0) {
+		const IrradianceVolumeDesc& volume = mIrradianceVolume.Desc();
+		float invCellSize[3];
+		mIrradianceVolume.InvCellSize(invCellSize);
+		mMainPassCB.VolumeMin = XMFLOAT3(volume.Min);
+		mMainPassCB.VolumeEnabled = 1;
+		mMainPassCB.VolumeInvCellSize = XMFLOAT3(invCellSize);
+		mMainPassCB.VolumeDim = XMUINT3(volume.Dim);
+	}
 
-	mMainPassCB.Lights[0].LightColor = XMFLOAT3(300, 300, 300);
-	mMainPassCB.Lights[1].LightColor = XMFLOAT3(300, 300, 300);
-	mMainPassCB.Lights[2].LightColor = XMFLOAT3(300, 300, 300);
-	mMainPassCB.Lights[3].LightColor = XMFLOAT3(300, 300, 300);
+	// Directional lights point the way the light travels.
+	UINT lightCount = 0;
+	for (const DominantLight& light : mDominantLights) {
+		mMainPassCB.Lights[lightCount].LightPosAndDir = XMFLOAT3(-light.Direction[0], -light.Direction[1], -light.Direction[2]);
+		mMainPassCB.Lights[lightCount].LightColor = XMFLOAT3(light.Irradiance);
+		lightCount++;
+	}
+	mMainPassCB.NumDirLights = lightCount;
+
+	const XMFLOAT3 pointLightPositions[NumScenePointLights] = {
+		XMFLOAT3(-10, 10, 10), XMFLOAT3(10, 10, 10), XMFLOAT3(-10, -10, 10), XMFLOAT3(10, -10, 10) };
+	for (UINT i = 0; i < NumScenePointLights; i++) {
+		mMainPassCB.Lights[lightCount].LightPosAndDir = pointLightPositions[i];
+		mMainPassCB.Lights[lightCount].LightColor = XMFLOAT3(300, 300, 300);
+		lightCount++;
+	}
+	mMainPassCB.NumPointLights = NumScenePointLights;
 	
 	auto currPassCB = mCurrFrameResource->PassCB.get();
 	currPassCB->CopyData(0, mMainPassCB);
 }
 
+// DDS cache of the BC6H environment next to the panorama.  The name carries a hash of
+// the panorama and of everything that shapes the encode, so changing either misses.
+static std::string EnvironmentBC6HCachePath(const std::string& panoramaPath, BC6HQuality quality)
+{
+	std::string key = HashFile(panoramaPath).ToString() + " size " + std::to_string(EnvironmentMapSize) +
+		" supersample unsigned " + (quality == BC6HQuality::Fast ? "fast" : "quality");
+	std::string stem = panoramaPath.substr(0, panoramaPath.rfind('.'));
+	return stem + "_bc6h_" + HashBytes(key.data(), key.size()).ToString().substr(0, 16) + ".dds";
+}
+
 void PBR::LoadTextures()
 {
 	std::vector<std::string> texNames = 
@@ -524,42 +1240,27 @@ void PBR::LoadTextures()
 		"default",
 		"defaultNormal",
 		"rusted_iron_albedo",
-		"rusted_iron_ao",
-		"rusted_iron_metallic",
-		"rusted_iron_roughness",
 		"rusted_iron_normal",
 		"plastic_albedo",
-		"plastic_ao",
-		"plastic_metallic",
-		"plastic_roughness",
 		"plastic_normal",
 
 		"mesh_albedo",
-		"mesh_metallic",
-		"mesh_roughness",
 		"mesh_normal",
 	};
 
-	std::vector<bool> isSrgb = {
-		false,
-		false,
+	// How each texture is cooked; the DDS ones are loaded as they are.
+	std::vector<TextureUsage> usages = {
+		TextureUsage::Color,
+		TextureUsage::Normal,
 		// rusted iron
-		true,
-		false,
-		false,
-		false,
-		false,
+		TextureUsage::Color,
+		TextureUsage::Normal,
 		// gold
-		true,
-		false,
-		false,
-		false,
-		false,
+		TextureUsage::Color,
+		TextureUsage::Normal,
 		// mesh
-		true,
-		false,
-		false,
-		false,
+		TextureUsage::Color,
+		TextureUsage::Normal,
 	};
 	
 	std::vector<std::wstring> texFilenames = 
@@ -568,20 +1269,12 @@ void PBR::LoadTextures()
 		L"../Textures/default_nmap.dds",
 
 		L"../textures-nondds/pbr/rusted_iron/albedo.png",
-		L"../textures-nondds/pbr/rusted_iron/ao.png",
-		L"../textures-nondds/pbr/rusted_iron/metallic.png",
-		L"../textures-nondds/pbr/rusted_iron/roughness.png",
 		L"../textures-nondds/pbr/rusted_iron/normal.png",
 
 		L"../textures-nondds/pbr/gold/albedo.png",
-		L"../textures-nondds/pbr/gold/ao.png",
-		L"../textures-nondds/pbr/gold/metallic.png",
-		L"../textures-nondds/pbr/gold/roughness.png",
 		L"../textures-nondds/pbr/gold/normal.png",
 
 		L"../textures-nondds/pbr/cerberus/albedo.png",
-		L"../textures-nondds/pbr/cerberus/metallic.png",
-		L"../textures-nondds/pbr/cerberus/roughness.png",
 		L"../textures-nondds/pbr/cerberus/normal.png",
 	};
 
@@ -591,92 +1284,443 @@ void PBR::LoadTextures()
 		// rusted iron
 		false,
 		false,
-		false,
-		false,
-		false,
 		// gold
 		false,
 		false,
-		false,
-		false,
-		false,
 		// mesh
 		false,
 		false,
-		false,
-		false,
 	};
 
+	// Occlusion, roughness and metallic go into one ORM texture per material, so the
+	// pixel shader reads them with one fetch.  Cerberus has no AO map; it is left white.
+	// The roughness mips are widened by the spread of the material's normal map.
+	std::vector<TextureCookRequest> ormRequests = {
+		OrmCookRequest("rusted_iron_orm", "../textures-nondds/pbr/rusted_iron/ao.png",
+			"../textures-nondds/pbr/rusted_iron/roughness.png", "../textures-nondds/pbr/rusted_iron/metallic.png",
+			"../textures-nondds/pbr/rusted_iron/normal.png"),
+		OrmCookRequest("plastic_orm", "../textures-nondds/pbr/gold/ao.png",
+			"../textures-nondds/pbr/gold/roughness.png", "../textures-nondds/pbr/gold/metallic.png",
+			"../textures-nondds/pbr/gold/normal.png"),
+		OrmCookRequest("mesh_orm", "",
+			"../textures-nondds/pbr/cerberus/roughness.png", "../textures-nondds/pbr/cerberus/metallic.png",
+			"../textures-nondds/pbr/cerberus/normal.png"),
+	};
+
+	// The HDR panorama decodes on the pool while the material textures cook.
+	const std::string panoramaPath = "../textures-nondds/hdr/newport_loft.hdr";
+	auto panoramaJob = std::make_shared<HDRImage>();
+	std::future<void> panoramaLoaded = TaskPool::Default().Submit([panoramaJob, panoramaPath]() {
+		*panoramaJob = LoadHDR(panoramaPath);
+	});
+
+	// Cook the sources that changed since the manifest was written, one job per
+	// texture.  Up to date ones only cost a hash of the source file.
+	std::vector<TextureCookRequest> cookRequests;
+	std::vector<int> requestTextures;
+	for (int i = 0; i < (int)texNames.size(); ++i) {
+		if (!isDDS[i]) {
+			requestTextures.push_back(i);
+			TextureCookRequest request;
+			request.Name = texNames[i];
+			request.SourcePath = std::string(texFilenames[i].begin(), texFilenames[i].end());
+			request.Usage = usages[i];
+			cookRequests.push_back(request);
+		}
+	}
+	for (const TextureCookRequest& request : ormRequests) {
+		requestTextures.push_back((int)texNames.size());
+		cookRequests.push_back(request);
+		texNames.push_back(request.Name);
+		texFilenames.push_back(L"");
+		isDDS.push_back(false);
+	}
+	auto decodeWIC = [](const std::string& path) { return LoadImageWIC(std::wstring(path.begin(), path.end())); };
+	std::vector<CompressedTexture> generatedTextures(texNames.size());
+
+	// A package holding every texture replaces the cook and the file reads below.
+	if (UseAssetPackage) {
+		try {
+			mPackage = std::make_unique<AssetPackage>(AssetPackagePath);
+			for (const std::string& name : texNames) {
+				if (!mPackage->Find(name)) {
+					throw std::runtime_error("Asset package has no " + name);
+				}
+			}
+			if (mPackage->Sources().empty()) {
+				throw std::runtime_error("Asset package records no sources");
+			}
+			std::vector<std::string> stale = mPackage->StaleSources();
+			if (!stale.empty()) {
+				throw std::runtime_error("Asset package source " + stale[0] + " changed");
+			}
+		}
+		catch (const std::exception& e) {
+			::OutputDebugStringA((std::string(e.what()) + ", loading the loose files\n").c_str());
+			mPackage.reset();
+			mPackageWriter = std::make_unique<AssetPackageWriter>();
+		}
+	}
+
+	if (mPackage) {
+		std::string packageMsg = "Asset package: " + std::string(AssetPackagePath) + ", " +
+			std::to_string(mPackage->Entries().size()) + " entries, " +
+			std::to_string(mPackage->FileSize() / (1024.0 * 1024.0)) + " MB mapped\n";
+		::OutputDebugStringA(packageMsg.c_str());
+	}
+	else if (CookMaterialTextures) {
+		CreateDirectoryA(CookedTextureDir, nullptr);
+		TextureCookStats cookStats = CookTextures(cookRequests, CookedTextureDir, TextureManifestPath, decodeWIC,
+			gTextureCookSettings);
+		std::string cookMsg = "Texture cook: " + std::to_string(cookStats.Cooked) + " cooked, " +
+			std::to_string(cookStats.UpToDate) + " up to date, " + std::to_string(cookStats.Seconds * 1000.0) + " ms, " +
+			std::to_string(cookStats.JobSeconds * 1000.0) + " ms of jobs\n";
+		for (const TextureCookTiming& timing : cookStats.Textures) {
+			if (!timing.UpToDate) {
+				cookMsg += "  " + timing.Name + ": " + std::to_string(timing.Seconds * 1000.0) + " ms (decode " +
+					std::to_string(timing.DecodeSeconds * 1000.0) + ", mips " + std::to_string(timing.MipSeconds * 1000.0) +
+					", encode " + std::to_string(timing.EncodeSeconds * 1000.0) + ")\n";
+			}
+		}
+		::OutputDebugStringA(cookMsg.c_str());
+		if (cookStats.EncodeSeconds > 0.0) {
+			std::string encodeMsg = "Texture block compression: " + std::to_string(cookStats.EncodedMPixels) + " Mpixels, " +
+				std::to_string(cookStats.EncodedMPixels / cookStats.EncodeSeconds) + " Mpixels/s, min PSNR " +
+				std::to_string(cookStats.MinPsnr) + " dB, RDO changed " + std::to_string(cookStats.RdoChangedBlocks) +
+				" of " + std::to_string(cookStats.RdoBlocks) + " blocks\n";
+			::OutputDebugStringA(encodeMsg.c_str());
+		}
+		if (cookStats.Cooked != 0) {
+			std::string sizeMsg = "Cooked texture files: " + std::to_string(cookStats.CookedBytes) + " bytes of texels in " +
+				std::to_string(cookStats.CookedFileBytes) + " bytes with " + PackageCodecName(gTextureCookSettings.Codec) + "\n";
+			::OutputDebugStringA(sizeMsg.c_str());
+		}
+
+		TextureManifest manifest = TextureManifest::Load(TextureManifestPath);
+
+		// Cooked textures carry their whole mip chain, so nothing is generated here.
+		for (int i = 0; i < (int)texNames.size(); ++i) {
+			if (!isDDS[i]) {
+				// The cook just wrote every request, so a missing entry means the manifest
+				// could not be written or was changed under us.
+				const TextureManifestEntry* entry = manifest.Find(texNames[i]);
+				if (!entry) {
+					throw std::runtime_error("Texture manifest " + std::string(TextureManifestPath) + " has no " + texNames[i]);
+				}
+				texFilenames[i] = std::wstring(entry->CookedPath.begin(), entry->CookedPath.end());
+			}
+		}
+	}
+	else {
+		// The loader builds the same chains the cooker would, minus block compression.
+		auto generateStart = std::chrono::steady_clock::now();
+		TaskPool::Default().ParallelFor((uint32_t)cookRequests.size(), [&](uint32_t r) {
+			CookSource source = DecodeCookSource(cookRequests[r], decodeWIC);
+			generatedTextures[requestTextures[r]] = GenerateMips(source.Image, CookMipSettings(cookRequests[r], source));
+		});
+		std::string generateMsg = "Texture mips: " + std::to_string(cookRequests.size()) + " textures generated in " +
+			std::to_string(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - generateStart).count()) +
+			" ms\n";
+		::OutputDebugStringA(generateMsg.c_str());
+	}
+
+	// Map the cooked textures and read and hash the DDS files on the pool; only the
+	// uploads below run in order here.  A DDS file that cannot be read stays empty and
+	// fails its upload.  The header is part of the hash, so only textures of the same
+	// format and size match.
+	auto readStart = std::chrono::steady_clock::now();
+	std::vector<std::vector<uint8_t>> ddsFiles(texNames.size());
+	std::vector<ContentHash> contentHashes(texNames.size());
+	std::vector<std::unique_ptr<AssetPackage>> cookedPackages(texNames.size());
+	std::vector<const AssetPackage*> packages(texNames.size());
+	std::vector<const AssetEntry*> entries(texNames.size());
+	TaskPool::Default().ParallelFor((uint32_t)texNames.size(), [&](uint32_t i) {
+		if (mPackage) {
+			packages[i] = mPackage.get();
+		}
+		else if (CookMaterialTextures && !isDDS[i]) {
+			cookedPackages[i] = std::make_unique<AssetPackage>(std::string(texFilenames[i].begin(), texFilenames[i].end()));
+			packages[i] = cookedPackages[i].get();
+		}
+		if (packages[i]) {
+			entries[i] = packages[i]->Find(texNames[i]);
+			if (!entries[i]) {
+				throw std::runtime_error("Asset package has no " + texNames[i]);
+			}
+			contentHashes[i] = entries[i]->Hash;
+			return;
+		}
+		if (generatedTextures[i].MipLevels() != 0) {
+			contentHashes[i] = HashTextureContent(generatedTextures[i]);
+			return;
+		}
+		std::ifstream file(texFilenames[i], std::ios::binary | std::ios::ate);
+		if (file) {
+			ddsFiles[i].resize((size_t)file.tellg());
+			file.seekg(0);
+			if (!file.read((char*)ddsFiles[i].data(), ddsFiles[i].size())) {
+				ddsFiles[i].clear();
+			}
+		}
+		contentHashes[i] = HashBytes(ddsFiles[i].data(), ddsFiles[i].size());
+	});
+
+	// Textures the CPU formats cover are stored in upload layout with
+	// PackageTextureCodec; other DDS files are stored whole.  The package goes stale
+	// when any file the textures came from changes.
+	if (mPackageWriter) {
+		for (int i = 0; i < (int)texNames.size(); ++i) {
+			if (isDDS[i]) {
+				mPackageWriter->AddSource(std::string(texFilenames[i].begin(), texFilenames[i].end()));
+			}
+			CompressedTexture parsed;
+			if (generatedTextures[i].MipLevels() != 0) {
+				mPackageWriter->AddTexture(texNames[i], generatedTextures[i], PackageTextureCodec);
+				continue;
+			}
+			if (entries[i]) {
+				mPackageWriter->AddEntry(texNames[i], *packages[i], *entries[i], PackageTextureCodec);
+			}
+			else if (ReadDDS(ddsFiles[i].data(), ddsFiles[i].size(), parsed)) {
+				mPackageWriter->AddTexture(texNames[i], parsed, PackageTextureCodec);
+			}
+			else {
+				mPackageWriter->AddBlob(texNames[i], ddsFiles[i].data(), ddsFiles[i].size());
+			}
+		}
+		for (const TextureCookRequest& request : cookRequests) {
+			for (const std::string& path : { request.SourcePath, request.ChannelPaths[0], request.ChannelPaths[1],
+				request.ChannelPaths[2], request.ToksvigNormalPath }) {
+				if (!path.empty()) {
+					mPackageWriter->AddSource(path);
+				}
+			}
+		}
+	}
+
+	auto uploadStart = std::chrono::steady_clock::now();
+
 	ResourceUploadBatch resUpload(md3dDevice.Get());
 	resUpload.Begin();
+	// The package textures are decompressed once all their uploads are recorded, all
+	// of them at once on the pool.
+	struct PackageRead {
+		const AssetPackage* Package;
+		const AssetEntry* Entry;
+		uint8_t* Mapped;
+	};
+	std::vector<PackageRead> packageReads;
 	
 	for(int i = 0; i < (int)texNames.size(); ++i)
 	{
 		auto texMap = std::make_unique<TextureData>();
 		texMap->Name = texNames[i];
 		texMap->FileName = texFilenames[i];
-		texMap->isDDS = isDDS[i];
-		texMap->srvHeapIndex = i;
+		const AssetEntry* entry = entries[i];
+		texMap->isDDS = entry ? entry->Kind == AssetKind::Blob : generatedTextures[i].MipLevels() == 0;
+		texMap->Hash = contentHashes[i];
 
-		if (texMap->isDDS) {
-			ThrowIfFailed(CreateDDSTextureFromFile(
+		if (ResourceRegistry::Entry* shared = mResources->Acquire(texMap->Hash)) {
+			texMap->Resource = shared->Resource;
+		}
+		else if (entry && entry->Kind == AssetKind::Texture) {
+			ComPtr<ID3D12Resource> uploader;
+			PackageRead read = { packages[i], entry, nullptr };
+			CreateTextureFromPackage(md3dDevice.Get(), mCommandList.Get(), *packages[i], *entry,
+				texMap->Resource.ReleaseAndGetAddressOf(), uploader.GetAddressOf(), &read.Mapped);
+			mPackageUploaders.push_back(uploader);
+			packageReads.push_back(read);
+		}
+		else if (entry) {
+			std::vector<uint8_t> bytes;
+			const uint8_t* data = packages[i]->Data(*entry);
+			if (!data) {
+				bytes = packages[i]->Read(*entry);
+				data = bytes.data();
+			}
+			ThrowIfFailed(CreateDDSTextureFromMemory(
+				md3dDevice.Get(),
+				resUpload,
+				data,
+				(size_t)entry->Size,
+				texMap->Resource.ReleaseAndGetAddressOf(),
+				true
+			));
+		}
+		else if (!texMap->isDDS) {
+			CreateTexture2DFromImage(md3dDevice.Get(), resUpload, generatedTextures[i],
+				texMap->Resource.ReleaseAndGetAddressOf());
+		}
+		else {
+			ThrowIfFailed(CreateDDSTextureFromMemory(
 				md3dDevice.Get(),
 				resUpload,
-				texMap->FileName.c_str(),
+				ddsFiles[i].data(),
+				ddsFiles[i].size(),
 				texMap->Resource.ReleaseAndGetAddressOf(),
 				true
 			));
 		}
+		if (texMap->Resource != nullptr && mResources->Find(texMap->Hash) == nullptr) {
+			mResources->Add(texMap->Hash, texMap->Resource);
+		}
+
+		mTextures[texMap->Name] = std::move(texMap);
+	}
+	TaskPool::Default().ParallelFor((uint32_t)packageReads.size(), [&](uint32_t r) {
+		packageReads[r].Package->Read(*packageReads[r].Entry, packageReads[r].Mapped);
+	});
+	ddsFiles.clear();
+	generatedTextures.clear();
+	cookedPackages.clear();
+
+	std::string loadMsg = "Texture load: read " + std::to_string(texNames.size()) + " files in " +
+		std::to_string(std::chrono::duration<double, std::milli>(uploadStart - readStart).count()) + " ms, upload " +
+		std::to_string(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart).count()) +
+		" ms\n";
+	::OutputDebugStringA(loadMsg.c_str());
+
+	mCubeTexture = std::make_unique<TextureData>();
+	mCubeTexture->FileName = L"../textures-nondds/hdr/newport_loft.hdr";
+	mCubeTexture->isDDS = false;
+
+	// The environment is an HDR panorama, resampled into a float cube map on the CPU.
+	panoramaLoaded.get();
+	HDRImage panorama = std::move(*panoramaJob);
+	CubeMapImage environment(EnvironmentMapSize, 0);
+	EquirectToCubeStats envStats = EquirectToCube(panorama, environment, EquirectFilter::Supersample);
+
+	std::string envMsg = "Environment " + std::to_string(panorama.Width) + "x" + std::to_string(panorama.Height) +
+		" -> " + std::to_string(EnvironmentMapSize) + "^2 cube: " + std::to_string(envStats.Seconds * 1000.0) + " ms, " +
+		std::to_string(envStats.MPixelsPerSecond) + " Mpixels/s\n";
+	::OutputDebugStringA(envMsg.c_str());
+
+	if (CompressEnvironment) {
+		std::string ddsPath = EnvironmentBC6HCachePath(panoramaPath, EnvironmentBC6HQuality);
+		if (GetFileAttributesA(ddsPath.c_str()) == INVALID_FILE_ATTRIBUTES) {
+			// The slower qualities take seconds, so they encode for the next launch on a
+			// detached low priority thread with its own pool: nothing on the default pool
+			// waits behind them and exit does not wait for them.  The cache appears under
+			// its name only once it is complete.
+			if (EnvironmentBC6HQuality != BC6HQuality::Fast) {
+				auto source = std::make_shared<CubeMapImage>(environment);
+				std::thread([source, ddsPath]() {
+					::SetThreadPriority(::GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+					try {
+						TaskPool pool(1);
+						CompressedTexture encoded;
+						BC6HStats stats = EncodeCubeMapBC6H(*source, BC6HFormat::Unsigned, EnvironmentBC6HQuality, encoded,
+							pool);
+						std::string tempPath = ddsPath + ".tmp";
+						WriteDDS(tempPath, encoded);
+						if (std::rename(tempPath.c_str(), ddsPath.c_str()) != 0) {
+							std::remove(tempPath.c_str());
+						}
+						std::string msg = "Environment BC6H cache written: " + std::to_string(stats.Seconds * 1000.0) + " ms\n";
+						::OutputDebugStringA(msg.c_str());
+					}
+					catch (const std::exception& e) {
+						std::string msg = std::string("Environment BC6H cache failed: ") + e.what() + "\n";
+						::OutputDebugStringA(msg.c_str());
+					}
+				}).detach();
+			}
+
+			CompressedTexture bc6h;
+			BC6HStats bc6hStats = EncodeCubeMapBC6H(environment, BC6HFormat::Unsigned, BC6HQuality::Fast, bc6h);
+			CreateTexture2DFromImage(md3dDevice.Get(), resUpload, bc6h, mCubeTexture->Resource.ReleaseAndGetAddressOf());
+
+			std::string bc6hMsg = "Environment BC6H fast encode: " + std::to_string(bc6hStats.Seconds * 1000.0) + " ms, " +
+				std::to_string(bc6hStats.MPixelsPerSecond) + " Mpixels/s\n";
+			::OutputDebugStringA(bc6hMsg.c_str());
+		}
 		else {
-			ThrowIfFailed(CreateWICTextureFromFileEx(
+			std::wstring ddsFile(ddsPath.begin(), ddsPath.end());
+			ThrowIfFailed(CreateDDSTextureFromFileEx(
 				md3dDevice.Get(),
 				resUpload,
-				texMap->FileName.c_str(),
+				ddsFile.c_str(),
 				0,
 				D3D12_RESOURCE_FLAG_NONE,
-				WIC_LOADER_MIP_AUTOGEN | (isSrgb[i] ? WIC_LOADER_SRGB_DEFAULT : WIC_LOADER_DEFAULT | WIC_LOADER_IGNORE_SRGB),
-				texMap->Resource.ReleaseAndGetAddressOf()
+				DDS_LOADER_DEFAULT,
+				mCubeTexture->Resource.ReleaseAndGetAddressOf()
 			));
 		}
+	}
+	else {
+		CreateTextureCubeFromImage(md3dDevice.Get(), resUpload, environment, mCubeTexture->Resource.ReleaseAndGetAddressOf(),
+			EnvironmentFloatFormat);
+	}
 
-		mTextures[texMap->Name] = std::move(texMap);
+	// The octahedral layout trades some accuracy for fewer texels; log how much
+	// against the cube it is derived from.
+	if (IBLLayout == EnvMapLayout::Octahedral) {
+		OctahedralImage octahedral(OctahedralSizeForCube(EnvironmentMapSize), gPrefilteredDesc.MipLevels);
+		CubeToOctahedral(environment, octahedral);
+		std::string octMsg = "Octahedral environment error vs cube (relative to mean):";
+		for (UINT mip = 0; mip < octahedral.MipLevels(); mip += 2) {
+			EnvMapError error = CompareOctahedralToCube(environment, octahedral, (float)mip);
+			octMsg += " mip " + std::to_string(mip) + " rms " + std::to_string(error.RmsError) +
+				" max " + std::to_string(error.MaxError) + ";";
+		}
+		octMsg += "\n";
+		::OutputDebugStringA(octMsg.c_str());
 	}
-	UINT srvIndex = texNames.size();
-	mCubeTexture = std::make_unique<TextureData>();
-	mCubeTexture->FileName = L"../Textures/Cubemap_LancellottiChapel.dds";
-	mCubeTexture->isDDS = true;
-	mCubeTexture->srvHeapIndex = srvIndex++;
-	ThrowIfFailed(CreateDDSTextureFromFileEx(
-		md3dDevice.Get(),
-		resUpload,
-		mCubeTexture->FileName.c_str(),
-		0,
-		D3D12_RESOURCE_FLAG_NONE,
-		DDS_LOADER_FORCE_SRGB | DDS_LOADER_MIP_AUTOGEN,
-		mCubeTexture->Resource.ReleaseAndGetAddressOf()
-	));
+
+	// From here on the environment is the residual without the dominant lights.  The
+	// sky above was uploaded from the full one.
+	if (ExtractEnvironmentLights) {
+		DominantLightDesc lightDesc;
+		lightDesc.MaxLights = MaxDominantLights;
+		DominantLightResult extracted = ExtractDominantLights(environment, lightDesc);
+		mDominantLights = extracted.Lights;
+		RemoveDominantLights(environment, mDominantLights);
+		CreateTextureCubeFromImage(md3dDevice.Get(), resUpload, environment, mIBLSourceTexture.ReleaseAndGetAddressOf(),
+			EnvironmentFloatFormat);
+
+		std::string lightMsg = "Extracted " + std::to_string(mDominantLights.size()) + " environment lights in " +
+			std::to_string(extracted.Seconds * 1000.0) + " ms:";
+		for (const DominantLight& light : mDominantLights) {
+			lightMsg += " (" + std::to_string(light.Direction[0]) + ", " + std::to_string(light.Direction[1]) + ", " +
+				std::to_string(light.Direction[2]) + ") " + std::to_string(light.SolidAngle) + " sr E " +
+				std::to_string(light.Irradiance[0]) + "/" + std::to_string(light.Irradiance[1]) + "/" +
+				std::to_string(light.Irradiance[2]) + ";";
+		}
+		lightMsg += "\n";
+		::OutputDebugStringA(lightMsg.c_str());
+	}
+	else {
+		mIBLSourceTexture = mCubeTexture->Resource;
+	}
+
+	// Low order stand-in for the irradiance and prefiltered maps while they bake.
+	mAmbientSH = RadianceToIrradianceSH9(ProjectCubeMapSH9(environment, std::min(5u, environment.MipLevels() - 1)));
+	if (UseIrradianceVolume) {
+		mEnvironment = std::move(environment);
+	}
+
 	auto uploadResourceFinished = resUpload.End(mCommandQueue.Get());
 	uploadResourceFinished.wait();
 
-	mDiffuseLight = std::make_unique<DiffuseCubeMap>(md3dDevice.Get(), mCubeTexture->Resource.Get(), IBLMapSize, IBLMapSize);
-	mDiffuseLight->srvHeapIndex = srvIndex++;
+	mDiffuseLight = std::make_unique<DiffuseCubeMap>(md3dDevice.Get(), mIBLSourceTexture.Get(), gIrradianceDesc);
 	mDiffuseLight->Initialize();
 
-	mPrefilteredMap = std::make_unique<PreFilteredCubeMap>(md3dDevice.Get(), mCubeTexture->Resource.Get(), IBLMapSize, IBLMapSize);
-	mPrefilteredMap->srvHeapIndex = srvIndex++;
+	mPrefilteredMap = std::make_unique<PreFilteredCubeMap>(md3dDevice.Get(), mIBLSourceTexture.Get(), gPrefilteredDesc);
 	mPrefilteredMap->Initialize();
 
-	mLUTMap = std::make_unique<LUTMap>(md3dDevice.Get(), IBLMapSize, IBLMapSize);
-	mLUTMap->srvHeapIndex = srvIndex++;
+	mLUTMap = std::make_unique<LUTMap>(md3dDevice.Get(), gBrdfLUTDesc);
 	mLUTMap->Initialize();
 
+	mProbeArray = std::make_unique<ReflectionProbeArray>(md3dDevice.Get(), gProbeDesc, ProbeArraySlices, ProbeCaptureSize);
+	mProbeArray->Initialize();
+
 }
 
 void PBR::BuildRootSignature()
 {
 
 	CD3DX12_DESCRIPTOR_RANGE texTable1;
-	texTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 20, 4);
+	texTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UINT_MAX, 4); // unbounded
 
 	CD3DX12_DESCRIPTOR_RANGE skyTable;
 	skyTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
@@ -690,8 +1734,11 @@ void PBR::BuildRootSignature()
 	CD3DX12_DESCRIPTOR_RANGE lutTable;
 	lutTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 3);
 
+	CD3DX12_DESCRIPTOR_RANGE probeTable;
+	probeTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 2);
+
     // Root parameter can be a table, root descriptor or root constants.
-    CD3DX12_ROOT_PARAMETER slotRootParameter[8];
+    CD3DX12_ROOT_PARAMETER slotRootParameter[10];
 
 	// Perfomance TIP: Order from most frequent to least frequent.
     slotRootParameter[0].InitAsConstantBufferView(0); // cbPerObject
@@ -702,6 +1749,8 @@ void PBR::BuildRootSignature()
 	slotRootParameter[5].InitAsDescriptorTable(1, &irradianceTable, D3D12_SHADER_VISIBILITY_PIXEL); // irradianceMap
 	slotRootParameter[6].InitAsDescriptorTable(1, &prefilteredTable, D3D12_SHADER_VISIBILITY_PIXEL); // prefilteredMap
 	slotRootParameter[7].InitAsDescriptorTable(1, &lutTable, D3D12_SHADER_VISIBILITY_PIXEL);      // LUTMap
+	slotRootParameter[8].InitAsDescriptorTable(1, &probeTable, D3D12_SHADER_VISIBILITY_PIXEL);    // gProbeMaps
+	slotRootParameter[9].InitAsShaderResourceView(1, 1, D3D12_SHADER_VISIBILITY_VERTEX);          // gIrradianceVolume
 
 	auto staticSamplers = GetStaticSamplers();
 
@@ -732,13 +1781,10 @@ void PBR::BuildRootSignature()
 void PBR::BuildDescriptorHeaps()
 {
 	//
-	// Create the SRV heap.
+	// Create the SRV heap.  Every view below gets a persistent index of its own.
 	//
-	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-	srvHeapDesc.NumDescriptors = 30;
-	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
+	mSrvHeap = std::make_unique<BindlessDescriptorHeap>(md3dDevice.Get(), BindlessInitialCapacity,
+		BindlessTransientPerFrame, gNumFrameResources);
 
 	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
@@ -752,13 +1798,13 @@ void PBR::BuildDescriptorHeaps()
 		srvDesc.Format = tex->Resource->GetDesc().Format;
 		srvDesc.Texture2D.MipLevels = tex->Resource->GetDesc().MipLevels;
 
-		CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(
-			mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(),
-			tex->srvHeapIndex,
-			mCbvSrvUavDescriptorSize
-		);
-
-		md3dDevice->CreateShaderResourceView(tex->Resource.Get(), &srvDesc, hDescriptor);
+		// Textures sharing a resource share its view too.
+		ResourceRegistry::Entry* entry = mResources->Find(tex->Hash);
+		if (entry->SrvIndex == kNoDescriptor) {
+			entry->SrvIndex = mSrvHeap->AllocatePersistent(mCurrentFence);
+			mSrvHeap->CreateSrv(entry->SrvIndex, tex->Resource.Get(), &srvDesc);
+		}
+		tex->srvHeapIndex = entry->SrvIndex;
 	}
 
 	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
@@ -766,34 +1812,53 @@ void PBR::BuildDescriptorHeaps()
 	srvDesc.TextureCube.MostDetailedMip = 0;
 	srvDesc.TextureCube.ResourceMinLODClamp = 0.0f;
 	srvDesc.Format = mCubeTexture->Resource->GetDesc().Format;
-	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(
-			mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(),
-			mCubeTexture->srvHeapIndex,
-			mCbvSrvUavDescriptorSize
-	);
-	md3dDevice->CreateShaderResourceView(mCubeTexture->Resource.Get(), &srvDesc, hDescriptor);
-
-	ID3D12Resource* DiffuseLightResource = mDiffuseLight->Resource();
-	srvDesc.TextureCube.MipLevels = DiffuseLightResource->GetDesc().MipLevels;
-	srvDesc.Format = DiffuseLightResource->GetDesc().Format;
-	hDescriptor.Offset(mCbvSrvDescriptorSize);
-	md3dDevice->CreateShaderResourceView(DiffuseLightResource, &srvDesc, hDescriptor);
-
-	ID3D12Resource* PrefilteredReource = mPrefilteredMap->Resource();
-	srvDesc.TextureCube.MipLevels = PrefilteredReource->GetDesc().MipLevels;
-	srvDesc.Format = PrefilteredReource->GetDesc().Format;
-	hDescriptor.Offset(mCbvSrvDescriptorSize);
-	md3dDevice->CreateShaderResourceView(PrefilteredReource, &srvDesc, hDescriptor);
+	mCubeTexture->srvHeapIndex = mSrvHeap->AllocatePersistent(mCurrentFence);
+	mSrvHeap->CreateSrv(mCubeTexture->srvHeapIndex, mCubeTexture->Resource.Get(), &srvDesc);
+
+	// The irradiance and prefiltered maps are cubes, or plain 2D textures when they
+	// use the octahedral layout.
+	auto createIBLSrv = [&](RenderTexture* target) {
+		ID3D12Resource* resource = target->Resource();
+		srvDesc.Format = resource->GetDesc().Format;
+		if (IBLLayout == EnvMapLayout::Octahedral) {
+			srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+			srvDesc.Texture2D.MostDetailedMip = 0;
+			srvDesc.Texture2D.MipLevels = resource->GetDesc().MipLevels;
+			srvDesc.Texture2D.PlaneSlice = 0;
+			srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+		}
+		else {
+			srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
+			srvDesc.TextureCube.MostDetailedMip = 0;
+			srvDesc.TextureCube.MipLevels = resource->GetDesc().MipLevels;
+			srvDesc.TextureCube.ResourceMinLODClamp = 0.0f;
+		}
+		target->srvHeapIndex = mSrvHeap->AllocatePersistent(mCurrentFence);
+		mSrvHeap->CreateSrv(target->srvHeapIndex, resource, &srvDesc);
+	};
+	createIBLSrv(mDiffuseLight.get());
+	createIBLSrv(mPrefilteredMap.get());
 
 	ID3D12Resource* LUTMapResource = mLUTMap->Resource();
-	srvDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
+	srvDesc.Format = LUTMapResource->GetDesc().Format;
 	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
 	srvDesc.Texture2D.MipLevels = LUTMapResource->GetDesc().MipLevels;
 	srvDesc.Texture2D.MostDetailedMip = 0;
 	srvDesc.Texture2D.PlaneSlice = 0;
 	srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-	hDescriptor.Offset(mCbvSrvDescriptorSize);
-	md3dDevice->CreateShaderResourceView(LUTMapResource, &srvDesc, hDescriptor);
+	mLUTMap->srvHeapIndex = mSrvHeap->AllocatePersistent(mCurrentFence);
+	mSrvHeap->CreateSrv(mLUTMap->srvHeapIndex, LUTMapResource, &srvDesc);
+
+	ID3D12Resource* probeResource = mProbeArray->Resource();
+	srvDesc.Format = probeResource->GetDesc().Format;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBEARRAY;
+	srvDesc.TextureCubeArray.MostDetailedMip = 0;
+	srvDesc.TextureCubeArray.MipLevels = probeResource->GetDesc().MipLevels;
+	srvDesc.TextureCubeArray.First2DArrayFace = 0;
+	srvDesc.TextureCubeArray.NumCubes = mProbeArray->Slices();
+	srvDesc.TextureCubeArray.ResourceMinLODClamp = 0.0f;
+	mProbeArray->srvHeapIndex = mSrvHeap->AllocatePersistent(mCurrentFence);
+	mSrvHeap->CreateSrv(mProbeArray->srvHeapIndex, probeResource, &srvDesc);
 }
 
 void PBR::BuildShadersAndInputLayout()
@@ -804,11 +1869,30 @@ void PBR::BuildShadersAndInputLayout()
 		NULL, NULL
 	};
 
+	// Selects how PBR.hlsl reads the irradiance and prefiltered maps.
+	const D3D_SHADER_MACRO iblDefines[] =
+	{
+		"IBL_OCTAHEDRAL", "1",
+		NULL, NULL
+	};
+	const D3D_SHADER_MACRO* opaqueDefines = IBLLayout == EnvMapLayout::Octahedral ? iblDefines : nullptr;
+
 	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\PBR.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\PBR.hlsl", nullptr, "PS", "ps_5_1");
+	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\PBR.hlsl", opaqueDefines, "PS", "ps_5_1");
 	mShaders["skyVS"] = d3dUtil::CompileShader(L"Shaders\\sky.hlsl", nullptr, "VS", "vs_5_1");
 	mShaders["skyPS"] = d3dUtil::CompileShader(L"Shaders\\sky.hlsl", nullptr, "PS", "ps_5_1");
 
+	const D3D_SHADER_MACRO probeCaptureDefines[] =
+	{
+		"PROBE_CAPTURE", "1",
+		// A NULL name ends the list, so this one only exists for octahedral maps.
+		IBLLayout == EnvMapLayout::Octahedral ? "IBL_OCTAHEDRAL" : NULL, "1",
+		NULL, NULL
+	};
+
+	mShaders["probeCapturePS"] = d3dUtil::CompileShader(L"Shaders\\PBR.hlsl", probeCaptureDefines, "PS", "ps_5_1");
+	mShaders["probeCaptureSkyPS"] = d3dUtil::CompileShader(L"Shaders\\sky.hlsl", probeCaptureDefines, "PS", "ps_5_1");
+
 	mShaders["debugVS"] = d3dUtil::CompileShader(L"Shaders\\watchTexture.hlsl", nullptr, "VS", "vs_5_1");
 	mShaders["debugPS"] = d3dUtil::CompileShader(L"Shaders\\watchTexture.hlsl", nullptr, "PS", "ps_5_1");
 
@@ -821,25 +1905,50 @@ void PBR::BuildShadersAndInputLayout()
     };
 }
 
-void PBR::BuildMeshes() {
-	Model model("..\\Models\\Cerberus_LP.obj");
-
-	std::vector<Vertex> vertices(model.totalVertexCount);
-	std::vector<uint32_t> indices(model.totalIndexCount);
+// Box around the vertices of a submesh, and the sphere around the center of the box.
+static void ComputeSubmeshBounds(const Vertex* vertices, size_t count, SubmeshGeometry& submesh)
+{
+	BoundingBox::CreateFromPoints(submesh.Bounds, count, &vertices[0].Pos, sizeof(Vertex));
+	XMVECTOR center = XMLoadFloat3(&submesh.Bounds.Center);
+	XMVECTOR radiusSq = XMVectorZero();
+	for (size_t i = 0; i < count; i++) {
+		radiusSq = XMVectorMax(radiusSq, XMVector3LengthSq(XMLoadFloat3(&vertices[i].Pos) - center));
+	}
+	submesh.Sphere = BoundingSphere(submesh.Bounds.Center, XMVectorGetX(XMVectorSqrt(radiusSq)));
+}
 
-	uint16_t startVertex = 0;
-	for (Mesh &mesh: model.meshes) {
-		for (int i = 0; i < mesh.vertices.size(); i++) {
-			vertices[i] = mesh.vertices[i];
-		}
-		for (int i = 0; i < mesh.indices.size(); i++) {
-			indices[i] = mesh.indices[i] + startVertex;
+void PBR::BuildMeshes() {
+	const char* modelPath = "..\\Models\\Cerberus_LP.obj";
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+
+	const AssetEntry* vertexEntry = mPackage ? mPackage->Find("mesh.vertices") : nullptr;
+	const AssetEntry* indexEntry = mPackage ? mPackage->Find("mesh.indices") : nullptr;
+	if (vertexEntry && indexEntry && vertexEntry->Stride == sizeof(Vertex)) {
+		vertices.resize((size_t)(vertexEntry->Size / sizeof(Vertex)));
+		indices.resize((size_t)(indexEntry->Size / sizeof(uint32_t)));
+		mPackage->Read(*vertexEntry, vertices.data());
+		mPackage->Read(*indexEntry, indices.data());
+	}
+	else {
+		Model model(modelPath);
+		vertices.resize(model.totalVertexCount);
+		indices.resize(model.totalIndexCount);
+
+		uint16_t startVertex = 0;
+		for (Mesh &mesh: model.meshes) {
+			for (int i = 0; i < mesh.vertices.size(); i++) {
+				vertices[i] = mesh.vertices[i];
+			}
+			for (int i = 0; i < mesh.indices.size(); i++) {
+				indices[i] = mesh.indices[i] + startVertex;
+			}
+			startVertex += vertices.size();
 		}
-		startVertex += vertices.size();
 	}
 
-	UINT vbByteSize = model.totalIndexCount * sizeof(Vertex);
-	UINT ibByteSize = model.totalIndexCount * sizeof(std::uint32_t);
+	UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint32_t);
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "mesh";
@@ -849,11 +1958,8 @@ void PBR::BuildMeshes() {
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	geo->VertexBufferGPU = CreateSharedBuffer(geo->Name, vertices.data(), vbByteSize, geo->VertexBufferUploader);
+	geo->IndexBufferGPU = CreateSharedBuffer(geo->Name, indices.data(), ibByteSize, geo->IndexBufferUploader);
 
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
@@ -864,10 +1970,45 @@ void PBR::BuildMeshes() {
 	subMesh.BaseVertexLocation = 0;
 	subMesh.IndexCount = indices.size();
 	subMesh.StartIndexLocation = 0;
+	ComputeSubmeshBounds(vertices.data(), vertices.size(), subMesh);
 
 	geo->DrawArgs["mesh"] = subMesh;
 
 	mGeometries[geo->Name] = std::move(geo);
+
+	if (mPackageWriter) {
+		mPackageWriter->AddBlob("mesh.vertices", vertices.data(), vbByteSize, sizeof(Vertex), PackageCodec::LZ);
+		mPackageWriter->AddBlob("mesh.indices", indices.data(), ibByteSize, sizeof(uint32_t), PackageCodec::LZ);
+		mPackageWriter->AddSource(modelPath);
+		AssetPackStats packStats = mPackageWriter->Write(AssetPackagePath);
+		mPackageWriter.reset();
+		std::string packMsg = "Asset package: wrote " + std::to_string(packStats.Entries) + " entries (" +
+			std::to_string(packStats.Shared) + " shared), " + std::to_string(packStats.Bytes / (1024.0 * 1024.0)) +
+			" MB in a " + std::to_string(packStats.FileBytes / (1024.0 * 1024.0)) + " MB file, " +
+			std::to_string(packStats.Seconds * 1000.0) + " ms\n";
+		::OutputDebugStringA(packMsg.c_str());
+	}
+
+	SharedResourceStats shared = mResources->Stats();
+	std::string sharedMsg = "Resource registry: " + std::to_string(shared.LiveResources) + " resources, " +
+		std::to_string(shared.LiveBytes / (1024.0 * 1024.0)) + " MB, " + std::to_string(shared.Hits) +
+		" shared uses saved " + std::to_string(shared.SavedBytes / (1024.0 * 1024.0)) + " MB\n";
+	::OutputDebugStringA(sharedMsg.c_str());
+}
+
+// Uploads a default heap buffer, or hands out the existing one with the same bytes,
+// as a reference held by geometry.  uploader stays empty when the buffer is shared.
+ComPtr<ID3D12Resource> PBR::CreateSharedBuffer(const std::string& geometry, const void* data, UINT byteSize,
+	ComPtr<ID3D12Resource>& uploader)
+{
+	ContentHash hash = HashBytes(data, byteSize);
+	mGeometryContent[geometry].push_back(hash);
+	if (ResourceRegistry::Entry* shared = mResources->Acquire(hash)) {
+		return shared->Resource;
+	}
+	ComPtr<ID3D12Resource> buffer = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(), data, byteSize, uploader);
+	mResources->Add(hash, buffer);
+	return buffer;
 }
 
 void PBR::BuildShapeGeometry()
@@ -961,6 +2102,11 @@ void PBR::BuildShapeGeometry()
 		vertices[k].TangentU = cylinder.Vertices[i].TangentU;
 	}
 
+	ComputeSubmeshBounds(&vertices[boxVertexOffset], box.Vertices.size(), boxSubmesh);
+	ComputeSubmeshBounds(&vertices[gridVertexOffset], grid.Vertices.size(), gridSubmesh);
+	ComputeSubmeshBounds(&vertices[sphereVertexOffset], sphere.Vertices.size(), sphereSubmesh);
+	ComputeSubmeshBounds(&vertices[cylinderVertexOffset], cylinder.Vertices.size(), cylinderSubmesh);
+
 	std::vector<std::uint16_t> indices;
 	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
 	indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
@@ -979,11 +2125,8 @@ void PBR::BuildShapeGeometry()
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	geo->VertexBufferGPU = CreateSharedBuffer(geo->Name, vertices.data(), vbByteSize, geo->VertexBufferUploader);
+	geo->IndexBufferGPU = CreateSharedBuffer(geo->Name, indices.data(), ibByteSize, geo->IndexBufferUploader);
 
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
@@ -1043,6 +2186,31 @@ void PBR::BuildPSOs()
 	skyPsoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
 	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&skyPsoDesc, IID_PPV_ARGS(&mPSOs["sky"])));
 
+	//
+	// PSOs for reflection probe captures: linear HDR output into the probe's capture cube.
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC probeCapturePsoDesc = opaquePsoDesc;
+	probeCapturePsoDesc.PS = {
+		reinterpret_cast< BYTE* >(mShaders["probeCapturePS"]->GetBufferPointer()),
+		mShaders["probeCapturePS"]->GetBufferSize()
+	};
+	probeCapturePsoDesc.RTVFormats[0] = mProbeArray->CaptureFormat();
+	probeCapturePsoDesc.DSVFormat = mProbeArray->CaptureDepthFormat();
+	probeCapturePsoDesc.SampleDesc.Count = 1;
+	probeCapturePsoDesc.SampleDesc.Quality = 0;
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&probeCapturePsoDesc, IID_PPV_ARGS(&mPSOs["probeCapture"])));
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC probeCaptureSkyPsoDesc = skyPsoDesc;
+	probeCaptureSkyPsoDesc.PS = {
+		reinterpret_cast< BYTE* >(mShaders["probeCaptureSkyPS"]->GetBufferPointer()),
+		mShaders["probeCaptureSkyPS"]->GetBufferSize()
+	};
+	probeCaptureSkyPsoDesc.RTVFormats[0] = mProbeArray->CaptureFormat();
+	probeCaptureSkyPsoDesc.DSVFormat = mProbeArray->CaptureDepthFormat();
+	probeCaptureSkyPsoDesc.SampleDesc.Count = 1;
+	probeCaptureSkyPsoDesc.SampleDesc.Quality = 0;
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&probeCaptureSkyPsoDesc, IID_PPV_ARGS(&mPSOs["probeCaptureSky"])));
+
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC debugPso = opaquePsoDesc;
 	debugPso.VS = {
 		reinterpret_cast< BYTE* >(mShaders["debugVS"]->GetBufferPointer()),
@@ -1062,7 +2230,7 @@ void PBR::BuildFrameResources()
     for(int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size()));
+            1 + 6 * ProbeBakesPerFrame, (UINT)mAllRitems.size(), (UINT)mMaterials.size()));
     }
 }
 
@@ -1080,9 +2248,7 @@ void PBR::BuildMaterials()
 			Mat->Roughness = (1 - 0.05) * ((float)row / 10) + 0.05;
 
 			Mat->AlbedoTex = mTextures["default"].get();
-			Mat->MetallicTex = mTextures["default"].get();
-			Mat->AOTex = mTextures["default"].get();
-			Mat->RoughnessTex = mTextures["default"].get();
+			Mat->OrmTex = mTextures["default"].get();
 			Mat->NormalTex = mTextures["defaultNormal"].get();
 			mMaterials[Mat->Name] = std::move(Mat);
 		}
@@ -1096,9 +2262,7 @@ void PBR::BuildMaterials()
 	rusted_iron->Metallic = 1.0f;
 	rusted_iron->Roughness = 1.0f;
 	rusted_iron->AlbedoTex = mTextures["rusted_iron_albedo"].get();
-	rusted_iron->MetallicTex = mTextures["rusted_iron_metallic"].get();
-	rusted_iron->AOTex = mTextures["rusted_iron_ao"].get();
-	rusted_iron->RoughnessTex = mTextures["rusted_iron_roughness"].get();
+	rusted_iron->OrmTex = mTextures["rusted_iron_orm"].get();
 	rusted_iron->NormalTex = mTextures["rusted_iron_normal"].get();
 	mMaterials[rusted_iron->Name] = std::move(rusted_iron);
 
@@ -1110,9 +2274,7 @@ void PBR::BuildMaterials()
 	plastic->Metallic = 1.0f;
 	plastic->Roughness = 1.0f;
 	plastic->AlbedoTex = mTextures["plastic_albedo"].get();
-	plastic->MetallicTex = mTextures["plastic_metallic"].get();
-	plastic->AOTex = mTextures["plastic_ao"].get();
-	plastic->RoughnessTex = mTextures["plastic_roughness"].get();
+	plastic->OrmTex = mTextures["plastic_orm"].get();
 	plastic->NormalTex = mTextures["plastic_normal"].get();
 	mMaterials[plastic->Name] = std::move(plastic);
 
@@ -1124,9 +2286,7 @@ void PBR::BuildMaterials()
 	mesh->Metallic = 1.0f;
 	mesh->Roughness = 1.0f;
 	mesh->AlbedoTex = mTextures["mesh_albedo"].get();
-	mesh->MetallicTex = mTextures["mesh_metallic"].get();
-	mesh->AOTex = mTextures["default"].get();
-	mesh->RoughnessTex = mTextures["mesh_roughness"].get();
+	mesh->OrmTex = mTextures["mesh_orm"].get();
 	mesh->NormalTex = mTextures["mesh_normal"].get();
 	mMaterials[mesh->Name] = std::move(mesh);
 }
@@ -1148,6 +2308,8 @@ void PBR::BuildRenderItems()
 			ball->IndexCount = ball->Geo->DrawArgs["sphere"].IndexCount;
 			ball->StartIndexLocation = ball->Geo->DrawArgs["sphere"].StartIndexLocation;
 			ball->BaseVertexLocation = ball->Geo->DrawArgs["sphere"].BaseVertexLocation;
+			ball->Bounds = ball->Geo->DrawArgs["sphere"].Bounds;
+			ball->Sphere = ball->Geo->DrawArgs["sphere"].Sphere;
 
 			mRitemLayer[(int)RenderLayer::Opaque].push_back(ball.get());
 			mAllRitems.push_back(std::move(ball));
@@ -1165,6 +2327,8 @@ void PBR::BuildRenderItems()
 	ball->IndexCount = ball->Geo->DrawArgs["sphere"].IndexCount;
 	ball->StartIndexLocation = ball->Geo->DrawArgs["sphere"].StartIndexLocation;
 	ball->BaseVertexLocation = ball->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	ball->Bounds = ball->Geo->DrawArgs["sphere"].Bounds;
+	ball->Sphere = ball->Geo->DrawArgs["sphere"].Sphere;
 
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(ball.get());
 	mAllRitems.push_back(std::move(ball));
@@ -1180,6 +2344,8 @@ void PBR::BuildRenderItems()
 	ball->IndexCount = ball->Geo->DrawArgs["sphere"].IndexCount;
 	ball->StartIndexLocation = ball->Geo->DrawArgs["sphere"].StartIndexLocation;
 	ball->BaseVertexLocation = ball->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	ball->Bounds = ball->Geo->DrawArgs["sphere"].Bounds;
+	ball->Sphere = ball->Geo->DrawArgs["sphere"].Sphere;
 
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(ball.get());
 	mAllRitems.push_back(std::move(ball));
@@ -1194,6 +2360,8 @@ void PBR::BuildRenderItems()
 	sky->IndexCount = sky->Geo->DrawArgs["sphere"].IndexCount;
 	sky->StartIndexLocation = sky->Geo->DrawArgs["sphere"].StartIndexLocation;
 	sky->BaseVertexLocation = sky->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	sky->Bounds = sky->Geo->DrawArgs["sphere"].Bounds;
+	sky->Sphere = sky->Geo->DrawArgs["sphere"].Sphere;
 
 	mRitemLayer[( int )RenderLayer::Sky].push_back(sky.get());
 	mAllRitems.push_back(std::move(sky));
@@ -1207,11 +2375,58 @@ void PBR::BuildRenderItems()
 	gun->IndexCount = gun->Geo->DrawArgs["mesh"].IndexCount;
 	gun->StartIndexLocation = gun->Geo->DrawArgs["mesh"].StartIndexLocation;
 	gun->BaseVertexLocation = gun->Geo->DrawArgs["mesh"].BaseVertexLocation;
+	gun->Bounds = gun->Geo->DrawArgs["mesh"].Bounds;
+	gun->Sphere = gun->Geo->DrawArgs["mesh"].Sphere;
 
 	mRitemLayer[( int )RenderLayer::Opaque].push_back(gun.get());
 	mAllRitems.push_back(std::move(gun));
 }
 
+void PBR::BuildCullingBounds()
+{
+	// The items never move, so their world bounds are set once.
+	const std::vector<RenderItem*>& opaque = mRitemLayer[(int)RenderLayer::Opaque];
+	std::vector<float> boxes;
+	mOpaqueBounds.Clear();
+	for (auto ri : opaque) {
+		XMMATRIX world = XMLoadFloat4x4(&ri->World);
+		BoundingBox box;
+		BoundingSphere sphere;
+		ri->Bounds.Transform(box, world);
+		ri->Sphere.Transform(sphere, world);
+		mOpaqueBounds.Add(&box.Center.x, &box.Extents.x, sphere.Radius);
+
+		const XMFLOAT3& c = box.Center;
+		const XMFLOAT3& e = box.Extents;
+		boxes.insert(boxes.end(), { c.x - e.x, c.y - e.y, c.z - e.z, c.x + e.x, c.y + e.y, c.z + e.z });
+	}
+	mOpaqueBVH = opaque.size() >= SceneBVHMinItems ? SceneBVH(boxes) : SceneBVH();
+}
+
+// Replaces visible with the opaque items that may be seen through viewProj.
+void PBR::CullOpaqueItems(FXMMATRIX viewProj, std::vector<RenderItem*>& visible)
+{
+	const std::vector<RenderItem*>& opaque = mRitemLayer[(int)RenderLayer::Opaque];
+	if (!CullRenderItems) {
+		visible = opaque;
+		return;
+	}
+
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, viewProj);
+	Frustum frustum = FrustumFromViewProj(m.m);
+	if (mOpaqueBVH.ObjectCount() != 0) {
+		mOpaqueBVH.QueryFrustum(frustum, mVisibleIds);
+	}
+	else {
+		mOpaqueBounds.Cull(frustum, mVisibleIds);
+	}
+	visible.clear();
+	for (uint32_t id : mVisibleIds) {
+		visible.push_back(opaque[id]);
+	}
+}
+
 void PBR::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 {
 	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
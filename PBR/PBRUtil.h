@@ -1,4 +1,5 @@
 #include "../Common/d3dUtil.h"
+#include "ContentHash.h"
 
 class TextureData {
 public:
@@ -6,6 +7,8 @@ public:
 	std::wstring FileName;
 	bool isDDS = false;
 	UINT srvHeapIndex = -1;
+	// Content the resource is shared under in the ResourceRegistry.
+	ContentHash Hash;
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
 };
@@ -15,9 +18,8 @@ struct MaterialObj {
 	UINT MatCBIndex;
 
 	TextureData* AlbedoTex;
-	TextureData* MetallicTex;
-	TextureData* RoughnessTex;
-	TextureData* AOTex;
+	// Occlusion, roughness and metallic in R, G and B.
+	TextureData* OrmTex;
 	TextureData* NormalTex;
 
 	DirectX::XMFLOAT3 albedo;
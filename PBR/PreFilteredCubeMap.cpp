@@ -1,9 +1,10 @@
 #include "PreFilteredCubeMap.h"
 
-PreFilteredCubeMap::PreFilteredCubeMap(ID3D12Device* device, ID3D12Resource* lightMap, UINT width, UINT height)
-	:RenderTexture(device, width, height, DXGI_FORMAT_R8G8B8A8_UNORM)
+PreFilteredCubeMap::PreFilteredCubeMap(ID3D12Device* device, ID3D12Resource* lightMap, const IBLTextureDesc& desc)
+	:RenderTexture(device, IBLTextureExtent(desc), IBLTextureExtent(desc), desc.MipLevels, desc.Format)
 {
 	mLightMap = lightMap;
+	mLayout = desc.Layout;
 }
 
 void PreFilteredCubeMap::BuildResource() {
@@ -12,8 +13,8 @@ void PreFilteredCubeMap::BuildResource() {
 	texDesc.Height = mHeight;
 	texDesc.Width = mWidth;
 	texDesc.Format = mFormat;
-	texDesc.DepthOrArraySize = 6;
-	texDesc.MipLevels = 0;
+	texDesc.DepthOrArraySize = FaceCount();
+	texDesc.MipLevels = mMipLevels;
 	texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
 	texDesc.Alignment = 0;
 	texDesc.SampleDesc.Count = 1;
@@ -35,7 +36,7 @@ void PreFilteredCubeMap::BuildResource() {
 
 void PreFilteredCubeMap::BuildDescriptorHeaps() {
 	D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc;
-	rtvHeapDesc.NumDescriptors = 6 * mMipLevels;
+	rtvHeapDesc.NumDescriptors = FaceCount() * mMipLevels;
 	rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
 	rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 	rtvHeapDesc.NodeMask = 0;
@@ -68,8 +69,8 @@ void PreFilteredCubeMap::BuildDescriptors() {
 
 	CD3DX12_CPU_DESCRIPTOR_HANDLE handle(mRtvHeap->GetCPUDescriptorHandleForHeapStart());
 
-	for (int mip = 0; mip < mMipLevels; mip++) {
-		for (int i = 0; i < 6; i++) {
+	for (UINT mip = 0; mip < mMipLevels; mip++) {
+		for (UINT i = 0; i < FaceCount(); i++) {
 			D3D12_RENDER_TARGET_VIEW_DESC rtvDesc;
 			rtvDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2DARRAY;
 			rtvDesc.Format = mFormat;
@@ -80,7 +81,7 @@ void PreFilteredCubeMap::BuildDescriptors() {
 			rtvDesc.Texture2DArray.FirstArraySlice = i;
 
 			md3dDevice->CreateRenderTargetView(mTextureMap.Get(), &rtvDesc, handle);
-			handle.Offset(mCbvSrvUavDescriptorSize);
+			handle.Offset(mRtvDescriptorSize);
 		}
 	}
 }
@@ -136,7 +137,7 @@ void PreFilteredCubeMap::BuildRootSignature() {
 
 void PreFilteredCubeMap::BuildPso() {
 	mVertexShader = d3dUtil::CompileShader(L"Shaders/preFilter.hlsl", nullptr, "VS", "vs_5_1");
-	mPixelShader = d3dUtil::CompileShader(L"Shaders/preFilter.hlsl", nullptr, "PS", "ps_5_1");
+	mPixelShader = d3dUtil::CompileShader(L"Shaders/preFilter.hlsl", LayoutDefines(), "PS", "ps_5_1");
 
 	std::vector<D3D12_INPUT_ELEMENT_DESC> inputLayout = {
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
@@ -161,7 +162,7 @@ void PreFilteredCubeMap::BuildPso() {
 	psoDesc.SampleMask = UINT_MAX;
 	psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
 	psoDesc.NumRenderTargets = 1;
-	psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+	psoDesc.RTVFormats[0] = mFormat;
 	psoDesc.SampleDesc.Count = 1;
 	psoDesc.SampleDesc.Quality = 0;
 	psoDesc.DepthStencilState.DepthEnable = false;
@@ -182,14 +183,8 @@ void PreFilteredCubeMap::OnResize(UINT newWidth, UINT newHeight) {
 	}
 }
 
-void PreFilteredCubeMap::BakeTexture(ID3D12GraphicsCommandList* cmdList) {
-	ThrowIfFailed(md3dDevice->CreateCommandAllocator(
-		D3D12_COMMAND_LIST_TYPE_DIRECT,
-		IID_PPV_ARGS(cmdListAlloc.GetAddressOf())
-	));
-
-	ThrowIfFailed(cmdListAlloc->Reset());
-	ThrowIfFailed(cmdList->Reset(cmdListAlloc.Get(), mPSO.Get()));
+void PreFilteredCubeMap::BakeRegion(ID3D12GraphicsCommandList* cmdList, UINT face, UINT mip, const D3D12_RECT& rect) {
+	cmdList->SetPipelineState(mPSO.Get());
 
 	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvHeap.Get() };
 	cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
@@ -198,57 +193,26 @@ void PreFilteredCubeMap::BakeTexture(ID3D12GraphicsCommandList* cmdList) {
 	// Set the Light Map
 	cmdList->SetGraphicsRootDescriptorTable(2, mhGpuSrv);
 
-	cmdList->ResourceBarrier(
-		1,
-		&CD3DX12_RESOURCE_BARRIER::Transition(
-			mTextureMap.Get(),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			D3D12_RESOURCE_STATE_RENDER_TARGET
-		)
-	);
-
-	UINT faceCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(faceCB));
-
-	CD3DX12_CPU_DESCRIPTOR_HANDLE rtv(mRtvHeap->GetCPUDescriptorHandleForHeapStart());
-
-	D3D12_VIEWPORT viewport = mViewport;
-	D3D12_RECT scissorRect = mScissorRect;
-
-	for (int mip = 0; mip < mMipLevels; mip++) {
+	float roughness = mMipLevels > 1 ? (float)mip / (mMipLevels - 1) : 0.0f;
+	cmdList->SetGraphicsRoot32BitConstants(1, 1, &roughness, 0);
 
-		float roughness = (float)mip / (mMipLevels - 1);
-		cmdList->SetGraphicsRoot32BitConstants(1, 1, &roughness, 0);
+	TransitionForBake(cmdList, face, mip, true);
 
-		cmdList->RSSetViewports(1, &viewport);
-		cmdList->RSSetScissorRects(1, &scissorRect);
+	D3D12_VIEWPORT viewport = MipViewport(mip);
+	cmdList->RSSetViewports(1, &viewport);
+	cmdList->RSSetScissorRects(1, &rect);
 
-		for (int i = 0; i < 6; i++) {
+	CD3DX12_CPU_DESCRIPTOR_HANDLE rtv = RtvHandle(face, mip);
+	cmdList->OMSetRenderTargets(1, &rtv, true, nullptr);
 
-			D3D12_GPU_VIRTUAL_ADDRESS faceCBAddress = faceCB->Resource()->GetGPUVirtualAddress() + i * faceCBByteSize;
-			cmdList->SetGraphicsRootConstantBufferView(0, faceCBAddress);
+	UINT faceCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(FaceConstants));
+	D3D12_GPU_VIRTUAL_ADDRESS faceCBAddress = faceCB->Resource()->GetGPUVirtualAddress() + (face % 6) * faceCBByteSize;
+	cmdList->SetGraphicsRootConstantBufferView(0, faceCBAddress);
 
-			cmdList->OMSetRenderTargets(1, &rtv, true, nullptr);
+	cmdList->IASetVertexBuffers(0, 0, nullptr);
+	cmdList->IASetIndexBuffer(nullptr);
+	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	cmdList->DrawInstanced(6, 1, 0, 0);
 
-			rtv.Offset(mCbvSrvUavDescriptorSize);
-
-			cmdList->IASetVertexBuffers(0, 0, nullptr);
-			cmdList->IASetIndexBuffer(nullptr);
-			cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-			cmdList->DrawInstanced(6, 1, 0, 0);
-		}
-		viewport.Height /= 2;
-		viewport.Width /= 2;
-
-		scissorRect.right /= 2;
-		scissorRect.bottom /= 2;
-	}
-
-	cmdList->ResourceBarrier(
-		1,
-		&CD3DX12_RESOURCE_BARRIER::Transition(
-			mTextureMap.Get(),
-			D3D12_RESOURCE_STATE_RENDER_TARGET,
-			D3D12_RESOURCE_STATE_GENERIC_READ
-		)
-	);
+	TransitionForBake(cmdList, face, mip, false);
 }
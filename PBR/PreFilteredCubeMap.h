@@ -1,17 +1,19 @@
 #pragma once
 #include "RenderTexture.h"
 
+// GGX prefiltered specular cube, one roughness step per mip.  Subclasses that report
+// more than six faces get a cube array; face f then belongs to cube f / 6.
 class PreFilteredCubeMap : public RenderTexture {
 
 public:
-	PreFilteredCubeMap(ID3D12Device* device, ID3D12Resource* lightMap, UINT width, UINT height);
+	PreFilteredCubeMap(ID3D12Device* device, ID3D12Resource* lightMap, const IBLTextureDesc& desc);
 	PreFilteredCubeMap(const PreFilteredCubeMap& rhs) = delete;
 	PreFilteredCubeMap& operator=(const PreFilteredCubeMap& rhs) = delete;
 
 	virtual ~PreFilteredCubeMap() = default;
 
 	virtual void OnResize(UINT newWidth, UINT newHeight)override;
-	virtual void BakeTexture(ID3D12GraphicsCommandList * cmdList)override;
+	virtual void BakeRegion(ID3D12GraphicsCommandList* cmdList, UINT face, UINT mip, const D3D12_RECT& rect)override;
 
 protected:
 	virtual void BuildResource()override;
@@ -22,7 +24,6 @@ protected:
 
 protected:
 	ID3D12Resource* mLightMap = nullptr;
-	UINT mMipLevels;
 	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuSrv;
 	CD3DX12_GPU_DESCRIPTOR_HANDLE mhGpuSrv;
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mSrvHeap = nullptr;
@@ -0,0 +1,148 @@
+#include "ReflectionProbeArray.h"
+
+ReflectionProbeArray::ReflectionProbeArray(ID3D12Device* device, const IBLTextureDesc& desc, UINT slices, UINT captureSize)
+	: PreFilteredCubeMap(device, nullptr, desc)
+{
+	mSlices = slices;
+	mCaptureSize = captureSize;
+}
+
+void ReflectionProbeArray::BuildResource() {
+	D3D12_RESOURCE_DESC texDesc;
+	ZeroMemory(&texDesc, sizeof(texDesc));
+	texDesc.Width = mCaptureSize;
+	texDesc.Height = mCaptureSize;
+	texDesc.Format = CaptureFormat();
+	texDesc.DepthOrArraySize = 6;
+	texDesc.MipLevels = 1;
+	texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	texDesc.Alignment = 0;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	texDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+
+	D3D12_CLEAR_VALUE colorClear = { CaptureFormat(), { 0.0f, 0.0f, 0.0f, 1.0f } };
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		&colorClear,
+		IID_PPV_ARGS(mCaptureMap.ReleaseAndGetAddressOf())
+	));
+
+	// One depth buffer, cleared for every face.
+	texDesc.Format = CaptureDepthFormat();
+	texDesc.DepthOrArraySize = 1;
+	texDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
+
+	D3D12_CLEAR_VALUE depthClear;
+	depthClear.Format = CaptureDepthFormat();
+	depthClear.DepthStencil.Depth = 1.0f;
+	depthClear.DepthStencil.Stencil = 0;
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_DEPTH_WRITE,
+		&depthClear,
+		IID_PPV_ARGS(mCaptureDepth.ReleaseAndGetAddressOf())
+	));
+
+	// The capture is the light map the prefilter pass reads.
+	mLightMap = mCaptureMap.Get();
+
+	PreFilteredCubeMap::BuildResource();
+}
+
+void ReflectionProbeArray::BuildDescriptorHeaps() {
+	PreFilteredCubeMap::BuildDescriptorHeaps();
+
+	D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc;
+	rtvHeapDesc.NumDescriptors = 6;
+	rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+	rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+	rtvHeapDesc.NodeMask = 0;
+	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(
+		&rtvHeapDesc, IID_PPV_ARGS(mCaptureRtvHeap.ReleaseAndGetAddressOf())));
+
+	D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc;
+	dsvHeapDesc.NumDescriptors = 1;
+	dsvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
+	dsvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+	dsvHeapDesc.NodeMask = 0;
+	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(
+		&dsvHeapDesc, IID_PPV_ARGS(mCaptureDsvHeap.ReleaseAndGetAddressOf())));
+}
+
+void ReflectionProbeArray::BuildDescriptors() {
+	PreFilteredCubeMap::BuildDescriptors();
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE handle(mCaptureRtvHeap->GetCPUDescriptorHandleForHeapStart());
+	for (UINT i = 0; i < 6; i++) {
+		D3D12_RENDER_TARGET_VIEW_DESC rtvDesc;
+		rtvDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2DARRAY;
+		rtvDesc.Format = CaptureFormat();
+		rtvDesc.Texture2DArray.MipSlice = 0;
+		rtvDesc.Texture2DArray.PlaneSlice = 0;
+		rtvDesc.Texture2DArray.ArraySize = 1;
+		rtvDesc.Texture2DArray.FirstArraySlice = i;
+
+		md3dDevice->CreateRenderTargetView(mCaptureMap.Get(), &rtvDesc, handle);
+		handle.Offset(mRtvDescriptorSize);
+	}
+
+	D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc;
+	dsvDesc.Flags = D3D12_DSV_FLAG_NONE;
+	dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+	dsvDesc.Format = CaptureDepthFormat();
+	dsvDesc.Texture2D.MipSlice = 0;
+	md3dDevice->CreateDepthStencilView(mCaptureDepth.Get(), &dsvDesc, mCaptureDsvHeap->GetCPUDescriptorHandleForHeapStart());
+}
+
+void ReflectionProbeArray::BeginCapture(ID3D12GraphicsCommandList* cmdList) {
+	cmdList->ResourceBarrier(
+		1,
+		&CD3DX12_RESOURCE_BARRIER::Transition(
+			mCaptureMap.Get(),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			D3D12_RESOURCE_STATE_RENDER_TARGET
+		)
+	);
+}
+
+void ReflectionProbeArray::BeginCaptureFace(ID3D12GraphicsCommandList* cmdList, UINT face) {
+	CD3DX12_CPU_DESCRIPTOR_HANDLE rtv(mCaptureRtvHeap->GetCPUDescriptorHandleForHeapStart(), face, mRtvDescriptorSize);
+	D3D12_CPU_DESCRIPTOR_HANDLE dsv = mCaptureDsvHeap->GetCPUDescriptorHandleForHeapStart();
+
+	const float clearColor[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	cmdList->ClearRenderTargetView(rtv, clearColor, 0, nullptr);
+	cmdList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+	cmdList->OMSetRenderTargets(1, &rtv, true, &dsv);
+
+	D3D12_VIEWPORT viewport = { 0.0f, 0.0f, (float)mCaptureSize, (float)mCaptureSize, 0.0f, 1.0f };
+	D3D12_RECT scissorRect = { 0, 0, (LONG)mCaptureSize, (LONG)mCaptureSize };
+	cmdList->RSSetViewports(1, &viewport);
+	cmdList->RSSetScissorRects(1, &scissorRect);
+}
+
+void ReflectionProbeArray::EndCapture(ID3D12GraphicsCommandList* cmdList) {
+	cmdList->ResourceBarrier(
+		1,
+		&CD3DX12_RESOURCE_BARRIER::Transition(
+			mCaptureMap.Get(),
+			D3D12_RESOURCE_STATE_RENDER_TARGET,
+			D3D12_RESOURCE_STATE_GENERIC_READ
+		)
+	);
+}
+
+void ReflectionProbeArray::FilterIntoSlice(ID3D12GraphicsCommandList* cmdList, UINT slice) {
+	for (UINT mip = 0; mip < mMipLevels; mip++) {
+		D3D12_RECT rect = { 0, 0, (LONG)std::max(mWidth >> mip, 1u), (LONG)std::max(mHeight >> mip, 1u) };
+		for (UINT face = 0; face < 6; face++) {
+			BakeRegion(cmdList, slice * 6 + face, mip, rect);
+		}
+	}
+}
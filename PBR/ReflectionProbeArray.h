@@ -0,0 +1,43 @@
+#pragma once
+#include "PreFilteredCubeMap.h"
+
+// GPU storage of the local reflection probes: a TextureCubeArray with one prefiltered
+// cube per slice, plus the HDR cube the scene is rendered into before it is filtered
+// into a slice.
+class ReflectionProbeArray : public PreFilteredCubeMap {
+public:
+	ReflectionProbeArray(ID3D12Device* device, const IBLTextureDesc& desc, UINT slices, UINT captureSize);
+	ReflectionProbeArray(const ReflectionProbeArray& rhs) = delete;
+	ReflectionProbeArray& operator=(const ReflectionProbeArray& rhs) = delete;
+	virtual ~ReflectionProbeArray() = default;
+
+	virtual UINT FaceCount()const override { return 6 * mSlices; }
+	UINT Slices()const { return mSlices; }
+
+	UINT CaptureSize()const { return mCaptureSize; }
+	DXGI_FORMAT CaptureFormat()const { return DXGI_FORMAT_R16G16B16A16_FLOAT; }
+	DXGI_FORMAT CaptureDepthFormat()const { return DXGI_FORMAT_D32_FLOAT; }
+
+	// Capture protocol: BeginCapture, then BeginCaptureFace and the scene draws for
+	// each of the six faces, then EndCapture and FilterIntoSlice.
+	void BeginCapture(ID3D12GraphicsCommandList* cmdList);
+	// Binds and clears the face's render target and depth buffer and sets the viewport.
+	void BeginCaptureFace(ID3D12GraphicsCommandList* cmdList, UINT face);
+	void EndCapture(ID3D12GraphicsCommandList* cmdList);
+	// Prefilters the capture into every mip of the slice.
+	void FilterIntoSlice(ID3D12GraphicsCommandList* cmdList, UINT slice);
+
+protected:
+	virtual void BuildResource()override;
+	virtual void BuildDescriptorHeaps()override;
+	virtual void BuildDescriptors()override;
+
+protected:
+	UINT mSlices;
+	UINT mCaptureSize;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCaptureMap = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCaptureDepth = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mCaptureRtvHeap = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mCaptureDsvHeap = nullptr;
+};
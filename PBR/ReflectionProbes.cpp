@@ -0,0 +1,271 @@
+#include "ReflectionProbes.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	// Cells per axis of the selection grid; the cell size grows when exceeded.
+	const uint32_t kMaxGridDim = 128;
+
+	float DistanceSq(const float a[3], const float b[3]) {
+		float dx = a[0] - b[0];
+		float dy = a[1] - b[1];
+		float dz = a[2] - b[2];
+		return dx * dx + dy * dy + dz * dz;
+	}
+
+	bool Overlaps(const ProbeBox& a, const ProbeBox& b) {
+		for (int i = 0; i < 3; i++) {
+			if (a.Max[i] < b.Min[i] || b.Max[i] < a.Min[i]) {
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+ReflectionProbeSet::ReflectionProbeSet(uint32_t sliceCapacity) {
+	mSliceOwner.assign(sliceCapacity, kNoProbe);
+}
+
+uint32_t ReflectionProbeSet::AddProbe(const float position[3], const ProbeBox& influence, float blendDistance) {
+	ReflectionProbe probe;
+	for (int i = 0; i < 3; i++) {
+		probe.Position[i] = position[i];
+	}
+	probe.Influence = influence;
+	probe.BlendDistance = blendDistance;
+	mProbes.push_back(probe);
+	return (uint32_t)mProbes.size() - 1;
+}
+
+void ReflectionProbeSet::BuildSpatialIndex(float cellSize) {
+	mCellStart.clear();
+	mCellProbes.clear();
+	if (mProbes.empty()) {
+		mGridDim[0] = mGridDim[1] = mGridDim[2] = 0;
+		return;
+	}
+
+	ProbeBox bounds = mProbes[0].Influence;
+	for (const ReflectionProbe& probe : mProbes) {
+		for (int i = 0; i < 3; i++) {
+			bounds.Min[i] = std::min(bounds.Min[i], probe.Influence.Min[i]);
+			bounds.Max[i] = std::max(bounds.Max[i], probe.Influence.Max[i]);
+		}
+	}
+
+	float largestExtent = 0.0f;
+	for (int i = 0; i < 3; i++) {
+		largestExtent = std::max(largestExtent, bounds.Max[i] - bounds.Min[i]);
+	}
+	cellSize = std::max(cellSize, largestExtent / kMaxGridDim);
+	cellSize = std::max(cellSize, 1e-4f);
+
+	mInvCellSize = 1.0f / cellSize;
+	for (int i = 0; i < 3; i++) {
+		mGridMin[i] = bounds.Min[i];
+		mGridDim[i] = std::min(kMaxGridDim, (uint32_t)((bounds.Max[i] - bounds.Min[i]) * mInvCellSize) + 1);
+	}
+
+	auto cellRange = [&](const ProbeBox& box, uint32_t lo[3], uint32_t hi[3]) {
+		for (int i = 0; i < 3; i++) {
+			lo[i] = std::min((uint32_t)((box.Min[i] - mGridMin[i]) * mInvCellSize), mGridDim[i] - 1);
+			hi[i] = std::min((uint32_t)((box.Max[i] - mGridMin[i]) * mInvCellSize), mGridDim[i] - 1);
+		}
+	};
+
+	// Count, prefix sum, then scatter, so every cell's probes are contiguous.
+	size_t cellCount = (size_t)mGridDim[0] * mGridDim[1] * mGridDim[2];
+	mCellStart.assign(cellCount + 1, 0);
+	for (const ReflectionProbe& probe : mProbes) {
+		uint32_t lo[3], hi[3];
+		cellRange(probe.Influence, lo, hi);
+		for (uint32_t z = lo[2]; z <= hi[2]; z++) {
+			for (uint32_t y = lo[1]; y <= hi[1]; y++) {
+				for (uint32_t x = lo[0]; x <= hi[0]; x++) {
+					mCellStart[((size_t)z * mGridDim[1] + y) * mGridDim[0] + x + 1]++;
+				}
+			}
+		}
+	}
+	for (size_t c = 0; c < cellCount; c++) {
+		mCellStart[c + 1] += mCellStart[c];
+	}
+
+	mCellProbes.resize(mCellStart[cellCount]);
+	std::vector<uint32_t> cursor(mCellStart.begin(), mCellStart.end() - 1);
+	for (uint32_t p = 0; p < mProbes.size(); p++) {
+		uint32_t lo[3], hi[3];
+		cellRange(mProbes[p].Influence, lo, hi);
+		for (uint32_t z = lo[2]; z <= hi[2]; z++) {
+			for (uint32_t y = lo[1]; y <= hi[1]; y++) {
+				for (uint32_t x = lo[0]; x <= hi[0]; x++) {
+					mCellProbes[cursor[((size_t)z * mGridDim[1] + y) * mGridDim[0] + x]++] = p;
+				}
+			}
+		}
+	}
+}
+
+float ReflectionProbeSet::Weight(const ReflectionProbe& probe, const float point[3])const {
+	float inset = INFINITY;
+	for (int i = 0; i < 3; i++) {
+		inset = std::min(inset, std::min(point[i] - probe.Influence.Min[i], probe.Influence.Max[i] - point[i]));
+	}
+	if (inset < 0.0f) {
+		return 0.0f;
+	}
+	if (probe.BlendDistance <= 0.0f) {
+		return 1.0f;
+	}
+	return std::min(inset / probe.BlendDistance, 1.0f);
+}
+
+ProbeSelection ReflectionProbeSet::Select(const float point[3])const {
+	ProbeSelection selection;
+	if (mCellStart.empty()) {
+		return selection;
+	}
+
+	size_t cell = 0;
+	size_t stride = 1;
+	for (int i = 0; i < 3; i++) {
+		float coord = (point[i] - mGridMin[i]) * mInvCellSize;
+		if (coord < 0.0f || coord >= mGridDim[i]) {
+			return selection;
+		}
+		cell += (size_t)coord * stride;
+		stride *= mGridDim[i];
+	}
+
+	float bestDistance[2] = { INFINITY, INFINITY };
+	for (uint32_t i = mCellStart[cell]; i < mCellStart[cell + 1]; i++) {
+		uint32_t p = mCellProbes[i];
+		const ReflectionProbe& probe = mProbes[p];
+		if (!probe.Baked) {
+			continue;
+		}
+
+		float weight = Weight(probe, point);
+		if (weight <= 0.0f) {
+			continue;
+		}
+
+		// Higher weight wins; on ties the probe captured closer to the point does.
+		float distance = DistanceSq(probe.Position, point);
+		for (int slot = 0; slot < 2; slot++) {
+			bool better = weight > selection.Weight[slot] ||
+				(weight == selection.Weight[slot] && distance < bestDistance[slot]);
+			if (better) {
+				if (slot == 0) {
+					selection.Probe[1] = selection.Probe[0];
+					selection.Weight[1] = selection.Weight[0];
+					bestDistance[1] = bestDistance[0];
+				}
+				selection.Probe[slot] = p;
+				selection.Weight[slot] = weight;
+				bestDistance[slot] = distance;
+				break;
+			}
+		}
+	}
+
+	float total = selection.Weight[0] + selection.Weight[1];
+	if (total > 1.0f) {
+		selection.Weight[0] /= total;
+		selection.Weight[1] /= total;
+	}
+	return selection;
+}
+
+void ReflectionProbeSet::MarkDirty(uint32_t probe, float amount) {
+	mProbes[probe].Dirtiness += amount;
+}
+
+void ReflectionProbeSet::MarkDirtyInBox(const ProbeBox& box, float amount) {
+	for (ReflectionProbe& probe : mProbes) {
+		if (Overlaps(probe.Influence, box)) {
+			probe.Dirtiness += amount;
+		}
+	}
+}
+
+void ReflectionProbeSet::MarkAllDirty(float amount) {
+	for (ReflectionProbe& probe : mProbes) {
+		probe.Dirtiness += amount;
+	}
+}
+
+void ReflectionProbeSet::ScheduleRebakes(const float camera[3], uint32_t maxBakes, float distanceScale, std::vector<uint32_t>& out) {
+	if (maxBakes == 0 || mSliceOwner.empty()) {
+		return;
+	}
+
+	float invScaleSq = 1.0f / std::max(distanceScale * distanceScale, 1e-8f);
+	mCandidates.clear();
+	for (uint32_t p = 0; p < mProbes.size(); p++) {
+		const ReflectionProbe& probe = mProbes[p];
+		if (probe.Dirtiness > 0.0f) {
+			float priority = probe.Dirtiness / (1.0f + DistanceSq(probe.Position, camera) * invScaleSq);
+			mCandidates.push_back(std::make_pair(priority, p));
+		}
+	}
+
+	// Only the head of the list is needed; a few spares cover candidates that lose
+	// the fight for a slice.
+	size_t considered = std::min(mCandidates.size(), (size_t)maxBakes * 4 + 4);
+	std::partial_sort(mCandidates.begin(), mCandidates.begin() + considered, mCandidates.end(),
+		[](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) {
+			return a.first > b.first || (a.first == b.first && a.second < b.second);
+		});
+
+	size_t firstScheduled = out.size();
+	for (size_t i = 0; i < considered && out.size() - firstScheduled < maxBakes; i++) {
+		uint32_t p = mCandidates[i].second;
+		if (mProbes[p].Slice != kNoProbe ||
+			AcquireSlice(p, camera, out.data() + firstScheduled, out.size() - firstScheduled)) {
+			out.push_back(p);
+		}
+	}
+}
+
+bool ReflectionProbeSet::AcquireSlice(uint32_t probe, const float camera[3], const uint32_t* scheduled, size_t scheduledCount) {
+	uint32_t slice = kNoProbe;
+	float victimDistance = DistanceSq(mProbes[probe].Position, camera);
+	for (uint32_t s = 0; s < mSliceOwner.size(); s++) {
+		uint32_t owner = mSliceOwner[s];
+		if (owner == kNoProbe) {
+			slice = s;
+			break;
+		}
+		// Never steal the slice of a probe that bakes this frame.
+		if (std::find(scheduled, scheduled + scheduledCount, owner) != scheduled + scheduledCount) {
+			continue;
+		}
+		float distance = DistanceSq(mProbes[owner].Position, camera);
+		if (distance > victimDistance) {
+			victimDistance = distance;
+			slice = s;
+		}
+	}
+	if (slice == kNoProbe) {
+		return false;
+	}
+
+	uint32_t evicted = mSliceOwner[slice];
+	if (evicted != kNoProbe) {
+		ReflectionProbe& old = mProbes[evicted];
+		old.Slice = kNoProbe;
+		old.Baked = false;
+		old.Dirtiness = std::max(old.Dirtiness, 1.0f);
+	}
+
+	mSliceOwner[slice] = probe;
+	mProbes[probe].Slice = slice;
+	return true;
+}
+
+void ReflectionProbeSet::MarkBaked(uint32_t probe) {
+	mProbes[probe].Dirtiness = 0.0f;
+	mProbes[probe].Baked = true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+const uint32_t kNoProbe = 0xffffffff;
+
+struct ProbeBox {
+	float Min[3];
+	float Max[3];
+};
+
+struct ReflectionProbe {
+	// Capture point of the cube map.
+	float Position[3];
+	// Objects inside the box use the probe; its weight fades to zero over
+	// BlendDistance towards the faces of the box.
+	ProbeBox Influence;
+	float BlendDistance;
+
+	// How stale the baked result is; 0 means up to date.
+	float Dirtiness = 1.0f;
+	// Cube array slice holding the prefiltered result, kNoProbe if not resident.
+	uint32_t Slice = kNoProbe;
+	bool Baked = false;
+};
+
+// Up to two probes affecting a point.  Whatever weight is left over goes to the
+// global environment.
+struct ProbeSelection {
+	uint32_t Probe[2] = { kNoProbe, kNoProbe };
+	float Weight[2] = { 0.0f, 0.0f };
+
+	bool operator==(const ProbeSelection& rhs)const {
+		return Probe[0] == rhs.Probe[0] && Probe[1] == rhs.Probe[1] &&
+			Weight[0] == rhs.Weight[0] && Weight[1] == rhs.Weight[1];
+	}
+	bool operator!=(const ProbeSelection& rhs)const { return !(*this == rhs); }
+};
+
+// CPU side of the local reflection probes: placement, per-object selection through a
+// uniform grid, and which probes to rebake next.  Only sliceCapacity probes can be
+// resident in the GPU cube array at once; the rest are baked on demand.
+class ReflectionProbeSet {
+public:
+	explicit ReflectionProbeSet(uint32_t sliceCapacity = 0);
+
+	uint32_t AddProbe(const float position[3], const ProbeBox& influence, float blendDistance);
+	uint32_t ProbeCount()const { return (uint32_t)mProbes.size(); }
+	uint32_t SliceCapacity()const { return (uint32_t)mSliceOwner.size(); }
+	const ReflectionProbe& Probe(uint32_t probe)const { return mProbes[probe]; }
+
+	// Rebuilds the grid used by Select.  Call after adding or moving probes.
+	void BuildSpatialIndex(float cellSize);
+
+	// Picks the two baked probes with the largest influence at point.
+	ProbeSelection Select(const float point[3])const;
+
+	void MarkDirty(uint32_t probe, float amount = 1.0f);
+	// Marks every probe whose influence overlaps box, e.g. around an object that moved.
+	void MarkDirtyInBox(const ProbeBox& box, float amount = 1.0f);
+	void MarkAllDirty(float amount = 1.0f);
+
+	// Appends up to maxBakes dirty probes to out, most urgent first.  Urgency is
+	// dirtiness / (1 + (distance / distanceScale)^2).  Probes without a slice get one,
+	// evicting the resident probe farthest from the camera if it is farther away
+	// than the candidate.
+	void ScheduleRebakes(const float camera[3], uint32_t maxBakes, float distanceScale, std::vector<uint32_t>& out);
+
+	// Call once the bake of a scheduled probe has been recorded.
+	void MarkBaked(uint32_t probe);
+
+private:
+	float Weight(const ReflectionProbe& probe, const float point[3])const;
+	bool AcquireSlice(uint32_t probe, const float camera[3], const uint32_t* scheduled, size_t scheduledCount);
+
+private:
+	std::vector<ReflectionProbe> mProbes;
+	std::vector<uint32_t> mSliceOwner;
+
+	float mGridMin[3] = { 0.0f, 0.0f, 0.0f };
+	float mInvCellSize = 1.0f;
+	uint32_t mGridDim[3] = { 0, 0, 0 };
+	// Probes of cell c are mCellProbes[mCellStart[c], mCellStart[c + 1]).
+	std::vector<uint32_t> mCellStart;
+	std::vector<uint32_t> mCellProbes;
+
+	std::vector<std::pair<float, uint32_t>> mCandidates;
+};
@@ -1,9 +1,32 @@
 #include "RenderTexture.h"
+#include "CubeMapImage.h"
+#include "OctahedralMap.h"
+#include <algorithm>
+#include <cstdio>
 
-RenderTexture::RenderTexture(ID3D12Device* device, UINT width, UINT height, DXGI_FORMAT format) {
+namespace {
+	const char* FormatName(DXGI_FORMAT format) {
+		switch (format) {
+		case DXGI_FORMAT_R8G8B8A8_UNORM: return "R8G8B8A8_UNORM";
+		case DXGI_FORMAT_R16G16B16A16_FLOAT: return "R16G16B16A16_FLOAT";
+		case DXGI_FORMAT_R11G11B10_FLOAT: return "R11G11B10_FLOAT";
+		case DXGI_FORMAT_R9G9B9E5_SHAREDEXP: return "R9G9B9E5_SHAREDEXP";
+		case DXGI_FORMAT_R32G32_FLOAT: return "R32G32_FLOAT";
+		case DXGI_FORMAT_R16G16_FLOAT: return "R16G16_FLOAT";
+		default: return "UNKNOWN";
+		}
+	}
+}
+
+UINT IBLTextureExtent(const IBLTextureDesc& desc) {
+	return desc.Layout == EnvMapLayout::Octahedral ? OctahedralSizeForCube(desc.Size) : desc.Size;
+}
+
+RenderTexture::RenderTexture(ID3D12Device* device, UINT width, UINT height, UINT mipLevels, DXGI_FORMAT format) {
 	md3dDevice = device;
 	mWidth = width;
 	mHeight = height;
+	mMipLevels = mipLevels;
 	mFormat = format;
 
 	mViewport = { 0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f };
@@ -16,6 +39,7 @@ RenderTexture::RenderTexture(ID3D12Device* device, UINT width, UINT height, DXGI
 }
 
 void RenderTexture::Initialize() {
+	ValidateFormat();
 	BuildResource();
 	BuildDescriptorHeaps();
 	BuildDescriptors();
@@ -28,41 +52,84 @@ ID3D12Resource* RenderTexture::Resource() {
 	return mTextureMap.Get();
 }
 
-void RenderTexture::BuildFaceConstant() {
-	float x = 0, y = 0, z = 0;
+UINT64 RenderTexture::MemorySize() {
+	D3D12_RESOURCE_DESC desc = mTextureMap->GetDesc();
+	return md3dDevice->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+}
 
-	DirectX::XMFLOAT3 targets[6] =
-	{
-		DirectX::XMFLOAT3(x + 1.0f, y, z), // +X
-		DirectX::XMFLOAT3(x - 1.0f, y, z), // -X
-		DirectX::XMFLOAT3(x, y + 1.0f, z), // +Y
-		DirectX::XMFLOAT3(x, y - 1.0f, z), // -Y
-		DirectX::XMFLOAT3(x, y, z + 1.0f), // +Z
-		DirectX::XMFLOAT3(x, y, z - 1.0f)  // -Z
-	};
+std::string RenderTexture::Describe(const std::string& name) {
+	D3D12_RESOURCE_DESC desc = mTextureMap->GetDesc();
+
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "%s: %ux%ux%u, %u mips, %s, %.2f MB, baked in %.2f ms\n",
+		name.c_str(), (UINT)desc.Width, desc.Height, desc.DepthOrArraySize, desc.MipLevels,
+		FormatName(desc.Format), MemorySize() / (1024.0 * 1024.0), BakeTimeMs);
+	return buffer;
+}
+
+D3D12_VIEWPORT RenderTexture::MipViewport(UINT mip)const {
+	D3D12_VIEWPORT viewport = mViewport;
+	viewport.Width = (float)std::max(mWidth >> mip, 1u);
+	viewport.Height = (float)std::max(mHeight >> mip, 1u);
+	return viewport;
+}
 
-	// Use world up vector (0,1,0) for all directions except +Y/-Y.  In these cases, we
-	// are looking down +Y or -Y, so we need a different "up" vector.
-	DirectX::XMFLOAT3 ups[6] =
+CD3DX12_CPU_DESCRIPTOR_HANDLE RenderTexture::RtvHandle(UINT face, UINT mip)const {
+	return CD3DX12_CPU_DESCRIPTOR_HANDLE(
+		mRtvHeap->GetCPUDescriptorHandleForHeapStart(),
+		mip * FaceCount() + face,
+		mRtvDescriptorSize);
+}
+
+void RenderTexture::TransitionForBake(ID3D12GraphicsCommandList* cmdList, UINT face, UINT mip, bool toRenderTarget) {
+	UINT subresource = D3D12CalcSubresource(mip, face, 0, mMipLevels, FaceCount());
+	D3D12_RESOURCE_STATES readState = D3D12_RESOURCE_STATE_GENERIC_READ;
+	D3D12_RESOURCE_STATES writeState = D3D12_RESOURCE_STATE_RENDER_TARGET;
+
+	cmdList->ResourceBarrier(
+		1,
+		&CD3DX12_RESOURCE_BARRIER::Transition(
+			mTextureMap.Get(),
+			toRenderTarget ? readState : writeState,
+			toRenderTarget ? writeState : readState,
+			subresource
+		)
+	);
+}
+
+void RenderTexture::ValidateFormat() {
+	D3D12_FEATURE_DATA_FORMAT_SUPPORT support = { mFormat };
+	ThrowIfFailed(md3dDevice->CheckFeatureSupport(D3D12_FEATURE_FORMAT_SUPPORT, &support, sizeof(support)));
+
+	// Shared exponent formats such as RGB9E5 can be sampled but never rendered to,
+	// so the GPU bakers have to store those outputs as half floats.
+	if ((support.Support1 & D3D12_FORMAT_SUPPORT1_RENDER_TARGET) == 0) {
+		std::string msg = std::string(FormatName(mFormat)) + " is not renderable, baking to R16G16B16A16_FLOAT instead\n";
+		::OutputDebugStringA(msg.c_str());
+		mFormat = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	}
+}
+
+const D3D_SHADER_MACRO* RenderTexture::LayoutDefines()const {
+	static const D3D_SHADER_MACRO octahedralDefines[] =
 	{
-		DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f),  // +X
-		DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f),  // -X
-		DirectX::XMFLOAT3(0.0f, 0.0f, -1.0f), // +Y
-		DirectX::XMFLOAT3(0.0f, 0.0f, +1.0f), // -Y
-		DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f),	 // +Z
-		DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f)	 // -Z
+		"OCTAHEDRAL", "1",
+		NULL, NULL
 	};
+	return mLayout == EnvMapLayout::Octahedral ? octahedralDefines : nullptr;
+}
 
-
+void RenderTexture::BuildFaceConstant() {
 	faceCB = std::make_unique<UploadBuffer<FaceConstants>>(md3dDevice, 6, true);
 
+	// The basis is shared with the CPU cube map code, see CubeMapImage.h.
 	for (int i = 0; i < 6; i++) {
+		const CubeFaceBasis& basis = gCubeFaceBasis[i];
+
 		FaceConstants fc;
-		fc.LookAt = targets[i];
-		fc.Up = ups[i];
-		DirectX::XMVECTOR lookAt = DirectX::XMLoadFloat3(&fc.LookAt);
-		DirectX::XMVECTOR up = DirectX::XMLoadFloat3(&fc.Up);
-		DirectX::XMStoreFloat3(&fc.Right, DirectX::XMVector3Cross(up, lookAt));
+		fc.LookAt = DirectX::XMFLOAT3(basis.LookAt);
+		fc.Up = DirectX::XMFLOAT3(basis.Up);
+		fc.Right = DirectX::XMFLOAT3(basis.Right);
 		faceCB->CopyData(i, fc);
 	}
 }
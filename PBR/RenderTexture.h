@@ -21,17 +21,57 @@ struct FaceConstants {
 	float padding2;
 };
 
+// How an environment product is stored on the GPU.
+enum class EnvMapLayout {
+	// Six-face TextureCube.
+	Cube,
+	// One Texture2D with the sphere folded onto an octahedron, see OctahedralMap.h.
+	Octahedral
+};
+
+// Resolution, mip count and storage format of one baked IBL product.  Size is the
+// cube face size; octahedral maps get the matching OctahedralSizeForCube side.
+struct IBLTextureDesc {
+	UINT Size;
+	UINT MipLevels;
+	DXGI_FORMAT Format;
+	EnvMapLayout Layout = EnvMapLayout::Cube;
+};
+
+// Width and height of the texture described by desc.
+UINT IBLTextureExtent(const IBLTextureDesc& desc);
+
 class RenderTexture{
 public:
-	RenderTexture(ID3D12Device* device, UINT width, UINT height, DXGI_FORMAT format);
+	RenderTexture(ID3D12Device* device, UINT width, UINT height, UINT mipLevels, DXGI_FORMAT format);
 	RenderTexture(const RenderTexture& rhs) = delete;
 	RenderTexture& operator=(const RenderTexture& rhs) = delete;
 	virtual ~RenderTexture() = default;
 
 	ID3D12Resource* Resource();
 
+	// Bytes the texture occupies in video memory, as reported by the device.
+	UINT64 MemorySize();
+	UINT MipLevels()const { return mMipLevels; }
+	DXGI_FORMAT Format()const { return mFormat; }
+
+	// Number of array slices baked per mip: 6 for cube maps, 1 for 2D targets.
+	virtual UINT FaceCount()const { return mLayout == EnvMapLayout::Octahedral ? 1 : 6; }
+	EnvMapLayout Layout()const { return mLayout; }
+	UINT Size()const { return mWidth; }
+
+	// Wall time of the last bake, filled in by whoever submits the bake.
+	float BakeTimeMs = 0.0f;
+
+	// One line summary of the configuration, memory and bake time for the log.
+	std::string Describe(const std::string& name);
+
 	virtual void OnResize(UINT newWidth, UINT newHeight) = 0;
-	virtual void BakeTexture(ID3D12GraphicsCommandList* cmdList) = 0;
+
+	// Records the draw that bakes rect of one face and mip into an open command list.
+	// Sets its own pipeline state, root signature and descriptor heaps, so the caller
+	// has to rebind its own afterwards.
+	virtual void BakeRegion(ID3D12GraphicsCommandList* cmdList, UINT face, UINT mip, const D3D12_RECT& rect) = 0;
 
 	UINT srvHeapIndex = 0;
 
@@ -45,6 +85,20 @@ protected:
 	virtual void BuildDescriptors() = 0;
 	virtual void BuildFaceConstant();
 
+	// Falls back to a renderable HDR format when mFormat cannot be a render target.
+	void ValidateFormat();
+
+	// Shader defines that select the layout in the bake shaders: OCTAHEDRAL for
+	// octahedral targets, nothing for cubes.
+	const D3D_SHADER_MACRO* LayoutDefines()const;
+
+	// Full mip sized viewport; tiles are selected with the scissor rect.
+	D3D12_VIEWPORT MipViewport(UINT mip)const;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE RtvHandle(UINT face, UINT mip)const;
+
+	// Moves one subresource between GENERIC_READ and RENDER_TARGET around a region bake.
+	void TransitionForBake(ID3D12GraphicsCommandList* cmdList, UINT face, UINT mip, bool toRenderTarget);
+
 protected:
 	ID3D12Device* md3dDevice = nullptr;
 
@@ -53,7 +107,9 @@ protected:
 	
 	UINT mWidth;
 	UINT mHeight;
+	UINT mMipLevels = 1;
 	DXGI_FORMAT mFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
+	EnvMapLayout mLayout = EnvMapLayout::Cube;
 
 	UINT mRtvDescriptorSize;
 	UINT mDsvDescriptorSize;
@@ -66,7 +122,6 @@ protected:
 	Microsoft::WRL::ComPtr<ID3DBlob> mPixelShader;
 
 	Microsoft::WRL::ComPtr<ID3D12PipelineState> mPSO;
-	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> cmdListAlloc;
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
 
 
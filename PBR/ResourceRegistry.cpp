@@ -0,0 +1,17 @@
+#include "ResourceRegistry.h"
+
+using Microsoft::WRL::ComPtr;
+
+ResourceRegistry::Entry* ResourceRegistry::Add(const ContentHash& hash, ComPtr<ID3D12Resource> resource) {
+	D3D12_RESOURCE_DESC desc = resource->GetDesc();
+	uint64_t bytes = mDevice->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+	return mTable.Add(hash, std::move(resource), bytes);
+}
+
+void ResourceRegistry::Release(const ContentHash& hash, uint64_t fence, BindlessDescriptorHeap* heap) {
+	Entry* entry = mTable.Find(hash);
+	uint32_t srvIndex = entry ? entry->SrvIndex : kNoDescriptor;
+	if (mTable.Release(hash, fence) && heap && srvIndex != kNoDescriptor) {
+		heap->FreePersistent(srvIndex, fence);
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "BindlessDescriptorHeap.h"
+#include "SharedResourceTable.h"
+
+// Shares GPU resources, and the SRV of textures, between assets whose decoded
+// content hashes the same, whatever their names or paths.  Every user holds a
+// reference; the last Release retires the resource and its descriptor until the GPU
+// has passed the given fence.  The counting is a SharedResourceTable.  Render thread
+// only.
+class ResourceRegistry {
+public:
+	using Entry = SharedResourceTable<Microsoft::WRL::ComPtr<ID3D12Resource>>::Entry;
+
+	explicit ResourceRegistry(ID3D12Device* device) : mDevice(device) {}
+	ResourceRegistry(const ResourceRegistry& rhs) = delete;
+	ResourceRegistry& operator=(const ResourceRegistry& rhs) = delete;
+
+	// Takes a reference to the resource with this content, or returns nullptr when
+	// there is none yet and the caller has to create it and Add it.
+	Entry* Acquire(const ContentHash& hash) { return mTable.Acquire(hash); }
+	// Registers a new resource with one reference.
+	Entry* Add(const ContentHash& hash, Microsoft::WRL::ComPtr<ID3D12Resource> resource);
+	// The entry without taking a reference, or nullptr.
+	Entry* Find(const ContentHash& hash) { return mTable.Find(hash); }
+
+	// Drops a reference.  The last one keeps the resource alive, and frees its SRV
+	// in heap, once the GPU passes fence.
+	void Release(const ContentHash& hash, uint64_t fence, BindlessDescriptorHeap* heap);
+	// Destroys the retired resources whose fence is at most completedFence.
+	void Collect(uint64_t completedFence) { mTable.Collect(completedFence); }
+
+	SharedResourceStats Stats()const { return mTable.Stats(); }
+
+private:
+	ID3D12Device* mDevice;
+	SharedResourceTable<Microsoft::WRL::ComPtr<ID3D12Resource>> mTable;
+};
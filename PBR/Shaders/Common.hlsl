@@ -29,21 +29,29 @@ struct MaterialData
     float roughness;
     float ao;
     int albedoMapIndex;
-    int metallicMapIndex;
+    // Occlusion, roughness and metallic in r, g and b.
+    int ormMapIndex;
 
-    int roughnessMapIndex;
-    int aoMapIndex;
     int normalMapIndex;
     float padding;
 };
 
 TextureCube gCubeMap : register(t0);
+#ifdef IBL_OCTAHEDRAL
+#include "Octahedral.hlsl"
+Texture2D gIrradianceMap : register(t1);
+Texture2D gPrefilterdMap : register(t2);
+#else
 TextureCube gIrradianceMap : register(t1);
 TextureCube gPrefilterdMap : register(t2);
+#endif
 Texture2D gLUTMap : register(t3);
-Texture2D gTextureMaps[20] : register(t4);
+Texture2D gTextureMaps[] : register(t4);
+TextureCubeArray gProbeMaps : register(t0, space2);
 
 StructuredBuffer<MaterialData> gMaterialData : register(t0, space1);
+// Nine float4 L2 SH coefficients of irradiance / pi per probe, x fastest.
+StructuredBuffer<float4> gIrradianceVolume : register(t1, space1);
 
 SamplerState gsamPointWrap        : register(s0);
 SamplerState gsamPointClamp       : register(s1);
@@ -52,6 +60,27 @@ SamplerState gsamLinearClamp      : register(s3);
 SamplerState gsamAnisotropicWrap  : register(s4);
 SamplerState gsamAnisotropicClamp : register(s5);
 
+// The irradiance and prefiltered maps are either cubes or octahedral maps.  The
+// octahedral ones are clamped at the border: the texels across a fold are
+// neighbours on the sphere, so this is off by at most half a texel.
+float3 SampleIrradianceMap(float3 dir)
+{
+#ifdef IBL_OCTAHEDRAL
+    return gIrradianceMap.SampleLevel(gsamLinearClamp, OctEncode(dir), 0.0f).rgb;
+#else
+    return gIrradianceMap.Sample(gsamLinearWrap, dir).rgb;
+#endif
+}
+
+float3 SamplePrefilteredMap(float3 dir, float lod)
+{
+#ifdef IBL_OCTAHEDRAL
+    return gPrefilterdMap.SampleLevel(gsamLinearClamp, OctEncode(dir), lod).rgb;
+#else
+    return gPrefilterdMap.SampleLevel(gsamLinearWrap, dir, lod).rgb;
+#endif
+}
+
 // Constant data that varies per frame.
 cbuffer cbPerObject : register(b0)
 {
@@ -59,9 +88,13 @@ cbuffer cbPerObject : register(b0)
     float4x4 gInvTransWorld;
 	float4x4 gTexTransform;
 	uint gMaterialIndex;
+	uint gProbeSlice0;
+	uint gProbeSlice1;
 	uint gObjPad0;
-	uint gObjPad1;
-	uint gObjPad2;
+	float gProbeWeight0;
+	float gProbeWeight1;
+	float gObjPad1;
+	float gObjPad2;
 };
 
 // Constant data that varies per material.
@@ -83,6 +116,26 @@ cbuffer cbPass : register(b1)
     float gDeltaTime;
     float4 gAmbientLight;
 
+    // Progressive IBL bake state, see PassConstants.
+    float gPrefilteredMinMip;
+    uint gIBLReadyMask;
+    uint gProbeMipLevels;
+    float gIBLPad;
+    float4 gAmbientSH[9];
+
+    // SH irradiance volume, see PassConstants.
+    float3 gVolumeMin;
+    uint gVolumeEnabled;
+    float3 gVolumeInvCellSize;
+    float gVolumePad0;
+    uint3 gVolumeDim;
+    float gVolumePad1;
+
+    // Light counts, see PassConstants.
+    uint gNumDirLights;
+    uint gNumPointLights;
+    float2 gLightPad;
+
     // Indices [0, NUM_DIR_LIGHTS) are directional lights;
     // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
     // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
@@ -0,0 +1,24 @@
+// Octahedral environment layout, the same mapping as OctahedralMap.h on the CPU:
+// +Y in the center of the map, -Y in the corners, u along +X and v along +Z.
+
+float2 OctEncode(float3 dir)
+{
+    float3 p = dir / (abs(dir.x) + abs(dir.y) + abs(dir.z));
+    float2 uv = p.xz;
+    if (p.y < 0)
+    {
+        uv = (1 - abs(p.zx)) * (p.xz >= 0 ? 1 : -1);
+    }
+    return uv * 0.5f + 0.5f;
+}
+
+float3 OctDecode(float2 uv)
+{
+    float2 p = uv * 2 - 1;
+    float3 dir = float3(p.x, 1 - abs(p.x) - abs(p.y), p.y);
+    if (dir.y < 0)
+    {
+        dir.xz = (1 - abs(p.yx)) * (p >= 0 ? 1 : -1);
+    }
+    return normalize(dir);
+}
@@ -33,9 +33,13 @@ float GeometrySmith(float3 N, float3 V, float3 L, float k)
     return ggx1 * ggx2;
 }
 
-float3 TangentNormalToWorld(float3 sampledNormal, float3 unitTangent, float3 unitNormalW)
+// Only XY of the sampled normal is used and Z is rebuilt, so BC5 normal maps, which
+// keep two channels, work like RGBA ones.
+float3 TangentNormalToWorld(float2 sampledXY, float3 unitTangent, float3 unitNormalW)
 {
-    float3 localNormal = sampledNormal * 2.0 - 1.0;
+    float3 localNormal;
+    localNormal.xy = sampledXY * 2.0 - 1.0;
+    localNormal.z = sqrt(saturate(1.0 - dot(localNormal.xy, localNormal.xy)));
 
     float3 N = unitNormalW;
     float3 T = normalize(unitTangent - dot(unitTangent, unitNormalW) * N);
@@ -55,6 +59,93 @@ float3 fresnelSchlickRoughness(float cosTheta, float3 f0, float roughness)
     return f0 + (temp - f0) * pow(1.0 - cosTheta, 5.0);
 }
 
+// The nine real L2 SH basis functions, in the order of SphericalHarmonics.h.
+void SHBasis9(float3 n, out float basis[9])
+{
+    basis[0] = 0.282095;
+    basis[1] = 0.488603 * n.y;
+    basis[2] = 0.488603 * n.z;
+    basis[3] = 0.488603 * n.x;
+    basis[4] = 1.092548 * n.x * n.y;
+    basis[5] = 1.092548 * n.y * n.z;
+    basis[6] = 0.315392 * (3 * n.z * n.z - 1);
+    basis[7] = 1.092548 * n.x * n.z;
+    basis[8] = 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
+// Diffuse irradiance (divided by pi, like gIrradianceMap) from the SH fallback.
+float3 EvaluateAmbientSH(float3 n)
+{
+    float basis[9];
+    SHBasis9(n, basis);
+    float3 result = 0;
+    for (uint i = 0; i < 9; i++)
+    {
+        result += gAmbientSH[i].rgb * basis[i];
+    }
+    return max(result, 0);
+}
+
+// Irradiance (divided by pi) from the volume: the eight probes around posW blended
+// trilinearly, evaluated along n.  Outside the volume the border probes are used.
+float3 SampleIrradianceVolume(float3 posW, float3 n)
+{
+    float3 coord = clamp((posW - gVolumeMin) * gVolumeInvCellSize, 0, float3(gVolumeDim - 1));
+    uint3 base = min(uint3(coord), gVolumeDim - 2);
+    float3 f = coord - base;
+
+    float basis[9];
+    SHBasis9(n, basis);
+
+    float3 result = 0;
+    for (uint corner = 0; corner < 8; corner++)
+    {
+        uint3 offset = uint3(corner & 1, (corner >> 1) & 1, corner >> 2);
+        float3 w = lerp(1 - f, f, float3(offset));
+        uint3 p = base + offset;
+        uint first = ((p.z * gVolumeDim.y + p.y) * gVolumeDim.x + p.x) * 9;
+
+        float3 probe = 0;
+        for (uint i = 0; i < 9; i++)
+        {
+            probe += gIrradianceVolume[first + i].rgb * basis[i];
+        }
+        result += w.x * w.y * w.z * probe;
+    }
+    return max(result, 0);
+}
+
+// Analytic fit of the split sum BRDF used until the LUT is baked (Karis 2014).
+float2 EnvBRDFApprox(float NdotV, float roughness)
+{
+    const float4 c0 = float4(-1, -0.0275, -0.572, 0.022);
+    const float4 c1 = float4(1, 0.0425, 1.04, -0.04);
+    float4 r = roughness * c0 + c1;
+    float a004 = min(r.x * r.x, exp2(-9.28 * NdotV)) * r.x + r.y;
+    return float2(-1.04, 1.04) * a004 + r.zw;
+}
+
+// Cook-Torrance response to light arriving from L with the given radiance.
+float3 DirectLight(float3 N, float3 V, float3 L, float3 radiance, float3 albedo, float3 F0, float metallic, float roughness)
+{
+    float3 H = normalize(L + V);
+
+    float cosTheta = max(dot(H, V), 0.0);
+    float3 F = fresnelSchlick(cosTheta, F0);
+
+    float NDF = DistributionGGX(N, H, roughness);
+    float G = GeometrySmith(N, V, L, roughness);
+
+    float3 numerator = NDF * G * F;
+    float denominator = 4 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0);
+    float3 specular = numerator / max(denominator, 0.001);
+
+    float3 kD = (float3(1, 1, 1) - F) * (1 - metallic);
+
+    float NdotL = max(dot(N, L), 0.0);
+    return (kD * albedo / PI + specular) * radiance * NdotL;
+}
+
 struct VertexIn
 {
     float3 PosL : POSITION;
@@ -70,6 +161,8 @@ struct VertexOut
     float3 NormalW : NORMAL;
     float3 TangentW : TANGENT;
     float2 TexC : TEXCOORD;
+    // Irradiance volume lookup along the vertex normal.
+    float3 VolumeIrradiance : COLOR0;
 };
 
 VertexOut VS(VertexIn vin)
@@ -85,6 +178,12 @@ VertexOut VS(VertexIn vin)
 
     vout.TexC = vin.TexC;
 
+    vout.VolumeIrradiance = 0;
+    if (gVolumeEnabled)
+    {
+        vout.VolumeIrradiance = SampleIrradianceVolume(vout.PosW, normalize(vout.NormalW));
+    }
+
     return vout;
 };
 
@@ -93,7 +192,7 @@ float4 PS(VertexOut pin) : SV_Target
 
     MaterialData Mat = gMaterialData[gMaterialIndex];
 
-    float3 localNormal = gTextureMaps[Mat.normalMapIndex].Sample(gsamLinearClamp, pin.TexC).rgb;
+    float2 localNormal = gTextureMaps[Mat.normalMapIndex].Sample(gsamLinearClamp, pin.TexC).rg;
     
     float3 N = TangentNormalToWorld(localNormal, normalize(pin.TangentW), normalize(pin.NormalW));
     N = normalize(N);
@@ -101,9 +200,10 @@ float4 PS(VertexOut pin) : SV_Target
 
 
     float3 albedo = Mat.albedo * gTextureMaps[Mat.albedoMapIndex].Sample(gsamAnisotropicClamp, pin.TexC).rgb;
-    float metallic = Mat.metallic * gTextureMaps[Mat.metallicMapIndex].Sample(gsamLinearClamp, pin.TexC).x;
-    float roughness = Mat.roughness * gTextureMaps[Mat.roughnessMapIndex].Sample(gsamLinearClamp, pin.TexC).x;
-    float ao = Mat.ao * gTextureMaps[Mat.aoMapIndex].Sample(gsamLinearClamp, pin.TexC).x;
+    float3 orm = gTextureMaps[Mat.ormMapIndex].Sample(gsamLinearClamp, pin.TexC).rgb;
+    float ao = Mat.ao * orm.r;
+    float roughness = Mat.roughness * orm.g;
+    float metallic = Mat.metallic * orm.b;
 
     float3 F0 = float3(0.04, 0.04, 0.04);
     F0 = lerp(F0, albedo, metallic);
@@ -111,46 +211,68 @@ float4 PS(VertexOut pin) : SV_Target
     float3 light = float3(0, 0, 0);
 
     float3 R = reflect(-V, N);
-    float3 prefilteredColor = gPrefilterdMap.SampleLevel(gsamLinearWrap, R, roughness * gPrefilteredMapMipLevels).rgb;
+    // The IBL maps bake over several frames: only sample the mips and maps that are done.
+    float3 prefilteredColor = EvaluateAmbientSH(R);
+    if (gPrefilteredMinMip < gPrefilteredMapMipLevels)
+    {
+        float lod = max(roughness * (gPrefilteredMapMipLevels - 1), gPrefilteredMinMip);
+        prefilteredColor = SamplePrefilteredMap(R, lod);
+    }
+#ifndef PROBE_CAPTURE
+    // Local reflection probes replace part of the global environment.  Captures skip
+    // this so that probes never see each other.
+    float probeLod = roughness * (gProbeMipLevels - 1);
+    prefilteredColor *= 1 - gProbeWeight0 - gProbeWeight1;
+    if (gProbeWeight0 > 0)
+    {
+        prefilteredColor += gProbeWeight0 * gProbeMaps.SampleLevel(gsamLinearWrap, float4(R, gProbeSlice0), probeLod).rgb;
+    }
+    if (gProbeWeight1 > 0)
+    {
+        prefilteredColor += gProbeWeight1 * gProbeMaps.SampleLevel(gsamLinearWrap, float4(R, gProbeSlice1), probeLod).rgb;
+    }
+#endif
     float3 F = fresnelSchlickRoughness(max(dot(N, V), 0), F0, roughness);
-    float2 envBRDF = gLUTMap.Sample(gsamLinearClamp, float2(max(dot(N, V), 0), roughness)).rg;
+    float2 envBRDF = EnvBRDFApprox(max(dot(N, V), 0), roughness);
+    if (gIBLReadyMask & 2)
+    {
+        envBRDF = gLUTMap.Sample(gsamLinearClamp, float2(max(dot(N, V), 0), roughness)).rg;
+    }
     float3 specular = prefilteredColor * (F * envBRDF.x + envBRDF.y);
 
-    for (int i = 0; i < 4; i++)
+    // Directional lights extracted from the environment; their color is irradiance.
+    for (uint i = 0; i < gNumDirLights; i++)
     {
-        float3 toEye = gLights[i].dir_and_pos - pin.PosW;
-        float3 L = normalize(toEye);
-        float3 H = normalize(L + V);
+        float3 L = normalize(-gLights[i].dir_and_pos);
+        light += DirectLight(N, V, L, gLights[i].lightColor, albedo, F0, metallic, roughness);
+    }
 
-        float distance = length(toEye);
+    for (uint j = gNumDirLights; j < gNumDirLights + gNumPointLights; j++)
+    {
+        float3 toLight = gLights[j].dir_and_pos - pin.PosW;
+        float distance = length(toLight);
         float attenuation = 1 / (distance * distance);
-        float3 radiance = gLights[i].lightColor * attenuation;
-
-        float cosTheta = max(dot(H, V), 0.0);
-        float3 F = fresnelSchlick(cosTheta, F0);
-
-        float NDF = DistributionGGX(N, H, roughness);
-        float G = GeometrySmith(N, V, L, roughness);
-
-        float3 numerator = NDF * G * F;
-        float denominator = 4 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0);
-        float3 specular = numerator / max(denominator, 0.001);
-
-        float3 kD = (float3(1, 1, 1) - F) * (1 - metallic);
-
-        float NdotL = max(dot(N, L), 0.0);
-        light += (kD * albedo / PI + specular) * radiance * NdotL;
+        light += DirectLight(N, V, toLight / distance, gLights[j].lightColor * attenuation, albedo, F0, metallic, roughness);
     }
 
     float3 ks = fresnelSchlickRoughness(max(dot(N, V), 0.0f), F0, roughness);
     float3 kd = 1.0 - ks;
-    float3 irradiance = gIrradianceMap.Sample(gsamLinearWrap, N).rgb;
+    float3 irradiance = (gIBLReadyMask & 1) ? SampleIrradianceMap(N) : EvaluateAmbientSH(N);
+    // The volume adds the occlusion and bounce light of the scene; it is looked up
+    // per vertex, so it does not follow the normal map.
+    if (gVolumeEnabled)
+    {
+        irradiance = pin.VolumeIrradiance;
+    }
     float3 diffuse = irradiance * albedo;
     float3 ambient = (kd * diffuse + specular) * ao;
 
     float3 color = ambient + light;
+#ifndef PROBE_CAPTURE
+    // Probe captures stay linear HDR for the prefilter.
     color = color / (color + float3(1, 1, 1));
     color = pow(color, float3(1.0 / 2.2, 1.0 / 2.2, 1.0 / 2.2));
+#endif
 
     // return float4(localNormal, 1.0f);
     // return float4((normalize(pin.NormalW) + 1.0f) / 2, 1.0f);
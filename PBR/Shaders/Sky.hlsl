@@ -35,7 +35,10 @@ VertexOut VS(VertexIn vin)
 float4 PS(VertexOut pin) : SV_Target
 {
 	float3 color = gCubeMap.SampleLevel(gsamLinearWrap, pin.PosL, 0.0f).rgb;
+#ifndef PROBE_CAPTURE
+    color = color / (color + float3(1, 1, 1));
     color = pow(color, float3(1.0 / 2.2, 1.0 / 2.2, 1.0 / 2.2));
+#endif
     return float4(color, 1.0f);
 }
 
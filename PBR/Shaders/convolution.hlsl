@@ -10,6 +10,10 @@ cbuffer cbPerFace
 };
 TextureCube lightingCube : register(t0);
 
+#ifdef OCTAHEDRAL
+#include "Octahedral.hlsl"
+#endif
+
 SamplerState gsamLinearWrap : register(s0);
 
 struct VertexIn
@@ -45,13 +49,20 @@ VertexOut VS(uint pid : SV_VertexID)
 
 float4 PS(VertexOut pin) : SV_Target
 {
+#ifdef OCTAHEDRAL
+    // Octahedral target: the direction comes from the position in the map.
+    float3 normalW = OctDecode(float2(pin.PosV.x, -pin.PosV.y) * 0.5f + 0.5f);
+    float3 tangentRef = abs(normalW.y) < 0.999f ? float3(0.0f, 1.0f, 0.0f) : float3(1.0f, 0.0f, 0.0f);
+#else
     float3 normalL = pin.PosV;
 
     float3 normalW = mul(normalL, float3x3(gRight, gUp, gLookAt));
     normalW = normalize(normalW);
+    float3 tangentRef = gRight;
+#endif
 
     float3 N = normalW;
-    float3 T = cross(normalW, gRight);
+    float3 T = cross(normalW, tangentRef);
     float3 B = cross(T, N);
 
     T = normalize(T);
@@ -0,0 +1,10 @@
+#include "SharedResourceTable.h"
+
+ContentHash HashTextureContent(const CompressedTexture& texture) {
+	// The description seeds the hash of the texels, so that the same bytes read as
+	// another format or shape do not collide.
+	uint32_t desc[6] = { texture.Width(), texture.Height(), texture.MipLevels(), texture.ArraySize(),
+		texture.DxgiFormat(), texture.IsCube() ? 1u : 0u };
+	ContentHash descHash = HashBytes(desc, sizeof(desc));
+	return HashBytes(texture.Data(), texture.ByteSize(), (uint32_t)(descHash.Low ^ descHash.High));
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include "CompressedTexture.h"
+#include "ContentHash.h"
+#include "DescriptorIndexAllocator.h"
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct ContentHashHasher {
+	size_t operator()(const ContentHash& hash)const { return (size_t)(hash.Low ^ (hash.High * 0x9e3779b97f4a7c15ull)); }
+};
+
+// Hash of a texture chain's texels together with its size, mips and format.
+ContentHash HashTextureContent(const CompressedTexture& texture);
+
+struct SharedResourceStats {
+	// Lookups that found a resource, and resources created.
+	uint32_t Hits = 0;
+	uint32_t Misses = 0;
+	uint32_t LiveResources = 0;
+	uint64_t LiveBytes = 0;
+	// What the extra references would have allocated without sharing.
+	uint64_t SavedBytes = 0;
+};
+
+// Reference counted resources keyed by the hash of their content, the bookkeeping of
+// ResourceRegistry without the graphics API.  The last Release retires a resource
+// until Collect sees its fence pass; Handle is any movable type whose destruction
+// frees the resource.  Lookups are one hash map probe.  One thread at a time.
+template <typename Handle>
+class SharedResourceTable {
+public:
+	struct Entry {
+		Handle Resource;
+		// Persistent index in the bindless heap, or kNoDescriptor until a view is made.
+		uint32_t SrvIndex = kNoDescriptor;
+		uint64_t Bytes = 0;
+		uint32_t RefCount = 0;
+	};
+
+	// Takes a reference to the resource with this content, or returns nullptr when
+	// there is none yet and the caller has to create it and Add it.
+	Entry* Acquire(const ContentHash& hash) {
+		auto it = mEntries.find(hash);
+		if (it == mEntries.end()) {
+			return nullptr;
+		}
+		it->second.RefCount++;
+		mHits++;
+		return &it->second;
+	}
+
+	// Registers a new resource of bytes with one reference.
+	Entry* Add(const ContentHash& hash, Handle resource, uint64_t bytes) {
+		Entry& entry = mEntries[hash];
+		entry.Resource = std::move(resource);
+		entry.Bytes = bytes;
+		entry.RefCount = 1;
+		mMisses++;
+		return &entry;
+	}
+
+	// The entry without taking a reference, or nullptr.
+	Entry* Find(const ContentHash& hash) {
+		auto it = mEntries.find(hash);
+		return it == mEntries.end() ? nullptr : &it->second;
+	}
+
+	// Drops a reference.  Returns true when it was the last one: the resource is then
+	// kept until the GPU passes fence, and the entry is gone.
+	bool Release(const ContentHash& hash, uint64_t fence) {
+		auto it = mEntries.find(hash);
+		if (it == mEntries.end() || --it->second.RefCount != 0) {
+			return false;
+		}
+		mRetired.emplace_back(std::move(it->second.Resource), fence);
+		mEntries.erase(it);
+		return true;
+	}
+
+	// Destroys the retired resources whose fence is at most completedFence.
+	void Collect(uint64_t completedFence) {
+		mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(),
+			[completedFence](const std::pair<Handle, uint64_t>& retired) {
+				return retired.second <= completedFence;
+			}), mRetired.end());
+	}
+
+	// Resources released but still waiting for their fence.
+	uint32_t RetiredCount()const { return (uint32_t)mRetired.size(); }
+
+	SharedResourceStats Stats()const {
+		SharedResourceStats stats;
+		stats.Hits = mHits;
+		stats.Misses = mMisses;
+		stats.LiveResources = (uint32_t)mEntries.size();
+		for (const auto& e : mEntries) {
+			stats.LiveBytes += e.second.Bytes;
+			stats.SavedBytes += e.second.Bytes * (e.second.RefCount - 1);
+		}
+		return stats;
+	}
+
+private:
+	std::unordered_map<ContentHash, Entry, ContentHashHasher> mEntries;
+	std::vector<std::pair<Handle, uint64_t>> mRetired;
+	uint32_t mHits = 0;
+	uint32_t mMisses = 0;
+};
@@ -0,0 +1,108 @@
+#include "SphericalHarmonics.h"
+#include <cmath>
+
+namespace {
+	const float kPi = 3.14159265358979f;
+
+	// Integral of the solid angle of a cube face from the face center to (x, y).
+	float AreaElement(float x, float y) {
+		return std::atan2(x * y, std::sqrt(x * x + y * y + 1.0f));
+	}
+
+	float TexelSolidAngle(uint32_t x, uint32_t y, uint32_t size) {
+		float invSize = 1.0f / size;
+		float x0 = 2.0f * x * invSize - 1.0f;
+		float y0 = 2.0f * y * invSize - 1.0f;
+		float x1 = x0 + 2.0f * invSize;
+		float y1 = y0 + 2.0f * invSize;
+		return AreaElement(x0, y0) - AreaElement(x0, y1) - AreaElement(x1, y0) + AreaElement(x1, y1);
+	}
+}
+
+void SHBasis9(const float dir[3], float basis[9]) {
+	float x = dir[0];
+	float y = dir[1];
+	float z = dir[2];
+
+	basis[0] = 0.282095f;
+	basis[1] = 0.488603f * y;
+	basis[2] = 0.488603f * z;
+	basis[3] = 0.488603f * x;
+	basis[4] = 1.092548f * x * y;
+	basis[5] = 1.092548f * y * z;
+	basis[6] = 0.315392f * (3.0f * z * z - 1.0f);
+	basis[7] = 1.092548f * x * z;
+	basis[8] = 0.546274f * (x * x - y * y);
+}
+
+SH9Color ProjectCubeMapSH9(const CubeMapImage& cube, uint32_t mip) {
+	uint32_t size = cube.MipSize(mip);
+
+	double sum[9][3] = {};
+	double totalWeight = 0.0;
+	for (uint32_t face = 0; face < 6; face++) {
+		const float* texels = cube.Texels(face, mip);
+		for (uint32_t y = 0; y < size; y++) {
+			for (uint32_t x = 0; x < size; x++) {
+				float dir[3];
+				CubeFaceDirection(face, (x + 0.5f) / size, (y + 0.5f) / size, dir);
+				float invLength = 1.0f / std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+				dir[0] *= invLength;
+				dir[1] *= invLength;
+				dir[2] *= invLength;
+
+				float basis[9];
+				SHBasis9(dir, basis);
+
+				float weight = TexelSolidAngle(x, y, size);
+				const float* texel = texels + ((size_t)y * size + x) * 4;
+				for (int i = 0; i < 9; i++) {
+					for (int c = 0; c < 3; c++) {
+						sum[i][c] += (double)texel[c] * basis[i] * weight;
+					}
+				}
+				totalWeight += weight;
+			}
+		}
+	}
+
+	// The solid angles add up to 4 pi up to rounding; renormalize to remove it.
+	double normalization = 4.0 * kPi / totalWeight;
+
+	SH9Color sh;
+	for (int i = 0; i < 9; i++) {
+		for (int c = 0; c < 3; c++) {
+			sh.C[i][c] = (float)(sum[i][c] * normalization);
+		}
+	}
+	return sh;
+}
+
+SH9Color RadianceToIrradianceSH9(const SH9Color& radiance) {
+	// Cosine lobe band factors pi, 2pi/3 and pi/4, divided by pi.
+	const float band[9] = {
+		1.0f,
+		2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f,
+		0.25f, 0.25f, 0.25f, 0.25f, 0.25f
+	};
+
+	SH9Color irradiance;
+	for (int i = 0; i < 9; i++) {
+		for (int c = 0; c < 3; c++) {
+			irradiance.C[i][c] = radiance.C[i][c] * band[i];
+		}
+	}
+	return irradiance;
+}
+
+void EvaluateSH9(const SH9Color& sh, const float dir[3], float rgb[3]) {
+	float basis[9];
+	SHBasis9(dir, basis);
+
+	rgb[0] = rgb[1] = rgb[2] = 0.0f;
+	for (int i = 0; i < 9; i++) {
+		for (int c = 0; c < 3; c++) {
+			rgb[c] += sh.C[i][c] * basis[i];
+		}
+	}
+}
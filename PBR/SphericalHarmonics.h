@@ -0,0 +1,22 @@
+#pragma once
+#include "CubeMapImage.h"
+
+// Nine RGB coefficients of a real order-2 (L2) spherical harmonic expansion.
+struct SH9Color {
+	float C[9][3] = {};
+};
+
+// Evaluates the nine L2 basis functions for a unit direction.
+void SHBasis9(const float dir[3], float basis[9]);
+
+// Projects the radiance of one mip of a cube map onto SH, weighting every texel by
+// the solid angle it covers.  A small mip (16^2 or 32^2) is plenty for L2.
+SH9Color ProjectCubeMapSH9(const CubeMapImage& cube, uint32_t mip);
+
+// Convolves projected radiance with the clamped cosine lobe and divides by pi, so
+// that evaluating the result along n gives the same value as the irradiance map
+// produced by convolution.hlsl.
+SH9Color RadianceToIrradianceSH9(const SH9Color& radiance);
+
+// Sum of coeff * basis along dir.
+void EvaluateSH9(const SH9Color& sh, const float dir[3], float rgb[3]);
@@ -0,0 +1,133 @@
+#include "TaskPool.h"
+#include <algorithm>
+#include <exception>
+
+namespace {
+	// Shared between ParallelFor and its helper tasks, which may outlive the call.
+	struct ParallelForState {
+		std::function<void(uint32_t)> Fn;
+		uint32_t Count = 0;
+		std::atomic<uint32_t> Next{ 0 };
+		// Indices that ran, or that were dropped after a call threw.
+		std::atomic<uint32_t> Done{ 0 };
+		std::mutex Mutex;
+		std::condition_variable Finished;
+		// The first exception thrown by Fn, guarded by Mutex.
+		std::exception_ptr Error;
+
+		void Drain() {
+			uint32_t completed = 0;
+			for (uint32_t i = Next++; i < Count; i = Next++) {
+				try {
+					Fn(i);
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock(Mutex);
+					if (!Error) {
+						Error = std::current_exception();
+					}
+					// Hand out no more indices.  Those claimed before the exchange finish on
+					// their threads; the rest count as done here.
+					uint32_t unclaimed = Next.exchange(Count);
+					if (unclaimed < Count) {
+						completed += Count - unclaimed;
+					}
+				}
+				completed++;
+			}
+			if (completed != 0 && (Done += completed) == Count) {
+				std::lock_guard<std::mutex> lock(Mutex);
+				Finished.notify_all();
+			}
+		}
+	};
+}
+
+TaskPool::TaskPool(uint32_t threadCount) {
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (uint32_t i = 0; i < threadCount; i++) {
+		mWorkers.emplace_back(&TaskPool::WorkerLoop, this);
+	}
+}
+
+TaskPool::~TaskPool() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWakeUp.notify_all();
+	for (auto& worker : mWorkers) {
+		worker.join();
+	}
+}
+
+TaskPool& TaskPool::Default() {
+	static TaskPool pool;
+	return pool;
+}
+
+std::future<void> TaskPool::Submit(std::function<void()> task) {
+	auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+	std::future<void> result = packaged->get_future();
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQueue.emplace_back([packaged]() { (*packaged)(); });
+	}
+	mWakeUp.notify_one();
+	return result;
+}
+
+void TaskPool::ParallelFor(uint32_t count, const std::function<void(uint32_t)>& fn) {
+	if (count == 0) {
+		return;
+	}
+	if (count == 1) {
+		fn(0);
+		return;
+	}
+
+	auto state = std::make_shared<ParallelForState>();
+	state->Fn = fn;
+	state->Count = count;
+
+	uint32_t helpers = std::min(count - 1, ThreadCount());
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (uint32_t i = 0; i < helpers; i++) {
+			mQueue.emplace_back([state]() { state->Drain(); });
+		}
+	}
+	mWakeUp.notify_all();
+
+	state->Drain();
+
+	// Only the calls in flight on other threads are left.  Running unrelated queued
+	// work here instead could pick up a long task and hold the caller far past them.
+	{
+		std::unique_lock<std::mutex> lock(state->Mutex);
+		state->Finished.wait(lock, [&]() { return state->Done.load() == count; });
+	}
+
+	// Every call has returned, so no helper writes Error any more.
+	if (state->Error) {
+		std::rethrow_exception(state->Error);
+	}
+}
+
+void TaskPool::WorkerLoop() {
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWakeUp.wait(lock, [this]() { return mStopping || !mQueue.empty(); });
+			if (mStopping && mQueue.empty()) {
+				return;
+			}
+			task = std::move(mQueue.front());
+			mQueue.pop_front();
+		}
+		task();
+	}
+}
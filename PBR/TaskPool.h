@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads shared by the CPU side texture and baking code.
+class TaskPool {
+public:
+	// threadCount == 0 uses one worker per hardware thread.
+	explicit TaskPool(uint32_t threadCount = 0);
+	TaskPool(const TaskPool& rhs) = delete;
+	TaskPool& operator=(const TaskPool& rhs) = delete;
+	~TaskPool();
+
+	uint32_t ThreadCount()const { return (uint32_t)mWorkers.size(); }
+
+	// Queues a task and returns a future that becomes ready when it has run.
+	std::future<void> Submit(std::function<void()> task);
+
+	// Calls fn(i) for every i in [0, count) and returns once all calls finished.
+	// The calling thread takes part in the loop, so nesting from a worker is safe, and
+	// it runs nothing else that is queued on the pool while it waits.
+	// When a call throws, indices not yet started are skipped and the first exception
+	// is rethrown here once the calls in flight have returned.
+	void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& fn);
+
+	// Process wide pool, created on first use.
+	static TaskPool& Default();
+
+private:
+	void WorkerLoop();
+
+private:
+	std::vector<std::thread> mWorkers;
+	std::deque<std::function<void()>> mQueue;
+	std::mutex mMutex;
+	std::condition_variable mWakeUp;
+	bool mStopping = false;
+};
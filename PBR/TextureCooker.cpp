@@ -0,0 +1,372 @@
+#include "TextureCooker.h"
+#include "MipGenerator.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+	const char* const kManifestHeader = "# texture manifest 5";
+
+	uint8_t ToUnorm8(float v) {
+		return (uint8_t)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+
+	bool FileExists(const std::string& path) {
+		return std::ifstream(path, std::ios::binary).good();
+	}
+
+	// Block format the settings pick for a usage; false when it stays RGBA8.
+	bool CompressedFormat(TextureUsage usage, const TextureCookSettings& settings, BCFormat& format) {
+		switch (usage) {
+		case TextureUsage::Color: format = settings.ColorFormat; break;
+		case TextureUsage::Linear: format = BCFormat::BC4; break;
+		case TextureUsage::Normal: format = BCFormat::BC5; break;
+		// BC4 would keep only red, and BC1 ties the channels to one line.
+		case TextureUsage::Packed: format = BCFormat::BC7; break;
+		default: return false;
+		}
+		return settings.Compress;
+	}
+
+	bool UsesRdo(const TextureCookSettings& settings) {
+		return settings.Codec == PackageCodec::Entropy && settings.Rdo.MaxMseIncrease > 0.0f;
+	}
+
+	std::string EncodingName(TextureUsage usage, const TextureCookSettings& settings) {
+		static const char* const kFormatNames[] = { "bc1", "bc4", "bc5", "bc7" };
+		BCFormat format;
+		std::string codec = settings.Codec == PackageCodec::None ? "" : std::string("-") + PackageCodecName(settings.Codec);
+		if (!CompressedFormat(usage, settings, format)) {
+			return "rgba8" + codec;
+		}
+		std::ostringstream name;
+		name << kFormatNames[(int)format] << (settings.Quality == BCQuality::Fast ? "-fast" : "-quality") << codec;
+		if (UsesRdo(settings)) {
+			name << "-rdo" << settings.Rdo.MaxMseIncrease << "w" << settings.Rdo.Window;
+		}
+		return name.str();
+	}
+}
+
+const char* TextureUsageName(TextureUsage usage) {
+	switch (usage) {
+	case TextureUsage::Color: return "color";
+	case TextureUsage::Linear: return "linear";
+	case TextureUsage::Normal: return "normal";
+	case TextureUsage::Packed: return "packed";
+	}
+	return "unknown";
+}
+
+bool ParseTextureUsage(const std::string& text, TextureUsage& usage) {
+	const TextureUsage all[] = { TextureUsage::Color, TextureUsage::Linear, TextureUsage::Normal, TextureUsage::Packed };
+	for (TextureUsage candidate : all) {
+		if (text == TextureUsageName(candidate)) {
+			usage = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+SourceImage PackChannels(const SourceImage* const sources[3], const uint8_t defaults[3], TaskPool& pool) {
+	SourceImage packed;
+	for (int c = 0; c < 3; c++) {
+		if (sources[c]) {
+			if (sources[c]->Width == 0 || sources[c]->Height == 0 ||
+				sources[c]->Pixels.size() != (size_t)sources[c]->Width * sources[c]->Height * 4) {
+				throw std::runtime_error("PackChannels: bad source image");
+			}
+			packed.Width = std::max(packed.Width, sources[c]->Width);
+			packed.Height = std::max(packed.Height, sources[c]->Height);
+		}
+	}
+	if (packed.Width == 0) {
+		throw std::runtime_error("PackChannels: no source image");
+	}
+
+	size_t texelCount = (size_t)packed.Width * packed.Height;
+	packed.Pixels.resize(texelCount * 4);
+	for (size_t i = 0; i < texelCount; i++) {
+		for (int c = 0; c < 3; c++) {
+			packed.Pixels[i * 4 + c] = defaults[c];
+		}
+		packed.Pixels[i * 4 + 3] = 255;
+	}
+
+	for (int c = 0; c < 3; c++) {
+		const SourceImage* source = sources[c];
+		if (!source) {
+			continue;
+		}
+		if (source->Width == packed.Width && source->Height == packed.Height) {
+			for (size_t i = 0; i < texelCount; i++) {
+				packed.Pixels[i * 4 + c] = source->Pixels[i * 4];
+			}
+			continue;
+		}
+		// The box filter takes a single source texel per destination one when it
+		// magnifies, so this is a nearest neighbour upscale along that axis.
+		std::vector<float> texels(source->Pixels.size());
+		for (size_t i = 0; i < source->Pixels.size(); i++) {
+			texels[i] = source->Pixels[i] / 255.0f;
+		}
+		std::vector<float> resized;
+		ResampleRGBA(texels, source->Width, source->Height, resized, packed.Width, packed.Height, pool);
+		for (size_t i = 0; i < texelCount; i++) {
+			packed.Pixels[i * 4 + c] = ToUnorm8(resized[i * 4]);
+		}
+	}
+	return packed;
+}
+
+TextureManifest TextureManifest::Load(const std::string& path) {
+	TextureManifest manifest;
+	std::ifstream file(path);
+	if (!file) {
+		return manifest;
+	}
+
+	std::string line;
+	if (!std::getline(file, line) || line != kManifestHeader) {
+		return manifest;
+	}
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		std::vector<std::string> fields;
+		std::stringstream stream(line);
+		std::string field;
+		while (std::getline(stream, field, '\t')) {
+			fields.push_back(field);
+		}
+
+		TextureManifestEntry entry;
+		if (fields.size() != 7 ||
+			!ParseTextureUsage(fields[1], entry.Usage) ||
+			fields[2].empty() ||
+			!ContentHash::FromString(fields[3], entry.SourceHash) ||
+			!ContentHash::FromString(fields[4], entry.CookedHash)) {
+			throw std::runtime_error("Malformed texture manifest entry in " + path + ": " + line);
+		}
+		entry.Name = fields[0];
+		entry.Encoding = fields[2];
+		entry.SourcePath = fields[5];
+		entry.CookedPath = fields[6];
+		manifest.mEntries.push_back(entry);
+	}
+	return manifest;
+}
+
+void TextureManifest::Save(const std::string& path)const {
+	std::ofstream file(path, std::ios::trunc);
+	if (!file) {
+		throw std::runtime_error("Cannot create " + path);
+	}
+	file << kManifestHeader << "\n";
+	for (const TextureManifestEntry& entry : mEntries) {
+		file << entry.Name << '\t' << TextureUsageName(entry.Usage) << '\t' << entry.Encoding << '\t' <<
+			entry.SourceHash.ToString() << '\t' << entry.CookedHash.ToString() << '\t' << entry.SourcePath << '\t' <<
+			entry.CookedPath << "\n";
+	}
+	if (!file) {
+		throw std::runtime_error("Failed writing " + path);
+	}
+}
+
+const TextureManifestEntry* TextureManifest::Find(const std::string& name)const {
+	for (const TextureManifestEntry& entry : mEntries) {
+		if (entry.Name == name) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+void TextureManifest::Set(const TextureManifestEntry& entry) {
+	for (TextureManifestEntry& existing : mEntries) {
+		if (existing.Name == entry.Name) {
+			existing = entry;
+			return;
+		}
+	}
+	mEntries.push_back(entry);
+}
+
+TextureCookRequest OrmCookRequest(const std::string& name, const std::string& aoPath,
+	const std::string& roughnessPath, const std::string& metallicPath, const std::string& normalPath)
+{
+	TextureCookRequest request;
+	request.Name = name;
+	request.Usage = TextureUsage::Packed;
+	request.ChannelPaths[0] = aoPath;
+	request.ChannelPaths[1] = roughnessPath;
+	request.ChannelPaths[2] = metallicPath;
+	request.ToksvigNormalPath = normalPath;
+	return request;
+}
+
+CookSource DecodeCookSource(const TextureCookRequest& request,
+	const std::function<SourceImage(const std::string&)>& decode, TaskPool& pool)
+{
+	CookSource source;
+	if (request.Usage == TextureUsage::Packed) {
+		SourceImage channels[3];
+		const SourceImage* sources[3] = {};
+		for (int c = 0; c < 3; c++) {
+			if (!request.ChannelPaths[c].empty()) {
+				channels[c] = decode(request.ChannelPaths[c]);
+				sources[c] = &channels[c];
+			}
+		}
+		source.Image = PackChannels(sources, request.ChannelDefaults, pool);
+	}
+	else {
+		source.Image = decode(request.SourcePath);
+	}
+	if (!request.ToksvigNormalPath.empty()) {
+		source.ToksvigNormals = decode(request.ToksvigNormalPath);
+	}
+	return source;
+}
+
+MipGenSettings CookMipSettings(const TextureCookRequest& request, const CookSource& source) {
+	MipGenSettings mips;
+	mips.Usage = request.Usage;
+	if (!source.ToksvigNormals.Pixels.empty()) {
+		mips.ToksvigNormals = &source.ToksvigNormals;
+		mips.RoughnessChannel = request.Usage == TextureUsage::Packed ? 1 : 0;
+	}
+	return mips;
+}
+
+TextureCookStats CookTextures(const std::vector<TextureCookRequest>& requests, const std::string& cookedDir,
+	const std::string& manifestPath, const std::function<SourceImage(const std::string&)>& decode,
+	const TextureCookSettings& settings, TaskPool& pool)
+{
+	auto start = std::chrono::steady_clock::now();
+	TextureCookStats stats;
+	TextureManifest manifest = TextureManifest::Load(manifestPath);
+
+	// What each job hands back to the calling thread.
+	struct CookResult {
+		TextureCookTiming Timing;
+		TextureManifestEntry Entry;
+		double BCSeconds = 0.0;
+		double EncodedMPixels = 0.0;
+		double Psnr = INFINITY;
+		BCRdoStats Rdo;
+		AssetPackStats Package;
+	};
+	std::vector<CookResult> results(requests.size());
+
+	pool.ParallelFor((uint32_t)requests.size(), [&](uint32_t i) {
+		const TextureCookRequest& request = requests[i];
+		CookResult& result = results[i];
+		result.Timing.Name = request.Name;
+		auto jobStart = std::chrono::steady_clock::now();
+		auto phaseStart = jobStart;
+		auto phaseSeconds = [&phaseStart]() {
+			auto now = std::chrono::steady_clock::now();
+			double seconds = std::chrono::duration<double>(now - phaseStart).count();
+			phaseStart = now;
+			return seconds;
+		};
+
+		bool packed = request.Usage == TextureUsage::Packed;
+		std::string sourcePath = request.SourcePath;
+		ContentHash sourceHash;
+		if (packed) {
+			// Hash the channel hashes and defaults, so that changing any of them recooks.
+			sourcePath = request.ChannelPaths[0] + "|" + request.ChannelPaths[1] + "|" + request.ChannelPaths[2];
+			std::string channels;
+			for (int c = 0; c < 3; c++) {
+				channels += request.ChannelPaths[c].empty() ? "-" : HashFile(request.ChannelPaths[c]).ToString();
+				channels += "/" + std::to_string(request.ChannelDefaults[c]) + ";";
+			}
+			sourceHash = HashBytes(channels.data(), channels.size());
+		}
+		else {
+			sourceHash = HashFile(request.SourcePath);
+		}
+		if (!request.ToksvigNormalPath.empty()) {
+			std::string hashes = sourceHash.ToString() + "+" + HashFile(request.ToksvigNormalPath).ToString();
+			sourceHash = HashBytes(hashes.data(), hashes.size());
+		}
+		std::string cookedPath = cookedDir + "/" + request.Name + ".pak";
+		std::string encoding = EncodingName(request.Usage, settings);
+
+		const TextureManifestEntry* existing = manifest.Find(request.Name);
+		if (existing && existing->SourceHash == sourceHash && existing->Usage == request.Usage &&
+			existing->Encoding == encoding && existing->CookedPath == cookedPath && FileExists(cookedPath)) {
+			result.Timing.UpToDate = true;
+		}
+		else {
+			CookSource source = DecodeCookSource(request, decode, pool);
+			result.Timing.DecodeSeconds = phaseSeconds();
+
+			CompressedTexture cooked = GenerateMips(source.Image, CookMipSettings(request, source), pool);
+			result.Timing.MipSeconds = phaseSeconds();
+
+			BCFormat format;
+			if (CompressedFormat(request.Usage, settings, format) && cooked.Width() % 4 == 0 && cooked.Height() % 4 == 0) {
+				CompressedTexture compressed;
+				BCStats encodeStats = EncodeTextureBC(cooked, format, settings.Quality, compressed, pool);
+				result.BCSeconds = encodeStats.Seconds;
+				result.EncodedMPixels = encodeStats.Seconds * encodeStats.MPixelsPerSecond;
+				if (UsesRdo(settings)) {
+					result.Rdo = OptimizeBCForCompression(cooked, format, settings.Rdo, compressed, pool);
+				}
+				result.Psnr = MeasureBCPsnr(cooked, compressed, format);
+				cooked = std::move(compressed);
+			}
+			// Stored by its upload footprints, so loading it is a copy into an upload
+			// buffer or a decompression.
+			AssetPackageWriter writer;
+			writer.AddTexture(request.Name, cooked, settings.Codec);
+			result.Package = writer.Write(cookedPath, pool);
+			result.Timing.EncodeSeconds = phaseSeconds();
+
+			TextureManifestEntry& entry = result.Entry;
+			entry.Name = request.Name;
+			entry.Usage = request.Usage;
+			entry.Encoding = encoding;
+			entry.SourcePath = sourcePath;
+			entry.CookedPath = cookedPath;
+			entry.SourceHash = sourceHash;
+			entry.CookedHash = HashBytes(cooked.Data(), cooked.ByteSize());
+		}
+		result.Timing.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - jobStart).count();
+	});
+
+	for (CookResult& result : results) {
+		if (result.Timing.UpToDate) {
+			stats.UpToDate++;
+		}
+		else {
+			manifest.Set(result.Entry);
+			stats.Cooked++;
+			stats.EncodeSeconds += result.BCSeconds;
+			stats.EncodedMPixels += result.EncodedMPixels;
+			stats.MinPsnr = std::min(stats.MinPsnr, result.Psnr);
+			stats.RdoBlocks += result.Rdo.Blocks;
+			stats.RdoChangedBlocks += result.Rdo.RepeatedBlocks + result.Rdo.RepeatedIndices;
+			stats.CookedBytes += result.Package.Bytes;
+			stats.CookedFileBytes += result.Package.FileBytes;
+		}
+		stats.JobSeconds += result.Timing.Seconds;
+		stats.Textures.push_back(result.Timing);
+	}
+
+	if (stats.Cooked != 0) {
+		manifest.Save(manifestPath);
+	}
+	stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
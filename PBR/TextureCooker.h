@@ -0,0 +1,169 @@
+#pragma once
+#include "AssetPackage.h"
+#include "BCEncoder.h"
+#include "CompressedTexture.h"
+#include "ContentHash.h"
+#include "TaskPool.h"
+#include <cmath>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct MipGenSettings;
+
+// What the texels of a texture mean; picks its format and how its mips are filtered.
+enum class TextureUsage {
+	// sRGB encoded color, averaged in linear space and stored as *_SRGB.
+	Color,
+	// Linear data such as roughness, metallic or AO.
+	Linear,
+	// Tangent space normals packed to [0, 1], averaged as vectors and renormalized.
+	Normal,
+	// Unrelated linear maps in R, G and B, such as the occlusion, roughness and
+	// metallic of an ORM texture.  Filtered like Linear.
+	Packed
+};
+
+const char* TextureUsageName(TextureUsage usage);
+// Returns false for unknown names.
+bool ParseTextureUsage(const std::string& text, TextureUsage& usage);
+
+// Decoded RGBA8 image, top row first.
+struct SourceImage {
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	std::vector<uint8_t> Pixels;
+};
+
+// Packs the red channel of each source into R, G and B; a null source gives the
+// channel its default.  Sources smaller than the largest one are resampled to it.
+// Alpha is opaque.  Throws std::runtime_error when no source is given.
+SourceImage PackChannels(const SourceImage* const sources[3], const uint8_t defaults[3], TaskPool& pool = TaskPool::Default());
+
+// How CookTextures stores the mip chains.
+struct TextureCookSettings {
+	// Block compress color to ColorFormat, linear data to BC4, normals to BC5 and
+	// packed channels to BC7.
+	// Textures whose size is not a multiple of four, and all of them when this is
+	// off, stay RGBA8.
+	bool Compress = true;
+	BCFormat ColorFormat = BCFormat::BC7;
+	BCQuality Quality = BCQuality::Quality;
+	// Codec of the cooked packages.  With PackageCodec::Entropy the blocks first go
+	// through OptimizeBCForCompression with Rdo; a MaxMseIncrease of 0 skips it.
+	PackageCodec Codec = PackageCodec::Entropy;
+	BCRdoSettings Rdo;
+};
+
+struct TextureManifestEntry {
+	std::string Name;
+	TextureUsage Usage = TextureUsage::Color;
+	// How the texels were stored: "rgba8", or the block format and quality, such as
+	// "bc7-quality", then the package codec and the RDO tolerance, such as
+	// "-entropy-rdo1".  Sizes that are not a multiple of four stay RGBA8 regardless.
+	std::string Encoding;
+	// Packed textures list their channel files separated by '|', empty for defaults.
+	std::string SourcePath;
+	std::string CookedPath;
+	// Hash of the source file, and of the texel data of the cooked texture.
+	ContentHash SourceHash;
+	ContentHash CookedHash;
+};
+
+// Maps logical texture names to cooked texture files.  Stored as text with one tab
+// separated entry per line: name, usage, encoding, source hash, cooked hash,
+// source, cooked.
+class TextureManifest {
+public:
+	// A missing file, or one written by another version, gives an empty manifest.
+	// Throws std::runtime_error when the file is malformed.
+	static TextureManifest Load(const std::string& path);
+	// Throws std::runtime_error when the file cannot be written.
+	void Save(const std::string& path)const;
+
+	const TextureManifestEntry* Find(const std::string& name)const;
+	// Adds the entry or replaces the one with the same name.
+	void Set(const TextureManifestEntry& entry);
+	const std::vector<TextureManifestEntry>& Entries()const { return mEntries; }
+
+private:
+	std::vector<TextureManifestEntry> mEntries;
+};
+
+struct TextureCookRequest {
+	std::string Name;
+	std::string SourcePath;
+	TextureUsage Usage = TextureUsage::Color;
+	// Packed requests read R, G and B from these instead of SourcePath; an empty path
+	// takes the default.
+	std::string ChannelPaths[3];
+	uint8_t ChannelDefaults[3] = { 255, 255, 255 };
+	// Linear and packed requests: the normal map drawn with this texture.  Its spread
+	// widens the roughness of the mips (in R, or G when packed); see MipGenSettings.
+	std::string ToksvigNormalPath;
+};
+
+// Packs occlusion, roughness and metallic maps into R, G and B of one texture.  Any
+// path may be empty; missing maps are white, so the material constants apply as they are.
+TextureCookRequest OrmCookRequest(const std::string& name, const std::string& aoPath,
+	const std::string& roughnessPath, const std::string& metallicPath, const std::string& normalPath = "");
+
+// The decoded sources of a request: its image, packed from the channel files for
+// packed requests, and the Toksvig normal map when it has one.
+struct CookSource {
+	SourceImage Image;
+	SourceImage ToksvigNormals;
+};
+
+CookSource DecodeCookSource(const TextureCookRequest& request,
+	const std::function<SourceImage(const std::string&)>& decode, TaskPool& pool = TaskPool::Default());
+// How the mips of a request are filtered; points into source.
+MipGenSettings CookMipSettings(const TextureCookRequest& request, const CookSource& source);
+
+// Where the time of one request went.  The phases are wall times inside its job.
+struct TextureCookTiming {
+	std::string Name;
+	bool UpToDate = false;
+	double Seconds = 0.0;
+	// Reading and decoding the source files, packing included.
+	double DecodeSeconds = 0.0;
+	// Color space conversion and the mip chain.
+	double MipSeconds = 0.0;
+	// Block compression and writing the cooked file.
+	double EncodeSeconds = 0.0;
+};
+
+struct TextureCookStats {
+	double Seconds = 0.0;
+	uint32_t Cooked = 0;
+	uint32_t UpToDate = 0;
+	// Block compression of the cooked textures: time summed over textures, texels
+	// over all mips, and the lowest PSNR of a mip 0.
+	double EncodeSeconds = 0.0;
+	double EncodedMPixels = 0.0;
+	double MinPsnr = INFINITY;
+	// Blocks the RDO pass went through and how many of them it changed.
+	uint64_t RdoBlocks = 0;
+	uint64_t RdoChangedBlocks = 0;
+	// Bytes of the cooked textures, and of their package files.
+	uint64_t CookedBytes = 0;
+	uint64_t CookedFileBytes = 0;
+	// One per request, in request order.  JobSeconds sums their Seconds, so
+	// JobSeconds / Seconds is how much running them side by side saved.
+	std::vector<TextureCookTiming> Textures;
+	double JobSeconds = 0.0;
+};
+
+// Cooks the requests into cookedDir/<name>.pak, an asset package holding the one
+// texture in its upload layout, and saves the manifest.  A request
+// is skipped when the manifest already has it with the same source hash, usage and
+// encoding and the cooked file exists; for packed requests the source hash covers
+// every channel file and default, and for any request its Toksvig normal map.  Every
+// request is a job on the pool that hashes, decodes, builds the mips with
+// GenerateMips, compresses and writes its file, so decode must be safe to call from
+// several threads at once.  The manifest is only touched on the calling thread.  The
+// first exception thrown by a job stops the jobs not started yet and is rethrown once
+// the running ones are done, without saving the manifest.
+TextureCookStats CookTextures(const std::vector<TextureCookRequest>& requests, const std::string& cookedDir,
+	const std::string& manifestPath, const std::function<SourceImage(const std::string&)>& decode,
+	const TextureCookSettings& settings = TextureCookSettings(), TaskPool& pool = TaskPool::Default());
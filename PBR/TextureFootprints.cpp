@@ -0,0 +1,89 @@
+#include "TextureFootprints.h"
+#include <cstring>
+
+namespace {
+	uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+TextureFootprints ComputeTextureFootprints(uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t arraySize,
+	uint32_t blockBytes, uint32_t blockDim)
+{
+	// Every subresource starts at the placement alignment and every row at the pitch
+	// alignment; the last row of a subresource is not padded.
+	TextureFootprints footprints;
+	footprints.Subresources.reserve((size_t)mipLevels * arraySize);
+	uint64_t end = 0;
+	for (uint32_t item = 0; item < arraySize; item++) {
+		for (uint32_t mip = 0; mip < mipLevels; mip++) {
+			uint32_t blocksWide = ((width >> mip ? width >> mip : 1) + blockDim - 1) / blockDim;
+			uint32_t blocksHigh = ((height >> mip ? height >> mip : 1) + blockDim - 1) / blockDim;
+			SubresourceFootprint footprint;
+			footprint.Offset = AlignUp(end, kTexturePlacementAlignment);
+			footprint.Width = blocksWide * blockDim;
+			footprint.Height = blocksHigh * blockDim;
+			footprint.RowBytes = blocksWide * blockBytes;
+			footprint.RowPitch = (uint32_t)AlignUp(footprint.RowBytes, kTextureRowPitchAlignment);
+			footprint.NumRows = blocksHigh;
+			end = footprint.Offset + (uint64_t)footprint.RowPitch * (footprint.NumRows - 1) + footprint.RowBytes;
+			footprints.Subresources.push_back(footprint);
+		}
+	}
+	footprints.TotalBytes = end;
+	return footprints;
+}
+
+TextureFootprints ComputeTextureFootprints(const CompressedTexture& texture) {
+	return ComputeTextureFootprints(texture.Width(), texture.Height(), texture.MipLevels(), texture.ArraySize(),
+		texture.BlockBytes(), texture.BlockDim());
+}
+
+void CopyToFootprints(const CompressedTexture& texture, const TextureFootprints& footprints, uint8_t* dst) {
+	std::memset(dst, 0, (size_t)footprints.TotalBytes);
+	for (uint32_t item = 0; item < texture.ArraySize(); item++) {
+		for (uint32_t mip = 0; mip < texture.MipLevels(); mip++) {
+			const SubresourceFootprint& footprint = footprints.Subresources[item * texture.MipLevels() + mip];
+			const uint8_t* src = texture.Blocks(item, mip);
+			for (uint32_t row = 0; row < footprint.NumRows; row++) {
+				std::memcpy(dst + footprint.Offset + (uint64_t)row * footprint.RowPitch, src + row * texture.RowPitch(mip),
+					footprint.RowBytes);
+			}
+		}
+	}
+}
+
+bool ValidateTextureFootprints(const TextureFootprints& footprints, uint64_t size, std::string& error) {
+	uint64_t end = 0;
+	for (size_t i = 0; i < footprints.Subresources.size(); i++) {
+		const SubresourceFootprint& footprint = footprints.Subresources[i];
+		std::string where = "subresource " + std::to_string(i) + ": ";
+		if (footprint.Offset % kTexturePlacementAlignment != 0) {
+			error = where + "offset is not 512 byte aligned";
+			return false;
+		}
+		if (footprint.RowPitch % kTextureRowPitchAlignment != 0) {
+			error = where + "row pitch is not 256 byte aligned";
+			return false;
+		}
+		if (footprint.NumRows == 0 || footprint.RowBytes == 0 || footprint.RowBytes > footprint.RowPitch) {
+			error = where + "rows do not fit the pitch";
+			return false;
+		}
+		if (footprint.Offset < end) {
+			error = where + "overlaps the previous subresource";
+			return false;
+		}
+		uint64_t bytes = (uint64_t)footprint.RowPitch * (footprint.NumRows - 1) + footprint.RowBytes;
+		if (footprint.Offset > size || bytes > size - footprint.Offset) {
+			error = where + "ends past the data";
+			return false;
+		}
+		end = footprint.Offset + bytes;
+	}
+	if (footprints.TotalBytes != end) {
+		error = "total size does not match the last subresource";
+		return false;
+	}
+	return true;
+}
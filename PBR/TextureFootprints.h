@@ -0,0 +1,43 @@
+#pragma once
+#include "CompressedTexture.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// D3D12_TEXTURE_DATA_PITCH_ALIGNMENT and D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT.
+const uint32_t kTextureRowPitchAlignment = 256;
+const uint32_t kTexturePlacementAlignment = 512;
+
+// One subresource in a buffer, as D3D12_PLACED_SUBRESOURCE_FOOTPRINT describes it
+// together with the row count and row size GetCopyableFootprints returns.  Width
+// and Height are in texels, rounded up to whole blocks; rows are rows of blocks.
+struct SubresourceFootprint {
+	uint64_t Offset = 0;
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	uint32_t RowPitch = 0;
+	uint32_t NumRows = 0;
+	uint32_t RowBytes = 0;
+};
+
+// Footprints of every subresource in D3D12 subresource order, and the bytes from the
+// first to the end of the last row of the last one.
+struct TextureFootprints {
+	std::vector<SubresourceFootprint> Subresources;
+	uint64_t TotalBytes = 0;
+};
+
+// What ID3D12Device::GetCopyableFootprints returns for a 2D texture, array or cube
+// of a format with the given block size, placed from offset 0.
+TextureFootprints ComputeTextureFootprints(uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t arraySize,
+	uint32_t blockBytes, uint32_t blockDim);
+TextureFootprints ComputeTextureFootprints(const CompressedTexture& texture);
+
+// Copies the texture into dst, which holds footprints.TotalBytes bytes, row by row.
+// The padding between rows and subresources is zeroed.
+void CopyToFootprints(const CompressedTexture& texture, const TextureFootprints& footprints, uint8_t* dst);
+
+// Checks that the footprints satisfy the D3D12 copy rules and stay inside size bytes:
+// aligned offsets and pitches, rows that fit their pitch and subresources that do
+// not overlap.  Returns false with the reason in error.
+bool ValidateTextureFootprints(const TextureFootprints& footprints, uint64_t size, std::string& error);
@@ -0,0 +1,218 @@
+#include "TextureStreamer.h"
+#include <algorithm>
+
+using Microsoft::WRL::ComPtr;
+
+namespace {
+	// Mips whose larger side is at most this many texels stay resident.
+	const uint32_t kTailMipSize = 64;
+}
+
+TextureStreamer::TextureStreamer(ID3D12Device* device, ID3D12CommandQueue* queue, const MipStreamingDesc& desc)
+	: mDevice(device), mQueue(queue), mStreamer(desc)
+{
+}
+
+bool TextureStreamer::Supported(ID3D12Device* device) {
+	D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+	return SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options))) &&
+		options.TiledResourcesTier != D3D12_TILED_RESOURCES_TIER_NOT_SUPPORTED;
+}
+
+uint32_t TextureStreamer::Size(uint32_t texture)const {
+	const D3D12_RESOURCE_DESC& desc = mTextures[texture].Desc;
+	return std::max((uint32_t)desc.Width, (uint32_t)desc.Height);
+}
+
+uint32_t TextureStreamer::Add(ID3D12GraphicsCommandList* cmdList, ID3D12Resource* source) {
+	Texture texture;
+	texture.Source = source;
+	D3D12_RESOURCE_DESC sourceDesc = source->GetDesc();
+	if (sourceDesc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D || sourceDesc.DepthOrArraySize != 1) {
+		throw std::runtime_error("TextureStreamer: only single 2D textures can stream");
+	}
+	uint32_t mipLevels = sourceDesc.MipLevels;
+
+	texture.Desc = sourceDesc;
+	texture.Desc.Alignment = 0;
+	texture.Desc.Layout = D3D12_TEXTURE_LAYOUT_64KB_UNDEFINED_SWIZZLE;
+	ThrowIfFailed(mDevice->CreateReservedResource(&texture.Desc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+		IID_PPV_ARGS(texture.Resource.GetAddressOf())));
+
+	D3D12_PACKED_MIP_INFO packed;
+	std::vector<D3D12_SUBRESOURCE_TILING> tilings(mipLevels);
+	UINT tilingCount = mipLevels;
+	mDevice->GetResourceTiling(texture.Resource.Get(), nullptr, &packed, nullptr, &tilingCount, 0, tilings.data());
+	texture.Tiles.assign(mipLevels, 0);
+	for (uint32_t mip = 0; mip < packed.NumStandardMips; mip++) {
+		texture.Tiles[mip] = tilings[mip].WidthInTiles * tilings[mip].HeightInTiles * tilings[mip].DepthInTiles;
+	}
+	if (packed.NumPackedMips > 0) {
+		texture.Tiles[packed.NumStandardMips] = packed.NumTilesForPackedMips;
+	}
+	texture.TailMip = std::min((uint32_t)packed.NumStandardMips, mipLevels - 1);
+	while (texture.TailMip > 0 &&
+		std::max((uint32_t)sourceDesc.Width, sourceDesc.Height) >> (texture.TailMip - 1) <= kTailMipSize) {
+		texture.TailMip--;
+	}
+	texture.MipHeaps.resize(texture.TailMip);
+
+	StreamedTextureDesc streamed;
+	streamed.Width = (uint32_t)sourceDesc.Width;
+	streamed.Height = sourceDesc.Height;
+	streamed.TailMips = mipLevels - texture.TailMip;
+	for (uint32_t tiles : texture.Tiles) {
+		streamed.MipBytes.push_back((uint64_t)tiles * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES);
+	}
+	uint32_t index = mStreamer.AddTexture(streamed);
+
+	// The tail shares one heap.  The mapping is a queue operation, so it lands before
+	// the command list recording the copies is executed.
+	uint32_t tailTiles = 0;
+	for (uint32_t mip = texture.TailMip; mip < mipLevels; mip++) {
+		tailTiles += texture.Tiles[mip];
+	}
+	texture.TailHeap = CreateHeap(tailTiles);
+	uint32_t heapTile = 0;
+	for (uint32_t mip = texture.TailMip; mip < mipLevels; mip++) {
+		if (texture.Tiles[mip] != 0) {
+			MapTiles(texture, mip, texture.TailHeap.Get(), heapTile);
+			heapTile += texture.Tiles[mip];
+		}
+	}
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(source,
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_SOURCE));
+	for (uint32_t mip = texture.TailMip; mip < mipLevels; mip++) {
+		CD3DX12_TEXTURE_COPY_LOCATION dst(texture.Resource.Get(), mip);
+		CD3DX12_TEXTURE_COPY_LOCATION src(source, mip);
+		cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+	}
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.Resource.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+	if (texture.TailMip > 0) {
+		texture.Footprints.resize(texture.TailMip);
+		UINT64 bytes = 0;
+		mDevice->GetCopyableFootprints(&sourceDesc, 0, texture.TailMip, 0, texture.Footprints.data(), nullptr, nullptr, &bytes);
+		ThrowIfFailed(mDevice->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(bytes),
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(texture.Readback.GetAddressOf())));
+		texture.Texels.resize((size_t)bytes);
+		for (uint32_t mip = 0; mip < texture.TailMip; mip++) {
+			CD3DX12_TEXTURE_COPY_LOCATION dst(texture.Readback.Get(), texture.Footprints[mip]);
+			CD3DX12_TEXTURE_COPY_LOCATION src(source, mip);
+			cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+		}
+	}
+
+	mTextures.push_back(std::move(texture));
+	return index;
+}
+
+void TextureStreamer::FinishAdds() {
+	for (Texture& texture : mTextures) {
+		if (texture.Readback) {
+			D3D12_RANGE range = { 0, texture.Texels.size() };
+			UINT8* data = nullptr;
+			ThrowIfFailed(texture.Readback->Map(0, &range, reinterpret_cast<void**>(&data)));
+			std::copy(data, data + texture.Texels.size(), texture.Texels.begin());
+			D3D12_RANGE written = { 0, 0 };
+			texture.Readback->Unmap(0, &written);
+		}
+		texture.Readback.Reset();
+		texture.Source.Reset();
+	}
+}
+
+void TextureStreamer::Update(uint64_t completedFence, uint64_t nextFence, std::vector<uint32_t>& changed) {
+	changed.clear();
+	auto landed = std::stable_partition(mInFlight.begin(), mInFlight.end(),
+		[&](const Load& load) { return load.Fence > completedFence; });
+	for (auto it = landed; it != mInFlight.end(); ++it) {
+		mStreamer.LoadFinished(it->Texture, it->Mip);
+		changed.push_back(it->Texture);
+	}
+	mInFlight.erase(landed, mInFlight.end());
+	mRetiredHeaps.erase(std::remove_if(mRetiredHeaps.begin(), mRetiredHeaps.end(),
+		[&](const std::pair<ComPtr<ID3D12Heap>, uint64_t>& heap) { return heap.second <= completedFence; }),
+		mRetiredHeaps.end());
+
+	for (const MipStreamCommand& command : mStreamer.Update()) {
+		Texture& texture = mTextures[command.Texture];
+		if (command.Action == MipStreamAction::Drop) {
+			// The frames in flight were recorded with views that still sample the mip;
+			// the unmap runs after them on the queue.
+			MapTiles(texture, command.Mip, nullptr, 0);
+			mRetiredHeaps.push_back({ std::move(texture.MipHeaps[command.Mip]), nextFence });
+			changed.push_back(command.Texture);
+		}
+		else {
+			texture.MipHeaps[command.Mip] = CreateHeap(texture.Tiles[command.Mip]);
+			MapTiles(texture, command.Mip, texture.MipHeaps[command.Mip].Get(), 0);
+			mUnrecorded.push_back({ command.Texture, command.Mip, nextFence, nullptr });
+		}
+	}
+
+	std::sort(changed.begin(), changed.end());
+	changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+}
+
+void TextureStreamer::RecordUploads(ID3D12GraphicsCommandList* cmdList) {
+	for (Load& load : mUnrecorded) {
+		const Texture& texture = mTextures[load.Texture];
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = texture.Footprints[load.Mip];
+		UINT64 end = load.Mip + 1 < texture.Footprints.size() ? texture.Footprints[load.Mip + 1].Offset : texture.Texels.size();
+		UINT64 bytes = end - footprint.Offset;
+
+		ThrowIfFailed(mDevice->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(bytes),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(load.Uploader.GetAddressOf())));
+		UINT8* data = nullptr;
+		ThrowIfFailed(load.Uploader->Map(0, nullptr, reinterpret_cast<void**>(&data)));
+		std::copy(texture.Texels.begin() + (size_t)footprint.Offset, texture.Texels.begin() + (size_t)end, data);
+		load.Uploader->Unmap(0, nullptr);
+
+		footprint.Offset = 0;
+		CD3DX12_TEXTURE_COPY_LOCATION dst(texture.Resource.Get(), load.Mip);
+		CD3DX12_TEXTURE_COPY_LOCATION src(load.Uploader.Get(), footprint);
+		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.Resource.Get(),
+			D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST, load.Mip));
+		cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.Resource.Get(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, load.Mip));
+		mInFlight.push_back(std::move(load));
+	}
+	mUnrecorded.clear();
+}
+
+void TextureStreamer::MapTiles(const Texture& texture, uint32_t mip, ID3D12Heap* heap, uint32_t heapTile) {
+	// The packed mips are mapped as one run of tiles from their first subresource.
+	D3D12_TILED_RESOURCE_COORDINATE coordinate = {};
+	coordinate.Subresource = mip;
+	D3D12_TILE_REGION_SIZE region = {};
+	region.NumTiles = texture.Tiles[mip];
+	D3D12_TILE_RANGE_FLAGS flags = heap ? D3D12_TILE_RANGE_FLAG_NONE : D3D12_TILE_RANGE_FLAG_NULL;
+	UINT rangeTiles = region.NumTiles;
+	mQueue->UpdateTileMappings(texture.Resource.Get(), 1, &coordinate, &region, heap, 1, &flags,
+		heap ? &heapTile : nullptr, &rangeTiles, D3D12_TILE_MAPPING_FLAG_NONE);
+}
+
+ComPtr<ID3D12Heap> TextureStreamer::CreateHeap(uint32_t tiles) {
+	D3D12_HEAP_DESC desc = {};
+	desc.SizeInBytes = (UINT64)tiles * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+	desc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+	desc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	desc.Flags = D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES;
+	ComPtr<ID3D12Heap> heap;
+	ThrowIfFailed(mDevice->CreateHeap(&desc, IID_PPV_ARGS(heap.GetAddressOf())));
+	return heap;
+}
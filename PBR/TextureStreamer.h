@@ -0,0 +1,88 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "MipStreaming.h"
+
+// Streams the mips of 2D textures under the byte budget of a MipStreamer.  Each
+// texture becomes a reserved resource whose mip tail (the packed mips and the mips
+// of 64 texels and below) is always mapped; the finer mips get a heap of their own
+// when the streamer loads them and give it back when it drops them.  The texels of
+// the streamed mips are kept in system memory, which stands in for the disk.
+//
+// Loads map their tiles and copy the mip from an upload buffer in the frame's
+// command list, and become visible once the GPU has passed the frame's fence.
+// Views should clamp their min LOD to ResidentMip, so that no unmapped mip is
+// ever sampled.
+class TextureStreamer {
+public:
+	TextureStreamer(ID3D12Device* device, ID3D12CommandQueue* queue, const MipStreamingDesc& desc);
+	TextureStreamer(const TextureStreamer& rhs) = delete;
+	TextureStreamer& operator=(const TextureStreamer& rhs) = delete;
+
+	// Whether the device has the tiled resources reserved resources need.
+	static bool Supported(ID3D12Device* device);
+
+	// Records the copy of source, a 2D texture in the pixel shader resource state,
+	// into a new reserved resource with only its tail mapped, and into the readback
+	// buffer its streamed mips are kept from.  Call FinishAdds once the GPU has run
+	// the commands.
+	uint32_t Add(ID3D12GraphicsCommandList* cmdList, ID3D12Resource* source);
+	// Moves the streamed mips of the added textures out of their readback buffers
+	// and releases the sources.
+	void FinishAdds();
+
+	MipStreamer& Streamer() { return mStreamer; }
+	ID3D12Resource* Resource(uint32_t texture)const { return mTextures[texture].Resource.Get(); }
+	uint32_t Size(uint32_t texture)const;
+	uint32_t ResidentMip(uint32_t texture)const { return mStreamer.ResidentMip(texture); }
+
+	// Finishes the loads the GPU has passed completedFence on, then runs the streamer
+	// on the requests made since its BeginFrame.  Drops unmap their mip after the
+	// frames already submitted; loads map theirs and wait for RecordUploads.  Both
+	// take effect for the commands submitted next, whose fence is nextFence.  changed
+	// receives the textures whose ResidentMip moved.
+	void Update(uint64_t completedFence, uint64_t nextFence, std::vector<uint32_t>& changed);
+	// Records the copies of the loads started by the last Update.
+	void RecordUploads(ID3D12GraphicsCommandList* cmdList);
+
+private:
+	struct Texture {
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+		D3D12_RESOURCE_DESC Desc;
+		uint32_t TailMip = 0;
+		// Tiles of each mip; the packed mips are counted on the first of them.
+		std::vector<uint32_t> Tiles;
+		Microsoft::WRL::ComPtr<ID3D12Heap> TailHeap;
+		// Heaps of the resident streamed mips, by mip.
+		std::vector<Microsoft::WRL::ComPtr<ID3D12Heap>> MipHeaps;
+
+		// The streamed mips in the layout of GetCopyableFootprints from offset 0.
+		std::vector<uint8_t> Texels;
+		std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> Footprints;
+
+		// Until FinishAdds.
+		Microsoft::WRL::ComPtr<ID3D12Resource> Source;
+		Microsoft::WRL::ComPtr<ID3D12Resource> Readback;
+	};
+
+	struct Load {
+		uint32_t Texture;
+		uint32_t Mip;
+		uint64_t Fence;
+		Microsoft::WRL::ComPtr<ID3D12Resource> Uploader;
+	};
+
+	void MapTiles(const Texture& texture, uint32_t mip, ID3D12Heap* heap, uint32_t heapTile);
+	Microsoft::WRL::ComPtr<ID3D12Heap> CreateHeap(uint32_t tiles);
+
+private:
+	ID3D12Device* mDevice;
+	ID3D12CommandQueue* mQueue;
+	MipStreamer mStreamer;
+	std::vector<Texture> mTextures;
+
+	// Loads waiting for RecordUploads, then for their fence.
+	std::vector<Load> mUnrecorded;
+	std::vector<Load> mInFlight;
+	// Heaps of dropped mips, released once the GPU passes the fence of their unmap.
+	std::vector<std::pair<Microsoft::WRL::ComPtr<ID3D12Heap>, uint64_t>> mRetiredHeaps;
+};
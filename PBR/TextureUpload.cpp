@@ -0,0 +1,153 @@
+#include "TextureUpload.h"
+#include "HDRPacking.h"
+
+void CreateTextureCubeFromImage(
+	ID3D12Device* device,
+	DirectX::ResourceUploadBatch& resUpload,
+	const CubeMapImage& image,
+	ID3D12Resource** texture,
+	DXGI_FORMAT format)
+{
+	UINT texelBytes = HDRTexelBytes(format);
+	if (texelBytes == 0) {
+		throw std::runtime_error("cube map format " + std::to_string(format) + " is not an HDR format");
+	}
+
+	D3D12_RESOURCE_DESC texDesc;
+	ZeroMemory(&texDesc, sizeof(texDesc));
+	texDesc.Width = image.Size();
+	texDesc.Height = image.Size();
+	texDesc.Format = format;
+	texDesc.DepthOrArraySize = 6;
+	texDesc.MipLevels = image.MipLevels();
+	texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	texDesc.Alignment = 0;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	texDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(texture)
+	));
+
+	// CubeMapImage already stores faces and mips in subresource order.  Other formats
+	// are packed first; Upload copies the data into its own buffer before returning.
+	std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+	std::vector<std::vector<uint8_t>> packed;
+	for (UINT face = 0; face < 6; face++) {
+		for (UINT mip = 0; mip < image.MipLevels(); mip++) {
+			size_t texels = (size_t)image.MipSize(mip) * image.MipSize(mip);
+			D3D12_SUBRESOURCE_DATA data;
+			data.pData = image.Texels(face, mip);
+			if (format != DXGI_FORMAT_R32G32B32A32_FLOAT) {
+				packed.emplace_back(texels * texelBytes);
+				PackHDRTexels(format, image.Texels(face, mip), texels, packed.back().data());
+				data.pData = packed.back().data();
+			}
+			data.RowPitch = (LONG_PTR)image.MipSize(mip) * texelBytes;
+			data.SlicePitch = data.RowPitch * image.MipSize(mip);
+			subresources.push_back(data);
+		}
+	}
+
+	resUpload.Upload(*texture, 0, subresources.data(), (UINT)subresources.size());
+	resUpload.Transition(*texture, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+}
+
+void CreateTexture2DFromImage(
+	ID3D12Device* device,
+	DirectX::ResourceUploadBatch& resUpload,
+	const CompressedTexture& texture,
+	ID3D12Resource** resource)
+{
+	D3D12_RESOURCE_DESC texDesc = CD3DX12_RESOURCE_DESC::Tex2D((DXGI_FORMAT)texture.DxgiFormat(),
+		texture.Width(), texture.Height(), (UINT16)texture.ArraySize(), (UINT16)texture.MipLevels());
+
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(resource)
+	));
+
+	// Subresource index mip + item * MipLevels, the order of the items' blocks.
+	std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+	for (UINT item = 0; item < texture.ArraySize(); item++) {
+		for (UINT mip = 0; mip < texture.MipLevels(); mip++) {
+			D3D12_SUBRESOURCE_DATA data;
+			data.pData = texture.Blocks(item, mip);
+			data.RowPitch = (LONG_PTR)texture.RowPitch(mip);
+			data.SlicePitch = (LONG_PTR)texture.SubresourceBytes(mip);
+			subresources.push_back(data);
+		}
+	}
+
+	resUpload.Upload(*resource, 0, subresources.data(), (UINT)subresources.size());
+	resUpload.Transition(*resource, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+}
+
+void CreateTextureFromPackage(
+	ID3D12Device* device,
+	ID3D12GraphicsCommandList* cmdList,
+	const AssetPackage& package,
+	const AssetEntry& entry,
+	ID3D12Resource** texture,
+	ID3D12Resource** uploader,
+	uint8_t** mapped)
+{
+	const PackageTextureDesc& desc = entry.Texture;
+	D3D12_RESOURCE_DESC texDesc = CD3DX12_RESOURCE_DESC::Tex2D((DXGI_FORMAT)desc.DxgiFormat,
+		desc.Width, desc.Height, (UINT16)desc.ArraySize, (UINT16)desc.MipLevels);
+
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(texture)
+	));
+
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(entry.Size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(uploader)
+	));
+
+	BYTE* memory = nullptr;
+	ThrowIfFailed((*uploader)->Map(0, nullptr, reinterpret_cast<void**>(&memory)));
+	if (mapped) {
+		*mapped = memory;
+	}
+	else {
+		package.Read(entry, memory);
+		(*uploader)->Unmap(0, nullptr);
+	}
+
+	// The package validated the footprints against the copy alignment rules, so they
+	// are used as they are instead of asking the device.
+	UINT count = (UINT)entry.Footprints.Subresources.size();
+	for (UINT i = 0; i < count; i++) {
+		CD3DX12_TEXTURE_COPY_LOCATION dst(*texture, i);
+		const SubresourceFootprint& footprint = entry.Footprints.Subresources[i];
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout;
+		layout.Offset = footprint.Offset;
+		layout.Footprint = CD3DX12_SUBRESOURCE_FOOTPRINT((DXGI_FORMAT)desc.DxgiFormat, footprint.Width,
+			footprint.Height, 1, footprint.RowPitch);
+		CD3DX12_TEXTURE_COPY_LOCATION src(*uploader, layout);
+		cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+	}
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(*texture,
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+}
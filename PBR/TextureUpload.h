@@ -0,0 +1,39 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "AssetPackage.h"
+#include "CubeMapImage.h"
+#include "CompressedTexture.h"
+
+// Creates a TextureCube with the image's full mip chain and queues the upload of
+// every face and mip on the batch.  format is R32G32B32A32_FLOAT or one of the
+// compact HDR formats HDRPacking converts to, which take 1/2 or 1/4 of the upload.
+void CreateTextureCubeFromImage(
+	ID3D12Device* device,
+	DirectX::ResourceUploadBatch& resUpload,
+	const CubeMapImage& image,
+	ID3D12Resource** texture,
+	DXGI_FORMAT format = DXGI_FORMAT_R32G32B32A32_FLOAT);
+
+// Creates a Texture2D in the format of texture, with its full mip chain and every
+// array item (the six faces of a cube), and queues the upload of all of them on the
+// batch.
+void CreateTexture2DFromImage(
+	ID3D12Device* device,
+	DirectX::ResourceUploadBatch& resUpload,
+	const CompressedTexture& texture,
+	ID3D12Resource** resource);
+
+// Creates the texture of a package entry and records its upload on cmdList.  The
+// entry is already laid out by its footprints, so it goes into the upload buffer
+// with one copy or decompression.  uploader has to stay alive until the list has run.
+// Given mapped, the read is left to the caller: it receives the upload buffer's
+// memory, mapped for as long as uploader lives, which package.Read has to fill
+// before the list runs.  That way many entries can be decompressed at once.
+void CreateTextureFromPackage(
+	ID3D12Device* device,
+	ID3D12GraphicsCommandList* cmdList,
+	const AssetPackage& package,
+	const AssetEntry& entry,
+	ID3D12Resource** texture,
+	ID3D12Resource** uploader,
+	uint8_t** mapped = nullptr);
@@ -0,0 +1,465 @@
+#include "VirtualTexture.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+namespace {
+	const uint32_t kMaxTextures = 1u << 8;
+	const uint32_t kMaxMips = 1u << 4;
+	const uint32_t kMaxPagesPerAxis = 1u << 10;
+	const uint32_t kTraceMagic = 0x42465456; // "VTFB"
+	const uint32_t kTraceVersion = 1;
+
+	uint32_t PagesAlong(uint32_t size, uint32_t mip, uint32_t pageSize) {
+		uint32_t extent = std::max(size >> mip, 1u);
+		return (extent + pageSize - 1) / pageSize;
+	}
+
+	// Mips down to the first one that fits in a single page; smaller ones live in
+	// that page too.
+	uint32_t PageMipLevels(uint32_t width, uint32_t height, uint32_t pageSize) {
+		uint32_t mips = 1;
+		while (PagesAlong(width, mips - 1, pageSize) > 1 || PagesAlong(height, mips - 1, pageSize) > 1) {
+			mips++;
+		}
+		return mips;
+	}
+
+	void WriteU32(std::ofstream& file, uint32_t value) {
+		file.write((const char*)&value, sizeof(value));
+	}
+
+	uint32_t ReadU32(std::ifstream& file, const std::string& path) {
+		uint32_t value;
+		if (!file.read((char*)&value, sizeof(value))) {
+			throw std::runtime_error("Unexpected end of file in " + path);
+		}
+		return value;
+	}
+}
+
+uint32_t PackFeedback(const VirtualPage& page) {
+	return page.Texture << 24 | page.Mip << 20 | page.X << 10 | page.Y;
+}
+
+VirtualPage UnpackFeedback(uint32_t word) {
+	VirtualPage page;
+	page.Texture = word >> 24;
+	page.Mip = (word >> 20) & 0xf;
+	page.X = (word >> 10) & 0x3ff;
+	page.Y = word & 0x3ff;
+	return page;
+}
+
+VirtualTextureCache::VirtualTextureCache(const VirtualTextureCacheDesc& desc) : mDesc(desc) {
+	mDesc.PageSize = std::max(mDesc.PageSize, 1u);
+	mDesc.Slots = std::max(mDesc.Slots, 1u);
+	mSlots.resize(mDesc.Slots);
+	// Popped from the back, so the lowest slots fill first.
+	for (uint32_t slot = mDesc.Slots; slot-- > 0;) {
+		mFreeSlots.push_back(slot);
+	}
+}
+
+uint32_t VirtualTextureCache::AddTexture(uint32_t width, uint32_t height) {
+	if (mTextures.size() == kMaxTextures) {
+		throw std::runtime_error("VirtualTextureCache: too many textures");
+	}
+	if (width == 0 || height == 0 || PagesAlong(width, 0, mDesc.PageSize) > kMaxPagesPerAxis ||
+		PagesAlong(height, 0, mDesc.PageSize) > kMaxPagesPerAxis) {
+		throw std::runtime_error("VirtualTextureCache: bad texture size " + std::to_string(width) + "x" +
+			std::to_string(height));
+	}
+	uint32_t mipLevels = PageMipLevels(width, height, mDesc.PageSize);
+	if (mipLevels > kMaxMips) {
+		throw std::runtime_error("VirtualTextureCache: too many mips");
+	}
+
+	TextureState texture;
+	for (uint32_t mip = 0; mip < mipLevels; mip++) {
+		MipPages pages;
+		pages.PagesWide = PagesAlong(width, mip, mDesc.PageSize);
+		pages.PagesHigh = PagesAlong(height, mip, mDesc.PageSize);
+		pages.Slots.assign((size_t)pages.PagesWide * pages.PagesHigh, kPageNotResident);
+		texture.Mips.push_back(pages);
+	}
+	if (mFreeSlots.empty()) {
+		throw std::runtime_error("VirtualTextureCache: no slot left to pin the coarsest mip");
+	}
+	mTextures.push_back(texture);
+
+	// The coarsest mip is a single page.
+	PageMapping pinned;
+	pinned.Page.Texture = (uint32_t)mTextures.size() - 1;
+	pinned.Page.Mip = mipLevels - 1;
+	pinned.Slot = mFreeSlots.back();
+	mFreeSlots.pop_back();
+	SlotOf(pinned.Page) = pinned.Slot;
+	mSlots[pinned.Slot].Key = PackFeedback(pinned.Page);
+	mSlots[pinned.Slot].Pinned = true;
+	mPinned.push_back(pinned);
+	return pinned.Page.Texture;
+}
+
+bool VirtualTextureCache::IsValid(const VirtualPage& page)const {
+	if (page.Texture >= mTextures.size() || page.Mip >= mTextures[page.Texture].Mips.size()) {
+		return false;
+	}
+	const MipPages& pages = mTextures[page.Texture].Mips[page.Mip];
+	return page.X < pages.PagesWide && page.Y < pages.PagesHigh;
+}
+
+uint32_t& VirtualTextureCache::SlotOf(const VirtualPage& page) {
+	MipPages& pages = mTextures[page.Texture].Mips[page.Mip];
+	return pages.Slots[(size_t)page.Y * pages.PagesWide + page.X];
+}
+
+uint32_t VirtualTextureCache::SlotOf(const VirtualPage& page)const {
+	const MipPages& pages = mTextures[page.Texture].Mips[page.Mip];
+	return pages.Slots[(size_t)page.Y * pages.PagesWide + page.X];
+}
+
+VirtualPage VirtualTextureCache::Parent(const VirtualPage& page)const {
+	// Rounding can leave the last page of a mip without a parent of its own; the
+	// last page of the next mip covers it.
+	VirtualPage parent = page;
+	parent.Mip++;
+	const MipPages& pages = mTextures[page.Texture].Mips[parent.Mip];
+	parent.X = std::min(page.X / 2, pages.PagesWide - 1);
+	parent.Y = std::min(page.Y / 2, pages.PagesHigh - 1);
+	return parent;
+}
+
+void VirtualTextureCache::Unlink(uint32_t slot) {
+	SlotState& state = mSlots[slot];
+	if (state.Prev != kPageNotResident) {
+		mSlots[state.Prev].Next = state.Next;
+	}
+	else {
+		mLruHead = state.Next;
+	}
+	if (state.Next != kPageNotResident) {
+		mSlots[state.Next].Prev = state.Prev;
+	}
+	else {
+		mLruTail = state.Prev;
+	}
+	state.Prev = kPageNotResident;
+	state.Next = kPageNotResident;
+}
+
+void VirtualTextureCache::LinkBack(uint32_t slot) {
+	SlotState& state = mSlots[slot];
+	state.Prev = mLruTail;
+	state.Next = kPageNotResident;
+	if (mLruTail != kPageNotResident) {
+		mSlots[mLruTail].Next = slot;
+	}
+	else {
+		mLruHead = slot;
+	}
+	mLruTail = slot;
+}
+
+void VirtualTextureCache::Touch(uint32_t slot) {
+	SlotState& state = mSlots[slot];
+	if (state.LastUsed == mFrame) {
+		return;
+	}
+	state.LastUsed = mFrame;
+	if (!state.Pinned) {
+		Unlink(slot);
+		LinkBack(slot);
+	}
+}
+
+uint32_t VirtualTextureCache::AllocateSlot(VirtualTextureUpdate& update) {
+	if (!mFreeSlots.empty()) {
+		uint32_t slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+		return slot;
+	}
+	// Pages used this frame sit at the back, so a used head means all of them are.
+	uint32_t slot = mLruHead;
+	if (slot == kPageNotResident || mSlots[slot].LastUsed == mFrame) {
+		return kPageNotResident;
+	}
+	VirtualPage evicted = UnpackFeedback(mSlots[slot].Key);
+	SlotOf(evicted) = kPageNotResident;
+	Unlink(slot);
+	update.Evictions.push_back(evicted);
+	mStats.Evictions++;
+	return slot;
+}
+
+void VirtualTextureCache::AddRequest(const VirtualPage& page, uint64_t pixels) {
+	Request& request = mRequests[PackFeedback(page)];
+	if (request.LastRequested != mFrame) {
+		request.Page = page;
+		request.Pixels = 0;
+		request.LastRequested = mFrame;
+	}
+	request.Pixels += pixels;
+}
+
+VirtualTextureUpdate VirtualTextureCache::Update(const uint32_t* feedback, size_t count) {
+	VirtualTextureUpdate update;
+	mFrame++;
+	mStats.Frames++;
+	mStats.FeedbackWords += count;
+
+	update.Loads.assign(mPinned.begin() + mPinnedReported, mPinned.end());
+	mPinnedReported = mPinned.size();
+	for (const PageMapping& pinned : update.Loads) {
+		mSlots[pinned.Slot].LastUsed = mFrame;
+	}
+
+	// Sorting brings the repeats of a page together, and is deterministic where a
+	// hash map would not be.
+	mScratch.clear();
+	for (size_t i = 0; i < count; i++) {
+		if (feedback[i] != kNoFeedback && IsValid(UnpackFeedback(feedback[i]))) {
+			mScratch.push_back(feedback[i]);
+		}
+	}
+	std::sort(mScratch.begin(), mScratch.end());
+
+	for (size_t i = 0; i < mScratch.size();) {
+		size_t end = i + 1;
+		while (end < mScratch.size() && mScratch[end] == mScratch[i]) {
+			end++;
+		}
+		uint64_t pixels = end - i;
+		VirtualPage page = UnpackFeedback(mScratch[i]);
+		i = end;
+
+		mStats.RequestedPages++;
+		uint32_t slot = SlotOf(page);
+		if (slot != kPageNotResident) {
+			mStats.Hits++;
+			Touch(slot);
+			continue;
+		}
+		mStats.Misses++;
+
+		// Queue the page and its missing ancestors, and keep the resident ancestor that
+		// stands in for them in use.  The pinned coarsest mip ends the walk.
+		AddRequest(page, pixels);
+		for (VirtualPage parent = Parent(page);; parent = Parent(parent)) {
+			uint32_t parentSlot = SlotOf(parent);
+			if (parentSlot != kPageNotResident) {
+				Touch(parentSlot);
+				break;
+			}
+			AddRequest(parent, pixels);
+		}
+	}
+
+	// Drop requests the feedback stopped asking for, then load coarse mips first, the
+	// ones asked for this frame before older ones, then by the pixels they cover.
+	std::vector<Request> queue;
+	for (auto it = mRequests.begin(); it != mRequests.end();) {
+		if (mFrame - it->second.LastRequested >= mDesc.RequestLifetime) {
+			it = mRequests.erase(it);
+		}
+		else {
+			queue.push_back(it->second);
+			++it;
+		}
+	}
+	std::sort(queue.begin(), queue.end(), [](const Request& a, const Request& b) {
+		if (a.Page.Mip != b.Page.Mip) {
+			return a.Page.Mip > b.Page.Mip;
+		}
+		if (a.LastRequested != b.LastRequested) {
+			return a.LastRequested > b.LastRequested;
+		}
+		if (a.Pixels != b.Pixels) {
+			return a.Pixels > b.Pixels;
+		}
+		return PackFeedback(a.Page) < PackFeedback(b.Page);
+	});
+
+	uint32_t loads = 0;
+	for (size_t i = 0; i < queue.size() && loads < mDesc.MaxLoadsPerFrame; i++) {
+		const VirtualPage& page = queue[i].Page;
+		// A page only maps under a resident parent, so a lookup never skips a level
+		// that was evicted; the parent is queued again from the next feedback.
+		uint32_t parentSlot = SlotOf(Parent(page));
+		if (parentSlot == kPageNotResident) {
+			continue;
+		}
+		// Keeps the parent from being evicted for its own child.
+		Touch(parentSlot);
+		uint32_t slot = AllocateSlot(update);
+		if (slot == kPageNotResident) {
+			mStats.Starved += std::min<size_t>(queue.size() - i, mDesc.MaxLoadsPerFrame - loads);
+			break;
+		}
+
+		SlotOf(page) = slot;
+		SlotState& state = mSlots[slot];
+		state.Key = PackFeedback(page);
+		state.LastUsed = mFrame;
+		LinkBack(slot);
+		update.Loads.push_back({ page, slot });
+		mRequests.erase(state.Key);
+		mStats.Loads++;
+		loads++;
+	}
+	return update;
+}
+
+uint32_t VirtualTextureCache::Slot(const VirtualPage& page)const {
+	return IsValid(page) ? SlotOf(page) : kPageNotResident;
+}
+
+PageTableEntry VirtualTextureCache::Lookup(const VirtualPage& page)const {
+	PageTableEntry entry;
+	if (!IsValid(page)) {
+		return entry;
+	}
+	VirtualPage current = page;
+	for (;;) {
+		uint32_t slot = SlotOf(current);
+		if (slot != kPageNotResident || current.Mip + 1 == mTextures[page.Texture].Mips.size()) {
+			entry.Slot = slot;
+			entry.Mip = current.Mip;
+			return entry;
+		}
+		current = Parent(current);
+	}
+}
+
+void VirtualTextureCache::BuildPageTable(uint32_t texture, uint32_t mip, std::vector<PageTableEntry>& entries)const {
+	const MipPages& pages = mTextures[texture].Mips[mip];
+	entries.resize((size_t)pages.PagesWide * pages.PagesHigh);
+	VirtualPage page;
+	page.Texture = texture;
+	page.Mip = mip;
+	for (page.Y = 0; page.Y < pages.PagesHigh; page.Y++) {
+		for (page.X = 0; page.X < pages.PagesWide; page.X++) {
+			entries[(size_t)page.Y * pages.PagesWide + page.X] = Lookup(page);
+		}
+	}
+}
+
+void SaveFeedbackTrace(const std::string& path, const FeedbackTrace& trace) {
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		throw std::runtime_error("Cannot create " + path);
+	}
+	WriteU32(file, kTraceMagic);
+	WriteU32(file, kTraceVersion);
+	WriteU32(file, (uint32_t)trace.TextureSizes.size());
+	for (uint32_t size : trace.TextureSizes) {
+		WriteU32(file, size);
+	}
+	WriteU32(file, (uint32_t)trace.Frames.size());
+	for (const std::vector<uint32_t>& frame : trace.Frames) {
+		WriteU32(file, (uint32_t)frame.size());
+		file.write((const char*)frame.data(), frame.size() * sizeof(uint32_t));
+	}
+	if (!file) {
+		throw std::runtime_error("Failed writing " + path);
+	}
+}
+
+FeedbackTrace LoadFeedbackTrace(const std::string& path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Cannot open " + path);
+	}
+	if (ReadU32(file, path) != kTraceMagic || ReadU32(file, path) != kTraceVersion) {
+		throw std::runtime_error(path + " is not a feedback trace");
+	}
+
+	FeedbackTrace trace;
+	trace.TextureSizes.resize(ReadU32(file, path));
+	for (uint32_t& size : trace.TextureSizes) {
+		size = ReadU32(file, path);
+	}
+	trace.Frames.resize(ReadU32(file, path));
+	for (std::vector<uint32_t>& frame : trace.Frames) {
+		frame.resize(ReadU32(file, path));
+		if (!file.read((char*)frame.data(), frame.size() * sizeof(uint32_t))) {
+			throw std::runtime_error("Unexpected end of file in " + path);
+		}
+	}
+	return trace;
+}
+
+FeedbackTrace MakePanningTrace(uint32_t textureCount, uint32_t size, uint32_t frames,
+	uint32_t width, uint32_t height, uint32_t pageSize, uint32_t seed)
+{
+	const double kPi = 3.14159265358979323846;
+	FeedbackTrace trace;
+	for (uint32_t i = 0; i < textureCount; i++) {
+		trace.TextureSizes.push_back(size);
+		trace.TextureSizes.push_back(size);
+	}
+	uint32_t mipLevels = PageMipLevels(size, size, pageSize);
+	// Raw engine output only: the distributions are not the same on every library.
+	std::mt19937 rng(seed);
+
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		double t = frames > 1 ? (double)frame / (frames - 1) : 0.0;
+		// The view center crosses the row of textures while the viewer moves between
+		// one and sixteen texels per pixel.
+		double centerX = t * textureCount * size;
+		double centerY = size * (0.5 + 0.3 * std::sin(2.0 * kPi * 3.0 * t));
+		double lod = 2.0 + 2.0 * std::sin(2.0 * kPi * 5.0 * t);
+		double texelsPerPixel = std::exp2(lod);
+
+		std::vector<uint32_t> feedback((size_t)width * height, kNoFeedback);
+		for (uint32_t py = 0; py < height; py++) {
+			// Lower rows are closer to the viewer, as on a floor seen at an angle.
+			double rowLod = lod + 1.5 * (0.5 - (double)py / height);
+			double y = centerY + ((double)py - height * 0.5) * texelsPerPixel;
+			for (uint32_t px = 0; px < width; px++) {
+				double x = centerX + ((double)px - width * 0.5) * texelsPerPixel;
+				if (x < 0.0 || y < 0.0 || x >= (double)textureCount * size || y >= size) {
+					continue;
+				}
+				// Some pixels ask for one mip finer, like the edges of anisotropic footprints.
+				double pixelLod = rowLod - ((rng() & 7) == 0 ? 1.0 : 0.0);
+				VirtualPage page;
+				page.Texture = (uint32_t)(x / size);
+				page.Mip = (uint32_t)std::min(std::max(pixelLod, 0.0), (double)(mipLevels - 1));
+				uint32_t texelX = ((uint32_t)x - page.Texture * size) >> page.Mip;
+				uint32_t texelY = (uint32_t)y >> page.Mip;
+				page.X = std::min(texelX / pageSize, PagesAlong(size, page.Mip, pageSize) - 1);
+				page.Y = std::min(texelY / pageSize, PagesAlong(size, page.Mip, pageSize) - 1);
+				feedback[(size_t)py * width + px] = PackFeedback(page);
+			}
+		}
+		trace.Frames.push_back(std::move(feedback));
+	}
+	return trace;
+}
+
+VirtualTextureReplayStats ReplayFeedbackTrace(const FeedbackTrace& trace, const VirtualTextureCacheDesc& desc) {
+	VirtualTextureCache cache(desc);
+	for (size_t i = 0; i + 1 < trace.TextureSizes.size(); i += 2) {
+		cache.AddTexture(trace.TextureSizes[i], trace.TextureSizes[i + 1]);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (const std::vector<uint32_t>& frame : trace.Frames) {
+		cache.Update(frame.data(), frame.size());
+	}
+
+	VirtualTextureReplayStats stats;
+	stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stats.Cache = cache.Stats();
+	if (stats.Seconds > 0.0) {
+		stats.MWordsPerSecond = stats.Cache.FeedbackWords / stats.Seconds * 1e-6;
+	}
+	if (stats.Cache.RequestedPages != 0) {
+		stats.HitRate = (double)stats.Cache.Hits / stats.Cache.RequestedPages;
+	}
+	return stats;
+}
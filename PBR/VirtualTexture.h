@@ -0,0 +1,189 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One tile of one mip of a virtual texture.
+struct VirtualPage {
+	uint32_t Texture = 0;
+	uint32_t Mip = 0;
+	uint32_t X = 0;
+	uint32_t Y = 0;
+};
+
+// The 32 bit word the feedback pass writes per pixel: 8 bits texture, 4 bits mip,
+// then 10 bits each of page x and y.  Pixels that sample no virtual texture write
+// kNoFeedback.
+const uint32_t kNoFeedback = 0xffffffffu;
+uint32_t PackFeedback(const VirtualPage& page);
+VirtualPage UnpackFeedback(uint32_t word);
+
+const uint32_t kPageNotResident = 0xffffffffu;
+
+// Where the texels of a page come from: its own slot, or the slot of the finest
+// resident page of a coarser mip that covers it.  Mip tells the shader which.
+struct PageTableEntry {
+	uint32_t Slot = kPageNotResident;
+	uint32_t Mip = 0;
+};
+
+struct PageMapping {
+	VirtualPage Page;
+	uint32_t Slot;
+};
+
+struct VirtualTextureCacheDesc {
+	// Texels along each side of a page.
+	uint32_t PageSize = 128;
+	// Pages the physical texture holds.
+	uint32_t Slots = 1024;
+	// Most page loads handed out per Update.
+	uint32_t MaxLoadsPerFrame = 32;
+	// Frames a requested page stays queued after the feedback last asked for it.
+	uint32_t RequestLifetime = 4;
+};
+
+// What one Update asks the renderer to do.
+struct VirtualTextureUpdate {
+	// Pages to copy into their slots, coarse mips first.  They are mapped already.
+	std::vector<PageMapping> Loads;
+	// Pages that gave up their slot for a load.
+	std::vector<VirtualPage> Evictions;
+};
+
+struct VirtualTextureStats {
+	uint64_t Frames = 0;
+	uint64_t FeedbackWords = 0;
+	// Distinct pages in the feedback of each frame, summed over frames.
+	uint64_t RequestedPages = 0;
+	uint64_t Hits = 0;
+	uint64_t Misses = 0;
+	uint64_t Loads = 0;
+	uint64_t Evictions = 0;
+	// Loads that could not be scheduled because every slot was in use this frame.
+	uint64_t Starved = 0;
+};
+
+// CPU side of virtual texturing: a fixed set of physical page slots shared by all
+// textures, a page table per texture and the queue of pages the feedback asked for.
+// Only pure bookkeeping; the renderer copies the texels and writes the indirection.
+//
+// The coarsest mip of every texture is mapped and pinned when it is added, so every
+// page has something to fall back on.  Missing pages queue their missing ancestors
+// too, and loads go out coarse mips first, so detail sharpens level by level.  When
+// no slot is free the least recently used page not touched this frame is evicted.
+class VirtualTextureCache {
+public:
+	explicit VirtualTextureCache(const VirtualTextureCacheDesc& desc);
+
+	// Registers a texture and returns its index.  Throws std::runtime_error when it
+	// does not fit the feedback word or the pinned pages do not fit the slots.
+	uint32_t AddTexture(uint32_t width, uint32_t height);
+
+	uint32_t TextureCount()const { return (uint32_t)mTextures.size(); }
+	uint32_t MipLevels(uint32_t texture)const { return (uint32_t)mTextures[texture].Mips.size(); }
+	uint32_t PagesWide(uint32_t texture, uint32_t mip)const { return mTextures[texture].Mips[mip].PagesWide; }
+	uint32_t PagesHigh(uint32_t texture, uint32_t mip)const { return mTextures[texture].Mips[mip].PagesHigh; }
+	// The pinned pages are loaded with the first Update.
+	const std::vector<PageMapping>& PinnedPages()const { return mPinned; }
+
+	// Digests one frame of feedback words, in any order with any repeats, and
+	// returns the loads to perform.  Words outside any registered texture are ignored.
+	VirtualTextureUpdate Update(const uint32_t* feedback, size_t count);
+
+	// Slot holding exactly this page, or kPageNotResident.
+	uint32_t Slot(const VirtualPage& page)const;
+	// What the indirection texture holds for the page.
+	PageTableEntry Lookup(const VirtualPage& page)const;
+	// Lookup for every page of one mip, row by row.
+	void BuildPageTable(uint32_t texture, uint32_t mip, std::vector<PageTableEntry>& entries)const;
+
+	uint32_t ResidentPages()const { return mDesc.Slots - (uint32_t)mFreeSlots.size(); }
+	size_t QueuedRequests()const { return mRequests.size(); }
+	const VirtualTextureStats& Stats()const { return mStats; }
+
+private:
+	struct MipPages {
+		uint32_t PagesWide;
+		uint32_t PagesHigh;
+		// Slot per page, row by row.
+		std::vector<uint32_t> Slots;
+	};
+
+	struct TextureState {
+		std::vector<MipPages> Mips;
+	};
+
+	struct SlotState {
+		uint32_t Key = kNoFeedback;
+		uint64_t LastUsed = 0;
+		bool Pinned = false;
+		// Least recently used list of the unpinned, occupied slots.
+		uint32_t Prev = kPageNotResident;
+		uint32_t Next = kPageNotResident;
+	};
+
+	struct Request {
+		VirtualPage Page;
+		// Pixels of this frame's feedback that asked for the page or a page it stands in for.
+		uint64_t Pixels;
+		uint64_t LastRequested;
+	};
+
+	bool IsValid(const VirtualPage& page)const;
+	uint32_t& SlotOf(const VirtualPage& page);
+	uint32_t SlotOf(const VirtualPage& page)const;
+	void Touch(uint32_t slot);
+	void Unlink(uint32_t slot);
+	void LinkBack(uint32_t slot);
+	uint32_t AllocateSlot(VirtualTextureUpdate& update);
+	void AddRequest(const VirtualPage& page, uint64_t pixels);
+	VirtualPage Parent(const VirtualPage& page)const;
+
+private:
+	VirtualTextureCacheDesc mDesc;
+	std::vector<TextureState> mTextures;
+	std::vector<SlotState> mSlots;
+	std::vector<uint32_t> mFreeSlots;
+	uint32_t mLruHead = kPageNotResident;
+	uint32_t mLruTail = kPageNotResident;
+	std::vector<PageMapping> mPinned;
+	size_t mPinnedReported = 0;
+	// Queued pages by feedback word.
+	std::unordered_map<uint32_t, Request> mRequests;
+	uint64_t mFrame = 0;
+	VirtualTextureStats mStats;
+	std::vector<uint32_t> mScratch;
+};
+
+// Feedback of a run of frames, recorded to replay the same page traffic through
+// different cache settings.
+struct FeedbackTrace {
+	// Width and height of each texture, in AddTexture order.
+	std::vector<uint32_t> TextureSizes;
+	std::vector<std::vector<uint32_t>> Frames;
+};
+
+// Binary files; both throw std::runtime_error on failure.
+void SaveFeedbackTrace(const std::string& path, const FeedbackTrace& trace);
+FeedbackTrace LoadFeedbackTrace(const std::string& path);
+
+// A viewer sweeping across textureCount textures of size x size at a changing
+// distance, seen through a width x height feedback buffer.  The same seed always
+// gives the same trace.
+FeedbackTrace MakePanningTrace(uint32_t textureCount, uint32_t size, uint32_t frames,
+	uint32_t width, uint32_t height, uint32_t pageSize, uint32_t seed = 1);
+
+struct VirtualTextureReplayStats {
+	VirtualTextureStats Cache;
+	double Seconds = 0.0;
+	// Feedback words digested per second, in millions.
+	double MWordsPerSecond = 0.0;
+	// Fraction of requested pages that were resident.
+	double HitRate = 0.0;
+};
+
+// Feeds every frame of the trace through a fresh cache.
+VirtualTextureReplayStats ReplayFeedbackTrace(const FeedbackTrace& trace, const VirtualTextureCacheDesc& desc);
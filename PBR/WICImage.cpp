@@ -0,0 +1,36 @@
+#include "WICImage.h"
+#include <wincodec.h>
+
+#pragma comment(lib, "windowscodecs.lib")
+
+using Microsoft::WRL::ComPtr;
+
+SourceImage LoadImageWIC(const std::wstring& path)
+{
+	// RPC_E_CHANGED_MODE means the thread already runs COM single threaded, which
+	// WIC is fine with.  COM stays initialized for the rest of the process.
+	HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	if (hr != RPC_E_CHANGED_MODE) {
+		ThrowIfFailed(hr);
+	}
+
+	ComPtr<IWICImagingFactory> factory;
+	ThrowIfFailed(CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory)));
+
+	ComPtr<IWICBitmapDecoder> decoder;
+	ThrowIfFailed(factory->CreateDecoderFromFilename(path.c_str(), nullptr, GENERIC_READ,
+		WICDecodeMetadataCacheOnDemand, decoder.GetAddressOf()));
+	ComPtr<IWICBitmapFrameDecode> frame;
+	ThrowIfFailed(decoder->GetFrame(0, frame.GetAddressOf()));
+
+	ComPtr<IWICFormatConverter> converter;
+	ThrowIfFailed(factory->CreateFormatConverter(converter.GetAddressOf()));
+	ThrowIfFailed(converter->Initialize(frame.Get(), GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone,
+		nullptr, 0.0, WICBitmapPaletteTypeCustom));
+
+	SourceImage image;
+	ThrowIfFailed(converter->GetSize(&image.Width, &image.Height));
+	image.Pixels.resize((size_t)image.Width * image.Height * 4);
+	ThrowIfFailed(converter->CopyPixels(nullptr, image.Width * 4, (UINT)image.Pixels.size(), image.Pixels.data()));
+	return image;
+}
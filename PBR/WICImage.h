@@ -0,0 +1,8 @@
+#pragma once
+#include "../Common/d3dUtil.h"
+#include "TextureCooker.h"
+
+// Decodes a PNG, JPG or any other WIC supported file to RGBA8 without touching the
+// values (no sRGB or gamma conversion).  Initializes COM on the calling thread when
+// needed.  Throws DxException on failure.
+SourceImage LoadImageWIC(const std::wstring& path);
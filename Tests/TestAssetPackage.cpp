@@ -0,0 +1,167 @@
+#include "TestFramework.h"
+#include "AssetPackage.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+	const char* kPackagePath = "TestAssetPackage.pak";
+
+	std::string SourcePath(uint32_t i) {
+		return "TestAssetPackage_source" + std::to_string(i) + ".bin";
+	}
+
+	std::vector<uint8_t> Noise(size_t size, uint32_t seed) {
+		std::vector<uint8_t> bytes(size);
+		for (uint8_t& byte : bytes) {
+			seed = seed * 1664525u + 1013904223u;
+			// Runs of repeated bytes, so that LZ has something to find.
+			byte = (uint8_t)(seed >> 28);
+		}
+		return bytes;
+	}
+
+	CompressedTexture Texture() {
+		CompressedTexture texture(37, 20, 3, 2, false, kDxgiFormatR8G8B8A8Unorm, 4, 1);
+		std::vector<uint8_t> bytes = Noise(texture.ByteSize(), 3);
+		std::copy(bytes.begin(), bytes.end(), texture.Blocks(0, 0));
+		return texture;
+	}
+
+	// A package with one source per file, each a blob of the file's content.
+	void WritePackage(uint32_t sourceCount) {
+		AssetPackageWriter writer;
+		for (uint32_t i = 0; i < sourceCount; i++) {
+			std::ofstream(SourcePath(i), std::ios::binary) << "source " << i;
+			writer.AddSource(SourcePath(i));
+			std::string content = "source " + std::to_string(i);
+			writer.AddBlob(SourcePath(i), content.data(), content.size());
+		}
+		writer.Write(kPackagePath);
+	}
+
+	void RemoveFiles(uint32_t sourceCount) {
+		std::remove(kPackagePath);
+		for (uint32_t i = 0; i < sourceCount; i++) {
+			std::remove(SourcePath(i).c_str());
+		}
+	}
+}
+
+TEST(EntriesRoundTripWithEveryCodec) {
+	std::vector<uint8_t> blob = Noise(3 * kPackageCompressionBlock + 123, 1);
+	CompressedTexture texture = Texture();
+	TextureFootprints footprints = ComputeTextureFootprints(texture);
+	std::vector<uint8_t> uploaded((size_t)footprints.TotalBytes);
+	CopyToFootprints(texture, footprints, uploaded.data());
+
+	for (PackageCodec codec : { PackageCodec::None, PackageCodec::LZ, PackageCodec::Entropy }) {
+		AssetPackageWriter writer;
+		writer.AddBlob("blob", blob.data(), blob.size(), 4, codec);
+		writer.AddTexture("texture", texture, codec);
+		// The same content under another name is stored once.
+		writer.AddBlob("copy", blob.data(), blob.size(), 4, codec);
+		AssetPackStats stats = writer.Write(kPackagePath);
+		CHECK_EQUAL(stats.Entries, 3u);
+		CHECK_EQUAL(stats.Shared, 1u);
+
+		AssetPackage package(kPackagePath);
+		const AssetEntry* blobEntry = package.Find("blob");
+		const AssetEntry* textureEntry = package.Find("texture");
+		CHECK(blobEntry && textureEntry && package.Find("copy"));
+		CHECK(!package.Find("missing"));
+		CHECK_EQUAL(blobEntry->Stride, 4u);
+		CHECK(package.Read(*blobEntry) == blob);
+		CHECK(package.Read(*package.Find("copy")) == blob);
+		CHECK(textureEntry->Kind == AssetKind::Texture);
+		CHECK_EQUAL(textureEntry->Texture.Width, 37u);
+		CHECK_EQUAL(textureEntry->Texture.ArraySize, 2u);
+		CHECK(package.Read(*textureEntry) == uploaded);
+		if (codec != PackageCodec::None) {
+			CHECK(blobEntry->StoredSize < blobEntry->Size);
+		}
+	}
+	std::remove(kPackagePath);
+}
+
+TEST(DuplicateNamesThrow) {
+	AssetPackageWriter writer;
+	writer.AddBlob("a", "x", 1);
+	CHECK_THROWS(writer.AddBlob("a", "y", 1));
+}
+
+TEST(SourcesAreRecorded) {
+	WritePackage(3);
+	{
+		AssetPackage package(kPackagePath);
+		CHECK_EQUAL(package.Sources().size(), (size_t)3);
+		const PackageSource& source = package.Sources()[1];
+		CHECK_EQUAL(source.Path, SourcePath(1));
+		CHECK_EQUAL(source.Size, (uint64_t)8);
+		CHECK(source.Hash == HashFile(SourcePath(1)));
+		CHECK(package.StaleSources().empty());
+	}
+	RemoveFiles(3);
+}
+
+TEST(ChangedAndMissingSourcesAreStale) {
+	WritePackage(3);
+	std::ofstream(SourcePath(0), std::ios::binary) << "edited source 0";
+	std::remove(SourcePath(2).c_str());
+	{
+		AssetPackage package(kPackagePath);
+		std::vector<std::string> stale = package.StaleSources();
+		CHECK_EQUAL(stale.size(), (size_t)2);
+		CHECK_EQUAL(stale[0], SourcePath(0));
+		CHECK_EQUAL(stale[1], SourcePath(2));
+	}
+	RemoveFiles(3);
+}
+
+TEST(RewrittenSameContentIsNotStale) {
+	WritePackage(1);
+	// Same bytes written again; whatever the time says, the hash still matches.
+	std::ofstream(SourcePath(0), std::ios::binary) << "source 0";
+	{
+		AssetPackage package(kPackagePath);
+		CHECK(package.StaleSources().empty());
+	}
+	RemoveFiles(1);
+}
+
+TEST(WriteReplacesAnExistingPackage) {
+	WritePackage(2);
+	{
+#if !defined(_WIN32)
+		// A reader of the old package keeps its content while a new one replaces it.
+		// Windows refuses to replace a mapped file instead.
+		AssetPackage old(kPackagePath);
+#endif
+		AssetPackageWriter writer;
+		writer.AddBlob("new", "new content", 11);
+		writer.Write(kPackagePath);
+		CHECK(std::ifstream(std::string(kPackagePath) + ".tmp").fail());
+#if !defined(_WIN32)
+		CHECK(old.Read(*old.Find(SourcePath(1))) == std::vector<uint8_t>({ 's', 'o', 'u', 'r', 'c', 'e', ' ', '1' }));
+#endif
+	}
+	{
+		AssetPackage package(kPackagePath);
+		CHECK(package.Find("new") && !package.Find(SourcePath(0)));
+	}
+	RemoveFiles(2);
+}
+
+TEST(MissingSourceCannotBeAdded) {
+	AssetPackageWriter writer;
+	CHECK_THROWS(writer.AddSource("TestAssetPackage_missing.bin"));
+}
+
+TEST(MalformedFilesThrow) {
+	std::ofstream(kPackagePath, std::ios::binary) << "not a package at all, but long enough for a header";
+	CHECK_THROWS(AssetPackage package(kPackagePath));
+	std::remove(kPackagePath);
+	CHECK_THROWS(AssetPackage package(kPackagePath));
+}
@@ -0,0 +1,308 @@
+#include "TestFramework.h"
+#include "BC6HEncoder.h"
+#include "HDRPacking.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+	uint32_t gNoise = 1;
+
+	float Random() {
+		gNoise = gNoise * 1664525u + 1013904223u;
+		return (gNoise >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// The index of the block's mode in the order of the D3D documentation, or -1
+	// for the reserved ones.
+	int BlockMode(const uint8_t block[16]) {
+		const uint32_t values[14] = { 0x00, 0x01, 0x02, 0x06, 0x0a, 0x0e, 0x12, 0x16, 0x1a, 0x1e, 0x03, 0x07, 0x0b, 0x0f };
+		uint32_t value = (block[0] & 2) ? block[0] & 0x1fu : block[0] & 3u;
+		for (int mode = 0; mode < 14; mode++) {
+			if (values[mode] == value) {
+				return mode;
+			}
+		}
+		return -1;
+	}
+
+	// Sets count bits at position, lowest first, as BC6H blocks store their fields.
+	void PutBits(uint8_t block[16], int position, uint32_t value, int count) {
+		for (int i = 0; i < count; i++, position++) {
+			if ((value >> i) & 1) {
+				block[position >> 3] |= (uint8_t)(1 << (position & 7));
+			}
+		}
+	}
+
+	// A block of one of four kinds, between 1/16 and 256 in magnitude: a gradient, two
+	// regions split by a line, an almost flat gradient, and two regions far apart in
+	// brightness.  Signed blocks get a random sign per channel; BC6H interpolates
+	// sign and magnitude bits, so no format does well on a channel crossing zero.
+	void MakeBlock(int kind, bool isSigned, float texels[16][4]) {
+		float scale = std::exp2(Random() * 12.0f - 4.0f);
+		float spread = std::exp2(Random() * 12.0f - 6.0f);
+		float a[3], b[3], c[3];
+		for (int k = 0; k < 3; k++) {
+			float sign = isSigned && Random() < 0.5f ? -1.0f : 1.0f;
+			a[k] = sign * Random() * scale;
+			b[k] = sign * Random() * scale;
+			c[k] = sign * Random() * scale;
+		}
+		float dx = Random() * 2.0f - 1.0f;
+		float dy = Random() * 2.0f - 1.0f;
+		float split = Random() - 0.5f;
+		for (int t = 0; t < 16; t++) {
+			float x = t % 4 - 1.5f;
+			float y = t / 4 - 1.5f;
+			float along = x * dx + y * dy;
+			float s = (along + 3.0f) / 6.0f;
+			for (int k = 0; k < 3; k++) {
+				switch (kind) {
+				case 0:
+					texels[t][k] = a[k] + (b[k] - a[k]) * s;
+					break;
+				case 1:
+					texels[t][k] = along > split ? a[k] + 0.1f * (b[k] - a[k]) * s : c[k] + 0.1f * (b[k] - c[k]) * s;
+					break;
+				case 2:
+					texels[t][k] = a[k] + 0.02f * (b[k] - a[k]) * s;
+					break;
+				default:
+					texels[t][k] = along > split ? a[k] + (b[k] - a[k]) * s : spread * (c[k] + 0.5f * (b[k] - c[k]) * s);
+					break;
+				}
+			}
+			texels[t][3] = 1.0f;
+		}
+	}
+
+	// Squared error over RGB relative to the largest magnitude in the block.
+	double RelativeMse(const float reference[16][4], const float decoded[16][4]) {
+		double sum = 0.0;
+		float peak = 0.0f;
+		for (int t = 0; t < 16; t++) {
+			for (int c = 0; c < 3; c++) {
+				double error = decoded[t][c] - reference[t][c];
+				sum += error * error;
+				peak = std::max(peak, std::fabs(reference[t][c]));
+			}
+		}
+		return sum / 48.0 / ((double)peak * peak);
+	}
+
+	double Psnr(double relativeMse) {
+		return 10.0 * std::log10(1.0 / std::max(relativeMse, 1e-20));
+	}
+
+	struct ModeResults {
+		uint32_t Blocks[14] = {};
+		double SumMse[14] = {};
+		double WorstPsnr = INFINITY;
+		double MeanPsnr(int mode)const { return Psnr(SumMse[mode] / Blocks[mode]); }
+	};
+
+	// Encodes and decodes count blocks, gathering the error by the mode chosen.
+	ModeResults RoundTrip(BC6HFormat format, BC6HQuality quality, uint32_t count) {
+		gNoise = 1;
+		ModeResults results;
+		for (uint32_t i = 0; i < count; i++) {
+			float texels[16][4];
+			MakeBlock(i % 4, format == BC6HFormat::Signed, texels);
+			uint8_t block[16];
+			EncodeBC6HBlock(texels, format, quality, block);
+			float decoded[16][4];
+			DecodeBC6HBlock(block, format, decoded);
+			int mode = BlockMode(block);
+			CHECK(mode >= 0);
+			if (mode < 0) {
+				continue;
+			}
+			double mse = RelativeMse(texels, decoded);
+			results.Blocks[mode]++;
+			results.SumMse[mode] += mse;
+			results.WorstPsnr = std::min(results.WorstPsnr, Psnr(mse));
+			for (int t = 0; t < 16; t++) {
+				CHECK_EQUAL(decoded[t][3], 1.0f);
+			}
+		}
+		return results;
+	}
+
+	double OverallPsnr(const ModeResults& results) {
+		double sum = 0.0;
+		uint32_t blocks = 0;
+		for (int mode = 0; mode < 14; mode++) {
+			sum += results.SumMse[mode];
+			blocks += results.Blocks[mode];
+		}
+		return Psnr(sum / blocks);
+	}
+}
+
+TEST(QualityUsesEveryModeAndEachDecodes) {
+	// A field packed in the wrong place or order breaks its mode, and that mode's
+	// error with it.  The floors are about 3 dB under the measured means, more for
+	// the modes picked only a few times; the two region modes with few endpoint bits
+	// trade precision for range.
+	const double floors[2][14] = {
+		{ 42.0, 29.0, 55.0, 50.0, 48.0, 37.0, 33.0, 33.0, 33.0, 25.0, 33.0, 39.0, 49.0, 64.0 },
+		{ 37.0, 25.0, 45.0, 44.0, 43.0, 33.0, 29.0, 28.0, 29.0, 24.0, 32.0, 33.0, 43.0, 61.0 },
+	};
+	for (BC6HFormat format : { BC6HFormat::Unsigned, BC6HFormat::Signed }) {
+		ModeResults results = RoundTrip(format, BC6HQuality::Quality, 6000);
+		for (int mode = 0; mode < 14; mode++) {
+			CHECK(results.Blocks[mode] >= 1);
+			if (results.Blocks[mode] != 0) {
+				CHECK(results.MeanPsnr(mode) > floors[format == BC6HFormat::Signed][mode]);
+			}
+		}
+		CHECK(results.WorstPsnr > 17.0);
+	}
+}
+
+TEST(FastUsesTheSingleRegionModes) {
+	for (BC6HFormat format : { BC6HFormat::Unsigned, BC6HFormat::Signed }) {
+		ModeResults fast = RoundTrip(format, BC6HQuality::Fast, 4000);
+		for (int mode = 0; mode < 10; mode++) {
+			CHECK_EQUAL(fast.Blocks[mode], 0u);
+		}
+		const double floors[2][4] = { { 28.0, 31.0, 43.0, 70.0 }, { 23.0, 29.0, 37.0, 68.0 } };
+		for (int mode = 10; mode < 14; mode++) {
+			if (fast.Blocks[mode] != 0) {
+				CHECK(fast.MeanPsnr(mode) > floors[format == BC6HFormat::Signed][mode - 10]);
+			}
+		}
+		CHECK(fast.WorstPsnr > 16.0);
+
+		// The full search pays for itself.
+		ModeResults quality = RoundTrip(format, BC6HQuality::Quality, 4000);
+		CHECK(OverallPsnr(quality) > OverallPsnr(fast) + 1.0);
+	}
+}
+
+TEST(KnownBlocksDecode) {
+	// Blocks packed by hand from the bit positions of the D3D documentation, which
+	// the round trips cannot check: the encoder and decoder share one layout table.
+	// Mode 11 of the documentation: 10 bit endpoints stored as they are.
+	uint8_t block[16] = {};
+	PutBits(block, 0, 0x03, 5);
+	PutBits(block, 5, 0, 10);
+	PutBits(block, 15, 1023, 10);
+	PutBits(block, 25, 512, 10);
+	PutBits(block, 35, 1023, 10);
+	PutBits(block, 45, 0, 10);
+	PutBits(block, 55, 512, 10);
+	// Texel 0 has a three bit index, the rest four.
+	for (int t = 1; t < 16; t++) {
+		PutBits(block, 68 + (t - 1) * 4, t == 15 ? 15 : 0, 4);
+	}
+	float texels[16][4];
+	DecodeBC6HBlock(block, BC6HFormat::Unsigned, texels);
+	// 1023 is the largest half, 512 unquantizes to 0x8020 and scales to 0x3e0f.
+	float middle = HalfToFloat(0x3e0f);
+	CHECK(texels[0][0] == 0.0f && texels[0][1] == 65504.0f && texels[0][2] == middle);
+	CHECK(texels[14][0] == 0.0f && texels[14][1] == 65504.0f && texels[14][2] == middle);
+	CHECK(texels[15][0] == 65504.0f && texels[15][1] == 0.0f && texels[15][2] == middle);
+
+	// Mode 14: 16 bit endpoints whose top six bits come in reverse order after the
+	// deltas.  Bit 15 of red and bit 11 of green, scaled by 31/64.
+	std::memset(block, 0, sizeof(block));
+	PutBits(block, 0, 0x0f, 5);
+	PutBits(block, 39, 1, 1);
+	PutBits(block, 49 + 15 - 11, 1, 1);
+	DecodeBC6HBlock(block, BC6HFormat::Unsigned, texels);
+	for (int t = 0; t < 16; t++) {
+		CHECK(texels[t][0] == HalfToFloat((uint16_t)((0x8000 * 31) >> 6)));
+		CHECK(texels[t][1] == HalfToFloat((uint16_t)((0x0800 * 31) >> 6)));
+		CHECK(texels[t][2] == 0.0f);
+	}
+}
+
+TEST(ReservedModesDecodeToBlack) {
+	for (uint8_t mode : { 0x13, 0x17, 0x1b, 0x1f }) {
+		uint8_t block[16];
+		std::memset(block, 0xa5, sizeof(block));
+		block[0] = (uint8_t)((block[0] & 0xe0) | mode);
+		float texels[16][4];
+		DecodeBC6HBlock(block, BC6HFormat::Unsigned, texels);
+		for (int t = 0; t < 16; t++) {
+			CHECK(texels[t][0] == 0.0f && texels[t][1] == 0.0f && texels[t][2] == 0.0f && texels[t][3] == 1.0f);
+		}
+	}
+}
+
+TEST(SurfacesRepeatTheLastRowAndColumn) {
+	// 6x5 texels: the blocks past the edge are built from the last row and column.
+	const uint32_t width = 6, height = 5;
+	std::vector<float> rgba(width * height * 4);
+	for (uint32_t i = 0; i < width * height; i++) {
+		rgba[i * 4 + 0] = 0.5f + (i % width);
+		rgba[i * 4 + 1] = 2.0f + 0.5f * (i / width);
+		rgba[i * 4 + 2] = 1.0f + 0.1f * i;
+		rgba[i * 4 + 3] = 1.0f;
+	}
+	std::vector<uint8_t> blocks(2 * 2 * 16);
+	EncodeBC6HSurface(rgba.data(), width, height, BC6HFormat::Unsigned, BC6HQuality::Quality, blocks.data());
+
+	for (uint32_t by = 0; by < 2; by++) {
+		for (uint32_t bx = 0; bx < 2; bx++) {
+			float texels[16][4];
+			for (uint32_t t = 0; t < 16; t++) {
+				uint32_t x = std::min(bx * 4 + t % 4, width - 1);
+				uint32_t y = std::min(by * 4 + t / 4, height - 1);
+				std::memcpy(texels[t], &rgba[(y * width + x) * 4], sizeof(texels[t]));
+			}
+			uint8_t expected[16];
+			EncodeBC6HBlock(texels, BC6HFormat::Unsigned, BC6HQuality::Quality, expected);
+			CHECK(std::memcmp(expected, &blocks[(by * 2 + bx) * 16], 16) == 0);
+
+			float decoded[16][4];
+			DecodeBC6HBlock(&blocks[(by * 2 + bx) * 16], BC6HFormat::Unsigned, decoded);
+			// The top left block spans three octaves of red, which is far from a line
+			// in half bits.
+			CHECK(Psnr(RelativeMse(texels, decoded)) > 20.0);
+		}
+	}
+}
+
+TEST(CubeMapsEncodeEveryFaceAndMip) {
+	// Each face and mip a different flat colour, so a subresource in the wrong
+	// place shows.
+	CubeMapImage cube(16, 0);
+	for (uint32_t face = 0; face < 6; face++) {
+		for (uint32_t mip = 0; mip < cube.MipLevels(); mip++) {
+			float* texels = cube.Texels(face, mip);
+			for (uint32_t i = 0; i < cube.MipSize(mip) * cube.MipSize(mip); i++) {
+				texels[i * 4 + 0] = 1.0f + face;
+				texels[i * 4 + 1] = 0.25f * (mip + 1);
+				texels[i * 4 + 2] = -1.0f - face;
+				texels[i * 4 + 3] = 1.0f;
+			}
+		}
+	}
+
+	for (BC6HFormat format : { BC6HFormat::Unsigned, BC6HFormat::Signed }) {
+		CompressedTexture encoded;
+		EncodeCubeMapBC6H(cube, format, BC6HQuality::Fast, encoded);
+		CHECK(encoded.IsCube());
+		CHECK_EQUAL(encoded.ArraySize(), 6u);
+		CHECK_EQUAL(encoded.MipLevels(), 5u);
+		CHECK_EQUAL(encoded.DxgiFormat(), format == BC6HFormat::Signed ? kDxgiFormatBC6HSF16 : kDxgiFormatBC6HUF16);
+		for (uint32_t face = 0; face < 6; face++) {
+			for (uint32_t mip = 0; mip < 5; mip++) {
+				uint32_t blockCount = encoded.BlocksWide(mip) * encoded.BlocksHigh(mip);
+				for (uint32_t b = 0; b < blockCount; b++) {
+					float texels[16][4];
+					DecodeBC6HBlock(encoded.Blocks(face, mip) + b * 16, format, texels);
+					// Unsigned clamps the negative blue to zero.
+					float blue = format == BC6HFormat::Signed ? -1.0f - face : 0.0f;
+					CHECK(std::fabs(texels[5][0] - (1.0f + face)) < 0.01f * (1.0f + face));
+					CHECK(std::fabs(texels[5][1] - 0.25f * (mip + 1)) < 0.01f);
+					CHECK(std::fabs(texels[5][2] - blue) < 0.01f * (1.0f + face));
+				}
+			}
+		}
+	}
+}
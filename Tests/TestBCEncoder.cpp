@@ -0,0 +1,229 @@
+#include "TestFramework.h"
+#include "BCEncoder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+	const BCFormat kFormats[] = { BCFormat::BC1, BCFormat::BC4, BCFormat::BC5, BCFormat::BC7 };
+	const BCQuality kQualities[] = { BCQuality::Fast, BCQuality::Quality };
+
+	uint32_t gNoise = 1;
+
+	int Random(int range) {
+		gNoise = gNoise * 1664525u + 1013904223u;
+		return (int)((gNoise >> 8) % (uint32_t)range);
+	}
+
+	uint8_t Clamp8(int value) {
+		return (uint8_t)std::min(std::max(value, 0), 255);
+	}
+
+	// The channels a format keeps: RGB for BC1, red for BC4, red and green for BC5.
+	int KeptChannels(BCFormat format) {
+		switch (format) {
+		case BCFormat::BC1: return 3;
+		case BCFormat::BC4: return 1;
+		case BCFormat::BC5: return 2;
+		default: return 4;
+		}
+	}
+
+	void EncodeBlock(const uint8_t texels[16][4], BCFormat format, BCQuality quality, uint8_t block[16]) {
+		switch (format) {
+		case BCFormat::BC1: EncodeBC1Block(texels, quality, block); break;
+		case BCFormat::BC4: EncodeBC4Block(texels, 0, quality, block); break;
+		case BCFormat::BC5: EncodeBC5Block(texels, quality, block); break;
+		case BCFormat::BC7: EncodeBC7Block(texels, quality, block); break;
+		}
+	}
+
+	void RoundTrip(const uint8_t texels[16][4], BCFormat format, BCQuality quality, uint8_t decoded[16][4]) {
+		uint8_t block[16];
+		EncodeBlock(texels, format, quality, block);
+		DecodeBCBlock(block, format, decoded);
+	}
+
+	double SquaredError(const uint8_t a[16][4], const uint8_t b[16][4], int firstChannel, int channels) {
+		double sum = 0.0;
+		for (int t = 0; t < 16; t++) {
+			for (int c = firstChannel; c < firstChannel + channels; c++) {
+				double d = (double)a[t][c] - b[t][c];
+				sum += d * d;
+			}
+		}
+		return sum;
+	}
+
+	double Psnr(double squaredError, double samples) {
+		double mse = squaredError / samples;
+		return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : INFINITY;
+	}
+
+	// A linear gradient across the block between two random colours, with a little
+	// noise, and random alpha when withAlpha.
+	void GradientBlock(bool withAlpha, uint8_t texels[16][4]) {
+		int a[4], b[4];
+		for (int c = 0; c < 4; c++) {
+			a[c] = Random(256);
+			b[c] = Random(256);
+		}
+		int dx = Random(5) - 2, dy = Random(5) - 2;
+		for (int t = 0; t < 16; t++) {
+			int along = (t % 4) * dx + (t / 4) * dy + 12;
+			for (int c = 0; c < 4; c++) {
+				texels[t][c] = Clamp8(a[c] + (b[c] - a[c]) * along / 24 + Random(5) - 2);
+			}
+			if (!withAlpha) {
+				texels[t][3] = 255;
+			}
+		}
+	}
+
+	// An RGBA8 texture as CookTexture makes them, with the full mip chain filled.  At
+	// most 13x7.
+	CompressedTexture Rgba8Texture(uint32_t width, uint32_t height, bool srgb) {
+		uint32_t mipLevels = 1;
+		while ((std::max(width, height) >> mipLevels) != 0) {
+			mipLevels++;
+		}
+		CompressedTexture texture(width, height, mipLevels, 1, false,
+			srgb ? kDxgiFormatR8G8B8A8UnormSrgb : kDxgiFormatR8G8B8A8Unorm, 4, 1);
+		for (uint32_t mip = 0; mip < texture.MipLevels(); mip++) {
+			uint32_t w = texture.MipWidth(mip), h = texture.MipHeight(mip);
+			uint8_t* texels = texture.Blocks(0, mip);
+			for (uint32_t y = 0; y < h; y++) {
+				for (uint32_t x = 0; x < w; x++) {
+					uint8_t* texel = texels + ((size_t)y * w + x) * 4;
+					// A diagonal ramp in colour and alpha, with a ripple in blue.
+					uint32_t ramp = 12 * x + 6 * y;
+					texel[0] = (uint8_t)ramp;
+					texel[1] = (uint8_t)(40 + ramp / 2);
+					texel[2] = (uint8_t)(200 - ramp / 2 + 6 * std::sin(1.3f * x));
+					texel[3] = (uint8_t)(255 - ramp / 3);
+				}
+			}
+		}
+		return texture;
+	}
+}
+
+TEST(SolidColoursRoundTrip) {
+	const uint8_t colours[][4] = {
+		{ 0, 0, 0, 255 }, { 255, 255, 255, 255 }, { 13, 200, 77, 255 }, { 128, 127, 129, 255 }, { 90, 30, 250, 60 },
+	};
+	// BC4 and BC5 hit any value exactly.  BC1 and BC7 get within a step, through the
+	// interpolated 5:6:5 endpoints and the p-bits the channels share.
+	const int tolerance[] = { 1, 0, 0, 1 };
+	for (const auto& colour : colours) {
+		uint8_t texels[16][4];
+		for (int t = 0; t < 16; t++) {
+			std::memcpy(texels[t], colour, 4);
+		}
+		for (int f = 0; f < 4; f++) {
+			for (BCQuality quality : kQualities) {
+				uint8_t decoded[16][4];
+				RoundTrip(texels, kFormats[f], quality, decoded);
+				for (int t = 0; t < 16; t++) {
+					for (int c = 0; c < KeptChannels(kFormats[f]); c++) {
+						CHECK(std::abs(decoded[t][c] - colour[c]) <= tolerance[f]);
+					}
+				}
+			}
+		}
+	}
+}
+
+TEST(GradientsMeetTheirFloors) {
+	// Floors about 2 dB under the PSNR measured over 2000 noisy gradients.
+	const double floors[4][2] = { { 35.0, 36.0 }, { 42.0, 44.0 }, { 42.0, 44.0 }, { 44.0, 45.0 } };
+	for (int f = 0; f < 4; f++) {
+		double psnr[2];
+		for (int q = 0; q < 2; q++) {
+			gNoise = 1;
+			double sum = 0.0;
+			for (int i = 0; i < 2000; i++) {
+				uint8_t texels[16][4], decoded[16][4];
+				GradientBlock(false, texels);
+				RoundTrip(texels, kFormats[f], kQualities[q], decoded);
+				sum += SquaredError(texels, decoded, 0, KeptChannels(kFormats[f]));
+			}
+			psnr[q] = Psnr(sum, 2000.0 * 16 * KeptChannels(kFormats[f]));
+			CHECK(psnr[q] > floors[f][q]);
+		}
+		CHECK(psnr[1] >= psnr[0]);
+	}
+}
+
+TEST(AlphaIsKeptByBC7Only) {
+	gNoise = 7;
+	double sum[2] = {};
+	for (int i = 0; i < 1000; i++) {
+		uint8_t texels[16][4];
+		GradientBlock(true, texels);
+		for (int q = 0; q < 2; q++) {
+			uint8_t decoded[16][4];
+			RoundTrip(texels, BCFormat::BC7, kQualities[q], decoded);
+			sum[q] += SquaredError(texels, decoded, 3, 1);
+		}
+		for (BCFormat format : { BCFormat::BC1, BCFormat::BC4, BCFormat::BC5 }) {
+			uint8_t decoded[16][4];
+			RoundTrip(texels, format, BCQuality::Quality, decoded);
+			for (int t = 0; t < 16; t++) {
+				CHECK_EQUAL(decoded[t][3], 255);
+			}
+		}
+	}
+	CHECK(Psnr(sum[0], 1000.0 * 16) > 43.0);
+	CHECK(Psnr(sum[1], 1000.0 * 16) > 43.0);
+}
+
+TEST(OddSizesRepeatTheLastRowAndColumn) {
+	// 13x7 down to 1x1: the blocks past the edges are built from the last row and
+	// column, and the PSNR only counts the texels inside.
+	CompressedTexture rgba8 = Rgba8Texture(13, 7, false);
+	const double floors[] = { 35.0, 40.0, 42.0, 42.0 };
+	for (int f = 0; f < 4; f++) {
+		BCFormat format = kFormats[f];
+		CompressedTexture encoded;
+		EncodeTextureBC(rgba8, format, BCQuality::Quality, encoded);
+		CHECK_EQUAL(encoded.MipLevels(), 4u);
+		CHECK_EQUAL(encoded.BlockBytes(), BCBlockBytes(format));
+		CHECK_EQUAL(encoded.DxgiFormat(), BCDxgiFormat(format, false));
+		CHECK(MeasureBCPsnr(rgba8, encoded, format) > floors[f]);
+
+		for (uint32_t mip = 0; mip < encoded.MipLevels(); mip++) {
+			uint32_t w = encoded.MipWidth(mip), h = encoded.MipHeight(mip);
+			for (uint32_t by = 0; by < encoded.BlocksHigh(mip); by++) {
+				for (uint32_t bx = 0; bx < encoded.BlocksWide(mip); bx++) {
+					uint8_t texels[16][4];
+					for (uint32_t t = 0; t < 16; t++) {
+						uint32_t x = std::min(bx * 4 + t % 4, w - 1);
+						uint32_t y = std::min(by * 4 + t / 4, h - 1);
+						std::memcpy(texels[t], rgba8.Blocks(0, mip) + ((size_t)y * w + x) * 4, 4);
+					}
+					uint8_t expected[16];
+					EncodeBlock(texels, format, BCQuality::Quality, expected);
+					const uint8_t* block = encoded.Blocks(0, mip) + by * encoded.RowPitch(mip) + bx * encoded.BlockBytes();
+					CHECK(std::memcmp(expected, block, encoded.BlockBytes()) == 0);
+				}
+			}
+		}
+	}
+}
+
+TEST(SrgbSourcesGiveSrgbFormats) {
+	CompressedTexture srgb = Rgba8Texture(8, 8, true);
+	CompressedTexture encoded;
+	EncodeTextureBC(srgb, BCFormat::BC1, BCQuality::Fast, encoded);
+	CHECK_EQUAL(encoded.DxgiFormat(), kDxgiFormatBC1UnormSrgb);
+	EncodeTextureBC(srgb, BCFormat::BC7, BCQuality::Fast, encoded);
+	CHECK_EQUAL(encoded.DxgiFormat(), kDxgiFormatBC7UnormSrgb);
+	EncodeTextureBC(srgb, BCFormat::BC5, BCQuality::Fast, encoded);
+	CHECK_EQUAL(encoded.DxgiFormat(), kDxgiFormatBC5Unorm);
+
+	// Only RGBA8 sources encode.
+	CompressedTexture blocks = encoded;
+	CHECK_THROWS(EncodeTextureBC(blocks, BCFormat::BC1, BCQuality::Fast, encoded));
+}
@@ -0,0 +1,337 @@
+#include "TestFramework.h"
+#include "BVH.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Every query is checked against testing each object or triangle on its own.
+
+namespace {
+	// Boxes of count objects scattered in a cube of side 2 * range: min xyz, then max xyz.
+	std::vector<float> RandomBoxes(uint32_t count, float range, std::mt19937& rng) {
+		std::uniform_real_distribution<float> position(-range, range);
+		std::uniform_real_distribution<float> size(0.05f, 3.0f);
+		std::vector<float> boxes((size_t)count * 6);
+		for (uint32_t id = 0; id < count; id++) {
+			for (int i = 0; i < 3; i++) {
+				float center = position(rng);
+				float extent = size(rng);
+				boxes[(size_t)id * 6 + i] = center - extent;
+				boxes[(size_t)id * 6 + 3 + i] = center + extent;
+			}
+		}
+		return boxes;
+	}
+
+	// Six planes facing the origin at 10 to 40 units from it, which bound a convex
+	// volume like a frustum does.
+	Frustum RandomFrustum(std::mt19937& rng) {
+		std::normal_distribution<float> axis;
+		std::uniform_real_distribution<float> distance(10.0f, 40.0f);
+		Frustum frustum;
+		for (auto& plane : frustum.Planes) {
+			float n[3] = { axis(rng), axis(rng), axis(rng) };
+			float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (int i = 0; i < 3; i++) {
+				plane[i] = n[i] / length;
+			}
+			plane[3] = distance(rng);
+		}
+		return frustum;
+	}
+
+	std::vector<uint32_t> Sorted(std::vector<uint32_t> ids) {
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+
+	std::vector<uint32_t> FrustumReference(const std::vector<float>& boxes, const Frustum& frustum) {
+		std::vector<uint32_t> ids;
+		for (uint32_t id = 0; id < boxes.size() / 6; id++) {
+			const float* box = &boxes[(size_t)id * 6];
+			bool inside = true;
+			for (const auto& plane : frustum.Planes) {
+				float dist = plane[3];
+				float reach = 0.0f;
+				for (int i = 0; i < 3; i++) {
+					dist += 0.5f * (box[i] + box[3 + i]) * plane[i];
+					reach += 0.5f * (box[3 + i] - box[i]) * std::fabs(plane[i]);
+				}
+				inside = inside && dist + reach >= 0.0f;
+			}
+			if (inside) {
+				ids.push_back(id);
+			}
+		}
+		return ids;
+	}
+
+	std::vector<uint32_t> SphereReference(const std::vector<float>& boxes, const float center[3], float radius) {
+		std::vector<uint32_t> ids;
+		for (uint32_t id = 0; id < boxes.size() / 6; id++) {
+			const float* box = &boxes[(size_t)id * 6];
+			float nearSq = 0.0f;
+			for (int i = 0; i < 3; i++) {
+				float gap = std::max(std::max(box[i] - center[i], center[i] - box[3 + i]), 0.0f);
+				nearSq += gap * gap;
+			}
+			if (nearSq <= radius * radius) {
+				ids.push_back(id);
+			}
+		}
+		return ids;
+	}
+
+	std::vector<uint32_t> BoxReference(const std::vector<float>& boxes, const float min[3], const float max[3]) {
+		std::vector<uint32_t> ids;
+		for (uint32_t id = 0; id < boxes.size() / 6; id++) {
+			const float* box = &boxes[(size_t)id * 6];
+			bool overlap = true;
+			for (int i = 0; i < 3; i++) {
+				overlap = overlap && box[i] <= max[i] && box[3 + i] >= min[i];
+			}
+			if (overlap) {
+				ids.push_back(id);
+			}
+		}
+		return ids;
+	}
+
+	// Entry distance of the ray into a box, 0 from inside, or INFINITY on a miss.
+	float RayEntry(const float* box, const float origin[3], const float dir[3], float tMax) {
+		float t0 = 0.0f, t1 = tMax;
+		for (int i = 0; i < 3; i++) {
+			float invDir = 1.0f / dir[i];
+			float a = (box[i] - origin[i]) * invDir;
+			float b = (box[3 + i] - origin[i]) * invDir;
+			t0 = std::max(t0, std::min(a, b));
+			t1 = std::min(t1, std::max(a, b));
+		}
+		return t0 <= t1 ? t0 : INFINITY;
+	}
+
+	void RandomDirection(std::mt19937& rng, float dir[3]) {
+		std::normal_distribution<float> axis;
+		for (int i = 0; i < 3; i++) {
+			dir[i] = axis(rng);
+		}
+	}
+
+	// Runs each query at a few random places against the reference for boxes.
+	void CheckQueries(const SceneBVH& bvh, const std::vector<float>& boxes, std::mt19937& rng) {
+		std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+		std::uniform_real_distribution<float> size(0.5f, 25.0f);
+		std::vector<uint32_t> ids;
+		for (int query = 0; query < 8; query++) {
+			Frustum frustum = RandomFrustum(rng);
+			bvh.QueryFrustum(frustum, ids);
+			CHECK(Sorted(ids) == FrustumReference(boxes, frustum));
+
+			float center[3] = { position(rng), position(rng), position(rng) };
+			float radius = size(rng);
+			bvh.QuerySphere(center, radius, ids);
+			CHECK(Sorted(ids) == SphereReference(boxes, center, radius));
+
+			float min[3], max[3];
+			for (int i = 0; i < 3; i++) {
+				float extent = size(rng);
+				min[i] = center[i] - extent;
+				max[i] = center[i] + extent;
+			}
+			bvh.QueryBox(min, max, ids);
+			CHECK(Sorted(ids) == BoxReference(boxes, min, max));
+
+			float dir[3];
+			RandomDirection(rng, dir);
+			float closest = 500.0f;
+			for (uint32_t id = 0; id < boxes.size() / 6; id++) {
+				closest = std::min(closest, RayEntry(&boxes[(size_t)id * 6], center, dir, 500.0f));
+			}
+			uint32_t hitId = 0;
+			float t = 0.0f;
+			bool hit = bvh.Raycast(center, dir, 500.0f, hitId, t);
+			CHECK_EQUAL(hit, closest < 500.0f);
+			if (hit) {
+				CHECK(std::fabs(t - closest) <= 1e-4f * std::max(1.0f, closest));
+				CHECK(std::fabs(RayEntry(&boxes[(size_t)hitId * 6], center, dir, 500.0f) - t) <= 1e-4f * std::max(1.0f, t));
+			}
+		}
+	}
+
+	// Moves count random objects by up to reach and records their new boxes.
+	void MoveObjects(SceneBVH& bvh, std::vector<float>& boxes, uint32_t count, float reach, std::mt19937& rng) {
+		uint32_t objects = (uint32_t)(boxes.size() / 6);
+		std::uniform_int_distribution<uint32_t> pick(0, objects - 1);
+		std::uniform_real_distribution<float> offset(-reach, reach);
+		for (uint32_t n = 0; n < count; n++) {
+			uint32_t id = pick(rng);
+			float* box = &boxes[(size_t)id * 6];
+			for (int i = 0; i < 3; i++) {
+				float move = offset(rng);
+				box[i] += move;
+				box[3 + i] += move;
+			}
+			bvh.SetBounds(id, box, box + 3);
+		}
+	}
+}
+
+TEST(EmptyTreeFindsNothing) {
+	SceneBVH bvh;
+	std::vector<uint32_t> ids = { 7 };
+	const float center[3] = { 0.0f, 0.0f, 0.0f };
+	bvh.QuerySphere(center, 100.0f, ids);
+	CHECK(ids.empty());
+	uint32_t id = 0;
+	float t = 0.0f;
+	const float dir[3] = { 1.0f, 0.0f, 0.0f };
+	CHECK(!bvh.Raycast(center, dir, 100.0f, id, t));
+	CHECK_EQUAL(bvh.Cost(), 0.0f);
+	CHECK(!bvh.Update());
+}
+
+TEST(QueriesMatchBruteForce) {
+	std::mt19937 rng(1);
+	for (uint32_t objects : { 1u, 2u, 9u, 100u, 5000u }) {
+		std::vector<float> boxes = RandomBoxes(objects, 50.0f, rng);
+		SceneBVH bvh(boxes);
+		CHECK_EQUAL(bvh.ObjectCount(), objects);
+		CheckQueries(bvh, boxes, rng);
+	}
+}
+
+TEST(QueriesMatchAfterRefits) {
+	std::mt19937 rng(2);
+	std::vector<float> boxes = RandomBoxes(4000, 50.0f, rng);
+	SceneBVH bvh(boxes);
+	// A few moves refit up from each object, many refit every node; a high ratio
+	// keeps both from rebuilding.
+	for (uint32_t moved : { 10u, 100u, 1000u, 4000u }) {
+		MoveObjects(bvh, boxes, moved, 5.0f, rng);
+		CHECK(!bvh.Update(1000.0f));
+		CheckQueries(bvh, boxes, rng);
+	}
+}
+
+TEST(LooseTreesRebuild) {
+	std::mt19937 rng(3);
+	std::vector<float> boxes = RandomBoxes(3000, 50.0f, rng);
+	SceneBVH bvh(boxes);
+	float built = bvh.Cost();
+	// Scattering every object far from where it was leaves every node spanning the world.
+	MoveObjects(bvh, boxes, 3000, 50.0f, rng);
+	CHECK(!bvh.Update(1000.0f));
+	CHECK(bvh.Cost() > 1.5f * built);
+	CheckQueries(bvh, boxes, rng);
+
+	MoveObjects(bvh, boxes, 3000, 50.0f, rng);
+	CHECK(bvh.Update(1.5f));
+	CHECK(bvh.Cost() < 1.5f * built);
+	CheckQueries(bvh, boxes, rng);
+
+	MoveObjects(bvh, boxes, 300, 50.0f, rng);
+	bvh.Update(1000.0f);
+	bvh.Rebuild();
+	CheckQueries(bvh, boxes, rng);
+}
+
+TEST(RaysFromInsideABoxHitAtZero) {
+	const std::vector<float> boxes = {
+		-1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f,
+		4.0f, -1.0f, -1.0f, 6.0f, 1.0f, 1.0f,
+		9.0f, -1.0f, -1.0f, 11.0f, 1.0f, 1.0f,
+	};
+	SceneBVH bvh(boxes);
+	const float origin[3] = { 5.0f, 0.0f, 0.0f };
+	const float right[3] = { 2.0f, 0.0f, 0.0f };
+	uint32_t id = 0;
+	float t = -1.0f;
+	CHECK(bvh.Raycast(origin, right, 100.0f, id, t));
+	CHECK_EQUAL(id, 1u);
+	CHECK_EQUAL(t, 0.0f);
+
+	// Outside every box, dir is not unit length and t is in its units.
+	const float between[3] = { 7.0f, 0.0f, 0.0f };
+	CHECK(bvh.Raycast(between, right, 100.0f, id, t));
+	CHECK_EQUAL(id, 2u);
+	CHECK_EQUAL(t, 1.0f);
+	// tMax stops short of it.
+	CHECK(!bvh.Raycast(between, right, 0.9f, id, t));
+}
+
+TEST(BadInputThrows) {
+	std::vector<float> bounds(7, 0.0f);
+	CHECK_THROWS(SceneBVH bvh(bounds));
+	bounds.resize(6);
+	SceneBVH bvh(bounds);
+	CHECK_THROWS(bvh.SetBounds(1, bounds.data(), bounds.data() + 3));
+}
+
+TEST(TriangleHitsMatchBruteForce) {
+	std::mt19937 rng(4);
+	std::uniform_real_distribution<float> position(-20.0f, 20.0f);
+	std::uniform_real_distribution<float> edge(-2.0f, 2.0f);
+	std::vector<float> positions;
+	std::vector<uint32_t> indices;
+	for (uint32_t t = 0; t < 3000; t++) {
+		float v0[3] = { position(rng), position(rng), position(rng) };
+		for (int k = 0; k < 3; k++) {
+			for (int i = 0; i < 3; i++) {
+				positions.push_back(v0[i] + (k == 0 ? 0.0f : edge(rng)));
+			}
+			indices.push_back(t * 3 + k);
+		}
+	}
+	TriangleBVH bvh(positions, indices);
+	CHECK_EQUAL(bvh.TriangleCount(), 3000u);
+
+	for (int ray = 0; ray < 2000; ray++) {
+		float origin[3] = { position(rng), position(rng), position(rng) };
+		float dir[3];
+		RandomDirection(rng, dir);
+		// Moller-Trumbore against every triangle.
+		RayHit expected;
+		bool expectedHit = false;
+		float closest = 30.0f;
+		for (uint32_t triangle = 0; triangle < 3000; triangle++) {
+			const float* v0 = &positions[triangle * 9];
+			float e1[3], e2[3], s[3];
+			for (int i = 0; i < 3; i++) {
+				e1[i] = v0[3 + i] - v0[i];
+				e2[i] = v0[6 + i] - v0[i];
+				s[i] = origin[i] - v0[i];
+			}
+			float p[3] = { dir[1] * e2[2] - dir[2] * e2[1], dir[2] * e2[0] - dir[0] * e2[2], dir[0] * e2[1] - dir[1] * e2[0] };
+			float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+			if (std::fabs(det) < 1e-12f) {
+				continue;
+			}
+			float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) / det;
+			float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+			float v = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) / det;
+			float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) / det;
+			if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 0.0f && t < closest) {
+				expectedHit = true;
+				closest = t;
+				expected.T = t;
+				expected.Triangle = triangle;
+				expected.U = u;
+				expected.V = v;
+			}
+		}
+
+		RayHit hit;
+		bool found = bvh.Intersect(origin, dir, 30.0f, hit);
+		CHECK_EQUAL(found, expectedHit);
+		CHECK_EQUAL(bvh.Occluded(origin, dir, 30.0f), expectedHit);
+		if (found && expectedHit) {
+			CHECK_EQUAL(hit.Triangle, expected.Triangle);
+			CHECK(std::fabs(hit.T - expected.T) <= 1e-4f * std::max(1.0f, expected.T));
+			CHECK(std::fabs(hit.U - expected.U) < 1e-4f && std::fabs(hit.V - expected.V) < 1e-4f);
+		}
+	}
+
+	std::vector<uint32_t> outOfRange = { 0, 1, 9000 };
+	CHECK_THROWS(TriangleBVH bad(positions, outOfRange));
+}
@@ -0,0 +1,213 @@
+#include "TestFramework.h"
+#include "CubeMapSampler.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+	void Normalize(float v[3]) {
+		float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		for (int i = 0; i < 3; i++) {
+			v[i] /= length;
+		}
+	}
+
+	// A cube whose texels hold a smooth function of their direction in rgb and the
+	// mip in alpha, so that both seams and level blends show.
+	CubeMapImage SmoothCube(uint32_t size) {
+		CubeMapImage cube(size, 0);
+		for (uint32_t face = 0; face < 6; face++) {
+			for (uint32_t mip = 0; mip < cube.MipLevels(); mip++) {
+				uint32_t mipSize = cube.MipSize(mip);
+				float* texels = cube.Texels(face, mip);
+				for (uint32_t y = 0; y < mipSize; y++) {
+					for (uint32_t x = 0; x < mipSize; x++) {
+						float dir[3];
+						CubeFaceDirection(face, (x + 0.5f) / mipSize, (y + 0.5f) / mipSize, dir);
+						Normalize(dir);
+						float* texel = texels + (y * mipSize + x) * 4;
+						texel[0] = 2.0f + dir[0];
+						texel[1] = 2.0f + dir[1] * dir[2];
+						texel[2] = 2.0f + dir[2];
+						texel[3] = (float)mip;
+					}
+				}
+			}
+		}
+		return cube;
+	}
+
+	// A cube with one constant value per face.
+	CubeMapImage FlatFaces(uint32_t size) {
+		CubeMapImage cube(size, 1);
+		for (uint32_t face = 0; face < 6; face++) {
+			float* texels = cube.Texels(face, 0);
+			for (uint32_t i = 0; i < size * size * 4; i++) {
+				texels[i] = (float)(face + 1);
+			}
+		}
+		return cube;
+	}
+
+	// Directions on and around the edges of the faces, where taps leave the face, and
+	// some anywhere.  With corners, some near the corners too.
+	void EdgeDirections(uint32_t count, uint32_t seed, bool corners, std::vector<float>& x, std::vector<float>& y,
+		std::vector<float>& z)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> any(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> nudge(-0.02f, 0.02f);
+		std::uniform_int_distribution<int> kind(0, 3);
+		for (uint32_t i = 0; i < count; i++) {
+			float dir[3] = { any(rng), any(rng), any(rng) };
+			int k = kind(rng);
+			if (k >= 1) {
+				// Two components of about the same size put the direction near an edge,
+				// three near a corner.
+				int a = (int)(i % 3);
+				int b = (a + 1) % 3;
+				float major = std::copysign(1.0f, dir[a]);
+				dir[a] = major;
+				dir[b] = std::copysign(1.0f, dir[b]) + nudge(rng);
+				if (k == 3 && corners) {
+					dir[3 - a - b] = std::copysign(1.0f, dir[3 - a - b]) + nudge(rng);
+				}
+			}
+			x.push_back(dir[0]);
+			y.push_back(dir[1]);
+			z.push_back(dir[2]);
+		}
+	}
+}
+
+TEST(DirectionToFaceUVInvertsFaceDirection) {
+	for (uint32_t face = 0; face < 6; face++) {
+		for (float v = 0.01f; v < 1.0f; v += 0.07f) {
+			for (float u = 0.01f; u < 1.0f; u += 0.07f) {
+				float dir[3];
+				CubeFaceDirection(face, u, v, dir);
+				// Any length.
+				for (float& d : dir) {
+					d *= 3.0f;
+				}
+				CubeFaceUV uv = DirectionToFaceUV(dir);
+				CHECK_EQUAL(uv.Face, face);
+				CHECK(std::fabs(uv.U - u) < 1e-5f && std::fabs(uv.V - v) < 1e-5f);
+			}
+		}
+	}
+}
+
+TEST(WrappedTexelsAreTheNeighbouringTexels) {
+	const int32_t size = 16;
+	for (uint32_t face = 0; face < 6; face++) {
+		for (int32_t t = 0; t < size; t++) {
+			const int32_t outside[4][2] = { { -1, t }, { size, t }, { t, -1 }, { t, size } };
+			for (const auto& texel : outside) {
+				uint32_t wrappedFace = face;
+				int32_t x = texel[0], y = texel[1];
+				WrapCubeTexel(wrappedFace, x, y, size);
+				CHECK(wrappedFace != face);
+				CHECK(x >= 0 && x < size && y >= 0 && y < size);
+				// The texel it lands on lies on the edge it was pushed across, within a
+				// texel of the direction it came from.
+				CHECK(x == 0 || x == size - 1 || y == 0 || y == size - 1);
+				float from[3], to[3];
+				CubeFaceDirection(face, (texel[0] + 0.5f) / size, (texel[1] + 0.5f) / size, from);
+				CubeFaceDirection(wrappedFace, (x + 0.5f) / size, (y + 0.5f) / size, to);
+				Normalize(from);
+				Normalize(to);
+				float dot = from[0] * to[0] + from[1] * to[1] + from[2] * to[2];
+				CHECK(dot > std::cos(1.5f * 2.0f / size));
+			}
+		}
+	}
+}
+
+TEST(EdgesBlendBothFaces) {
+	// Exactly on an edge the bilinear taps split evenly between the two faces, from
+	// whichever side the direction is looked up.
+	CubeMapImage cube = FlatFaces(8);
+	CubeMapSampler sampler(cube);
+	for (uint32_t face = 0; face < 6; face++) {
+		for (float t : { 0.3f, 0.5f, 0.7f }) {
+			const float edges[4][2] = { { 0.0f, t }, { 1.0f, t }, { t, 0.0f }, { t, 1.0f } };
+			for (const auto& edge : edges) {
+				float dir[3];
+				CubeFaceDirection(face, edge[0], edge[1], dir);
+				CubeFaceUV uv = DirectionToFaceUV(dir);
+				float rgba[4];
+				sampler.SampleBilinear(dir, 0, rgba);
+				// The neighbour across the edge, from a texel just outside it.
+				uint32_t neighbour = face;
+				int32_t x = edge[0] == 0.0f ? -1 : edge[0] == 1.0f ? 8 : 3;
+				int32_t y = edge[1] == 0.0f ? -1 : edge[1] == 1.0f ? 8 : 3;
+				WrapCubeTexel(neighbour, x, y, 8);
+				float expected = 0.5f * (face + 1) + 0.5f * (neighbour + 1);
+				CHECK(uv.Face == face || uv.Face == neighbour);
+				CHECK(std::fabs(rgba[0] - expected) < 1e-5f);
+			}
+		}
+	}
+}
+
+TEST(SamplesAreContinuousAcrossEdges) {
+	CubeMapImage cube = SmoothCube(32);
+	CubeMapSampler sampler(cube);
+	// Steps of a thousandth of a texel across every edge change the result by about
+	// as much as anywhere else, where a clamp at the face would jump.  Corners take
+	// their outside tap from one of the two neighbours, so they are left out.
+	std::vector<float> x, y, z;
+	EdgeDirections(4000, 1, false, x, y, z);
+	for (size_t i = 0; i < x.size(); i++) {
+		float dir[3] = { x[i], y[i], z[i] };
+		float moved[3] = { x[i] * 1.00005f, y[i], z[i] * 0.99995f };
+		for (float lod : { 0.0f, 1.5f, 3.0f }) {
+			float a[4], b[4];
+			sampler.SampleLevel(dir, lod, a);
+			sampler.SampleLevel(moved, lod, b);
+			for (int c = 0; c < 3; c++) {
+				CHECK(std::fabs(a[c] - b[c]) < 2e-3f);
+			}
+			CHECK(std::fabs(a[3] - lod) < 1e-5f);
+		}
+	}
+}
+
+TEST(TrilinearFollowsTheLevel) {
+	CubeMapImage cube = SmoothCube(16);
+	CubeMapSampler sampler(cube);
+	const float dir[3] = { 0.3f, -0.5f, 0.8f };
+	for (float lod : { -1.0f, 0.0f, 0.25f, 2.5f, 4.0f, 9.0f }) {
+		float rgba[4];
+		sampler.SampleLevel(dir, lod, rgba);
+		CHECK(std::fabs(rgba[3] - std::min(std::max(lod, 0.0f), 4.0f)) < 1e-5f);
+	}
+}
+
+TEST(SimdMatchesScalar) {
+	if (!CpuHasAVX2()) {
+		return;
+	}
+	CubeMapImage cube = SmoothCube(64);
+	CubeMapSampler sampler(cube);
+	std::vector<float> x, y, z;
+	EdgeDirections(8 * 500 + 5, 2, true, x, y, z);
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> level(-0.5f, 7.5f);
+	std::vector<float> lod(x.size());
+	for (float& l : lod) {
+		l = level(rng);
+	}
+	uint32_t count = (uint32_t)x.size();
+	for (const float* lods : { (const float*)nullptr, (const float*)lod.data() }) {
+		std::vector<float> simd(count * 4), scalar(count * 4);
+		sampler.SampleLevel(x.data(), y.data(), z.data(), lods, count, simd.data());
+		sampler.SampleLevelScalar(x.data(), y.data(), z.data(), lods, count, scalar.data());
+		for (uint32_t i = 0; i < count * 4; i++) {
+			// Fused multiply-adds round differently, nothing more.
+			CHECK(std::fabs(simd[i] - scalar[i]) < 1e-4f);
+		}
+	}
+}
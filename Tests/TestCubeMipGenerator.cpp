@@ -0,0 +1,134 @@
+#include "TestFramework.h"
+#include "CubeMipGenerator.h"
+#include "CubeMapSampler.h"
+#include <cmath>
+#include <vector>
+
+namespace {
+	// Black but for an 8x8 spot of 100 on face 0 that touches its right edge halfway
+	// down.
+	CubeMapImage EdgeSpot(uint32_t size) {
+		CubeMapImage cube(size, 0);
+		float* texels = cube.Texels(0, 0);
+		for (uint32_t y = size / 2 - 4; y < size / 2 + 4; y++) {
+			for (uint32_t x = size - 8; x < size; x++) {
+				for (int c = 0; c < 4; c++) {
+					texels[(y * size + x) * 4 + c] = 100.0f;
+				}
+			}
+		}
+		return cube;
+	}
+
+	// The ratio of the texel just across the right edge of face 0 to the edge texel
+	// inside it, halfway down, at every mip.
+	std::vector<float> AcrossEdgeRatios(const CubeMapImage& cube) {
+		std::vector<float> ratios;
+		for (uint32_t mip = 0; mip < cube.MipLevels(); mip++) {
+			int32_t size = (int32_t)cube.MipSize(mip);
+			int32_t y = size / 2;
+			float inside = cube.Texels(0, mip)[(y * size + size - 1) * 4];
+			uint32_t face = 0;
+			int32_t x = size;
+			WrapCubeTexel(face, x, y, size);
+			float across = cube.Texels(face, mip)[(y * size + x) * 4];
+			ratios.push_back(inside > 0.0f ? across / inside : 0.0f);
+		}
+		return ratios;
+	}
+}
+
+TEST(ConstantCubesStayConstant) {
+	for (CubeMipFilter filter : { CubeMipFilter::Box, CubeMipFilter::Kaiser, CubeMipFilter::Lanczos }) {
+		CubeMapImage cube(48, 0);
+		for (uint32_t face = 0; face < 6; face++) {
+			float* texels = cube.Texels(face, 0);
+			for (uint32_t i = 0; i < 48 * 48; i++) {
+				texels[i * 4 + 0] = 1.0f;
+				texels[i * 4 + 1] = 2.0f;
+				texels[i * 4 + 2] = 3.0f;
+				texels[i * 4 + 3] = 4.0f;
+			}
+		}
+		GenerateCubeMips(cube, filter);
+		for (uint32_t face = 0; face < 6; face++) {
+			for (uint32_t mip = 1; mip < cube.MipLevels(); mip++) {
+				const float* texels = cube.Texels(face, mip);
+				for (uint32_t i = 0; i < cube.MipSize(mip) * cube.MipSize(mip) * 4; i++) {
+					CHECK(std::fabs(texels[i] - (float)(i % 4 + 1)) < 1e-4f);
+				}
+			}
+		}
+	}
+}
+
+TEST(BoxMatchesThePerFaceAverageOnPowersOfTwo) {
+	CubeMapImage cube(64, 0);
+	for (uint32_t face = 0; face < 6; face++) {
+		float* texels = cube.Texels(face, 0);
+		for (uint32_t i = 0; i < 64 * 64 * 4; i++) {
+			texels[i] = (float)((i * 31 + face * 7) % 17);
+		}
+	}
+	CubeMapImage perFace = cube;
+	perFace.GenerateMips();
+	GenerateCubeMips(cube, CubeMipFilter::Box);
+	for (uint32_t face = 0; face < 6; face++) {
+		for (uint32_t mip = 1; mip < cube.MipLevels(); mip++) {
+			for (uint32_t i = 0; i < cube.MipSize(mip) * cube.MipSize(mip) * 4; i++) {
+				CHECK(std::fabs(cube.Texels(face, mip)[i] - perFace.Texels(face, mip)[i]) < 1e-4f);
+			}
+		}
+	}
+}
+
+TEST(SincKernelsCarryLightAcrossEdges) {
+	// The box kernel stays inside its face, so the spot never reaches the neighbour.
+	CubeMapImage box = EdgeSpot(128);
+	GenerateCubeMips(box, CubeMipFilter::Box);
+	for (float ratio : AcrossEdgeRatios(box)) {
+		CHECK_EQUAL(ratio, 0.0f);
+	}
+
+	// The wider kernels spread it over the edge as they would within a face: a little
+	// at the first mips, and more as the spot shrinks to a texel or two.
+	for (CubeMipFilter filter : { CubeMipFilter::Kaiser, CubeMipFilter::Lanczos }) {
+		CubeMapImage cube = EdgeSpot(128);
+		GenerateCubeMips(cube, filter);
+		std::vector<float> ratios = AcrossEdgeRatios(cube);
+		CHECK_EQUAL(ratios[0], 0.0f);
+		CHECK(ratios[1] > 0.05f);
+		for (uint32_t mip = 2; mip < ratios.size(); mip++) {
+			CHECK(ratios[mip] > ratios[mip - 1]);
+		}
+		CHECK(ratios[4] > 0.3f);
+		CHECK(ratios[6] > 0.55f);
+		CHECK(ratios[7] > 0.7f);
+
+		// With the negative lobes clamped nothing goes below zero.
+		for (uint32_t face = 0; face < 6; face++) {
+			for (uint32_t mip = 1; mip < cube.MipLevels(); mip++) {
+				const float* texels = cube.Texels(face, mip);
+				for (uint32_t i = 0; i < cube.MipSize(mip) * cube.MipSize(mip) * 4; i++) {
+					CHECK(texels[i] >= 0.0f);
+				}
+			}
+		}
+	}
+}
+
+TEST(ResultsDoNotDependOnThreads) {
+	CubeMapImage one = EdgeSpot(96);
+	CubeMapImage four = one;
+	TaskPool single(1);
+	TaskPool pool(4);
+	GenerateCubeMips(one, CubeMipFilter::Kaiser, single);
+	GenerateCubeMips(four, CubeMipFilter::Kaiser, pool);
+	for (uint32_t face = 0; face < 6; face++) {
+		for (uint32_t mip = 1; mip < one.MipLevels(); mip++) {
+			for (uint32_t i = 0; i < one.MipSize(mip) * one.MipSize(mip) * 4; i++) {
+				CHECK_EQUAL(one.Texels(face, mip)[i], four.Texels(face, mip)[i]);
+			}
+		}
+	}
+}
@@ -0,0 +1,85 @@
+#include "TestFramework.h"
+#include "DescriptorIndexAllocator.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+TEST(AllocatesLowestFirstUntilFull) {
+	DescriptorIndexAllocator allocator(4, 16);
+	for (uint32_t i = 0; i < 4; i++) {
+		CHECK_EQUAL(allocator.Allocate(), i);
+	}
+	CHECK_EQUAL(allocator.Allocate(), kNoDescriptor);
+
+	allocator.Free(2);
+	CHECK_EQUAL(allocator.Allocate(), 2u);
+}
+
+TEST(GrowAddsIndicesUpToMax) {
+	DescriptorIndexAllocator allocator(2, 8);
+	allocator.Allocate();
+	allocator.Allocate();
+	CHECK(allocator.Grow(8));
+	CHECK_EQUAL(allocator.Capacity(), 8u);
+	CHECK_EQUAL(allocator.Allocate(), 2u);
+	CHECK(!allocator.Grow(9));
+}
+
+TEST(DeferredFreesWaitForTheirFence) {
+	DescriptorIndexAllocator allocator(2, 2);
+	uint32_t a = allocator.Allocate();
+	uint32_t b = allocator.Allocate();
+	allocator.FreeDeferred(a, 5);
+	allocator.FreeDeferred(b, 7);
+
+	allocator.ReleaseCompleted(4);
+	CHECK_EQUAL(allocator.Allocate(), kNoDescriptor);
+	allocator.ReleaseCompleted(5);
+	CHECK_EQUAL(allocator.Allocate(), a);
+	CHECK_EQUAL(allocator.Allocate(), kNoDescriptor);
+	allocator.ReleaseCompleted(7);
+	CHECK_EQUAL(allocator.Allocate(), b);
+}
+
+TEST(ConcurrentUseNeverHandsOutAnIndexTwice) {
+	const uint32_t capacity = 256;
+	DescriptorIndexAllocator allocator(capacity, capacity);
+	std::vector<std::atomic<uint32_t>> owners(capacity);
+	std::atomic<uint32_t> conflicts{ 0 };
+
+	TaskPool pool(4);
+	pool.ParallelFor(4, [&](uint32_t worker) {
+		std::vector<uint32_t> held;
+		for (uint32_t round = 0; round < 20000; round++) {
+			uint32_t index = allocator.Allocate();
+			if (index != kNoDescriptor) {
+				uint32_t expected = 0;
+				if (!owners[index].compare_exchange_strong(expected, worker + 1)) {
+					conflicts++;
+				}
+				held.push_back(index);
+			}
+			if (held.size() == 8 || (index == kNoDescriptor && !held.empty())) {
+				for (uint32_t h : held) {
+					owners[h].store(0);
+					allocator.Free(h);
+				}
+				held.clear();
+			}
+		}
+		for (uint32_t h : held) {
+			owners[h].store(0);
+			allocator.Free(h);
+		}
+	});
+	CHECK_EQUAL(conflicts.load(), 0u);
+
+	// Every index came back.
+	std::vector<uint32_t> all;
+	for (uint32_t index = allocator.Allocate(); index != kNoDescriptor; index = allocator.Allocate()) {
+		all.push_back(index);
+	}
+	std::sort(all.begin(), all.end());
+	CHECK_EQUAL(all.size(), (size_t)capacity);
+	CHECK(std::unique(all.begin(), all.end()) == all.end());
+}
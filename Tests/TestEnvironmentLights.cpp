@@ -0,0 +1,179 @@
+#include "TestFramework.h"
+#include "EnvironmentLights.h"
+#include <cmath>
+#include <vector>
+
+namespace {
+	const float kPi = 3.14159265f;
+
+	void Normalize(float v[3]) {
+		float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		for (int i = 0; i < 3; i++) {
+			v[i] /= length;
+		}
+	}
+
+	float Dot(const float a[3], const float b[3]) {
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	float AreaElement(float x, float y) {
+		return std::atan2(x * y, std::sqrt(x * x + y * y + 1.0f));
+	}
+
+	// Solid angle of texel (x, y) of a size^2 face.
+	float TexelSolidAngle(uint32_t x, uint32_t y, uint32_t size) {
+		float x0 = 2.0f * x / size - 1.0f;
+		float y0 = 2.0f * y / size - 1.0f;
+		float x1 = 2.0f * (x + 1) / size - 1.0f;
+		float y1 = 2.0f * (y + 1) / size - 1.0f;
+		return AreaElement(x0, y0) - AreaElement(x0, y1) - AreaElement(x1, y0) + AreaElement(x1, y1);
+	}
+
+	struct Sun {
+		float Direction[3];
+		float AngularRadius;
+		float Radiance[3];
+	};
+
+	// A sky of radiance 1 that is slightly blue at the top, with discs of suns.
+	CubeMapImage SyntheticSky(uint32_t size, const std::vector<Sun>& suns) {
+		CubeMapImage image(size, 0);
+		for (uint32_t face = 0; face < 6; face++) {
+			float* texels = image.Texels(face, 0);
+			for (uint32_t y = 0; y < size; y++) {
+				for (uint32_t x = 0; x < size; x++) {
+					float dir[3];
+					CubeFaceDirection(face, (x + 0.5f) / size, (y + 0.5f) / size, dir);
+					Normalize(dir);
+					float* texel = texels + ((size_t)y * size + x) * 4;
+					texel[0] = 0.8f;
+					texel[1] = 0.9f;
+					texel[2] = 1.0f + 0.5f * std::max(dir[1], 0.0f);
+					texel[3] = 1.0f;
+					for (const Sun& sun : suns) {
+						if (Dot(dir, sun.Direction) >= std::cos(sun.AngularRadius)) {
+							for (int c = 0; c < 3; c++) {
+								texel[c] += sun.Radiance[c];
+							}
+						}
+					}
+				}
+			}
+		}
+		image.GenerateMips();
+		return image;
+	}
+
+	// Radiance of mip 0 integrated over the sphere.
+	void TotalPower(const CubeMapImage& image, double power[3]) {
+		power[0] = power[1] = power[2] = 0.0;
+		uint32_t size = image.Size();
+		for (uint32_t face = 0; face < 6; face++) {
+			const float* texels = image.Texels(face, 0);
+			for (uint32_t y = 0; y < size; y++) {
+				for (uint32_t x = 0; x < size; x++) {
+					float solidAngle = TexelSolidAngle(x, y, size);
+					for (int c = 0; c < 3; c++) {
+						power[c] += (double)texels[((size_t)y * size + x) * 4 + c] * solidAngle;
+					}
+				}
+			}
+		}
+	}
+
+	float AngleBetween(const float a[3], const float b[3]) {
+		return std::acos(std::min(std::max(Dot(a, b), -1.0f), 1.0f));
+	}
+
+	Sun MakeSun(float x, float y, float z, float angularRadius, float radiance) {
+		Sun sun = { { x, y, z }, angularRadius, { radiance, radiance * 0.9f, radiance * 0.7f } };
+		Normalize(sun.Direction);
+		return sun;
+	}
+}
+
+TEST(FindsASyntheticSun) {
+	Sun sun = MakeSun(0.3f, 0.8f, -0.5f, 0.05f, 2000.0f);
+	CubeMapImage sky = SyntheticSky(128, { sun });
+	DominantLightResult result = ExtractDominantLights(sky);
+
+	CHECK_EQUAL((size_t)1, result.Lights.size());
+	const DominantLight& light = result.Lights[0];
+	CHECK(AngleBetween(light.Direction, sun.Direction) < 0.02f);
+	CHECK(std::fabs(Dot(light.Direction, light.Direction) - 1.0f) < 1e-4f);
+	CHECK(light.SolidAngle > 0.0f);
+	// Red carries the most of the sun, blue the least.
+	CHECK(light.Irradiance[0] > light.Irradiance[1] && light.Irradiance[1] > light.Irradiance[2]);
+
+	// The sun's power is radiance times its solid angle, 2 pi (1 - cos r).  The
+	// analysed mip blurs the disc, so allow some slack.
+	float sunPower = sun.Radiance[0] * 2.0f * kPi * (1.0f - std::cos(sun.AngularRadius));
+	CHECK(light.Irradiance[0] > 0.7f * sunPower);
+	CHECK(light.Irradiance[0] < 1.1f * sunPower);
+}
+
+TEST(RemovingLightsKeepsTheEnergy) {
+	Sun sun = MakeSun(-0.6f, 0.4f, 0.2f, 0.04f, 3000.0f);
+	CubeMapImage sky = SyntheticSky(128, { sun });
+	double before[3];
+	TotalPower(sky, before);
+
+	DominantLightResult result = ExtractDominantLights(sky);
+	CHECK_EQUAL((size_t)1, result.Lights.size());
+	RemoveDominantLights(sky, result.Lights);
+	double after[3];
+	TotalPower(sky, after);
+
+	for (int c = 0; c < 3; c++) {
+		double restored = after[c] + result.Lights[0].Irradiance[c];
+		CHECK(std::fabs(restored - before[c]) < 1e-3 * before[c]);
+	}
+	// Most of the power was the sun's.
+	CHECK(after[0] < before[0] * 0.5);
+}
+
+TEST(FindsTwoSunsBrightestFirst) {
+	Sun bright = MakeSun(0.0f, 1.0f, 0.2f, 0.05f, 4000.0f);
+	Sun dim = MakeSun(1.0f, 0.1f, -0.3f, 0.05f, 1500.0f);
+	CubeMapImage sky = SyntheticSky(128, { dim, bright });
+	DominantLightResult result = ExtractDominantLights(sky);
+
+	CHECK_EQUAL((size_t)2, result.Lights.size());
+	CHECK(AngleBetween(result.Lights[0].Direction, bright.Direction) < 0.02f);
+	CHECK(AngleBetween(result.Lights[1].Direction, dim.Direction) < 0.02f);
+	CHECK(result.Lights[0].Irradiance[0] > result.Lights[1].Irradiance[0]);
+}
+
+TEST(RespectsMaxLightsAndMinPower) {
+	Sun bright = MakeSun(0.0f, 1.0f, 0.2f, 0.05f, 4000.0f);
+	Sun dim = MakeSun(1.0f, 0.1f, -0.3f, 0.05f, 1500.0f);
+	CubeMapImage sky = SyntheticSky(128, { dim, bright });
+
+	DominantLightDesc one;
+	one.MaxLights = 1;
+	DominantLightResult result = ExtractDominantLights(sky, one);
+	CHECK_EQUAL((size_t)1, result.Lights.size());
+	CHECK(AngleBetween(result.Lights[0].Direction, bright.Direction) < 0.02f);
+
+	// The dim sun carries well under half of the power.
+	DominantLightDesc strict;
+	strict.MinPowerFraction = 0.5f;
+	result = ExtractDominantLights(sky, strict);
+	CHECK(result.Lights.size() <= 1);
+}
+
+TEST(NoLightsInAnEvenSky) {
+	CubeMapImage sky = SyntheticSky(64, {});
+	DominantLightResult result = ExtractDominantLights(sky);
+	CHECK(result.Lights.empty());
+
+	// The residual is then the whole sky, whose constant SH coefficient is the mean
+	// radiance times sqrt(4 pi).
+	double power[3];
+	TotalPower(sky, power);
+	for (int c = 0; c < 3; c++) {
+		float mean = (float)(power[c] / (4.0 * kPi));
+		CHECK(std::fabs(result.ResidualSH.C[0][c] - mean * std::sqrt(4.0f * kPi)) < 0.02f * mean * std::sqrt(4.0f * kPi));
+	}
+}
@@ -0,0 +1,186 @@
+#include "TestFramework.h"
+#include "EquirectToCube.h"
+#include <cmath>
+#include <vector>
+
+namespace {
+	const float kPi = 3.14159265f;
+
+	void Normalize(float v[3]) {
+		float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		for (int i = 0; i < 3; i++) {
+			v[i] /= length;
+		}
+	}
+
+	// The face and uv the D3D TextureCube addressing rules pick for dir: the major
+	// axis selects the face, and sc, tc are read off the table of the D3D spec.
+	void D3DCubeAddress(const float dir[3], uint32_t& face, float& u, float& v) {
+		float ax = std::fabs(dir[0]), ay = std::fabs(dir[1]), az = std::fabs(dir[2]);
+		float sc, tc, ma;
+		if (ax >= ay && ax >= az) {
+			face = dir[0] > 0.0f ? 0 : 1;
+			sc = dir[0] > 0.0f ? -dir[2] : dir[2];
+			tc = -dir[1];
+			ma = ax;
+		}
+		else if (ay >= az) {
+			face = dir[1] > 0.0f ? 2 : 3;
+			sc = dir[0];
+			tc = dir[1] > 0.0f ? dir[2] : -dir[2];
+			ma = ay;
+		}
+		else {
+			face = dir[2] > 0.0f ? 4 : 5;
+			sc = dir[2] > 0.0f ? dir[0] : -dir[0];
+			tc = -dir[1];
+			ma = az;
+		}
+		u = 0.5f * (sc / ma + 1.0f);
+		v = 0.5f * (tc / ma + 1.0f);
+	}
+
+	// The panorama direction of pixel (x, y): longitude 0 along +X at the middle
+	// column, growing towards +Z, and +Y along the top row.
+	void PanoramaDirection(float x, float y, uint32_t width, uint32_t height, float dir[3]) {
+		float longitude = (x / width - 0.5f) * 2.0f * kPi;
+		float latitude = (0.5f - y / height) * kPi;
+		dir[0] = std::cos(latitude) * std::cos(longitude);
+		dir[1] = std::sin(latitude);
+		dir[2] = std::cos(latitude) * std::sin(longitude);
+	}
+
+	// A panorama whose pixels hold their own directions, shifted to be positive.
+	HDRImage DirectionPanorama(uint32_t width, uint32_t height) {
+		HDRImage image;
+		image.Width = width;
+		image.Height = height;
+		for (uint32_t y = 0; y < height; y++) {
+			for (uint32_t x = 0; x < width; x++) {
+				float dir[3];
+				PanoramaDirection(x + 0.5f, y + 0.5f, width, height, dir);
+				for (int i = 0; i < 3; i++) {
+					image.Pixels.push_back(dir[i] + 2.0f);
+				}
+			}
+		}
+		return image;
+	}
+}
+
+TEST(FaceBasesAreRightHandedAndOrthonormal) {
+	for (uint32_t face = 0; face < 6; face++) {
+		const CubeFaceBasis& b = gCubeFaceBasis[face];
+		// Right = cross(Up, LookAt).
+		float right[3] = {
+			b.Up[1] * b.LookAt[2] - b.Up[2] * b.LookAt[1],
+			b.Up[2] * b.LookAt[0] - b.Up[0] * b.LookAt[2],
+			b.Up[0] * b.LookAt[1] - b.Up[1] * b.LookAt[0],
+		};
+		for (int i = 0; i < 3; i++) {
+			CHECK_EQUAL(b.Right[i], right[i]);
+		}
+		float dot = b.Up[0] * b.LookAt[0] + b.Up[1] * b.LookAt[1] + b.Up[2] * b.LookAt[2];
+		CHECK_EQUAL(dot, 0.0f);
+	}
+}
+
+TEST(FaceDirectionsFollowD3DAddressing) {
+	for (uint32_t face = 0; face < 6; face++) {
+		for (float v = 0.05f; v < 1.0f; v += 0.1f) {
+			for (float u = 0.05f; u < 1.0f; u += 0.1f) {
+				float dir[3];
+				CubeFaceDirection(face, u, v, dir);
+				uint32_t addressedFace;
+				float addressedU, addressedV;
+				D3DCubeAddress(dir, addressedFace, addressedU, addressedV);
+				CHECK_EQUAL(addressedFace, face);
+				CHECK(std::fabs(addressedU - u) < 1e-5f);
+				CHECK(std::fabs(addressedV - v) < 1e-5f);
+			}
+		}
+	}
+}
+
+TEST(FaceEdgesMeetTheirNeighbours) {
+	// Every point on the edge of a face is also on the edge of the face D3D picks
+	// just past it.
+	for (uint32_t face = 0; face < 6; face++) {
+		for (float t = 0.1f; t < 1.0f; t += 0.2f) {
+			const float edges[4][2] = { { 0.0f, t }, { 1.0f, t }, { t, 0.0f }, { t, 1.0f } };
+			for (const auto& edge : edges) {
+				float dir[3];
+				float inward[3];
+				CubeFaceDirection(face, edge[0], edge[1], dir);
+				CubeFaceDirection(face, 0.5f, 0.5f, inward);
+				// Nudge outward, away from the face center.
+				float outside[3];
+				for (int i = 0; i < 3; i++) {
+					outside[i] = dir[i] + 1e-3f * (dir[i] - inward[i]);
+				}
+				uint32_t neighbour;
+				float u, v;
+				D3DCubeAddress(outside, neighbour, u, v);
+				CHECK(neighbour != face);
+				float across[3];
+				CubeFaceDirection(neighbour, u, v, across);
+				Normalize(across);
+				Normalize(outside);
+				for (int i = 0; i < 3; i++) {
+					CHECK(std::fabs(across[i] - outside[i]) < 1e-4f);
+				}
+				CHECK(std::fmin(std::fmin(u, 1.0f - u), std::fmin(v, 1.0f - v)) < 1e-3f);
+			}
+		}
+	}
+}
+
+TEST(PanoramaMapsToTheTexelDirections) {
+	HDRImage panorama = DirectionPanorama(512, 256);
+	for (EquirectFilter filter : { EquirectFilter::Bilinear, EquirectFilter::Supersample }) {
+		CubeMapImage cube(32, 1);
+		EquirectToCube(panorama, cube, filter);
+		for (uint32_t face = 0; face < 6; face++) {
+			const float* texels = cube.Texels(face, 0);
+			for (uint32_t y = 0; y < 32; y++) {
+				for (uint32_t x = 0; x < 32; x++) {
+					float dir[3];
+					CubeFaceDirection(face, (x + 0.5f) / 32, (y + 0.5f) / 32, dir);
+					Normalize(dir);
+					const float* texel = texels + (y * 32 + x) * 4;
+					float sampled[3] = { texel[0] - 2.0f, texel[1] - 2.0f, texel[2] - 2.0f };
+					Normalize(sampled);
+					float dot = dir[0] * sampled[0] + dir[1] * sampled[1] + dir[2] * sampled[2];
+					CHECK(dot > 0.999f);
+					CHECK_EQUAL(texel[3], 1.0f);
+				}
+			}
+		}
+	}
+}
+
+TEST(LandmarksLandOnTheirFaces) {
+	// A panorama that is black but for the pixel at longitude 90 degrees on the
+	// horizon, which is +Z: only the middle of the +Z face lights up.
+	HDRImage panorama;
+	panorama.Width = 64;
+	panorama.Height = 32;
+	panorama.Pixels.assign(64 * 32 * 3, 0.0f);
+	for (uint32_t y = 15; y <= 16; y++) {
+		for (uint32_t x = 47; x <= 48; x++) {
+			for (int c = 0; c < 3; c++) {
+				panorama.Pixels[(y * 64 + x) * 3 + c] = 1.0f;
+			}
+		}
+	}
+	CubeMapImage cube(8, 1);
+	EquirectToCube(panorama, cube, EquirectFilter::Bilinear);
+	for (uint32_t face = 0; face < 6; face++) {
+		float sum = 0.0f;
+		for (uint32_t i = 0; i < 64; i++) {
+			sum += cube.Texels(face, 0)[i * 4];
+		}
+		CHECK(face == 4 ? sum > 0.0f : sum == 0.0f);
+	}
+	CHECK(cube.Texels(4, 0)[(3 * 8 + 3) * 4] > 0.0f);
+}
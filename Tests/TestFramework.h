@@ -0,0 +1,69 @@
+#pragma once
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// A minimal test harness: TEST(Name) { ... } registers a test, and CHECK and
+// CHECK_EQUAL end it with a message when they fail.  TestMain.cpp runs them all, or
+// those whose names contain the command line argument, or with -name those whose
+// names do not.
+
+struct TestFailure : std::runtime_error {
+	using std::runtime_error::runtime_error;
+};
+
+struct TestCase {
+	const char* Name;
+	std::function<void()> Fn;
+};
+
+inline std::vector<TestCase>& RegisteredTests() {
+	static std::vector<TestCase> tests;
+	return tests;
+}
+
+struct TestRegistration {
+	TestRegistration(const char* name, std::function<void()> fn) {
+		RegisteredTests().push_back({ name, std::move(fn) });
+	}
+};
+
+#define TEST(name) \
+	static void name(); \
+	static TestRegistration name##Registration(#name, name); \
+	static void name()
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::ostringstream message_; \
+			message_ << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed"; \
+			throw TestFailure(message_.str()); \
+		} \
+	} while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+	do { \
+		auto&& expected_ = (expected); \
+		auto&& actual_ = (actual); \
+		if (!(expected_ == actual_)) { \
+			std::ostringstream message_; \
+			message_ << __FILE__ << ":" << __LINE__ << ": CHECK_EQUAL(" #expected ", " #actual ") failed: " \
+				<< expected_ << " != " << actual_; \
+			throw TestFailure(message_.str()); \
+		} \
+	} while (0)
+
+#define CHECK_THROWS(statement) \
+	do { \
+		bool threw_ = false; \
+		try { statement; } \
+		catch (...) { threw_ = true; } \
+		if (!threw_) { \
+			std::ostringstream message_; \
+			message_ << __FILE__ << ":" << __LINE__ << ": CHECK_THROWS(" #statement ") did not throw"; \
+			throw TestFailure(message_.str()); \
+		} \
+	} while (0)
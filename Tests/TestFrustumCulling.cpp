@@ -0,0 +1,230 @@
+#include "TestFramework.h"
+#include "FrustumCulling.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+	// A 60 degree 16:9 camera at the origin looking down +z, as XMMatrixPerspectiveFovLH
+	// builds it, then turned and moved by view when given.
+	Frustum Camera(float nearZ, float farZ, const float view[4][4] = nullptr) {
+		float yScale = 1.0f / std::tan(0.5f * 1.0471976f);
+		float proj[4][4] = {
+			{ yScale * 9.0f / 16.0f, 0.0f, 0.0f, 0.0f },
+			{ 0.0f, yScale, 0.0f, 0.0f },
+			{ 0.0f, 0.0f, farZ / (farZ - nearZ), 1.0f },
+			{ 0.0f, 0.0f, -nearZ * farZ / (farZ - nearZ), 0.0f },
+		};
+		if (!view) {
+			return FrustumFromViewProj(proj);
+		}
+		float viewProj[4][4] = {};
+		for (int r = 0; r < 4; r++) {
+			for (int c = 0; c < 4; c++) {
+				for (int k = 0; k < 4; k++) {
+					viewProj[r][c] += view[r][k] * proj[k][c];
+				}
+			}
+		}
+		return FrustumFromViewProj(viewProj);
+	}
+
+	// The world to view transform of a camera at eye turned by yaw about y, then by
+	// pitch about x, as row vectors times the matrix.
+	void LookFrom(const float eye[3], float yaw, float pitch, float view[4][4]) {
+		float cy = std::cos(yaw), sy = std::sin(yaw), cp = std::cos(pitch), sp = std::sin(pitch);
+		// Rows of the camera's right, up and forward axes in world space.
+		float axes[3][3] = {
+			{ cy, 0.0f, -sy },
+			{ sy * sp, cp, cy * sp },
+			{ sy * cp, -sp, cy * cp },
+		};
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++) {
+				view[r][c] = axes[c][r];
+			}
+			view[r][3] = 0.0f;
+		}
+		for (int c = 0; c < 3; c++) {
+			view[3][c] = -(eye[0] * axes[c][0] + eye[1] * axes[c][1] + eye[2] * axes[c][2]);
+		}
+		view[3][3] = 1.0f;
+	}
+
+	float Distance(const Frustum& frustum, int plane, const float p[3]) {
+		const float* n = frustum.Planes[plane];
+		return n[0] * p[0] + n[1] * p[1] + n[2] * p[2] + n[3];
+	}
+
+	struct Object {
+		float Center[3];
+		float Extents[3];
+		float Radius;
+	};
+
+	std::vector<Object> RandomObjects(uint32_t count, float range, uint32_t seed) {
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> position(-range, range);
+		std::uniform_real_distribution<float> size(0.1f, 8.0f);
+		std::uniform_real_distribution<float> tightness(0.4f, 1.0f);
+		std::vector<Object> objects(count);
+		for (Object& object : objects) {
+			for (int k = 0; k < 3; k++) {
+				object.Center[k] = position(rng);
+				object.Extents[k] = size(rng);
+			}
+			object.Radius = tightness(rng) * std::sqrt(object.Extents[0] * object.Extents[0] +
+				object.Extents[1] * object.Extents[1] + object.Extents[2] * object.Extents[2]);
+		}
+		return objects;
+	}
+
+	CullingBounds Bounds(const std::vector<Object>& objects) {
+		CullingBounds bounds;
+		for (const Object& object : objects) {
+			bounds.Add(object.Center, object.Extents, object.Radius);
+		}
+		return bounds;
+	}
+
+	// Whether a point of a grid over the box that is also in the sphere lies inside
+	// the frustum, so that the object is certainly visible.
+	bool SampledInside(const Frustum& frustum, const Object& object) {
+		const int steps = 4;
+		for (int x = 0; x <= steps; x++) {
+			for (int y = 0; y <= steps; y++) {
+				for (int z = 0; z <= steps; z++) {
+					float p[3];
+					float distance2 = 0.0f;
+					const int grid[3] = { x, y, z };
+					for (int k = 0; k < 3; k++) {
+						float offset = object.Extents[k] * (2.0f * grid[k] / steps - 1.0f);
+						p[k] = object.Center[k] + offset;
+						distance2 += offset * offset;
+					}
+					if (distance2 > object.Radius * object.Radius) {
+						continue;
+					}
+					bool inside = true;
+					for (int plane = 0; plane < 6; plane++) {
+						inside = inside && Distance(frustum, plane, p) > 1e-3f;
+					}
+					if (inside) {
+						return true;
+					}
+				}
+			}
+		}
+		return false;
+	}
+}
+
+TEST(PlanesAreNormalizedAndFaceInward) {
+	Frustum frustum = Camera(0.5f, 100.0f);
+	for (int plane = 0; plane < 6; plane++) {
+		const float* n = frustum.Planes[plane];
+		CHECK(std::fabs(n[0] * n[0] + n[1] * n[1] + n[2] * n[2] - 1.0f) < 1e-5f);
+		const float ahead[3] = { 0.0f, 0.0f, 10.0f };
+		CHECK(Distance(frustum, plane, ahead) > 0.0f);
+	}
+	const float nearPoint[3] = { 0.0f, 0.0f, 0.5f };
+	const float farPoint[3] = { 0.0f, 0.0f, 100.0f };
+	CHECK(std::fabs(Distance(frustum, 4, nearPoint)) < 1e-4f);
+	CHECK(std::fabs(Distance(frustum, 5, farPoint)) < 1e-2f);
+	// The left plane, at 10 units, passes half the horizontal field of view out.
+	float halfWidth = 10.0f * std::tan(0.5f * 1.0471976f) * 16.0f / 9.0f;
+	const float leftEdge[3] = { -halfWidth, 0.0f, 10.0f };
+	CHECK(std::fabs(Distance(frustum, 0, leftEdge)) < 1e-4f);
+}
+
+TEST(CullsObjectsOutsideEachPlane) {
+	Frustum frustum = Camera(0.5f, 100.0f);
+	const float extents[3] = { 1.0f, 1.0f, 1.0f };
+	const float centers[][3] = {
+		{ 0.0f, 0.0f, 20.0f },	// ahead
+		{ 0.0f, 0.0f, -5.0f },	// behind
+		{ 0.0f, 0.0f, 150.0f },	// past the far plane
+		{ -80.0f, 0.0f, 20.0f },	// left
+		{ 80.0f, 0.0f, 20.0f },	// right
+		{ 0.0f, -80.0f, 20.0f },	// below
+		{ 0.0f, 80.0f, 20.0f },	// above
+		{ 0.0f, 0.0f, 100.5f },	// straddling the far plane
+	};
+	CullingBounds bounds;
+	for (const auto& center : centers) {
+		bounds.Add(center, extents, 1.8f);
+	}
+	std::vector<uint32_t> visible;
+	bounds.Cull(frustum, visible);
+	CHECK(visible == std::vector<uint32_t>({ 0, 7 }));
+
+	// Moving an object changes its result.
+	const float ahead[3] = { 1.0f, 2.0f, 30.0f };
+	bounds.Set(1, ahead, extents, 1.8f);
+	bounds.Cull(frustum, visible);
+	CHECK(visible == std::vector<uint32_t>({ 0, 1, 7 }));
+}
+
+TEST(SphereAndBoxEachCull) {
+	Frustum frustum = Camera(0.5f, 100.0f);
+	std::vector<uint32_t> visible;
+	// A long thin box along x whose corner is behind the left plane and whose center
+	// is near it: the small sphere culls it though the box does not.
+	float halfWidth = 20.0f * std::tan(0.5f * 1.0471976f) * 16.0f / 9.0f;
+	const float center[3] = { -halfWidth - 1.0f, 0.0f, 20.0f };
+	const float longBox[3] = { 5.0f, 0.1f, 0.1f };
+	CullingBounds bounds;
+	bounds.Add(center, longBox, 0.2f);
+	bounds.Cull(frustum, visible);
+	CHECK(visible.empty());
+	bounds.Set(0, center, longBox, 5.0f);
+	bounds.Cull(frustum, visible);
+	CHECK_EQUAL(visible.size(), (size_t)1);
+
+	// A flat box behind the near plane inside a large sphere: the box culls it.
+	const float behind[3] = { 0.0f, 0.0f, -1.0f };
+	const float flat[3] = { 10.0f, 10.0f, 0.2f };
+	bounds.Set(0, behind, flat, 15.0f);
+	bounds.Cull(frustum, visible);
+	CHECK(visible.empty());
+}
+
+TEST(NothingVisibleIsCulled) {
+	const float eye[3] = { 3.0f, -2.0f, 5.0f };
+	float view[4][4];
+	LookFrom(eye, 0.7f, -0.3f, view);
+	Frustum frustum = Camera(0.3f, 60.0f, view);
+	std::vector<Object> objects = RandomObjects(4000, 70.0f, 5);
+	CullingBounds bounds = Bounds(objects);
+	std::vector<uint32_t> visible;
+	bounds.Cull(frustum, visible, false);
+
+	uint32_t sampledVisible = 0;
+	for (uint32_t i = 0; i < objects.size(); i++) {
+		if (SampledInside(frustum, objects[i])) {
+			sampledVisible++;
+			CHECK(std::binary_search(visible.begin(), visible.end(), i));
+		}
+	}
+	// The test sees a real share of both outcomes.
+	CHECK(sampledVisible > 50);
+	CHECK(visible.size() < objects.size() / 2);
+}
+
+TEST(SimdMatchesScalar) {
+	const float eye[3] = { -10.0f, 4.0f, 0.0f };
+	float view[4][4];
+	LookFrom(eye, -1.2f, 0.4f, view);
+	Frustum frustum = Camera(0.1f, 200.0f, view);
+	// Counts around the eight object batches.
+	for (uint32_t count : { 0u, 1u, 7u, 8u, 9u, 63u, 1000u, 20001u }) {
+		CullingBounds bounds = Bounds(RandomObjects(count, 250.0f, count + 1));
+		std::vector<uint32_t> scalar;
+		std::vector<uint32_t> simd;
+		bounds.Cull(frustum, scalar, false);
+		bounds.Cull(frustum, simd, true);
+		CHECK(scalar == simd);
+		CHECK(std::is_sorted(scalar.begin(), scalar.end()));
+	}
+}
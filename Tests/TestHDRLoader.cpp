@@ -0,0 +1,158 @@
+#include "TestFramework.h"
+#include "HDRLoader.h"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+	const char* kPath = "TestHDRLoader.hdr";
+
+	// A header for width x height, with the resolution string given.
+	std::vector<uint8_t> Header(uint32_t width, uint32_t height, const char* yAxis = "-Y") {
+		std::string header = "#?RADIANCE\n# made by the test\nFORMAT=32-bit_rle_rgbe\n\n" + std::string(yAxis) + " " +
+			std::to_string(height) + " +X " + std::to_string(width) + "\n";
+		return std::vector<uint8_t>(header.begin(), header.end());
+	}
+
+	void Append(std::vector<uint8_t>& file, std::initializer_list<uint8_t> bytes) {
+		file.insert(file.end(), bytes);
+	}
+
+	HDRImage Load(const std::vector<uint8_t>& file) {
+		std::ofstream(kPath, std::ios::binary).write(reinterpret_cast<const char*>(file.data()), (std::streamsize)file.size());
+		HDRImage image = LoadHDR(kPath);
+		std::remove(kPath);
+		return image;
+	}
+
+	bool LoadThrows(const std::vector<uint8_t>& file) {
+		bool threw = false;
+		try {
+			Load(file);
+		}
+		catch (const std::runtime_error&) {
+			threw = true;
+		}
+		std::remove(kPath);
+		return threw;
+	}
+
+	// Pixel x of row y, as the RGB triple it decodes to.
+	std::vector<float> Pixel(const HDRImage& image, uint32_t x, uint32_t y) {
+		const float* p = &image.Pixels[((size_t)y * image.Width + x) * 3];
+		return std::vector<float>(p, p + 3);
+	}
+}
+
+TEST(FlatScanlinesDecode) {
+	// Narrow images are always flat: exponent 136 scales mantissas by 1, 129 by 1/128.
+	std::vector<uint8_t> file = Header(2, 2);
+	Append(file, { 128, 64, 32, 129, 1, 2, 3, 136 });
+	Append(file, { 0, 0, 0, 0, 255, 0, 128, 137 });
+	HDRImage image = Load(file);
+	CHECK_EQUAL(image.Width, 2u);
+	CHECK_EQUAL(image.Height, 2u);
+	CHECK(Pixel(image, 0, 0) == std::vector<float>({ 1.0f, 0.5f, 0.25f }));
+	CHECK(Pixel(image, 1, 0) == std::vector<float>({ 1.0f, 2.0f, 3.0f }));
+	// Exponent 0 is black whatever the mantissas.
+	CHECK(Pixel(image, 0, 1) == std::vector<float>({ 0.0f, 0.0f, 0.0f }));
+	CHECK(Pixel(image, 1, 1) == std::vector<float>({ 510.0f, 0.0f, 256.0f }));
+}
+
+TEST(BottomUpFilesAreFlipped) {
+	std::vector<uint8_t> file = Header(1, 2, "+Y");
+	Append(file, { 1, 1, 2, 136 });
+	Append(file, { 4, 4, 4, 136 });
+	HDRImage image = Load(file);
+	CHECK(Pixel(image, 0, 0) == std::vector<float>({ 4.0f, 4.0f, 4.0f }));
+	CHECK(Pixel(image, 0, 1) == std::vector<float>({ 1.0f, 1.0f, 2.0f }));
+}
+
+TEST(OldStyleRunsRepeatThePreviousPixel) {
+	// (1,1,1,n) repeats the pixel before it n times.
+	std::vector<uint8_t> file = Header(6, 1);
+	Append(file, { 10, 20, 30, 136 });
+	Append(file, { 1, 1, 1, 3 });
+	Append(file, { 5, 6, 7, 136 });
+	Append(file, { 8, 9, 10, 136 });
+	HDRImage image = Load(file);
+	for (uint32_t x = 0; x < 4; x++) {
+		CHECK(Pixel(image, x, 0) == std::vector<float>({ 10.0f, 20.0f, 30.0f }));
+	}
+	CHECK(Pixel(image, 4, 0) == std::vector<float>({ 5.0f, 6.0f, 7.0f }));
+	CHECK(Pixel(image, 5, 0) == std::vector<float>({ 8.0f, 9.0f, 10.0f }));
+
+	// Wide scanlines that do not start with 2,2 are flat too.
+	file = Header(8, 1);
+	for (uint8_t x = 0; x < 8; x++) {
+		Append(file, { x, (uint8_t)(x + 1), 3, 136 });
+	}
+	image = Load(file);
+	CHECK(Pixel(image, 7, 0) == std::vector<float>({ 7.0f, 8.0f, 3.0f }));
+}
+
+TEST(PerChannelRunsDecode) {
+	// Width 10: each channel is a run of 6 and then 4 literals.
+	std::vector<uint8_t> file = Header(10, 2);
+	for (uint32_t row = 0; row < 2; row++) {
+		Append(file, { 2, 2, 0, 10 });
+		for (uint8_t c = 0; c < 3; c++) {
+			Append(file, { 128 + 6, (uint8_t)(c + row * 10), 4, 50, 51, 52, 53 });
+		}
+		Append(file, { 128 + 6, 136, 4, 136, 137, 136, 0 });
+	}
+	HDRImage image = Load(file);
+	for (uint32_t row = 0; row < 2; row++) {
+		for (uint32_t x = 0; x < 6; x++) {
+			float base = row * 10.0f;
+			CHECK(Pixel(image, x, row) == std::vector<float>({ base, base + 1.0f, base + 2.0f }));
+		}
+		CHECK(Pixel(image, 6, row) == std::vector<float>({ 50.0f, 50.0f, 50.0f }));
+		CHECK(Pixel(image, 7, row) == std::vector<float>({ 102.0f, 102.0f, 102.0f }));
+		CHECK(Pixel(image, 8, row) == std::vector<float>({ 52.0f, 52.0f, 52.0f }));
+		CHECK(Pixel(image, 9, row) == std::vector<float>({ 0.0f, 0.0f, 0.0f }));
+	}
+}
+
+TEST(BrokenFilesThrow) {
+	std::vector<uint8_t> good = Header(10, 1);
+	Append(good, { 2, 2, 0, 10 });
+	for (int c = 0; c < 4; c++) {
+		Append(good, { 128 + 10, 136 });
+	}
+	HDRImage image = Load(good);
+	CHECK(Pixel(image, 9, 0) == std::vector<float>({ 136.0f, 136.0f, 136.0f }));
+
+	// Cut anywhere in the scanline.
+	for (size_t cut = Header(10, 1).size(); cut < good.size(); cut++) {
+		CHECK(LoadThrows(std::vector<uint8_t>(good.begin(), good.begin() + cut)));
+	}
+
+	// A run past the end of the scanline, and a zero length one.
+	std::vector<uint8_t> overflow = Header(10, 1);
+	Append(overflow, { 2, 2, 0, 10, 128 + 11, 0 });
+	CHECK(LoadThrows(overflow));
+	std::vector<uint8_t> empty = Header(10, 1);
+	Append(empty, { 2, 2, 0, 10, 128, 0 });
+	CHECK(LoadThrows(empty));
+	// A scanline that claims another width.
+	std::vector<uint8_t> width = Header(10, 1);
+	Append(width, { 2, 2, 0, 11 });
+	CHECK(LoadThrows(width));
+	// An old style run with no pixel before it.
+	std::vector<uint8_t> firstRun = Header(2, 1);
+	Append(firstRun, { 1, 1, 1, 1, 0, 0, 0, 0 });
+	CHECK(LoadThrows(firstRun));
+
+	std::string notHdr = "P6\n2 2\n255\n";
+	CHECK(LoadThrows(std::vector<uint8_t>(notHdr.begin(), notHdr.end())));
+	std::string format = "#?RADIANCE\nFORMAT=32-bit_rle_xyze\n\n-Y 1 +X 1\n";
+	CHECK(LoadThrows(std::vector<uint8_t>(format.begin(), format.end())));
+	std::vector<uint8_t> transposed = Header(1, 1);
+	transposed = std::vector<uint8_t>(transposed.begin(), transposed.end() - 10);
+	std::string resolution = "+X 1 -Y 1\n";
+	transposed.insert(transposed.end(), resolution.begin(), resolution.end());
+	CHECK(LoadThrows(transposed));
+	CHECK_THROWS(LoadHDR("TestHDRLoader_missing.hdr"));
+}
@@ -0,0 +1,398 @@
+#include "TestFramework.h"
+#include "CompressedTexture.h"
+#include "CpuFeatures.h"
+#include "HDRPacking.h"
+#include "TaskPool.h"
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <vector>
+#if CPU_AVX2_COMPILED
+#include <immintrin.h>
+#endif
+
+// The sweeps run the conversions on every step-th 32 bit pattern, as floats or as
+// packed texels.  The quick tests take a prime step, which still visits every
+// exponent; the Exhaustive ones take every pattern and run when the build is
+// configured with PBR_EXHAUSTIVE_TESTS.
+
+#if CPU_AVX2_COMPILED && !defined(_MSC_VER)
+#define F16C_TARGET __attribute__((target("avx,f16c")))
+#else
+#define F16C_TARGET
+#endif
+
+namespace {
+	const uint32_t kQuickStep = 4099;
+	const uint64_t kNoMismatch = UINT64_MAX;
+
+	uint32_t BitsOf(float f) {
+		uint32_t u;
+		std::memcpy(&u, &f, sizeof(u));
+		return u;
+	}
+
+	float FloatOf(uint32_t u) {
+		float f;
+		std::memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+
+	// The code of a positive finite value as an unsigned float with a 5 bit exponent,
+	// rounded to nearest even in double, which holds every float and every scaled
+	// float exactly.  Codes past the largest finite one are returned as they are.
+	uint32_t ReferenceSmallFloat(float value, int mantissaBits) {
+		int exponent;
+		std::frexp(value, &exponent);
+		exponent = std::max(exponent - 1, -14);
+		double mantissa = std::nearbyint(std::ldexp((double)value, mantissaBits - exponent));
+		return (uint32_t)(((int64_t)(exponent + 15) << mantissaBits) + (int64_t)mantissa - (1 << mantissaBits));
+	}
+
+	uint16_t ReferenceHalf(float value) {
+		uint16_t sign = (uint16_t)((BitsOf(value) >> 16) & 0x8000);
+		float magnitude = std::fabs(value);
+		if (std::isnan(value)) {
+			return sign | 0x7e00;
+		}
+		if (magnitude == 0.0f) {
+			return sign;
+		}
+		if (magnitude == INFINITY) {
+			return sign | 0x7c00;
+		}
+		// Past the largest finite code is infinity.
+		return (uint16_t)(sign | std::min(ReferenceSmallFloat(magnitude, 10), 0x7c00u));
+	}
+
+	uint32_t ReferenceUnsignedFloat(float value, int mantissaBits) {
+		if (!(value > 0.0f)) {
+			return 0;
+		}
+		if (value == INFINITY) {
+			return 31u << mantissaBits;
+		}
+		return std::min(ReferenceSmallFloat(value, mantissaBits), (31u << mantissaBits) - 1);
+	}
+
+	// EXT_texture_shared_exponent, with the mantissas rounded to nearest even.
+	uint32_t ReferenceRGB9E5(const float rgb[3]) {
+		double c[3];
+		for (int i = 0; i < 3; i++) {
+			c[i] = rgb[i] > 0.0f ? std::min((double)rgb[i], 65408.0) : 0.0;
+		}
+		double maxChannel = std::max(c[0], std::max(c[1], c[2]));
+		int exponent = -16;
+		if (maxChannel > 0.0) {
+			std::frexp(maxChannel, &exponent);
+			exponent = std::max(exponent - 1, -16);
+		}
+		exponent += 16;
+		if (std::nearbyint(std::ldexp(maxChannel, 24 - exponent)) == 512.0) {
+			exponent++;
+		}
+		uint32_t packed = (uint32_t)exponent << 27;
+		for (int i = 0; i < 3; i++) {
+			packed |= (uint32_t)std::nearbyint(std::ldexp(c[i], 24 - exponent)) << (9 * i);
+		}
+		return packed;
+	}
+
+	bool SameFloat(float a, float b) {
+		return std::isnan(a) ? std::isnan(b) : BitsOf(a) == BitsOf(b);
+	}
+
+	bool HalfIsNaN(uint16_t half) {
+		return (half & 0x7fff) > 0x7c00;
+	}
+
+	// F16C is part of every processor with AVX2.
+	bool HasF16C() {
+#if CPU_AVX2_COMPILED
+		return CpuHasAVX2();
+#else
+		return false;
+#endif
+	}
+
+#if CPU_AVX2_COMPILED
+	// count is a multiple of 8.
+	F16C_TARGET void FloatsToHalvesF16C(const float* src, uint16_t* dst, size_t count) {
+		for (size_t i = 0; i < count; i += 8) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+				_mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+		}
+	}
+
+	F16C_TARGET void HalvesToFloatsF16C(const uint16_t* src, float* dst, size_t count) {
+		for (size_t i = 0; i < count; i += 8) {
+			_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+		}
+	}
+#endif
+
+	// Runs check on the patterns 0, step, 2 * step, ... below 2^32, in chunks on the
+	// pool.  check returns the index of its first bad pattern or the chunk size; the
+	// result is the smallest bad pattern, or kNoMismatch.
+	uint64_t Sweep(uint32_t step, const std::function<size_t(const std::vector<uint32_t>& patterns)>& check) {
+		const uint64_t chunkSize = 1u << 16;
+		uint64_t count = ((1ull << 32) + step - 1) / step;
+		std::mutex mutex;
+		uint64_t first = kNoMismatch;
+		TaskPool::Default().ParallelFor((uint32_t)((count + chunkSize - 1) / chunkSize), [&](uint32_t chunk) {
+			std::vector<uint32_t> patterns;
+			for (uint64_t i = chunk * chunkSize; i < std::min(count, (chunk + 1) * chunkSize); i++) {
+				patterns.push_back((uint32_t)(i * step));
+			}
+			size_t bad = check(patterns);
+			if (bad < patterns.size()) {
+				std::lock_guard<std::mutex> lock(mutex);
+				first = std::min<uint64_t>(first, patterns[bad]);
+			}
+		});
+		return first;
+	}
+
+	// FP16 of the patterns as floats against the reference and F16C, and AVX2 against
+	// scalar.  NaNs only have to stay NaNs of the same sign.
+	uint64_t SweepHalves(uint32_t step) {
+		return Sweep(step, [](const std::vector<uint32_t>& patterns) {
+			// F16C converts 8 at a time; the padding converts zeros.
+			size_t count = (patterns.size() + 7) / 8 * 8;
+			std::vector<float> floats(count, 0.0f);
+			std::memcpy(floats.data(), patterns.data(), patterns.size() * sizeof(float));
+			std::vector<uint16_t> scalar(count);
+			std::vector<uint16_t> simd(count);
+			std::vector<uint16_t> hardware(count);
+			FloatsToHalves(floats.data(), scalar.data(), count, false);
+			FloatsToHalves(floats.data(), simd.data(), count, true);
+#if CPU_AVX2_COMPILED
+			if (HasF16C()) {
+				FloatsToHalvesF16C(floats.data(), hardware.data(), count);
+			}
+#endif
+			for (size_t i = 0; i < patterns.size(); i++) {
+				uint16_t expected = ReferenceHalf(floats[i]);
+				if (HasF16C() && hardware[i] != expected && !HalfIsNaN(expected)) {
+					return i;
+				}
+				bool same = HalfIsNaN(expected) ? HalfIsNaN(scalar[i]) && (scalar[i] & 0x8000) == (expected & 0x8000) :
+					scalar[i] == expected;
+				if (!same || simd[i] != scalar[i]) {
+					return i;
+				}
+			}
+			return patterns.size();
+		});
+	}
+
+	// Every pattern as the three channels of an R11G11B10 texel.
+	uint64_t SweepR11G11B10(uint32_t step) {
+		return Sweep(step, [](const std::vector<uint32_t>& patterns) {
+			std::vector<float> rgba(patterns.size() * 4);
+			for (size_t i = 0; i < patterns.size(); i++) {
+				float value = FloatOf(patterns[i]);
+				rgba[i * 4 + 0] = value;
+				rgba[i * 4 + 1] = value;
+				rgba[i * 4 + 2] = value;
+				rgba[i * 4 + 3] = 0.0f;
+			}
+			std::vector<uint32_t> scalar(patterns.size());
+			std::vector<uint32_t> simd(patterns.size());
+			PackR11G11B10(rgba.data(), scalar.data(), patterns.size(), false);
+			PackR11G11B10(rgba.data(), simd.data(), patterns.size(), true);
+			for (size_t i = 0; i < patterns.size(); i++) {
+				float value = rgba[i * 4];
+				uint32_t expected = ReferenceUnsignedFloat(value, 6) | ReferenceUnsignedFloat(value, 6) << 11 |
+					ReferenceUnsignedFloat(value, 5) << 22;
+				if (scalar[i] != expected || simd[i] != scalar[i]) {
+					return i;
+				}
+			}
+			return patterns.size();
+		});
+	}
+
+	// Every pattern as the red channel of an RGB9E5 texel, with a green about an
+	// eighth of it and a blue from a hash of it.
+	uint64_t SweepRGB9E5(uint32_t step) {
+		return Sweep(step, [](const std::vector<uint32_t>& patterns) {
+			std::vector<float> rgba(patterns.size() * 4);
+			for (size_t i = 0; i < patterns.size(); i++) {
+				rgba[i * 4 + 0] = FloatOf(patterns[i]);
+				rgba[i * 4 + 1] = FloatOf(patterns[i] - (3u << 23));
+				rgba[i * 4 + 2] = FloatOf(patterns[i] * 2654435761u);
+				rgba[i * 4 + 3] = 0.0f;
+			}
+			std::vector<uint32_t> scalar(patterns.size());
+			std::vector<uint32_t> simd(patterns.size());
+			PackRGB9E5(rgba.data(), scalar.data(), patterns.size(), false);
+			PackRGB9E5(rgba.data(), simd.data(), patterns.size(), true);
+			for (size_t i = 0; i < patterns.size(); i++) {
+				if (scalar[i] != ReferenceRGB9E5(&rgba[i * 4]) || simd[i] != scalar[i]) {
+					return i;
+				}
+			}
+			return patterns.size();
+		});
+	}
+
+	// Every pattern as an RGB9E5 code: AVX2 decodes it as scalar does, and packing the
+	// decoded texel gives back the same values, though not always the same code.
+	uint64_t SweepRGB9E5Codes(uint32_t step) {
+		return Sweep(step, [](const std::vector<uint32_t>& patterns) {
+			std::vector<float> scalar(patterns.size() * 4);
+			std::vector<float> simd(patterns.size() * 4);
+			UnpackRGB9E5(patterns.data(), scalar.data(), patterns.size(), false);
+			UnpackRGB9E5(patterns.data(), simd.data(), patterns.size(), true);
+			std::vector<uint32_t> repacked(patterns.size());
+			PackRGB9E5(scalar.data(), repacked.data(), patterns.size(), false);
+			std::vector<float> again(patterns.size() * 4);
+			UnpackRGB9E5(repacked.data(), again.data(), patterns.size(), false);
+			for (size_t i = 0; i < patterns.size() * 4; i++) {
+				if (BitsOf(scalar[i]) != BitsOf(simd[i]) || BitsOf(again[i]) != BitsOf(scalar[i])) {
+					return i / 4;
+				}
+			}
+			return patterns.size();
+		});
+	}
+}
+
+TEST(HalfEdgeCases) {
+	CHECK_EQUAL(FloatToHalf(65504.0f), 0x7bff);
+	CHECK_EQUAL(FloatToHalf(65519.99f), 0x7bff);
+	CHECK_EQUAL(FloatToHalf(65520.0f), 0x7c00);
+	CHECK_EQUAL(FloatToHalf(-INFINITY), 0xfc00);
+	CHECK(HalfIsNaN(FloatToHalf(NAN)));
+	// The smallest denormal, 2^-24, and ties to even below and above it.
+	CHECK_EQUAL(FloatToHalf(std::ldexp(1.0f, -24)), 0x0001);
+	CHECK_EQUAL(FloatToHalf(std::ldexp(1.0f, -25)), 0x0000);
+	CHECK_EQUAL(FloatToHalf(std::ldexp(3.0f, -25)), 0x0002);
+	CHECK_EQUAL(FloatToHalf(-0.0f), 0x8000);
+	// 1 + 2^-11 is halfway between 1 and the next half, and rounds to the even 1.
+	CHECK_EQUAL(FloatToHalf(1.0f + std::ldexp(1.0f, -11)), 0x3c00);
+	CHECK_EQUAL(FloatToHalf(1.0f + std::ldexp(3.0f, -11)), 0x3c02);
+}
+
+TEST(EveryHalfRoundTrips) {
+	std::vector<uint16_t> halves(1u << 16);
+	for (uint32_t h = 0; h < halves.size(); h++) {
+		halves[h] = (uint16_t)h;
+	}
+	std::vector<float> scalar(halves.size());
+	std::vector<float> simd(halves.size());
+	HalvesToFloats(halves.data(), scalar.data(), halves.size(), false);
+	HalvesToFloats(halves.data(), simd.data(), halves.size(), true);
+	std::vector<float> hardware(halves.size());
+#if CPU_AVX2_COMPILED
+	if (HasF16C()) {
+		HalvesToFloatsF16C(halves.data(), hardware.data(), halves.size());
+	}
+#endif
+	for (uint32_t h = 0; h < halves.size(); h++) {
+		CHECK_EQUAL(BitsOf(simd[h]), BitsOf(scalar[h]));
+		if (HasF16C()) {
+			CHECK(SameFloat(scalar[h], hardware[h]));
+		}
+		if (HalfIsNaN((uint16_t)h)) {
+			CHECK(std::isnan(scalar[h]));
+			CHECK(HalfIsNaN(FloatToHalf(scalar[h])));
+		}
+		else {
+			CHECK_EQUAL(FloatToHalf(scalar[h]), h);
+		}
+	}
+}
+
+TEST(EverySmallFloatCodeRoundTrips) {
+	// Each channel on its own; the others stay 0.  Codes with the top exponent and a
+	// mantissa are NaN, which the packer turns into 0.
+	const int shifts[3] = { 0, 11, 22 };
+	const int mantissaBits[3] = { 6, 6, 5 };
+	for (int c = 0; c < 3; c++) {
+		for (uint32_t code = 0; code <= 31u << mantissaBits[c]; code++) {
+			uint32_t packed = code << shifts[c];
+			float rgba[4];
+			float simd[8 * 4];
+			uint32_t eight[8] = { packed, packed, packed, packed, packed, packed, packed, packed };
+			UnpackR11G11B10(&packed, rgba, 1, false);
+			UnpackR11G11B10(eight, simd, 8, true);
+			CHECK_EQUAL(BitsOf(simd[4 * 7 + c]), BitsOf(rgba[c]));
+			CHECK_EQUAL(PackR11G11B10(rgba), packed);
+		}
+	}
+	float huge[3] = { 1e9f, 1e9f, 1e9f };
+	float rgb[3];
+	UnpackR11G11B10(PackR11G11B10(huge), rgb);
+	CHECK_EQUAL(rgb[0], 65024.0f);
+	CHECK_EQUAL(rgb[2], 64512.0f);
+}
+
+TEST(RGB9E5EdgeCases) {
+	float rgb[3];
+	float max[3] = { 65408.0f, 1e9f, -1.0f };
+	UnpackRGB9E5(PackRGB9E5(max), rgb);
+	CHECK_EQUAL(rgb[0], 65408.0f);
+	CHECK_EQUAL(rgb[1], 65408.0f);
+	CHECK_EQUAL(rgb[2], 0.0f);
+	// 511.5 rounds up to 512 mantissa steps, which carries into the exponent.
+	float carry[3] = { 511.5f, 0.25f, 0.0f };
+	UnpackRGB9E5(PackRGB9E5(carry), rgb);
+	CHECK_EQUAL(rgb[0], 512.0f);
+	CHECK_EQUAL(rgb[1], 0.0f);
+	float zero[3] = { 0.0f, -0.0f, NAN };
+	CHECK_EQUAL(PackRGB9E5(zero), 0u);
+}
+
+TEST(PackHDRTexelsDispatchesByFormat) {
+	std::vector<float> rgba = { 0.5f, 2.0f, 1000.0f, 1.0f, 1e-3f, 0.0f, 70000.0f, 1.0f };
+	CHECK_EQUAL(HDRTexelBytes(kDxgiFormatR16G16B16A16Float), 8u);
+	CHECK_EQUAL(HDRTexelBytes(kDxgiFormatR11G11B10Float), 4u);
+	CHECK_EQUAL(HDRTexelBytes(kDxgiFormatR9G9B9E5SharedExp), 4u);
+	CHECK_EQUAL(HDRTexelBytes(kDxgiFormatR8G8B8A8Unorm), 0u);
+
+	uint16_t halves[8];
+	PackHDRTexels(kDxgiFormatR16G16B16A16Float, rgba.data(), 2, halves);
+	for (int i = 0; i < 8; i++) {
+		CHECK_EQUAL(halves[i], FloatToHalf(rgba[i]));
+	}
+	uint32_t packed[2];
+	PackHDRTexels(kDxgiFormatR9G9B9E5SharedExp, rgba.data(), 2, packed);
+	CHECK_EQUAL(packed[1], PackRGB9E5(&rgba[4]));
+	CHECK_THROWS(PackHDRTexels(kDxgiFormatR8G8B8A8Unorm, rgba.data(), 2, packed));
+}
+
+TEST(HalvesMatchReferenceAndF16C) {
+	CHECK_EQUAL(SweepHalves(kQuickStep), kNoMismatch);
+}
+
+TEST(R11G11B10MatchesReference) {
+	CHECK_EQUAL(SweepR11G11B10(kQuickStep), kNoMismatch);
+}
+
+TEST(RGB9E5MatchesReference) {
+	CHECK_EQUAL(SweepRGB9E5(kQuickStep), kNoMismatch);
+}
+
+TEST(RGB9E5CodesRoundTrip) {
+	CHECK_EQUAL(SweepRGB9E5Codes(kQuickStep), kNoMismatch);
+}
+
+TEST(ExhaustiveHalves) {
+	CHECK_EQUAL(SweepHalves(1), kNoMismatch);
+}
+
+TEST(ExhaustiveR11G11B10) {
+	CHECK_EQUAL(SweepR11G11B10(1), kNoMismatch);
+}
+
+TEST(ExhaustiveRGB9E5) {
+	CHECK_EQUAL(SweepRGB9E5(1), kNoMismatch);
+}
+
+TEST(ExhaustiveRGB9E5Codes) {
+	CHECK_EQUAL(SweepRGB9E5Codes(1), kNoMismatch);
+}
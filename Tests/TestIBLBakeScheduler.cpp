@@ -0,0 +1,187 @@
+#include "TestFramework.h"
+#include "IBLBakeScheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <vector>
+
+namespace {
+	// A backend whose jobs take a fixed time per texel of each target.  It returns the
+	// time right away, or, like the GPU backend, -1 and hands it over later.
+	class SimulatedBackend : public IBakeBackend {
+	public:
+		SimulatedBackend(std::vector<float> msPerTexel, bool async) : mMsPerTexel(msPerTexel), mAsync(async) {}
+
+		virtual float ExecuteJob(const BakeJob& job)override {
+			float ms = mMsPerTexel[job.Target] * job.Width * job.Height;
+			FrameMs += ms;
+			FrameJobs++;
+			if (mAsync) {
+				Pending.push_back({ job.Target, (uint64_t)job.Width * job.Height, ms });
+				return -1.0f;
+			}
+			return ms;
+		}
+
+		struct Cost {
+			uint32_t Target;
+			uint64_t Texels;
+			float Ms;
+		};
+		std::vector<Cost> Pending;
+		float FrameMs = 0.0f;
+		uint32_t FrameJobs = 0;
+
+	private:
+		std::vector<float> mMsPerTexel;
+		bool mAsync;
+	};
+
+	// Runs the scheduler to the end and returns the time each frame took.  Async
+	// costs reach the scheduler latency frames after their frame.
+	std::vector<float> RunToCompletion(IBLBakeScheduler& scheduler, SimulatedBackend& backend, float budgetMs,
+		uint32_t latency, std::vector<uint32_t>* jobsPerFrame = nullptr)
+	{
+		std::deque<std::vector<SimulatedBackend::Cost>> inFlight;
+		std::vector<float> frames;
+		while (!scheduler.Finished()) {
+			if (inFlight.size() > latency) {
+				for (const auto& cost : inFlight.front()) {
+					scheduler.ReportCost(cost.Target, cost.Texels, cost.Ms);
+				}
+				inFlight.pop_front();
+			}
+			backend.FrameMs = 0.0f;
+			backend.FrameJobs = 0;
+			scheduler.RunFrame(backend, budgetMs);
+			frames.push_back(backend.FrameMs);
+			if (jobsPerFrame) {
+				jobsPerFrame->push_back(backend.FrameJobs);
+			}
+			inFlight.push_back(std::move(backend.Pending));
+			backend.Pending.clear();
+			CHECK(frames.size() < 100000);
+		}
+		return frames;
+	}
+
+	BakeTargetDesc Target(uint32_t size, uint32_t mips, uint32_t faces, float costPerTexelMs) {
+		BakeTargetDesc desc;
+		desc.Size = size;
+		desc.MipLevels = mips;
+		desc.Faces = faces;
+		desc.CostPerTexelMs = costPerTexelMs;
+		return desc;
+	}
+}
+
+TEST(MeasuredCostsKeepFramesInBudget) {
+	// The initial guesses are ten times too low and too high.
+	IBLBakeScheduler scheduler(64);
+	scheduler.AddTarget(Target(256, 9, 6, 1e-5f));
+	scheduler.AddTarget(Target(512, 10, 6, 2e-6f));
+	SimulatedBackend backend({ 1e-4f, 2e-7f }, false);
+	const float budgetMs = 2.0f;
+	std::vector<uint32_t> jobs;
+	std::vector<float> frames = RunToCompletion(scheduler, backend, budgetMs, 0, &jobs);
+
+	// After a few frames to learn the costs, a frame goes over the budget only when
+	// its first job alone does, which the scheduler runs to make progress.
+	for (size_t i = 4; i < frames.size(); i++) {
+		CHECK(frames[i] <= budgetMs * 1.001f || jobs[i] == 1);
+	}
+	CHECK(scheduler.TargetFinished(0));
+	CHECK(scheduler.TargetFinished(1));
+	CHECK(scheduler.Progress() == 1.0f);
+}
+
+TEST(DelayedCostsKeepFramesInBudget) {
+	// As with GPU timestamps read back when the frame's fence has passed.  The first
+	// guess is four times too low, the second twice too high.
+	IBLBakeScheduler scheduler(64);
+	scheduler.AddTarget(Target(512, 10, 6, 5e-6f));
+	scheduler.AddTarget(Target(512, 10, 6, 1e-5f));
+	SimulatedBackend backend({ 2e-5f, 5e-6f }, true);
+	const float budgetMs = 1.0f;
+	const uint32_t latency = 2;
+	std::vector<float> frames = RunToCompletion(scheduler, backend, budgetMs, latency);
+
+	// Frames recorded before any measurement arrived run on the guess.
+	CHECK(frames.size() > 40);
+	CHECK(frames[0] > budgetMs * 2.0f);
+	// The smoothed estimate needs a few frames of reports to settle.
+	for (size_t i = latency + 8; i < frames.size(); i++) {
+		CHECK(frames[i] <= budgetMs * 1.05f);
+	}
+}
+
+TEST(FramesUseMostOfTheBudget) {
+	IBLBakeScheduler scheduler(16);
+	scheduler.AddTarget(Target(512, 1, 6, 1e-4f));
+	SimulatedBackend backend({ 1e-4f }, false);
+	const float budgetMs = 2.0f;
+	std::vector<float> frames = RunToCompletion(scheduler, backend, budgetMs, 0);
+	// 16x16 jobs of 0.0256 ms: every frame but the last packs 78 of them.
+	for (size_t i = 0; i + 1 < frames.size(); i++) {
+		CHECK(frames[i] <= budgetMs);
+		CHECK(frames[i] > budgetMs - 0.0256f * 1.01f);
+	}
+}
+
+TEST(CpuBackendBakesEveryTexelOnceWithinBudget) {
+	const uint32_t size = 128;
+	const uint32_t mips = 8;
+	IBLBakeScheduler scheduler(32);
+	scheduler.AddTarget(Target(size, mips, 6, 1e-6f));
+
+	// One counter per texel of every face and mip, and a few hundred flops per texel
+	// so that the jobs take measurable time.
+	std::vector<std::vector<uint32_t>> written(mips);
+	for (uint32_t mip = 0; mip < mips; mip++) {
+		uint32_t extent = std::max(size >> mip, 1u);
+		written[mip].assign(6 * extent * extent, 0);
+	}
+	volatile float sink = 0.0f;
+	CpuBakeBackend backend([&](const BakeJob& job) {
+		uint32_t extent = std::max(size >> job.Mip, 1u);
+		for (uint32_t y = job.Y; y < job.Y + job.Height; y++) {
+			for (uint32_t x = job.X; x < job.X + job.Width; x++) {
+				float sum = 0.0f;
+				for (int s = 0; s < 256; s++) {
+					sum += std::sqrt((float)(x * s + y));
+				}
+				sink = sink + sum;
+				written[job.Mip][(job.Face * extent + y) * extent + x]++;
+			}
+		}
+	});
+
+	struct TimingBackend : IBakeBackend {
+		IBakeBackend* Inner;
+		float FrameMs = 0.0f;
+		virtual float ExecuteJob(const BakeJob& job)override {
+			float ms = Inner->ExecuteJob(job);
+			CHECK(ms >= 0.0f);
+			FrameMs += ms;
+			return ms;
+		}
+	} timing;
+	timing.Inner = &backend;
+
+	const float budgetMs = 1.0f;
+	std::vector<float> frames;
+	while (!scheduler.Finished()) {
+		timing.FrameMs = 0.0f;
+		scheduler.RunFrame(timing, budgetMs);
+		frames.push_back(timing.FrameMs);
+	}
+	for (const auto& mip : written) {
+		for (uint32_t count : mip) {
+			CHECK_EQUAL(1u, count);
+		}
+	}
+	// Wall time is noisy, so look at the typical frame.
+	CHECK(frames.size() > 4);
+	std::sort(frames.begin(), frames.end());
+	CHECK(frames[frames.size() / 2] <= budgetMs * 1.25f);
+}
@@ -0,0 +1,38 @@
+#include "TestFramework.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+int main(int argc, char** argv) {
+	// A filter that starts with - skips the tests whose names contain the rest.
+	const char* filter = argc > 1 ? argv[1] : nullptr;
+	bool exclude = filter && filter[0] == '-';
+	if (exclude) {
+		filter++;
+	}
+	int run = 0;
+	int failed = 0;
+	for (const TestCase& test : RegisteredTests()) {
+		if (filter && (std::strstr(test.Name, filter) != nullptr) == exclude) {
+			continue;
+		}
+		run++;
+		auto start = std::chrono::steady_clock::now();
+		try {
+			test.Fn();
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			std::printf("[ pass ] %s (%.3f s)\n", test.Name, seconds);
+		}
+		catch (const std::exception& e) {
+			failed++;
+			std::printf("[ FAIL ] %s\n  %s\n", test.Name, e.what());
+		}
+		catch (...) {
+			failed++;
+			std::printf("[ FAIL ] %s\n  unknown exception\n", test.Name);
+		}
+	}
+	std::printf("%d of %d tests passed\n", run - failed, run);
+	return failed == 0 && run > 0 ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+#include "TestFramework.h"
+#include "MipGenerator.h"
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+	SourceImage Image(uint32_t width, uint32_t height, const uint8_t rgba[4]) {
+		SourceImage image;
+		image.Width = width;
+		image.Height = height;
+		for (uint32_t i = 0; i < width * height; i++) {
+			image.Pixels.insert(image.Pixels.end(), rgba, rgba + 4);
+		}
+		return image;
+	}
+
+	SourceImage Noise(uint32_t width, uint32_t height, uint32_t seed) {
+		SourceImage image;
+		image.Width = width;
+		image.Height = height;
+		for (uint32_t i = 0; i < width * height * 4; i++) {
+			seed = seed * 1664525u + 1013904223u;
+			image.Pixels.push_back((uint8_t)(seed >> 24));
+		}
+		return image;
+	}
+
+	// Normals that tilt by tilt in x, alternating in sign from texel to texel.
+	SourceImage Bumps(uint32_t size, float tilt) {
+		SourceImage image;
+		image.Width = size;
+		image.Height = size;
+		float z = std::sqrt(1.0f - tilt * tilt);
+		for (uint32_t y = 0; y < size; y++) {
+			for (uint32_t x = 0; x < size; x++) {
+				float nx = (x + y) % 2 ? tilt : -tilt;
+				image.Pixels.insert(image.Pixels.end(),
+					{ (uint8_t)std::lround(127.5f * (nx + 1.0f)), 128, (uint8_t)std::lround(127.5f * (z + 1.0f)), 255 });
+			}
+		}
+		return image;
+	}
+
+	const uint8_t* Texel(const CompressedTexture& texture, uint32_t mip, uint32_t x, uint32_t y) {
+		return texture.Blocks(0, mip) + y * texture.RowPitch(mip) + x * 4;
+	}
+}
+
+TEST(ChainCoversOddSizes) {
+	const uint8_t grey[4] = { 90, 90, 90, 255 };
+	CompressedTexture chain = GenerateMips(Image(37, 20, grey), MipGenSettings());
+	CHECK_EQUAL(chain.MipLevels(), 6u);
+	CHECK_EQUAL(chain.MipWidth(1), 18u);
+	CHECK_EQUAL(chain.MipHeight(1), 10u);
+	CHECK_EQUAL(chain.MipWidth(5), 1u);
+	CHECK_EQUAL(chain.MipHeight(5), 1u);
+	CHECK_EQUAL(chain.BlockBytes(), 4u);
+}
+
+TEST(ConstantImageStaysConstant) {
+	const uint8_t color[4] = { 200, 17, 96, 255 };
+	for (TextureUsage usage : { TextureUsage::Color, TextureUsage::Linear, TextureUsage::Packed }) {
+		MipGenSettings settings;
+		settings.Usage = usage;
+		CompressedTexture chain = GenerateMips(Image(45, 45, color), settings);
+		for (uint32_t mip = 0; mip < chain.MipLevels(); mip++) {
+			for (uint32_t y = 0; y < chain.MipHeight(mip); y++) {
+				for (uint32_t x = 0; x < chain.MipWidth(mip); x++) {
+					const uint8_t* texel = Texel(chain, mip, x, y);
+					for (int c = 0; c < 4; c++) {
+						CHECK(std::abs(texel[c] - color[c]) <= 1);
+					}
+				}
+			}
+		}
+	}
+}
+
+TEST(ColorAveragesInLinearSpace) {
+	// Black and white stripes average to linear 0.5, which is 188 in sRGB.
+	SourceImage image;
+	image.Width = 2;
+	image.Height = 2;
+	image.Pixels = { 0, 0, 0, 255, 255, 255, 255, 255, 0, 0, 0, 255, 255, 255, 255, 255 };
+	CompressedTexture chain = GenerateMips(image, MipGenSettings());
+	CHECK(std::abs(Texel(chain, 1, 0, 0)[0] - 188) <= 1);
+
+	MipGenSettings linear;
+	linear.Usage = TextureUsage::Linear;
+	chain = GenerateMips(image, linear);
+	CHECK(std::abs(Texel(chain, 1, 0, 0)[0] - 128) <= 1);
+}
+
+TEST(TransparentTexelsDoNotBleed) {
+	// Opaque red next to transparent green.
+	SourceImage image;
+	image.Width = 8;
+	image.Height = 8;
+	for (uint32_t i = 0; i < 64; i++) {
+		bool opaque = i % 8 < 4;
+		image.Pixels.insert(image.Pixels.end(), { (uint8_t)(opaque ? 255 : 0), (uint8_t)(opaque ? 0 : 255), 0, (uint8_t)(opaque ? 255 : 0) });
+	}
+	MipGenSettings settings;
+	settings.AlphaWeighted = true;
+	CompressedTexture chain = GenerateMips(image, settings);
+	const uint8_t* last = Texel(chain, chain.MipLevels() - 1, 0, 0);
+	CHECK(last[0] >= 254);
+	CHECK(last[1] <= 1);
+	CHECK(std::abs(last[3] - 128) <= 1);
+}
+
+TEST(NormalsStayUnitLength) {
+	MipGenSettings settings;
+	settings.Usage = TextureUsage::Normal;
+	CompressedTexture chain = GenerateMips(Noise(33, 17, 5), settings);
+	for (uint32_t mip = 1; mip < chain.MipLevels(); mip++) {
+		for (uint32_t y = 0; y < chain.MipHeight(mip); y++) {
+			for (uint32_t x = 0; x < chain.MipWidth(mip); x++) {
+				const uint8_t* texel = Texel(chain, mip, x, y);
+				float length2 = 0.0f;
+				for (int c = 0; c < 3; c++) {
+					float n = texel[c] / 127.5f - 1.0f;
+					length2 += n * n;
+				}
+				CHECK(std::fabs(std::sqrt(length2) - 1.0f) < 0.02f);
+			}
+		}
+	}
+}
+
+TEST(ToksvigWidensRoughness) {
+	const uint8_t orm[4] = { 255, 64, 0, 255 };
+	SourceImage bumps = Bumps(16, 0.6f);
+	MipGenSettings plain;
+	plain.Usage = TextureUsage::Packed;
+	MipGenSettings toksvig = plain;
+	toksvig.ToksvigNormals = &bumps;
+
+	CompressedTexture flat = GenerateMips(Image(16, 16, orm), plain);
+	CompressedTexture widened = GenerateMips(Image(16, 16, orm), toksvig);
+	uint32_t last = flat.MipLevels() - 1;
+	CHECK(std::abs(Texel(flat, last, 0, 0)[1] - 64) <= 1);
+	CHECK(Texel(widened, last, 0, 0)[1] > 64 + 8);
+	// Occlusion and metallic are untouched.
+	CHECK_EQUAL(Texel(widened, last, 0, 0)[0], Texel(flat, last, 0, 0)[0]);
+	CHECK_EQUAL(Texel(widened, last, 0, 0)[2], Texel(flat, last, 0, 0)[2]);
+}
+
+TEST(SimdMatchesScalarWithinOneCode) {
+	for (TextureUsage usage : { TextureUsage::Color, TextureUsage::Linear, TextureUsage::Normal }) {
+		MipGenSettings scalar;
+		scalar.Usage = usage;
+		scalar.AlphaWeighted = usage == TextureUsage::Color;
+		scalar.AllowSimd = false;
+		MipGenSettings simd = scalar;
+		simd.AllowSimd = true;
+
+		SourceImage image = Noise(131, 77, 9);
+		CompressedTexture a = GenerateMips(image, scalar);
+		CompressedTexture b = GenerateMips(image, simd);
+		CHECK_EQUAL(a.ByteSize(), b.ByteSize());
+		for (size_t i = 0; i < a.ByteSize(); i++) {
+			CHECK(std::abs(a.Data()[i] - b.Data()[i]) <= 1);
+		}
+	}
+}
+
+TEST(MalformedImageThrows) {
+	SourceImage image;
+	image.Width = 4;
+	image.Height = 4;
+	image.Pixels.resize(15);
+	CHECK_THROWS(GenerateMips(image, MipGenSettings()));
+}
@@ -0,0 +1,306 @@
+#include "TestFramework.h"
+#include "MipStreaming.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+	const float kPi = 3.14159265f;
+
+	// A square RGBA8 texture with its mips of tailSize texels and below resident.
+	StreamedTextureDesc Texture(uint32_t size, uint32_t tailSize = 64) {
+		StreamedTextureDesc desc;
+		desc.Width = size;
+		desc.Height = size;
+		desc.TailMips = 0;
+		for (uint32_t mip = size; mip > 0; mip /= 2) {
+			desc.MipBytes.push_back((uint64_t)mip * mip * 4);
+			desc.TailMips += mip <= tailSize ? 1 : 0;
+		}
+		return desc;
+	}
+
+	uint64_t Bytes(const StreamedTextureDesc& desc, uint32_t firstMip) {
+		uint64_t bytes = 0;
+		for (uint32_t mip = firstMip; mip < desc.MipBytes.size(); mip++) {
+			bytes += desc.MipBytes[mip];
+		}
+		return bytes;
+	}
+
+	StreamingView View(float z, float lookZ = 1.0f) {
+		StreamingView view;
+		view.Eye[0] = 0.0f;
+		view.Eye[1] = 0.0f;
+		view.Eye[2] = z;
+		view.Look[0] = 0.0f;
+		view.Look[1] = 0.0f;
+		view.Look[2] = lookZ;
+		view.FovY = 0.25f * kPi;
+		view.ViewportWidth = 1280.0f;
+		view.ViewportHeight = 720.0f;
+		return view;
+	}
+
+	StreamingInstance Sphere(float x, float radius, uint32_t texture) {
+		StreamingInstance instance;
+		instance.Center[0] = x;
+		instance.Center[1] = 0.0f;
+		instance.Center[2] = 0.0f;
+		instance.Radius = radius;
+		instance.UVPerWorldUnit = 1.0f / (2.0f * kPi * radius);
+		instance.Texture = texture;
+		return instance;
+	}
+
+	// Runs frames of the same requests, finishing every load at once, until the
+	// streamer has nothing left to do.
+	void Settle(MipStreamer& streamer, const std::vector<std::pair<uint32_t, float>>& requests, float coverage = 1000.0f) {
+		for (int frame = 0; frame < 100; frame++) {
+			streamer.BeginFrame();
+			for (const auto& request : requests) {
+				streamer.Request(request.first, request.second, coverage);
+			}
+			std::vector<MipStreamCommand> commands = streamer.Update();
+			if (commands.empty()) {
+				return;
+			}
+			for (const MipStreamCommand& command : commands) {
+				if (command.Action == MipStreamAction::Load) {
+					streamer.LoadFinished(command.Texture, command.Mip);
+				}
+			}
+		}
+		CHECK(false);
+	}
+
+	MipStreamingScenario SphereRow(uint32_t textures, uint32_t size) {
+		MipStreamingScenario scenario;
+		for (uint32_t t = 0; t < textures; t++) {
+			scenario.Textures.push_back(Texture(size));
+			scenario.Instances.push_back(Sphere(3.0f * t - 1.5f * textures, 1.0f, t));
+		}
+		const float center[3] = { 0.0f, 0.0f, 0.0f };
+		scenario.Path = MakeOrbitPath(center, 2.0f, 80.0f, 600, 0.25f * kPi, 1280.0f, 720.0f);
+		return scenario;
+	}
+}
+
+TEST(RequiredMipFollowsDistance) {
+	StreamingInstance sphere = Sphere(0.0f, 1.0f, 0);
+	float nearCoverage;
+	float farCoverage;
+	float nearMip = RequiredMip(View(-4.0f), sphere, 2048, nearCoverage);
+	float farMip = RequiredMip(View(-7.0f), sphere, 2048, farCoverage);
+	// Twice as far from the surface needs one mip less.
+	CHECK(std::fabs(farMip - nearMip - 1.0f) < 1e-3f);
+	CHECK(nearCoverage > farCoverage);
+	CHECK(farCoverage > 0.0f);
+
+	float behindCoverage;
+	RequiredMip(View(-4.0f, -1.0f), sphere, 2048, behindCoverage);
+	CHECK_EQUAL(behindCoverage, 0.0f);
+}
+
+TEST(TailsStayResidentAndCount) {
+	MipStreamingDesc desc;
+	desc.BudgetBytes = 1 << 20;
+	MipStreamer streamer(desc);
+	StreamedTextureDesc texture = Texture(1024);
+	uint32_t id = streamer.AddTexture(texture);
+	CHECK_EQUAL(streamer.ResidentMip(id), 4u);
+	CHECK_EQUAL(streamer.CommittedBytes(), Bytes(texture, 4));
+
+	// Nothing requested: nothing to load, and the tail is never dropped.
+	streamer.BeginFrame();
+	CHECK(streamer.Update().empty());
+	CHECK_EQUAL(streamer.ResidentMip(id), 4u);
+
+	desc.BudgetBytes = Bytes(texture, 4) - 1;
+	MipStreamer small(desc);
+	CHECK_THROWS(small.AddTexture(texture));
+}
+
+TEST(RequestedMipsLoadInOrder) {
+	MipStreamingDesc desc;
+	desc.BudgetBytes = 64ull << 20;
+	MipStreamer streamer(desc);
+	uint32_t id = streamer.AddTexture(Texture(1024));
+
+	// Loads run one mip at a time from the tail towards the request, so the resident
+	// mips stay contiguous.
+	uint32_t expected = 3;
+	for (int frame = 0; frame < 10; frame++) {
+		streamer.BeginFrame();
+		streamer.Request(id, 1.4f, 100.0f);
+		for (const MipStreamCommand& command : streamer.Update()) {
+			CHECK(command.Action == MipStreamAction::Load);
+			CHECK_EQUAL(command.Mip, expected);
+			streamer.LoadFinished(command.Texture, command.Mip);
+			expected--;
+		}
+	}
+	CHECK_EQUAL(streamer.ResidentMip(id), 1u);
+	CHECK_EQUAL(streamer.TargetMip(id), 1u);
+}
+
+TEST(BudgetGoesToHigherCoverage) {
+	StreamedTextureDesc texture = Texture(1024);
+	MipStreamingDesc desc;
+	// Room for mip 3 of one texture only.
+	desc.BudgetBytes = 2 * Bytes(texture, 4) + texture.MipBytes[3];
+	MipStreamer streamer(desc);
+	uint32_t small = streamer.AddTexture(texture);
+	uint32_t large = streamer.AddTexture(texture);
+
+	for (int frame = 0; frame < 4; frame++) {
+		streamer.BeginFrame();
+		streamer.Request(small, 0.0f, 100.0f);
+		streamer.Request(large, 0.0f, 10000.0f);
+		for (const MipStreamCommand& command : streamer.Update()) {
+			streamer.LoadFinished(command.Texture, command.Mip);
+		}
+	}
+	CHECK_EQUAL(streamer.ResidentMip(large), 3u);
+	CHECK_EQUAL(streamer.ResidentMip(small), 4u);
+	CHECK(streamer.CommittedBytes() <= desc.BudgetBytes);
+}
+
+TEST(BudgetGoesToCheaperBytes) {
+	// Same coverage: a step of the small texture buys the same pixels for a quarter
+	// of the bytes.
+	StreamedTextureDesc big = Texture(2048, 128);
+	StreamedTextureDesc small = Texture(1024, 64);
+	MipStreamingDesc desc;
+	desc.BudgetBytes = Bytes(big, 4) + Bytes(small, 4) + small.MipBytes[3];
+	MipStreamer streamer(desc);
+	uint32_t bigId = streamer.AddTexture(big);
+	uint32_t smallId = streamer.AddTexture(small);
+
+	streamer.BeginFrame();
+	streamer.Request(bigId, 0.0f, 1000.0f);
+	streamer.Request(smallId, 0.0f, 1000.0f);
+	std::vector<MipStreamCommand> commands = streamer.Update();
+	CHECK_EQUAL(commands.size(), (size_t)1);
+	CHECK_EQUAL(commands[0].Texture, smallId);
+	CHECK_EQUAL(commands[0].Mip, 3u);
+}
+
+TEST(DropsComeBeforeLoads) {
+	StreamedTextureDesc texture = Texture(1024);
+	MipStreamingDesc desc;
+	desc.BudgetBytes = Bytes(texture, 0) + Bytes(texture, 4);
+	MipStreamer streamer(desc);
+	uint32_t a = streamer.AddTexture(texture);
+	uint32_t b = streamer.AddTexture(texture);
+	Settle(streamer, { { a, 0.0f } });
+	CHECK_EQUAL(streamer.ResidentMip(a), 0u);
+
+	// Turning to the other texture drops the first one's fine mips in the same
+	// update that starts loading the second, and before it.
+	streamer.BeginFrame();
+	streamer.Request(b, 0.0f, 1000.0f);
+	std::vector<MipStreamCommand> commands = streamer.Update();
+	CHECK(!commands.empty());
+	bool loading = false;
+	for (const MipStreamCommand& command : commands) {
+		if (command.Action == MipStreamAction::Load) {
+			loading = true;
+			CHECK_EQUAL(command.Texture, b);
+		}
+		else {
+			CHECK(!loading);
+			CHECK_EQUAL(command.Texture, a);
+		}
+	}
+	CHECK(loading);
+	CHECK(streamer.CommittedBytes() <= desc.BudgetBytes);
+}
+
+TEST(LoadsInFlightAreLimited) {
+	MipStreamingDesc desc;
+	desc.BudgetBytes = 256ull << 20;
+	desc.MaxLoadsInFlight = 3;
+	MipStreamer streamer(desc);
+	for (uint32_t t = 0; t < 8; t++) {
+		streamer.AddTexture(Texture(512));
+	}
+	streamer.BeginFrame();
+	for (uint32_t t = 0; t < 8; t++) {
+		streamer.Request(t, 0.0f, 100.0f * (t + 1));
+	}
+	std::vector<MipStreamCommand> commands = streamer.Update();
+	CHECK_EQUAL(commands.size(), (size_t)3);
+	// Highest coverage first.
+	CHECK_EQUAL(commands[0].Texture, 7u);
+	CHECK_EQUAL(commands[1].Texture, 6u);
+	CHECK_EQUAL(commands[2].Texture, 5u);
+
+	// Nothing more until one lands.
+	streamer.BeginFrame();
+	for (uint32_t t = 0; t < 8; t++) {
+		streamer.Request(t, 0.0f, 100.0f * (t + 1));
+	}
+	CHECK(streamer.Update().empty());
+	streamer.LoadFinished(commands[0].Texture, commands[0].Mip);
+	CHECK_THROWS(streamer.LoadFinished(commands[0].Texture, commands[0].Mip));
+}
+
+TEST(CameraPathStaysInBudget) {
+	MipStreamingScenario scenario = SphereRow(12, 2048);
+	for (uint64_t budgetMB : { 8ull, 32ull, 128ull }) {
+		MipStreamingDesc desc;
+		desc.BudgetBytes = budgetMB << 20;
+		MipStreamingSimStats sim = SimulateMipStreaming(scenario, desc);
+		CHECK_EQUAL(sim.FramesOverBudget, 0u);
+		CHECK(sim.Streaming.PeakBytes <= desc.BudgetBytes);
+		CHECK(sim.Streaming.Loads > 0);
+	}
+}
+
+TEST(LargerBudgetIsSharper) {
+	MipStreamingScenario scenario = SphereRow(12, 2048);
+	double previous = 0.0;
+	for (uint64_t budgetMB : { 4ull, 16ull, 64ull, 512ull }) {
+		MipStreamingDesc desc;
+		desc.BudgetBytes = budgetMB << 20;
+		double missing = SimulateMipStreaming(scenario, desc).MeanMissingMipPixels;
+		if (budgetMB != 4) {
+			CHECK(missing <= previous);
+		}
+		previous = missing;
+	}
+}
+
+TEST(ApproachLoadsAndRetreatDrops) {
+	MipStreamingDesc desc;
+	desc.BudgetBytes = 256ull << 20;
+	MipStreamer streamer(desc);
+	uint32_t id = streamer.AddTexture(Texture(2048));
+	StreamingInstance sphere = Sphere(0.0f, 1.0f, id);
+
+	// Walk up to the sphere and back, finishing loads a frame after they start.
+	std::vector<MipStreamCommand> pending;
+	std::vector<uint32_t> resident;
+	for (int frame = 0; frame < 400; frame++) {
+		for (const MipStreamCommand& command : pending) {
+			streamer.LoadFinished(command.Texture, command.Mip);
+		}
+		pending.clear();
+		float distance = 2.0f + std::fabs(frame - 200) * 0.5f;
+		streamer.BeginFrame();
+		StreamingView view = View(-distance);
+		streamer.RequestInstances(view, &sphere, 1);
+		for (const MipStreamCommand& command : streamer.Update()) {
+			if (command.Action == MipStreamAction::Load) {
+				pending.push_back(command);
+			}
+		}
+		resident.push_back(streamer.ResidentMip(id));
+	}
+	uint32_t closest = *std::min_element(resident.begin(), resident.end());
+	CHECK(closest <= 2u);
+	CHECK(resident[200] - closest <= 1u);
+	CHECK_EQUAL(resident.back(), resident.front());
+	CHECK(streamer.Stats().Drops > 0);
+}
@@ -0,0 +1,255 @@
+#include "TestFramework.h"
+#include "ReflectionProbes.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+	const uint32_t kProbeCount = 10000;
+	const float kWorldSize = 400.0f;
+
+	// Probes with boxes of 4 to 40 units scattered over the world.
+	void AddRandomProbes(ReflectionProbeSet& probes, uint32_t count, uint32_t seed) {
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> position(0.0f, kWorldSize);
+		std::uniform_real_distribution<float> halfSize(2.0f, 20.0f);
+		std::uniform_real_distribution<float> blend(0.0f, 4.0f);
+		for (uint32_t i = 0; i < count; i++) {
+			float center[3] = { position(rng), position(rng), position(rng) };
+			ProbeBox box;
+			for (int k = 0; k < 3; k++) {
+				float half = halfSize(rng);
+				box.Min[k] = center[k] - half;
+				box.Max[k] = center[k] + half;
+			}
+			// Every tenth probe blends hard, to exercise ties at weight 1.
+			probes.AddProbe(center, box, i % 10 == 0 ? 0.0f : blend(rng));
+		}
+	}
+
+	float DistanceSq(const float a[3], const float b[3]) {
+		float dx = a[0] - b[0];
+		float dy = a[1] - b[1];
+		float dz = a[2] - b[2];
+		return dx * dx + dy * dy + dz * dz;
+	}
+
+	// The rules Select documents, applied to every probe.
+	ProbeSelection BruteForceSelect(const ReflectionProbeSet& probes, const float point[3]) {
+		ProbeSelection selection;
+		float bestDistance[2] = { INFINITY, INFINITY };
+		for (uint32_t p = 0; p < probes.ProbeCount(); p++) {
+			const ReflectionProbe& probe = probes.Probe(p);
+			if (!probe.Baked) {
+				continue;
+			}
+			float inset = INFINITY;
+			for (int i = 0; i < 3; i++) {
+				inset = std::min(inset, std::min(point[i] - probe.Influence.Min[i], probe.Influence.Max[i] - point[i]));
+			}
+			if (inset < 0.0f) {
+				continue;
+			}
+			float weight = probe.BlendDistance <= 0.0f ? 1.0f : std::min(inset / probe.BlendDistance, 1.0f);
+			if (weight <= 0.0f) {
+				continue;
+			}
+			float distance = DistanceSq(probe.Position, point);
+			for (int slot = 0; slot < 2; slot++) {
+				if (weight > selection.Weight[slot] || (weight == selection.Weight[slot] && distance < bestDistance[slot])) {
+					if (slot == 0) {
+						selection.Probe[1] = selection.Probe[0];
+						selection.Weight[1] = selection.Weight[0];
+						bestDistance[1] = bestDistance[0];
+					}
+					selection.Probe[slot] = p;
+					selection.Weight[slot] = weight;
+					bestDistance[slot] = distance;
+					break;
+				}
+			}
+		}
+		float total = selection.Weight[0] + selection.Weight[1];
+		if (total > 1.0f) {
+			selection.Weight[0] /= total;
+			selection.Weight[1] /= total;
+		}
+		return selection;
+	}
+
+	// Checks that slices and their owners agree and returns the resident probes.
+	std::vector<uint32_t> ResidentProbes(const ReflectionProbeSet& probes) {
+		std::vector<uint32_t> resident;
+		std::vector<bool> sliceUsed(probes.SliceCapacity(), false);
+		for (uint32_t p = 0; p < probes.ProbeCount(); p++) {
+			uint32_t slice = probes.Probe(p).Slice;
+			if (slice != kNoProbe) {
+				CHECK(slice < probes.SliceCapacity());
+				CHECK(!sliceUsed[slice]);
+				sliceUsed[slice] = true;
+				resident.push_back(p);
+			}
+			else {
+				CHECK(!probes.Probe(p).Baked);
+			}
+		}
+		return resident;
+	}
+
+	std::vector<uint32_t> NearestProbes(const ReflectionProbeSet& probes, const float camera[3], uint32_t count) {
+		std::vector<uint32_t> order(probes.ProbeCount());
+		for (uint32_t p = 0; p < order.size(); p++) {
+			order[p] = p;
+		}
+		std::partial_sort(order.begin(), order.begin() + count, order.end(), [&](uint32_t a, uint32_t b) {
+			return DistanceSq(probes.Probe(a).Position, camera) < DistanceSq(probes.Probe(b).Position, camera);
+		});
+		order.resize(count);
+		std::sort(order.begin(), order.end());
+		return order;
+	}
+
+	// Schedules and bakes frames at camera until nothing is scheduled any more.
+	uint32_t SettleAt(ReflectionProbeSet& probes, const float camera[3], uint32_t bakesPerFrame) {
+		std::vector<uint32_t> scheduled;
+		for (uint32_t frame = 0; frame < 1000; frame++) {
+			scheduled.clear();
+			probes.ScheduleRebakes(camera, bakesPerFrame, 10.0f, scheduled);
+			CHECK(scheduled.size() <= bakesPerFrame);
+			if (scheduled.empty()) {
+				return frame;
+			}
+			for (uint32_t p : scheduled) {
+				CHECK(probes.Probe(p).Slice != kNoProbe);
+				probes.MarkBaked(p);
+			}
+			ResidentProbes(probes);
+		}
+		CHECK(false);
+		return 0;
+	}
+}
+
+TEST(SelectMatchesBruteForce) {
+	ReflectionProbeSet probes;
+	AddRandomProbes(probes, kProbeCount, 1);
+	// Selection only considers baked probes; leave a quarter of them out.
+	for (uint32_t p = 0; p < kProbeCount; p++) {
+		if (p % 4 != 3) {
+			probes.MarkBaked(p);
+		}
+	}
+	probes.BuildSpatialIndex(16.0f);
+
+	std::mt19937 rng(2);
+	std::uniform_real_distribution<float> position(-30.0f, kWorldSize + 30.0f);
+	uint32_t selected = 0;
+	for (int i = 0; i < 4000; i++) {
+		float point[3] = { position(rng), position(rng), position(rng) };
+		ProbeSelection expected = BruteForceSelect(probes, point);
+		CHECK(probes.Select(point) == expected);
+		CHECK(expected.Probe[0] == kNoProbe || expected.Probe[0] % 4 != 3);
+		selected += expected.Probe[1] != kNoProbe ? 1 : 0;
+	}
+	// Many points lie in two or more boxes.
+	CHECK(selected > 500);
+}
+
+TEST(SelectIgnoresPointsOutsideTheGrid) {
+	ReflectionProbeSet probes;
+	AddRandomProbes(probes, 100, 3);
+	for (uint32_t p = 0; p < 100; p++) {
+		probes.MarkBaked(p);
+	}
+	probes.BuildSpatialIndex(8.0f);
+	float outside[3] = { -1000.0f, 50.0f, 50.0f };
+	CHECK(probes.Select(outside) == ProbeSelection());
+}
+
+TEST(ScheduleRebakesTakesMostUrgentFirst) {
+	ReflectionProbeSet probes(16);
+	AddRandomProbes(probes, kProbeCount, 4);
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> dirtiness(0.1f, 4.0f);
+	for (uint32_t p = 0; p < kProbeCount; p++) {
+		probes.MarkDirty(p, dirtiness(rng));
+	}
+
+	// With free slices the picks are the head of the urgency order.
+	const float camera[3] = { 200.0f, 200.0f, 200.0f };
+	const float scale = 10.0f;
+	std::vector<std::pair<float, uint32_t>> urgency;
+	for (uint32_t p = 0; p < kProbeCount; p++) {
+		const ReflectionProbe& probe = probes.Probe(p);
+		float distanceSq = DistanceSq(probe.Position, camera);
+		urgency.push_back(std::make_pair(-probe.Dirtiness / (1.0f + distanceSq / (scale * scale)), p));
+	}
+	std::sort(urgency.begin(), urgency.end());
+
+	std::vector<uint32_t> scheduled;
+	probes.ScheduleRebakes(camera, 4, scale, scheduled);
+	CHECK_EQUAL((size_t)4, scheduled.size());
+	for (size_t i = 0; i < scheduled.size(); i++) {
+		CHECK_EQUAL(urgency[i].second, scheduled[i]);
+	}
+
+	// ScheduleRebakes appends, and clean probes never come back.
+	for (uint32_t p : scheduled) {
+		probes.MarkBaked(p);
+	}
+	probes.ScheduleRebakes(camera, 4, scale, scheduled);
+	CHECK_EQUAL((size_t)8, scheduled.size());
+	for (size_t i = 4; i < 8; i++) {
+		CHECK_EQUAL(urgency[i].second, scheduled[i]);
+	}
+}
+
+TEST(ResidentProbesFollowTheCamera) {
+	// Along a path through the world, the resident set settles on the probes nearest
+	// to the camera, within the budget of bakes per frame.
+	const uint32_t slices = 8;
+	const uint32_t bakesPerFrame = 2;
+	ReflectionProbeSet probes(slices);
+	AddRandomProbes(probes, kProbeCount, 6);
+
+	for (int stop = 0; stop < 5; stop++) {
+		float camera[3] = { 40.0f + stop * 80.0f, 200.0f, 360.0f - stop * 80.0f };
+		uint32_t frames = SettleAt(probes, camera, bakesPerFrame);
+		CHECK(frames >= slices / bakesPerFrame);
+		CHECK(ResidentProbes(probes) == NearestProbes(probes, camera, slices));
+		for (uint32_t p : ResidentProbes(probes)) {
+			CHECK(probes.Probe(p).Baked);
+			CHECK(probes.Probe(p).Dirtiness == 0.0f);
+		}
+	}
+}
+
+TEST(BakingProbesKeepTheirSlices) {
+	// Two slices and two bakes a frame: the second candidate must not evict the
+	// first, even though it is the farthest resident.
+	ReflectionProbeSet probes(2);
+	ProbeBox box = { { -1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f, 1.0f } };
+	for (int i = 0; i < 4; i++) {
+		float position[3] = { (float)i * 10.0f, 0.0f, 0.0f };
+		probes.AddProbe(position, box, 0.0f);
+	}
+	const float camera[3] = { 0.0f, 0.0f, 0.0f };
+	std::vector<uint32_t> scheduled;
+	probes.ScheduleRebakes(camera, 2, 10.0f, scheduled);
+	CHECK_EQUAL((size_t)2, scheduled.size());
+	CHECK(probes.Probe(scheduled[0]).Slice != probes.Probe(scheduled[1]).Slice);
+	for (uint32_t p : scheduled) {
+		probes.MarkBaked(p);
+	}
+
+	// The camera moves next to probes 2 and 3: both evict one of 0 and 1.
+	const float moved[3] = { 25.0f, 0.0f, 0.0f };
+	scheduled.clear();
+	probes.ScheduleRebakes(moved, 2, 10.0f, scheduled);
+	std::sort(scheduled.begin(), scheduled.end());
+	CHECK(scheduled == std::vector<uint32_t>({ 2, 3 }));
+	CHECK(!probes.Probe(0).Baked && !probes.Probe(1).Baked);
+	CHECK(probes.Probe(0).Dirtiness >= 1.0f);
+	ResidentProbes(probes);
+}
@@ -0,0 +1,125 @@
+#include "TestFramework.h"
+#include "SharedResourceTable.h"
+#include <memory>
+
+namespace {
+	// A resource is a shared_ptr the table holds; a weak_ptr to it tells whether it
+	// was destroyed.
+	using Table = SharedResourceTable<std::shared_ptr<int>>;
+
+	ContentHash Hash(uint32_t content) {
+		return HashBytes(&content, sizeof(content));
+	}
+}
+
+TEST(SameContentIsShared) {
+	Table table;
+	CHECK(table.Acquire(Hash(1)) == nullptr);
+	Table::Entry* added = table.Add(Hash(1), std::make_shared<int>(1), 1000);
+	CHECK_EQUAL(added->RefCount, 1u);
+	CHECK_EQUAL(added->SrvIndex, kNoDescriptor);
+
+	Table::Entry* shared = table.Acquire(Hash(1));
+	CHECK(shared == added);
+	CHECK_EQUAL(shared->RefCount, 2u);
+	CHECK_EQUAL(*shared->Resource, 1);
+	CHECK(table.Acquire(Hash(2)) == nullptr);
+
+	// Find takes no reference.
+	CHECK(table.Find(Hash(1)) == added);
+	CHECK_EQUAL(added->RefCount, 2u);
+	CHECK(table.Find(Hash(2)) == nullptr);
+
+	SharedResourceStats stats = table.Stats();
+	CHECK_EQUAL(stats.Hits, 1u);
+	CHECK_EQUAL(stats.Misses, 1u);
+	CHECK_EQUAL(stats.LiveResources, 1u);
+}
+
+TEST(LastReleaseRetiresAtTheFence) {
+	Table table;
+	std::shared_ptr<int> resource = std::make_shared<int>(7);
+	std::weak_ptr<int> alive = resource;
+	table.Add(Hash(7), std::move(resource), 64);
+	table.Acquire(Hash(7));
+	table.Acquire(Hash(7));
+
+	CHECK(!table.Release(Hash(7), 10));
+	CHECK(!table.Release(Hash(7), 11));
+	CHECK_EQUAL(table.Find(Hash(7))->RefCount, 1u);
+	CHECK_EQUAL(table.RetiredCount(), 0u);
+
+	// The last reference goes with fence 12: the entry is gone at once, the resource
+	// only once the GPU is past 12.
+	CHECK(table.Release(Hash(7), 12));
+	CHECK(table.Find(Hash(7)) == nullptr);
+	CHECK_EQUAL(table.RetiredCount(), 1u);
+	table.Collect(11);
+	CHECK(!alive.expired());
+	table.Collect(12);
+	CHECK(alive.expired());
+	CHECK_EQUAL(table.RetiredCount(), 0u);
+
+	// Releasing content that is not there is a no-op.
+	CHECK(!table.Release(Hash(7), 13));
+	CHECK(!table.Release(Hash(8), 13));
+}
+
+TEST(RetiredContentCanComeBack) {
+	Table table;
+	table.Add(Hash(3), std::make_shared<int>(3), 16);
+	table.Release(Hash(3), 5);
+	// A new user of the same content before the fence passes gets a new resource;
+	// the old one still waits for its fence.
+	CHECK(table.Acquire(Hash(3)) == nullptr);
+	std::shared_ptr<int> again = std::make_shared<int>(33);
+	std::weak_ptr<int> alive = again;
+	table.Add(Hash(3), std::move(again), 16);
+	table.Collect(5);
+	CHECK_EQUAL(table.RetiredCount(), 0u);
+	CHECK(!alive.expired());
+	CHECK_EQUAL(*table.Find(Hash(3))->Resource, 33);
+}
+
+TEST(SavedBytesCountTheExtraReferences) {
+	Table table;
+	table.Add(Hash(1), std::make_shared<int>(1), 1000);
+	table.Add(Hash(2), std::make_shared<int>(2), 300);
+	table.Acquire(Hash(1));
+	table.Acquire(Hash(1));
+	table.Acquire(Hash(2));
+
+	SharedResourceStats stats = table.Stats();
+	CHECK_EQUAL(stats.LiveResources, 2u);
+	CHECK_EQUAL(stats.LiveBytes, 1300ull);
+	CHECK_EQUAL(stats.SavedBytes, 2 * 1000ull + 300ull);
+	CHECK_EQUAL(stats.Hits, 3u);
+	CHECK_EQUAL(stats.Misses, 2u);
+
+	// Dropping to one reference saves nothing more; the last release takes the bytes
+	// out of the live set.
+	table.Release(Hash(1), 1);
+	table.Release(Hash(1), 1);
+	stats = table.Stats();
+	CHECK_EQUAL(stats.SavedBytes, 300ull);
+	table.Release(Hash(2), 1);
+	table.Release(Hash(2), 1);
+	stats = table.Stats();
+	CHECK_EQUAL(stats.LiveResources, 1u);
+	CHECK_EQUAL(stats.LiveBytes, 1000ull);
+	CHECK_EQUAL(stats.SavedBytes, 0ull);
+}
+
+TEST(TextureHashesTellShapeAndFormatApart) {
+	CompressedTexture a(4, 4, 1, 1, false, kDxgiFormatR8G8B8A8Unorm, 4, 1);
+	CompressedTexture b(4, 4, 1, 1, false, kDxgiFormatR8G8B8A8Unorm, 4, 1);
+	CHECK(HashTextureContent(a) == HashTextureContent(b));
+	b.Blocks(0, 0)[5] = 1;
+	CHECK(HashTextureContent(a) != HashTextureContent(b));
+
+	// The same bytes read as another format or shape.
+	CompressedTexture srgb(4, 4, 1, 1, false, kDxgiFormatR8G8B8A8UnormSrgb, 4, 1);
+	CompressedTexture wide(8, 2, 1, 1, false, kDxgiFormatR8G8B8A8Unorm, 4, 1);
+	CHECK(HashTextureContent(a) != HashTextureContent(srgb));
+	CHECK(HashTextureContent(a) != HashTextureContent(wide));
+}
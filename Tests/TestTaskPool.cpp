@@ -0,0 +1,126 @@
+#include "TestFramework.h"
+#include "TaskPool.h"
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST(ParallelForRunsEveryIndexOnce) {
+	TaskPool pool(4);
+	std::vector<std::atomic<int>> calls(10000);
+	pool.ParallelFor((uint32_t)calls.size(), [&](uint32_t i) { calls[i]++; });
+	for (auto& count : calls) {
+		CHECK_EQUAL(1, count.load());
+	}
+}
+
+TEST(ParallelForRethrowsFromWorkers) {
+	TaskPool pool(4);
+	std::atomic<int> active{ 0 };
+	std::atomic<uint32_t> ran{ 0 };
+	const uint32_t count = 1000;
+	try {
+		pool.ParallelFor(count, [&](uint32_t i) {
+			active++;
+			ran++;
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+			active--;
+			if (i % 97 == 13) {
+				throw std::runtime_error("index " + std::to_string(i));
+			}
+		});
+		CHECK(false);
+	}
+	catch (const std::runtime_error& e) {
+		CHECK(std::string(e.what()).find("index ") == 0);
+	}
+	// Every call in flight has returned, and the loop stopped early.
+	CHECK_EQUAL(0, active.load());
+	CHECK(ran.load() < count);
+}
+
+TEST(ParallelForRethrowsFromTheCaller) {
+	TaskPool pool(2);
+	std::thread::id caller = std::this_thread::get_id();
+	CHECK_THROWS(pool.ParallelFor(64, [&](uint32_t) {
+		if (std::this_thread::get_id() == caller) {
+			throw std::logic_error("caller");
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}));
+}
+
+TEST(ParallelForRethrowsThroughNesting) {
+	TaskPool pool(4);
+	std::atomic<uint32_t> outer{ 0 };
+	CHECK_THROWS(pool.ParallelFor(16, [&](uint32_t i) {
+		outer++;
+		pool.ParallelFor(64, [&](uint32_t j) {
+			if (i == 5 && j == 40) {
+				throw std::runtime_error("inner");
+			}
+		});
+	}));
+	CHECK(outer.load() >= 1);
+}
+
+TEST(ParallelForLeavesOtherTasksToTheWorkers) {
+	// One worker is held by a long task, the other runs index 1, which queues an
+	// unrelated task while the caller still waits on it.  That task must not end up
+	// on the caller.
+	TaskPool pool(2);
+	std::promise<void> release;
+	std::shared_future<void> released = release.get_future().share();
+	std::atomic<bool> blocking{ false };
+	pool.Submit([&]() {
+		blocking = true;
+		released.wait();
+	});
+	while (!blocking) {
+		std::this_thread::yield();
+	}
+
+	std::thread::id caller = std::this_thread::get_id();
+	std::atomic<uint32_t> started{ 0 };
+	std::atomic<bool> ranOnCaller{ false };
+	std::future<void> unrelated;
+	pool.ParallelFor(2, [&](uint32_t) {
+		started++;
+		if (std::this_thread::get_id() == caller) {
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+			while (started < 2 && std::chrono::steady_clock::now() < deadline) {
+				std::this_thread::yield();
+			}
+			return;
+		}
+		unrelated = pool.Submit([&]() { ranOnCaller = std::this_thread::get_id() == caller; });
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	});
+	CHECK_EQUAL(2u, started.load());
+	release.set_value();
+	unrelated.get();
+	CHECK(!ranOnCaller);
+}
+
+TEST(PoolIsUsableAfterAnException) {
+	TaskPool pool(3);
+	for (int round = 0; round < 20; round++) {
+		CHECK_THROWS(pool.ParallelFor(100, [&](uint32_t i) {
+			if (i == (uint32_t)round) {
+				throw std::runtime_error("round");
+			}
+		}));
+		std::atomic<uint32_t> sum{ 0 };
+		pool.ParallelFor(100, [&](uint32_t i) { sum += i; });
+		CHECK_EQUAL(4950u, sum.load());
+	}
+}
+
+TEST(SubmitCarriesExceptionsToTheFuture) {
+	TaskPool pool(1);
+	std::future<void> result = pool.Submit([]() { throw std::runtime_error("task"); });
+	CHECK_THROWS(result.get());
+	pool.Submit([]() {}).get();
+}
@@ -0,0 +1,70 @@
+#include "TestFramework.h"
+#include "TextureCooker.h"
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+	const uint32_t kTextureCount = 8;
+
+	std::string SourcePath(uint32_t i) {
+		return "TestTextureCooker_source" + std::to_string(i) + ".bin";
+	}
+
+	bool FileExists(const std::string& path) {
+		return std::ifstream(path).good();
+	}
+
+	// Source files whose content only feeds the hash, and requests for them.
+	std::vector<TextureCookRequest> WriteSources() {
+		std::vector<TextureCookRequest> requests;
+		for (uint32_t i = 0; i < kTextureCount; i++) {
+			std::ofstream(SourcePath(i), std::ios::binary) << "source " << i;
+			TextureCookRequest request;
+			request.Name = "TestTextureCooker_texture" + std::to_string(i);
+			request.SourcePath = SourcePath(i);
+			requests.push_back(request);
+		}
+		return requests;
+	}
+
+	// A 64x64 gradient for any path, except that failPath throws.
+	std::function<SourceImage(const std::string&)> Decoder(const std::string& failPath) {
+		return [failPath](const std::string& path) {
+			if (path == failPath) {
+				throw std::runtime_error("cannot decode " + path);
+			}
+			SourceImage image;
+			image.Width = 64;
+			image.Height = 64;
+			for (uint32_t y = 0; y < 64; y++) {
+				for (uint32_t x = 0; x < 64; x++) {
+					image.Pixels.insert(image.Pixels.end(), { (uint8_t)(x * 4), (uint8_t)(y * 4), (uint8_t)path.size(), 255 });
+				}
+			}
+			return image;
+		};
+	}
+}
+
+TEST(FailedJobSkipsTheManifest) {
+	const std::string manifestPath = "TestTextureCooker_manifest.txt";
+	std::remove(manifestPath.c_str());
+	std::vector<TextureCookRequest> requests = WriteSources();
+	TextureCookSettings settings;
+	settings.Quality = BCQuality::Fast;
+
+	// The decode error of one job surfaces on the calling thread, and no manifest
+	// claims the textures that did cook.
+	CHECK_THROWS(CookTextures(requests, ".", manifestPath, Decoder(SourcePath(3)), settings));
+	CHECK(!FileExists(manifestPath));
+
+	TextureCookStats stats = CookTextures(requests, ".", manifestPath, Decoder(""), settings);
+	CHECK_EQUAL(kTextureCount, stats.Cooked);
+	CHECK(FileExists(manifestPath));
+
+	stats = CookTextures(requests, ".", manifestPath, Decoder(SourcePath(0)), settings);
+	CHECK_EQUAL(kTextureCount, stats.UpToDate);
+}
@@ -0,0 +1,210 @@
+#include "TestFramework.h"
+#include "TextureFootprints.h"
+#include <string>
+#include <vector>
+
+// Expected values follow what ID3D12Device::GetCopyableFootprints returns: rows of
+// blocks at a 256 byte pitch, subresources at 512 bytes, item by item and mip by mip.
+
+namespace {
+	struct Format {
+		uint32_t BlockBytes;
+		uint32_t BlockDim;
+	};
+	const Format kBC1 = { 8, 4 };
+	const Format kBC7 = { 16, 4 };
+	const Format kRGBA8 = { 4, 1 };
+	const Format kRGBA32F = { 16, 1 };
+
+	TextureFootprints Footprints(uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t arraySize,
+		const Format& format)
+	{
+		return ComputeTextureFootprints(width, height, mipLevels, arraySize, format.BlockBytes, format.BlockDim);
+	}
+
+	uint64_t End(const SubresourceFootprint& footprint) {
+		return footprint.Offset + (uint64_t)footprint.RowPitch * (footprint.NumRows - 1) + footprint.RowBytes;
+	}
+
+	bool Valid(const TextureFootprints& footprints) {
+		std::string error;
+		return ValidateTextureFootprints(footprints, footprints.TotalBytes, error);
+	}
+}
+
+TEST(BlockCompressedRowsAreRowsOfBlocks) {
+	TextureFootprints footprints = Footprints(256, 128, 1, 1, kBC1);
+	const SubresourceFootprint& top = footprints.Subresources[0];
+	CHECK_EQUAL(top.Offset, 0ull);
+	CHECK_EQUAL(top.Width, 256u);
+	CHECK_EQUAL(top.Height, 128u);
+	CHECK_EQUAL(top.RowBytes, 512u);
+	CHECK_EQUAL(top.RowPitch, 512u);
+	CHECK_EQUAL(top.NumRows, 32u);
+	CHECK_EQUAL(footprints.TotalBytes, 512ull * 32);
+}
+
+TEST(OddSizesRoundUpToWholeBlocksAndPitch) {
+	// 37x19 is 10x5 blocks of BC7.
+	SubresourceFootprint bc7 = Footprints(37, 19, 1, 1, kBC7).Subresources[0];
+	CHECK_EQUAL(bc7.Width, 40u);
+	CHECK_EQUAL(bc7.Height, 20u);
+	CHECK_EQUAL(bc7.RowBytes, 160u);
+	CHECK_EQUAL(bc7.RowPitch, 256u);
+	CHECK_EQUAL(bc7.NumRows, 5u);
+
+	// Uncompressed rows are rows of texels.
+	TextureFootprints rgba = Footprints(37, 20, 2, 1, kRGBA8);
+	CHECK_EQUAL(rgba.Subresources[0].Width, 37u);
+	CHECK_EQUAL(rgba.Subresources[0].RowBytes, 148u);
+	CHECK_EQUAL(rgba.Subresources[0].RowPitch, 256u);
+	CHECK_EQUAL(rgba.Subresources[0].NumRows, 20u);
+	// The last row is not padded: 19 * 256 + 148 = 5012, placed at the next 512.
+	CHECK_EQUAL(rgba.Subresources[1].Offset, 5120ull);
+	CHECK_EQUAL(rgba.Subresources[1].Width, 18u);
+	CHECK_EQUAL(rgba.Subresources[1].RowBytes, 72u);
+	CHECK_EQUAL(rgba.Subresources[1].NumRows, 10u);
+	CHECK_EQUAL(rgba.TotalBytes, 5120ull + 9 * 256 + 72);
+}
+
+TEST(MipTailKeepsOneBlock) {
+	TextureFootprints footprints = Footprints(16, 16, 5, 1, kBC1);
+	// 16, 8, 4, 2 and 1 texels wide; the last three are one block each.
+	const uint32_t rows[5] = { 4, 2, 1, 1, 1 };
+	for (uint32_t mip = 0; mip < 5; mip++) {
+		const SubresourceFootprint& footprint = footprints.Subresources[mip];
+		CHECK_EQUAL(footprint.NumRows, rows[mip]);
+		CHECK_EQUAL(footprint.Width % 4, 0u);
+		CHECK_EQUAL(footprint.RowPitch, 256u);
+	}
+	CHECK_EQUAL(footprints.Subresources[3].Width, 4u);
+	CHECK_EQUAL(footprints.Subresources[4].RowBytes, 8u);
+	// Mip 0 ends at 3 * 256 + 32 bytes and mip 1 at 1024 + 256 + 16; the one row mips
+	// after them take 512 bytes each.
+	const uint64_t offsets[5] = { 0, 1024, 1536, 2048, 2560 };
+	for (uint32_t mip = 0; mip < 5; mip++) {
+		CHECK_EQUAL(footprints.Subresources[mip].Offset, offsets[mip]);
+	}
+	CHECK_EQUAL(footprints.TotalBytes, 2560ull + 8);
+
+	// Non square chains clamp each side at one texel on its own.
+	TextureFootprints wide = Footprints(64, 2, 7, 1, kRGBA32F);
+	CHECK_EQUAL(wide.Subresources[2].Width, 16u);
+	CHECK_EQUAL(wide.Subresources[2].NumRows, 1u);
+	CHECK_EQUAL(wide.Subresources[6].Width, 1u);
+	CHECK_EQUAL(wide.Subresources[6].RowBytes, 16u);
+}
+
+TEST(ArraysGoItemByItem) {
+	TextureFootprints footprints = Footprints(8, 8, 4, 6, kRGBA8);
+	CHECK_EQUAL(footprints.Subresources.size(), (size_t)24);
+	for (uint32_t item = 0; item < 6; item++) {
+		// Mip 0 of every face restarts at 8 texels.
+		CHECK_EQUAL(footprints.Subresources[item * 4].Width, 8u);
+		CHECK_EQUAL(footprints.Subresources[item * 4 + 3].Width, 1u);
+	}
+	// Mip 0 ends at 7 * 256 + 32 bytes, mip 1 at 2048 + 3 * 256 + 16, mip 2 at
+	// 3072 + 256 + 8 and mip 3 at 3584 + 4, so every item takes 4096 bytes.
+	const uint64_t offsets[4] = { 0, 2048, 3072, 3584 };
+	for (uint32_t i = 0; i < 24; i++) {
+		CHECK_EQUAL(footprints.Subresources[i].Offset, i / 4 * 4096ull + offsets[i % 4]);
+	}
+	CHECK_EQUAL(footprints.TotalBytes, 5 * 4096ull + 3584 + 4);
+	CHECK(Valid(footprints));
+}
+
+TEST(LayoutsAreTightAndValidAcrossSizes) {
+	const Format formats[] = { kBC1, kBC7, kRGBA8, kRGBA32F };
+	for (const Format& format : formats) {
+		for (uint32_t width = 1; width <= 300; width += 23) {
+			for (uint32_t height = 1; height <= 140; height += 17) {
+				uint32_t mipLevels = 1;
+				while ((width | height) >> mipLevels) {
+					mipLevels++;
+				}
+				TextureFootprints footprints = Footprints(width, height, mipLevels, 3, format);
+				CHECK(Valid(footprints));
+				uint64_t previousEnd = 0;
+				for (uint32_t item = 0; item < 3; item++) {
+					for (uint32_t mip = 0; mip < mipLevels; mip++) {
+						const SubresourceFootprint& footprint = footprints.Subresources[item * mipLevels + mip];
+						uint32_t mipWidth = width >> mip ? width >> mip : 1;
+						uint32_t mipHeight = height >> mip ? height >> mip : 1;
+						uint32_t blocksWide = (mipWidth + format.BlockDim - 1) / format.BlockDim;
+						CHECK_EQUAL(footprint.Width, blocksWide * format.BlockDim);
+						CHECK_EQUAL(footprint.NumRows, (mipHeight + format.BlockDim - 1) / format.BlockDim);
+						CHECK_EQUAL(footprint.RowBytes, blocksWide * format.BlockBytes);
+						// The smallest aligned pitch and the first aligned offset.
+						CHECK(footprint.RowPitch % kTextureRowPitchAlignment == 0);
+						CHECK(footprint.RowPitch - footprint.RowBytes < kTextureRowPitchAlignment);
+						CHECK(footprint.Offset % kTexturePlacementAlignment == 0);
+						CHECK(footprint.Offset >= previousEnd && footprint.Offset - previousEnd < kTexturePlacementAlignment);
+						previousEnd = End(footprint);
+					}
+				}
+				CHECK_EQUAL(footprints.TotalBytes, previousEnd);
+			}
+		}
+	}
+}
+
+TEST(CopyPlacesRowsAtThePitchAndZeroesPadding) {
+	CompressedTexture texture(5, 3, 2, 2, false, kDxgiFormatR8G8B8A8Unorm, 4, 1);
+	for (size_t i = 0; i < texture.ByteSize(); i++) {
+		texture.Blocks(0, 0)[i] = (uint8_t)(i % 251 + 1);
+	}
+	TextureFootprints footprints = ComputeTextureFootprints(texture);
+	std::vector<uint8_t> buffer((size_t)footprints.TotalBytes, 0xCD);
+	CopyToFootprints(texture, footprints, buffer.data());
+
+	std::vector<bool> covered(buffer.size(), false);
+	for (uint32_t item = 0; item < 2; item++) {
+		for (uint32_t mip = 0; mip < 2; mip++) {
+			const SubresourceFootprint& footprint = footprints.Subresources[item * 2 + mip];
+			for (uint32_t row = 0; row < footprint.NumRows; row++) {
+				const uint8_t* src = texture.Blocks(item, mip) + row * texture.RowPitch(mip);
+				size_t begin = (size_t)(footprint.Offset + (uint64_t)row * footprint.RowPitch);
+				for (uint32_t b = 0; b < footprint.RowBytes; b++) {
+					CHECK_EQUAL(buffer[begin + b], src[b]);
+					covered[begin + b] = true;
+				}
+			}
+		}
+	}
+	for (size_t i = 0; i < buffer.size(); i++) {
+		if (!covered[i]) {
+			CHECK_EQUAL(buffer[i], 0);
+		}
+	}
+}
+
+TEST(ValidationRejectsBrokenRules) {
+	TextureFootprints good = Footprints(64, 64, 3, 2, kBC1);
+	CHECK(Valid(good));
+	std::string error;
+
+	TextureFootprints broken = good;
+	broken.Subresources[1].Offset += 256;
+	broken.TotalBytes += 256;
+	CHECK(!ValidateTextureFootprints(broken, broken.TotalBytes, error));
+	CHECK(error.find("512") != std::string::npos);
+
+	broken = good;
+	broken.Subresources[0].RowPitch = 128;
+	CHECK(!ValidateTextureFootprints(broken, broken.TotalBytes, error));
+	CHECK(error.find("256") != std::string::npos);
+
+	broken = good;
+	broken.Subresources[0].RowBytes = 257;
+	CHECK(!ValidateTextureFootprints(broken, broken.TotalBytes, error));
+
+	broken = good;
+	broken.Subresources[2].Offset = broken.Subresources[1].Offset;
+	CHECK(!ValidateTextureFootprints(broken, broken.TotalBytes, error));
+
+	CHECK(!ValidateTextureFootprints(good, good.TotalBytes - 1, error));
+
+	broken = good;
+	broken.TotalBytes += 512;
+	CHECK(!ValidateTextureFootprints(broken, broken.TotalBytes, error));
+}
@@ -0,0 +1,239 @@
+#include "TestFramework.h"
+#include "VirtualTexture.h"
+#include <cstdio>
+#include <vector>
+
+namespace {
+	VirtualPage Page(uint32_t texture, uint32_t mip, uint32_t x, uint32_t y) {
+		VirtualPage page;
+		page.Texture = texture;
+		page.Mip = mip;
+		page.X = x;
+		page.Y = y;
+		return page;
+	}
+
+	bool SamePage(const VirtualPage& a, const VirtualPage& b) {
+		return PackFeedback(a) == PackFeedback(b);
+	}
+
+	// Feedback of one frame: each page repeated pixels times.
+	VirtualTextureUpdate Frame(VirtualTextureCache& cache, const std::vector<std::pair<VirtualPage, uint32_t>>& pages) {
+		std::vector<uint32_t> feedback;
+		for (const auto& page : pages) {
+			feedback.insert(feedback.end(), page.second, PackFeedback(page.first));
+		}
+		feedback.push_back(kNoFeedback);
+		return cache.Update(feedback.data(), feedback.size());
+	}
+
+	VirtualTextureCacheDesc Desc(uint32_t slots, uint32_t maxLoads = 32) {
+		VirtualTextureCacheDesc desc;
+		desc.PageSize = 128;
+		desc.Slots = slots;
+		desc.MaxLoadsPerFrame = maxLoads;
+		return desc;
+	}
+}
+
+TEST(FeedbackWordsRoundTrip) {
+	VirtualPage page = Page(200, 11, 1023, 517);
+	CHECK(SamePage(page, UnpackFeedback(PackFeedback(page))));
+	CHECK(PackFeedback(page) != kNoFeedback);
+}
+
+TEST(CoarsestMipIsPinned) {
+	// 1024^2 in 128 texel pages: 8x8, 4x4, 2x2 and 1x1.
+	VirtualTextureCache cache(Desc(6));
+	CHECK_EQUAL(0u, cache.AddTexture(1024, 1024));
+	CHECK_EQUAL(4u, cache.MipLevels(0));
+	CHECK_EQUAL(1u, cache.PagesWide(0, 3));
+	uint32_t pinnedSlot = cache.Slot(Page(0, 3, 0, 0));
+	CHECK(pinnedSlot != kPageNotResident);
+
+	// The first update hands out the pinned page.
+	VirtualTextureUpdate update = Frame(cache, {});
+	CHECK_EQUAL((size_t)1, update.Loads.size());
+	CHECK(SamePage(Page(0, 3, 0, 0), update.Loads[0].Page));
+
+	// Far more traffic than slots never evicts it.
+	for (uint32_t frame = 0; frame < 64; frame++) {
+		update = Frame(cache, { { Page(0, 0, frame % 8, (frame / 8) % 8), 10 }, { Page(0, 1, (frame + 1) % 4, frame % 4), 5 } });
+		for (const VirtualPage& evicted : update.Evictions) {
+			CHECK(evicted.Mip != 3);
+		}
+		CHECK_EQUAL(pinnedSlot, cache.Slot(Page(0, 3, 0, 0)));
+	}
+	CHECK(cache.Stats().Evictions > 0);
+}
+
+TEST(AddTextureNeedsASlotToPin) {
+	VirtualTextureCache cache(Desc(1));
+	cache.AddTexture(256, 256);
+	CHECK_THROWS(cache.AddTexture(256, 256));
+	CHECK_THROWS(cache.AddTexture(0, 256));
+}
+
+TEST(PageTableFallsBackToResidentParents) {
+	VirtualTextureCache cache(Desc(16));
+	cache.AddTexture(1024, 1024);
+	uint32_t pinnedSlot = cache.Slot(Page(0, 3, 0, 0));
+
+	// Nothing but the pin: every page reads from it.
+	PageTableEntry entry = cache.Lookup(Page(0, 0, 5, 6));
+	CHECK_EQUAL(pinnedSlot, entry.Slot);
+	CHECK_EQUAL(3u, entry.Mip);
+
+	// One load of mip 2 covers a quarter of the texture.
+	VirtualTextureUpdate update = Frame(cache, { { Page(0, 2, 1, 1), 1 } });
+	CHECK_EQUAL((size_t)2, update.Loads.size());
+	uint32_t slot = cache.Slot(Page(0, 2, 1, 1));
+	CHECK(slot != kPageNotResident);
+
+	std::vector<PageTableEntry> table;
+	cache.BuildPageTable(0, 0, table);
+	CHECK_EQUAL((size_t)64, table.size());
+	for (uint32_t y = 0; y < 8; y++) {
+		for (uint32_t x = 0; x < 8; x++) {
+			const PageTableEntry& expected = table[y * 8 + x];
+			entry = cache.Lookup(Page(0, 0, x, y));
+			CHECK_EQUAL(expected.Slot, entry.Slot);
+			CHECK_EQUAL(expected.Mip, entry.Mip);
+			bool covered = x >= 4 && y >= 4;
+			CHECK_EQUAL(covered ? slot : pinnedSlot, entry.Slot);
+			CHECK_EQUAL(covered ? 2u : 3u, entry.Mip);
+		}
+	}
+
+	// A resident page maps to itself.
+	entry = cache.Lookup(Page(0, 2, 1, 1));
+	CHECK_EQUAL(slot, entry.Slot);
+	CHECK_EQUAL(2u, entry.Mip);
+}
+
+TEST(MissingPagesLoadCoarseMipsFirst) {
+	VirtualTextureCache cache(Desc(16));
+	cache.AddTexture(1024, 1024);
+	Frame(cache, {});
+
+	// A mip 0 page queues its missing ancestors; each loads under the one before it.
+	VirtualTextureUpdate update = Frame(cache, { { Page(0, 0, 6, 3), 1 } });
+	CHECK_EQUAL((size_t)3, update.Loads.size());
+	CHECK(SamePage(Page(0, 2, 1, 0), update.Loads[0].Page));
+	CHECK(SamePage(Page(0, 1, 3, 1), update.Loads[1].Page));
+	CHECK(SamePage(Page(0, 0, 6, 3), update.Loads[2].Page));
+	CHECK_EQUAL((size_t)0, cache.QueuedRequests());
+	CHECK_EQUAL(1u, (uint32_t)cache.Stats().Misses);
+
+	update = Frame(cache, { { Page(0, 0, 6, 3), 1 } });
+	CHECK(update.Loads.empty());
+	CHECK_EQUAL(1u, (uint32_t)cache.Stats().Hits);
+}
+
+TEST(RequestsArePrioritized) {
+	// One load a frame: coarser mips first, then the pages covering more pixels.
+	VirtualTextureCache cache(Desc(16, 1));
+	cache.AddTexture(1024, 1024);
+	Frame(cache, {});
+	Frame(cache, { { Page(0, 2, 0, 0), 1 } });
+	CHECK(cache.Slot(Page(0, 2, 0, 0)) != kPageNotResident);
+
+	std::vector<std::pair<VirtualPage, uint32_t>> feedback = {
+		{ Page(0, 1, 0, 0), 10 }, { Page(0, 1, 1, 0), 50 }, { Page(0, 1, 0, 1), 30 }, { Page(0, 2, 1, 1), 1 } };
+	VirtualTextureUpdate update = Frame(cache, feedback);
+	CHECK_EQUAL((size_t)1, update.Loads.size());
+	CHECK(SamePage(Page(0, 2, 1, 1), update.Loads[0].Page));
+	update = Frame(cache, feedback);
+	CHECK(SamePage(Page(0, 1, 1, 0), update.Loads[0].Page));
+	update = Frame(cache, feedback);
+	CHECK(SamePage(Page(0, 1, 0, 1), update.Loads[0].Page));
+
+	// Pages asked for this frame go before ones only asked for earlier.
+	Frame(cache, { { Page(0, 0, 0, 0), 100 } });
+	update = Frame(cache, { { Page(0, 0, 1, 1), 1 } });
+	CHECK_EQUAL((size_t)1, update.Loads.size());
+	CHECK(SamePage(Page(0, 0, 1, 1), update.Loads[0].Page));
+}
+
+TEST(RequestsExpire) {
+	VirtualTextureCacheDesc desc = Desc(16, 0);
+	desc.RequestLifetime = 3;
+	VirtualTextureCache cache(desc);
+	cache.AddTexture(1024, 1024);
+	Frame(cache, { { Page(0, 0, 2, 2), 4 } });
+	// The page and its two missing ancestors.
+	CHECK_EQUAL((size_t)3, cache.QueuedRequests());
+	Frame(cache, {});
+	Frame(cache, {});
+	CHECK_EQUAL((size_t)3, cache.QueuedRequests());
+	Frame(cache, {});
+	CHECK_EQUAL((size_t)0, cache.QueuedRequests());
+}
+
+TEST(EvictsLeastRecentlyUsedFirst) {
+	// The pin and the four pages of mip 2 fill all five slots.
+	VirtualTextureCache cache(Desc(5));
+	cache.AddTexture(1024, 1024);
+	Frame(cache, {});
+	VirtualTextureUpdate update = Frame(cache, {
+		{ Page(0, 2, 0, 0), 1 }, { Page(0, 2, 1, 0), 1 }, { Page(0, 2, 0, 1), 1 }, { Page(0, 2, 1, 1), 1 } });
+	CHECK_EQUAL((size_t)4, update.Loads.size());
+	CHECK_EQUAL(5u, cache.ResidentPages());
+
+	// Use them in the order (1, 0), (0, 1), (1, 1), (0, 0).
+	Frame(cache, { { Page(0, 2, 1, 0), 1 } });
+	Frame(cache, { { Page(0, 2, 0, 1), 1 } });
+	Frame(cache, { { Page(0, 2, 1, 1), 1 } });
+	Frame(cache, { { Page(0, 2, 0, 0), 1 } });
+
+	// Each mip 1 page under (0, 0) needs a slot and takes the oldest one.
+	const VirtualPage expected[] = { Page(0, 2, 1, 0), Page(0, 2, 0, 1), Page(0, 2, 1, 1) };
+	for (uint32_t i = 0; i < 3; i++) {
+		update = Frame(cache, { { Page(0, 1, i % 2, i / 2), 1 } });
+		CHECK_EQUAL((size_t)1, update.Loads.size());
+		CHECK_EQUAL((size_t)1, update.Evictions.size());
+		CHECK(SamePage(expected[i], update.Evictions[0]));
+		CHECK_EQUAL(kPageNotResident, cache.Slot(expected[i]));
+	}
+	CHECK_EQUAL(3u, (uint32_t)cache.Stats().Evictions);
+}
+
+TEST(PagesUsedThisFrameAreNotEvicted) {
+	VirtualTextureCache cache(Desc(5));
+	cache.AddTexture(1024, 1024);
+	Frame(cache, {});
+	std::vector<std::pair<VirtualPage, uint32_t>> all = {
+		{ Page(0, 2, 0, 0), 1 }, { Page(0, 2, 1, 0), 1 }, { Page(0, 2, 0, 1), 1 }, { Page(0, 2, 1, 1), 1 } };
+	Frame(cache, all);
+
+	// Every resident page is in use, so the mip 1 page starves.
+	all.push_back({ Page(0, 1, 0, 0), 1 });
+	VirtualTextureUpdate update = Frame(cache, all);
+	CHECK(update.Loads.empty());
+	CHECK(update.Evictions.empty());
+	CHECK(cache.Stats().Starved > 0);
+}
+
+TEST(ReplayIsDeterministic) {
+	FeedbackTrace trace = MakePanningTrace(4, 4096, 60, 64, 36, 128, 7);
+	CHECK_EQUAL((size_t)60, trace.Frames.size());
+	VirtualTextureCacheDesc small = Desc(64);
+	VirtualTextureReplayStats a = ReplayFeedbackTrace(trace, small);
+	VirtualTextureReplayStats b = ReplayFeedbackTrace(trace, small);
+	CHECK_EQUAL(a.Cache.Loads, b.Cache.Loads);
+	CHECK_EQUAL(a.Cache.Evictions, b.Cache.Evictions);
+	CHECK_EQUAL(a.Cache.Hits, b.Cache.Hits);
+
+	// A bigger cache hits at least as often and never evicts more.
+	VirtualTextureReplayStats big = ReplayFeedbackTrace(trace, Desc(1024));
+	CHECK(big.HitRate >= a.HitRate);
+	CHECK(big.Cache.Evictions <= a.Cache.Evictions);
+
+	// The trace survives a save and load.
+	const char* path = "TestVirtualTexture_trace.bin";
+	SaveFeedbackTrace(path, trace);
+	FeedbackTrace loaded = LoadFeedbackTrace(path);
+	std::remove(path);
+	CHECK(loaded.TextureSizes == trace.TextureSizes);
+	CHECK(loaded.Frames == trace.Frames);
+}
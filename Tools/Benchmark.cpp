@@ -0,0 +1,776 @@
+#include "AssetPackage.h"
+#include "BVH.h"
+#include "BC6HEncoder.h"
+#include "BCEncoder.h"
+#include "CubeMapSampler.h"
+#include "CubeMipGenerator.h"
+#include "DescriptorIndexAllocator.h"
+#include "EquirectToCube.h"
+#include "FrustumCulling.h"
+#include "HDRPacking.h"
+#include "IrradianceVolume.h"
+#include "MipGenerator.h"
+#include "MipStreaming.h"
+#include "ReflectionProbes.h"
+#include "SphericalHarmonics.h"
+#include "VirtualTexture.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Benchmarks of the CPU modules the renderer uses, one per command, on synthetic
+// inputs so that they run anywhere.
+
+namespace {
+	const float kPi = 3.14159265f;
+
+	// Appends a UV sphere of the given center and radius, with outward normals and
+	// one albedo.
+	void AddSphere(ProbeScene& scene, std::vector<float>& positions, std::vector<uint32_t>& indices,
+		const float center[3], float radius, const float albedo[3], uint32_t rings, uint32_t segments)
+	{
+		auto point = [&](uint32_t ring, uint32_t segment, float p[3]) {
+			float theta = kPi * ring / rings;
+			float phi = 2.0f * kPi * segment / segments;
+			p[0] = std::sin(theta) * std::cos(phi);
+			p[1] = std::cos(theta);
+			p[2] = std::sin(theta) * std::sin(phi);
+		};
+		for (uint32_t ring = 0; ring < rings; ring++) {
+			for (uint32_t segment = 0; segment < segments; segment++) {
+				float corners[4][3];
+				point(ring, segment, corners[0]);
+				point(ring + 1, segment, corners[1]);
+				point(ring + 1, segment + 1, corners[2]);
+				point(ring, segment + 1, corners[3]);
+				const int triangles[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+				for (const auto& triangle : triangles) {
+					float normal[3] = { 0.0f, 0.0f, 0.0f };
+					for (int k : triangle) {
+						indices.push_back((uint32_t)(positions.size() / 3));
+						for (int i = 0; i < 3; i++) {
+							positions.push_back(center[i] + radius * corners[k][i]);
+							normal[i] += corners[k][i];
+						}
+					}
+					float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+					scene.Normals.insert(scene.Normals.end(), { normal[0] / length, normal[1] / length, normal[2] / length });
+					scene.Albedo.insert(scene.Albedo.end(), { albedo[0], albedo[1], albedo[2] });
+				}
+			}
+		}
+	}
+
+	// Bakes a volume over a field of spheres with 1, 2, 4, ... pool threads.
+	int IrradianceVolumeScaling(int, char**) {
+		ProbeScene scene;
+		std::vector<float> positions;
+		std::vector<uint32_t> indices;
+		const float albedo[3] = { 0.6f, 0.5f, 0.4f };
+		for (int z = 0; z < 8; z++) {
+			for (int x = 0; x < 8; x++) {
+				float center[3] = { x * 6.0f, 1.0f + (x + z) % 3, z * 6.0f };
+				AddSphere(scene, positions, indices, center, 1.5f, albedo, 16, 32);
+			}
+		}
+		scene.Geometry = TriangleBVH(positions, indices);
+
+		// A sky that is bright above and dark below.
+		CubeMapImage environment(32, 1);
+		for (uint32_t face = 0; face < 6; face++) {
+			float radiance = face == 2 ? 4.0f : face == 3 ? 0.1f : 1.0f;
+			float* texels = environment.Texels(face, 0);
+			for (uint32_t i = 0; i < 32 * 32; i++) {
+				texels[i * 4 + 0] = radiance;
+				texels[i * 4 + 1] = radiance;
+				texels[i * 4 + 2] = radiance * 1.2f;
+				texels[i * 4 + 3] = 1.0f;
+			}
+		}
+		SH9Color irradiance = RadianceToIrradianceSH9(ProjectCubeMapSH9(environment, 0));
+
+		IrradianceVolumeDesc desc;
+		scene.Geometry.Bounds(desc.Min, desc.Max);
+		for (int i = 0; i < 3; i++) {
+			desc.Min[i] -= 1.5f;
+			desc.Max[i] += 1.5f;
+			desc.Dim[i] = std::max((uint32_t)std::ceil((desc.Max[i] - desc.Min[i]) / 3.0f) + 1, 2u);
+		}
+		desc.RaysPerProbe = 256;
+		std::printf("Irradiance volume %ux%ux%u over %u triangles\n", desc.Dim[0], desc.Dim[1], desc.Dim[2],
+			scene.Geometry.TriangleCount());
+
+		uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+		for (uint32_t threads = 1; threads <= hardwareThreads; threads *= 2) {
+			TaskPool pool(threads);
+			IrradianceVolume volume(desc);
+			IrradianceBakeStats stats = volume.Bake(scene, environment, irradiance, pool);
+			std::printf("  %u threads: %.1f ms, %.2f Mrays/s\n", stats.Threads, stats.Seconds * 1000.0, stats.MRaysPerSecond);
+		}
+		return 0;
+	}
+
+	// Replays a feedback trace through the page cache at a few cache sizes: the file
+	// given, or a sweep over eight 8K textures.
+	int VirtualTextureReplay(int argc, char** argv) {
+		FeedbackTrace trace = argc > 0 ? LoadFeedbackTrace(argv[0]) : MakePanningTrace(8, 8192, 600, 320, 180, 128);
+		std::printf("Virtual texture replay of %zu frames over %zu textures\n", trace.Frames.size(), trace.TextureSizes.size() / 2);
+		for (uint32_t slots = 256; slots <= 4096; slots *= 4) {
+			VirtualTextureCacheDesc desc;
+			desc.Slots = slots;
+			VirtualTextureReplayStats replay = ReplayFeedbackTrace(trace, desc);
+			std::printf("  %4u slots: hit rate %.4f, %llu loads, %llu evictions, %llu starved, %.1f Mwords/s\n", slots,
+				replay.HitRate, (unsigned long long)replay.Cache.Loads, (unsigned long long)replay.Cache.Evictions,
+				(unsigned long long)replay.Cache.Starved, replay.MWordsPerSecond);
+		}
+		return 0;
+	}
+
+	// Streams the textures of a grid of spheres like the renderer's along an orbit
+	// that moves in and out, under a few budgets.
+	int MipStreamingBudgets(int, char**) {
+		MipStreamingScenario scenario;
+		// Ten materials of three 2048^2 BC7 textures, with 64x64 and below resident.
+		for (uint32_t t = 0; t < 30; t++) {
+			StreamedTextureDesc texture;
+			texture.Width = 2048;
+			texture.Height = 2048;
+			for (uint32_t size = 2048; size > 0; size /= 2) {
+				uint64_t blocks = std::max(size / 4, 1u);
+				texture.MipBytes.push_back(blocks * blocks * 16);
+			}
+			texture.TailMips = 7;
+			scenario.Textures.push_back(texture);
+		}
+		for (int row = 0; row < 10; row++) {
+			for (int col = 0; col < 10; col++) {
+				StreamingInstance instance;
+				instance.Center[0] = (col - 5) * 3.0f;
+				instance.Center[1] = (row - 5) * 3.0f;
+				instance.Center[2] = 0.0f;
+				instance.Radius = 1.0f;
+				instance.UVPerWorldUnit = 1.0f / (2.0f * kPi * instance.Radius);
+				for (uint32_t map = 0; map < 3; map++) {
+					instance.Texture = (uint32_t)(row * 3 + map);
+					scenario.Instances.push_back(instance);
+				}
+			}
+		}
+		const float center[3] = { 0.0f, 0.0f, 0.0f };
+		scenario.Path = MakeOrbitPath(center, 3.0f, 60.0f, 1200, 0.25f * kPi, 1280.0f, 720.0f);
+
+		std::printf("Mip streaming of %zu textures over %zu frames\n", scenario.Textures.size(), scenario.Path.size());
+		for (uint64_t budgetMB = 16; budgetMB <= 256; budgetMB *= 4) {
+			MipStreamingDesc desc;
+			desc.BudgetBytes = budgetMB << 20;
+			MipStreamingSimStats sim = SimulateMipStreaming(scenario, desc);
+			std::printf("  %3llu MB: peak %llu MB, %llu loads (%llu MB), %llu drops, %u frames over budget, "
+				"%.0f missing mip pixels per frame, %.2f ms\n", (unsigned long long)budgetMB,
+				(unsigned long long)(sim.Streaming.PeakBytes >> 20), (unsigned long long)sim.Streaming.Loads,
+				(unsigned long long)(sim.Streaming.LoadedBytes >> 20), (unsigned long long)sim.Streaming.Drops,
+				sim.FramesOverBudget, sim.MeanMissingMipPixels, sim.Seconds * 1000.0);
+		}
+		return 0;
+	}
+
+	// Resamples a synthetic 8192x4096 panorama into a cube of the given size with
+	// each filter.
+	int EquirectResampling(int argc, char** argv) {
+		uint32_t size = argc > 0 ? (uint32_t)std::max(std::atoi(argv[0]), 4) : 1024;
+		HDRImage panorama;
+		panorama.Width = 8192;
+		panorama.Height = 4096;
+		panorama.Pixels.resize((size_t)panorama.Width * panorama.Height * 3);
+		for (uint32_t y = 0; y < panorama.Height; y++) {
+			for (uint32_t x = 0; x < panorama.Width; x++) {
+				// A sky gradient with a bright sun and a band of windows.
+				float* rgb = &panorama.Pixels[((size_t)y * panorama.Width + x) * 3];
+				float sky = 1.0f - (float)y / panorama.Height;
+				int dx = (int)x - 2048, dy = (int)y - 1024;
+				bool sun = dx * dx + dy * dy < 64 * 64;
+				bool window = y > 1900 && y < 2100 && x % 512 < 128;
+				float light = sun ? 5000.0f : window ? 20.0f : 0.0f;
+				rgb[0] = 0.4f * sky + light;
+				rgb[1] = 0.6f * sky + light;
+				rgb[2] = 1.0f * sky + light;
+			}
+		}
+
+		std::printf("Equirect %ux%u -> %u^2 cube\n", panorama.Width, panorama.Height, size);
+		const struct {
+			const char* Name;
+			EquirectFilter Filter;
+		} filters[] = {
+			{ "bilinear", EquirectFilter::Bilinear },
+			{ "supersample 2x2", EquirectFilter::Supersample },
+		};
+		for (const auto& filter : filters) {
+			CubeMapImage cube(size, 0);
+			EquirectToCubeStats stats = EquirectToCube(panorama, cube, filter.Filter);
+			std::printf("  %-16s %.1f Mpixels/s resampling, %.1f ms with the mip chain\n", filter.Name,
+				stats.MPixelsPerSecond, stats.Seconds * 1000.0);
+		}
+		return 0;
+	}
+
+	// Samples a 512^2 float cube at 1M random directions and levels, one direction at
+	// a time and in batches of eight with AVX2.
+	int CubeSampler(int, char**) {
+		CubeMapImage cube(512, 0);
+		for (uint32_t face = 0; face < 6; face++) {
+			for (uint32_t mip = 0; mip < cube.MipLevels(); mip++) {
+				float* texels = cube.Texels(face, mip);
+				for (uint32_t i = 0; i < cube.MipSize(mip) * cube.MipSize(mip) * 4; i++) {
+					texels[i] = (float)((i * 7 + face) % 13);
+				}
+			}
+		}
+		CubeMapSampler sampler(cube);
+
+		const uint32_t count = 1u << 20;
+		std::vector<float> x(count), y(count), z(count), lod(count);
+		uint32_t noise = 1;
+		auto random = [&]() {
+			noise = noise * 1664525u + 1013904223u;
+			return (noise >> 8) / 16777216.0f;
+		};
+		for (uint32_t i = 0; i < count; i++) {
+			x[i] = 2.0f * random() - 1.0f;
+			y[i] = 2.0f * random() - 1.0f;
+			z[i] = 2.0f * random() - 1.0f;
+			lod[i] = 9.0f * random();
+		}
+
+		std::vector<float> scalar((size_t)count * 4);
+		std::vector<float> simd((size_t)count * 4);
+		auto start = std::chrono::steady_clock::now();
+		sampler.SampleLevelScalar(x.data(), y.data(), z.data(), lod.data(), count, scalar.data());
+		double scalarSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		start = std::chrono::steady_clock::now();
+		sampler.SampleLevel(x.data(), y.data(), z.data(), lod.data(), count, simd.data());
+		double simdSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		float difference = 0.0f;
+		for (size_t i = 0; i < scalar.size(); i++) {
+			difference = std::max(difference, std::fabs(scalar[i] - simd[i]));
+		}
+
+		std::printf("Cube sampling of %u trilinear taps from a 512^2 cube\n", count);
+		std::printf("  scalar %.1f Msamples/s", count / (scalarSeconds * 1e6));
+		if (CpuHasAVX2()) {
+			std::printf(", AVX2 %.1f Msamples/s (%.2fx), max difference %g\n", count / (simdSeconds * 1e6),
+				scalarSeconds / simdSeconds, difference);
+		}
+		else {
+			std::printf(", AVX2 unsupported\n");
+		}
+		return 0;
+	}
+
+	// Generates the full mip chain of a float cube of the given size, 2048^2 by
+	// default, with each filter.
+	int CubeMips(int argc, char** argv) {
+		uint32_t size = argc > 0 ? (uint32_t)std::max(std::atoi(argv[0]), 1) : 2048;
+		CubeMapImage source(size, 0);
+		for (uint32_t face = 0; face < 6; face++) {
+			float* texels = source.Texels(face, 0);
+			for (uint32_t y = 0; y < size; y++) {
+				for (uint32_t x = 0; x < size; x++) {
+					float* texel = texels + ((size_t)y * size + x) * 4;
+					texel[0] = 1.0f + std::sin(0.01f * x);
+					texel[1] = 1.0f + std::cos(0.013f * y);
+					texel[2] = (x / 64 + y / 64 + face) % 2 ? 20.0f : 0.5f;
+					texel[3] = 1.0f;
+				}
+			}
+		}
+
+		std::printf("Cube mips of a %u^2 RGBA32F cube, %u threads\n", size, TaskPool::Default().ThreadCount());
+		const struct {
+			const char* Name;
+			CubeMipFilter Filter;
+		} filters[] = {
+			{ "box", CubeMipFilter::Box },
+			{ "Kaiser", CubeMipFilter::Kaiser },
+			{ "Lanczos", CubeMipFilter::Lanczos },
+		};
+		for (const auto& filter : filters) {
+			CubeMapImage cube = source;
+			CubeMipStats stats = GenerateCubeMips(cube, filter.Filter);
+			std::printf("  %-8s %.1f ms, %.1f Mtexels/s\n", filter.Name, stats.Seconds * 1000.0, stats.MPixelsPerSecond);
+		}
+		CubeMapImage perFace = source;
+		auto start = std::chrono::steady_clock::now();
+		perFace.GenerateMips();
+		std::printf("  %-8s %.1f ms on one thread\n", "per-face",
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		return 0;
+	}
+
+	// Encodes a synthetic environment cube of the given size, 512^2 by default as in
+	// the renderer, to BC6H with each quality: encode time against PSNR of the top
+	// level after x / (1 + x) tone mapping.
+	int BC6HEncoding(int argc, char** argv) {
+		uint32_t size = argc > 0 ? (uint32_t)std::max(std::atoi(argv[0]), 4) : 512;
+		CubeMapImage cube(size, 0);
+		for (uint32_t face = 0; face < 6; face++) {
+			float* texels = cube.Texels(face, 0);
+			for (uint32_t y = 0; y < size; y++) {
+				for (uint32_t x = 0; x < size; x++) {
+					// A sky gradient over a dim floor, a bright sun and a band of windows.
+					float dir[3];
+					CubeFaceDirection(face, (x + 0.5f) / size, (y + 0.5f) / size, dir);
+					float length = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+					float up = dir[1] / length;
+					float sun = (0.5f * dir[0] + 0.7f * dir[1] + 0.5f * dir[2]) / length;
+					float longitude = std::atan2(dir[2], dir[0]);
+					bool window = std::fabs(up) < 0.15f && std::fmod(longitude + kPi, 0.8f) < 0.2f;
+					float light = sun > 0.999f ? 5000.0f : window ? 20.0f : 0.0f;
+					float sky = up > 0.0f ? 0.5f + up : 0.05f;
+					float* texel = texels + ((size_t)y * size + x) * 4;
+					texel[0] = 0.4f * sky + light;
+					texel[1] = 0.6f * sky + light;
+					texel[2] = 1.0f * sky + light;
+					texel[3] = 1.0f;
+				}
+			}
+		}
+		cube.GenerateMips();
+
+		std::printf("BC6H of a %u^2 cube with mips, %u threads\n", size, TaskPool::Default().ThreadCount());
+		const struct {
+			const char* Name;
+			BC6HQuality Quality;
+		} qualities[] = {
+			{ "fast", BC6HQuality::Fast },
+			{ "quality", BC6HQuality::Quality },
+		};
+		for (const auto& quality : qualities) {
+			CompressedTexture encoded;
+			BC6HStats stats = EncodeCubeMapBC6H(cube, BC6HFormat::Unsigned, quality.Quality, encoded);
+
+			double sumSq = 0.0;
+			for (uint32_t face = 0; face < 6; face++) {
+				const float* texels = cube.Texels(face, 0);
+				for (uint32_t by = 0; by < encoded.BlocksHigh(0); by++) {
+					for (uint32_t bx = 0; bx < encoded.BlocksWide(0); bx++) {
+						float decoded[16][4];
+						DecodeBC6HBlock(encoded.Blocks(face, 0) + (by * encoded.BlocksWide(0) + bx) * 16,
+							BC6HFormat::Unsigned, decoded);
+						for (uint32_t t = 0; t < 16; t++) {
+							uint32_t x = bx * 4 + t % 4;
+							uint32_t y = by * 4 + t / 4;
+							if (x >= size || y >= size) {
+								continue;
+							}
+							const float* texel = texels + ((size_t)y * size + x) * 4;
+							for (int c = 0; c < 3; c++) {
+								double error = decoded[t][c] / (1.0 + decoded[t][c]) - texel[c] / (1.0 + texel[c]);
+								sumSq += error * error;
+							}
+						}
+					}
+				}
+			}
+			double mse = sumSq / (6.0 * size * size * 3);
+			std::printf("  %-8s %.1f ms, %.1f Mtexels/s, %.2f dB\n", quality.Name, stats.Seconds * 1000.0,
+				stats.MPixelsPerSecond, 10.0 * std::log10(1.0 / std::max(mse, 1e-20)));
+		}
+		return 0;
+	}
+
+	// Encodes a synthetic size x size texture with its mips, 1024^2 by default, to
+	// every BC format with each quality: throughput and PSNR of the top level.
+	int BCEncoding(int argc, char** argv) {
+		uint32_t size = argc > 0 ? (uint32_t)std::max(std::atoi(argv[0]), 1) : 1024;
+		SourceImage image;
+		image.Width = size;
+		image.Height = size;
+		uint32_t noise = 1;
+		for (uint32_t y = 0; y < size; y++) {
+			for (uint32_t x = 0; x < size; x++) {
+				noise = noise * 1664525u + 1013904223u;
+				// Smooth gradients and bands with a little grain, and a soft alpha edge.
+				uint8_t grain = (uint8_t)(noise >> 29);
+				image.Pixels.insert(image.Pixels.end(), { (uint8_t)(x * 255 / size + grain),
+					(uint8_t)(128 + 100 * std::sin(0.02f * y) + grain), (uint8_t)(((x / 64 + y / 64) % 2) * 160 + grain),
+					(uint8_t)(255 - std::min(255u, std::max(x, y) * 255 / size)) });
+			}
+		}
+		MipGenSettings settings;
+		settings.Usage = TextureUsage::Linear;
+		CompressedTexture rgba8 = GenerateMips(image, settings);
+
+		std::printf("BC encoding of a %u^2 texture with mips, %u threads\n", size, TaskPool::Default().ThreadCount());
+		const char* const names[] = { "BC1", "BC4", "BC5", "BC7" };
+		for (BCFormat format : { BCFormat::BC1, BCFormat::BC4, BCFormat::BC5, BCFormat::BC7 }) {
+			for (BCQuality quality : { BCQuality::Fast, BCQuality::Quality }) {
+				CompressedTexture encoded;
+				BCStats stats = EncodeTextureBC(rgba8, format, quality, encoded);
+				std::printf("  %s %-8s %.1f ms, %.1f Mpixels/s, %.2f dB\n", names[(int)format],
+					quality == BCQuality::Fast ? "fast" : "quality", stats.Seconds * 1000.0, stats.MPixelsPerSecond,
+					MeasureBCPsnr(rgba8, encoded, format));
+			}
+		}
+		return 0;
+	}
+
+	// Culls 10K to 1M random objects with the scalar and the AVX2 code.
+	int FrustumCullingRates(int, char**) {
+		FrustumCullBenchmark bench = BenchmarkFrustumCulling({ 10000, 100000, 1000000 });
+		for (const FrustumCullRates& rates : bench.Sizes) {
+			std::printf("Frustum culling %u objects (%u visible): scalar %.1f Mobjects/s", rates.Objects, rates.Visible,
+				rates.ScalarMObjectsPerSecond);
+			if (bench.Simd) {
+				std::printf(", AVX2 %.1f Mobjects/s%s", rates.SimdMObjectsPerSecond, rates.Match ? "" : ", visible lists differ");
+			}
+			std::printf("\n");
+		}
+		return 0;
+	}
+
+	// Builds, refits and queries BVHs over 100K and 1M moving objects.
+	int SceneBVHTimes(int, char**) {
+		for (uint32_t objects : { 100000u, 1000000u }) {
+			SceneBVHBenchmark bench = BenchmarkSceneBVH(objects);
+			std::printf("Scene BVH over %u objects (%u nodes): build %.1f ms, update %.2f ms/frame (%u rebuilds in %u frames, "
+				"cost %.2fx a fresh build)\n", bench.Objects, bench.Nodes, bench.BuildMs, bench.UpdateMs, bench.Rebuilds,
+				bench.Frames, bench.CostRatio);
+			std::printf("  frustum %.0f/s (%.0f objects) vs %.0f/s flat, sphere %.0f/s, box %.0f/s, ray %.0f/s\n",
+				bench.FrustumQueriesPerSecond, bench.FrustumObjects, bench.FlatCullsPerSecond, bench.SphereQueriesPerSecond,
+				bench.BoxQueriesPerSecond, bench.RaysPerSecond);
+		}
+		return 0;
+	}
+
+	// Selects probes for random points among 10K probes and schedules their rebakes
+	// along a camera path, as the renderer does every frame.
+	int ReflectionProbeTimes(int, char**) {
+		const uint32_t probeCount = 10000;
+		const float worldSize = 400.0f;
+		uint32_t noise = 1;
+		auto random = [&](float scale) {
+			noise = noise * 1664525u + 1013904223u;
+			return scale * (noise >> 8) / 16777216.0f;
+		};
+
+		ReflectionProbeSet probes(64);
+		for (uint32_t i = 0; i < probeCount; i++) {
+			float center[3] = { random(worldSize), random(worldSize), random(worldSize) };
+			ProbeBox box;
+			for (int k = 0; k < 3; k++) {
+				float half = 2.0f + random(18.0f);
+				box.Min[k] = center[k] - half;
+				box.Max[k] = center[k] + half;
+			}
+			probes.AddProbe(center, box, random(4.0f));
+		}
+		auto start = std::chrono::steady_clock::now();
+		probes.BuildSpatialIndex(16.0f);
+		double indexMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		// Rebakes along a path through the world, with a few objects moving each frame.
+		const uint32_t frames = 2000;
+		std::vector<uint32_t> scheduled;
+		uint32_t bakes = 0;
+		start = std::chrono::steady_clock::now();
+		for (uint32_t frame = 0; frame < frames; frame++) {
+			float t = (float)frame / frames;
+			float camera[3] = { worldSize * t, 0.5f * worldSize, 0.5f * worldSize * (1.0f + std::sin(2.0f * kPi * t)) };
+			for (int moved = 0; moved < 4; moved++) {
+				ProbeBox box;
+				for (int k = 0; k < 3; k++) {
+					box.Min[k] = camera[k] + random(40.0f) - 20.0f;
+					box.Max[k] = box.Min[k] + 2.0f;
+				}
+				probes.MarkDirtyInBox(box, 0.25f);
+			}
+			scheduled.clear();
+			probes.ScheduleRebakes(camera, 4, 10.0f, scheduled);
+			for (uint32_t probe : scheduled) {
+				probes.MarkBaked(probe);
+			}
+			bakes += (uint32_t)scheduled.size();
+		}
+		double scheduleSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		// Every probe baked, so that selection weighs them all.
+		for (uint32_t probe = 0; probe < probeCount; probe++) {
+			probes.MarkBaked(probe);
+		}
+		const uint32_t points = 1u << 20;
+		std::vector<float> positions((size_t)points * 3);
+		for (float& position : positions) {
+			position = random(worldSize);
+		}
+		uint32_t selected = 0;
+		start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < points; i++) {
+			selected += probes.Select(&positions[(size_t)i * 3]).Probe[0] != kNoProbe ? 1 : 0;
+		}
+		double selectSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::printf("Reflection probes: %u probes, spatial index in %.2f ms\n", probeCount, indexMs);
+		std::printf("  select: %.2f Mpoints/s, %.1f%% of points in a probe\n", points / (selectSeconds * 1e6),
+			100.0 * selected / points);
+		std::printf("  rebake scheduling: %.1f us/frame over %u frames, %u bakes into %u slices\n",
+			scheduleSeconds * 1e6 / frames, frames, bakes, probes.SliceCapacity());
+		return 0;
+	}
+
+	// Allocates and frees descriptor indices with 1, 2, 4, ... pool threads.
+	int DescriptorAllocatorScaling(int, char**) {
+		uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+		for (uint32_t threads = 1; threads <= hardwareThreads; threads *= 2) {
+			TaskPool pool(threads);
+			DescriptorAllocatorStats bench = BenchmarkDescriptorIndexAllocator(1u << 16, 1u << 22, pool);
+			std::printf("Descriptor allocator, %u threads: %llu ops in %.1f ms, %.1f Mops/s\n", bench.Threads,
+				(unsigned long long)bench.Operations, bench.Seconds * 1000.0, bench.MOpsPerSecond);
+		}
+		return 0;
+	}
+
+	// A size x size texture of each usage: noisy color with alpha, bumpy normals and
+	// the packed maps that take the normals' Toksvig roughness.
+	int MipGeneration(int argc, char** argv) {
+		uint32_t size = argc > 0 ? (uint32_t)std::max(std::atoi(argv[0]), 1) : 2048;
+		SourceImage color;
+		SourceImage normals;
+		SourceImage packed;
+		for (SourceImage* image : { &color, &normals, &packed }) {
+			image->Width = size;
+			image->Height = size;
+			image->Pixels.resize((size_t)size * size * 4);
+		}
+		uint32_t noise = 1;
+		for (uint32_t y = 0; y < size; y++) {
+			for (uint32_t x = 0; x < size; x++) {
+				noise = noise * 1664525u + 1013904223u;
+				size_t i = ((size_t)y * size + x) * 4;
+				uint8_t* c = &color.Pixels[i];
+				c[0] = (uint8_t)(x * 255 / size);
+				c[1] = (uint8_t)(y * 255 / size);
+				c[2] = (uint8_t)(noise >> 24);
+				c[3] = (uint8_t)(noise >> 16 & 0x80 ? 255 : 0);
+
+				float nx = 0.5f * std::sin(0.05f * x);
+				float ny = 0.5f * std::cos(0.07f * y);
+				float nz = std::sqrt(std::max(1.0f - nx * nx - ny * ny, 0.0f));
+				uint8_t* n = &normals.Pixels[i];
+				n[0] = (uint8_t)(127.5f * (nx + 1.0f));
+				n[1] = (uint8_t)(127.5f * (ny + 1.0f));
+				n[2] = (uint8_t)(127.5f * (nz + 1.0f));
+				n[3] = 255;
+
+				uint8_t* p = &packed.Pixels[i];
+				p[0] = 255;
+				p[1] = (uint8_t)(noise >> 8);
+				p[2] = (uint8_t)(x ^ y);
+				p[3] = 255;
+			}
+		}
+
+		MipGenSettings colorSettings;
+		colorSettings.AlphaWeighted = true;
+		MipGenSettings normalSettings;
+		normalSettings.Usage = TextureUsage::Normal;
+		MipGenSettings packedSettings;
+		packedSettings.Usage = TextureUsage::Packed;
+		packedSettings.ToksvigNormals = &normals;
+		const struct {
+			const char* Name;
+			const SourceImage& Image;
+			const MipGenSettings& Settings;
+		} textures[] = {
+			{ "color", color, colorSettings },
+			{ "normal", normals, normalSettings },
+			{ "packed + Toksvig", packed, packedSettings },
+		};
+
+		std::printf("Mip generation of %ux%u textures\n", size, size);
+		for (const auto& texture : textures) {
+			MipGenBenchmark bench = BenchmarkMipGeneration(texture.Image, texture.Settings, 4);
+			std::printf("  %-16s scalar %.1f Mpixels/s", texture.Name, bench.ScalarMPixelsPerSecond);
+			if (bench.Simd) {
+				std::printf(", AVX2 %.1f Mpixels/s, max difference %u\n", bench.SimdMPixelsPerSecond, bench.MaxDifference);
+			}
+			else {
+				std::printf(", AVX2 unsupported\n");
+			}
+		}
+		return 0;
+	}
+
+	// Reads the files given, or 64 synthetic 1 MB ones, loose and from a package of
+	// them, with cold and warm OS caches.
+	int AssetIO(int argc, char** argv) {
+		std::vector<std::string> files(argv, argv + argc);
+		std::vector<std::string> written;
+		if (files.empty()) {
+			std::vector<uint8_t> bytes(1u << 20);
+			uint32_t noise = 1;
+			for (uint32_t f = 0; f < 64; f++) {
+				for (uint8_t& byte : bytes) {
+					noise = noise * 1664525u + 1013904223u;
+					byte = (uint8_t)(noise >> 24);
+				}
+				written.push_back("asset-io-" + std::to_string(f) + ".bin");
+				std::ofstream(written.back(), std::ios::binary).write(reinterpret_cast<const char*>(bytes.data()),
+					(std::streamsize)bytes.size());
+			}
+			files = written;
+		}
+
+		const std::string packagePath = "asset-io.pak";
+		AssetPackageWriter writer;
+		for (const std::string& path : files) {
+			std::ifstream file(path, std::ios::binary | std::ios::ate);
+			if (!file) {
+				std::fprintf(stderr, "cannot open %s\n", path.c_str());
+				return 1;
+			}
+			std::vector<uint8_t> bytes((size_t)file.tellg());
+			file.seekg(0);
+			file.read(reinterpret_cast<char*>(bytes.data()), (std::streamsize)bytes.size());
+			writer.AddBlob(path, bytes.data(), bytes.size());
+		}
+		writer.Write(packagePath);
+
+		AssetIOStats io = BenchmarkAssetIO(files, packagePath);
+		std::printf("Asset I/O of %.1f MB in %u files%s\n", io.Bytes / (1024.0 * 1024.0), io.Files,
+			io.ColdValid ? "" : " (cold runs not evicted)");
+		std::printf("  loose:   cold %.1f ms, warm %.1f ms\n", io.LooseColdSeconds * 1000.0, io.LooseWarmSeconds * 1000.0);
+		std::printf("  package: cold %.1f ms, warm %.1f ms\n", io.PackageColdSeconds * 1000.0,
+			io.PackageWarmSeconds * 1000.0);
+
+		std::remove(packagePath.c_str());
+		for (const std::string& path : written) {
+			std::remove(path.c_str());
+		}
+		return 0;
+	}
+
+	// Converts random HDR texels to and from each compact format, scalar and AVX2.
+	int HDRPacking(int argc, char** argv) {
+		size_t texels = argc > 0 ? (size_t)std::max(std::atoi(argv[0]), 8) : 1u << 20;
+		HDRPackBenchmark bench = BenchmarkHDRPacking(texels);
+		std::printf("HDR packing of %zu texels, GB/s of RGBA32F\n", texels);
+		for (const HDRPackRates& rates : bench.Formats) {
+			std::printf("  %-20s scalar pack %6.2f, unpack %6.2f", rates.Format, rates.ScalarPackGBps, rates.ScalarUnpackGBps);
+			if (bench.Simd) {
+				std::printf("; AVX2 pack %6.2f, unpack %6.2f\n", rates.SimdPackGBps, rates.SimdUnpackGBps);
+			}
+			else {
+				std::printf("; AVX2 unsupported\n");
+			}
+		}
+		return 0;
+	}
+
+	// Stores textures with every package codec: the entries of the package given, or
+	// BC1 and BC7 encodings of a synthetic 1024^2 texture, plain and after the
+	// rate-distortion pass.
+	int PackageCodecs(int argc, char** argv) {
+		std::string packagePath = argc > 0 ? argv[0] : "package-codecs.pak";
+		if (argc == 0) {
+			const uint32_t size = 1024;
+			SourceImage image;
+			image.Width = size;
+			image.Height = size;
+			uint32_t noise = 1;
+			for (uint32_t y = 0; y < size; y++) {
+				for (uint32_t x = 0; x < size; x++) {
+					noise = noise * 1664525u + 1013904223u;
+					// Smooth gradients and bands with a little grain, as in material textures.
+					uint8_t grain = (uint8_t)(noise >> 29);
+					image.Pixels.insert(image.Pixels.end(), { (uint8_t)(x * 255 / size + grain),
+						(uint8_t)(128 + 100 * std::sin(0.02f * y) + grain), (uint8_t)(((x / 64 + y / 64) % 2) * 160 + grain), 255 });
+				}
+			}
+			MipGenSettings settings;
+			settings.Usage = TextureUsage::Linear;
+			CompressedTexture rgba8 = GenerateMips(image, settings);
+
+			AssetPackageWriter writer;
+			for (BCFormat format : { BCFormat::BC1, BCFormat::BC7 }) {
+				const char* name = format == BCFormat::BC1 ? "bc1" : "bc7";
+				CompressedTexture encoded;
+				EncodeTextureBC(rgba8, format, BCQuality::Fast, encoded);
+				writer.AddTexture(name, encoded);
+				OptimizeBCForCompression(rgba8, format, BCRdoSettings(), encoded);
+				writer.AddTexture(std::string(name) + "-rdo", encoded);
+			}
+			writer.Write(packagePath);
+		}
+
+		std::vector<PackageCodecStats> codecs;
+		{
+			AssetPackage package(packagePath);
+			std::vector<const AssetPackage*> packages;
+			std::vector<const AssetEntry*> entries;
+			for (const AssetEntry& entry : package.Entries()) {
+				packages.push_back(&package);
+				entries.push_back(&entry);
+			}
+			std::printf("Package codecs over %zu entries of %s\n", entries.size(), packagePath.c_str());
+			codecs = BenchmarkPackageCodecs(packages, entries);
+		}
+		for (const PackageCodecStats& codec : codecs) {
+			std::printf("  %-8s %llu -> %llu bytes (%.1f%%), encode %.1f ms, decode %.1f ms, %.2f GB/s\n",
+				PackageCodecName(codec.Codec), (unsigned long long)codec.Bytes, (unsigned long long)codec.StoredBytes,
+				codec.Bytes ? 100.0 * codec.StoredBytes / codec.Bytes : 100.0, codec.EncodeSeconds * 1000.0,
+				codec.DecodeSeconds * 1000.0, codec.DecodeSeconds > 0.0 ? codec.Bytes / (codec.DecodeSeconds * 1e9) : 0.0);
+		}
+		if (argc == 0) {
+			std::remove(packagePath.c_str());
+		}
+		return 0;
+	}
+
+	struct Benchmark {
+		const char* Name;
+		const char* Description;
+		int (*Run)(int argc, char** argv);
+	};
+
+	const Benchmark kBenchmarks[] = {
+		{ "irradiance-volume", "bake an irradiance volume with 1, 2, 4, ... threads", IrradianceVolumeScaling },
+		{ "vt-replay", "[trace] replay virtual texture feedback at a few cache sizes", VirtualTextureReplay },
+		{ "descriptor-allocator", "allocate and free descriptor indices with 1, 2, 4, ... threads", DescriptorAllocatorScaling },
+		{ "hdr-packing", "[texels] convert HDR texels to and from FP16, R11G11B10 and RGB9E5, scalar and AVX2", HDRPacking },
+		{ "package-codecs", "[package] store BC textures with every package codec", PackageCodecs },
+		{ "mip-generation", "[size] generate the mips of a color, normal and packed texture, scalar and AVX2", MipGeneration },
+		{ "asset-io", "[files] read loose files and a package of them, cold and warm", AssetIO },
+		{ "equirect", "[size] resample an 8192x4096 panorama into a cube, bilinear and supersampled", EquirectResampling },
+		{ "reflection-probes", "select and schedule rebakes among 10K reflection probes", ReflectionProbeTimes },
+		{ "cube-sampler", "sample a float cube one direction at a time and eight at a time with AVX2", CubeSampler },
+		{ "cube-mips", "[size] generate the mips of a float cube with the box, Kaiser and Lanczos kernels", CubeMips },
+		{ "bc-encoder", "[size] encode a texture to BC1, BC4, BC5 and BC7 with each quality, speed and PSNR", BCEncoding },
+		{ "bc6h", "[size] encode an environment cube to BC6H with each quality, time against PSNR", BC6HEncoding },
+		{ "frustum-culling", "cull 10K to 1M random objects, scalar and AVX2", FrustumCullingRates },
+		{ "scene-bvh", "build, refit and query BVHs over 100K and 1M moving objects", SceneBVHTimes },
+		{ "mip-streaming", "stream the mips of a sphere grid along an orbit under a few budgets", MipStreamingBudgets },
+	};
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1) {
+		for (const Benchmark& benchmark : kBenchmarks) {
+			if (std::strcmp(argv[1], benchmark.Name) == 0) {
+				return benchmark.Run(argc - 2, argv + 2);
+			}
+		}
+		std::fprintf(stderr, "unknown benchmark %s\n", argv[1]);
+	}
+	std::fprintf(stderr, "usage: %s <benchmark> [arguments]\n", argc > 0 ? argv[0] : "PBRBenchmark");
+	for (const Benchmark& benchmark : kBenchmarks) {
+		std::fprintf(stderr, "  %-24s %s\n", benchmark.Name, benchmark.Description);
+	}
+	return argc > 1 ? 1 : 0;
+}
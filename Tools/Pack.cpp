@@ -0,0 +1,154 @@
+#include "AssetPackage.h"
+#include "DDSFile.h"
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Writes and inspects asset packages outside the renderer, for instance to build
+// one on a Linux machine or to check whether the renderer will rebuild its own.
+
+namespace {
+	std::vector<uint8_t> ReadFile(const std::string& path) {
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file) {
+			throw std::runtime_error("Cannot open " + path);
+		}
+		std::vector<uint8_t> bytes((size_t)file.tellg());
+		file.seekg(0);
+		if (!file.read(reinterpret_cast<char*>(bytes.data()), (std::streamsize)bytes.size())) {
+			throw std::runtime_error("Cannot read " + path);
+		}
+		return bytes;
+	}
+
+	bool ParseCodec(const char* name, PackageCodec& codec) {
+		for (PackageCodec candidate : { PackageCodec::None, PackageCodec::LZ, PackageCodec::Entropy }) {
+			if (std::strcmp(name, PackageCodecName(candidate)) == 0) {
+				codec = candidate;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// pack [--codec none|lz|entropy] <package> <name>=<file>...
+	// DDS files in a CompressedTexture format become textures in upload layout, as the
+	// renderer stores them; every other file is stored whole.  Each file is recorded
+	// as a source of the package.
+	int Pack(int argc, char** argv) {
+		PackageCodec codec = PackageCodec::Entropy;
+		if (argc >= 2 && std::strcmp(argv[0], "--codec") == 0) {
+			if (!ParseCodec(argv[1], codec)) {
+				std::fprintf(stderr, "unknown codec %s\n", argv[1]);
+				return 1;
+			}
+			argc -= 2;
+			argv += 2;
+		}
+		if (argc < 2) {
+			std::fprintf(stderr, "usage: pack [--codec none|lz|entropy] <package> <name>=<file>...\n");
+			return 1;
+		}
+		AssetPackageWriter writer;
+		for (int i = 1; i < argc; i++) {
+			const char* equals = std::strchr(argv[i], '=');
+			if (!equals || equals == argv[i] || equals[1] == '\0') {
+				std::fprintf(stderr, "expected <name>=<file>, got %s\n", argv[i]);
+				return 1;
+			}
+			std::string name(argv[i], (size_t)(equals - argv[i]));
+			std::string path(equals + 1);
+			std::vector<uint8_t> bytes = ReadFile(path);
+			CompressedTexture texture;
+			if (ReadDDS(bytes.data(), bytes.size(), texture)) {
+				writer.AddTexture(name, texture, codec);
+			}
+			else {
+				writer.AddBlob(name, bytes.data(), bytes.size(), 0, codec);
+			}
+			writer.AddSource(path);
+		}
+		AssetPackStats stats = writer.Write(argv[0]);
+		std::printf("%s: %u entries (%u shared), %llu bytes in a %llu byte file, %.1f ms\n", argv[0], stats.Entries,
+			stats.Shared, (unsigned long long)stats.Bytes, (unsigned long long)stats.FileBytes, stats.Seconds * 1000.0);
+		return 0;
+	}
+
+	// list <package>
+	int List(int argc, char** argv) {
+		if (argc != 1) {
+			std::fprintf(stderr, "usage: list <package>\n");
+			return 1;
+		}
+		AssetPackage package(argv[0]);
+		for (const AssetEntry& entry : package.Entries()) {
+			std::printf("%-32s %-7s %-7s %12llu -> %12llu bytes", entry.Name.c_str(),
+				entry.Kind == AssetKind::Texture ? "texture" : "blob", PackageCodecName(entry.Codec),
+				(unsigned long long)entry.Size, (unsigned long long)entry.StoredSize);
+			if (entry.Kind == AssetKind::Texture) {
+				std::printf("  %ux%u, %u mips, %u layers, format %u", entry.Texture.Width, entry.Texture.Height,
+					entry.Texture.MipLevels, entry.Texture.ArraySize, entry.Texture.DxgiFormat);
+			}
+			std::printf("\n");
+		}
+		for (const PackageSource& source : package.Sources()) {
+			std::printf("source %s, %llu bytes, %s\n", source.Path.c_str(), (unsigned long long)source.Size,
+				source.Hash.ToString().c_str());
+		}
+		return 0;
+	}
+
+	// stale <package>
+	// Lists the sources that changed since the package was written and fails when
+	// there are any, the check the renderer makes before it uses a package.
+	int Stale(int argc, char** argv) {
+		if (argc != 1) {
+			std::fprintf(stderr, "usage: stale <package>\n");
+			return 1;
+		}
+		AssetPackage package(argv[0]);
+		std::vector<std::string> stale = package.StaleSources();
+		for (const std::string& path : stale) {
+			std::printf("%s\n", path.c_str());
+		}
+		return stale.empty() ? 0 : 2;
+	}
+
+	struct Command {
+		const char* Name;
+		const char* Description;
+		int (*Run)(int argc, char** argv);
+	};
+
+	const Command kCommands[] = {
+		{ "pack", "[--codec none|lz|entropy] <package> <name>=<file>... write a package of the files", Pack },
+		{ "list", "<package> list the entries and sources of a package", List },
+		{ "stale", "<package> list the sources that changed; exits with 2 when there are any", Stale },
+	};
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1) {
+		for (const Command& command : kCommands) {
+			if (std::strcmp(argv[1], command.Name) == 0) {
+				try {
+					return command.Run(argc - 2, argv + 2);
+				}
+				catch (const std::exception& e) {
+					std::fprintf(stderr, "%s\n", e.what());
+					return 1;
+				}
+			}
+		}
+		std::fprintf(stderr, "unknown command %s\n", argv[1]);
+	}
+	std::fprintf(stderr, "usage: %s <command> [arguments]\n", argc > 0 ? argv[0] : "PBRPack");
+	for (const Command& command : kCommands) {
+		std::fprintf(stderr, "  %-6s %s\n", command.Name, command.Description);
+	}
+	return argc > 1 ? 1 : 0;
+}